@@ -0,0 +1,1248 @@
+//
+//  SPStoreBenchmark.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+// A headless benchmark of the native index behind SPSearchStore, for comparing runs and
+// catching regressions on any machine with a C compiler and pthreads. It generates a
+// synthetic corpus whose words follow a Zipf distribution, then measures indexing
+// throughput one document at a time, from several threads at once and in batches, the
+// refresh (flush) and compaction that follow, the latency of term, boolean, phrase, NEAR,
+// prefix, substring and similar document queries, the cost of the term requests behind allTerms,
+// documentsForTerm: and termsForDocument:, and peak memory. Results are written as JSON.
+// With --crawl the corpus is also written out as files and indexed through the ingest
+// pipeline, once from scratch and once more when nothing has changed. With --analysis
+// the corpus reads more like English, and is also batch indexed with and without stop
+// words, numbers and stemming to compare the size of the index and the indexing speed.
+// With --positions the indexes keep term positions, which phrase and NEAR queries check
+// rather than matching any document with both words. With --log the index is saved to a
+// file with a write-ahead log beside it, and saving a few changes by writing out the
+// whole index is compared with committing them to the log, alone and from every thread.
+
+// The vocabulary is made of pronounceable words, the nth word spelling n in syllables, so
+// every word is distinct and words share prefixes and substrings the way real ones do.
+// Runs with the same options and seed index exactly the same corpus. An English-like
+// corpus takes its most frequent words from the English stop words, as real text does,
+// makes one word in eight a number and spells the rest in four inflected forms each, so
+// that every stage of analysis has work to do.
+
+// Build and run from this directory with:
+//
+//	make
+//	./SPStoreBenchmark --documents 20000 --vocabulary 50000 > results.json
+//
+// ./SPStoreBenchmark --help lists the options.
+
+#include "SPIndex.h"
+#include "SPIngest.h"
+#include "SPSimilarity.h"
+#include "SPStatistics.h"
+#include "SPStopWords.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kSPBenchmarkMaximumThreads	64
+#define kSPBenchmarkFetchCount		100
+#define kSPBenchmarkSimilarLimit	10
+#define kSPBenchmarkSaveCount		50
+#define kSPBenchmarkCommitCount		2000
+
+typedef struct {
+	size_t documentCount;
+	size_t vocabularySize;
+	size_t documentLength;			// mean words per document
+	double zipfExponent;
+	size_t threadCount;
+	size_t queryCount;				// per kind of query
+	uint32_t seed;
+	const char *outputPath;
+	bool crawls;
+	bool analyzes;					// English-like corpus and the analysis comparison
+	bool positions;					// indexes keep term positions
+	bool logs;						// the write-ahead log comparison
+} SPBenchmarkOptions;
+
+typedef struct {
+	char **words;
+	size_t *wordLengths;
+	double *cumulative;				// Zipf distribution over the word ranks
+	char **texts;
+	size_t *textLengths;
+	char **uris;
+	size_t byteCount;
+	size_t tokenCount;
+} SPBenchmarkCorpus;
+
+typedef struct {
+	size_t count;
+	double mean;
+	double p50;
+	double p90;
+	double p99;
+	double maximum;
+	double meanResults;
+} SPBenchmarkLatency;
+
+typedef struct {
+	double seconds;
+	double refreshSeconds;
+	size_t indexBytes;
+	size_t termCount;
+	size_t postingCount;
+} SPBenchmarkAnalysis;
+
+typedef struct {
+	SPBenchmarkLatency write;		// saving the whole index after each change
+	SPBenchmarkLatency commit;		// committing only the change to the log
+	size_t concurrentCommits;		// every thread committing after each of its adds
+	double concurrentSeconds;
+	uint64_t logBytes;
+	double replaySeconds;			// opening the file and replaying its log
+} SPBenchmarkDurability;
+
+#pragma mark Utilities
+
+static uint32_t SPBenchmarkRandom(uint32_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static double SPBenchmarkUniform(uint32_t *state) {
+	return ( SPBenchmarkRandom(state) >> 8 ) / 16777216.0;
+}
+
+static double SPBenchmarkSeconds(uint64_t start) {
+	return ( SPStatisticsGetTime() - start ) / 1e9;
+}
+
+static uint64_t SPBenchmarkPeakResidentSize(void) {
+
+	struct rusage usage;
+
+	if ( getrusage(RUSAGE_SELF, &usage) != 0 )
+		return 0;
+
+#if defined(__APPLE__)
+	return (uint64_t)usage.ru_maxrss;
+#else
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+static int SPBenchmarkCompareDoubles(const void *a, const void *b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return ( x < y ? -1 : ( x > y ? 1 : 0 ) );
+}
+
+static SPBenchmarkLatency SPBenchmarkSummarize(double *milliseconds, size_t count, size_t resultCount) {
+
+	SPBenchmarkLatency latency;
+	double total = 0;
+	size_t i;
+
+	memset(&latency, 0, sizeof(SPBenchmarkLatency));
+	if ( count == 0 ) return latency;
+
+	qsort(milliseconds, count, sizeof(double), SPBenchmarkCompareDoubles);
+	for ( i = 0; i < count; i++ ) total += milliseconds[i];
+
+	latency.count = count;
+	latency.mean = total / count;
+	latency.p50 = milliseconds[(size_t)( 0.50 * ( count - 1 ) + 0.5 )];
+	latency.p90 = milliseconds[(size_t)( 0.90 * ( count - 1 ) + 0.5 )];
+	latency.p99 = milliseconds[(size_t)( 0.99 * ( count - 1 ) + 0.5 )];
+	latency.maximum = milliseconds[count - 1];
+	latency.meanResults = (double)resultCount / count;
+
+	return latency;
+}
+
+static void SPBenchmarkWriteLatency(FILE *file, const char *name, SPBenchmarkLatency latency, bool last) {
+	fprintf(file, "\t\t\"%s\": { \"count\": %zu, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, "
+			"\"p99_ms\": %.4f, \"max_ms\": %.4f, \"mean_results\": %.1f }%s\n", 
+			name, latency.count, latency.mean, latency.p50, latency.p90, latency.p99, latency.maximum, 
+			latency.meanResults, ( last ? "" : "," ));
+}
+
+#pragma mark -
+#pragma mark Corpus
+
+typedef struct {
+	char **words;
+	size_t count;
+	size_t capacity;
+} SPBenchmarkStopWords;
+
+static void SPBenchmarkAddStopWord(const char *word, size_t length, void *context) {
+	SPBenchmarkStopWords *stopWords = context;
+	if ( stopWords->count < stopWords->capacity ) stopWords->words[stopWords->count++] = strndup(word, length);
+}
+
+static void SPBenchmarkCreateVocabulary(SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options) {
+
+	static const char *consonants = "bcdfghjklmnprstvwz";
+	static const char *vowels = "aeiou";
+	static const char *inflections[] = { "", "s", "ing", "ed" };
+
+	SPBenchmarkStopWords stopWords = { NULL, 0, 0 };
+	double total = 0;
+	size_t i;
+
+	corpus->words = malloc(options->vocabularySize * sizeof(char*));
+	corpus->wordLengths = malloc(options->vocabularySize * sizeof(size_t));
+	corpus->cumulative = malloc(options->vocabularySize * sizeof(double));
+
+	if ( options->analyzes ) {
+		stopWords.words = malloc(options->vocabularySize * sizeof(char*));
+		stopWords.capacity = options->vocabularySize;
+		SPStopWordsEnumerate(kSPLanguageEnglish, SPBenchmarkAddStopWord, &stopWords);
+	}
+
+	for ( i = 0; i < options->vocabularySize; i++ ) {
+		char word[32];
+		size_t length = 0, n = ( options->analyzes ? i / 4 : i );
+
+		if ( i < stopWords.count ) {
+			corpus->words[i] = stopWords.words[i];
+			corpus->wordLengths[i] = strlen(stopWords.words[i]);
+			goto rank;
+		}
+
+		if ( options->analyzes && i % 8 == 0 ) {
+			length = (size_t)snprintf(word, sizeof(word), "%zu", i * 7);
+			corpus->words[i] = strdup(word);
+			corpus->wordLengths[i] = length;
+			goto rank;
+		}
+
+		// Spell n in base 90 syllables, at least two of them so that no word is too short
+		// to be indexed or to carry a substring
+
+		do {
+			word[length++] = consonants[( n % 90 ) / 5];
+			word[length++] = vowels[n % 5];
+			n /= 90;
+		} while ( n > 0 || length < 4 );
+
+		if ( options->analyzes ) {
+			strcpy(word + length, inflections[i % 4]);
+			length += strlen(inflections[i % 4]);
+		}
+
+		word[length] = '\0';
+		corpus->words[i] = strdup(word);
+		corpus->wordLengths[i] = length;
+
+	rank:
+		total += 1.0 / pow((double)( i + 1 ), options->zipfExponent);
+		corpus->cumulative[i] = total;
+	}
+
+	for ( i = 0; i < options->vocabularySize; i++ )
+		corpus->cumulative[i] /= total;
+
+	free(stopWords.words);
+}
+
+static size_t SPBenchmarkZipfRank(const SPBenchmarkCorpus *corpus, size_t vocabularySize, uint32_t *state) {
+
+	double draw = SPBenchmarkUniform(state);
+	size_t low = 0, high = vocabularySize - 1;
+
+	while ( low < high ) {
+		size_t middle = ( low + high ) / 2;
+		if ( corpus->cumulative[middle] < draw ) low = middle + 1;
+		else high = middle;
+	}
+
+	return low;
+}
+
+static void SPBenchmarkCreateCorpus(SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options) {
+
+	uint32_t state = options->seed;
+	size_t i, j;
+
+	memset(corpus, 0, sizeof(SPBenchmarkCorpus));
+	SPBenchmarkCreateVocabulary(corpus, options);
+
+	corpus->texts = malloc(options->documentCount * sizeof(char*));
+	corpus->textLengths = malloc(options->documentCount * sizeof(size_t));
+	corpus->uris = malloc(options->documentCount * sizeof(char*));
+
+	for ( i = 0; i < options->documentCount; i++ ) {
+
+		// Lengths are spread evenly from half to one and a half times the mean
+
+		size_t words = options->documentLength / 2 + SPBenchmarkRandom(&state) % ( options->documentLength + 1 );
+		size_t capacity = 16, length = 0;
+		char *text = malloc(capacity);
+		char uri[48];
+
+		for ( j = 0; j < words; j++ ) {
+			size_t rank = SPBenchmarkZipfRank(corpus, options->vocabularySize, &state);
+			size_t wordLength = corpus->wordLengths[rank];
+
+			if ( length + wordLength + 2 > capacity ) {
+				capacity = ( length + wordLength + 2 ) * 2;
+				text = realloc(text, capacity);
+			}
+
+			memcpy(text + length, corpus->words[rank], wordLength);
+			length += wordLength;
+			text[length++] = ' ';
+		}
+
+		text[length] = '\0';
+		snprintf(uri, sizeof(uri), "file:///corpus/%zu.txt", i);
+
+		corpus->texts[i] = text;
+		corpus->textLengths[i] = length;
+		corpus->uris[i] = strdup(uri);
+		corpus->byteCount += length;
+		corpus->tokenCount += words;
+	}
+}
+
+static void SPBenchmarkReleaseCorpus(SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options) {
+
+	size_t i;
+
+	for ( i = 0; i < options->vocabularySize; i++ ) free(corpus->words[i]);
+	for ( i = 0; i < options->documentCount; i++ ) {
+		free(corpus->texts[i]);
+		free(corpus->uris[i]);
+	}
+
+	free(corpus->words);
+	free(corpus->wordLengths);
+	free(corpus->cumulative);
+	free(corpus->texts);
+	free(corpus->textLengths);
+	free(corpus->uris);
+}
+
+#pragma mark -
+#pragma mark Indexing
+
+typedef struct {
+	const SPBenchmarkCorpus *corpus;
+	size_t documentCount;
+	size_t threadCount;
+	size_t thread;
+	SPIndexRef index;
+	SPDocumentBatchRef batch;
+} SPBenchmarkWorker;
+
+static void * SPBenchmarkAddWorker(void *argument) {
+
+	SPBenchmarkWorker *worker = argument;
+	size_t i;
+
+	for ( i = worker->thread; i < worker->documentCount; i += worker->threadCount )
+		SPIndexAddDocument(worker->index, worker->corpus->uris[i], worker->corpus->texts[i], worker->corpus->textLengths[i]);
+
+	return NULL;
+}
+
+static void * SPBenchmarkBatchWorker(void *argument) {
+
+	SPBenchmarkWorker *worker = argument;
+	size_t i;
+
+	for ( i = worker->thread; i < worker->documentCount; i += worker->threadCount )
+		SPDocumentBatchSetDocument(worker->batch, i, worker->corpus->uris[i], worker->corpus->texts[i], 
+				worker->corpus->textLengths[i]);
+
+	return NULL;
+}
+
+static void SPBenchmarkRunWorkers(void *(*function)(void*), const SPBenchmarkCorpus *corpus, size_t documentCount, 
+		size_t threadCount, SPIndexRef index, SPDocumentBatchRef batch) {
+
+	pthread_t threads[kSPBenchmarkMaximumThreads];
+	SPBenchmarkWorker workers[kSPBenchmarkMaximumThreads];
+	size_t t;
+
+	for ( t = 0; t < threadCount; t++ ) {
+		SPBenchmarkWorker worker = { corpus, documentCount, threadCount, t, index, batch };
+		workers[t] = worker;
+		pthread_create(&threads[t], NULL, function, &workers[t]);
+	}
+
+	for ( t = 0; t < threadCount; t++ )
+		pthread_join(threads[t], NULL);
+}
+
+static void SPBenchmarkGetIndexOptions(bool analyzes, bool positions, SPIndexOptions *outOptions) {
+
+	// Refreshes are left to the benchmark, so that adding and refreshing are timed apart
+
+	memset(outOptions, 0, sizeof(SPIndexOptions));
+	outOptions->minTermLength = 1;
+	outOptions->refreshInterval = 3600;
+	outOptions->indexesTrigrams = true;
+	outOptions->indexesPositions = positions;
+
+	if ( analyzes ) {
+		outOptions->stopWordLanguages = kSPLanguageEnglish;
+		outOptions->analysisFlags = kSPAnalysisExcludesNumbers | kSPAnalysisStemsTerms;
+	}
+}
+
+static SPIndexRef SPBenchmarkCreateIndex(bool analyzes, bool positions) {
+
+	SPIndexOptions options;
+
+	SPBenchmarkGetIndexOptions(analyzes, positions, &options);
+	return SPIndexCreate(&options);
+}
+
+static void SPBenchmarkWriteIndexing(FILE *file, const char *name, size_t threadCount, double seconds, 
+		double refreshSeconds, const SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options, bool last) {
+	fprintf(file, "\t\t\"%s\": { \"threads\": %zu, \"seconds\": %.4f, \"documents_per_second\": %.1f, "
+			"\"megabytes_per_second\": %.2f, \"refresh_seconds\": %.4f }%s\n", 
+			name, threadCount, seconds, options->documentCount / seconds, corpus->byteCount / seconds / 1048576.0, 
+			refreshSeconds, ( last ? "" : "," ));
+}
+
+static bool SPBenchmarkCountPostings(SPTermID term, const char *string, size_t length, size_t documentCount, void *context) {
+	SPBenchmarkAnalysis *analysis = context;
+	analysis->termCount++;
+	analysis->postingCount += documentCount;
+	return true;
+}
+
+static SPBenchmarkAnalysis SPBenchmarkMeasureAnalysis(const SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options, 
+		bool analyzes) {
+
+	// Batch indexes the corpus with or without analysis and measures the index it makes
+
+	SPBenchmarkAnalysis analysis;
+	SPIndexRef index = SPBenchmarkCreateIndex(analyzes, options->positions);
+	SPDocumentBatchRef batch;
+	uint64_t start;
+
+	memset(&analysis, 0, sizeof(SPBenchmarkAnalysis));
+
+	start = SPStatisticsGetTime();
+	batch = SPDocumentBatchCreate(index, options->documentCount);
+	SPBenchmarkRunWorkers(SPBenchmarkBatchWorker, corpus, options->documentCount, options->threadCount, NULL, batch);
+	SPIndexAddDocumentBatch(index, batch);
+	SPDocumentBatchRelease(batch);
+	analysis.seconds = SPBenchmarkSeconds(start);
+
+	start = SPStatisticsGetTime();
+	SPIndexRefresh(index);
+	analysis.refreshSeconds = SPBenchmarkSeconds(start);
+
+	analysis.indexBytes = SPIndexGetMemorySize(index);
+	SPIndexEnumerateTermsWithPrefix(index, "", 0, SPBenchmarkCountPostings, &analysis);
+
+	SPIndexRelease(index);
+	return analysis;
+}
+
+static void SPBenchmarkWriteAnalysis(FILE *file, const char *name, SPBenchmarkAnalysis analysis, 
+		const SPBenchmarkCorpus *corpus, bool last) {
+	fprintf(file, "\t\t\"%s\": { \"seconds\": %.4f, \"megabytes_per_second\": %.2f, \"refresh_seconds\": %.4f, "
+			"\"index_bytes\": %zu, \"terms\": %zu, \"postings\": %zu }%s\n", 
+			name, analysis.seconds, corpus->byteCount / analysis.seconds / 1048576.0, analysis.refreshSeconds, 
+			analysis.indexBytes, analysis.termCount, analysis.postingCount, ( last ? "" : "," ));
+}
+
+#pragma mark -
+#pragma mark Crawling
+
+typedef struct {
+	const SPIngestDocument *documents;
+	size_t count;
+	size_t threadCount;
+	size_t thread;
+	SPDocumentBatchRef batch;
+} SPBenchmarkCrawlWorker;
+
+typedef struct {
+	SPIndexRef index;
+	size_t threadCount;
+} SPBenchmarkCrawl;
+
+static void * SPBenchmarkCrawlBatchWorker(void *argument) {
+
+	SPBenchmarkCrawlWorker *worker = argument;
+	size_t i;
+
+	for ( i = worker->thread; i < worker->count; i += worker->threadCount )
+		SPDocumentBatchSetDocument(worker->batch, i, worker->documents[i].path, worker->documents[i].text, 
+				worker->documents[i].length);
+
+	return NULL;
+}
+
+static bool SPBenchmarkIndexCrawledDocuments(const SPIngestDocument *documents, size_t count, void *context) {
+
+	// Tokenizes each batch in parallel and adds it under one acquisition of the write lock,
+	// as the native backend does
+
+	SPBenchmarkCrawl *crawl = context;
+	SPDocumentBatchRef batch = SPDocumentBatchCreate(crawl->index, count);
+	pthread_t threads[kSPBenchmarkMaximumThreads];
+	SPBenchmarkCrawlWorker workers[kSPBenchmarkMaximumThreads];
+	size_t t;
+
+	if ( batch == NULL ) return false;
+
+	for ( t = 0; t < crawl->threadCount; t++ ) {
+		SPBenchmarkCrawlWorker worker = { documents, count, crawl->threadCount, t, batch };
+		workers[t] = worker;
+		pthread_create(&threads[t], NULL, SPBenchmarkCrawlBatchWorker, &workers[t]);
+	}
+
+	for ( t = 0; t < crawl->threadCount; t++ )
+		pthread_join(threads[t], NULL);
+
+	SPIndexAddDocumentBatch(crawl->index, batch);
+	SPDocumentBatchRelease(batch);
+	return true;
+}
+
+static bool SPBenchmarkWriteCorpusFiles(const SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options, char *directory) {
+
+	// A thousand files to a directory, as a crawl of a real tree would find them
+
+	size_t i;
+	char path[1024];
+
+	if ( mkdtemp(directory) == NULL ) return false;
+
+	for ( i = 0; i < options->documentCount; i++ ) {
+		FILE *file;
+
+		if ( i % 1000 == 0 ) {
+			snprintf(path, sizeof(path), "%s/%zu", directory, i / 1000);
+			if ( mkdir(path, 0755) != 0 ) return false;
+		}
+
+		snprintf(path, sizeof(path), "%s/%zu/%zu.txt", directory, i / 1000, i);
+		if ( (file = fopen(path, "w")) == NULL ) return false;
+		fwrite(corpus->texts[i], 1, corpus->textLengths[i], file);
+		fclose(file);
+	}
+
+	return true;
+}
+
+static void SPBenchmarkRemoveCorpusFiles(const SPBenchmarkOptions *options, const char *directory) {
+
+	size_t i;
+	char path[1024];
+
+	for ( i = 0; i < options->documentCount; i++ ) {
+		snprintf(path, sizeof(path), "%s/%zu/%zu.txt", directory, i / 1000, i);
+		unlink(path);
+	}
+	for ( i = 0; i < options->documentCount; i += 1000 ) {
+		snprintf(path, sizeof(path), "%s/%zu", directory, i / 1000);
+		rmdir(path);
+	}
+
+	rmdir(directory);
+}
+
+#pragma mark -
+#pragma mark Durability
+
+static void * SPBenchmarkCommitWorker(void *argument) {
+
+	SPBenchmarkWorker *worker = argument;
+	size_t i;
+
+	for ( i = worker->thread; i < worker->documentCount; i += worker->threadCount ) {
+		SPIndexAddDocument(worker->index, worker->corpus->uris[i], worker->corpus->texts[i], worker->corpus->textLengths[i]);
+		SPIndexCommit(worker->index);
+	}
+
+	return NULL;
+}
+
+static void SPBenchmarkReplaceDocuments(SPIndexRef index, const SPBenchmarkCorpus *corpus, size_t documentCount, 
+		size_t first, size_t count) {
+	size_t i;
+	for ( i = first; i < first + count; i++ )
+		SPIndexAddDocument(index, corpus->uris[i % documentCount], corpus->texts[i % documentCount], 
+				corpus->textLengths[i % documentCount]);
+}
+
+static bool SPBenchmarkMeasureDurability(const SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options, 
+		const char *directory, SPBenchmarkDurability *outDurability) {
+
+	// The corpus is saved once and then a few documents are replaced before every save,
+	// which either writes out the whole index or commits the replacements to the log. The
+	// buffered documents are refreshed before either is timed, so only saving is measured.
+
+	SPIndexOptions indexOptions;
+	SPIndexRef index = NULL;
+	SPDocumentBatchRef batch;
+	size_t i, changeCount = options->documentCount / 1000 + 1;
+	size_t commitCount = ( options->documentCount < kSPBenchmarkCommitCount ? options->documentCount : kSPBenchmarkCommitCount );
+	double writes[kSPBenchmarkSaveCount], commits[kSPBenchmarkSaveCount];
+	char path[1024], logPath[1024];
+	uint64_t start;
+	bool success = false;
+
+	snprintf(path, sizeof(path), "%s/index", directory);
+	snprintf(logPath, sizeof(logPath), "%s/index-log", directory);
+	SPBenchmarkGetIndexOptions(options->analyzes, options->positions, &indexOptions);
+
+	index = SPIndexCreate(&indexOptions);
+	batch = ( index == NULL ? NULL : SPDocumentBatchCreate(index, options->documentCount) );
+	if ( batch == NULL ) goto bail;
+
+	SPBenchmarkRunWorkers(SPBenchmarkBatchWorker, corpus, options->documentCount, options->threadCount, NULL, batch);
+	SPIndexAddDocumentBatch(index, batch);
+	SPDocumentBatchRelease(batch);
+
+	if ( !SPIndexWriteToFile(index, path) || !SPIndexOpenLog(index, logPath) ) goto bail;
+
+	for ( i = 0; i < kSPBenchmarkSaveCount; i++ ) {
+		SPBenchmarkReplaceDocuments(index, corpus, options->documentCount, 2 * i * changeCount, changeCount);
+		SPIndexRefresh(index);
+		start = SPStatisticsGetTime();
+		if ( !SPIndexWriteToFile(index, path) ) goto bail;
+		writes[i] = SPBenchmarkSeconds(start) * 1000.0;
+
+		SPBenchmarkReplaceDocuments(index, corpus, options->documentCount, ( 2 * i + 1 ) * changeCount, changeCount);
+		SPIndexRefresh(index);
+		start = SPStatisticsGetTime();
+		if ( !SPIndexCommit(index) ) goto bail;
+		commits[i] = SPBenchmarkSeconds(start) * 1000.0;
+	}
+
+	outDurability->write = SPBenchmarkSummarize(writes, kSPBenchmarkSaveCount, changeCount * kSPBenchmarkSaveCount);
+	outDurability->commit = SPBenchmarkSummarize(commits, kSPBenchmarkSaveCount, changeCount * kSPBenchmarkSaveCount);
+
+	// Group commit: the threads share the fsyncs of whichever of them commits first
+
+	start = SPStatisticsGetTime();
+	SPBenchmarkRunWorkers(SPBenchmarkCommitWorker, corpus, commitCount, options->threadCount, index, NULL);
+	outDurability->concurrentSeconds = SPBenchmarkSeconds(start);
+	outDurability->concurrentCommits = commitCount;
+	outDurability->logBytes = SPIndexGetLogLength(index);
+
+	SPIndexRelease(index);
+
+	// Everything committed since the last full write is replayed
+
+	start = SPStatisticsGetTime();
+	index = SPIndexCreateWithFile(path, &indexOptions);
+	if ( index == NULL || !SPIndexOpenLog(index, logPath) ) goto bail;
+	outDurability->replaySeconds = SPBenchmarkSeconds(start);
+
+	success = true;
+
+bail:
+
+	SPIndexRelease(index);
+	unlink(logPath);
+	unlink(path);
+	rmdir(directory);
+
+	return success;
+}
+
+#pragma mark -
+#pragma mark Queries
+
+typedef enum {
+	kSPBenchmarkQueryTerm = 0,
+	kSPBenchmarkQueryAnd,
+	kSPBenchmarkQueryOr,
+	kSPBenchmarkQueryNot,
+	kSPBenchmarkQueryPhrase,
+	kSPBenchmarkQueryNear,
+	kSPBenchmarkQueryPrefix,
+	kSPBenchmarkQuerySubstring,
+	kSPBenchmarkQueryKindCount
+} SPBenchmarkQueryKind;
+
+static const char *SPBenchmarkQueryNames[kSPBenchmarkQueryKindCount] = { 
+	"term", "boolean_and", "boolean_or", "boolean_not", "phrase", "near", "prefix", "substring" 
+};
+
+static size_t SPBenchmarkMakeQuery(char *query, size_t capacity, SPBenchmarkQueryKind kind, 
+		const SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options, uint32_t *state) {
+
+	// Query terms are drawn from the same distribution as the text, so popular terms are
+	// queried most, as they are in a search box. Phrases and NEARs are drawn the same way
+	// as ANDs, so their latencies show what checking positions adds to the intersection.
+
+	const char *first = corpus->words[SPBenchmarkZipfRank(corpus, options->vocabularySize, state)];
+	const char *second = corpus->words[SPBenchmarkZipfRank(corpus, options->vocabularySize, state)];
+	size_t firstLength = strlen(first);
+	int length = 0;
+
+	switch ( kind ) {
+	case kSPBenchmarkQueryTerm:
+		length = snprintf(query, capacity, "%s", first);
+		break;
+	case kSPBenchmarkQueryAnd:
+		length = snprintf(query, capacity, "%s AND %s", first, second);
+		break;
+	case kSPBenchmarkQueryOr:
+		length = snprintf(query, capacity, "%s OR %s", first, second);
+		break;
+	case kSPBenchmarkQueryNot:
+		length = snprintf(query, capacity, "%s NOT %s", first, second);
+		break;
+	case kSPBenchmarkQueryPhrase:
+		length = snprintf(query, capacity, "\"%s %s\"", first, second);
+		break;
+	case kSPBenchmarkQueryNear:
+		length = snprintf(query, capacity, "%s NEAR/5 %s", first, second);
+		break;
+	case kSPBenchmarkQueryPrefix:
+		length = snprintf(query, capacity, "%.3s*", first);
+		break;
+	case kSPBenchmarkQuerySubstring:
+		length = snprintf(query, capacity, "*%.3s*", first + ( firstLength > 4 ? 1 : 0 ));
+		break;
+	default:
+		break;
+	}
+
+	return (size_t)length;
+}
+
+static SPBenchmarkLatency SPBenchmarkMeasureQueries(SPIndexRef index, SPBenchmarkQueryKind kind, 
+		const SPBenchmarkCorpus *corpus, const SPBenchmarkOptions *options) {
+
+	// Each query is prepared and then fetched in chunks until it is exhausted, the way a
+	// search session is used
+
+	double *milliseconds = malloc(options->queryCount * sizeof(double));
+	SPDocumentID documents[kSPBenchmarkFetchCount];
+	float scores[kSPBenchmarkFetchCount];
+	uint32_t state = options->seed + 1 + (uint32_t)kind;
+	size_t i, resultCount = 0;
+	SPBenchmarkLatency latency;
+
+	for ( i = 0; i < options->queryCount; i++ ) {
+		char query[128];
+		size_t length = SPBenchmarkMakeQuery(query, sizeof(query), kind, corpus, options, &state);
+		uint64_t start = SPStatisticsGetTime();
+		SPSearchRef search = SPSearchCreate(index, query, length, kSPSearchOptionDefault);
+		size_t found = 0;
+
+		if ( search != NULL ) {
+			while ( SPSearchFindMatches(search, kSPBenchmarkFetchCount, documents, scores, &found) )
+				resultCount += found;
+			resultCount += found;
+			SPSearchRelease(search);
+		}
+
+		milliseconds[i] = SPBenchmarkSeconds(start) * 1000.0;
+	}
+
+	latency = SPBenchmarkSummarize(milliseconds, options->queryCount, resultCount);
+	free(milliseconds);
+	return latency;
+}
+
+static SPBenchmarkLatency SPBenchmarkMeasureSimilar(SPIndexRef index, const SPBenchmarkOptions *options) {
+
+	double *milliseconds = malloc(options->queryCount * sizeof(double));
+	SPDocumentID documents[kSPBenchmarkSimilarLimit];
+	SPDocumentID maximum = SPIndexGetMaximumDocumentID(index);
+	uint32_t state = options->seed + 101;
+	size_t i, resultCount = 0;
+	SPBenchmarkLatency latency;
+
+	for ( i = 0; i < options->queryCount; i++ ) {
+		SPDocumentID document = 1 + (SPDocumentID)( SPBenchmarkRandom(&state) % (uint32_t)maximum );
+		uint64_t start = SPStatisticsGetTime();
+
+		resultCount += SPIndexCopySimilarDocuments(index, document, NULL, kSPBenchmarkSimilarLimit, documents, NULL);
+		milliseconds[i] = SPBenchmarkSeconds(start) * 1000.0;
+	}
+
+	latency = SPBenchmarkSummarize(milliseconds, options->queryCount, resultCount);
+	free(milliseconds);
+	return latency;
+}
+
+#pragma mark -
+#pragma mark Terms
+
+static bool SPBenchmarkCountTerm(SPTermID term, const char *string, size_t length, size_t documentCount, void *context) {
+	(*(size_t*)context)++;
+	return true;
+}
+
+static SPBenchmarkLatency SPBenchmarkMeasureDocumentsForTerm(SPIndexRef index, const SPBenchmarkCorpus *corpus, 
+		const SPBenchmarkOptions *options) {
+
+	// documentsForTerm: looks the term up, copies its documents and resolves their URLs
+
+	double *milliseconds = malloc(options->queryCount * sizeof(double));
+	uint32_t state = options->seed + 201;
+	size_t i, j, resultCount = 0;
+	SPBenchmarkLatency latency;
+
+	for ( i = 0; i < options->queryCount; i++ ) {
+		const char *word = corpus->words[SPBenchmarkZipfRank(corpus, options->vocabularySize, &state)];
+		uint64_t start = SPStatisticsGetTime();
+		SPTermID term = SPIndexGetTermID(index, word, strlen(word));
+		SPDocumentID *documents = NULL;
+		size_t count = ( term == kSPIndexNotFound ? 0 : SPIndexCopyDocumentIDsForTerm(index, term, &documents) );
+
+		for ( j = 0; j < count; j++ ) {
+			char *uri = NULL;
+			if ( SPIndexCopyDocumentURI(index, documents[j], &uri) > 0 ) free(uri);
+		}
+
+		free(documents);
+		milliseconds[i] = SPBenchmarkSeconds(start) * 1000.0;
+		resultCount += count;
+	}
+
+	latency = SPBenchmarkSummarize(milliseconds, options->queryCount, resultCount);
+	free(milliseconds);
+	return latency;
+}
+
+static SPBenchmarkLatency SPBenchmarkMeasureTermsForDocument(SPIndexRef index, const SPBenchmarkOptions *options) {
+
+	// termsForDocument: copies the document's term IDs and resolves their strings
+
+	double *milliseconds = malloc(options->queryCount * sizeof(double));
+	SPDocumentID maximum = SPIndexGetMaximumDocumentID(index);
+	uint32_t state = options->seed + 301;
+	size_t i, j, resultCount = 0;
+	SPBenchmarkLatency latency;
+
+	for ( i = 0; i < options->queryCount; i++ ) {
+		SPDocumentID document = 1 + (SPDocumentID)( SPBenchmarkRandom(&state) % (uint32_t)maximum );
+		uint64_t start = SPStatisticsGetTime();
+		SPTermID *terms = NULL;
+		size_t count = SPIndexCopyTermIDsForDocument(index, document, &terms, NULL);
+
+		for ( j = 0; j < count; j++ ) {
+			char *string = NULL;
+			if ( SPIndexCopyTerm(index, terms[j], &string) > 0 ) free(string);
+		}
+
+		free(terms);
+		milliseconds[i] = SPBenchmarkSeconds(start) * 1000.0;
+		resultCount += count;
+	}
+
+	latency = SPBenchmarkSummarize(milliseconds, options->queryCount, resultCount);
+	free(milliseconds);
+	return latency;
+}
+
+#pragma mark -
+#pragma mark Options
+
+static void SPBenchmarkUsage(FILE *file) {
+	fprintf(file, 
+			"usage: SPStoreBenchmark [options]\n"
+			"  -d, --documents N     documents in the corpus (20000)\n"
+			"  -v, --vocabulary N    distinct words in the vocabulary (50000)\n"
+			"  -l, --length N        mean words per document (200)\n"
+			"  -z, --zipf S          exponent of the word distribution (1.0)\n"
+			"  -t, --threads N       threads for concurrent and batch indexing (processors, at most 8)\n"
+			"  -q, --queries N       queries measured of each kind (1000)\n"
+			"  -s, --seed N          corpus and query seed (2011)\n"
+			"  -o, --output PATH     write the JSON results to PATH instead of standard output\n"
+			"  -c, --crawl           also write the corpus to a temporary directory and crawl it\n"
+			"  -a, --analysis        make the corpus English-like and compare indexing it with and without\n"
+			"                        stop words, numbers and stemming\n"
+			"  -p, --positions       index term positions, for phrase and NEAR queries\n"
+			"  -w, --log             also compare saving the index whole with committing a write-ahead log\n");
+}
+
+static bool SPBenchmarkParseOptions(int argc, char *argv[], SPBenchmarkOptions *options) {
+
+	static const struct option longOptions[] = {
+		{ "documents", required_argument, NULL, 'd' },
+		{ "vocabulary", required_argument, NULL, 'v' },
+		{ "length", required_argument, NULL, 'l' },
+		{ "zipf", required_argument, NULL, 'z' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "queries", required_argument, NULL, 'q' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "crawl", no_argument, NULL, 'c' },
+		{ "analysis", no_argument, NULL, 'a' },
+		{ "positions", no_argument, NULL, 'p' },
+		{ "log", no_argument, NULL, 'w' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	int c;
+
+	options->documentCount = 20000;
+	options->vocabularySize = 50000;
+	options->documentLength = 200;
+	options->zipfExponent = 1.0;
+	options->threadCount = ( processors < 1 ? 1 : ( processors > 8 ? 8 : (size_t)processors ) );
+	options->queryCount = 1000;
+	options->seed = 2011;
+	options->outputPath = NULL;
+	options->crawls = false;
+	options->analyzes = false;
+	options->positions = false;
+	options->logs = false;
+
+	while ( ( c = getopt_long(argc, argv, "d:v:l:z:t:q:s:o:capwh", longOptions, NULL) ) != -1 ) {
+		switch ( c ) {
+		case 'd': options->documentCount = strtoul(optarg, NULL, 10); break;
+		case 'v': options->vocabularySize = strtoul(optarg, NULL, 10); break;
+		case 'l': options->documentLength = strtoul(optarg, NULL, 10); break;
+		case 'z': options->zipfExponent = strtod(optarg, NULL); break;
+		case 't': options->threadCount = strtoul(optarg, NULL, 10); break;
+		case 'q': options->queryCount = strtoul(optarg, NULL, 10); break;
+		case 's': options->seed = (uint32_t)strtoul(optarg, NULL, 10); break;
+		case 'o': options->outputPath = optarg; break;
+		case 'c': options->crawls = true; break;
+		case 'a': options->analyzes = true; break;
+		case 'p': options->positions = true; break;
+		case 'w': options->logs = true; break;
+		case 'h': SPBenchmarkUsage(stdout); exit(0);
+		default: return false;
+		}
+	}
+
+	if ( options->documentCount == 0 || options->vocabularySize == 0 || options->documentLength == 0 
+			|| options->queryCount == 0 || options->zipfExponent < 0 ) return false;
+
+	if ( options->threadCount < 1 ) options->threadCount = 1;
+	if ( options->threadCount > kSPBenchmarkMaximumThreads ) options->threadCount = kSPBenchmarkMaximumThreads;
+	if ( options->seed == 0 ) options->seed = 1;	// xorshift never leaves zero
+
+	return true;
+}
+
+#pragma mark -
+
+int main(int argc, char *argv[]) {
+
+	SPBenchmarkOptions options;
+	SPBenchmarkCorpus corpus;
+	SPBenchmarkLatency queries[kSPBenchmarkQueryKindCount];
+	SPBenchmarkLatency similar, documentsForTerm, termsForDocument;
+	SPDocumentBatchRef batch;
+	SPIndexRef index, concurrent, batched;
+	FILE *file = stdout;
+	double generateSeconds, singleSeconds, singleRefresh, concurrentSeconds, concurrentRefresh;
+	double batchSeconds, batchRefresh, allTermsSeconds, compactSeconds;
+	double crawlSeconds = 0, recrawlSeconds = 0;
+	SPIngestResult crawlResult, recrawlResult;
+	SPBenchmarkAnalysis plain, analyzed;
+	SPBenchmarkDurability durability;
+	size_t i, termCount = 0, removedCount = 0, segmentCount;
+	uint64_t start;
+
+	if ( !SPBenchmarkParseOptions(argc, argv, &options) ) {
+		SPBenchmarkUsage(stderr);
+		return 1;
+	}
+
+	if ( options.outputPath != NULL && ( file = fopen(options.outputPath, "w") ) == NULL ) {
+		perror(options.outputPath);
+		return 1;
+	}
+
+	fprintf(stderr, "generating %zu documents over %zu words...\n", options.documentCount, options.vocabularySize);
+	start = SPStatisticsGetTime();
+	SPBenchmarkCreateCorpus(&corpus, &options);
+	generateSeconds = SPBenchmarkSeconds(start);
+
+	// Indexing one document at a time, from several threads at once and in a batch which
+	// is tokenized in parallel and added under a single acquisition of the write lock
+
+	fprintf(stderr, "indexing...\n");
+
+	index = SPBenchmarkCreateIndex(false, options.positions);
+	start = SPStatisticsGetTime();
+	for ( i = 0; i < options.documentCount; i++ )
+		SPIndexAddDocument(index, corpus.uris[i], corpus.texts[i], corpus.textLengths[i]);
+	singleSeconds = SPBenchmarkSeconds(start);
+
+	start = SPStatisticsGetTime();
+	SPIndexRefresh(index);
+	singleRefresh = SPBenchmarkSeconds(start);
+
+	concurrent = SPBenchmarkCreateIndex(false, options.positions);
+	start = SPStatisticsGetTime();
+	SPBenchmarkRunWorkers(SPBenchmarkAddWorker, &corpus, options.documentCount, options.threadCount, concurrent, NULL);
+	concurrentSeconds = SPBenchmarkSeconds(start);
+
+	start = SPStatisticsGetTime();
+	SPIndexRefresh(concurrent);
+	concurrentRefresh = SPBenchmarkSeconds(start);
+	SPIndexRelease(concurrent);
+
+	batched = SPBenchmarkCreateIndex(false, options.positions);
+	start = SPStatisticsGetTime();
+	batch = SPDocumentBatchCreate(batched, options.documentCount);
+	SPBenchmarkRunWorkers(SPBenchmarkBatchWorker, &corpus, options.documentCount, options.threadCount, NULL, batch);
+	SPIndexAddDocumentBatch(batched, batch);
+	SPDocumentBatchRelease(batch);
+	batchSeconds = SPBenchmarkSeconds(start);
+
+	start = SPStatisticsGetTime();
+	SPIndexRefresh(batched);
+	batchRefresh = SPBenchmarkSeconds(start);
+	SPIndexRelease(batched);
+
+	// Crawling the corpus as files, and crawling it again once the catalog knows them all
+
+	memset(&crawlResult, 0, sizeof(SPIngestResult));
+	memset(&recrawlResult, 0, sizeof(SPIngestResult));
+
+	if ( options.crawls ) {
+
+		const char *temporary = getenv("TMPDIR");
+		char directory[512];
+		SPIngestCatalog *catalog = SPIngestCatalogCreate();
+		SPBenchmarkCrawl crawl = { SPBenchmarkCreateIndex(false, options.positions), options.threadCount };
+
+		fprintf(stderr, "crawling...\n");
+		snprintf(directory, sizeof(directory), "%s/SPStoreBenchmark.XXXXXX", ( temporary == NULL ? "/tmp" : temporary ));
+
+		if ( SPBenchmarkWriteCorpusFiles(&corpus, &options, directory) ) {
+			start = SPStatisticsGetTime();
+			SPIngestPath(directory, catalog, NULL, SPBenchmarkIndexCrawledDocuments, &crawl, &crawlResult);
+			SPIndexRefresh(crawl.index);
+			crawlSeconds = SPBenchmarkSeconds(start);
+
+			start = SPStatisticsGetTime();
+			SPIngestPath(directory, catalog, NULL, SPBenchmarkIndexCrawledDocuments, &crawl, &recrawlResult);
+			recrawlSeconds = SPBenchmarkSeconds(start);
+		}
+		else {
+			fprintf(stderr, "could not write the corpus to %s\n", directory);
+		}
+
+		SPBenchmarkRemoveCorpusFiles(&options, directory);
+		SPIngestCatalogRelease(catalog);
+		SPIndexRelease(crawl.index);
+	}
+
+	// The same batch with and without index time analysis
+
+	if ( options.analyzes ) {
+		fprintf(stderr, "analyzing...\n");
+		plain = SPBenchmarkMeasureAnalysis(&corpus, &options, false);
+		analyzed = SPBenchmarkMeasureAnalysis(&corpus, &options, true);
+	}
+
+	// Saving a few changes at a time, whole or through the write-ahead log
+
+	memset(&durability, 0, sizeof(SPBenchmarkDurability));
+
+	if ( options.logs ) {
+
+		const char *temporary = getenv("TMPDIR");
+		char directory[512];
+
+		fprintf(stderr, "saving...\n");
+		snprintf(directory, sizeof(directory), "%s/SPStoreBenchmark.XXXXXX", ( temporary == NULL ? "/tmp" : temporary ));
+
+		if ( mkdtemp(directory) == NULL || !SPBenchmarkMeasureDurability(&corpus, &options, directory, &durability) )
+			fprintf(stderr, "could not save the index to %s\n", directory);
+	}
+
+	// Queries and term requests against the single segment index
+
+	fprintf(stderr, "querying...\n");
+
+	for ( i = 0; i < kSPBenchmarkQueryKindCount; i++ )
+		queries[i] = SPBenchmarkMeasureQueries(index, (SPBenchmarkQueryKind)i, &corpus, &options);
+
+	similar = SPBenchmarkMeasureSimilar(index, &options);
+
+	start = SPStatisticsGetTime();
+	SPIndexEnumerateTermsWithPrefix(index, "", 0, SPBenchmarkCountTerm, &termCount);
+	allTermsSeconds = SPBenchmarkSeconds(start);
+
+	documentsForTerm = SPBenchmarkMeasureDocumentsForTerm(index, &corpus, &options);
+	termsForDocument = SPBenchmarkMeasureTermsForDocument(index, &options);
+
+	// Compaction after removing every tenth document and replacing every twentieth
+
+	fprintf(stderr, "compacting...\n");
+
+	for ( i = 0; i < options.documentCount; i += 10 ) {
+		SPIndexRemoveDocument(index, corpus.uris[i]);
+		removedCount++;
+	}
+	for ( i = 5; i < options.documentCount; i += 20 )
+		SPIndexAddDocument(index, corpus.uris[i], corpus.texts[i], corpus.textLengths[i]);
+
+	SPIndexRefresh(index);
+	segmentCount = SPIndexGetSegmentCount(index);
+
+	start = SPStatisticsGetTime();
+	SPIndexCompact(index);
+	compactSeconds = SPBenchmarkSeconds(start);
+
+	// Results
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"benchmark\": \"SPStoreBenchmark\",\n");
+	fprintf(file, "\t\"format\": 1,\n");
+
+	fprintf(file, "\t\"options\": { \"documents\": %zu, \"vocabulary\": %zu, \"length\": %zu, \"zipf\": %.3f, "
+			"\"threads\": %zu, \"queries\": %zu, \"seed\": %u, \"analysis\": %s, \"positions\": %s },\n", 
+			options.documentCount, options.vocabularySize, options.documentLength, options.zipfExponent, 
+			options.threadCount, options.queryCount, options.seed, ( options.analyzes ? "true" : "false" ), 
+			( options.positions ? "true" : "false" ));
+
+	fprintf(file, "\t\"corpus\": { \"bytes\": %zu, \"tokens\": %zu, \"terms\": %zu, \"generate_seconds\": %.4f },\n", 
+			corpus.byteCount, corpus.tokenCount, termCount, generateSeconds);
+
+	fprintf(file, "\t\"indexing\": {\n");
+	SPBenchmarkWriteIndexing(file, "single", 1, singleSeconds, singleRefresh, &corpus, &options, false);
+	SPBenchmarkWriteIndexing(file, "concurrent", options.threadCount, concurrentSeconds, concurrentRefresh, &corpus, &options, false);
+	SPBenchmarkWriteIndexing(file, "batch", options.threadCount, batchSeconds, batchRefresh, &corpus, &options, true);
+	fprintf(file, "\t},\n");
+
+	if ( options.crawls ) {
+		fprintf(file, "\t\"crawl\": { \"files\": %llu, \"documents\": %llu, \"failed\": %llu, \"seconds\": %.4f, "
+				"\"documents_per_second\": %.1f, \"megabytes_per_second\": %.2f, \"recrawl_unchanged\": %llu, "
+				"\"recrawl_seconds\": %.4f },\n", 
+				(unsigned long long)crawlResult.fileCount, (unsigned long long)crawlResult.documentCount, 
+				(unsigned long long)crawlResult.failedCount, crawlSeconds, 
+				( crawlSeconds > 0 ? crawlResult.documentCount / crawlSeconds : 0 ), 
+				( crawlSeconds > 0 ? crawlResult.byteCount / crawlSeconds / 1048576.0 : 0 ), 
+				(unsigned long long)recrawlResult.unchangedCount, recrawlSeconds);
+	}
+
+	if ( options.analyzes ) {
+		fprintf(file, "\t\"analysis\": {\n");
+		SPBenchmarkWriteAnalysis(file, "plain", plain, &corpus, false);
+		SPBenchmarkWriteAnalysis(file, "analyzed", analyzed, &corpus, false);
+		fprintf(file, "\t\t\"index_bytes_saved\": %.3f, \"postings_saved\": %.3f, \"speedup\": %.3f\n", 
+				1.0 - (double)analyzed.indexBytes / plain.indexBytes, 1.0 - (double)analyzed.postingCount / plain.postingCount, 
+				( plain.seconds + plain.refreshSeconds ) / ( analyzed.seconds + analyzed.refreshSeconds ));
+		fprintf(file, "\t},\n");
+	}
+
+	if ( options.logs ) {
+		fprintf(file, "\t\"durability\": {\n");
+		SPBenchmarkWriteLatency(file, "write_index", durability.write, false);
+		SPBenchmarkWriteLatency(file, "commit_log", durability.commit, false);
+		fprintf(file, "\t\t\"concurrent_commits\": { \"threads\": %zu, \"commits\": %zu, \"seconds\": %.4f, "
+				"\"commits_per_second\": %.1f },\n", 
+				options.threadCount, durability.concurrentCommits, durability.concurrentSeconds, 
+				( durability.concurrentSeconds > 0 ? durability.concurrentCommits / durability.concurrentSeconds : 0 ));
+		fprintf(file, "\t\t\"log_bytes\": %llu, \"replay_seconds\": %.4f\n", 
+				(unsigned long long)durability.logBytes, durability.replaySeconds);
+		fprintf(file, "\t},\n");
+	}
+
+	fprintf(file, "\t\"compaction\": { \"removed\": %zu, \"segments\": %zu, \"seconds\": %.4f },\n", 
+			removedCount, segmentCount, compactSeconds);
+
+	fprintf(file, "\t\"queries\": {\n");
+	for ( i = 0; i < kSPBenchmarkQueryKindCount; i++ )
+		SPBenchmarkWriteLatency(file, SPBenchmarkQueryNames[i], queries[i], false);
+	SPBenchmarkWriteLatency(file, "similar", similar, true);
+	fprintf(file, "\t},\n");
+
+	fprintf(file, "\t\"terms\": {\n");
+	fprintf(file, "\t\t\"all_terms\": { \"terms\": %zu, \"seconds\": %.4f },\n", termCount, allTermsSeconds);
+	SPBenchmarkWriteLatency(file, "documents_for_term", documentsForTerm, false);
+	SPBenchmarkWriteLatency(file, "terms_for_document", termsForDocument, true);
+	fprintf(file, "\t},\n");
+
+#if SPSEARCHSTORE_STATISTICS
+	{
+		// The index's own histograms, for lock contention and the refreshes and merges that
+		// ran in the background
+
+		SPHistogram histograms[kSPStatisticCount];
+		SPStatistic statistic;
+		bool first = true;
+
+		SPStatisticsCopySnapshot(histograms);
+		fprintf(file, "\t\"statistics\": {");
+
+		for ( statistic = 0; statistic < kSPStatisticCount; statistic++ ) {
+			const SPHistogram *histogram = &histograms[statistic];
+			double scale = ( SPStatisticIsTime(statistic) ? 1e-6 : 1.0 );
+
+			if ( histogram->count == 0 ) continue;
+
+			fprintf(file, "%s\n\t\t\"%s\": { \"count\": %llu, \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"unit\": \"%s\" }", 
+					( first ? "" : "," ), SPStatisticGetName(statistic), (unsigned long long)histogram->count, 
+					(double)histogram->total / histogram->count * scale, SPHistogramGetPercentile(histogram, 0.5) * scale, 
+					SPHistogramGetPercentile(histogram, 0.99) * scale, histogram->maximum * scale, 
+					( SPStatisticIsTime(statistic) ? "ms" : "count" ));
+			first = false;
+		}
+
+		fprintf(file, "\n\t},\n");
+	}
+#endif
+
+	fprintf(file, "\t\"memory\": { \"index_bytes\": %zu, \"peak_rss_bytes\": %llu }\n", 
+			SPIndexGetMemorySize(index), (unsigned long long)SPBenchmarkPeakResidentSize());
+	fprintf(file, "}\n");
+
+	if ( file != stdout ) fclose(file);
+
+	SPIndexRelease(index);
+	SPBenchmarkReleaseCorpus(&corpus, &options);
+
+	return 0;
+}
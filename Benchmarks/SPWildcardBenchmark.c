@@ -0,0 +1,189 @@
+//
+//  SPWildcardBenchmark.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+// Compares wildcard query latency with and without the trigram index. The corpus is
+// synthetic: documents draw words from a vocabulary of random pronounceable terms, with
+// a skewed distribution so that a few terms are common and most are rare, and some
+// documents are removed along the way so that the index holds dead terms too.
+
+// Build and run from this directory with:
+//
+//	cc -std=gnu99 -O2 -I.. -o wildcard SPWildcardBenchmark.c ../SP*.c -lm -lpthread
+//	./wildcard [vocabulary size] [document count]
+
+#include "SPIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define kSPBenchmarkWordsPerDocument	120
+#define kSPBenchmarkRepetitions			20
+
+static uint32_t SPBenchmarkRandom(uint32_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static double SPBenchmarkNow(void) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (double)now.tv_sec + (double)now.tv_usec / 1e6;
+}
+
+static char ** SPBenchmarkCreateVocabulary(size_t count, uint32_t *state) {
+
+	static const char *consonants = "bcdfghjklmnprstvwz";
+	static const char *vowels = "aeiou";
+	static const char *suffixes[] = { "", "", "", "ing", "tion", "ed", "er", "ly", "ness" };
+
+	char **words = malloc(count * sizeof(char*));
+	size_t i;
+
+	for ( i = 0; i < count; i++ ) {
+		char word[64];
+		size_t length = 0, syllables = 1 + SPBenchmarkRandom(state) % 4, j;
+
+		for ( j = 0; j < syllables; j++ ) {
+			word[length++] = consonants[SPBenchmarkRandom(state) % 18];
+			word[length++] = vowels[SPBenchmarkRandom(state) % 5];
+			if ( SPBenchmarkRandom(state) % 3 == 0 ) word[length++] = consonants[SPBenchmarkRandom(state) % 18];
+		}
+
+		strcpy(word + length, suffixes[SPBenchmarkRandom(state) % 9]);
+		words[i] = strdup(word);
+	}
+
+	return words;
+}
+
+static void SPBenchmarkFillIndex(SPIndexRef index, char **words, size_t wordCount, size_t documentCount) {
+
+	char *text = malloc(kSPBenchmarkWordsPerDocument * 64);
+	uint32_t state = 7;
+	size_t i, j;
+
+	for ( i = 0; i < documentCount; i++ ) {
+		char uri[32];
+		size_t length = 0;
+
+		for ( j = 0; j < kSPBenchmarkWordsPerDocument; j++ ) {
+			// The product of two uniform draws favors low ranks
+			size_t rank = (size_t)( (uint64_t)( SPBenchmarkRandom(&state) % wordCount ) * ( SPBenchmarkRandom(&state) % wordCount ) / wordCount );
+			length += sprintf(text + length, "%s ", words[rank]);
+		}
+
+		snprintf(uri, sizeof(uri), "doc:%zu", i);
+		SPIndexAddDocument(index, uri, text, length);
+
+		if ( i % 10 == 9 ) {
+			snprintf(uri, sizeof(uri), "doc:%zu", i - 5);
+			SPIndexRemoveDocument(index, uri);
+		}
+	}
+
+	SPIndexCompact(index);
+	free(text);
+}
+
+static double SPBenchmarkQuery(SPIndexRef index, const char *query, size_t *outCount) {
+
+	// Milliseconds per search, including the evaluation of every matching term
+
+	double start = SPBenchmarkNow();
+	int i;
+
+	for ( i = 0; i < kSPBenchmarkRepetitions; i++ ) {
+		SPSearchRef search = SPSearchCreate(index, query, strlen(query), kSPSearchOptionDefault);
+		*outCount = SPSearchGetResultCount(search);
+		SPSearchRelease(search);
+	}
+
+	return ( SPBenchmarkNow() - start ) * 1000.0 / kSPBenchmarkRepetitions;
+}
+
+int main(int argc, char *argv[]) {
+
+	static const char *queries[] = { "*ing", "*tion", "*ba*", "*zo*", "*kal*", "*tu*er", "ra*", "*ness*", "*ab*ly" };
+
+	size_t wordCount = ( argc > 1 ? strtoul(argv[1], NULL, 10) : 200000 );
+	size_t documentCount = ( argc > 2 ? strtoul(argv[2], NULL, 10) : 20000 );
+	uint32_t state = 2011;
+	char **words = SPBenchmarkCreateVocabulary(wordCount, &state);
+	SPIndexOptions options;
+	SPIndexRef scanned, indexed;
+	size_t i;
+
+	memset(&options, 0, sizeof(SPIndexOptions));
+	options.minTermLength = 1;
+	options.refreshInterval = 1.0;
+	options.maximumBufferedDocuments = 2000;
+
+	scanned = SPIndexCreate(&options);
+	options.indexesTrigrams = true;
+	indexed = SPIndexCreate(&options);
+
+	SPBenchmarkFillIndex(scanned, words, wordCount, documentCount);
+	SPBenchmarkFillIndex(indexed, words, wordCount, documentCount);
+
+	printf("%zu documents, %d terms\n", SPIndexGetDocumentCount(indexed), (int)SPIndexGetMaximumTermID(indexed));
+	printf("memory without trigrams %.1f MB, with %.1f MB\n\n", 
+			SPIndexGetMemorySize(scanned) / 1048576.0, SPIndexGetMemorySize(indexed) / 1048576.0);
+	printf("%-10s %10s %14s %14s %9s\n", "query", "matches", "scan (ms)", "trigram (ms)", "speedup");
+
+	for ( i = 0; i < sizeof(queries) / sizeof(queries[0]); i++ ) {
+		size_t scannedCount, indexedCount;
+		double scanTime = SPBenchmarkQuery(scanned, queries[i], &scannedCount);
+		double indexTime = SPBenchmarkQuery(indexed, queries[i], &indexedCount);
+
+		printf("%-10s %10zu %14.3f %14.3f %8.1fx%s\n", queries[i], indexedCount, scanTime, indexTime, 
+				scanTime / indexTime, ( scannedCount == indexedCount ? "" : "  MISMATCH" ));
+	}
+
+	SPIndexRelease(scanned);
+	SPIndexRelease(indexed);
+
+	for ( i = 0; i < wordCount; i++ ) free(words[i]);
+	free(words);
+
+	return 0;
+}
@@ -0,0 +1,451 @@
+//
+//  SPAnalysis.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPAnalysis.h"
+#include "SPStemmer.h"
+#include "SPStopWords.h"
+#include "SPStringTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool SPAnalyzedTextGrowSlots(SPAnalyzedText *text) {
+
+	size_t capacity = ( text->slotCapacity == 0 ? 256 : text->slotCapacity * 2 );
+	int32_t *slots = malloc(capacity * sizeof(int32_t));
+	size_t i;
+
+	if ( slots == NULL ) return false;
+	for ( i = 0; i < capacity; i++ ) slots[i] = -1;
+
+	for ( i = 0; i < text->count; i++ ) {
+		uint32_t hash = SPStringHash(text->buffer + text->offsets[i], text->lengths[i]);
+		size_t index = hash & ( capacity - 1 );
+		while ( slots[index] != -1 ) index = ( index + 1 ) & ( capacity - 1 );
+		slots[index] = (int32_t)i;
+	}
+
+	free(text->slots);
+	text->slots = slots;
+	text->slotCapacity = capacity;
+
+	return true;
+}
+
+static bool SPAnalyzedTextAddTerm(SPAnalyzedText *text, uint32_t maximumTerms, uint32_t offset, uint32_t length, 
+		uint32_t frequency, int32_t *outIndex) {
+
+	// outIndex receives the term's index, or -1 if it was ignored
+
+	const char *term = text->buffer + offset;
+	uint32_t hash = SPStringHash(term, length);
+	size_t index;
+
+	if ( ( text->count + 1 ) * 2 > text->slotCapacity && !SPAnalyzedTextGrowSlots(text) )
+		return false;
+
+	index = hash & ( text->slotCapacity - 1 );
+
+	while ( text->slots[index] != -1 ) {
+		int32_t existing = text->slots[index];
+		if ( text->lengths[existing] == length && memcmp(text->buffer + text->offsets[existing], term, length) == 0 ) {
+			text->frequencies[existing] += frequency;
+			text->tokenCount += frequency;
+			*outIndex = existing;
+			return true;
+		}
+		index = ( index + 1 ) & ( text->slotCapacity - 1 );
+	}
+
+	// A new distinct term. Respect kSKMaximumTerms by ignoring terms past the limit.
+
+	*outIndex = -1;
+
+	if ( maximumTerms != 0 && text->count >= maximumTerms )
+		return true;
+
+	if ( text->count == text->capacity ) {
+		size_t capacity = ( text->capacity == 0 ? 64 : text->capacity * 2 );
+		uint32_t *offsets = realloc(text->offsets, capacity * sizeof(uint32_t));
+		if ( offsets != NULL ) text->offsets = offsets;
+		uint32_t *lengths = realloc(text->lengths, capacity * sizeof(uint32_t));
+		if ( lengths != NULL ) text->lengths = lengths;
+		uint32_t *frequencies = realloc(text->frequencies, capacity * sizeof(uint32_t));
+		if ( frequencies != NULL ) text->frequencies = frequencies;
+
+		if ( offsets == NULL || lengths == NULL || frequencies == NULL ) return false;
+		text->capacity = capacity;
+	}
+
+	text->offsets[text->count] = offset;
+	text->lengths[text->count] = length;
+	text->frequencies[text->count] = frequency;
+	text->slots[index] = (int32_t)text->count;
+	*outIndex = (int32_t)text->count;
+	text->count++;
+	text->tokenCount += frequency;
+
+	return true;
+}
+
+static bool SPAnalyzedTextAddPosition(SPAnalyzedText *text, int32_t term) {
+
+	if ( text->positionCount == text->positionCapacity ) {
+		size_t capacity = ( text->positionCapacity == 0 ? 256 : text->positionCapacity * 2 );
+		int32_t *tokens = realloc(text->tokens, capacity * sizeof(int32_t));
+		if ( tokens == NULL ) return false;
+		text->tokens = tokens;
+		text->positionCapacity = capacity;
+	}
+
+	text->tokens[text->positionCount++] = term;
+	return true;
+}
+
+#pragma mark Tokenizer
+
+// The tokenizer folds the text and classifies its bytes sixteen at a time, giving a bit
+// mask of the term characters in each 64 byte chunk, and then finds the runs of set bits
+// with count trailing zeros rather than testing byte by byte. Bytes of 0x80 and above are
+// term characters, so multibyte UTF-8 characters stay in one term without being decoded;
+// the native backend has already folded them for case and diacritics.
+
+#define kSPAnalysisChunkLength 64
+
+#if defined(__SSE2__)
+
+#include <emmintrin.h>
+
+static inline uint64_t SPAnalysisFoldBlock(const char *text, char *buffer) {
+
+	// Signed compares leave bytes of 0x80 and above out of every range
+
+	__m128i c = _mm_loadu_si128((const __m128i*)text);
+	__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+	__m128i folded = _mm_add_epi8(c, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+	__m128i letter = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	__m128i high = _mm_cmplt_epi8(c, _mm_setzero_si128());
+
+	_mm_storeu_si128((__m128i*)buffer, folded);
+	return (uint64_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), high));
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static inline uint64_t SPAnalysisFoldBlock(const char *text, char *buffer) {
+
+	// Each lane is tested with a single unsigned compare of its distance from the start
+	// of the range. NEON has no movemask, so the lanes are weighted by bit and summed.
+
+	static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t c = vld1q_u8((const uint8_t*)text);
+	uint8x16_t upper = vcltq_u8(vsubq_u8(c, vdupq_n_u8('A')), vdupq_n_u8(26));
+	uint8x16_t folded = vaddq_u8(c, vandq_u8(upper, vdupq_n_u8('a' - 'A')));
+	uint8x16_t letter = vcltq_u8(vsubq_u8(folded, vdupq_n_u8('a')), vdupq_n_u8(26));
+	uint8x16_t digit = vcltq_u8(vsubq_u8(c, vdupq_n_u8('0')), vdupq_n_u8(10));
+	uint8x16_t high = vcgeq_u8(c, vdupq_n_u8(0x80));
+	uint8x16_t bits = vandq_u8(vorrq_u8(vorrq_u8(letter, digit), high), vld1q_u8(weights));
+
+	vst1q_u8((uint8_t*)buffer, folded);
+	return (uint64_t)vaddv_u8(vget_low_u8(bits)) | ( (uint64_t)vaddv_u8(vget_high_u8(bits)) << 8 );
+}
+
+#else
+
+static inline uint64_t SPAnalysisFoldBlock(const char *text, char *buffer) {
+
+	uint64_t mask = 0;
+	int i;
+
+	for ( i = 0; i < 16; i++ ) {
+		uint8_t c = (uint8_t)text[i];
+		buffer[i] = (char)SPFoldCharacter(c);
+		if ( SPIsTermCharacter(c) ) mask |= 1U << i;
+	}
+
+	return mask;
+}
+
+#endif
+
+static inline uint64_t SPAnalysisFoldChunk(const char *text, char *buffer) {
+	return SPAnalysisFoldBlock(text, buffer)
+			| ( SPAnalysisFoldBlock(text + 16, buffer + 16) << 16 )
+			| ( SPAnalysisFoldBlock(text + 32, buffer + 32) << 32 )
+			| ( SPAnalysisFoldBlock(text + 48, buffer + 48) << 48 );
+}
+
+static inline int SPAnalysisCountTrailingZeros(uint64_t bits) {
+	return __builtin_ctzll(bits);
+}
+
+#pragma mark -
+
+static inline bool SPAnalysisIsEnabled(const SPIndexOptions *options) {
+	return ( options->stopWordLanguages != 0 || options->analysisFlags != 0 );
+}
+
+size_t SPAnalyzeTerm(const SPIndexOptions *options, char *term, size_t length) {
+
+	if ( ( options->analysisFlags & kSPAnalysisExcludesNumbers ) && term[0] >= '0' && term[0] <= '9' )
+		return 0;
+	if ( options->stopWordLanguages != 0 && ( SPStopWordGetLanguages(term, length) & options->stopWordLanguages ) != 0 )
+		return 0;
+	if ( options->analysisFlags & kSPAnalysisStemsTerms )
+		length = SPStemTerm(term, length);
+
+	return length;
+}
+
+static bool SPAnalyzedTextAddToken(SPAnalyzedText *text, const SPIndexOptions *options, size_t start, size_t termLength) {
+
+	char *term = text->buffer + start;
+
+	if ( termLength < options->minTermLength ) return true;
+
+	// Only count characters when the byte length alone cannot settle it, that is for a
+	// longer minimum or a run that starts inside a character and may have none at all.
+
+	if ( options->minTermLength > 1 || ( (uint8_t)term[0] & 0xC0 ) == 0x80 ) {
+		uint32_t characters = 0;
+		size_t i;
+		for ( i = 0; i < termLength; i++ ) {
+			if ( ( (uint8_t)term[i] & 0xC0 ) != 0x80 ) characters++;
+		}
+		if ( characters < options->minTermLength ) return true;
+	}
+
+	if ( termLength > kSPIndexMaximumTermLength ) {
+		// truncate, backing off to a character boundary
+		termLength = kSPIndexMaximumTermLength;
+		while ( termLength > 0 && ( (uint8_t)term[termLength] & 0xC0 ) == 0x80 ) termLength--;
+		if ( termLength == 0 ) return true;
+	}
+
+	// With analysis the term limit waits until stop words have been dropped
+
+	int32_t index;
+
+	if ( !SPAnalyzedTextAddTerm(text, ( SPAnalysisIsEnabled(options) ? 0 : options->maximumTerms ), 
+			(uint32_t)start, (uint32_t)termLength, 1, &index) )
+		return false;
+
+	return ( !options->indexesPositions || SPAnalyzedTextAddPosition(text, index) );
+}
+
+static void SPAnalyzedTextAnalyze(SPAnalyzedText *text, const SPIndexOptions *options, int32_t *outMap) {
+
+	// Stop words, numbers and stems are settled once per distinct term rather than once
+	// per occurrence, and the terms that remain are compacted in place in the order they
+	// first appeared. Stemming can make two terms one, so with it the slots are rebuilt
+	// as the terms are kept and a term whose stem is already kept is merged into it.
+	// Without it the slots are left stale; nothing adds to the text afterwards. outMap,
+	// which may be NULL, receives the new index of each term or -1 if it was dropped.
+
+	bool merges = ( options->analysisFlags & kSPAnalysisStemsTerms ) != 0;
+	size_t i, count = 0;
+
+	text->tokenCount = 0;
+
+	if ( merges ) {
+		for ( i = 0; i < text->slotCapacity; i++ ) text->slots[i] = -1;
+	}
+
+	for ( i = 0; i < text->count; i++ ) {
+
+		uint32_t offset = text->offsets[i];
+		uint32_t frequency = text->frequencies[i];
+		uint32_t length = (uint32_t)SPAnalyzeTerm(options, text->buffer + offset, text->lengths[i]);
+		size_t index = 0;
+
+		if ( outMap != NULL ) outMap[i] = -1;
+		if ( length == 0 ) continue;
+
+		if ( merges ) {
+			const char *term = text->buffer + offset;
+			int32_t existing;
+
+			index = SPStringHash(term, length) & ( text->slotCapacity - 1 );
+			while ( ( existing = text->slots[index] ) != -1 ) {
+				if ( text->lengths[existing] == length && memcmp(text->buffer + text->offsets[existing], term, length) == 0 ) {
+					text->frequencies[existing] += frequency;
+					text->tokenCount += frequency;
+					if ( outMap != NULL ) outMap[i] = existing;
+					break;
+				}
+				index = ( index + 1 ) & ( text->slotCapacity - 1 );
+			}
+			if ( existing != -1 ) continue;
+		}
+
+		if ( options->maximumTerms != 0 && count >= options->maximumTerms )
+			continue;
+
+		if ( merges ) text->slots[index] = (int32_t)count;
+		if ( outMap != NULL ) outMap[i] = (int32_t)count;
+
+		text->offsets[count] = offset;
+		text->lengths[count] = length;
+		text->frequencies[count] = frequency;
+		text->tokenCount += frequency;
+		count++;
+	}
+
+	text->count = count;
+}
+
+static bool SPAnalyzedTextCollectPositions(SPAnalyzedText *text, const int32_t *map) {
+
+	// Counting sort of the token sequence by term. Each term's offset is advanced past
+	// its positions as they are placed, leaving it where the next term's begin, so the
+	// offsets are shifted up one afterwards. map translates the tokenizer's term indexes
+	// when analysis has since moved or dropped terms.
+
+	size_t i, total = 0;
+
+	text->positionOffsets = malloc(( text->count + 1 ) * sizeof(uint32_t));
+	text->positions = malloc(( text->tokenCount == 0 ? 1 : text->tokenCount ) * sizeof(uint32_t));
+	if ( text->positionOffsets == NULL || text->positions == NULL ) return false;
+
+	for ( i = 0; i < text->count; i++ ) {
+		text->positionOffsets[i] = (uint32_t)total;
+		total += text->frequencies[i];
+	}
+
+	for ( i = 0; i < text->positionCount; i++ ) {
+		int32_t term = text->tokens[i];
+		if ( term != -1 && map != NULL ) term = map[term];
+		if ( term != -1 ) text->positions[text->positionOffsets[term]++] = (uint32_t)i;
+	}
+
+	memmove(text->positionOffsets + 1, text->positionOffsets, text->count * sizeof(uint32_t));
+	text->positionOffsets[0] = 0;
+
+	free(text->tokens);
+	text->tokens = NULL;
+	text->positionCapacity = 0;
+
+	return true;
+}
+
+bool SPAnalyzeText(const SPIndexOptions *options, const char *text, size_t length, SPAnalyzedText *outText) {
+
+	// Terms are maximal runs of ASCII letters and digits or non-ASCII bytes. The buffer
+	// is padded to whole chunks; the last partial chunk is folded from a zeroed copy, and
+	// the zeros are not term characters.
+
+	size_t chunked = length & ~(size_t)( kSPAnalysisChunkLength - 1 );
+	size_t base, start = 0;
+	int32_t *map = NULL;
+	bool inTerm = false;
+
+	outText->buffer = malloc(chunked + kSPAnalysisChunkLength + 1);
+	if ( outText->buffer == NULL ) return false;
+
+	for ( base = 0; base < length; base += kSPAnalysisChunkLength ) {
+
+		uint64_t bits;
+		int position = 0;
+
+		if ( base < chunked ) {
+			bits = SPAnalysisFoldChunk(text + base, outText->buffer + base);
+		}
+		else {
+			char tail[kSPAnalysisChunkLength];
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, text + base, length - base);
+			bits = SPAnalysisFoldChunk(tail, outText->buffer + base);
+		}
+
+		while ( position < kSPAnalysisChunkLength ) {
+			if ( inTerm ) {
+				uint64_t rest = ~bits >> position;
+				if ( rest == 0 ) break;
+				position += SPAnalysisCountTrailingZeros(rest);
+				inTerm = false;
+				if ( !SPAnalyzedTextAddToken(outText, options, start, base + position - start) ) goto bail;
+			}
+			else {
+				uint64_t rest = bits >> position;
+				if ( rest == 0 ) break;
+				position += SPAnalysisCountTrailingZeros(rest);
+				inTerm = true;
+				start = base + position;
+			}
+		}
+	}
+
+	if ( inTerm && !SPAnalyzedTextAddToken(outText, options, start, length - start) )
+		goto bail;
+
+	if ( SPAnalysisIsEnabled(options) ) {
+		if ( options->indexesPositions ) {
+			map = malloc(( outText->count == 0 ? 1 : outText->count ) * sizeof(int32_t));
+			if ( map == NULL ) goto bail;
+		}
+		SPAnalyzedTextAnalyze(outText, options, map);
+	}
+
+	if ( options->indexesPositions && !SPAnalyzedTextCollectPositions(outText, map) )
+		goto bail;
+
+	free(map);
+	return true;
+
+bail:
+
+	free(map);
+	SPAnalyzedTextFree(outText);
+	return false;
+}
+
+void SPAnalyzedTextFree(SPAnalyzedText *text) {
+	free(text->buffer);
+	free(text->offsets);
+	free(text->lengths);
+	free(text->frequencies);
+	free(text->slots);
+	free(text->positions);
+	free(text->positionOffsets);
+	free(text->tokens);
+	memset(text, 0, sizeof(SPAnalyzedText));
+}
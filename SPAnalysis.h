@@ -0,0 +1,93 @@
+//
+//  SPAnalysis.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPANALYSIS_H
+#define SPANALYSIS_H
+
+#include "SPIndex.h"
+
+// Text analysis. A document is tokenized and its term frequencies counted without
+// touching the index, so that this work can be done without holding the write lock.
+
+#define kSPIndexMaximumTermLength 255
+
+typedef struct {
+	char *buffer;					// folded copy of the text, terms point into it
+	uint32_t *offsets;
+	uint32_t *lengths;
+	uint32_t *frequencies;
+	size_t count;					// distinct terms
+	size_t capacity;
+	size_t tokenCount;				// terms counting repeats
+	
+	int32_t *slots;					// open addressing table over the distinct terms
+	size_t slotCapacity;
+
+	uint32_t *positions;			// NULL unless indexesPositions, see below
+	uint32_t *positionOffsets;		// count + 1 offsets into positions
+	int32_t *tokens;				// term of each position while tokenizing, -1 for none
+	size_t positionCount;			// positions counted, including dropped terms
+	size_t positionCapacity;
+} SPAnalyzedText;
+
+	// When positions are indexed, the positions of term i run from positionOffsets[i] to
+	// positionOffsets[i+1] in ascending order, frequencies[i] of them. A position is the
+	// word's place in the text counting every term long enough to index, so stop words
+	// and terms past maximumTerms leave gaps. tokens is scratch space freed once the text
+	// has been analyzed.
+
+static inline bool SPIsTermCharacter(uint8_t c) {
+	return ( c >= 0x80 || ( c >= '0' && c <= '9' ) || ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) );
+}
+
+static inline uint8_t SPFoldCharacter(uint8_t c) {
+	return ( c >= 'A' && c <= 'Z' ? c + ( 'a' - 'A' ) : c );
+}
+
+bool SPAnalyzeText(const SPIndexOptions *options, const char *text, size_t length, SPAnalyzedText *outText);
+void SPAnalyzedTextFree(SPAnalyzedText *text);
+
+	// SPAnalyzeText fills in a zeroed SPAnalyzedText. Free it when done.
+
+size_t SPAnalyzeTerm(const SPIndexOptions *options, char *term, size_t length);
+
+	// The filters and stemming SPAnalyzeText applies to each folded term, for terms that
+	// are tokenized elsewhere. Returns the term's new length or 0 if it is not indexed.
+
+#endif
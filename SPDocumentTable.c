@@ -0,0 +1,210 @@
+//
+//  SPDocumentTable.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPDocumentTable.h"
+#include "SPStringTable.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// locations[document] is the arena offset and length of the document's URI. A length
+// of zero marks an ID with no URI, which is also how a removed document is left behind.
+
+typedef struct {
+	uint32_t offset;
+	uint32_t length;
+} SPDocumentLocation;
+
+struct SPDocumentTable {
+	pthread_rwlock_t lock;
+	SPStringTable *uris;
+	
+	SPDocumentLocation *locations;
+	size_t locationCapacity;
+};
+
+SPDocumentTable * SPDocumentTableCreate(size_t capacityHint) {
+	
+	SPDocumentTable *table = calloc(1, sizeof(SPDocumentTable));
+	if ( table == NULL ) return NULL;
+	
+	table->uris = SPStringTableCreate(capacityHint);
+	if ( table->uris == NULL ) {
+		free(table);
+		return NULL;
+	}
+	
+	pthread_rwlock_init(&table->lock, NULL);
+	return table;
+}
+
+void SPDocumentTableRelease(SPDocumentTable *table) {
+	if ( table == NULL ) return;
+	
+	pthread_rwlock_destroy(&table->lock);
+	SPStringTableRelease(table->uris);
+	free(table->locations);
+	free(table);
+}
+
+static bool SPDocumentTableReserve(SPDocumentTable *table, int32_t document) {
+	
+	size_t capacity = ( table->locationCapacity == 0 ? 256 : table->locationCapacity );
+	SPDocumentLocation *locations;
+	
+	if ( (size_t)document < table->locationCapacity ) return true;
+	while ( capacity <= (size_t)document ) capacity <<= 1;
+	
+	locations = realloc(table->locations, capacity * sizeof(SPDocumentLocation));
+	if ( locations == NULL ) return false;
+	
+	memset(locations + table->locationCapacity, 0, ( capacity - table->locationCapacity ) * sizeof(SPDocumentLocation));
+	table->locations = locations;
+	table->locationCapacity = capacity;
+	return true;
+}
+
+bool SPDocumentTableSetDocument(SPDocumentTable *table, const char *uri, size_t length, int32_t document) {
+	
+	int32_t existing;
+	uint32_t offset;
+	bool success = false;
+	
+	if ( document < 0 || length == 0 ) return false;
+	
+	pthread_rwlock_wrlock(&table->lock);
+	
+	if ( !SPDocumentTableReserve(table, document) ) goto bail;
+	
+	existing = SPStringTableGetValue(table->uris, uri, length);
+	if ( existing == document ) {
+		success = true;
+		goto bail;
+	}
+	
+	if ( !SPStringTableSetValue(table->uris, uri, length, document, &offset) ) goto bail;
+	
+	// Another URI still mapped to the ID is forgotten, so that the two directions always
+	// agree
+	
+	if ( table->locations[document].length != 0 ) {
+		SPDocumentLocation *previous = &table->locations[document];
+		SPStringTableRemoveValue(table->uris, SPStringTableGetString(table->uris, previous->offset), previous->length);
+	}
+	
+	if ( existing != kSPStringTableNotFound ) table->locations[existing].length = 0;
+	
+	table->locations[document].offset = offset;
+	table->locations[document].length = (uint32_t)length;
+	success = true;
+	
+bail:
+	pthread_rwlock_unlock(&table->lock);
+	return success;
+}
+
+bool SPDocumentTableRemoveDocument(SPDocumentTable *table, int32_t document) {
+	
+	bool found = false;
+	
+	pthread_rwlock_wrlock(&table->lock);
+	
+	if ( document >= 0 && (size_t)document < table->locationCapacity && table->locations[document].length != 0 ) {
+		SPDocumentLocation *location = &table->locations[document];
+		SPStringTableRemoveValue(table->uris, SPStringTableGetString(table->uris, location->offset), location->length);
+		location->length = 0;
+		found = true;
+	}
+	
+	pthread_rwlock_unlock(&table->lock);
+	return found;
+}
+
+int32_t SPDocumentTableGetDocument(SPDocumentTable *table, const char *uri, size_t length) {
+	
+	int32_t document;
+	
+	pthread_rwlock_rdlock(&table->lock);
+	document = SPStringTableGetValue(table->uris, uri, length);
+	pthread_rwlock_unlock(&table->lock);
+	
+	return ( document == kSPStringTableNotFound ? kSPDocumentTableNotFound : document );
+}
+
+size_t SPDocumentTableGetURI(SPDocumentTable *table, int32_t document, char *buffer, size_t capacity) {
+	
+	size_t length = 0;
+	
+	pthread_rwlock_rdlock(&table->lock);
+	
+	if ( document >= 0 && (size_t)document < table->locationCapacity ) {
+		SPDocumentLocation location = table->locations[document];
+		length = location.length;
+		
+		if ( length != 0 && length <= capacity ) 
+			memcpy(buffer, SPStringTableGetString(table->uris, location.offset), length);
+	}
+	
+	pthread_rwlock_unlock(&table->lock);
+	return length;
+}
+
+size_t SPDocumentTableGetCount(SPDocumentTable *table) {
+	
+	size_t count;
+	
+	pthread_rwlock_rdlock(&table->lock);
+	count = SPStringTableGetCount(table->uris);
+	pthread_rwlock_unlock(&table->lock);
+	
+	return count;
+}
+
+size_t SPDocumentTableGetMemorySize(SPDocumentTable *table) {
+	
+	size_t size;
+	
+	pthread_rwlock_rdlock(&table->lock);
+	size = sizeof(SPDocumentTable) + SPStringTableGetMemorySize(table->uris) 
+			+ table->locationCapacity * sizeof(SPDocumentLocation);
+	pthread_rwlock_unlock(&table->lock);
+	
+	return size;
+}
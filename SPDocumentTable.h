@@ -0,0 +1,87 @@
+//
+//  SPDocumentTable.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPDOCUMENTTABLE_H
+#define SPDOCUMENTTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// SPDocumentTable maps document URIs to integer document IDs and back. Each URI is
+// interned once in an SPStringTable arena, which answers URI -> ID lookups by hashing,
+// and an array indexed by ID holds the location of each URI in the arena, so ID -> URI
+// lookups are a single index. The SearchKit backend keeps one alongside its SKIndexRef
+// so that per document calls and search results never round trip through SKDocumentRefs.
+
+// The table guards itself with a read-write lock, so lookups from any number of threads
+// run alongside a writer.
+
+typedef struct SPDocumentTable SPDocumentTable;
+
+#define kSPDocumentTableNotFound (-1)
+
+SPDocumentTable * SPDocumentTableCreate(size_t capacityHint);
+void SPDocumentTableRelease(SPDocumentTable *table);
+
+bool SPDocumentTableSetDocument(SPDocumentTable *table, const char *uri, size_t length, int32_t document);
+
+	// Associates uri with document, which must be zero or positive. Any other URI mapped to
+	// document and any other document mapped to uri lose their mapping. Returns false if
+	// memory could not be allocated, leaving the table as it was.
+
+bool SPDocumentTableRemoveDocument(SPDocumentTable *table, int32_t document);
+
+	// Forgets document and its URI. Returns false if the document was not in the table.
+
+int32_t SPDocumentTableGetDocument(SPDocumentTable *table, const char *uri, size_t length);
+
+	// Returns the document mapped to uri or kSPDocumentTableNotFound.
+
+size_t SPDocumentTableGetURI(SPDocumentTable *table, int32_t document, char *buffer, size_t capacity);
+
+	// Copies the URI of document into buffer, which is not NUL terminated, and returns its
+	// length. Returns 0 for an unknown document. When the length is larger than capacity
+	// nothing is copied; call again with a buffer of at least that size. The arena may move
+	// while a writer holds the table, so URIs are copied out rather than returned in place.
+
+size_t SPDocumentTableGetCount(SPDocumentTable *table);
+size_t SPDocumentTableGetMemorySize(SPDocumentTable *table);
+
+#endif
@@ -0,0 +1,532 @@
+//
+//  SPGraph.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPGraph.h"
+#include "SPIndexPrivate.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A graph is a handful of flat arrays, called sections, which are either malloc'd or
+// point into a mapped file. The file is a header followed by the sections in order.
+
+enum {
+	kSPGraphDocumentIDs,
+	kSPGraphURIOffsets,
+	kSPGraphURIs,
+	kSPGraphTermIDs,
+	kSPGraphTermOffsets,
+	kSPGraphTerms,
+	kSPGraphRowOffsets,
+	kSPGraphColumns,
+	kSPGraphValues,
+	kSPGraphSectionCount
+};
+
+#define kSPGraphFileMagic		"SPGRAPH"
+#define kSPGraphFileVersion		1
+#define kSPGraphByteOrder		0x01020304
+#define kSPGraphAlignment		64
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;				// reads back differently on a machine of the other order
+	uint32_t orientation;
+	uint32_t reserved;
+	uint64_t documentCount;
+	uint64_t termCount;
+	uint64_t entryCount;
+	uint64_t offsets[kSPGraphSectionCount];
+	uint64_t lengths[kSPGraphSectionCount];
+} SPGraphFileHeader;
+
+struct __SPGraph {
+	SPGraphOrientation orientation;
+	uint64_t documentCount;
+	uint64_t termCount;
+	uint64_t entryCount;
+
+	void *sections[kSPGraphSectionCount];
+	uint64_t lengths[kSPGraphSectionCount];	// in bytes
+
+	void *map;						// NULL unless the graph was created with a file
+	size_t mapLength;
+};
+
+static void * SPGraphAllocateSection(SPGraphRef graph, int section, uint64_t length) {
+	if ( length > SIZE_MAX ) return NULL;
+	graph->sections[section] = malloc(( length == 0 ? 1 : (size_t)length ));
+	graph->lengths[section] = length;
+	return graph->sections[section];
+}
+
+static void SPGraphFreeSection(SPGraphRef graph, int section) {
+	free(graph->sections[section]);
+	graph->sections[section] = NULL;
+	graph->lengths[section] = 0;
+}
+
+#pragma mark -
+#pragma mark Exporting
+
+SPGraphRef SPIndexCopyGraph(SPIndexRef index, SPDocumentID first, SPDocumentID last, SPGraphOrientation orientation) {
+
+	// Document rows are copied in ID order straight out of the term vectors, counting
+	// the entries of every term on the way. The counts give the term table and, for term
+	// rows, the offsets of a transpose which is then filled in a single scatter pass.
+	// Scattering documents in ID order keeps the columns of every term row sorted.
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	SPGraphRef graph = calloc(1, sizeof(struct __SPGraph));
+	uint64_t *counts = NULL, *documentOffsets = NULL;
+	uint64_t documentCount = 0, termCount = 0, entryCount = 0, uriLength = 0, termLength = 0, entry;
+	SPDocumentID *documentIDs;
+	uint64_t *uriOffsets, *termOffsets;
+	char *uris, *terms;
+	SPTermID *columns, *termIDs;
+	float *values;
+	size_t i, j, row;
+	bool success = false;
+
+	if ( graph == NULL ) goto bail;
+
+	graph->orientation = orientation;
+	counts = calloc((size_t)snapshot->termCount + 1, sizeof(uint64_t));
+	if ( counts == NULL ) goto bail;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegment *segment = snapshot->segments[i];
+
+		if ( segment->documentCount == 0 || SPSegmentGetLastDocument(segment) < first || SPSegmentGetFirstDocument(segment) > last )
+			continue;
+
+		for ( j = 0; j < segment->documentCount; j++ ) {
+			const SPSegmentDocument *info = &segment->documents[j];
+			if ( info->document < first || info->document > last || SPDeletionSetContains(snapshot->deleted, info->document) ) 
+				continue;
+
+			documentCount++;
+			entryCount += info->termCount;
+			uriLength += info->uriLength;
+		}
+	}
+
+	// Document rows
+
+	documentIDs = SPGraphAllocateSection(graph, kSPGraphDocumentIDs, documentCount * sizeof(SPDocumentID));
+	uriOffsets = SPGraphAllocateSection(graph, kSPGraphURIOffsets, ( documentCount + 1 ) * sizeof(uint64_t));
+	uris = SPGraphAllocateSection(graph, kSPGraphURIs, uriLength);
+	columns = SPGraphAllocateSection(graph, kSPGraphColumns, entryCount * sizeof(SPTermID));
+	values = SPGraphAllocateSection(graph, kSPGraphValues, entryCount * sizeof(float));
+	documentOffsets = malloc(( documentCount + 1 ) * sizeof(uint64_t));
+
+	if ( documentIDs == NULL || uriOffsets == NULL || uris == NULL || columns == NULL || values == NULL || documentOffsets == NULL )
+		goto bail;
+
+	row = 0;
+	entry = 0;
+	uriOffsets[0] = 0;
+	documentOffsets[0] = 0;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegment *segment = snapshot->segments[i];
+
+		if ( segment->documentCount == 0 || SPSegmentGetLastDocument(segment) < first || SPSegmentGetFirstDocument(segment) > last )
+			continue;
+
+		for ( j = 0; j < segment->documentCount; j++ ) {
+			const SPSegmentDocument *info = &segment->documents[j];
+			SPPostingIterator iterator;
+
+			if ( info->document < first || info->document > last || SPDeletionSetContains(snapshot->deleted, info->document) ) 
+				continue;
+
+			SPPostingIteratorInit(&iterator, segment->vectors + info->vectorOffset, info->vectorLength);
+			while ( SPPostingIteratorNext(&iterator) ) {
+				columns[entry] = (SPTermID)iterator.document;
+				values[entry] = (float)iterator.frequency;
+				counts[iterator.document]++;
+				entry++;
+			}
+
+			documentIDs[row] = info->document;
+			memcpy(uris + uriOffsets[row], segment->uris + info->uriOffset, info->uriLength);
+			uriOffsets[row+1] = uriOffsets[row] + info->uriLength;
+			documentOffsets[row+1] = entry;
+			row++;
+		}
+	}
+
+	// Term table
+
+	for ( i = 0; i < (size_t)snapshot->termCount; i++ ) {
+		size_t length;
+		if ( counts[i] == 0 ) continue;
+
+		SPTermDirectoryGetTerm(snapshot->directory, (SPTermID)i, &length);
+		termLength += length;
+		termCount++;
+	}
+
+	termIDs = SPGraphAllocateSection(graph, kSPGraphTermIDs, termCount * sizeof(SPTermID));
+	termOffsets = SPGraphAllocateSection(graph, kSPGraphTermOffsets, ( termCount + 1 ) * sizeof(uint64_t));
+	terms = SPGraphAllocateSection(graph, kSPGraphTerms, termLength);
+
+	if ( termIDs == NULL || termOffsets == NULL || terms == NULL ) goto bail;
+
+	termOffsets[0] = 0;
+
+	for ( i = 0, row = 0; i < (size_t)snapshot->termCount; i++ ) {
+		size_t length;
+		const char *string;
+
+		if ( counts[i] == 0 ) continue;
+
+		string = SPTermDirectoryGetTerm(snapshot->directory, (SPTermID)i, &length);
+		termIDs[row] = (SPTermID)i;
+		memcpy(terms + termOffsets[row], string, length);
+		termOffsets[row+1] = termOffsets[row] + length;
+		row++;
+	}
+
+	graph->documentCount = documentCount;
+	graph->termCount = termCount;
+	graph->entryCount = entryCount;
+
+	if ( orientation == kSPGraphDocumentRows ) {
+		graph->sections[kSPGraphRowOffsets] = documentOffsets;
+		graph->lengths[kSPGraphRowOffsets] = ( documentCount + 1 ) * sizeof(uint64_t);
+		documentOffsets = NULL;
+	}
+	else {
+		uint64_t *rowOffsets = SPGraphAllocateSection(graph, kSPGraphRowOffsets, ( termCount + 1 ) * sizeof(uint64_t));
+		SPDocumentID *transposedColumns = malloc(( entryCount == 0 ? 1 : (size_t)entryCount ) * sizeof(SPDocumentID));
+		float *transposedValues = malloc(( entryCount == 0 ? 1 : (size_t)entryCount ) * sizeof(float));
+
+		if ( rowOffsets == NULL || transposedColumns == NULL || transposedValues == NULL ) {
+			free(transposedColumns);
+			free(transposedValues);
+			goto bail;
+		}
+
+		// counts becomes the next free entry of each term row
+
+		rowOffsets[0] = 0;
+		for ( row = 0; row < termCount; row++ ) {
+			rowOffsets[row+1] = rowOffsets[row] + counts[termIDs[row]];
+			counts[termIDs[row]] = rowOffsets[row];
+		}
+
+		for ( row = 0; row < documentCount; row++ ) {
+			for ( entry = documentOffsets[row]; entry < documentOffsets[row+1]; entry++ ) {
+				uint64_t position = counts[columns[entry]]++;
+				transposedColumns[position] = documentIDs[row];
+				transposedValues[position] = values[entry];
+			}
+		}
+
+		SPGraphFreeSection(graph, kSPGraphColumns);
+		SPGraphFreeSection(graph, kSPGraphValues);
+
+		graph->sections[kSPGraphColumns] = transposedColumns;
+		graph->lengths[kSPGraphColumns] = entryCount * sizeof(SPDocumentID);
+		graph->sections[kSPGraphValues] = transposedValues;
+		graph->lengths[kSPGraphValues] = entryCount * sizeof(float);
+	}
+
+	success = true;
+
+bail:
+	free(counts);
+	free(documentOffsets);
+	SPSnapshotRelease(snapshot);
+
+	if ( !success && graph != NULL ) {
+		SPGraphRelease(graph);
+		graph = NULL;
+	}
+
+	return graph;
+}
+
+#pragma mark -
+#pragma mark Files
+
+bool SPGraphWriteToFile(SPGraphRef graph, const char *path) {
+
+	static const uint8_t padding[kSPGraphAlignment] = { 0 };
+
+	SPGraphFileHeader header;
+	FILE *file = NULL;
+	uint64_t offset = sizeof(SPGraphFileHeader);
+	int i;
+	bool success = false;
+
+	memset(&header, 0, sizeof(SPGraphFileHeader));
+	memcpy(header.magic, kSPGraphFileMagic, sizeof(kSPGraphFileMagic));
+	header.version = kSPGraphFileVersion;
+	header.byteOrder = kSPGraphByteOrder;
+	header.orientation = (uint32_t)graph->orientation;
+	header.documentCount = graph->documentCount;
+	header.termCount = graph->termCount;
+	header.entryCount = graph->entryCount;
+
+	for ( i = 0; i < kSPGraphSectionCount; i++ ) {
+		header.offsets[i] = offset;
+		header.lengths[i] = graph->lengths[i];
+		offset += ( graph->lengths[i] + kSPGraphAlignment - 1 ) / kSPGraphAlignment * kSPGraphAlignment;
+	}
+
+	file = fopen(path, "wb");
+	if ( file == NULL ) return false;
+
+	if ( fwrite(&header, sizeof(SPGraphFileHeader), 1, file) != 1 ) goto bail;
+
+	for ( i = 0; i < kSPGraphSectionCount; i++ ) {
+		size_t length = (size_t)graph->lengths[i], pad = ( kSPGraphAlignment - length % kSPGraphAlignment ) % kSPGraphAlignment;
+		if ( length > 0 && fwrite(graph->sections[i], 1, length, file) != length ) goto bail;
+		if ( pad > 0 && fwrite(padding, 1, pad, file) != pad ) goto bail;
+	}
+
+	success = true;
+
+bail:
+	if ( fclose(file) != 0 ) success = false;
+	if ( !success ) unlink(path);
+
+	return success;
+}
+
+static bool SPGraphValidateOffsets(const uint64_t *offsets, uint64_t count, uint64_t end) {
+
+	// count + 1 offsets must rise from 0 to end
+
+	uint64_t i;
+
+	if ( offsets[0] != 0 || offsets[count] != end ) return false;
+
+	for ( i = 0; i < count; i++ ) {
+		if ( offsets[i] > offsets[i+1] ) return false;
+	}
+
+	return true;
+}
+
+SPGraphRef SPGraphCreateWithFile(const char *path) {
+
+	// Every section is checked against the counts in the header before it is used, so a
+	// truncated or foreign file is refused rather than read out of bounds
+
+	SPGraphRef graph = NULL;
+	const SPGraphFileHeader *header;
+	uint64_t rowCount, expected[kSPGraphSectionCount];
+	struct stat info;
+	void *map = MAP_FAILED;
+	int i, descriptor = open(path, O_RDONLY);
+
+	if ( descriptor == -1 ) return NULL;
+
+	if ( fstat(descriptor, &info) != 0 || (uint64_t)info.st_size < sizeof(SPGraphFileHeader) || (uint64_t)info.st_size > SIZE_MAX )
+		goto bail;
+
+	map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	if ( map == MAP_FAILED ) goto bail;
+
+	header = map;
+	if ( memcmp(header->magic, kSPGraphFileMagic, sizeof(kSPGraphFileMagic)) != 0 || header->version != kSPGraphFileVersion 
+			|| header->byteOrder != kSPGraphByteOrder || header->orientation > kSPGraphTermRows )
+		goto bail;
+
+	if ( header->documentCount > UINT32_MAX || header->termCount > UINT32_MAX || header->entryCount > SIZE_MAX / sizeof(uint64_t) )
+		goto bail;
+
+	rowCount = ( header->orientation == kSPGraphDocumentRows ? header->documentCount : header->termCount );
+
+	expected[kSPGraphDocumentIDs] = header->documentCount * sizeof(SPDocumentID);
+	expected[kSPGraphURIOffsets] = ( header->documentCount + 1 ) * sizeof(uint64_t);
+	expected[kSPGraphURIs] = header->lengths[kSPGraphURIs];
+	expected[kSPGraphTermIDs] = header->termCount * sizeof(SPTermID);
+	expected[kSPGraphTermOffsets] = ( header->termCount + 1 ) * sizeof(uint64_t);
+	expected[kSPGraphTerms] = header->lengths[kSPGraphTerms];
+	expected[kSPGraphRowOffsets] = ( rowCount + 1 ) * sizeof(uint64_t);
+	expected[kSPGraphColumns] = header->entryCount * sizeof(int32_t);
+	expected[kSPGraphValues] = header->entryCount * sizeof(float);
+
+	graph = calloc(1, sizeof(struct __SPGraph));
+	if ( graph == NULL ) goto bail;
+
+	for ( i = 0; i < kSPGraphSectionCount; i++ ) {
+		if ( header->lengths[i] != expected[i] || header->offsets[i] % kSPGraphAlignment != 0 
+				|| header->offsets[i] > (uint64_t)info.st_size || header->lengths[i] > (uint64_t)info.st_size - header->offsets[i] )
+			goto fail;
+
+		graph->sections[i] = (uint8_t*)map + header->offsets[i];
+		graph->lengths[i] = header->lengths[i];
+	}
+
+	if ( !SPGraphValidateOffsets(graph->sections[kSPGraphURIOffsets], header->documentCount, header->lengths[kSPGraphURIs]) 
+			|| !SPGraphValidateOffsets(graph->sections[kSPGraphTermOffsets], header->termCount, header->lengths[kSPGraphTerms]) 
+			|| !SPGraphValidateOffsets(graph->sections[kSPGraphRowOffsets], rowCount, header->entryCount) )
+		goto fail;
+
+	graph->orientation = (SPGraphOrientation)header->orientation;
+	graph->documentCount = header->documentCount;
+	graph->termCount = header->termCount;
+	graph->entryCount = header->entryCount;
+	graph->map = map;
+	graph->mapLength = (size_t)info.st_size;
+
+	close(descriptor);
+	return graph;
+
+fail:
+	free(graph);
+	graph = NULL;
+
+bail:
+	if ( map != MAP_FAILED ) munmap(map, (size_t)info.st_size);
+	close(descriptor);
+
+	return NULL;
+}
+
+void SPGraphRelease(SPGraphRef graph) {
+
+	int i;
+
+	if ( graph == NULL ) return;
+
+	if ( graph->map != NULL ) {
+		munmap(graph->map, graph->mapLength);
+	}
+	else {
+		for ( i = 0; i < kSPGraphSectionCount; i++ )
+			free(graph->sections[i]);
+	}
+
+	free(graph);
+}
+
+#pragma mark -
+#pragma mark Accessors
+
+SPGraphOrientation SPGraphGetOrientation(SPGraphRef graph) {
+	return graph->orientation;
+}
+
+size_t SPGraphGetRowCount(SPGraphRef graph) {
+	return (size_t)( graph->orientation == kSPGraphDocumentRows ? graph->documentCount : graph->termCount );
+}
+
+size_t SPGraphGetEntryCount(SPGraphRef graph) {
+	return (size_t)graph->entryCount;
+}
+
+const int32_t * SPGraphGetRowIDs(SPGraphRef graph) {
+	return graph->sections[( graph->orientation == kSPGraphDocumentRows ? kSPGraphDocumentIDs : kSPGraphTermIDs )];
+}
+
+const uint64_t * SPGraphGetRowOffsets(SPGraphRef graph) {
+	return graph->sections[kSPGraphRowOffsets];
+}
+
+const int32_t * SPGraphGetColumnIDs(SPGraphRef graph) {
+	return graph->sections[kSPGraphColumns];
+}
+
+const float * SPGraphGetValues(SPGraphRef graph) {
+	return graph->sections[kSPGraphValues];
+}
+
+static size_t SPGraphFindID(const int32_t *ids, size_t count, int32_t id) {
+
+	size_t low = 0, high = count;
+
+	while ( low < high ) {
+		size_t middle = low + ( high - low ) / 2;
+
+		if ( ids[middle] == id ) return middle;
+		if ( ids[middle] < id ) low = middle + 1;
+		else high = middle;
+	}
+
+	return kSPGraphNotFound;
+}
+
+size_t SPGraphGetDocumentCount(SPGraphRef graph) {
+	return (size_t)graph->documentCount;
+}
+
+const SPDocumentID * SPGraphGetDocumentIDs(SPGraphRef graph) {
+	return graph->sections[kSPGraphDocumentIDs];
+}
+
+const char * SPGraphGetDocumentURI(SPGraphRef graph, size_t index, size_t *outLength) {
+	const uint64_t *offsets = graph->sections[kSPGraphURIOffsets];
+	*outLength = (size_t)( offsets[index+1] - offsets[index] );
+	return (const char*)graph->sections[kSPGraphURIs] + offsets[index];
+}
+
+size_t SPGraphFindDocument(SPGraphRef graph, SPDocumentID document) {
+	return SPGraphFindID(graph->sections[kSPGraphDocumentIDs], (size_t)graph->documentCount, document);
+}
+
+size_t SPGraphGetTermCount(SPGraphRef graph) {
+	return (size_t)graph->termCount;
+}
+
+const SPTermID * SPGraphGetTermIDs(SPGraphRef graph) {
+	return graph->sections[kSPGraphTermIDs];
+}
+
+const char * SPGraphGetTermString(SPGraphRef graph, size_t index, size_t *outLength) {
+	const uint64_t *offsets = graph->sections[kSPGraphTermOffsets];
+	*outLength = (size_t)( offsets[index+1] - offsets[index] );
+	return (const char*)graph->sections[kSPGraphTerms] + offsets[index];
+}
+
+size_t SPGraphFindTerm(SPGraphRef graph, SPTermID term) {
+	return SPGraphFindID(graph->sections[kSPGraphTermIDs], (size_t)graph->termCount, term);
+}
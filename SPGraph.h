@@ -0,0 +1,106 @@
+//
+//  SPGraph.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPGRAPH_H
+#define SPGRAPH_H
+
+#include "SPIndex.h"
+
+// SPGraph is a flat export of the document <-> term graph in compressed sparse row form,
+// for analytics that want the whole graph, or a large slice of it, in one call instead of
+// a call per document. Rows are documents and columns terms, or the other way around.
+// The entries of row r are columns[rowOffsets[r]] up to columns[rowOffsets[r+1]], in
+// ascending ID order, and values holds the frequency of each entry. Document and term
+// tables map every ID in the graph to its URI or string.
+
+// A graph never changes once it is created. It may be written to a file and opened again
+// with SPGraphCreateWithFile, which maps the file instead of reading it: the arrays are
+// stored exactly as they are laid out in memory, in native byte order and aligned to 64
+// bytes, so they are paged in on demand and shared by every process that maps the file.
+
+typedef struct __SPGraph * SPGraphRef;
+
+typedef enum {
+	kSPGraphDocumentRows = 0,		// a row per document, columns are term IDs
+	kSPGraphTermRows = 1			// a row per term, columns are document IDs
+} SPGraphOrientation;
+
+#define kSPGraphNotFound ((size_t)-1)
+
+SPGraphRef SPIndexCopyGraph(SPIndexRef index, SPDocumentID first, SPDocumentID last, SPGraphOrientation orientation);
+
+	// Exports the live documents with IDs from first to last inclusive, as of the last
+	// refresh. Pass 1 and SPIndexGetMaximumDocumentID for the whole index. The term table
+	// only covers the terms of the exported documents. Returns NULL if memory ran out.
+
+SPGraphRef SPGraphCreateWithFile(const char *path);
+bool SPGraphWriteToFile(SPGraphRef graph, const char *path);
+void SPGraphRelease(SPGraphRef graph);
+
+	// SPGraphCreateWithFile returns NULL if the file cannot be mapped or was not written by
+	// the same version of SPGraphWriteToFile on a machine of the same byte order.
+
+SPGraphOrientation SPGraphGetOrientation(SPGraphRef graph);
+size_t SPGraphGetRowCount(SPGraphRef graph);
+size_t SPGraphGetEntryCount(SPGraphRef graph);
+
+const int32_t * SPGraphGetRowIDs(SPGraphRef graph);
+const uint64_t * SPGraphGetRowOffsets(SPGraphRef graph);
+const int32_t * SPGraphGetColumnIDs(SPGraphRef graph);
+const float * SPGraphGetValues(SPGraphRef graph);
+
+	// The row IDs are document IDs for kSPGraphDocumentRows and term IDs otherwise, in
+	// ascending order. There are row count + 1 row offsets. Every document becomes a row,
+	// even one without terms, and every term with at least one entry.
+
+size_t SPGraphGetDocumentCount(SPGraphRef graph);
+const SPDocumentID * SPGraphGetDocumentIDs(SPGraphRef graph);
+const char * SPGraphGetDocumentURI(SPGraphRef graph, size_t index, size_t *outLength);
+size_t SPGraphFindDocument(SPGraphRef graph, SPDocumentID document);
+
+size_t SPGraphGetTermCount(SPGraphRef graph);
+const SPTermID * SPGraphGetTermIDs(SPGraphRef graph);
+const char * SPGraphGetTermString(SPGraphRef graph, size_t index, size_t *outLength);
+size_t SPGraphFindTerm(SPGraphRef graph, SPTermID term);
+
+	// The tables are in ascending ID order and are indexed by position, not by ID. The
+	// Find functions return the position of an ID or kSPGraphNotFound. Strings are not
+	// NUL terminated.
+
+#endif
@@ -0,0 +1,1590 @@
+//
+//  SPIndex.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPIndexPrivate.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define kSPIndexDefaultMergeFactor 8
+
+typedef struct {
+	SPSegment *segment;
+	double ratio;				// removed documents over all documents
+} SPCompactionCandidate;
+
+static bool SPIndexMerge(SPIndexRef index);
+
+#pragma mark Snapshots
+
+SPSnapshot * SPSnapshotCreate(SPIndexRef index, size_t segmentCount) {
+
+	SPSnapshot *snapshot = calloc(1, sizeof(SPSnapshot));
+	if ( snapshot == NULL ) return NULL;
+
+	snapshot->segments = calloc(( segmentCount == 0 ? 1 : segmentCount ), sizeof(SPSegment*));
+	snapshot->deletedCounts = calloc(( segmentCount == 0 ? 1 : segmentCount ), sizeof(uint32_t));
+
+	if ( snapshot->segments == NULL || snapshot->deletedCounts == NULL ) {
+		free(snapshot->segments);
+		free(snapshot->deletedCounts);
+		free(snapshot);
+		return NULL;
+	}
+
+	snapshot->retainCount = 1;
+	snapshot->directory = index->directory;
+	snapshot->trigrams = index->trigrams;
+	return snapshot;
+}
+
+SPSnapshot * SPIndexCopySnapshot(SPIndexRef index) {
+
+	SPSnapshot *snapshot;
+
+	pthread_mutex_lock(&index->snapshotLock);
+	snapshot = index->snapshot;
+	__sync_fetch_and_add(&snapshot->retainCount, 1);
+	pthread_mutex_unlock(&index->snapshotLock);
+
+	return snapshot;
+}
+
+void SPSnapshotRelease(SPSnapshot *snapshot) {
+
+	size_t i;
+
+	if ( snapshot == NULL || __sync_sub_and_fetch(&snapshot->retainCount, 1) != 0 )
+		return;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) SPSegmentRelease(snapshot->segments[i]);
+
+	SPDeletionSetRelease(snapshot->deleted);
+	free(snapshot->segments);
+	free(snapshot->deletedCounts);
+	free(snapshot);
+}
+
+void SPIndexPublishSnapshot(SPIndexRef index, SPSnapshot *snapshot) {
+
+	// Called with the write lock held, which is what serializes publishers. The snapshot
+	// lock only protects readers retaining the pointer while it is swapped.
+
+	SPSnapshot *previous = index->snapshot;
+
+	snapshot->generation = previous->generation + 1;
+	snapshot->termCount = SPTermDirectoryGetCount(index->directory);
+
+	// Failing to index the new terms leaves the trigram index refusing every pattern,
+	// and wildcards fall back on scanning the dictionary
+
+	if ( index->trigrams != NULL ) SPTrigramIndexAddTerms(index->trigrams, index->directory, snapshot->termCount);
+
+	pthread_mutex_lock(&index->snapshotLock);
+	index->snapshot = snapshot;
+	pthread_mutex_unlock(&index->snapshotLock);
+
+	SPSnapshotRelease(previous);
+}
+
+static size_t SPSnapshotFindSegment(const SPSnapshot *snapshot, SPDocumentID document) {
+
+	// The first segment whose last document is at or above document, or segmentCount
+
+	size_t low = 0, high = snapshot->segmentCount;
+
+	while ( low < high ) {
+		size_t middle = low + ( high - low ) / 2;
+		if ( SPSegmentGetLastDocument(snapshot->segments[middle]) < document ) low = middle + 1;
+		else high = middle;
+	}
+
+	return low;
+}
+
+const SPSegmentDocument * SPSnapshotFindDocument(const SPSnapshot *snapshot, SPDocumentID document, const SPSegment **outSegment) {
+
+	size_t i;
+
+	if ( document <= 0 || SPDeletionSetContains(snapshot->deleted, document) )
+		return NULL;
+
+	i = SPSnapshotFindSegment(snapshot, document);
+	if ( i == snapshot->segmentCount ) return NULL;
+
+	if ( outSegment != NULL ) *outSegment = snapshot->segments[i];
+	return SPSegmentFindDocument(snapshot->segments[i], document);
+}
+
+const SPSegmentDocument * SPSnapshotFindURI(const SPSnapshot *snapshot, const char *uri, size_t length, const SPSegment **outSegment) {
+
+	// Newest first. Older versions of a replaced document are in the deletion set.
+
+	size_t i = snapshot->segmentCount;
+
+	while ( i-- > 0 ) {
+		const SPSegmentDocument *document = SPSegmentFindURI(snapshot->segments[i], uri, length);
+		if ( document != NULL && !SPDeletionSetContains(snapshot->deleted, document->document) ) {
+			if ( outSegment != NULL ) *outSegment = snapshot->segments[i];
+			return document;
+		}
+	}
+
+	return NULL;
+}
+
+static size_t SPSnapshotGetLiveDocumentCount(const SPSnapshot *snapshot, size_t segment, const SPSegmentTerm *term) {
+
+	SPPostingIterator iterator;
+	size_t count = 0;
+
+	if ( snapshot->deletedCounts[segment] == 0 )
+		return term->documentCount;
+
+	SPPostingIteratorInit(&iterator, snapshot->segments[segment]->postings + term->postingsOffset, term->postingsLength);
+	while ( SPPostingIteratorNext(&iterator) ) {
+		if ( !SPDeletionSetContains(snapshot->deleted, (SPDocumentID)iterator.document) ) count++;
+	}
+
+	return count;
+}
+
+void SPScorerInit(SPScorer *scorer, const SPSnapshot *snapshot, const SPRankingOptions *options) {
+
+	// Collection statistics include removed documents until a merge drops them, which
+	// keeps them consistent with document frequencies read straight off the segments.
+
+	uint64_t documentCount = 0, tokenCount = 0;
+	size_t i;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		documentCount += snapshot->segments[i]->documentCount;
+		tokenCount += snapshot->segments[i]->tokenCount;
+	}
+
+	scorer->model = ( options != NULL ? options->model : kSPRankingModelBM25 );
+	scorer->k1 = ( options != NULL ? options->k1 : 1.2f );
+	scorer->b = ( options != NULL ? options->b : 0.75f );
+	scorer->documentCount = (float)documentCount;
+	scorer->averageLength = ( documentCount == 0 || tokenCount == 0 ? 1.0f : (float)( (double)tokenCount / (double)documentCount ) );
+	scorer->collection = NULL;
+}
+
+void SPScorerInitWithIndex(SPScorer *scorer, SPIndexRef index, const SPSnapshot *snapshot, const SPRankingOptions *options) {
+
+	uint64_t documentCount = 0, tokenCount = 0;
+
+	SPScorerInit(scorer, snapshot, options);
+	if ( !index->hasCollection ) return;
+
+	index->collection.getCounts(&documentCount, &tokenCount, index->collection.context);
+
+	scorer->collection = &index->collection;
+	scorer->documentCount = (float)documentCount;
+	scorer->averageLength = ( documentCount == 0 || tokenCount == 0 ? 1.0f : (float)( (double)tokenCount / (double)documentCount ) );
+}
+
+#pragma mark -
+#pragma mark Index Management
+
+static void * SPIndexMaintenanceThread(void *context) {
+
+	// Refreshes every refreshInterval seconds, or sooner once the buffer is full, and
+	// runs any merges the refresh calls for.
+
+	SPIndexRef index = context;
+
+	pthread_mutex_lock(&index->writeLock);
+
+	while ( !index->stopsMaintenance ) {
+
+		struct timeval now;
+		struct timespec deadline;
+		double interval = index->options.refreshInterval;
+
+		gettimeofday(&now, NULL);
+		deadline.tv_sec = now.tv_sec + (time_t)interval;
+		deadline.tv_nsec = now.tv_usec * 1000 + (long)( ( interval - floor(interval) ) * 1e9 );
+		if ( deadline.tv_nsec >= 1000000000 ) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		while ( !index->stopsMaintenance && ( index->options.maximumBufferedDocuments == 0 
+				|| index->bufferCount < index->options.maximumBufferedDocuments ) ) {
+			if ( pthread_cond_timedwait(&index->maintenanceCondition, &index->writeLock, &deadline) == ETIMEDOUT )
+				break;
+		}
+
+		if ( index->stopsMaintenance )
+			break;
+
+		SPIndexRefreshLocked(index);
+
+		pthread_mutex_unlock(&index->writeLock);
+		SPIndexMerge(index);
+		pthread_mutex_lock(&index->writeLock);
+	}
+
+	pthread_mutex_unlock(&index->writeLock);
+	return NULL;
+}
+
+SPIndexRef SPIndexCreate(const SPIndexOptions *options) {
+
+	SPIndexRef index = calloc(1, sizeof(struct __SPIndex));
+	if ( index == NULL ) return NULL;
+
+	if ( options != NULL ) {
+		index->options = *options;
+	}
+	else {
+		index->options.minTermLength = 1;
+		index->options.maximumTerms = 0;
+	}
+
+	if ( index->options.mergeFactor == 0 ) index->options.mergeFactor = kSPIndexDefaultMergeFactor;
+	if ( index->options.mergeFactor < 2 ) index->options.mergeFactor = 2;
+
+	pthread_mutex_init(&index->writeLock, NULL);
+	pthread_rwlock_init(&index->dataLock, NULL);
+	pthread_mutex_init(&index->mergeLock, NULL);
+	pthread_mutex_init(&index->saveLock, NULL);
+	pthread_mutex_init(&index->snapshotLock, NULL);
+	pthread_mutex_init(&index->normsLock, NULL);
+	pthread_cond_init(&index->maintenanceCondition, NULL);
+
+	index->directory = SPTermDirectoryCreate();
+	index->documentTable = SPStringTableCreate(1024);
+	index->dataTable = SPStringTableCreate(64);
+	index->freeData = SIZE_MAX;
+	if ( index->options.indexesTrigrams ) index->trigrams = SPTrigramIndexCreate();
+	if ( index->options.indexesSignatures ) index->signatures = SPSignatureIndexCreate();
+	if ( index->directory != NULL ) index->snapshot = SPSnapshotCreate(index, 0);
+
+	if ( index->directory == NULL || index->documentTable == NULL || index->dataTable == NULL || index->snapshot == NULL 
+			|| ( index->options.indexesTrigrams && index->trigrams == NULL ) 
+			|| ( index->options.indexesSignatures && index->signatures == NULL ) ) {
+		SPIndexRelease(index);
+		return NULL;
+	}
+
+	// Without a maintenance thread changes are refreshed synchronously
+
+	if ( index->options.refreshInterval > 0.0 )
+		index->hasMaintenanceThread = ( pthread_create(&index->maintenanceThread, NULL, SPIndexMaintenanceThread, index) == 0 );
+
+	return index;
+}
+
+void SPIndexRelease(SPIndexRef index) {
+	size_t i;
+
+	if ( index == NULL ) return;
+
+	if ( index->hasMaintenanceThread ) {
+		SPIndexLockForWriting(index);
+		index->stopsMaintenance = true;
+		pthread_cond_signal(&index->maintenanceCondition);
+		SPIndexUnlockForWriting(index);
+
+		pthread_join(index->maintenanceThread, NULL);
+	}
+
+	SPIndexLogRelease(index->log);
+
+	for ( i = 0; i < index->bufferCount; i++ ) {
+		free(index->buffer[i].uri);
+		SPAnalyzedTextFree(&index->buffer[i].text);
+	}
+
+	for ( i = 0; i < index->dataCount; i++ )
+		free(index->data[i].bytes);
+
+	SPSnapshotRelease(index->snapshot);
+	SPTermDirectoryRelease(index->directory);
+	SPTrigramIndexRelease(index->trigrams);
+	SPSignatureIndexRelease(index->signatures);
+	SPVectorNormsRelease(index->norms);
+	SPStringTableRelease(index->documentTable);
+	SPStringTableRelease(index->dataTable);
+	SPMappedFileRelease(index->file);
+	free(index->buffer);
+	free(index->pendingDeletions);
+	free(index->data);
+
+	pthread_cond_destroy(&index->maintenanceCondition);
+	pthread_mutex_destroy(&index->normsLock);
+	pthread_mutex_destroy(&index->snapshotLock);
+	pthread_mutex_destroy(&index->saveLock);
+	pthread_mutex_destroy(&index->mergeLock);
+	pthread_rwlock_destroy(&index->dataLock);
+	pthread_mutex_destroy(&index->writeLock);
+	free(index);
+}
+
+#pragma mark -
+#pragma mark Writing
+
+static bool SPIndexReserveWrite(SPIndexRef index, size_t documents) {
+
+	// Makes room for documents more buffered documents and as many pending deletions, so
+	// that a replacement cannot fail halfway through. Called with the write lock held.
+
+	if ( index->bufferCount + documents > index->bufferCapacity ) {
+		size_t capacity = ( index->bufferCapacity == 0 ? 256 : index->bufferCapacity * 2 );
+		while ( capacity < index->bufferCount + documents ) capacity *= 2;
+
+		SPBufferedDocument *buffer = realloc(index->buffer, capacity * sizeof(SPBufferedDocument));
+		if ( buffer == NULL ) return false;
+
+		index->buffer = buffer;
+		index->bufferCapacity = capacity;
+	}
+
+	if ( index->pendingCount + documents > index->pendingCapacity ) {
+		size_t capacity = ( index->pendingCapacity == 0 ? 256 : index->pendingCapacity * 2 );
+		while ( capacity < index->pendingCount + documents ) capacity *= 2;
+
+		SPDocumentID *pending = realloc(index->pendingDeletions, capacity * sizeof(SPDocumentID));
+		if ( pending == NULL ) return false;
+
+		index->pendingDeletions = pending;
+		index->pendingCapacity = capacity;
+	}
+
+	return true;
+}
+
+static void SPIndexRemoveDocumentWithID(SPIndexRef index, SPDocumentID document) {
+
+	// A buffered document is simply dropped from the buffer. A refreshed one is deleted
+	// when the next refresh publishes the pending deletions.
+
+	if ( document > index->refreshedDocumentID ) {
+		size_t low = 0, high = index->bufferCount;
+
+		while ( low < high ) {
+			size_t middle = low + ( high - low ) / 2;
+			if ( index->buffer[middle].document < document ) low = middle + 1;
+			else high = middle;
+		}
+
+		if ( low < index->bufferCount && index->buffer[low].document == document ) {
+			SPBufferedDocument *buffered = &index->buffer[low];
+			free(buffered->uri);
+			SPAnalyzedTextFree(&buffered->text);
+			buffered->uri = NULL;
+			buffered->removed = true;
+		}
+	}
+	else {
+		index->pendingDeletions[index->pendingCount++] = document;
+	}
+}
+
+static SPDocumentID SPIndexBufferDocument(SPIndexRef index, char *uri, size_t uriLength, SPAnalyzedText *text) {
+
+	// Takes ownership of uri and text on success. Called with the write lock held.
+
+	SPDocumentID existing = SPStringTableGetValue(index->documentTable, uri, uriLength);
+	SPDocumentID document = index->maximumDocumentID + 1;
+	SPBufferedDocument *buffered;
+
+	if ( !SPIndexReserveWrite(index, 1) )
+		return kSPIndexNotFound;
+
+	if ( !SPStringTableSetValue(index->documentTable, uri, uriLength, document, NULL) )
+		return kSPIndexNotFound;
+
+	if ( existing != kSPStringTableNotFound ) 
+		SPIndexRemoveDocumentWithID(index, existing);
+
+	buffered = &index->buffer[index->bufferCount++];
+	buffered->document = document;
+	buffered->uri = uri;
+	buffered->uriLength = uriLength;
+	buffered->text = *text;
+	buffered->removed = false;
+
+	index->maximumDocumentID = document;
+	return document;
+}
+
+static void SPIndexDidBufferDocuments(SPIndexRef index) {
+
+	// Called with the write lock held after documents have been buffered or removed
+
+	if ( !index->hasMaintenanceThread ) {
+		SPIndexRefreshLocked(index);
+	}
+	else if ( index->options.maximumBufferedDocuments != 0 
+			&& index->bufferCount >= index->options.maximumBufferedDocuments ) {
+		pthread_cond_signal(&index->maintenanceCondition);
+	}
+}
+
+SPDocumentID SPIndexAddDocument(SPIndexRef index, const char *uri, const char *text, size_t length) {
+
+	SPAnalyzedText analyzed;
+	SPDocumentID document;
+	size_t uriLength = strlen(uri);
+	char *uriCopy;
+
+	// Tokenize before taking the write lock. Only buffering the result is serialized.
+
+	memset(&analyzed, 0, sizeof(SPAnalyzedText));
+	if ( !SPAnalyzeText(&index->options, text, length, &analyzed) )
+		return kSPIndexNotFound;
+
+	uriCopy = malloc(uriLength + 1);
+	if ( uriCopy == NULL ) {
+		SPAnalyzedTextFree(&analyzed);
+		return kSPIndexNotFound;
+	}
+
+	memcpy(uriCopy, uri, uriLength + 1);
+
+	SPIndexLockForWriting(index);
+
+	document = SPIndexBufferDocument(index, uriCopy, uriLength, &analyzed);
+	if ( document != kSPIndexNotFound ) {
+		if ( index->log != NULL ) SPIndexLogAppend(index->log, kSPIndexLogAdd, uri, uriLength, text, length);
+		SPIndexDidBufferDocuments(index);
+	}
+
+	SPIndexUnlockForWriting(index);
+
+	if ( document == kSPIndexNotFound ) {
+		free(uriCopy);
+		SPAnalyzedTextFree(&analyzed);
+		return kSPIndexNotFound;
+	}
+
+	if ( !index->hasMaintenanceThread ) SPIndexMerge(index);
+	if ( index->log != NULL ) SPIndexLogCommitIfFull(index->log);
+
+	return document;
+}
+
+bool SPIndexRemoveDocument(SPIndexRef index, const char *uri) {
+
+	bool success = false;
+	size_t uriLength = strlen(uri);
+
+	SPIndexLockForWriting(index);
+
+	SPDocumentID document = SPStringTableGetValue(index->documentTable, uri, uriLength);
+	if ( document != kSPStringTableNotFound && SPIndexReserveWrite(index, 1) ) {
+		SPStringTableRemoveValue(index->documentTable, uri, uriLength);
+		SPIndexRemoveDocumentWithID(index, document);
+		SPIndexSetDocumentDataLocked(index, uri, uriLength, NULL, 0);
+		if ( index->log != NULL ) SPIndexLogAppend(index->log, kSPIndexLogRemove, uri, uriLength, NULL, 0);
+		SPIndexDidBufferDocuments(index);
+		success = true;
+	}
+
+	SPIndexUnlockForWriting(index);
+
+	if ( success && !index->hasMaintenanceThread ) SPIndexMerge(index);
+	if ( success && index->log != NULL ) SPIndexLogCommitIfFull(index->log);
+	return success;
+}
+
+#pragma mark -
+
+SPDocumentBatchRef SPDocumentBatchCreate(SPIndexRef index, size_t count) {
+
+	SPDocumentBatchRef batch = calloc(1, sizeof(struct __SPDocumentBatch));
+	if ( batch == NULL ) return NULL;
+
+	batch->documents = calloc(( count == 0 ? 1 : count ), sizeof(SPBatchDocument));
+	if ( batch->documents == NULL ) {
+		free(batch);
+		return NULL;
+	}
+
+	batch->options = index->options;	// immutable once the index is created
+	batch->keepsText = ( index->log != NULL );
+	batch->count = count;
+
+	return batch;
+}
+
+bool SPDocumentBatchSetDocument(SPDocumentBatchRef batch, size_t slot, const char *uri, 
+		const char *text, size_t length) {
+
+	if ( slot >= batch->count ) return false;
+
+	SPBatchDocument *document = &batch->documents[slot];
+	size_t uriLength = strlen(uri);
+
+	// Refilling a slot replaces its document
+
+	free(document->uri);
+	free(document->contents);
+	SPAnalyzedTextFree(&document->text);
+	memset(document, 0, sizeof(SPBatchDocument));
+
+	if ( !SPAnalyzeText(&batch->options, text, length, &document->text) )
+		return false;
+
+	if ( batch->keepsText ) {
+		document->contents = malloc(length + 1);
+		if ( document->contents == NULL ) {
+			SPAnalyzedTextFree(&document->text);
+			return false;
+		}
+
+		memcpy(document->contents, text, length);
+		document->contentsLength = length;
+	}
+
+	document->uri = malloc(uriLength + 1);
+	if ( document->uri == NULL ) {
+		free(document->contents);
+		document->contents = NULL;
+		SPAnalyzedTextFree(&document->text);
+		return false;
+	}
+
+	memcpy(document->uri, uri, uriLength + 1);
+	document->uriLength = uriLength;
+
+	__sync_fetch_and_add(&batch->byteCount, length);
+	return true;
+}
+
+size_t SPIndexAddDocumentBatch(SPIndexRef index, SPDocumentBatchRef batch) {
+
+	// The analyzed documents move into the write buffer, so the batch slots are emptied
+
+	size_t i, added = 0;
+
+	SPIndexLockForWriting(index);
+
+	for ( i = 0; i < batch->count; i++ ) {
+		SPBatchDocument *document = &batch->documents[i];
+		if ( document->uri == NULL ) continue;
+
+		if ( SPIndexBufferDocument(index, document->uri, document->uriLength, &document->text) != kSPIndexNotFound ) {
+			if ( index->log != NULL ) SPIndexLogAppend(index->log, kSPIndexLogAdd, document->uri, document->uriLength, 
+					document->contents, document->contentsLength);
+			free(document->contents);
+			memset(document, 0, sizeof(SPBatchDocument));
+			added++;
+		}
+	}
+
+	if ( added > 0 ) SPIndexDidBufferDocuments(index);
+
+	SPIndexUnlockForWriting(index);
+
+	if ( added > 0 && !index->hasMaintenanceThread ) SPIndexMerge(index);
+	if ( added > 0 && index->log != NULL ) SPIndexLogCommitIfFull(index->log);
+	return added;
+}
+
+size_t SPDocumentBatchGetByteCount(SPDocumentBatchRef batch) {
+	return __sync_fetch_and_add(&batch->byteCount, 0);
+}
+
+void SPDocumentBatchRelease(SPDocumentBatchRef batch) {
+
+	size_t i;
+
+	if ( batch == NULL ) return;
+
+	for ( i = 0; i < batch->count; i++ ) {
+		free(batch->documents[i].uri);
+		free(batch->documents[i].contents);
+		SPAnalyzedTextFree(&batch->documents[i].text);
+	}
+
+	free(batch->documents);
+	free(batch);
+}
+
+#pragma mark -
+#pragma mark Refreshing and Merging
+
+bool SPIndexRefreshLocked(SPIndexRef index) {
+
+	// Writes the buffer out as a segment and publishes it together with the pending
+	// deletions. Called with the write lock held, which keeps other writers out while
+	// the segment is built but never blocks a reader.
+
+	SPSnapshot *current = index->snapshot;
+	SPSnapshot *snapshot = NULL;
+	SPSegmentSource *sources = NULL;
+	SPSegment *segment = NULL;
+	size_t i, count = 0;
+
+	if ( index->bufferCount == 0 && index->pendingCount == 0 )
+		return true;
+
+	SPStatisticsStart(started);
+	SPStatisticsCount(kSPStatisticFlushChanges, index->bufferCount + index->pendingCount);
+
+	sources = malloc(( index->bufferCount == 0 ? 1 : index->bufferCount ) * sizeof(SPSegmentSource));
+	if ( sources == NULL ) return false;
+
+	for ( i = 0; i < index->bufferCount; i++ ) {
+		SPBufferedDocument *buffered = &index->buffer[i];
+		if ( buffered->removed ) continue;
+
+		sources[count].document = buffered->document;
+		sources[count].uri = buffered->uri;
+		sources[count].uriLength = buffered->uriLength;
+		sources[count].text = &buffered->text;
+		count++;
+	}
+
+	if ( count > 0 ) {
+		segment = SPSegmentCreate(sources, count, index->directory);
+		if ( segment == NULL ) goto bail;
+	}
+
+	snapshot = SPSnapshotCreate(index, current->segmentCount + ( segment == NULL ? 0 : 1 ));
+	if ( snapshot == NULL ) goto bail;
+
+	for ( i = 0; i < current->segmentCount; i++ ) {
+		snapshot->segments[i] = SPSegmentRetain(current->segments[i]);
+		snapshot->deletedCounts[i] = current->deletedCounts[i];
+	}
+
+	snapshot->segmentCount = current->segmentCount;
+	snapshot->documentCount = current->documentCount;
+	snapshot->tokenCount = current->tokenCount;
+	snapshot->maximumDocumentID = current->maximumDocumentID;
+
+	if ( segment != NULL ) {
+		snapshot->segments[snapshot->segmentCount++] = segment;
+		snapshot->documentCount += segment->documentCount;
+		snapshot->tokenCount += segment->tokenCount;
+		snapshot->maximumDocumentID = SPSegmentGetLastDocument(segment);
+		segment = NULL;
+	}
+
+	// Pending deletions are applied to a copy of the deletion set, since readers may be
+	// using the current one. Without deletions the set is shared.
+
+	if ( index->pendingCount == 0 ) {
+		snapshot->deleted = SPDeletionSetRetain(current->deleted);
+	}
+	else {
+		snapshot->deleted = SPDeletionSetCreateCopy(current->deleted, index->maximumDocumentID + 1);
+		if ( snapshot->deleted == NULL ) goto bail;
+
+		for ( i = 0; i < index->pendingCount; i++ ) {
+			SPDocumentID document = index->pendingDeletions[i];
+			size_t s = SPSnapshotFindSegment(snapshot, document);
+			const SPSegmentDocument *info = SPSegmentFindDocument(snapshot->segments[s], document);
+
+			SPDeletionSetAdd(snapshot->deleted, document);
+			snapshot->deletedCounts[s]++;
+			snapshot->documentCount--;
+			snapshot->tokenCount -= info->length;
+		}
+	}
+
+	// Failing to sign the new documents leaves the signature index finding nothing
+
+	if ( index->signatures != NULL ) {
+		if ( snapshot->segmentCount > current->segmentCount )
+			SPSignatureIndexAddSegment(index->signatures, snapshot->segments[snapshot->segmentCount - 1]);
+		SPSignatureIndexRemoveDocuments(index->signatures, index->pendingDeletions, index->pendingCount);
+	}
+
+	SPIndexPublishSnapshot(index, snapshot);
+	snapshot = NULL;
+
+	for ( i = 0; i < index->bufferCount; i++ ) {
+		free(index->buffer[i].uri);
+		SPAnalyzedTextFree(&index->buffer[i].text);
+	}
+
+	index->bufferCount = 0;
+	index->pendingCount = 0;
+	index->refreshedDocumentID = index->maximumDocumentID;
+
+bail:
+	SPSegmentRelease(segment);
+	SPSnapshotRelease(snapshot);
+	free(sources);
+
+	SPStatisticsStop(kSPStatisticFlush, started);
+	return ( index->bufferCount == 0 && index->pendingCount == 0 );
+}
+
+bool SPIndexRefresh(SPIndexRef index) {
+
+	bool success;
+
+	SPIndexLockForWriting(index);
+	success = SPIndexRefreshLocked(index);
+	SPIndexUnlockForWriting(index);
+
+	if ( success ) success = SPIndexMerge(index);
+	return success;
+}
+
+static bool SPSnapshotFindMergeRun(const SPSnapshot *snapshot, uint32_t mergeFactor, size_t *outStart, size_t *outCount) {
+
+	// A log merge policy. A segment's level is log_mergeFactor(live documents). Working
+	// from the oldest segment, the segments down to the last one within 0.75 of the
+	// highest remaining level form a band, and mergeFactor neighbours within a band are
+	// merged into one segment of the next level. The segment count therefore stays
+	// logarithmic in the size of the index, each document is rewritten a logarithmic
+	// number of times, and small new segments are never merged into a large old one.
+	// Segments emptied by deletions fall to level 0 and are merged away with small ones.
+
+	double levels[64];
+	double *segmentLevels = ( snapshot->segmentCount <= 64 ? levels : malloc(snapshot->segmentCount * sizeof(double)) );
+	double factor = log((double)mergeFactor);
+	size_t i, start = 0;
+	bool found = false;
+
+	if ( segmentLevels == NULL ) return false;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		uint32_t live = snapshot->segments[i]->documentCount - snapshot->deletedCounts[i];
+		segmentLevels[i] = log((double)( live == 0 ? 1 : live )) / factor;
+	}
+
+	while ( start < snapshot->segmentCount && !found ) {
+		double maximumLevel = 0.0, bottomLevel;
+		size_t end = start;
+
+		for ( i = start; i < snapshot->segmentCount; i++ ) {
+			if ( segmentLevels[i] > maximumLevel ) maximumLevel = segmentLevels[i];
+		}
+
+		bottomLevel = ( maximumLevel < 1.0 ? -1.0 : maximumLevel - 0.75 );
+
+		for ( i = start; i < snapshot->segmentCount; i++ ) {
+			if ( segmentLevels[i] >= bottomLevel ) end = i + 1;
+		}
+
+		if ( end - start >= mergeFactor ) {
+			*outStart = start;
+			*outCount = mergeFactor;
+			found = true;
+		}
+
+		start = end;
+	}
+
+	if ( segmentLevels != levels ) free(segmentLevels);
+	return found;
+}
+
+static bool SPIndexPublishMerge(SPIndexRef index, const SPSnapshot *source, size_t start, size_t count, SPSegment *merged) {
+
+	// Replaces the merged run in the current snapshot. Only merges remove segments and
+	// they are serialized, so the run is still in place; refreshes will at most have
+	// appended segments or deleted more documents. Called with the write lock held.
+
+	SPSnapshot *current = index->snapshot;
+	SPSnapshot *snapshot;
+	size_t i, j = 0;
+	uint32_t deletedCount = 0;
+
+	if ( current->deleted != source->deleted ) {
+		for ( i = 0; i < merged->documentCount; i++ ) {
+			if ( SPDeletionSetContains(current->deleted, merged->documents[i].document) ) deletedCount++;
+		}
+	}
+
+	snapshot = SPSnapshotCreate(index, current->segmentCount - count + 1);
+	if ( snapshot == NULL ) return false;
+
+	for ( i = 0; i < current->segmentCount; i++ ) {
+		if ( i == start && merged->documentCount > 0 ) {
+			snapshot->segments[j] = SPSegmentRetain(merged);
+			snapshot->deletedCounts[j] = deletedCount;
+			j++;
+		}
+
+		if ( i >= start && i < start + count ) continue;
+
+		snapshot->segments[j] = SPSegmentRetain(current->segments[i]);
+		snapshot->deletedCounts[j] = current->deletedCounts[i];
+		j++;
+	}
+
+	snapshot->segmentCount = j;
+	snapshot->deleted = SPDeletionSetRetain(current->deleted);
+	snapshot->documentCount = current->documentCount;
+	snapshot->tokenCount = current->tokenCount;
+	snapshot->maximumDocumentID = current->maximumDocumentID;
+
+	SPIndexPublishSnapshot(index, snapshot);
+	return true;
+}
+
+static bool SPIndexMerge(SPIndexRef index) {
+
+	// Segments are merged from a snapshot without holding the write lock, so neither
+	// readers nor writers wait on a merge. Only publishing the result takes the lock.
+	// Merges give way to a merge or compaction step already in progress.
+
+	bool success = true;
+
+	if ( pthread_mutex_trylock(&index->mergeLock) != 0 ) return true;
+
+	while ( success ) {
+		SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+		SPSegment *merged = NULL;
+		size_t start = 0, count = 0;
+		bool found = SPSnapshotFindMergeRun(snapshot, index->options.mergeFactor, &start, &count);
+
+		if ( found ) {
+			SPStatisticsStart(started);
+			
+			merged = SPSegmentCreateByMerging(snapshot->segments + start, count, snapshot->deleted);
+			success = ( merged != NULL );
+			
+			if ( merged != NULL ) {
+				SPIndexLockForWriting(index);
+				success = SPIndexPublishMerge(index, snapshot, start, count, merged);
+				SPIndexUnlockForWriting(index);
+			}
+			
+			SPStatisticsStop(kSPStatisticMerge, started);
+		}
+
+		SPSegmentRelease(merged);
+		SPSnapshotRelease(snapshot);
+
+		if ( !found ) break;
+	}
+
+	pthread_mutex_unlock(&index->mergeLock);
+	return success;
+}
+
+static int SPCompactionCandidateCompare(const void *a, const void *b) {
+	const SPCompactionCandidate *first = a, *second = b;
+	return ( first->ratio < second->ratio ? 1 : ( first->ratio > second->ratio ? -1 : 0 ) );
+}
+
+static bool SPIndexExpungeSegment(SPIndexRef index, const SPSegment *segment) {
+
+	// Rewrites one segment without its removed documents and swaps it in. The segment
+	// is looked up again in a fresh snapshot under the merge lock, since a policy merge
+	// may have folded it into another one since compaction started. A segment that was
+	// merged away has already been expunged.
+
+	SPSnapshot *snapshot;
+	SPSegment *rewritten = NULL;
+	size_t i;
+	bool success = true;
+
+	pthread_mutex_lock(&index->mergeLock);
+	snapshot = SPIndexCopySnapshot(index);
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		if ( snapshot->segments[i] == segment ) break;
+	}
+
+	if ( i < snapshot->segmentCount && snapshot->deletedCounts[i] > 0 ) {
+		SPStatisticsStart(started);
+
+		rewritten = SPSegmentCreateByMerging(snapshot->segments + i, 1, snapshot->deleted);
+		success = ( rewritten != NULL );
+
+		if ( rewritten != NULL ) {
+			SPIndexLockForWriting(index);
+			success = SPIndexPublishMerge(index, snapshot, i, 1, rewritten);
+			SPIndexUnlockForWriting(index);
+		}
+
+		SPStatisticsStop(kSPStatisticMerge, started);
+	}
+
+	SPSegmentRelease(rewritten);
+	SPSnapshotRelease(snapshot);
+	pthread_mutex_unlock(&index->mergeLock);
+
+	return success;
+}
+
+bool SPIndexCompact(SPIndexRef index) {
+
+	// Compaction is incremental. The segments holding removed documents are rewritten one
+	// at a time, most wasteful first, and each is published as soon as it is done, so
+	// searches, writers and the maintenance thread's merges run in between. The merge
+	// lock is only held for a single segment, and with a duty cycle below 1 the thread
+	// sleeps after each one in proportion to how long it took.
+
+	SPSnapshot *snapshot;
+	SPCompactionCandidate *candidates = NULL;
+	double dutyCycle = index->options.compactionDutyCycle;
+	size_t i, count = 0;
+	bool success;
+
+	SPIndexLockForWriting(index);
+	success = SPIndexRefreshLocked(index);
+	SPIndexUnlockForWriting(index);
+
+	snapshot = SPIndexCopySnapshot(index);
+	candidates = malloc(( snapshot->segmentCount == 0 ? 1 : snapshot->segmentCount ) * sizeof(SPCompactionCandidate));
+
+	if ( candidates == NULL ) {
+		SPSnapshotRelease(snapshot);
+		return false;
+	}
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		if ( snapshot->deletedCounts[i] == 0 ) continue;
+
+		candidates[count].segment = SPSegmentRetain(snapshot->segments[i]);
+		candidates[count].ratio = (double)snapshot->deletedCounts[i] / (double)snapshot->segments[i]->documentCount;
+		count++;
+	}
+
+	SPSnapshotRelease(snapshot);
+	qsort(candidates, count, sizeof(SPCompactionCandidate), SPCompactionCandidateCompare);
+
+	for ( i = 0; i < count; i++ ) {
+		uint64_t started = SPStatisticsGetTime();
+
+		if ( success ) success = SPIndexExpungeSegment(index, candidates[i].segment);
+		SPSegmentRelease(candidates[i].segment);
+
+		if ( success && dutyCycle > 0.0 && dutyCycle < 1.0 && i + 1 < count ) {
+			double pause = (double)( SPStatisticsGetTime() - started ) * ( 1.0 - dutyCycle ) / dutyCycle;
+			struct timespec interval;
+
+			interval.tv_sec = (time_t)( pause / 1e9 );
+			interval.tv_nsec = (long)( pause - (double)interval.tv_sec * 1e9 );
+			while ( nanosleep(&interval, &interval) != 0 && errno == EINTR );
+		}
+	}
+
+	free(candidates);
+
+	// Emptied and shrunken segments are left for the merge policy to fold into their
+	// neighbours
+
+	return ( SPIndexMerge(index) && success );
+}
+
+size_t SPIndexGetSegmentCount(SPIndexRef index) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	size_t count = snapshot->segmentCount;
+	SPSnapshotRelease(snapshot);
+	return count;
+}
+
+uint64_t SPIndexGetGeneration(SPIndexRef index) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	uint64_t generation = snapshot->generation;
+	SPSnapshotRelease(snapshot);
+	return generation;
+}
+
+#pragma mark -
+#pragma mark Documents
+
+size_t SPIndexGetDocumentCount(SPIndexRef index) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	size_t count = snapshot->documentCount;
+	SPSnapshotRelease(snapshot);
+	return count;
+}
+
+SPDocumentID SPIndexGetMaximumDocumentID(SPIndexRef index) {
+	SPDocumentID document;
+
+	SPIndexLockForWriting(index);
+	document = index->maximumDocumentID;
+	SPIndexUnlockForWriting(index);
+
+	return document;
+}
+
+SPDocumentID SPIndexGetDocumentID(SPIndexRef index, const char *uri) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	const SPSegmentDocument *document = SPSnapshotFindURI(snapshot, uri, strlen(uri), NULL);
+	SPDocumentID documentID = ( document == NULL ? kSPIndexNotFound : document->document );
+
+	SPSnapshotRelease(snapshot);
+	return documentID;
+}
+
+SPDocumentState SPIndexGetDocumentState(SPIndexRef index, const char *uri) {
+
+	// Compares the writer's view of the document with the published one
+
+	SPDocumentState state;
+	size_t length = strlen(uri);
+
+	SPIndexLockForWriting(index);
+
+	SPDocumentID document = SPStringTableGetValue(index->documentTable, uri, length);
+
+	if ( document != kSPStringTableNotFound )
+		state = ( document > index->refreshedDocumentID ? kSPDocumentStateAddPending : kSPDocumentStateIndexed );
+	else if ( SPSnapshotFindURI(index->snapshot, uri, length, NULL) != NULL )
+		state = kSPDocumentStateDeletePending;
+	else
+		state = kSPDocumentStateNotIndexed;
+
+	SPIndexUnlockForWriting(index);
+	return state;
+}
+
+static size_t SPCopyString(const char *string, size_t length, char **outString) {
+	char *copy = malloc(length + 1);
+	if ( copy == NULL ) return 0;
+
+	memcpy(copy, string, length);
+	copy[length] = '\0';
+
+	*outString = copy;
+	return length;
+}
+
+size_t SPIndexCopyDocumentURI(SPIndexRef index, SPDocumentID document, char **outURI) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	const SPSegment *segment = NULL;
+	const SPSegmentDocument *info = SPSnapshotFindDocument(snapshot, document, &segment);
+	size_t length = 0;
+
+	if ( info != NULL ) length = SPCopyString(segment->uris + info->uriOffset, info->uriLength, outURI);
+
+	SPSnapshotRelease(snapshot);
+	return length;
+}
+
+size_t SPIndexGetDocumentURI(SPIndexRef index, SPDocumentID document, char *buffer, size_t capacity) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	const SPSegment *segment = NULL;
+	const SPSegmentDocument *info = SPSnapshotFindDocument(snapshot, document, &segment);
+	size_t length = 0;
+
+	if ( info != NULL ) {
+		length = info->uriLength;
+		if ( length <= capacity ) memcpy(buffer, segment->uris + info->uriOffset, length);
+	}
+
+	SPSnapshotRelease(snapshot);
+	return length;
+}
+
+void SPIndexEnumerateDocuments(SPIndexRef index, SPIndexDocumentCallback callback, void *context) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	size_t i, j;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegment *segment = snapshot->segments[i];
+
+		for ( j = 0; j < segment->documentCount; j++ ) {
+			const SPSegmentDocument *info = &segment->documents[j];
+			if ( SPDeletionSetContains(snapshot->deleted, info->document) ) continue;
+
+			if ( !callback(info->document, segment->uris + info->uriOffset, info->uriLength, info->termCount, context) )
+				goto done;
+		}
+	}
+
+done:
+	SPSnapshotRelease(snapshot);
+}
+
+#pragma mark -
+#pragma mark Document Data
+
+static bool SPIndexSetDocumentDataSlot(SPIndexRef index, const char *uri, size_t uriLength, void *copy, size_t length) {
+
+	// Takes ownership of copy only when it succeeds. Called with the data lock held for
+	// writing.
+
+	int32_t slot = SPStringTableGetValue(index->dataTable, uri, uriLength);
+	SPDocumentData *data;
+	uint32_t uriOffset;
+
+	if ( length == 0 ) {
+		if ( slot != kSPStringTableNotFound ) {
+			SPStringTableRemoveValue(index->dataTable, uri, uriLength);
+			free(index->data[slot].bytes);
+			index->data[slot].bytes = NULL;
+			index->data[slot].length = index->freeData;
+			index->freeData = (size_t)slot;
+		}
+		return true;
+	}
+
+	if ( slot != kSPStringTableNotFound ) {
+		data = &index->data[slot];
+		free(data->bytes);
+		data->bytes = copy;
+		data->length = length;
+		return true;
+	}
+
+	// A new URI takes a free slot, or one from the end
+
+	if ( index->freeData == SIZE_MAX && index->dataCount == index->dataCapacity ) {
+		size_t capacity = ( index->dataCapacity == 0 ? 64 : index->dataCapacity * 2 );
+		SPDocumentData *slots = ( capacity > INT32_MAX ? NULL : realloc(index->data, capacity * sizeof(SPDocumentData)) );
+
+		if ( slots == NULL ) return false;
+
+		index->data = slots;
+		index->dataCapacity = capacity;
+	}
+
+	slot = (int32_t)( index->freeData != SIZE_MAX ? index->freeData : index->dataCount );
+
+	if ( uriLength > UINT32_MAX || !SPStringTableSetValue(index->dataTable, uri, uriLength, slot, &uriOffset) )
+		return false;
+
+	data = &index->data[slot];
+	if ( index->freeData != SIZE_MAX ) index->freeData = data->length;
+	else index->dataCount++;
+
+	data->bytes = copy;
+	data->length = length;
+	data->uriOffset = uriOffset;
+	data->uriLength = (uint32_t)uriLength;
+
+	return true;
+}
+
+bool SPIndexSetDocumentDataLocked(SPIndexRef index, const char *uri, size_t uriLength, const void *bytes, size_t length) {
+
+	// The data is copied before the data lock is taken, so readers only wait for the table
+	// itself to change
+
+	void *copy = NULL;
+	bool success;
+
+	if ( length > 0 ) {
+		copy = malloc(length);
+		if ( copy == NULL ) return false;
+		memcpy(copy, bytes, length);
+	}
+
+	pthread_rwlock_wrlock(&index->dataLock);
+	success = SPIndexSetDocumentDataSlot(index, uri, uriLength, copy, length);
+	pthread_rwlock_unlock(&index->dataLock);
+
+	if ( !success ) free(copy);
+	return success;
+}
+
+bool SPIndexSetDocumentData(SPIndexRef index, const char *uri, const void *bytes, size_t length) {
+
+	size_t uriLength = strlen(uri);
+	bool success;
+
+	SPIndexLockForWriting(index);
+
+	success = SPIndexSetDocumentDataLocked(index, uri, uriLength, bytes, length);
+	if ( success && index->log != NULL ) SPIndexLogAppend(index->log, kSPIndexLogSetData, uri, uriLength, bytes, length);
+
+	SPIndexUnlockForWriting(index);
+
+	if ( success && index->log != NULL ) SPIndexLogCommitIfFull(index->log);
+	return success;
+}
+
+size_t SPIndexCopyDocumentData(SPIndexRef index, const char *uri, void **outBytes) {
+
+	size_t length = 0;
+
+	pthread_rwlock_rdlock(&index->dataLock);
+
+	int32_t slot = SPStringTableGetValue(index->dataTable, uri, strlen(uri));
+	if ( slot != kSPStringTableNotFound && ( *outBytes = malloc(index->data[slot].length) ) != NULL ) {
+		length = index->data[slot].length;
+		memcpy(*outBytes, index->data[slot].bytes, length);
+	}
+
+	pthread_rwlock_unlock(&index->dataLock);
+	return length;
+}
+
+#pragma mark -
+#pragma mark Terms
+
+SPTermID SPIndexGetMaximumTermID(SPIndexRef index) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	SPTermID term = snapshot->termCount;
+	SPSnapshotRelease(snapshot);
+	return term;
+}
+
+size_t SPIndexAnalyzeTerm(SPIndexRef index, char *term, size_t length) {
+	return ( length == 0 ? 0 : SPAnalyzeTerm(&index->options, term, length) );
+}
+
+SPTermID SPIndexGetTermID(SPIndexRef index, const char *term, size_t length) {
+
+	// The term directory's own table belongs to the writer, so look in the segments
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	SPTermID termID = kSPIndexNotFound;
+	size_t i;
+
+	for ( i = snapshot->segmentCount; i-- > 0 && termID == kSPIndexNotFound; ) {
+		const SPSegmentTerm *info = SPSegmentFindTerm(snapshot->segments[i], term, length);
+		if ( info != NULL ) termID = info->term;
+	}
+
+	SPSnapshotRelease(snapshot);
+	return termID;
+}
+
+size_t SPIndexCopyTerm(SPIndexRef index, SPTermID term, char **outTerm) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	size_t length = 0;
+
+	if ( term >= 0 && term < snapshot->termCount ) {
+		const char *string = SPTermDirectoryGetTerm(snapshot->directory, term, &length);
+		length = SPCopyString(string, length, outTerm);
+	}
+
+	SPSnapshotRelease(snapshot);
+	return length;
+}
+
+static size_t SPSnapshotGetTermDocumentCount(const SPSnapshot *snapshot, SPTermID term) {
+
+	const char *string;
+	size_t i, length, count = 0;
+
+	if ( term < 0 || term >= snapshot->termCount ) return 0;
+	string = SPTermDirectoryGetTerm(snapshot->directory, term, &length);
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegmentTerm *info = SPSegmentFindTerm(snapshot->segments[i], string, length);
+		if ( info != NULL ) count += SPSnapshotGetLiveDocumentCount(snapshot, i, info);
+	}
+
+	return count;
+}
+
+void SPIndexSetCollectionStatistics(SPIndexRef index, const SPCollectionStatistics *statistics) {
+
+	// Searches read the statistics without a lock, so they are set before the index is
+	// searched, as SPIndex.h asks
+
+	SPIndexLockForWriting(index);
+
+	index->hasCollection = ( statistics != NULL );
+	if ( statistics != NULL ) index->collection = *statistics;
+	else memset(&index->collection, 0, sizeof(SPCollectionStatistics));
+
+	SPIndexUnlockForWriting(index);
+}
+
+void SPIndexGetCollectionCounts(SPIndexRef index, uint64_t *outDocumentCount, uint64_t *outTokenCount) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	uint64_t documentCount = 0, tokenCount = 0;
+	size_t i;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		documentCount += snapshot->segments[i]->documentCount;
+		tokenCount += snapshot->segments[i]->tokenCount;
+	}
+
+	SPSnapshotRelease(snapshot);
+	*outDocumentCount = documentCount;
+	*outTokenCount = tokenCount;
+}
+
+size_t SPIndexGetTermDocumentFrequency(SPIndexRef index, const char *term, size_t length) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	size_t i, count = 0;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegmentTerm *info = SPSegmentFindTerm(snapshot->segments[i], term, length);
+		if ( info != NULL ) count += info->documentCount;
+	}
+
+	SPSnapshotRelease(snapshot);
+	return count;
+}
+
+size_t SPIndexGetTermDocumentCount(SPIndexRef index, SPTermID term) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	size_t count = SPSnapshotGetTermDocumentCount(snapshot, term);
+	SPSnapshotRelease(snapshot);
+	return count;
+}
+
+size_t SPIndexCopyDocumentIDsForTerm(SPIndexRef index, SPTermID term, SPDocumentID **outDocuments) {
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	size_t i, count = 0, capacity = SPSnapshotGetTermDocumentCount(snapshot, term);
+	SPDocumentID *documents = NULL;
+
+	*outDocuments = NULL;
+
+	if ( capacity > 0 && ( documents = malloc(capacity * sizeof(SPDocumentID)) ) != NULL ) {
+		size_t length;
+		const char *string = SPTermDirectoryGetTerm(snapshot->directory, term, &length);
+
+		for ( i = 0; i < snapshot->segmentCount; i++ ) {
+			const SPSegment *segment = snapshot->segments[i];
+			const SPSegmentTerm *info = SPSegmentFindTerm(segment, string, length);
+			SPPostingIterator iterator;
+
+			if ( info == NULL ) continue;
+
+			SPPostingIteratorInit(&iterator, segment->postings + info->postingsOffset, info->postingsLength);
+			while ( SPPostingIteratorNext(&iterator) ) {
+				if ( !SPDeletionSetContains(snapshot->deleted, (SPDocumentID)iterator.document) )
+					documents[count++] = (SPDocumentID)iterator.document;
+			}
+		}
+
+		*outDocuments = documents;
+	}
+
+	SPSnapshotRelease(snapshot);
+	return count;
+}
+
+void SPIndexEnumerateTerms(SPIndexRef index, SPIndexTermCallback callback, void *context) {
+
+	// Document counts are totalled over the segments first so that terms can be reported
+	// in ID order
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	uint32_t *counts = calloc((size_t)snapshot->termCount + 1, sizeof(uint32_t));
+	size_t i, j;
+
+	if ( counts != NULL ) {
+		for ( i = 0; i < snapshot->segmentCount; i++ ) {
+			const SPSegment *segment = snapshot->segments[i];
+			for ( j = 0; j < segment->termCount; j++ )
+				counts[segment->terms[j].term] += (uint32_t)SPSnapshotGetLiveDocumentCount(snapshot, i, &segment->terms[j]);
+		}
+
+		for ( i = 0; i < (size_t)snapshot->termCount; i++ ) {
+			size_t length;
+			const char *string;
+
+			if ( counts[i] == 0 ) continue;
+
+			string = SPTermDirectoryGetTerm(snapshot->directory, (SPTermID)i, &length);
+			if ( !callback((SPTermID)i, string, length, counts[i], context) )
+				break;
+		}
+
+		free(counts);
+	}
+
+	SPSnapshotRelease(snapshot);
+}
+
+void SPIndexEnumerateTermsWithPrefix(SPIndexRef index, const char *prefix, size_t length, 
+		SPIndexTermCallback callback, void *context) {
+
+	// Each segment's dictionary is positioned at the prefix and the segments are merged by
+	// string. Equal strings carry equal IDs, so a term's document count is totalled over
+	// every reader positioned on it before they are all advanced together.
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	SPSegmentTermReader *readers = calloc(( snapshot->segmentCount == 0 ? 1 : snapshot->segmentCount ), sizeof(SPSegmentTermReader));
+	size_t i;
+
+	if ( readers == NULL ) goto bail;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		SPSegmentTermReaderSeek(&readers[i], snapshot->segments[i], prefix, length);
+		if ( readers[i].term != NULL && ( readers[i].length < length || memcmp(readers[i].string, prefix, length) != 0 ) )
+			readers[i].term = NULL;
+	}
+
+	for ( ;; ) {
+		const SPSegmentTermReader *smallest = NULL;
+		SPTermID term;
+		size_t documentCount = 0;
+		bool proceed = true;
+
+		for ( i = 0; i < snapshot->segmentCount; i++ ) {
+			if ( readers[i].term != NULL && ( smallest == NULL 
+					|| SPCompareStrings(readers[i].string, readers[i].length, smallest->string, smallest->length) < 0 ) )
+				smallest = &readers[i];
+		}
+
+		if ( smallest == NULL ) break;
+
+		term = smallest->term->term;
+
+		for ( i = 0; i < snapshot->segmentCount; i++ ) {
+			if ( readers[i].term != NULL && readers[i].term->term == term )
+				documentCount += SPSnapshotGetLiveDocumentCount(snapshot, i, readers[i].term);
+		}
+
+		if ( documentCount > 0 )
+			proceed = callback(term, smallest->string, smallest->length, documentCount, context);
+
+		if ( !proceed ) break;
+
+		for ( i = 0; i < snapshot->segmentCount; i++ ) {
+			if ( readers[i].term == NULL || readers[i].term->term != term ) 
+				continue;
+			if ( SPSegmentTermReaderNext(&readers[i]) && ( readers[i].length < length || memcmp(readers[i].string, prefix, length) != 0 ) )
+				readers[i].term = NULL;
+		}
+	}
+
+bail:
+	free(readers);
+	SPSnapshotRelease(snapshot);
+}
+
+#pragma mark -
+#pragma mark Term Vectors
+
+size_t SPIndexGetDocumentTermCount(SPIndexRef index, SPDocumentID document) {
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	const SPSegmentDocument *info = SPSnapshotFindDocument(snapshot, document, NULL);
+	size_t count = ( info == NULL ? 0 : info->termCount );
+
+	SPSnapshotRelease(snapshot);
+	return count;
+}
+
+size_t SPIndexCopyTermIDsForDocument(SPIndexRef index, SPDocumentID document,
+		SPTermID **outTerms, uint32_t **outFrequencies) {
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	const SPSegment *segment = NULL;
+	const SPSegmentDocument *info = SPSnapshotFindDocument(snapshot, document, &segment);
+	size_t count = 0;
+
+	*outTerms = NULL;
+	if ( outFrequencies != NULL ) *outFrequencies = NULL;
+
+	if ( info != NULL && info->termCount > 0 ) {
+		SPTermID *terms = malloc(info->termCount * sizeof(SPTermID));
+		uint32_t *frequencies = ( outFrequencies == NULL ? NULL : malloc(info->termCount * sizeof(uint32_t)) );
+		SPPostingIterator iterator;
+
+		if ( terms != NULL && ( outFrequencies == NULL || frequencies != NULL ) ) {
+			SPPostingIteratorInit(&iterator, segment->vectors + info->vectorOffset, info->vectorLength);
+			while ( SPPostingIteratorNext(&iterator) ) {
+				terms[count] = (SPTermID)iterator.document;
+				if ( frequencies != NULL ) frequencies[count] = iterator.frequency;
+				count++;
+			}
+			*outTerms = terms;
+			if ( outFrequencies != NULL ) *outFrequencies = frequencies;
+		}
+		else {
+			free(terms);
+			free(frequencies);
+		}
+	}
+
+	SPSnapshotRelease(snapshot);
+	return count;
+}
+
+uint32_t SPIndexGetDocumentTermFrequency(SPIndexRef index, SPDocumentID document, SPTermID term) {
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	const SPSegment *segment = NULL;
+	const SPSegmentDocument *info = SPSnapshotFindDocument(snapshot, document, &segment);
+	uint32_t frequency = 0;
+
+	if ( info != NULL ) {
+		SPPostingIterator iterator;
+
+		SPPostingIteratorInit(&iterator, segment->vectors + info->vectorOffset, info->vectorLength);
+		while ( SPPostingIteratorNext(&iterator) && iterator.document <= (uint32_t)term ) {
+			if ( iterator.document == (uint32_t)term ) {
+				frequency = iterator.frequency;
+				break;
+			}
+		}
+	}
+
+	SPSnapshotRelease(snapshot);
+	return frequency;
+}
+
+#pragma mark -
+
+size_t SPIndexGetMemorySize(SPIndexRef index) {
+
+	size_t size = sizeof(struct __SPIndex);
+	SPSnapshot *snapshot;
+	size_t i;
+
+	SPIndexLockForWriting(index);
+
+	size += SPTermDirectoryGetMemorySize(index->directory);
+	if ( index->trigrams != NULL ) size += SPTrigramIndexGetMemorySize(index->trigrams);
+	if ( index->signatures != NULL ) size += SPSignatureIndexGetMemorySize(index->signatures);
+	size += SPStringTableGetMemorySize(index->documentTable);
+	size += index->bufferCapacity * sizeof(SPBufferedDocument);
+	size += index->pendingCapacity * sizeof(SPDocumentID);
+	size += SPStringTableGetMemorySize(index->dataTable) + index->dataCapacity * sizeof(SPDocumentData);
+
+	for ( i = 0; i < index->dataCount; i++ ) size += ( index->data[i].bytes == NULL ? 0 : index->data[i].length );
+
+	for ( i = 0; i < index->bufferCount; i++ ) {
+		const SPAnalyzedText *text = &index->buffer[i].text;
+		size += index->buffer[i].uriLength + text->capacity * 3 * sizeof(uint32_t) + text->slotCapacity * sizeof(int32_t);
+		if ( text->positions != NULL ) size += ( text->tokenCount + text->count + 1 ) * sizeof(uint32_t);
+	}
+
+	SPIndexUnlockForWriting(index);
+
+	snapshot = SPIndexCopySnapshot(index);
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) size += snapshot->segments[i]->memorySize;
+	if ( snapshot->deleted != NULL ) size += snapshot->deleted->capacity / 8;
+
+	SPSnapshotRelease(snapshot);
+	return size;
+}
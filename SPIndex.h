@@ -0,0 +1,417 @@
+//
+//  SPIndex.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPINDEX_H
+#define SPINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// SPIndex is the native inverted index used by SPNativeBackend. It is written in plain
+// C99 with pthreads so that the same index can be built, profiled and benchmarked on
+// platforms without SearchKit. The API deliberately mirrors the SearchKit calls it
+// replaces: documents are identified by a URI string and an integer ID, terms by a
+// string and an integer ID, and searches are created once and then drained in chunks.
+
+// Document IDs start at 1 and are never reused, just like SearchKit's. Term IDs start
+// at 0 and are stable for the lifetime of the index. Terms whose documents have all
+// been removed keep their IDs but are no longer enumerated.
+
+// Internally the index is a set of immutable segments. Added documents are buffered
+// and become searchable when the index is refreshed, which writes the buffer out as a
+// new segment, and a merge policy combines small segments into larger ones in the
+// background. Readers work from a snapshot of the segments taken when the call begins:
+// they never wait on writers, refreshes or merges, and always see one consistent state
+// of the index. Refreshing is the native counterpart of SKIndexFlush.
+
+// An SPIndexRef is thread safe. Any number of threads may search, read and write at
+// once. Text passed to the index must be UTF-8. Only ASCII letters are case folded;
+// SPNativeBackend folds case and diacritics with Foundation before handing text over.
+
+typedef struct __SPIndex * SPIndexRef;
+typedef struct __SPSearch * SPSearchRef;
+typedef struct __SPDocumentBatch * SPDocumentBatchRef;
+
+typedef int32_t SPDocumentID;
+typedef int32_t SPTermID;
+
+#define kSPIndexNotFound (-1)
+
+typedef enum {
+	kSPSearchOptionDefault				= 0,
+	kSPSearchOptionNoRelevanceScores	= 1 << 0,
+	kSPSearchOptionSpaceMeansOR			= 1 << 1,
+	kSPSearchOptionFindSimilar			= 1 << 2
+} SPSearchOptions;
+
+	// The values match SKSearchOptions so that options can be passed straight through.
+
+typedef enum {
+	kSPDocumentStateNotIndexed		= 0,
+	kSPDocumentStateIndexed			= 1,
+	kSPDocumentStateAddPending		= 2,
+	kSPDocumentStateDeletePending	= 3
+} SPDocumentState;
+
+	// The values match SKDocumentState. A change is pending until the next refresh.
+
+typedef struct {
+	uint32_t minTermLength;			// in characters, terms shorter than this are not indexed
+	uint32_t maximumTerms;			// distinct terms indexed per document, 0 for no limit
+	double refreshInterval;			// in seconds, 0 to refresh before every add or remove returns
+	uint32_t mergeFactor;			// segments of a size merged at once, 0 for the default of 8
+	uint32_t maximumBufferedDocuments;	// refresh early once this many are buffered, 0 for no limit
+	bool indexesTrigrams;			// keep a trigram index over the terms for wildcard queries
+	bool indexesSignatures;			// keep MinHash signatures of the documents, see SPSimilarity.h
+	double compactionDutyCycle;		// share of the time compaction may run, 0 for no limit
+	uint32_t stopWordLanguages;		// kSPLanguage values whose stop words are not indexed
+	uint32_t analysisFlags;			// kSPAnalysisExcludesNumbers, kSPAnalysisStemsTerms
+	bool indexesPositions;			// keep term positions for phrase and NEAR queries
+} SPIndexOptions;
+
+enum {
+	kSPAnalysisExcludesNumbers		= 1 << 0,	// terms beginning with a digit are not indexed
+	kSPAnalysisStemsTerms			= 1 << 1	// terms are indexed by their English stems
+};
+
+	// The index always keeps document -> term vectors alongside the postings, so it
+	// behaves like a kSKIndexInvertedVector SearchKit index.
+
+	// With a refreshInterval above zero a maintenance thread refreshes the index that
+	// often and runs merges, so writers return as soon as a document is buffered. With
+	// zero, every add and remove refreshes and merges on the calling thread, and changes
+	// are visible as soon as the call returns.
+
+	// Without the trigram index a wildcard term is matched against every term in the
+	// dictionary. With it, the terms containing each run of literal characters in the
+	// pattern are looked up and only those are matched, which keeps *substring* and
+	// *suffix queries fast as the vocabulary grows at the cost of some memory.
+
+	// Stop words, numbers and stemming are applied as text is analyzed, before anything
+	// reaches the postings, so excluded terms cost nothing to store or merge. Stop words
+	// are checked before a term is stemmed, see SPStopWords.h and SPStemmer.h. Query terms
+	// other than wildcards are analyzed the same way, so a search for "connecting" finds
+	// documents containing "connected", and a phrase keeps its remaining words. These
+	// settings are saved with the index and cannot change once documents are indexed.
+
+	// With indexesPositions every posting also records where in the document the term
+	// occurs, a byte or two for each occurrence, which makes the benchmark's index about a
+	// quarter larger. Phrases then match only documents with their terms side by side, and
+	// NEAR matches terms close together. Without positions both match any document
+	// containing all of their terms. Positions count every word, stop words included, so a
+	// phrase whose stop words were dropped still requires the same gaps between the words
+	// that remain. The setting is saved with the index.
+
+SPIndexRef SPIndexCreate(const SPIndexOptions *options);
+void SPIndexRelease(SPIndexRef index);
+
+	// options may be NULL for a minimum term length of 1, no term limit and synchronous
+	// refreshes. Releasing the index stops its maintenance thread; buffered documents
+	// that were never refreshed are discarded.
+
+SPDocumentID SPIndexAddDocument(SPIndexRef index, const char *uri, const char *text, size_t length);
+bool SPIndexRemoveDocument(SPIndexRef index, const char *uri);
+
+	// Adding a document whose URI is already indexed replaces the previous version, which
+	// receives a new document ID. Returns the new ID or kSPIndexNotFound on failure.
+
+SPDocumentBatchRef SPDocumentBatchCreate(SPIndexRef index, size_t count);
+bool SPDocumentBatchSetDocument(SPDocumentBatchRef batch, size_t slot, const char *uri, 
+		const char *text, size_t length);
+size_t SPIndexAddDocumentBatch(SPIndexRef index, SPDocumentBatchRef batch);
+void SPDocumentBatchRelease(SPDocumentBatchRef batch);
+
+	// Batches split indexing into an analysis step that does not touch the index and a
+	// single merge under the write lock. SPDocumentBatchSetDocument tokenizes one document
+	// into its own buffers and may be called from many threads at once, provided each
+	// thread fills different slots. SPIndexAddDocumentBatch then adds every filled slot in
+	// slot order with one acquisition of the write lock and returns the number added.
+	// The documents of a batch are made searchable together by a single refresh when
+	// refreshInterval is zero, and otherwise by the next periodic refresh. A batch is tied
+	// to the options of the index it was created for.
+
+size_t SPDocumentBatchGetByteCount(SPDocumentBatchRef batch);
+
+	// Total length of the text analyzed into the batch so far.
+
+bool SPIndexRefresh(SPIndexRef index);
+
+	// Writes buffered documents out as a new segment, applies pending removals and
+	// publishes the result to readers, then merges segments if the merge policy calls
+	// for it. Safe to call at any time; returns false if memory ran out.
+
+bool SPIndexCompact(SPIndexRef index);
+
+	// Refreshes the index and rewrites every segment holding removed documents without
+	// them, dropping their postings and releasing the memory they held on to. Term and
+	// document IDs are preserved. Segments are rewritten and swapped in one at a time,
+	// so searches, adds and removes carry on at full speed while it runs, and a change
+	// made during compaction is never lost. A compactionDutyCycle of 0.25 has the thread
+	// sleep three times as long as it spent on each segment, keeping compaction from
+	// crowding out searches. Documents removed while it runs may be left for the next.
+
+bool SPIndexWriteToFile(SPIndexRef index, const char *path);
+SPIndexRef SPIndexCreateWithFile(const char *path, const SPIndexOptions *options);
+
+	// Saves the index and opens a saved one. Writing refreshes the index first and holds
+	// the write lock only while it copies the dictionaries and document tables, so writers
+	// carry on while the file is written and synced and readers never wait. The file holds
+	// the index as of that copy. One save runs at a time. The file is written next to path
+	// and renamed over it once it is on disk, so an existing file, even one an open index is
+	// reading, is only ever replaced whole.
+
+	// The file is a header, a table of sections and the sections themselves, each starting
+	// on a page boundary. Opening maps the file and points the segments, dictionaries and
+	// URI tables straight at their sections without reading or copying them, so it takes
+	// about as long for a large index as a small one, and pages are read as queries touch
+	// them. Only the header and the section table are checked when opening. Options work
+	// as they do for SPIndexCreate, except that the minimum term length, term limit, stop
+	// words and analysis flags the index was built with are kept. Trigrams and signatures are
+	// not saved and are rebuilt while opening when the options ask for them, which does read
+	// the whole index. Returns NULL if the file cannot be mapped or was written by an
+	// incompatible version.
+
+bool SPIndexVerifyFile(const char *path);
+
+	// Checks every section of a saved index against the checksum recorded when it was
+	// written. This reads the whole file, so use it on files of unknown provenance before
+	// opening them rather than every time.
+
+bool SPIndexOpenLog(SPIndexRef index, const char *path);
+bool SPIndexCommit(SPIndexRef index);
+bool SPIndexCheckpoint(SPIndexRef index, const char *path);
+uint64_t SPIndexGetLogLength(SPIndexRef index);
+
+	// A write-ahead log makes changes durable without saving the whole index. Once a log is
+	// open every add, remove and document data change is appended to it in the order the
+	// changes are made, and SPIndexCommit writes out what has been appended and waits for it
+	// to reach the disk. Commits are grouped: one thread writes and syncs everything appended
+	// so far while the others wait for it, so concurrent writers share a single fsync and a
+	// commit costs about as much as the changes made since the last one. Returns false
+	// without a log, or once a record could not be written, until the next checkpoint.
+
+	// SPIndexOpenLog replays the changes recorded at path on top of the index and creates
+	// the log if there is none. Open it right after creating the index or opening its file,
+	// before any other thread uses the index. Records cut short by a crash are dropped.
+	// Returns false if the log cannot be read or created, or if it starts after the last
+	// change the index holds, as it does when the index file is older than the log.
+
+	// SPIndexCheckpoint writes the index to path as SPIndexWriteToFile does and, once the
+	// file is on disk, truncates the log to the changes made while it was being written.
+	// path must be the file the index is opened from along with the log. Every saved file
+	// records the last change it holds, so replaying a log never applies a change twice.
+	// SPIndexGetLogLength returns the size of the log in bytes, to decide when to checkpoint.
+
+bool SPIndexSetDocumentData(SPIndexRef index, const char *uri, const void *bytes, size_t length);
+size_t SPIndexCopyDocumentData(SPIndexRef index, const char *uri, void **outBytes);
+
+	// Associates opaque data, such as a name and properties, with a URI. The data is saved
+	// and logged with the index. It is kept by URI, so it survives the document being
+	// replaced, and is dropped when the document is removed. A length of 0 removes it.
+	// SPIndexCopyDocumentData copies the data into a malloc'd buffer which the caller must
+	// free and returns its length, or 0 if there is none. It does not wait for documents
+	// being added, removed, refreshed or saved, only for data being set.
+
+size_t SPIndexGetSegmentCount(SPIndexRef index);
+uint64_t SPIndexGetGeneration(SPIndexRef index);
+
+	// The generation of the last refresh. It increases whenever a refresh or merge publishes
+	// new contents, and only then, so results computed at one generation hold until it changes.
+
+size_t SPIndexGetDocumentCount(SPIndexRef index);
+SPDocumentID SPIndexGetMaximumDocumentID(SPIndexRef index);
+SPDocumentID SPIndexGetDocumentID(SPIndexRef index, const char *uri);
+SPDocumentState SPIndexGetDocumentState(SPIndexRef index, const char *uri);
+
+	// Like every read below, the count and IDs describe the last refresh. The maximum
+	// document ID and the document state also account for pending changes.
+
+size_t SPIndexCopyDocumentURI(SPIndexRef index, SPDocumentID document, char **outURI);
+
+	// Copies the NUL terminated URI of a live document into a malloc'd buffer which the
+	// caller must free. Returns the length of the URI, or 0 if the document is unknown.
+
+size_t SPIndexGetDocumentURI(SPIndexRef index, SPDocumentID document, char *buffer, size_t capacity);
+
+	// Copies the URI of a live document into buffer without a NUL and returns its length,
+	// or 0 if the document is unknown. Nothing is copied when the length is larger than
+	// capacity, so that callers can retry with a larger buffer.
+
+typedef bool (*SPIndexDocumentCallback)(SPDocumentID document, const char *uri, size_t length, 
+		size_t termCount, void *context);
+
+void SPIndexEnumerateDocuments(SPIndexRef index, SPIndexDocumentCallback callback, void *context);
+
+	// Calls callback for every live document in ID order. The URI is not NUL terminated.
+	// Return false from the callback to stop the enumeration.
+
+SPTermID SPIndexGetMaximumTermID(SPIndexRef index);
+SPTermID SPIndexGetTermID(SPIndexRef index, const char *term, size_t length);
+size_t SPIndexCopyTerm(SPIndexRef index, SPTermID term, char **outTerm);
+
+	// Term strings must already be in indexed form, that is lower case. SPIndexCopyTerm
+	// behaves like SPIndexCopyDocumentURI.
+
+size_t SPIndexAnalyzeTerm(SPIndexRef index, char *term, size_t length);
+
+	// Puts a lower case term into indexed form in place, applying the index's stop words,
+	// numeric exclusion and stemming. Returns the new length, or 0 for a term the index
+	// never holds. Look up terms that come from outside the index this way.
+
+size_t SPIndexGetTermDocumentCount(SPIndexRef index, SPTermID term);
+size_t SPIndexCopyDocumentIDsForTerm(SPIndexRef index, SPTermID term, SPDocumentID **outDocuments);
+
+	// Returns the number of live documents containing term. The ID array is malloc'd and
+	// must be freed by the caller.
+
+typedef bool (*SPIndexTermCallback)(SPTermID term, const char *string, size_t length, 
+		size_t documentCount, void *context);
+
+void SPIndexEnumerateTerms(SPIndexRef index, SPIndexTermCallback callback, void *context);
+
+	// Calls callback for every term with at least one live document, in term ID order.
+
+void SPIndexEnumerateTermsWithPrefix(SPIndexRef index, const char *prefix, size_t length, 
+		SPIndexTermCallback callback, void *context);
+
+	// Calls callback for every term beginning with prefix that has at least one live
+	// document, in byte order. An empty prefix enumerates the whole dictionary. Terms are
+	// decoded one at a time from the segment dictionaries, so nothing is materialized,
+	// and the callback may stop the enumeration by returning false.
+
+size_t SPIndexGetDocumentTermCount(SPIndexRef index, SPDocumentID document);
+size_t SPIndexCopyTermIDsForDocument(SPIndexRef index, SPDocumentID document, 
+		SPTermID **outTerms, uint32_t **outFrequencies);
+uint32_t SPIndexGetDocumentTermFrequency(SPIndexRef index, SPDocumentID document, SPTermID term);
+
+	// The term ID array and the optional frequency array are malloc'd and must be freed
+	// by the caller.
+
+size_t SPIndexGetMemorySize(SPIndexRef index);
+
+	// Approximate number of bytes held by the dictionary, segments, document tables and
+	// write buffer, for profiling.
+
+SPSearchRef SPSearchCreate(SPIndexRef index, const char *query, size_t length, SPSearchOptions options);
+void SPSearchRelease(SPSearchRef search);
+
+	// The query syntax follows SearchKit: terms separated by white space are ANDed (or ORed
+	// with kSPSearchOptionSpaceMeansOR), AND/&, OR/| and NOT/! combine clauses, parentheses
+	// group them, "quoted phrases" match all of their terms and * is a wildcard within a
+	// term. a NEAR/n b matches a and b with at most n other words between them, in either
+	// order, and NEAR alone allows kSPQueryDefaultNearDistance; chained, as in a NEAR/n b
+	// NEAR/n c, at most n other words may fall within the span of all of them. Phrase and
+	// NEAR operands other than plain terms only need to be present, and both need
+	// indexesPositions to look at word order at all. With kSPSearchOptionFindSimilar the query
+	// is treated as example text and documents are ranked by the terms they share with it.
+
+#define kSPQueryDefaultNearDistance 10
+
+bool SPSearchIsOperatorWord(const char *word, size_t length);
+
+	// True for the words the query parser reads as operators: AND, OR, NOT, NEAR and
+	// NEAR/n. They are upper case only, so callers that fold a query before searching
+	// must leave these words as they are.
+
+	// The search is evaluated against the current snapshot when it is created. Results are
+	// ordered by descending score.
+
+bool SPSearchFindMatches(SPSearchRef search, size_t maxCount, SPDocumentID *outDocuments, 
+		float *outScores, size_t *outFoundCount);
+
+	// Copies up to maxCount results into outDocuments and outScores (which may be NULL).
+	// Returns true while more results remain.
+
+size_t SPSearchGetResultCount(SPSearchRef search);
+void SPSearchCancel(SPSearchRef search);
+
+	// A search may be cancelled from any thread. Searches never touch the index once they
+	// are created, so any number may be read concurrently with each other and with writers.
+
+typedef enum {
+	kSPRankingModelTFIDF = 0,
+	kSPRankingModelBM25 = 1
+} SPRankingModel;
+
+typedef struct {
+	SPRankingModel model;
+	float k1;						// BM25 term frequency saturation
+	float b;						// BM25 document length normalization, 0 to 1
+} SPRankingOptions;
+
+	// kSPRankingModelTFIDF scores documents the way SPSearchCreate does.
+
+size_t SPIndexCopyTopResults(SPIndexRef index, const char *query, size_t length, SPSearchOptions options, 
+		const SPRankingOptions *ranking, size_t limit, SPDocumentID *outDocuments, float *outScores);
+
+	// Finds the limit best scoring documents for query without scoring and sorting every
+	// match, and copies them into outDocuments and outScores (which may be NULL) by
+	// descending score, ties going to the lower document ID. Returns the number copied.
+	// ranking may be NULL for BM25 with k1 = 1.2 and b = 0.75.
+
+	// Queries that are a single term, terms ORed together or terms ANDed together, which
+	// includes find similar queries, are evaluated with block-max WAND over the skip
+	// blocks of the posting lists and pass over most of the documents that cannot make
+	// the top results. Other queries are evaluated in full and only the sort is saved.
+
+typedef struct {
+	void (*getCounts)(uint64_t *outDocumentCount, uint64_t *outTokenCount, void *context);
+	size_t (*getTermDocumentFrequency)(const char *term, size_t length, void *context);
+	void *context;
+} SPCollectionStatistics;
+
+void SPIndexSetCollectionStatistics(SPIndexRef index, const SPCollectionStatistics *statistics);
+
+	// An index which holds one shard of a larger collection ranks searches and top results
+	// against the collection's statistics rather than its own, so that scores from different
+	// shards can be compared and merged. The callbacks are made from searching threads and
+	// must be thread safe. Terms are passed in indexed form and are not NUL terminated. Set
+	// them before the index is searched, and pass NULL to rank against the index's own
+	// again. Similar documents are always found with the index's own statistics.
+
+void SPIndexGetCollectionCounts(SPIndexRef index, uint64_t *outDocumentCount, uint64_t *outTokenCount);
+size_t SPIndexGetTermDocumentFrequency(SPIndexRef index, const char *term, size_t length);
+
+	// The index's own statistics as ranking sees them: the documents and tokens in its
+	// segments, and the number of documents posted under term. Removed documents count until
+	// a merge drops them, so the figures from several shards sum to what one index holding
+	// every document would rank with.
+
+#endif
@@ -0,0 +1,836 @@
+//
+//  SPIndexFile.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPIndexPrivate.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A saved index is a header, a table of sections and the sections, each of which starts
+// on a page boundary so that it can be mapped and used in place. The first sections
+// describe the whole index; every segment then has the same run of sections. Arrays are
+// written exactly as they are laid out in memory, so the file is only read back by a
+// machine of the same byte order, which the header records.
+
+// The version changes whenever the layout of a section or of any structure written into
+// one does, and files of any other version are refused.
+
+enum {
+	kSPIndexFileSegmentInfo,		// an SPIndexFileSegment per segment
+	kSPIndexFileDeleted,			// the deletion bitmap
+	kSPIndexFileTermOffsets,		// term directory, termCount + 1 offsets into the strings
+	kSPIndexFileTermStrings,
+	kSPIndexFileTermSlots,			// term directory table
+	kSPIndexFileTermArena,
+	kSPIndexFileDocumentSlots,		// URI -> document table of the writer
+	kSPIndexFileDocumentArena,
+	kSPIndexFileDocumentData,		// a URI and data length, the URI and the data per entry
+	kSPIndexFileIndexSectionCount
+};
+
+enum {
+	kSPIndexFileDocuments,
+	kSPIndexFileURIs,
+	kSPIndexFileURISlots,
+	kSPIndexFileURIArena,
+	kSPIndexFileVectors,
+	kSPIndexFileTerms,
+	kSPIndexFileTermBlockStrings,
+	kSPIndexFileTermBlocks,
+	kSPIndexFilePostings,
+	kSPIndexFileBlocks,
+	kSPIndexFilePositions,			// empty unless the index keeps positions
+	kSPIndexFileSegmentSectionCount
+};
+
+enum {
+	kSPIndexFileIndexesPositions	= 1 << 0
+};
+
+#define kSPIndexFileMagic		"SPINDEX"
+#define kSPIndexFileVersion		3
+#define kSPIndexFileByteOrder	0x01020304
+#define kSPIndexFilePageSize	16384			// the largest page size of the machines we run on
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;				// reads back differently on a machine of the other order
+	uint32_t pageSize;
+	uint32_t sectionCount;
+	uint32_t segmentCount;
+	uint32_t minTermLength;
+	uint32_t maximumTerms;
+	SPDocumentID maximumDocumentID;
+	SPTermID termCount;
+	uint32_t analysis;				// stop word languages in the low half, analysis flags in the high
+	uint32_t flags;					// kSPIndexFileIndexesPositions
+	uint32_t reserved;
+	uint64_t documentCount;
+	uint64_t tokenCount;
+	uint64_t termTableCount;
+	uint64_t termTableUsed;
+	uint64_t documentTableCount;
+	uint64_t documentTableUsed;
+	uint64_t logSequence;			// of the last logged change the file holds
+	uint64_t fileLength;
+	uint64_t sectionsChecksum;
+	uint64_t headerChecksum;		// of the header up to this field
+} SPIndexFileHeader;
+
+typedef struct {
+	uint32_t kind;
+	uint32_t segment;
+	uint64_t offset;
+	uint64_t length;
+	uint64_t checksum;
+} SPIndexFileSection;
+
+typedef struct {
+	uint32_t documentCount;
+	uint32_t termCount;
+	uint32_t blockCount;
+	uint32_t deletedCount;
+	uint64_t tokenCount;
+	uint64_t uriTableCount;
+	uint64_t uriTableUsed;
+} SPIndexFileSegment;
+
+#pragma mark Checksums
+
+static inline uint64_t SPChecksumRound(uint64_t hash, uint64_t word) {
+	hash ^= word * 0x87c37b91114253d5ULL;
+	hash = ( hash << 31 ) | ( hash >> 33 );
+	return hash * 0x4cf5ad432745937fULL;
+}
+
+uint64_t SPChecksum(const void *bytes, size_t length) {
+
+	// Eight bytes at a time, which keeps verifying a large file close to the speed of
+	// reading it. Not cryptographic: it catches damage, not tampering.
+
+	const uint8_t *cursor = bytes;
+	uint64_t hash = 0x9e3779b97f4a7c15ULL ^ (uint64_t)length;
+	uint64_t word;
+
+	while ( length >= 8 ) {
+		memcpy(&word, cursor, 8);
+		hash = SPChecksumRound(hash, word);
+		cursor += 8;
+		length -= 8;
+	}
+
+	if ( length > 0 ) {
+		word = 0;
+		memcpy(&word, cursor, length);
+		hash = SPChecksumRound(hash, word);
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+static inline uint64_t SPPageAlign(uint64_t offset) {
+	return ( offset + kSPIndexFilePageSize - 1 ) / kSPIndexFilePageSize * kSPIndexFilePageSize;
+}
+
+#pragma mark -
+#pragma mark Writing
+
+typedef struct {
+	const void *bytes;
+	uint64_t length;
+} SPSectionSource;
+
+static bool SPIndexFileWriteSections(FILE *file, SPIndexFileHeader *header, SPIndexFileSection *sections, 
+		const SPSectionSource *sources) {
+
+	// Sections follow the header and section table in order. The header goes in last,
+	// once the offsets and checksums are known.
+
+	static const uint8_t padding[4096] = { 0 };
+
+	uint64_t offset = SPPageAlign(sizeof(SPIndexFileHeader) + header->sectionCount * sizeof(SPIndexFileSection));
+	uint32_t i;
+
+	for ( i = 0; i < header->sectionCount; i++ ) {
+		uint64_t length = sources[i].length;
+
+		if ( fseeko(file, (off_t)offset, SEEK_SET) != 0 ) return false;
+		if ( length > 0 && fwrite(sources[i].bytes, 1, (size_t)length, file) != (size_t)length ) return false;
+
+		sections[i].offset = offset;
+		sections[i].length = length;
+		sections[i].checksum = SPChecksum(sources[i].bytes, (size_t)length);
+		offset = SPPageAlign(offset + length);
+	}
+
+	// Pad the last section out so that the file length is a whole number of pages
+
+	if ( fseeko(file, 0, SEEK_END) != 0 ) return false;
+	while ( (uint64_t)ftello(file) < offset ) {
+		size_t count = (size_t)( offset - (uint64_t)ftello(file) );
+		if ( count > sizeof(padding) ) count = sizeof(padding);
+		if ( fwrite(padding, 1, count, file) != count ) return false;
+	}
+
+	header->fileLength = offset;
+	header->sectionsChecksum = SPChecksum(sections, header->sectionCount * sizeof(SPIndexFileSection));
+	header->headerChecksum = SPChecksum(header, offsetof(SPIndexFileHeader, headerChecksum));
+
+	if ( fseeko(file, 0, SEEK_SET) != 0 ) return false;
+	if ( fwrite(header, sizeof(SPIndexFileHeader), 1, file) != 1 ) return false;
+	if ( fwrite(sections, sizeof(SPIndexFileSection), header->sectionCount, file) != header->sectionCount ) return false;
+
+	return true;
+}
+
+static uint8_t * SPIndexFileCopyDocumentData(SPIndexRef index, size_t *outLength) {
+
+	// Packs the live document data into one section. Called with the write lock held.
+
+	size_t i, length = 0;
+	uint8_t *bytes, *cursor;
+
+	for ( i = 0; i < index->dataCount; i++ ) {
+		if ( index->data[i].bytes == NULL ) continue;
+		if ( index->data[i].length > UINT32_MAX ) return NULL;
+		length += 2 * sizeof(uint32_t) + index->data[i].uriLength + index->data[i].length;
+	}
+
+	bytes = malloc(( length == 0 ? 1 : length ));
+	if ( bytes == NULL ) return NULL;
+
+	for ( i = 0, cursor = bytes; i < index->dataCount; i++ ) {
+		const SPDocumentData *data = &index->data[i];
+		uint32_t dataLength = (uint32_t)data->length;
+
+		if ( data->bytes == NULL ) continue;
+
+		memcpy(cursor, &data->uriLength, sizeof(uint32_t));
+		memcpy(cursor + sizeof(uint32_t), &dataLength, sizeof(uint32_t));
+		cursor += 2 * sizeof(uint32_t);
+		memcpy(cursor, SPStringTableGetString(index->dataTable, data->uriOffset), data->uriLength);
+		cursor += data->uriLength;
+		memcpy(cursor, data->bytes, data->length);
+		cursor += data->length;
+	}
+
+	*outLength = length;
+	return bytes;
+}
+
+static void * SPIndexFileCopyBytes(const void *bytes, size_t length) {
+	void *copy = malloc(( length == 0 ? 1 : length ));
+	if ( copy != NULL && length > 0 ) memcpy(copy, bytes, length);
+	return copy;
+}
+
+static bool SPIndexWriteFile(SPIndexRef index, const char *path, bool checkpoints) {
+
+	// Everything the file needs from the writer's state is copied while the write lock is
+	// held, along with a mark in the log. The snapshot's segments and deletions never
+	// change, so the file itself is written and synced with the lock let go, and writers
+	// carry on appending to the index and its log meanwhile. Saves are serialized, so that
+	// an older file is never renamed over a newer one.
+
+	SPIndexFileHeader header;
+	SPIndexFileSection *sections = NULL;
+	SPSectionSource *sources = NULL;
+	SPIndexFileSegment *infos = NULL;
+	SPSnapshot *snapshot = NULL;
+	SPStringTableImage termTable, documentTable;
+	SPIndexLogMark mark;
+	uint32_t *termOffsets = NULL;
+	uint8_t *documentData = NULL;
+	void *termSlots = NULL, *documentSlots = NULL;
+	char *termArena = NULL, *documentArena = NULL;
+	char *termStrings = NULL, *temporaryPath = NULL;
+	size_t i, length, stringsLength = 0, dataLength = 0;
+	FILE *file = NULL;
+	int descriptor = -1;
+	bool locked = true, success = false;
+
+	pthread_mutex_lock(&index->saveLock);
+	SPIndexLockForWriting(index);
+
+	if ( !SPIndexRefreshLocked(index) ) goto bail;
+
+	// The file holds every change logged so far. A checkpoint marks the log here, so that
+	// it can drop those changes once the file is on disk and keep the ones that follow.
+
+	memset(&mark, 0, sizeof(SPIndexLogMark));
+	if ( index->log != NULL && checkpoints ) SPIndexLogMarkCheckpoint(index->log, &mark);
+	else if ( index->log != NULL ) mark.sequence = SPIndexLogGetSequence(index->log);
+	else mark.sequence = index->logSequence;
+
+	documentData = SPIndexFileCopyDocumentData(index, &dataLength);
+	if ( documentData == NULL ) goto bail;
+
+	snapshot = SPIndexCopySnapshot(index);
+	SPTermDirectoryGetImage(index->directory, &termTable);
+	SPStringTableGetImage(index->documentTable, &documentTable);
+
+	termSlots = SPIndexFileCopyBytes(termTable.slots, termTable.slotsLength);
+	termArena = SPIndexFileCopyBytes(termTable.arena, termTable.arenaLength);
+	documentSlots = SPIndexFileCopyBytes(documentTable.slots, documentTable.slotsLength);
+	documentArena = SPIndexFileCopyBytes(documentTable.arena, documentTable.arenaLength);
+	if ( termSlots == NULL || termArena == NULL || documentSlots == NULL || documentArena == NULL ) goto bail;
+
+	termTable.slots = termSlots;
+	termTable.arena = termArena;
+	documentTable.slots = documentSlots;
+	documentTable.arena = documentArena;
+
+	memset(&header, 0, sizeof(SPIndexFileHeader));
+	memcpy(header.magic, kSPIndexFileMagic, sizeof(kSPIndexFileMagic));
+	header.version = kSPIndexFileVersion;
+	header.byteOrder = kSPIndexFileByteOrder;
+	header.pageSize = kSPIndexFilePageSize;
+	header.sectionCount = (uint32_t)( kSPIndexFileIndexSectionCount + snapshot->segmentCount * kSPIndexFileSegmentSectionCount );
+	header.segmentCount = (uint32_t)snapshot->segmentCount;
+	header.minTermLength = index->options.minTermLength;
+	header.maximumTerms = index->options.maximumTerms;
+	header.analysis = ( index->options.stopWordLanguages & 0xFFFF ) | ( index->options.analysisFlags << 16 );
+	header.flags = ( index->options.indexesPositions ? kSPIndexFileIndexesPositions : 0 );
+	header.maximumDocumentID = index->maximumDocumentID;
+	header.termCount = snapshot->termCount;
+	header.documentCount = snapshot->documentCount;
+	header.tokenCount = snapshot->tokenCount;
+	header.termTableCount = termTable.count;
+	header.termTableUsed = termTable.used;
+	header.documentTableCount = documentTable.count;
+	header.documentTableUsed = documentTable.used;
+	header.logSequence = mark.sequence;
+
+	// The directory's strings are gathered in ID order
+
+	termOffsets = malloc(( (size_t)snapshot->termCount + 1 ) * sizeof(uint32_t));
+	if ( termOffsets == NULL ) goto bail;
+
+	for ( i = 0; i < (size_t)snapshot->termCount; i++ ) {
+		SPTermDirectoryGetTerm(index->directory, (SPTermID)i, &length);
+		termOffsets[i] = (uint32_t)stringsLength;
+		stringsLength += length;
+	}
+
+	termOffsets[snapshot->termCount] = (uint32_t)stringsLength;
+	if ( stringsLength > UINT32_MAX ) goto bail;
+
+	termStrings = malloc(( stringsLength == 0 ? 1 : stringsLength ));
+	if ( termStrings == NULL ) goto bail;
+
+	for ( i = 0; i < (size_t)snapshot->termCount; i++ ) {
+		const char *string = SPTermDirectoryGetTerm(index->directory, (SPTermID)i, &length);
+		memcpy(termStrings + termOffsets[i], string, length);
+	}
+
+	SPIndexUnlockForWriting(index);
+	locked = false;
+
+	sections = calloc(header.sectionCount, sizeof(SPIndexFileSection));
+	sources = calloc(header.sectionCount, sizeof(SPSectionSource));
+	infos = calloc(( snapshot->segmentCount == 0 ? 1 : snapshot->segmentCount ), sizeof(SPIndexFileSegment));
+	if ( sections == NULL || sources == NULL || infos == NULL ) goto bail;
+
+	sources[kSPIndexFileSegmentInfo] = (SPSectionSource){ infos, snapshot->segmentCount * sizeof(SPIndexFileSegment) };
+	sources[kSPIndexFileDeleted] = (SPSectionSource){ ( snapshot->deleted == NULL ? NULL : snapshot->deleted->bits ), 
+			( snapshot->deleted == NULL ? 0 : (uint64_t)snapshot->deleted->capacity / 8 ) };
+	sources[kSPIndexFileTermOffsets] = (SPSectionSource){ termOffsets, ( (uint64_t)snapshot->termCount + 1 ) * sizeof(uint32_t) };
+	sources[kSPIndexFileTermStrings] = (SPSectionSource){ termStrings, stringsLength };
+	sources[kSPIndexFileTermSlots] = (SPSectionSource){ termTable.slots, termTable.slotsLength };
+	sources[kSPIndexFileTermArena] = (SPSectionSource){ termTable.arena, termTable.arenaLength };
+	sources[kSPIndexFileDocumentSlots] = (SPSectionSource){ documentTable.slots, documentTable.slotsLength };
+	sources[kSPIndexFileDocumentArena] = (SPSectionSource){ documentTable.arena, documentTable.arenaLength };
+	sources[kSPIndexFileDocumentData] = (SPSectionSource){ documentData, dataLength };
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegment *segment = snapshot->segments[i];
+		SPSectionSource *segmentSources = &sources[kSPIndexFileIndexSectionCount + i * kSPIndexFileSegmentSectionCount];
+		SPStringTableImage uriTable;
+
+		SPStringTableGetImage(segment->uriTable, &uriTable);
+
+		infos[i].documentCount = segment->documentCount;
+		infos[i].termCount = segment->termCount;
+		infos[i].blockCount = segment->blockCount;
+		infos[i].deletedCount = snapshot->deletedCounts[i];
+		infos[i].tokenCount = segment->tokenCount;
+		infos[i].uriTableCount = uriTable.count;
+		infos[i].uriTableUsed = uriTable.used;
+
+		segmentSources[kSPIndexFileDocuments] = (SPSectionSource){ segment->documents, 
+				(uint64_t)segment->documentCount * sizeof(SPSegmentDocument) };
+		segmentSources[kSPIndexFileURIs] = (SPSectionSource){ segment->uris, segment->urisLength };
+		segmentSources[kSPIndexFileURISlots] = (SPSectionSource){ uriTable.slots, uriTable.slotsLength };
+		segmentSources[kSPIndexFileURIArena] = (SPSectionSource){ uriTable.arena, uriTable.arenaLength };
+		segmentSources[kSPIndexFileVectors] = (SPSectionSource){ segment->vectors, segment->vectorsLength };
+		segmentSources[kSPIndexFileTerms] = (SPSectionSource){ segment->terms, (uint64_t)segment->termCount * sizeof(SPSegmentTerm) };
+		segmentSources[kSPIndexFileTermBlockStrings] = (SPSectionSource){ segment->termStrings, segment->termStringsLength };
+		segmentSources[kSPIndexFileTermBlocks] = (SPSectionSource){ segment->termBlocks, 
+				(uint64_t)( segment->termCount + kSPSegmentTermBlockSize - 1 ) / kSPSegmentTermBlockSize * sizeof(uint32_t) };
+		segmentSources[kSPIndexFilePostings] = (SPSectionSource){ segment->postings, segment->postingsLength };
+		segmentSources[kSPIndexFileBlocks] = (SPSectionSource){ segment->blocks, (uint64_t)segment->blockCount * sizeof(SPSegmentBlock) };
+		segmentSources[kSPIndexFilePositions] = (SPSectionSource){ segment->positions, segment->positionsLength };
+	}
+
+	for ( i = 0; i < header.sectionCount; i++ ) {
+		sections[i].kind = (uint32_t)( i < kSPIndexFileIndexSectionCount ? i 
+				: ( i - kSPIndexFileIndexSectionCount ) % kSPIndexFileSegmentSectionCount );
+		sections[i].segment = (uint32_t)( i < kSPIndexFileIndexSectionCount ? 0 
+				: ( i - kSPIndexFileIndexSectionCount ) / kSPIndexFileSegmentSectionCount );
+	}
+
+	// Written beside the destination and renamed over it, so that readers of the old file,
+	// which may have it mapped, never see a partial one
+
+	temporaryPath = malloc(strlen(path) + 8);
+	if ( temporaryPath == NULL ) goto bail;
+
+	sprintf(temporaryPath, "%s.XXXXXX", path);
+	descriptor = mkstemp(temporaryPath);
+	if ( descriptor == -1 ) goto bail;
+
+	fchmod(descriptor, 0644);
+	file = fdopen(descriptor, "wb");
+	if ( file == NULL ) goto bail;
+
+	success = SPIndexFileWriteSections(file, &header, sections, sources) && fflush(file) == 0 && fsync(descriptor) == 0;
+
+bail:
+	if ( locked ) SPIndexUnlockForWriting(index);
+
+	if ( file != NULL ) {
+		if ( fclose(file) != 0 ) success = false;
+	}
+	else if ( descriptor != -1 ) {
+		close(descriptor);
+	}
+
+	if ( descriptor != -1 ) {
+		if ( success ) success = ( rename(temporaryPath, path) == 0 );
+		if ( !success ) unlink(temporaryPath);
+	}
+
+	// The log may only let go of the changes once the rename is durable too
+
+	if ( success && checkpoints && index->log != NULL ) 
+		success = SPSyncDirectory(path) && SPIndexLogTruncate(index->log, &mark);
+
+	pthread_mutex_unlock(&index->saveLock);
+
+	SPSnapshotRelease(snapshot);
+	free(temporaryPath);
+	free(termOffsets);
+	free(termStrings);
+	free(termSlots);
+	free(termArena);
+	free(documentSlots);
+	free(documentArena);
+	free(documentData);
+	free(infos);
+	free(sources);
+	free(sections);
+
+	return success;
+}
+
+bool SPIndexWriteToFile(SPIndexRef index, const char *path) {
+	return SPIndexWriteFile(index, path, false);
+}
+
+bool SPIndexCheckpoint(SPIndexRef index, const char *path) {
+	return SPIndexWriteFile(index, path, true);
+}
+
+#pragma mark -
+#pragma mark Opening
+
+static const SPIndexFileHeader * SPIndexFileCheckHeader(const void *bytes, uint64_t length) {
+
+	// Checks the header and section table, and that every section lies within the file
+
+	const SPIndexFileHeader *header = bytes;
+	const SPIndexFileSection *sections = (const SPIndexFileSection*)( header + 1 );
+	uint32_t i;
+
+	if ( length < sizeof(SPIndexFileHeader) || memcmp(header->magic, kSPIndexFileMagic, sizeof(kSPIndexFileMagic)) != 0 
+			|| header->version != kSPIndexFileVersion || header->byteOrder != kSPIndexFileByteOrder 
+			|| header->pageSize != kSPIndexFilePageSize || header->fileLength != length
+			|| header->headerChecksum != SPChecksum(header, offsetof(SPIndexFileHeader, headerChecksum)) )
+		return NULL;
+
+	if ( header->segmentCount > ( UINT32_MAX - kSPIndexFileIndexSectionCount ) / kSPIndexFileSegmentSectionCount 
+			|| header->sectionCount != kSPIndexFileIndexSectionCount + header->segmentCount * kSPIndexFileSegmentSectionCount
+			|| (uint64_t)header->sectionCount * sizeof(SPIndexFileSection) > length - sizeof(SPIndexFileHeader)
+			|| header->sectionsChecksum != SPChecksum(sections, header->sectionCount * sizeof(SPIndexFileSection)) )
+		return NULL;
+
+	for ( i = 0; i < header->sectionCount; i++ ) {
+		if ( sections[i].offset % kSPIndexFilePageSize != 0 || sections[i].offset > length 
+				|| sections[i].length > length - sections[i].offset )
+			return NULL;
+	}
+
+	return header;
+}
+
+static bool SPIndexFileMap(const char *path, SPMappedFile **outFile) {
+
+	SPMappedFile *file = NULL;
+	struct stat info;
+	void *bytes = MAP_FAILED;
+	int descriptor = open(path, O_RDONLY);
+
+	if ( descriptor == -1 ) return false;
+
+	if ( fstat(descriptor, &info) != 0 || info.st_size <= 0 || (uint64_t)info.st_size > SIZE_MAX ) goto bail;
+
+	bytes = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	if ( bytes == MAP_FAILED ) goto bail;
+
+	file = malloc(sizeof(SPMappedFile));
+	if ( file == NULL ) goto bail;
+
+	file->retainCount = 1;
+	file->bytes = bytes;
+	file->length = (size_t)info.st_size;
+
+	*outFile = file;
+	bytes = MAP_FAILED;
+
+bail:
+	if ( bytes != MAP_FAILED ) munmap(bytes, (size_t)info.st_size);
+	close(descriptor);
+
+	return ( file != NULL );
+}
+
+static SPSegment * SPIndexFileCreateSegment(SPMappedFile *file, const SPIndexFileSection *sections, 
+		const SPIndexFileSegment *info) {
+
+	// Points a segment at its sections after checking their lengths against the counts
+
+	uint8_t *bytes = file->bytes;
+	SPStringTableImage uriTable;
+	SPSegment *segment;
+
+	if ( info->documentCount == 0 
+			|| sections[kSPIndexFileDocuments].length != (uint64_t)info->documentCount * sizeof(SPSegmentDocument)
+			|| sections[kSPIndexFileTerms].length != (uint64_t)info->termCount * sizeof(SPSegmentTerm)
+			|| sections[kSPIndexFileTermBlocks].length != (uint64_t)( info->termCount + kSPSegmentTermBlockSize - 1 ) 
+					/ kSPSegmentTermBlockSize * sizeof(uint32_t)
+			|| sections[kSPIndexFileBlocks].length != (uint64_t)info->blockCount * sizeof(SPSegmentBlock)
+			|| sections[kSPIndexFileURIs].length > UINT32_MAX || sections[kSPIndexFileVectors].length > UINT32_MAX
+			|| sections[kSPIndexFileTermBlockStrings].length > UINT32_MAX || sections[kSPIndexFilePostings].length > UINT32_MAX
+			|| sections[kSPIndexFilePositions].length > UINT32_MAX )
+		return NULL;
+
+	segment = calloc(1, sizeof(SPSegment));
+	if ( segment == NULL ) return NULL;
+
+	uriTable.slots = bytes + sections[kSPIndexFileURISlots].offset;
+	uriTable.slotsLength = (size_t)sections[kSPIndexFileURISlots].length;
+	uriTable.arena = (const char*)bytes + sections[kSPIndexFileURIArena].offset;
+	uriTable.arenaLength = (size_t)sections[kSPIndexFileURIArena].length;
+	uriTable.count = info->uriTableCount;
+	uriTable.used = info->uriTableUsed;
+
+	segment->uriTable = SPStringTableCreateWithImage(&uriTable);
+	if ( segment->uriTable == NULL ) {
+		free(segment);
+		return NULL;
+	}
+
+	segment->retainCount = 1;
+	segment->documents = (SPSegmentDocument*)( bytes + sections[kSPIndexFileDocuments].offset );
+	segment->documentCount = info->documentCount;
+	segment->tokenCount = info->tokenCount;
+	segment->uris = (char*)bytes + sections[kSPIndexFileURIs].offset;
+	segment->vectors = bytes + sections[kSPIndexFileVectors].offset;
+	segment->terms = (SPSegmentTerm*)( bytes + sections[kSPIndexFileTerms].offset );
+	segment->termCount = info->termCount;
+	segment->termStrings = bytes + sections[kSPIndexFileTermBlockStrings].offset;
+	segment->termBlocks = (uint32_t*)( bytes + sections[kSPIndexFileTermBlocks].offset );
+	segment->postings = bytes + sections[kSPIndexFilePostings].offset;
+	segment->blocks = (SPSegmentBlock*)( bytes + sections[kSPIndexFileBlocks].offset );
+	segment->blockCount = info->blockCount;
+	if ( sections[kSPIndexFilePositions].length > 0 ) segment->positions = bytes + sections[kSPIndexFilePositions].offset;
+
+	segment->urisLength = (uint32_t)sections[kSPIndexFileURIs].length;
+	segment->vectorsLength = (uint32_t)sections[kSPIndexFileVectors].length;
+	segment->termStringsLength = (uint32_t)sections[kSPIndexFileTermBlockStrings].length;
+	segment->postingsLength = (uint32_t)sections[kSPIndexFilePostings].length;
+	segment->positionsLength = (uint32_t)sections[kSPIndexFilePositions].length;
+
+	segment->file = SPMappedFileRetain(file);
+	segment->memorySize = sizeof(SPSegment) + SPStringTableGetMemorySize(segment->uriTable);
+
+	// Every lookup binary searches the dictionary, so ask for it to be read ahead
+
+	posix_madvise(segment->termBlocks, (size_t)sections[kSPIndexFileTermBlocks].length, POSIX_MADV_WILLNEED);
+	posix_madvise(segment->terms, (size_t)sections[kSPIndexFileTerms].length, POSIX_MADV_WILLNEED);
+
+	return segment;
+}
+
+static bool SPIndexFileLoadDocumentData(SPIndexRef index, const uint8_t *bytes, size_t length) {
+
+	// Document data is small and changes, so it is copied out of the file rather than used
+	// in place
+
+	while ( length > 0 ) {
+		uint32_t uriLength, dataLength;
+
+		if ( length < 2 * sizeof(uint32_t) ) return false;
+
+		memcpy(&uriLength, bytes, sizeof(uint32_t));
+		memcpy(&dataLength, bytes + sizeof(uint32_t), sizeof(uint32_t));
+		bytes += 2 * sizeof(uint32_t);
+		length -= 2 * sizeof(uint32_t);
+
+		if ( dataLength == 0 || uriLength > length || dataLength > length - uriLength 
+				|| !SPIndexSetDocumentDataLocked(index, (const char*)bytes, uriLength, bytes + uriLength, dataLength) )
+			return false;
+
+		bytes += uriLength + dataLength;
+		length -= uriLength + dataLength;
+	}
+
+	return true;
+}
+
+static bool SPIndexLoadFile(SPIndexRef index, SPMappedFile *file, const SPIndexFileHeader *header) {
+
+	// Called with the write lock held on a new, empty index
+
+	const SPIndexFileSection *sections = (const SPIndexFileSection*)( header + 1 );
+	const SPIndexFileSegment *infos;
+	uint8_t *bytes = file->bytes;
+	SPStringTableImage termTable, documentTable;
+	SPTermDirectory *directory;
+	SPStringTable *table;
+	SPSnapshot *snapshot;
+	SPDocumentID document;
+	uint32_t i;
+
+	if ( header->termCount < 0 || header->maximumDocumentID < 0
+			|| sections[kSPIndexFileSegmentInfo].length != header->segmentCount * sizeof(SPIndexFileSegment)
+			|| sections[kSPIndexFileTermOffsets].length != ( (uint64_t)header->termCount + 1 ) * sizeof(uint32_t) )
+		return false;
+
+	infos = (const SPIndexFileSegment*)( bytes + sections[kSPIndexFileSegmentInfo].offset );
+
+	termTable.slots = bytes + sections[kSPIndexFileTermSlots].offset;
+	termTable.slotsLength = (size_t)sections[kSPIndexFileTermSlots].length;
+	termTable.arena = (const char*)bytes + sections[kSPIndexFileTermArena].offset;
+	termTable.arenaLength = (size_t)sections[kSPIndexFileTermArena].length;
+	termTable.count = header->termTableCount;
+	termTable.used = header->termTableUsed;
+
+	documentTable.slots = bytes + sections[kSPIndexFileDocumentSlots].offset;
+	documentTable.slotsLength = (size_t)sections[kSPIndexFileDocumentSlots].length;
+	documentTable.arena = (const char*)bytes + sections[kSPIndexFileDocumentArena].offset;
+	documentTable.arenaLength = (size_t)sections[kSPIndexFileDocumentArena].length;
+	documentTable.count = header->documentTableCount;
+	documentTable.used = header->documentTableUsed;
+
+	directory = SPTermDirectoryCreateWithImage(&termTable, (const uint32_t*)( bytes + sections[kSPIndexFileTermOffsets].offset ), 
+			(const char*)bytes + sections[kSPIndexFileTermStrings].offset, (size_t)sections[kSPIndexFileTermStrings].length, 
+			header->termCount);
+	table = SPStringTableCreateWithImage(&documentTable);
+	snapshot = SPSnapshotCreate(index, header->segmentCount);
+
+	if ( directory == NULL || table == NULL || snapshot == NULL ) goto fail;
+
+	SPTermDirectoryRelease(index->directory);
+	SPStringTableRelease(index->documentTable);
+	index->directory = directory;
+	index->documentTable = table;
+	index->file = SPMappedFileRetain(file);
+	directory = NULL;
+	table = NULL;
+
+	snapshot->directory = index->directory;
+
+	if ( !SPIndexFileLoadDocumentData(index, bytes + sections[kSPIndexFileDocumentData].offset, 
+			(size_t)sections[kSPIndexFileDocumentData].length) )
+		goto fail;
+
+	for ( i = 0; i < header->segmentCount; i++ ) {
+		const SPIndexFileSection *segmentSections = &sections[kSPIndexFileIndexSectionCount + i * kSPIndexFileSegmentSectionCount];
+		SPSegment *segment = SPIndexFileCreateSegment(file, segmentSections, &infos[i]);
+		if ( segment == NULL ) goto fail;
+
+		snapshot->segments[i] = segment;
+		snapshot->deletedCounts[i] = infos[i].deletedCount;
+		snapshot->segmentCount++;
+	}
+
+	if ( sections[kSPIndexFileDeleted].length > 0 ) {
+		if ( sections[kSPIndexFileDeleted].length > (uint64_t)INT32_MAX / 8 ) goto fail;
+
+		snapshot->deleted = SPDeletionSetCreateCopy(NULL, (SPDocumentID)( sections[kSPIndexFileDeleted].length * 8 ));
+		if ( snapshot->deleted == NULL ) goto fail;
+
+		memcpy(snapshot->deleted->bits, bytes + sections[kSPIndexFileDeleted].offset, (size_t)sections[kSPIndexFileDeleted].length);
+	}
+
+	snapshot->documentCount = (size_t)header->documentCount;
+	snapshot->tokenCount = header->tokenCount;
+	snapshot->maximumDocumentID = ( header->segmentCount == 0 ? 0 : SPSegmentGetLastDocument(snapshot->segments[header->segmentCount - 1]) );
+
+	index->maximumDocumentID = header->maximumDocumentID;
+	index->refreshedDocumentID = header->maximumDocumentID;
+	index->logSequence = header->logSequence;
+
+	// Signatures are derived from the vectors and are not saved
+
+	if ( index->signatures != NULL ) {
+		SPDocumentID *deleted = NULL;
+		size_t deletedCount = 0;
+
+		for ( i = 0; i < header->segmentCount; i++ )
+			SPSignatureIndexAddSegment(index->signatures, snapshot->segments[i]);
+
+		// The bitmap also holds documents that merges have since dropped, so count it
+
+		for ( document = 0; snapshot->deleted != NULL && document < snapshot->deleted->capacity; document++ ) {
+			if ( SPDeletionSetContains(snapshot->deleted, document) ) deletedCount++;
+		}
+
+		if ( deletedCount > 0 && ( deleted = malloc(deletedCount * sizeof(SPDocumentID)) ) != NULL ) {
+			deletedCount = 0;
+			for ( document = 0; document < snapshot->deleted->capacity; document++ ) {
+				if ( SPDeletionSetContains(snapshot->deleted, document) ) deleted[deletedCount++] = document;
+			}
+
+			SPSignatureIndexRemoveDocuments(index->signatures, deleted, deletedCount);
+			free(deleted);
+		}
+	}
+
+	SPIndexPublishSnapshot(index, snapshot);
+	return true;
+
+fail:
+	SPTermDirectoryRelease(directory);
+	SPStringTableRelease(table);
+	SPSnapshotRelease(snapshot);
+
+	return false;
+}
+
+SPIndexRef SPIndexCreateWithFile(const char *path, const SPIndexOptions *options) {
+
+	SPMappedFile *file = NULL;
+	const SPIndexFileHeader *header;
+	SPIndexOptions indexOptions;
+	SPIndexRef index = NULL;
+	bool success;
+
+	if ( !SPIndexFileMap(path, &file) ) return NULL;
+
+	header = SPIndexFileCheckHeader(file->bytes, file->length);
+	if ( header == NULL ) goto bail;
+
+	if ( options != NULL ) {
+		indexOptions = *options;
+	}
+	else {
+		memset(&indexOptions, 0, sizeof(SPIndexOptions));
+	}
+
+	indexOptions.minTermLength = header->minTermLength;
+	indexOptions.maximumTerms = header->maximumTerms;
+	indexOptions.stopWordLanguages = header->analysis & 0xFFFF;
+	indexOptions.analysisFlags = header->analysis >> 16;
+	indexOptions.indexesPositions = ( header->flags & kSPIndexFileIndexesPositions ) != 0;
+
+	index = SPIndexCreate(&indexOptions);
+	if ( index == NULL ) goto bail;
+
+	SPIndexLockForWriting(index);
+	success = SPIndexLoadFile(index, file, header);
+	SPIndexUnlockForWriting(index);
+
+	if ( !success ) {
+		SPIndexRelease(index);
+		index = NULL;
+	}
+
+bail:
+	SPMappedFileRelease(file);
+	return index;
+}
+
+bool SPIndexVerifyFile(const char *path) {
+
+	SPMappedFile *file = NULL;
+	const SPIndexFileHeader *header;
+	const SPIndexFileSection *sections;
+	bool success = false;
+	uint32_t i;
+
+	if ( !SPIndexFileMap(path, &file) ) return false;
+
+	header = SPIndexFileCheckHeader(file->bytes, file->length);
+	if ( header == NULL ) goto bail;
+
+	sections = (const SPIndexFileSection*)( header + 1 );
+	posix_madvise(file->bytes, file->length, POSIX_MADV_SEQUENTIAL);
+
+	for ( i = 0; i < header->sectionCount; i++ ) {
+		if ( SPChecksum((uint8_t*)file->bytes + sections[i].offset, (size_t)sections[i].length) != sections[i].checksum )
+			goto bail;
+	}
+
+	success = true;
+
+bail:
+	SPMappedFileRelease(file);
+	return success;
+}
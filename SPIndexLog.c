@@ -0,0 +1,621 @@
+//
+//  SPIndexLog.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPIndexPrivate.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The log is a header followed by records, each a fixed header, the URI and the text or
+// data, with a checksum over all of it so that replay stops at the first record a crash
+// left incomplete. Records are numbered in sequence, and a saved index records the last
+// one it holds, so records already in the index are skipped. Like saved files the log is
+// written in the byte order of the machine, which the header records.
+
+// Records are appended to a buffer under the index's write lock. A commit swaps in an
+// empty buffer and writes and syncs the full one with no lock held, so writers carry on
+// appending while it waits on the disk. A commit that finds another one running waits
+// for it and then writes everything appended in the meantime in one go, which is what
+// lets concurrent writers share an fsync.
+
+#define kSPIndexLogMagic			"SPINLOG"
+#define kSPIndexLogVersion			1
+#define kSPIndexLogByteOrder		0x01020304
+#define kSPIndexLogBufferLimit		( 8 * 1024 * 1024 )		// committed without waiting to be asked
+#define kSPIndexLogReplayBatchSize	256						// documents replayed with one batch
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t firstSequence;			// of the first record the log may hold
+	uint64_t checksum;				// of the header up to this field
+} SPIndexLogHeader;
+
+typedef struct {
+	uint64_t checksum;				// of the rest of the record
+	uint64_t sequence;
+	uint32_t kind;
+	uint32_t uriLength;
+	uint64_t length;				// of the text or data after the URI
+} SPIndexLogRecord;
+
+struct SPIndexLog {
+	pthread_mutex_t lock;
+	pthread_cond_t condition;		// signalled when a commit finishes
+	char *path;
+	int descriptor;
+
+	uint8_t *buffer;				// records appended since the last commit began
+	size_t bufferLength;
+	size_t bufferCapacity;
+	uint8_t *spare;					// being written by the committing thread
+	size_t spareCapacity;
+
+	uint64_t sequence;				// of the last record appended
+	uint64_t durableSequence;		// of the last record on disk
+	uint64_t fileLength;			// bytes known to be written
+	uint64_t appendedLength;		// bytes written, being written or in the buffer
+
+	bool commits;					// a thread is writing the spare buffer or truncating
+	bool failed;					// a record was lost, and later ones are dropped
+	bool recovers;					// a checkpoint after a failure will replace the file
+};
+
+#pragma mark Files
+
+bool SPSyncDirectory(const char *path) {
+
+	const char *slash = strrchr(path, '/');
+	char *directory = ( slash == NULL ? strdup(".") : strndup(path, ( slash == path ? 1 : (size_t)( slash - path ) )) );
+	int descriptor;
+	bool success;
+
+	if ( directory == NULL ) return false;
+
+	descriptor = open(directory, O_RDONLY);
+	success = ( descriptor != -1 && fsync(descriptor) == 0 );
+
+	if ( descriptor != -1 ) close(descriptor);
+	free(directory);
+
+	return success;
+}
+
+static bool SPIndexLogWrite(int descriptor, const void *bytes, size_t length, uint64_t offset) {
+
+	const uint8_t *cursor = bytes;
+
+	while ( length > 0 ) {
+		ssize_t written = pwrite(descriptor, cursor, length, (off_t)offset);
+		if ( written < 0 ) {
+			if ( errno == EINTR ) continue;
+			return false;
+		}
+
+		cursor += written;
+		offset += (uint64_t)written;
+		length -= (size_t)written;
+	}
+
+	return true;
+}
+
+static void SPIndexLogInitHeader(SPIndexLogHeader *header, uint64_t firstSequence) {
+	memset(header, 0, sizeof(SPIndexLogHeader));
+	memcpy(header->magic, kSPIndexLogMagic, sizeof(kSPIndexLogMagic));
+	header->version = kSPIndexLogVersion;
+	header->byteOrder = kSPIndexLogByteOrder;
+	header->firstSequence = firstSequence;
+	header->checksum = SPChecksum(header, offsetof(SPIndexLogHeader, checksum));
+}
+
+static bool SPIndexLogCheckHeader(const SPIndexLogHeader *header) {
+	return ( memcmp(header->magic, kSPIndexLogMagic, sizeof(kSPIndexLogMagic)) == 0 
+			&& header->version == kSPIndexLogVersion && header->byteOrder == kSPIndexLogByteOrder 
+			&& header->checksum == SPChecksum(header, offsetof(SPIndexLogHeader, checksum)) );
+}
+
+#pragma mark -
+#pragma mark Appending and Committing
+
+void SPIndexLogAppend(SPIndexLog *log, SPIndexLogKind kind, const char *uri, size_t uriLength, 
+		const void *bytes, size_t length) {
+
+	size_t size = sizeof(SPIndexLogRecord) + uriLength + length;
+	SPIndexLogRecord record;
+	uint8_t *cursor;
+
+	pthread_mutex_lock(&log->lock);
+
+	log->sequence++;
+
+	// A failed log drops records until a checkpoint replaces it, since there is no
+	// writing the ones after a gap
+
+	if ( log->failed ) goto done;
+
+	if ( uriLength > UINT32_MAX || log->bufferLength + size > log->bufferCapacity ) {
+		size_t capacity = ( log->bufferCapacity == 0 ? 65536 : log->bufferCapacity * 2 );
+		uint8_t *buffer;
+
+		while ( capacity < log->bufferLength + size ) capacity *= 2;
+
+		buffer = ( uriLength > UINT32_MAX ? NULL : realloc(log->buffer, capacity) );
+		if ( buffer == NULL ) {
+			log->failed = true;
+			log->appendedLength -= log->bufferLength;
+			log->bufferLength = 0;
+			goto done;
+		}
+
+		log->buffer = buffer;
+		log->bufferCapacity = capacity;
+	}
+
+	record.checksum = 0;
+	record.sequence = log->sequence;
+	record.kind = kind;
+	record.uriLength = (uint32_t)uriLength;
+	record.length = length;
+
+	cursor = log->buffer + log->bufferLength;
+	memcpy(cursor, &record, sizeof(SPIndexLogRecord));
+	memcpy(cursor + sizeof(SPIndexLogRecord), uri, uriLength);
+	if ( length > 0 ) memcpy(cursor + sizeof(SPIndexLogRecord) + uriLength, bytes, length);
+
+	record.checksum = SPChecksum(cursor + sizeof(uint64_t), size - sizeof(uint64_t));
+	memcpy(cursor, &record.checksum, sizeof(uint64_t));
+
+	log->bufferLength += size;
+	log->appendedLength += size;
+
+done:
+	pthread_mutex_unlock(&log->lock);
+}
+
+bool SPIndexLogCommit(SPIndexLog *log) {
+
+	bool success;
+
+	pthread_mutex_lock(&log->lock);
+
+	uint64_t sequence = log->sequence;
+
+	while ( !log->failed && !log->recovers && log->durableSequence < sequence ) {
+
+		uint8_t *records = log->buffer;
+		size_t length = log->bufferLength, capacity = log->bufferCapacity;
+		uint64_t last = log->sequence, offset = log->fileLength;
+		int descriptor = log->descriptor;
+		bool written;
+
+		if ( log->commits ) {
+			pthread_cond_wait(&log->condition, &log->lock);
+			continue;
+		}
+
+		// Lead a commit of everything appended so far, including the records of any
+		// thread that is waiting on this one
+
+		log->buffer = log->spare;
+		log->bufferCapacity = log->spareCapacity;
+		log->bufferLength = 0;
+		log->spare = records;
+		log->spareCapacity = capacity;
+		log->commits = true;
+
+		pthread_mutex_unlock(&log->lock);
+		written = SPIndexLogWrite(descriptor, records, length, offset) && fsync(descriptor) == 0;
+		pthread_mutex_lock(&log->lock);
+
+		if ( written ) {
+			log->fileLength += length;
+			log->durableSequence = last;
+		}
+		else {
+			log->failed = true;
+			log->appendedLength = log->fileLength;
+			log->bufferLength = 0;
+		}
+
+		log->commits = false;
+		pthread_cond_broadcast(&log->condition);
+	}
+
+	success = ( !log->failed && !log->recovers );
+
+	pthread_mutex_unlock(&log->lock);
+	return success;
+}
+
+void SPIndexLogCommitIfFull(SPIndexLog *log) {
+
+	bool full;
+
+	pthread_mutex_lock(&log->lock);
+	full = ( log->bufferLength >= kSPIndexLogBufferLimit && !log->commits && !log->failed && !log->recovers );
+	pthread_mutex_unlock(&log->lock);
+
+	if ( full ) SPIndexLogCommit(log);
+}
+
+uint64_t SPIndexLogGetSequence(SPIndexLog *log) {
+
+	uint64_t sequence;
+
+	pthread_mutex_lock(&log->lock);
+	sequence = log->sequence;
+	pthread_mutex_unlock(&log->lock);
+
+	return sequence;
+}
+
+uint64_t SPIndexLogGetLength(SPIndexLog *log) {
+
+	uint64_t length;
+
+	pthread_mutex_lock(&log->lock);
+	length = log->appendedLength;
+	pthread_mutex_unlock(&log->lock);
+
+	return length;
+}
+
+#pragma mark -
+#pragma mark Checkpoints
+
+void SPIndexLogMarkCheckpoint(SPIndexLog *log, SPIndexLogMark *outMark) {
+
+	pthread_mutex_lock(&log->lock);
+
+	outMark->sequence = log->sequence;
+	outMark->offset = log->appendedLength;
+	outMark->discards = ( log->failed || log->recovers );
+
+	// Nothing after a failure reached the disk, so the checkpoint stands in for the whole
+	// log. Records appended from here on are kept for the log that replaces it.
+
+	if ( outMark->discards ) {
+		log->failed = false;
+		log->recovers = true;
+		log->appendedLength = log->fileLength;
+		log->bufferLength = 0;
+	}
+
+	pthread_mutex_unlock(&log->lock);
+}
+
+bool SPIndexLogTruncate(SPIndexLog *log, const SPIndexLogMark *mark) {
+
+	// The records after the mark that are already on disk are copied into a new log, which
+	// is renamed over the old one. Appends carry on into the buffer meanwhile, while
+	// commits wait for the new file.
+
+	SPIndexLogHeader header;
+	uint8_t *tail = NULL;
+	uint64_t tailLength = 0;
+	char *temporaryPath = NULL;
+	int descriptor = -1;
+	bool success = false;
+
+	if ( !mark->discards ) SPIndexLogCommit(log);
+
+	pthread_mutex_lock(&log->lock);
+
+	while ( log->commits ) pthread_cond_wait(&log->condition, &log->lock);
+
+	if ( !mark->discards && !log->recovers && mark->offset < log->fileLength ) 
+		tailLength = log->fileLength - mark->offset;
+
+	log->commits = true;
+	pthread_mutex_unlock(&log->lock);
+
+	if ( tailLength > SIZE_MAX ) goto bail;
+
+	tail = malloc(( tailLength == 0 ? 1 : (size_t)tailLength ));
+	temporaryPath = malloc(strlen(log->path) + 8);
+	if ( tail == NULL || temporaryPath == NULL ) goto bail;
+
+	if ( tailLength > 0 && pread(log->descriptor, tail, (size_t)tailLength, (off_t)mark->offset) != (ssize_t)tailLength ) 
+		goto bail;
+
+	sprintf(temporaryPath, "%s.XXXXXX", log->path);
+	descriptor = mkstemp(temporaryPath);
+	if ( descriptor == -1 ) goto bail;
+
+	fchmod(descriptor, 0644);
+	SPIndexLogInitHeader(&header, mark->sequence + 1);
+
+	success = SPIndexLogWrite(descriptor, &header, sizeof(SPIndexLogHeader), 0) 
+			&& SPIndexLogWrite(descriptor, tail, (size_t)tailLength, sizeof(SPIndexLogHeader)) 
+			&& fsync(descriptor) == 0 && rename(temporaryPath, log->path) == 0;
+
+	if ( success ) SPSyncDirectory(log->path);
+
+bail:
+	if ( !success && descriptor != -1 ) {
+		unlink(temporaryPath);
+		close(descriptor);
+	}
+
+	pthread_mutex_lock(&log->lock);
+
+	if ( success ) {
+		close(log->descriptor);
+		log->descriptor = descriptor;
+		log->fileLength = sizeof(SPIndexLogHeader) + tailLength;
+		log->appendedLength = log->fileLength + log->bufferLength;
+		if ( mark->discards ) log->recovers = false;
+	}
+
+	log->commits = false;
+	pthread_cond_broadcast(&log->condition);
+	pthread_mutex_unlock(&log->lock);
+
+	free(temporaryPath);
+	free(tail);
+
+	return success;
+}
+
+void SPIndexLogRelease(SPIndexLog *log) {
+
+	if ( log == NULL ) return;
+
+	SPIndexLogCommit(log);
+
+	close(log->descriptor);
+	pthread_cond_destroy(&log->condition);
+	pthread_mutex_destroy(&log->lock);
+
+	free(log->path);
+	free(log->buffer);
+	free(log->spare);
+	free(log);
+}
+
+#pragma mark -
+#pragma mark Replay
+
+typedef struct {
+	SPIndexRef index;
+	SPDocumentBatchRef batch;
+	size_t count;					// slots filled
+	char *uri;						// NUL terminated copy of the record's URI
+	size_t uriCapacity;
+} SPIndexLogReplay;
+
+static bool SPIndexLogReplayBatch(SPIndexLogReplay *replay) {
+
+	bool success = true;
+
+	if ( replay->count > 0 ) {
+		success = ( SPIndexAddDocumentBatch(replay->index, replay->batch) == replay->count );
+		SPDocumentBatchRelease(replay->batch);
+		replay->batch = NULL;
+		replay->count = 0;
+	}
+
+	return success;
+}
+
+static bool SPIndexLogReplayRecord(SPIndexLogReplay *replay, const SPIndexLogRecord *record, 
+		const char *uri, const void *bytes) {
+
+	// Adds are gathered into batches, so that they are analyzed and refreshed together,
+	// and the batch is added before any other change so that the order is kept
+
+	if ( (size_t)record->uriLength + 1 > replay->uriCapacity ) {
+		char *copy = realloc(replay->uri, (size_t)record->uriLength + 1);
+		if ( copy == NULL ) return false;
+
+		replay->uri = copy;
+		replay->uriCapacity = (size_t)record->uriLength + 1;
+	}
+
+	memcpy(replay->uri, uri, record->uriLength);
+	replay->uri[record->uriLength] = '\0';
+
+	switch ( record->kind ) {
+	case kSPIndexLogAdd:
+		if ( replay->batch == NULL ) {
+			replay->batch = SPDocumentBatchCreate(replay->index, kSPIndexLogReplayBatchSize);
+			if ( replay->batch == NULL ) return false;
+		}
+
+		if ( !SPDocumentBatchSetDocument(replay->batch, replay->count, replay->uri, bytes, (size_t)record->length) )
+			return false;
+
+		replay->count++;
+		return ( replay->count < kSPIndexLogReplayBatchSize || SPIndexLogReplayBatch(replay) );
+
+	case kSPIndexLogRemove:
+		if ( !SPIndexLogReplayBatch(replay) ) return false;
+		SPIndexRemoveDocument(replay->index, replay->uri);
+		return true;
+
+	case kSPIndexLogSetData:
+		if ( !SPIndexLogReplayBatch(replay) ) return false;
+		return SPIndexSetDocumentData(replay->index, replay->uri, bytes, (size_t)record->length);
+
+	default:
+		return false;
+	}
+}
+
+static bool SPIndexLogReplayRecords(SPIndexRef index, const uint8_t *bytes, size_t length, 
+		size_t *outLength, uint64_t *outSequence) {
+
+	// Applies the records after the header that the index does not hold. outLength
+	// receives the length of the log up to the first damaged record.
+
+	const SPIndexLogHeader *header = (const SPIndexLogHeader*)bytes;
+	SPIndexLogReplay replay = { index, NULL, 0, NULL, 0 };
+	size_t offset = sizeof(SPIndexLogHeader);
+	uint64_t sequence = header->firstSequence - 1;
+	bool success = true;
+
+	while ( success && length - offset >= sizeof(SPIndexLogRecord) ) {
+
+		SPIndexLogRecord record;
+		size_t size;
+
+		memcpy(&record, bytes + offset, sizeof(SPIndexLogRecord));
+
+		if ( record.length > length - offset - sizeof(SPIndexLogRecord) 
+				|| record.uriLength > length - offset - sizeof(SPIndexLogRecord) - record.length )
+			break;
+
+		size = sizeof(SPIndexLogRecord) + record.uriLength + (size_t)record.length;
+
+		if ( record.sequence <= sequence 
+				|| record.checksum != SPChecksum(bytes + offset + sizeof(uint64_t), size - sizeof(uint64_t)) )
+			break;
+
+		if ( record.sequence > index->logSequence ) {
+			const char *uri = (const char*)( bytes + offset + sizeof(SPIndexLogRecord) );
+			success = SPIndexLogReplayRecord(&replay, &record, uri, uri + record.uriLength);
+		}
+
+		sequence = record.sequence;
+		offset += size;
+	}
+
+	if ( success ) success = SPIndexLogReplayBatch(&replay);
+
+	SPDocumentBatchRelease(replay.batch);
+	free(replay.uri);
+
+	*outLength = offset;
+	*outSequence = sequence;
+
+	return success;
+}
+
+bool SPIndexOpenLog(SPIndexRef index, const char *path) {
+
+	SPIndexLog *log = NULL;
+	SPIndexLogHeader header;
+	struct stat info;
+	uint64_t sequence = index->logSequence;
+	size_t length = sizeof(SPIndexLogHeader);
+	void *bytes = MAP_FAILED;
+	int descriptor;
+	bool success = false;
+
+	if ( index->log != NULL ) return false;
+
+	descriptor = open(path, O_RDWR | O_CREAT, 0644);
+	if ( descriptor == -1 ) return false;
+
+	if ( fstat(descriptor, &info) != 0 || (uint64_t)info.st_size > SIZE_MAX ) goto bail;
+
+	if ( (size_t)info.st_size < sizeof(SPIndexLogHeader) ) {
+
+		// A new log, or one whose creation was cut short before it held any records
+
+		SPIndexLogInitHeader(&header, index->logSequence + 1);
+		if ( ftruncate(descriptor, 0) != 0 || !SPIndexLogWrite(descriptor, &header, sizeof(SPIndexLogHeader), 0) 
+				|| fsync(descriptor) != 0 || !SPSyncDirectory(path) )
+			goto bail;
+	}
+	else {
+		bytes = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+		if ( bytes == MAP_FAILED ) goto bail;
+
+		// A log that starts after the changes the index holds is missing some of them
+
+		if ( !SPIndexLogCheckHeader(bytes) || ((const SPIndexLogHeader*)bytes)->firstSequence == 0 
+				|| ((const SPIndexLogHeader*)bytes)->firstSequence > index->logSequence + 1 )
+			goto bail;
+
+		posix_madvise(bytes, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+		if ( !SPIndexLogReplayRecords(index, bytes, (size_t)info.st_size, &length, &sequence) ) goto bail;
+
+		// Later records go after the last complete one
+
+		if ( length < (size_t)info.st_size && ( ftruncate(descriptor, (off_t)length) != 0 || fsync(descriptor) != 0 ) )
+			goto bail;
+
+		if ( sequence < index->logSequence ) sequence = index->logSequence;
+		SPIndexRefresh(index);
+	}
+
+	log = calloc(1, sizeof(SPIndexLog));
+	if ( log == NULL ) goto bail;
+
+	log->path = strdup(path);
+	if ( log->path == NULL ) goto bail;
+
+	pthread_mutex_init(&log->lock, NULL);
+	pthread_cond_init(&log->condition, NULL);
+
+	log->descriptor = descriptor;
+	log->sequence = sequence;
+	log->durableSequence = sequence;
+	log->fileLength = length;
+	log->appendedLength = length;
+
+	index->log = log;
+	descriptor = -1;
+	log = NULL;
+	success = true;
+
+bail:
+	if ( bytes != MAP_FAILED ) munmap(bytes, (size_t)info.st_size);
+	if ( descriptor != -1 ) close(descriptor);
+	if ( log != NULL ) free(log);
+
+	return success;
+}
+
+bool SPIndexCommit(SPIndexRef index) {
+	return ( index->log != NULL && SPIndexLogCommit(index->log) );
+}
+
+uint64_t SPIndexGetLogLength(SPIndexRef index) {
+	return ( index->log == NULL ? 0 : SPIndexLogGetLength(index->log) );
+}
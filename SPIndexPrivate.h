@@ -0,0 +1,357 @@
+//
+//  SPIndexPrivate.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPINDEXPRIVATE_H
+#define SPINDEXPRIVATE_H
+
+#include "SPIndex.h"
+#include "SPAnalysis.h"
+#include "SPPostingList.h"
+#include "SPSegment.h"
+#include "SPSignatureIndex.h"
+#include "SPStatistics.h"
+#include "SPStringTable.h"
+#include "SPTermDirectory.h"
+#include "SPTrigramIndex.h"
+
+#include <math.h>
+#include <pthread.h>
+
+// Internal structures shared by the index, analysis and query modules. Nothing in this
+// header is part of the public interface.
+
+// The index is a log structured merge of immutable segments. Writers append analyzed
+// documents to a buffer and record removals; a refresh turns the buffer into a new
+// segment and publishes a new snapshot. Readers retain the current snapshot and work
+// from it without any further locking, so a search never waits on a writer, a refresh
+// or a merge, and always sees one consistent generation of the index.
+
+typedef struct {
+	SPDocumentID document;
+	char *uri;
+	size_t uriLength;
+	SPAnalyzedText text;
+	bool removed;					// removed or replaced before it was refreshed
+} SPBufferedDocument;
+
+typedef struct {
+	volatile int32_t retainCount;
+	uint64_t generation;
+
+	SPSegment **segments;			// oldest first
+	uint32_t *deletedCounts;		// documents of each segment found in deleted
+	size_t segmentCount;
+	SPDeletionSet *deleted;
+
+	SPTermDirectory *directory;		// owned by the index
+	SPTrigramIndex *trigrams;		// owned by the index, NULL unless indexesTrigrams
+	SPTermID termCount;				// directory entries the snapshot may look up
+	SPDocumentID maximumDocumentID;	// highest ID in any segment
+	size_t documentCount;			// live documents
+	uint64_t tokenCount;			// terms indexed across live documents
+} SPSnapshot;
+
+SPSnapshot * SPIndexCopySnapshot(SPIndexRef index);
+void SPSnapshotRelease(SPSnapshot *snapshot);
+
+	// The snapshot stays valid, and its segments alive, until it is released.
+
+const SPSegmentDocument * SPSnapshotFindDocument(const SPSnapshot *snapshot, SPDocumentID document, const SPSegment **outSegment);
+const SPSegmentDocument * SPSnapshotFindURI(const SPSnapshot *snapshot, const char *uri, size_t length, const SPSegment **outSegment);
+
+	// Return NULL unless the document is live in the snapshot.
+
+SPSnapshot * SPSnapshotCreate(SPIndexRef index, size_t segmentCount);
+void SPIndexPublishSnapshot(SPIndexRef index, SPSnapshot *snapshot);
+bool SPIndexRefreshLocked(SPIndexRef index);
+
+	// Publishing and refreshing require the write lock. Opening a saved index publishes
+	// its segments the same way a refresh does.
+
+// A scorer holds the collection statistics a ranking model needs. A term's document
+// frequency is the sum of its segments' posting counts. Term scores are the
+// product of the term's inverse document frequency and a term frequency component, so
+// that evaluation may compute the frequency component before it knows the document
+// frequency. Both components grow with the term frequency and shrink as the document
+// grows longer, so a block's maximum frequency and minimum length bound its scores.
+
+typedef struct {
+	SPRankingModel model;
+	float k1;
+	float b;
+	float documentCount;
+	float averageLength;
+	const SPCollectionStatistics *collection;	// NULL for the snapshot's own statistics
+} SPScorer;
+
+void SPScorerInit(SPScorer *scorer, const SPSnapshot *snapshot, const SPRankingOptions *options);
+void SPScorerInitWithIndex(SPScorer *scorer, SPIndexRef index, const SPSnapshot *snapshot, const SPRankingOptions *options);
+
+	// The second uses the collection statistics set on the index, if any. The scorer then
+	// refers to the index's copy of them, which lives as long as the index.
+
+static inline float SPScorerGetInverseDocumentFrequency(const SPScorer *scorer, size_t documentFrequency) {
+	float df = (float)documentFrequency;
+	if ( documentFrequency == 0 ) return 0.0f;
+	if ( scorer->model == kSPRankingModelBM25 )
+		return logf(1.0f + ( scorer->documentCount - df + 0.5f ) / ( df + 0.5f ));
+	return logf(1.0f + scorer->documentCount / df);
+}
+
+static inline float SPScorerGetTermInverseDocumentFrequency(const SPScorer *scorer, const char *term, size_t length, 
+		size_t documentFrequency) {
+	if ( scorer->collection != NULL )
+		documentFrequency = scorer->collection->getTermDocumentFrequency(term, length, scorer->collection->context);
+	return SPScorerGetInverseDocumentFrequency(scorer, documentFrequency);
+}
+
+static inline float SPScorerGetTermScore(const SPScorer *scorer, float weight, uint32_t frequency, uint32_t length) {
+	float tf = (float)frequency;
+	if ( scorer->model == kSPRankingModelBM25 ) {
+		float norm = scorer->k1 * ( 1.0f - scorer->b + scorer->b * (float)length / scorer->averageLength );
+		return weight * tf * ( scorer->k1 + 1.0f ) / ( tf + norm );
+	}
+	return weight * ( 1.0f + logf(tf) );
+}
+
+// Similarity needs the norm of every document vector, which depends on the collection
+// statistics. Norms are computed for a whole snapshot at once and shared until a later
+// generation replaces them.
+
+typedef struct {
+	volatile int32_t retainCount;
+	uint64_t generation;
+	SPScorer scorer;				// kSPRankingModelTFIDF
+	float *inverseFrequencies;		// indexed by term ID
+	float *norms;					// indexed by document ID
+} SPVectorNorms;
+
+void SPVectorNormsRelease(SPVectorNorms *norms);
+
+// Document data is kept in slots of its own, found through a URI table. Free slots are
+// chained through their lengths.
+
+typedef struct {
+	void *bytes;					// NULL for a free slot
+	size_t length;					// or the next free slot
+	uint32_t uriOffset;				// in the data table's arena
+	uint32_t uriLength;
+} SPDocumentData;
+
+bool SPIndexSetDocumentDataLocked(SPIndexRef index, const char *uri, size_t uriLength, const void *bytes, size_t length);
+
+	// Requires the write lock and does not log the change. The document data is changed
+	// only with both the write lock and the data lock held, so code holding the write lock
+	// may read it without the data lock, while SPIndexCopyDocumentData takes only the data
+	// lock and never waits for writers.
+
+// The write-ahead log records every change made to an index so that it can be replayed
+// over the last checkpoint. Records are appended under the write lock, which puts them in
+// the order the changes were made, and written out by whichever thread commits next.
+
+typedef struct SPIndexLog SPIndexLog;
+
+typedef enum {
+	kSPIndexLogAdd = 1,				// the URI and the document's text
+	kSPIndexLogRemove,				// the URI
+	kSPIndexLogSetData				// the URI and its data, empty to remove it
+} SPIndexLogKind;
+
+typedef struct {
+	uint64_t sequence;				// of the last change the checkpoint holds
+	uint64_t offset;				// where the records after it start
+	bool discards;					// the log failed, so none of its records are kept
+} SPIndexLogMark;
+
+void SPIndexLogAppend(SPIndexLog *log, SPIndexLogKind kind, const char *uri, size_t uriLength, 
+		const void *bytes, size_t length);
+bool SPIndexLogCommit(SPIndexLog *log);
+void SPIndexLogCommitIfFull(SPIndexLog *log);
+
+	// Appending requires the write lock. A record that cannot be appended or written fails
+	// the log, and commits return false until a checkpoint starts it over.
+
+void SPIndexLogMarkCheckpoint(SPIndexLog *log, SPIndexLogMark *outMark);
+bool SPIndexLogTruncate(SPIndexLog *log, const SPIndexLogMark *mark);
+
+	// Marking requires the write lock and is done as the checkpoint begins. Truncating
+	// drops the records the checkpoint holds once its file is on disk.
+
+uint64_t SPIndexLogGetSequence(SPIndexLog *log);
+uint64_t SPIndexLogGetLength(SPIndexLog *log);
+void SPIndexLogRelease(SPIndexLog *log);
+
+	// Releasing the log commits it first.
+
+uint64_t SPChecksum(const void *bytes, size_t length);
+bool SPSyncDirectory(const char *path);
+
+	// Shared by saved files and the log. Syncing the directory that holds path makes a
+	// file created or renamed there durable.
+
+struct __SPIndex {
+	SPIndexOptions options;
+	SPTermDirectory *directory;		// written only while writeLock is held
+	SPTrigramIndex *trigrams;		// updated as snapshots are published
+	SPSignatureIndex *signatures;	// updated as documents are refreshed and removed
+	SPMappedFile *file;				// NULL unless the index was opened from a file
+	SPIndexLog *log;				// NULL unless a log was opened
+	uint64_t logSequence;			// last logged change the opened file holds
+
+	pthread_mutex_t writeLock;		// guards the writer state below
+	SPStringTable *documentTable;	// URI -> ID for live documents, buffered or refreshed
+	SPBufferedDocument *buffer;		// in document ID order
+	size_t bufferCount;
+	size_t bufferCapacity;
+	SPDocumentID *pendingDeletions;	// refreshed documents removed since the last refresh
+	size_t pendingCount;
+	size_t pendingCapacity;
+	SPDocumentID maximumDocumentID;	// last ID assigned
+	SPDocumentID refreshedDocumentID; // last ID handed to a refresh
+
+	pthread_rwlock_t dataLock;		// guards the document data below, taken after writeLock
+	SPStringTable *dataTable;		// URI -> document data slot
+	SPDocumentData *data;
+	size_t dataCount;				// slots in use or free
+	size_t dataCapacity;
+	size_t freeData;				// first free slot or SIZE_MAX
+
+	pthread_mutex_t mergeLock;		// serializes merges
+	pthread_mutex_t saveLock;		// serializes saving files, taken before writeLock
+
+	pthread_mutex_t snapshotLock;	// guards the pointer, held only to swap or retain it
+	SPSnapshot *snapshot;
+
+	pthread_mutex_t normsLock;		// guards the pointer, held only to swap or retain it
+	SPVectorNorms *norms;			// NULL until similar documents are first looked up
+
+	SPCollectionStatistics collection;	// set when the index is a shard, see SPIndex.h
+	bool hasCollection;
+
+	pthread_t maintenanceThread;	// refreshes and merges when refreshInterval > 0
+	pthread_cond_t maintenanceCondition;	// waits on writeLock
+	bool hasMaintenanceThread;
+	bool stopsMaintenance;
+};
+
+// Writers take writeLock through these so that the time spent waiting for and holding it
+// is recorded. The maintenance thread sleeps on the lock's condition and takes it directly.
+
+#define SPIndexLockForWriting(index)		SPStatisticsLockMutex(&(index)->writeLock, kSPStatisticWriteLockWait, kSPStatisticWriteLockHold)
+#define SPIndexUnlockForWriting(index)		SPStatisticsUnlockMutex(&(index)->writeLock)
+
+// A batch holds analyzed documents waiting to be merged into the index.
+
+typedef struct {
+	char *uri;						// NULL until the slot is filled
+	size_t uriLength;
+	SPAnalyzedText text;
+	char *contents;					// the text itself, kept for the log if there is one
+	size_t contentsLength;
+} SPBatchDocument;
+
+struct __SPDocumentBatch {
+	SPIndexOptions options;
+	bool keepsText;
+	SPBatchDocument *documents;
+	size_t count;
+	volatile size_t byteCount;		// updated with __sync builtins
+};
+
+// Result sets are sorted on document ID so that boolean operators can be evaluated
+// with linear merges.
+
+typedef struct {
+	SPDocumentID *documents;
+	float *scores;
+	size_t count;
+	size_t capacity;
+} SPResultSet;
+
+bool SPResultSetAppend(SPResultSet *set, SPDocumentID document, float score);
+void SPResultSetFree(SPResultSet *set);
+
+// The best results found so far are kept in a bounded min-heap, so that the worst of
+// them is the threshold a new result must beat. Ties go to the lower document ID.
+
+typedef struct {
+	SPDocumentID *documents;
+	float *scores;
+	size_t count;
+	size_t limit;
+} SPTopResults;
+
+void SPTopResultsAdd(SPTopResults *top, SPDocumentID document, float score);
+void SPTopResultsSort(SPTopResults *top);
+
+	// Sorting leaves the best result first and the heap unusable for further adds.
+
+static inline float SPTopResultsGetThreshold(const SPTopResults *top) {
+	return ( top->count < top->limit ? -INFINITY : top->scores[0] );
+}
+
+// Parsed queries
+
+typedef enum {
+	kSPQueryNodeTerm,
+	kSPQueryNodeWildcard,
+	kSPQueryNodePhrase,
+	kSPQueryNodeNear,
+	kSPQueryNodeAnd,
+	kSPQueryNodeOr,
+	kSPQueryNodeNot
+} SPQueryNodeType;
+
+typedef struct SPQueryNode {
+	SPQueryNodeType type;
+	char *text;						// folded term or wildcard pattern
+	size_t length;
+	float weight;
+	uint32_t position;				// of a term within its phrase, counting dropped words
+	uint32_t distance;				// other words allowed between the terms of a NEAR
+	struct SPQueryNode **children;
+	size_t childCount;
+} SPQueryNode;
+
+SPQueryNode * SPQueryParse(const SPIndexOptions *options, const char *query, size_t length, SPSearchOptions searchOptions);
+void SPQueryNodeFree(SPQueryNode *node);
+
+bool SPSnapshotEvaluateQuery(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, SPResultSet *outResults);
+
+#endif
@@ -0,0 +1,1280 @@
+//
+//  SPIndexQuery.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPIndexPrivate.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark Result Sets
+
+bool SPResultSetAppend(SPResultSet *set, SPDocumentID document, float score) {
+
+	if ( set->count == set->capacity ) {
+		size_t capacity = ( set->capacity == 0 ? 64 : set->capacity * 2 );
+		SPDocumentID *documents = realloc(set->documents, capacity * sizeof(SPDocumentID));
+		if ( documents != NULL ) set->documents = documents;
+		float *scores = realloc(set->scores, capacity * sizeof(float));
+		if ( scores != NULL ) set->scores = scores;
+
+		if ( documents == NULL || scores == NULL ) return false;
+		set->capacity = capacity;
+	}
+
+	set->documents[set->count] = document;
+	set->scores[set->count] = score;
+	set->count++;
+
+	return true;
+}
+
+void SPResultSetFree(SPResultSet *set) {
+	free(set->documents);
+	free(set->scores);
+	memset(set, 0, sizeof(SPResultSet));
+}
+
+static void SPResultSetIntersect(SPResultSet *set, const SPResultSet *other) {
+
+	// In place, summing the scores of documents found in both sets
+
+	size_t i = 0, j = 0, count = 0;
+
+	while ( i < set->count && j < other->count ) {
+		if ( set->documents[i] < other->documents[j] ) i++;
+		else if ( set->documents[i] > other->documents[j] ) j++;
+		else {
+			set->documents[count] = set->documents[i];
+			set->scores[count] = set->scores[i] + other->scores[j];
+			count++; i++; j++;
+		}
+	}
+
+	set->count = count;
+}
+
+static void SPResultSetSubtract(SPResultSet *set, const SPResultSet *other) {
+
+	size_t i = 0, j = 0, count = 0;
+
+	while ( i < set->count ) {
+		while ( j < other->count && other->documents[j] < set->documents[i] ) j++;
+		if ( j < other->count && other->documents[j] == set->documents[i] ) {
+			i++;
+			continue;
+		}
+		set->documents[count] = set->documents[i];
+		set->scores[count] = set->scores[i];
+		count++; i++;
+	}
+
+	set->count = count;
+}
+
+// Unions over many operands, such as a wildcard that expands to thousands of terms, use
+// a dense accumulator indexed by document ID rather than repeated pairwise merges.
+
+typedef struct {
+	float *scores;
+	uint8_t *matched;
+	SPDocumentID maximumDocumentID;
+} SPAccumulator;
+
+static bool SPAccumulatorInit(SPAccumulator *accumulator, SPDocumentID maximumDocumentID) {
+	accumulator->maximumDocumentID = maximumDocumentID;
+	accumulator->scores = calloc((size_t)maximumDocumentID + 1, sizeof(float));
+	accumulator->matched = calloc((size_t)maximumDocumentID + 1, sizeof(uint8_t));
+	return ( accumulator->scores != NULL && accumulator->matched != NULL );
+}
+
+static void SPAccumulatorAdd(SPAccumulator *accumulator, const SPResultSet *set) {
+	size_t i;
+	for ( i = 0; i < set->count; i++ ) {
+		accumulator->scores[set->documents[i]] += set->scores[i];
+		accumulator->matched[set->documents[i]] = 1;
+	}
+}
+
+static bool SPAccumulatorCollect(SPAccumulator *accumulator, SPResultSet *outResults) {
+	SPDocumentID document;
+	bool success = true;
+
+	for ( document = 1; document <= accumulator->maximumDocumentID && success; document++ ) {
+		if ( accumulator->matched[document] )
+			success = SPResultSetAppend(outResults, document, accumulator->scores[document]);
+	}
+
+	free(accumulator->scores);
+	free(accumulator->matched);
+	return success;
+}
+
+#pragma mark -
+#pragma mark Query Parsing
+
+typedef enum {
+	kSPQueryTokenEnd,
+	kSPQueryTokenWord,
+	kSPQueryTokenPhrase,
+	kSPQueryTokenAnd,
+	kSPQueryTokenOr,
+	kSPQueryTokenNot,
+	kSPQueryTokenNear,
+	kSPQueryTokenOpen,
+	kSPQueryTokenClose
+} SPQueryTokenType;
+
+typedef struct {
+	const SPIndexOptions *options;
+	SPSearchOptions searchOptions;
+	const char *query;
+	size_t length;
+	size_t position;
+
+	SPQueryTokenType token;
+	const char *tokenText;
+	size_t tokenLength;
+	uint32_t tokenDistance;			// of a NEAR
+} SPQueryParser;
+
+static bool SPIsQueryOperator(char c) {
+	return ( c == '(' || c == ')' || c == '"' || c == '&' || c == '|' || c == '!' );
+}
+
+static bool SPIsQuerySpace(char c) {
+	return ( c == ' ' || c == '\t' || c == '\r' || c == '\n' );
+}
+
+static bool SPQueryParseNearOperator(const char *text, size_t length, uint32_t *outDistance) {
+
+	// NEAR on its own or NEAR/n, where n is a number of words
+
+	size_t i;
+
+	if ( length < 4 || memcmp(text, "NEAR", 4) != 0 ) return false;
+
+	if ( length == 4 ) {
+		*outDistance = kSPQueryDefaultNearDistance;
+		return true;
+	}
+
+	if ( text[4] != '/' || length == 5 || length > 14 ) return false;	// up to nine digits
+
+	*outDistance = 0;
+	for ( i = 5; i < length; i++ ) {
+		if ( text[i] < '0' || text[i] > '9' ) return false;
+		*outDistance = *outDistance * 10 + (uint32_t)( text[i] - '0' );
+	}
+
+	return true;
+}
+
+bool SPSearchIsOperatorWord(const char *word, size_t length) {
+	
+	uint32_t distance;
+	
+	return ( ( length == 3 && memcmp(word, "AND", 3) == 0 ) || ( length == 2 && memcmp(word, "OR", 2) == 0 )
+			|| ( length == 3 && memcmp(word, "NOT", 3) == 0 ) || SPQueryParseNearOperator(word, length, &distance) );
+}
+
+static void SPQueryParserNextToken(SPQueryParser *parser) {
+
+	const char *query = parser->query;
+	size_t length = parser->length;
+
+	while ( parser->position < length && SPIsQuerySpace(query[parser->position]) ) parser->position++;
+
+	parser->tokenText = query + parser->position;
+	parser->tokenLength = 0;
+
+	if ( parser->position >= length ) {
+		parser->token = kSPQueryTokenEnd;
+		return;
+	}
+
+	char c = query[parser->position];
+
+	if ( c == '(' || c == ')' || c == '!' ) {
+		parser->token = ( c == '(' ? kSPQueryTokenOpen : ( c == ')' ? kSPQueryTokenClose : kSPQueryTokenNot ) );
+		parser->position++;
+	}
+	else if ( c == '&' || c == '|' ) {
+		// accept both & and &&, | and ||
+		parser->token = ( c == '&' ? kSPQueryTokenAnd : kSPQueryTokenOr );
+		while ( parser->position < length && query[parser->position] == c ) parser->position++;
+	}
+	else if ( c == '"' ) {
+		size_t start = ++parser->position;
+		while ( parser->position < length && query[parser->position] != '"' ) parser->position++;
+
+		parser->token = kSPQueryTokenPhrase;
+		parser->tokenText = query + start;
+		parser->tokenLength = parser->position - start;
+
+		if ( parser->position < length ) parser->position++; // closing quote
+	}
+	else {
+		size_t start = parser->position;
+		while ( parser->position < length && !SPIsQuerySpace(query[parser->position])
+				&& !SPIsQueryOperator(query[parser->position]) )
+			parser->position++;
+
+		parser->token = kSPQueryTokenWord;
+		parser->tokenText = query + start;
+		parser->tokenLength = parser->position - start;
+
+		if ( parser->tokenLength == 3 && memcmp(parser->tokenText, "AND", 3) == 0 ) parser->token = kSPQueryTokenAnd;
+		else if ( parser->tokenLength == 2 && memcmp(parser->tokenText, "OR", 2) == 0 ) parser->token = kSPQueryTokenOr;
+		else if ( parser->tokenLength == 3 && memcmp(parser->tokenText, "NOT", 3) == 0 ) parser->token = kSPQueryTokenNot;
+		else if ( SPQueryParseNearOperator(parser->tokenText, parser->tokenLength, &parser->tokenDistance) ) parser->token = kSPQueryTokenNear;
+	}
+}
+
+static SPQueryNode * SPQueryNodeCreate(SPQueryNodeType type) {
+	SPQueryNode *node = calloc(1, sizeof(SPQueryNode));
+	if ( node != NULL ) {
+		node->type = type;
+		node->weight = 1.0f;
+	}
+	return node;
+}
+
+static bool SPQueryNodeAddChild(SPQueryNode *node, SPQueryNode *child) {
+	SPQueryNode **children = realloc(node->children, ( node->childCount + 1 ) * sizeof(SPQueryNode*));
+	if ( children == NULL ) {
+		SPQueryNodeFree(child);
+		return false;
+	}
+
+	node->children = children;
+	node->children[node->childCount++] = child;
+	return true;
+}
+
+void SPQueryNodeFree(SPQueryNode *node) {
+	size_t i;
+
+	if ( node == NULL ) return;
+
+	for ( i = 0; i < node->childCount; i++ ) SPQueryNodeFree(node->children[i]);
+	free(node->children);
+	free(node->text);
+	free(node);
+}
+
+static SPQueryNode * SPQueryNodeCreateTerm(SPQueryNodeType type, const char *text, size_t length) {
+	SPQueryNode *node = SPQueryNodeCreate(type);
+	if ( node == NULL ) return NULL;
+
+	node->text = malloc(length + 1);
+	if ( node->text == NULL ) {
+		free(node);
+		return NULL;
+	}
+
+	memcpy(node->text, text, length);
+	node->text[length] = '\0';
+	node->length = length;
+
+	return node;
+}
+
+static SPQueryNode * SPQueryNodeCreateFromText(const SPIndexOptions *options, const char *text, size_t length, bool allowsWildcards) {
+
+	// Splits a word or phrase into terms the same way documents are tokenized. A single
+	// term becomes a term node, several terms become a phrase. Within a word, * is kept
+	// as part of the term and turns it into a wildcard pattern. Other terms are analyzed
+	// as they were when indexed, so stop words drop out and the rest are stemmed; wildcard
+	// patterns are matched against the indexed forms as they are. Each term records its
+	// position the way the tokenizer counts them, dropped words included.
+
+	SPQueryNode *phrase = SPQueryNodeCreate(kSPQueryNodePhrase);
+	char term[kSPIndexMaximumTermLength + 1];
+	size_t position = 0;
+	uint32_t ordinal = 0;
+
+	if ( phrase == NULL ) return NULL;
+
+	while ( position < length ) {
+
+		size_t termLength = 0;
+		uint32_t characters = 0;
+		bool wildcard = false;
+
+		while ( position < length ) {
+			uint8_t c = (uint8_t)text[position];
+			if ( SPIsTermCharacter(c) ) {
+				if ( termLength < kSPIndexMaximumTermLength ) term[termLength++] = (char)SPFoldCharacter(c);
+				if ( ( c & 0xC0 ) != 0x80 ) characters++;
+			}
+			else if ( c == '*' && allowsWildcards ) {
+				if ( termLength < kSPIndexMaximumTermLength ) term[termLength++] = '*';
+				wildcard = true;
+			}
+			else if ( termLength > 0 ) {
+				break;
+			}
+			position++;
+		}
+
+		if ( termLength == 0 || ( !wildcard && characters < options->minTermLength ) )
+			continue;
+
+		if ( wildcard && characters == 0 ) // a bare * matches nothing in SearchKit either
+			continue;
+
+		ordinal++;
+
+		if ( !wildcard && ( termLength = SPAnalyzeTerm(options, term, termLength) ) == 0 )
+			continue;
+
+		SPQueryNode *node = SPQueryNodeCreateTerm(( wildcard ? kSPQueryNodeWildcard : kSPQueryNodeTerm ), term, termLength);
+		if ( node == NULL || !SPQueryNodeAddChild(phrase, node) ) {
+			SPQueryNodeFree(phrase);
+			return NULL;
+		}
+		node->position = ordinal - 1;
+	}
+
+	if ( phrase->childCount == 0 ) {
+		SPQueryNodeFree(phrase);
+		return NULL;
+	}
+
+	if ( phrase->childCount == 1 ) {
+		SPQueryNode *node = phrase->children[0];
+		phrase->childCount = 0;
+		SPQueryNodeFree(phrase);
+		return node;
+	}
+
+	return phrase;
+}
+
+static SPQueryNode * SPQueryParseOr(SPQueryParser *parser);
+
+static SPQueryNode * SPQueryParseUnary(SPQueryParser *parser) {
+
+	SPQueryNode *node = NULL;
+
+	switch ( parser->token ) {
+
+	case kSPQueryTokenNot:
+		SPQueryParserNextToken(parser);
+		node = SPQueryNodeCreate(kSPQueryNodeNot);
+		if ( node != NULL ) {
+			SPQueryNode *child = SPQueryParseUnary(parser);
+			if ( child == NULL ) {
+				SPQueryNodeFree(node);
+				return NULL;
+			}
+			if ( !SPQueryNodeAddChild(node, child) ) {
+				SPQueryNodeFree(node);
+				return NULL;
+			}
+		}
+		return node;
+
+	case kSPQueryTokenOpen:
+		SPQueryParserNextToken(parser);
+		node = SPQueryParseOr(parser);
+		if ( parser->token == kSPQueryTokenClose ) SPQueryParserNextToken(parser);
+		return node;
+
+	case kSPQueryTokenWord:
+	case kSPQueryTokenPhrase:
+		node = SPQueryNodeCreateFromText(parser->options, parser->tokenText, parser->tokenLength,
+				( parser->token == kSPQueryTokenWord ));
+		SPQueryParserNextToken(parser);
+		return node;
+
+	case kSPQueryTokenNear:
+		// a NEAR without a clause before it joins nothing
+		SPQueryParserNextToken(parser);
+		return NULL;
+
+	default:
+		return NULL;
+	}
+}
+
+static SPQueryNode * SPQueryParseNear(SPQueryParser *parser) {
+
+	// NEAR binds more tightly than AND. A run of NEARs with the same distance makes one
+	// node; a change of distance nests what came before as the first operand.
+
+	SPQueryNode *node = SPQueryParseUnary(parser);
+
+	while ( node != NULL && parser->token == kSPQueryTokenNear ) {
+		uint32_t distance = parser->tokenDistance;
+		SPQueryNode *operand;
+
+		SPQueryParserNextToken(parser);
+		operand = SPQueryParseUnary(parser);
+		if ( operand == NULL ) continue;
+
+		// SPQueryNodeAddChild frees the child when it fails, so each failure frees only what
+		// is still held here
+
+		if ( node->type != kSPQueryNodeNear || node->distance != distance ) {
+			SPQueryNode *near = SPQueryNodeCreate(kSPQueryNodeNear);
+			if ( near == NULL ) {
+				SPQueryNodeFree(node);
+				SPQueryNodeFree(operand);
+				return NULL;
+			}
+			if ( !SPQueryNodeAddChild(near, node) ) {
+				SPQueryNodeFree(near);
+				SPQueryNodeFree(operand);
+				return NULL;
+			}
+			near->distance = distance;
+			node = near;
+		}
+
+		if ( !SPQueryNodeAddChild(node, operand) ) {
+			SPQueryNodeFree(node);
+			return NULL;
+		}
+	}
+
+	return node;
+}
+
+static SPQueryNode * SPQueryParseAnd(SPQueryParser *parser) {
+
+	SPQueryNode *node = SPQueryNodeCreate(kSPQueryNodeAnd);
+	SPQueryNode *implicit = NULL;	// consecutive clauses joined by space when space means OR
+	bool explicitAnd = false;
+
+	if ( node == NULL ) return NULL;
+
+	while ( parser->token != kSPQueryTokenEnd && parser->token != kSPQueryTokenClose && parser->token != kSPQueryTokenOr ) {
+
+		if ( parser->token == kSPQueryTokenAnd ) {
+			explicitAnd = true;
+			implicit = NULL;
+			SPQueryParserNextToken(parser);
+			continue;
+		}
+
+		SPQueryNode *child = SPQueryParseNear(parser);
+		if ( child == NULL ) {
+			if ( parser->token == kSPQueryTokenClose || parser->token == kSPQueryTokenEnd ) break;
+			continue;	// empty word such as a lone punctuation mark
+		}
+
+		if ( ( parser->searchOptions & kSPSearchOptionSpaceMeansOR ) && !explicitAnd && child->type != kSPQueryNodeNot ) {
+			if ( implicit == NULL ) {
+				implicit = SPQueryNodeCreate(kSPQueryNodeOr);
+				if ( implicit == NULL || !SPQueryNodeAddChild(node, implicit) ) {
+					SPQueryNodeFree(child);
+					SPQueryNodeFree(node);
+					return NULL;
+				}
+			}
+			if ( !SPQueryNodeAddChild(implicit, child) ) {
+				SPQueryNodeFree(node);
+				return NULL;
+			}
+		}
+		else if ( !SPQueryNodeAddChild(node, child) ) {
+			SPQueryNodeFree(node);
+			return NULL;
+		}
+
+		explicitAnd = false;
+	}
+
+	return node;
+}
+
+static SPQueryNode * SPQueryParseOr(SPQueryParser *parser) {
+
+	SPQueryNode *node = SPQueryNodeCreate(kSPQueryNodeOr);
+	if ( node == NULL ) return NULL;
+
+	while ( true ) {
+		SPQueryNode *child = SPQueryParseAnd(parser);
+		if ( child == NULL || !SPQueryNodeAddChild(node, child) ) {
+			SPQueryNodeFree(node);
+			return NULL;
+		}
+
+		if ( parser->token != kSPQueryTokenOr ) break;
+		SPQueryParserNextToken(parser);
+	}
+
+	return node;
+}
+
+static SPQueryNode * SPQueryNodeSimplify(SPQueryNode *node) {
+
+	// Collapse the single child AND / OR nodes the grammar produces and drop empty ones
+
+	size_t i, count = 0;
+
+	for ( i = 0; i < node->childCount; i++ ) {
+		SPQueryNode *child = SPQueryNodeSimplify(node->children[i]);
+		if ( child != NULL ) node->children[count++] = child;
+	}
+	node->childCount = count;
+
+	if ( node->type != kSPQueryNodeTerm && node->type != kSPQueryNodeWildcard && count == 0 ) {
+		SPQueryNodeFree(node);
+		return NULL;
+	}
+
+	if ( ( node->type == kSPQueryNodeAnd || node->type == kSPQueryNodeOr || node->type == kSPQueryNodeNear ) && count == 1 ) {
+		SPQueryNode *child = node->children[0];
+		node->childCount = 0;
+		SPQueryNodeFree(node);
+		return child;
+	}
+
+	return node;
+}
+
+static SPQueryNode * SPQueryParseSimilar(const SPIndexOptions *options, const char *query, size_t length) {
+
+	// Find similar treats the query as an example document. Every distinct term becomes
+	// an optional clause weighted by its frequency in the example.
+
+	SPAnalyzedText analyzed;
+	SPIndexOptions textOptions = *options;
+	SPQueryNode *node = SPQueryNodeCreate(kSPQueryNodeOr);
+	size_t i;
+
+	if ( node == NULL ) return NULL;
+
+	textOptions.indexesPositions = false;	// only the frequencies matter
+
+	memset(&analyzed, 0, sizeof(SPAnalyzedText));
+	if ( !SPAnalyzeText(&textOptions, query, length, &analyzed) ) {
+		SPQueryNodeFree(node);
+		return NULL;
+	}
+
+	for ( i = 0; i < analyzed.count; i++ ) {
+		SPQueryNode *term = SPQueryNodeCreateTerm(kSPQueryNodeTerm, analyzed.buffer + analyzed.offsets[i], analyzed.lengths[i]);
+		if ( term == NULL || !SPQueryNodeAddChild(node, term) ) {
+			SPQueryNodeFree(node);
+			node = NULL;
+			break;
+		}
+		term->weight = (float)analyzed.frequencies[i];
+	}
+
+	SPAnalyzedTextFree(&analyzed);
+	return node;
+}
+
+SPQueryNode * SPQueryParse(const SPIndexOptions *options, const char *query, size_t length, SPSearchOptions searchOptions) {
+
+	SPQueryParser parser;
+	SPQueryNode *node;
+
+	if ( searchOptions & kSPSearchOptionFindSimilar )
+		return SPQueryNodeSimplify(SPQueryParseSimilar(options, query, length));
+
+	memset(&parser, 0, sizeof(SPQueryParser));
+	parser.options = options;
+	parser.searchOptions = searchOptions;
+	parser.query = query;
+	parser.length = length;
+
+	SPQueryParserNextToken(&parser);
+
+	node = SPQueryParseOr(&parser);
+	while ( node != NULL && parser.token != kSPQueryTokenEnd ) {
+		// unbalanced closing parenthesis, treat what follows as another clause
+		SPQueryParserNextToken(&parser);
+		SPQueryNode *rest = SPQueryParseOr(&parser);
+		if ( rest != NULL ) SPQueryNodeAddChild(node, rest);
+	}
+
+	return ( node == NULL ? NULL : SPQueryNodeSimplify(node) );
+}
+
+#pragma mark -
+#pragma mark Positions
+
+// Phrases and NEARs are evaluated in two steps. Their operands are first intersected just
+// as AND intersects them, and only the documents that survive have positions read: a
+// cursor per term skips through the term's blocks to each of them in turn and steps over
+// the position lists in between without decoding them, so a phrase costs little more than
+// the conjunction of its terms. Terms are the only operands with positions; any others
+// need only be present. Segments without positions keep every document that survives.
+
+typedef struct {
+	const SPSegment *segment;
+	const SPSegmentTerm *info;		// NULL when the segment does not have the term
+	const SPSegmentBlock *blocks;
+	SPPostingIterator iterator;
+	uint32_t block;					// holds the current posting
+	const uint8_t *list;			// the current posting's positions, or the block's first
+	bool started;					// the iterator has a current posting
+	uint32_t offset;				// of the term within a phrase
+	uint32_t *positions;			// decoded for the current posting
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t next;					// into positions while matching
+} SPPositionCursor;
+
+static void SPPositionCursorStartBlock(SPPositionCursor *cursor, uint32_t block) {
+	const SPSegmentBlock *start = &cursor->blocks[block];
+
+	SPPostingIteratorInit(&cursor->iterator, cursor->segment->postings + cursor->info->postingsOffset + start->postingsOffset, 
+			cursor->info->postingsLength - start->postingsOffset);
+	cursor->iterator.document = ( block == 0 ? 0 : cursor->blocks[block-1].lastDocument );
+	cursor->list = cursor->segment->positions + cursor->info->positionsOffset + start->positionsOffset;
+	cursor->block = block;
+	cursor->started = false;
+}
+
+static bool SPPositionCursorInit(SPPositionCursor *cursor, const SPSegment *segment, const SPQueryNode *node) {
+
+	// Returns false if memory could not be allocated
+
+	cursor->segment = segment;
+	cursor->info = SPSegmentFindTerm(segment, node->text, node->length);
+	cursor->offset = node->position;
+	if ( cursor->info == NULL ) return true;
+
+	if ( cursor->info->maxFrequency > cursor->capacity ) {
+		uint32_t *positions = realloc(cursor->positions, cursor->info->maxFrequency * sizeof(uint32_t));
+		if ( positions == NULL ) return false;
+		cursor->positions = positions;
+		cursor->capacity = cursor->info->maxFrequency;
+	}
+
+	cursor->blocks = segment->blocks + cursor->info->blockOffset;
+	SPPositionCursorStartBlock(cursor, 0);
+	return true;
+}
+
+static bool SPPositionCursorRead(SPPositionCursor *cursor, uint32_t document) {
+
+	// Moves forward to document's posting and decodes its positions. Returns false if
+	// the term has no posting for document.
+
+	if ( cursor->info == NULL ) return false;
+
+	if ( !cursor->started || cursor->iterator.document < document ) {
+		uint32_t block = cursor->block;
+
+		while ( block < cursor->info->blockCount && cursor->blocks[block].lastDocument < document ) block++;
+		if ( block == cursor->info->blockCount ) return false;
+		if ( block != cursor->block ) SPPositionCursorStartBlock(cursor, block);
+
+		do {
+			if ( cursor->started ) cursor->list = SPPositionListSkip(cursor->list);
+			if ( !SPPostingIteratorNext(&cursor->iterator) ) return false;
+			cursor->started = true;
+		} while ( cursor->iterator.document < document );
+	}
+
+	if ( cursor->iterator.document != document ) return false;
+
+	cursor->count = cursor->iterator.frequency;
+	cursor->next = 0;
+	SPPositionListDecode(cursor->list, cursor->count, cursor->positions);
+	return true;
+}
+
+static bool SPPositionsMatchPhrase(SPPositionCursor *cursors, size_t count) {
+
+	// Each position of the term with the fewest anchors a start for the phrase, which the
+	// other terms must have at their offsets from it. Starts only move forward, so each
+	// term's index into its positions does too.
+
+	size_t i, j, anchor = 0;
+
+	for ( i = 1; i < count; i++ ) {
+		if ( cursors[i].count < cursors[anchor].count ) anchor = i;
+	}
+
+	for ( i = 0; i < cursors[anchor].count; i++ ) {
+		int64_t start = (int64_t)cursors[anchor].positions[i] - cursors[anchor].offset;
+
+		if ( start < 0 ) continue;
+
+		for ( j = 0; j < count; j++ ) {
+			SPPositionCursor *cursor = &cursors[j];
+			int64_t target = start + cursor->offset;
+
+			while ( cursor->next < cursor->count && cursor->positions[cursor->next] < target ) cursor->next++;
+			if ( cursor->next == cursor->count ) return false;
+			if ( cursor->positions[cursor->next] != target ) break;
+		}
+
+		if ( j == count ) return true;
+	}
+
+	return false;
+}
+
+static bool SPPositionsMatchNear(SPPositionCursor *cursors, size_t count, uint32_t distance) {
+
+	// Looks for a window holding a position of every term with no more than distance other
+	// words in it, by repeatedly advancing whichever term is furthest behind
+
+	uint64_t span = (uint64_t)distance + count - 1;
+	size_t i;
+
+	for ( ;; ) {
+		size_t lowest = 0;
+		uint32_t highest = 0;
+
+		for ( i = 0; i < count; i++ ) {
+			uint32_t position = cursors[i].positions[cursors[i].next];
+			if ( position < cursors[lowest].positions[cursors[lowest].next] ) lowest = i;
+			if ( position > highest ) highest = position;
+		}
+
+		if ( highest - cursors[lowest].positions[cursors[lowest].next] <= span ) return true;
+		if ( ++cursors[lowest].next == cursors[lowest].count ) return false;
+	}
+}
+
+static bool SPSnapshotFilterPositions(const SPSnapshot *snapshot, const SPQueryNode *node, SPResultSet *results) {
+
+	// Keeps the documents of results whose term positions satisfy the phrase or NEAR
+
+	SPPositionCursor *cursors;
+	size_t i, j, k, termCount = 0, result = 0, count = 0;
+	bool success = true;
+
+	for ( i = 0; i < node->childCount; i++ ) {
+		if ( node->children[i]->type == kSPQueryNodeTerm ) termCount++;
+	}
+
+	if ( termCount < 2 || results->count == 0 ) return true;
+
+	cursors = calloc(termCount, sizeof(SPPositionCursor));
+	if ( cursors == NULL ) return false;
+
+	for ( i = 0; i < snapshot->segmentCount && result < results->count && success; i++ ) {
+		const SPSegment *segment = snapshot->segments[i];
+		SPDocumentID last = SPSegmentGetLastDocument(segment);
+		bool positional = ( segment->positions != NULL );
+
+		if ( results->documents[result] > last ) continue;
+
+		for ( j = 0, k = 0; j < node->childCount && positional && success; j++ ) {
+			if ( node->children[j]->type == kSPQueryNodeTerm )
+				success = SPPositionCursorInit(&cursors[k++], segment, node->children[j]);
+		}
+
+		for ( ; result < results->count && results->documents[result] <= last && success; result++ ) {
+			uint32_t document = (uint32_t)results->documents[result];
+			bool matches = true;
+
+			for ( j = 0; j < termCount && matches && positional; j++ ) matches = SPPositionCursorRead(&cursors[j], document);
+
+			if ( matches && positional ) {
+				matches = ( node->type == kSPQueryNodePhrase ? SPPositionsMatchPhrase(cursors, termCount) 
+						: SPPositionsMatchNear(cursors, termCount, node->distance) );
+			}
+
+			if ( matches ) {
+				results->documents[count] = results->documents[result];
+				results->scores[count] = results->scores[result];
+				count++;
+			}
+		}
+	}
+
+	results->count = count;
+
+	for ( i = 0; i < termCount; i++ ) free(cursors[i].positions);
+	free(cursors);
+
+	return success;
+}
+
+#pragma mark -
+#pragma mark Evaluation
+
+static const SPSegmentDocument * SPSegmentSeekDocument(const SPSegmentDocument *document, const SPSegmentDocument *end, SPDocumentID target) {
+
+	// Gallops forward through a segment's document table to target, which must be there
+
+	size_t step = 1;
+
+	while ( document + step < end && document[step].document <= target ) {
+		document += step;
+		step *= 2;
+	}
+
+	while ( document->document < target ) {
+		step = ( step > 1 ? step / 2 : 1 );
+		if ( document + step < end && document[step].document <= target ) document += step;
+	}
+
+	return document;
+}
+
+static bool SPSnapshotEvaluateTerm(const SPSnapshot *snapshot, const SPScorer *scorer, const char *term, size_t length, 
+		float weight, SPResultSet *outResults) {
+
+	// The term's postings are read segment by segment, which yields them in document
+	// order, and the inverse document frequency is applied once they are all read.
+	// Document lengths, when the model needs them, are found by galloping through the
+	// segment's document table alongside the postings.
+
+	bool needsLengths = ( scorer->model == kSPRankingModelBM25 );
+	size_t i, first = outResults->count, documentCount = 0;
+	float idf;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegment *segment = snapshot->segments[i];
+		const SPSegmentTerm *info = SPSegmentFindTerm(segment, term, length);
+		const SPSegmentDocument *document = segment->documents;
+		const SPSegmentDocument *end = segment->documents + segment->documentCount;
+		SPPostingIterator iterator;
+
+		if ( info == NULL ) continue;
+
+		documentCount += info->documentCount;
+		SPPostingIteratorInit(&iterator, segment->postings + info->postingsOffset, info->postingsLength);
+
+		while ( SPPostingIteratorNext(&iterator) ) {
+			uint32_t documentLength = 0;
+
+			if ( SPDeletionSetContains(snapshot->deleted, (SPDocumentID)iterator.document) ) continue;
+
+			if ( needsLengths ) {
+				document = SPSegmentSeekDocument(document, end, (SPDocumentID)iterator.document);
+				documentLength = document->length;
+			}
+
+			float score = SPScorerGetTermScore(scorer, weight, iterator.frequency, documentLength);
+			if ( !SPResultSetAppend(outResults, (SPDocumentID)iterator.document, score) ) return false;
+		}
+	}
+
+	idf = SPScorerGetTermInverseDocumentFrequency(scorer, term, length, documentCount);
+	for ( i = first; i < outResults->count; i++ ) outResults->scores[i] *= idf;
+
+	return true;
+}
+
+static bool SPWildcardMatch(const char *pattern, size_t patternLength, const char *string, size_t length) {
+
+	// Iterative glob matching with * as the only metacharacter
+
+	size_t p = 0, s = 0, star = (size_t)-1, mark = 0;
+
+	while ( s < length ) {
+		if ( p < patternLength && pattern[p] == '*' ) {
+			star = p++;
+			mark = s;
+		}
+		else if ( p < patternLength && pattern[p] == string[s] ) {
+			p++; s++;
+		}
+		else if ( star != (size_t)-1 ) {
+			p = star + 1;
+			s = ++mark;
+		}
+		else {
+			return false;
+		}
+	}
+
+	while ( p < patternLength && pattern[p] == '*' ) p++;
+	return ( p == patternLength );
+}
+
+static int SPCompareTermIDs(const void *a, const void *b) {
+	SPTermID x = *(const SPTermID*)a, y = *(const SPTermID*)b;
+	return ( x < y ? -1 : ( x > y ? 1 : 0 ) );
+}
+
+static bool SPSnapshotCopyWildcardTerms(const SPSnapshot *snapshot, const SPQueryNode *node, SPTermID **outTerms, size_t *outCount) {
+
+	// Candidates from the trigram index are matched against the pattern. Without one, or
+	// when the pattern has too few literal characters, each segment's dictionary is
+	// matched instead and the terms found are sorted and deduplicated.
+
+	SPTermID *terms = NULL;
+	size_t i, j, prefixLength, termCount = 0, termCapacity = 0;
+
+	if ( snapshot->trigrams != NULL 
+			&& SPTrigramIndexCopyCandidates(snapshot->trigrams, node->text, node->length, snapshot->termCount, &terms, &termCount) ) {
+
+		for ( i = 0, j = 0; i < termCount; i++ ) {
+			size_t length;
+			const char *string = SPTermDirectoryGetTerm(snapshot->directory, terms[i], &length);
+			if ( SPWildcardMatch(node->text, node->length, string, length) ) terms[j++] = terms[i];
+		}
+
+		*outTerms = terms;
+		*outCount = j;
+		return true;
+	}
+
+	// The dictionaries are sorted, so only the range of terms that begin with the literal
+	// prefix of the pattern needs to be scanned
+
+	prefixLength = 0;
+	while ( prefixLength < node->length && node->text[prefixLength] != '*' ) prefixLength++;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		SPSegmentTermReader reader;
+
+		for ( SPSegmentTermReaderSeek(&reader, snapshot->segments[i], node->text, prefixLength); reader.term != NULL; SPSegmentTermReaderNext(&reader) ) {
+			if ( reader.length < prefixLength || memcmp(reader.string, node->text, prefixLength) != 0 ) 
+				break;
+			if ( !SPWildcardMatch(node->text, node->length, reader.string, reader.length) )
+				continue;
+
+			if ( termCount == termCapacity ) {
+				size_t capacity = ( termCapacity == 0 ? 64 : termCapacity * 2 );
+				SPTermID *grown = realloc(terms, capacity * sizeof(SPTermID));
+				if ( grown == NULL ) {
+					free(terms);
+					return false;
+				}
+				terms = grown;
+				termCapacity = capacity;
+			}
+
+			terms[termCount++] = reader.term->term;
+		}
+	}
+
+	if ( termCount > 0 ) qsort(terms, termCount, sizeof(SPTermID), SPCompareTermIDs);
+
+	for ( i = 0, j = 0; i < termCount; i++ ) {
+		if ( i == 0 || terms[i] != terms[i-1] ) terms[j++] = terms[i];
+	}
+
+	*outTerms = terms;
+	*outCount = j;
+	return true;
+}
+
+static bool SPSnapshotEvaluateWildcard(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, SPResultSet *outResults) {
+
+	// The distinct terms matching the pattern are evaluated across all segments
+
+	SPAccumulator accumulator;
+	SPResultSet termResults;
+	SPTermID *terms = NULL;
+	size_t i, termCount = 0;
+	bool success;
+
+	if ( !SPAccumulatorInit(&accumulator, snapshot->maximumDocumentID) ) {
+		free(accumulator.scores);
+		free(accumulator.matched);
+		return false;
+	}
+
+	memset(&termResults, 0, sizeof(SPResultSet));
+
+	success = SPSnapshotCopyWildcardTerms(snapshot, node, &terms, &termCount);
+
+	for ( i = 0; i < termCount && success; i++ ) {
+		size_t length;
+		const char *string = SPTermDirectoryGetTerm(snapshot->directory, terms[i], &length);
+
+		termResults.count = 0;
+		success = SPSnapshotEvaluateTerm(snapshot, scorer, string, length, node->weight, &termResults);
+		if ( success ) SPAccumulatorAdd(&accumulator, &termResults);
+	}
+
+	free(terms);
+	SPResultSetFree(&termResults);
+	return ( SPAccumulatorCollect(&accumulator, outResults) && success );
+}
+
+static bool SPSnapshotEvaluateAll(const SPSnapshot *snapshot, SPResultSet *outResults) {
+	size_t i, j;
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegment *segment = snapshot->segments[i];
+
+		for ( j = 0; j < segment->documentCount; j++ ) {
+			SPDocumentID document = segment->documents[j].document;
+			if ( !SPDeletionSetContains(snapshot->deleted, document) && !SPResultSetAppend(outResults, document, 0.0f) )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool SPSnapshotEvaluateNode(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, SPResultSet *outResults);
+
+static bool SPSnapshotEvaluateConjunction(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, SPResultSet *outResults) {
+
+	// Positive clauses are intersected, smallest first would be better but the posting
+	// lists are short enough in practice. Negated clauses are subtracted afterwards. A
+	// conjunction made only of negations is evaluated against every document.
+
+	SPResultSet childResults;
+	bool hasPositive = false;
+	bool success = true;
+	size_t i;
+
+	memset(&childResults, 0, sizeof(SPResultSet));
+
+	for ( i = 0; i < node->childCount && success; i++ ) {
+		const SPQueryNode *child = node->children[i];
+		if ( child->type == kSPQueryNodeNot ) continue;
+
+		if ( !hasPositive ) {
+			success = SPSnapshotEvaluateNode(snapshot, scorer, child, outResults);
+			hasPositive = true;
+		}
+		else {
+			childResults.count = 0;
+			success = SPSnapshotEvaluateNode(snapshot, scorer, child, &childResults);
+			if ( success ) SPResultSetIntersect(outResults, &childResults);
+		}
+
+		if ( outResults->count == 0 ) break;
+	}
+
+	if ( success && !hasPositive ) success = SPSnapshotEvaluateAll(snapshot, outResults);
+
+	for ( i = 0; i < node->childCount && success && outResults->count > 0; i++ ) {
+		const SPQueryNode *child = node->children[i];
+		if ( child->type != kSPQueryNodeNot ) continue;
+
+		childResults.count = 0;
+		success = SPSnapshotEvaluateNode(snapshot, scorer, child->children[0], &childResults);
+		if ( success ) SPResultSetSubtract(outResults, &childResults);
+	}
+
+	SPResultSetFree(&childResults);
+	return success;
+}
+
+static bool SPSnapshotEvaluateDisjunction(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, SPResultSet *outResults) {
+
+	SPAccumulator accumulator;
+	SPResultSet childResults;
+	bool success = true;
+	size_t i;
+
+	if ( !SPAccumulatorInit(&accumulator, snapshot->maximumDocumentID) ) {
+		free(accumulator.scores);
+		free(accumulator.matched);
+		return false;
+	}
+
+	memset(&childResults, 0, sizeof(SPResultSet));
+
+	for ( i = 0; i < node->childCount && success; i++ ) {
+		childResults.count = 0;
+		success = SPSnapshotEvaluateNode(snapshot, scorer, node->children[i], &childResults);
+		if ( success ) SPAccumulatorAdd(&accumulator, &childResults);
+	}
+
+	SPResultSetFree(&childResults);
+	return ( SPAccumulatorCollect(&accumulator, outResults) && success );
+}
+
+static bool SPSnapshotEvaluateNode(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, SPResultSet *outResults) {
+
+	switch ( node->type ) {
+
+	case kSPQueryNodeTerm:
+		return SPSnapshotEvaluateTerm(snapshot, scorer, node->text, node->length, node->weight, outResults);
+
+	case kSPQueryNodeWildcard:
+		return SPSnapshotEvaluateWildcard(snapshot, scorer, node, outResults);
+
+	case kSPQueryNodePhrase:
+	case kSPQueryNodeNear:
+		return SPSnapshotEvaluateConjunction(snapshot, scorer, node, outResults) 
+				&& SPSnapshotFilterPositions(snapshot, node, outResults);
+
+	case kSPQueryNodeAnd:
+		return SPSnapshotEvaluateConjunction(snapshot, scorer, node, outResults);
+
+	case kSPQueryNodeOr:
+		return SPSnapshotEvaluateDisjunction(snapshot, scorer, node, outResults);
+
+	case kSPQueryNodeNot: {
+		// A negation on its own, or within a disjunction, matches every other document
+		SPQueryNode conjunction;
+		const SPQueryNode *children[1] = { node };
+
+		memset(&conjunction, 0, sizeof(SPQueryNode));
+		conjunction.type = kSPQueryNodeAnd;
+		conjunction.children = (SPQueryNode**)children;
+		conjunction.childCount = 1;
+
+		return SPSnapshotEvaluateConjunction(snapshot, scorer, &conjunction, outResults);
+	}
+	}
+
+	return false;
+}
+
+bool SPSnapshotEvaluateQuery(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, SPResultSet *outResults) {
+	if ( node == NULL ) return true;
+	return SPSnapshotEvaluateNode(snapshot, scorer, node, outResults);
+}
+
+#pragma mark -
+#pragma mark Searches
+
+struct __SPSearch {
+	SPDocumentID *documents;
+	float *scores;
+	size_t count;
+	size_t position;
+	volatile int cancelled;		// set from any thread, read with __sync builtins
+};
+
+typedef struct {
+	SPDocumentID document;
+	float score;
+} SPScoredDocument;
+
+static int SPCompareScoredDocuments(const void *a, const void *b) {
+	const SPScoredDocument *x = a, *y = b;
+	if ( x->score != y->score ) return ( x->score > y->score ? -1 : 1 );
+	return ( x->document < y->document ? -1 : ( x->document > y->document ? 1 : 0 ) );
+}
+
+SPSearchRef SPSearchCreate(SPIndexRef index, const char *query, size_t length, SPSearchOptions options) {
+
+	SPSearchRef search = calloc(1, sizeof(struct __SPSearch));
+	SPQueryNode *node;
+	SPResultSet results;
+	size_t i;
+
+	if ( search == NULL ) return NULL;
+
+	node = SPQueryParse(&index->options, query, length, options);
+	memset(&results, 0, sizeof(SPResultSet));
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	SPRankingOptions ranking = { kSPRankingModelTFIDF, 0.0f, 0.0f };
+	SPScorer scorer;
+
+	SPScorerInitWithIndex(&scorer, index, snapshot, &ranking);
+	bool success = SPSnapshotEvaluateQuery(snapshot, &scorer, node, &results);
+	SPSnapshotRelease(snapshot);
+
+	SPQueryNodeFree(node);
+
+	if ( !success ) {
+		SPResultSetFree(&results);
+		free(search);
+		return NULL;
+	}
+
+	// Order by descending relevance
+
+	SPScoredDocument *scored = malloc(( results.count == 0 ? 1 : results.count ) * sizeof(SPScoredDocument));
+	if ( scored == NULL ) {
+		SPResultSetFree(&results);
+		free(search);
+		return NULL;
+	}
+
+	for ( i = 0; i < results.count; i++ ) {
+		scored[i].document = results.documents[i];
+		scored[i].score = ( options & kSPSearchOptionNoRelevanceScores ? 0.0f : results.scores[i] );
+	}
+
+	if ( !( options & kSPSearchOptionNoRelevanceScores ) )
+		qsort(scored, results.count, sizeof(SPScoredDocument), SPCompareScoredDocuments);
+
+	for ( i = 0; i < results.count; i++ ) {
+		results.documents[i] = scored[i].document;
+		results.scores[i] = scored[i].score;
+	}
+
+	free(scored);
+
+	search->documents = results.documents;
+	search->scores = results.scores;
+	search->count = results.count;
+
+	return search;
+}
+
+void SPSearchRelease(SPSearchRef search) {
+	if ( search == NULL ) return;
+
+	free(search->documents);
+	free(search->scores);
+	free(search);
+}
+
+bool SPSearchFindMatches(SPSearchRef search, size_t maxCount, SPDocumentID *outDocuments,
+		float *outScores, size_t *outFoundCount) {
+
+	size_t count = 0;
+
+	if ( __sync_fetch_and_add(&search->cancelled, 0) ) {
+		if ( outFoundCount != NULL ) *outFoundCount = 0;
+		return false;
+	}
+
+	count = search->count - search->position;
+	if ( count > maxCount ) count = maxCount;
+
+	if ( count > 0 ) {
+		memcpy(outDocuments, search->documents + search->position, count * sizeof(SPDocumentID));
+		if ( outScores != NULL ) memcpy(outScores, search->scores + search->position, count * sizeof(float));
+	}
+
+	search->position += count;
+	if ( outFoundCount != NULL ) *outFoundCount = count;
+
+	return ( search->position < search->count );
+}
+
+size_t SPSearchGetResultCount(SPSearchRef search) {
+	return search->count;
+}
+
+void SPSearchCancel(SPSearchRef search) {
+	__sync_lock_test_and_set(&search->cancelled, 1);
+}
@@ -0,0 +1,520 @@
+//
+//  SPIndexRanking.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPIndexPrivate.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Ranked retrieval. Rather than scoring every match and sorting, the best results found
+// so far are kept in a bounded heap whose worst score is the threshold a document must
+// beat. Posting lists carry the highest score any of their blocks can contribute, which
+// lets whole blocks of documents be skipped once they cannot reach the threshold.
+
+#pragma mark Top Results
+
+// The root of the heap is the worst result held: the lowest score, or on equal scores
+// the higher document ID.
+
+static bool SPTopResultsIsWorse(const SPTopResults *top, size_t i, size_t j) {
+	if ( top->scores[i] != top->scores[j] ) return ( top->scores[i] < top->scores[j] );
+	return ( top->documents[i] > top->documents[j] );
+}
+
+static void SPTopResultsSwap(SPTopResults *top, size_t i, size_t j) {
+	SPDocumentID document = top->documents[i];
+	float score = top->scores[i];
+
+	top->documents[i] = top->documents[j];
+	top->scores[i] = top->scores[j];
+	top->documents[j] = document;
+	top->scores[j] = score;
+}
+
+static void SPTopResultsSiftDown(SPTopResults *top, size_t i) {
+	for ( ;; ) {
+		size_t worst = i, left = 2 * i + 1, right = left + 1;
+
+		if ( left < top->count && SPTopResultsIsWorse(top, left, worst) ) worst = left;
+		if ( right < top->count && SPTopResultsIsWorse(top, right, worst) ) worst = right;
+		if ( worst == i ) return;
+
+		SPTopResultsSwap(top, i, worst);
+		i = worst;
+	}
+}
+
+void SPTopResultsAdd(SPTopResults *top, SPDocumentID document, float score) {
+
+	if ( top->count < top->limit ) {
+		size_t i = top->count++;
+
+		top->documents[i] = document;
+		top->scores[i] = score;
+
+		while ( i > 0 && SPTopResultsIsWorse(top, i, ( i - 1 ) / 2) ) {
+			SPTopResultsSwap(top, i, ( i - 1 ) / 2);
+			i = ( i - 1 ) / 2;
+		}
+		return;
+	}
+
+	if ( score < top->scores[0] || ( score == top->scores[0] && document > top->documents[0] ) ) 
+		return;
+
+	top->documents[0] = document;
+	top->scores[0] = score;
+	SPTopResultsSiftDown(top, 0);
+}
+
+void SPTopResultsSort(SPTopResults *top) {
+
+	// Heap sort in place, leaving the best result first
+
+	size_t count = top->count;
+
+	while ( top->count > 1 ) {
+		SPTopResultsSwap(top, 0, top->count - 1);
+		top->count--;
+		SPTopResultsSiftDown(top, 0);
+	}
+
+	top->count = count;
+}
+
+#pragma mark -
+#pragma mark Term Cursors
+
+// A cursor walks one term's postings within one segment, passing over deleted documents.
+// It tracks the skip block holding its current posting so that it can jump forward a
+// block at a time, and separately the block a probe ahead of it would land in.
+
+#define kSPTermCursorEnd UINT32_MAX
+
+typedef struct {
+	const SPSegment *segment;
+	const SPSegmentTerm *info;
+	const SPSegmentBlock *blocks;
+	const SPDeletionSet *deleted;
+	const SPScorer *scorer;
+	SPPostingIterator iterator;
+	uint32_t block;					// holds the current posting
+	uint32_t probedBlock;			// at or ahead of block
+	uint32_t document;				// kSPTermCursorEnd once exhausted
+	uint32_t frequency;
+	float weight;
+	float idf;
+	float maxScore;					// bound for every posting in the list
+} SPTermCursor;
+
+static void SPTermCursorNext(SPTermCursor *cursor) {
+
+	while ( SPPostingIteratorNext(&cursor->iterator) ) {
+		while ( cursor->iterator.document > cursor->blocks[cursor->block].lastDocument ) cursor->block++;
+		if ( SPDeletionSetContains(cursor->deleted, (SPDocumentID)cursor->iterator.document) ) continue;
+
+		cursor->document = cursor->iterator.document;
+		cursor->frequency = cursor->iterator.frequency;
+		return;
+	}
+
+	cursor->document = kSPTermCursorEnd;
+}
+
+static void SPTermCursorInit(SPTermCursor *cursor, const SPSnapshot *snapshot, const SPScorer *scorer, 
+		const SPSegment *segment, const SPSegmentTerm *info, float weight, float idf) {
+
+	cursor->segment = segment;
+	cursor->info = info;
+	cursor->blocks = segment->blocks + info->blockOffset;
+	cursor->deleted = snapshot->deleted;
+	cursor->scorer = scorer;
+	cursor->block = 0;
+	cursor->probedBlock = 0;
+	cursor->weight = weight;
+	cursor->idf = idf;
+	cursor->maxScore = SPScorerGetTermScore(scorer, weight, info->maxFrequency, info->minLength) * idf;
+
+	SPPostingIteratorInit(&cursor->iterator, segment->postings + info->postingsOffset, info->postingsLength);
+	SPTermCursorNext(cursor);
+}
+
+static void SPTermCursorSeek(SPTermCursor *cursor, uint32_t target) {
+
+	// Moves to the first live posting at or after target, skipping whole blocks that end
+	// before it. The iterator restarts at a block from the previous block's last document.
+
+	uint32_t block = cursor->block;
+
+	if ( cursor->document >= target ) return;
+
+	while ( block < cursor->info->blockCount && cursor->blocks[block].lastDocument < target ) block++;
+
+	if ( block == cursor->info->blockCount ) {
+		cursor->document = kSPTermCursorEnd;
+		return;
+	}
+
+	if ( block != cursor->block ) {
+		uint32_t offset = cursor->blocks[block].postingsOffset;
+
+		SPPostingIteratorInit(&cursor->iterator, cursor->segment->postings + cursor->info->postingsOffset + offset, 
+				cursor->info->postingsLength - offset);
+		cursor->iterator.document = cursor->blocks[block-1].lastDocument;
+		cursor->block = block;
+	}
+
+	do SPTermCursorNext(cursor); while ( cursor->document < target );
+}
+
+static float SPTermCursorProbe(SPTermCursor *cursor, uint32_t target, uint32_t *outLastDocument) {
+
+	// Bounds the score of target without moving the cursor, using the block target would
+	// fall in. *outLastDocument receives the end of that block; no document up to it can
+	// score more than the bound.
+
+	uint32_t block = cursor->probedBlock;
+
+	if ( block < cursor->block || ( block > cursor->block && cursor->blocks[block-1].lastDocument >= target ) )
+		block = cursor->block;
+
+	while ( block < cursor->info->blockCount && cursor->blocks[block].lastDocument < target ) block++;
+	cursor->probedBlock = block;
+
+	if ( block == cursor->info->blockCount ) {
+		*outLastDocument = kSPTermCursorEnd;
+		return 0.0f;
+	}
+
+	*outLastDocument = cursor->blocks[block].lastDocument;
+	return SPScorerGetTermScore(cursor->scorer, cursor->weight, cursor->blocks[block].maxFrequency, 
+			cursor->blocks[block].minLength) * cursor->idf;
+}
+
+static float SPTermCursorGetScore(const SPTermCursor *cursor) {
+	const SPSegmentDocument *document = SPSegmentFindDocument(cursor->segment, (SPDocumentID)cursor->document);
+	return SPScorerGetTermScore(cursor->scorer, cursor->weight, cursor->frequency, document->length) * cursor->idf;
+}
+
+static float SPTermCursorsGetScore(const SPTermCursor *cursors, size_t count, uint32_t document) {
+
+	// Sums in query order, the order full evaluation adds term scores in, so that both
+	// produce identical scores.
+
+	float score = 0.0f;
+	size_t i;
+
+	for ( i = 0; i < count; i++ ) {
+		if ( cursors[i].document == document ) score += SPTermCursorGetScore(&cursors[i]);
+	}
+
+	return score;
+}
+
+static void SPTermCursorsSortByDocument(SPTermCursor **order, size_t count) {
+	size_t i, j;
+
+	// Insertion sort, the cursors are nearly in order after each step
+
+	for ( i = 1; i < count; i++ ) {
+		SPTermCursor *cursor = order[i];
+		for ( j = i; j > 0 && order[j-1]->document > cursor->document; j-- ) order[j] = order[j-1];
+		order[j] = cursor;
+	}
+}
+
+#pragma mark -
+#pragma mark Ranking
+
+static void SPRankDisjunction(SPTermCursor *cursors, SPTermCursor **order, size_t count, SPTopResults *top) {
+
+	// Block-max WAND. With the cursors ordered by document, the pivot is the first cursor
+	// at which the summed list bounds exceed the threshold: no document before it can
+	// make the top results. The pivot document is then bounded again with the blocks it
+	// falls in. If even that falls short, every document up to the nearest block end is
+	// skipped, otherwise the cursors behind the pivot are moved up to it and, once all
+	// of them are there, the document is scored.
+
+	size_t i;
+
+	for ( i = 0; i < count; i++ ) order[i] = &cursors[i];
+	SPTermCursorsSortByDocument(order, count);
+
+	for ( ;; ) {
+		float threshold = SPTopResultsGetThreshold(top), bound = 0.0f, blockBound = 0.0f;
+		uint32_t document, blockEnd = kSPTermCursorEnd;
+		size_t pivot;
+
+		for ( pivot = 0; pivot < count && order[pivot]->document != kSPTermCursorEnd; pivot++ ) {
+			bound += order[pivot]->maxScore;
+			if ( bound > threshold ) break;
+		}
+
+		if ( pivot == count || order[pivot]->document == kSPTermCursorEnd ) break;
+
+		document = order[pivot]->document;
+		while ( pivot + 1 < count && order[pivot+1]->document == document ) pivot++;
+
+		for ( i = 0; i <= pivot; i++ ) {
+			uint32_t lastDocument;
+			blockBound += SPTermCursorProbe(order[i], document, &lastDocument);
+			if ( lastDocument < blockEnd ) blockEnd = lastDocument;
+		}
+
+		if ( blockBound > threshold ) {
+			if ( order[0]->document == document ) {
+				SPTopResultsAdd(top, (SPDocumentID)document, SPTermCursorsGetScore(cursors, count, document));
+				for ( i = 0; i <= pivot; i++ ) SPTermCursorNext(order[i]);
+			}
+			else {
+				for ( i = 0; order[i]->document < document; i++ ) SPTermCursorSeek(order[i], document);
+			}
+		}
+		else {
+			uint32_t target = ( blockEnd == kSPTermCursorEnd ? kSPTermCursorEnd : blockEnd + 1 );
+			size_t best = 0;
+
+			if ( pivot + 1 < count && order[pivot+1]->document < target ) target = order[pivot+1]->document;
+
+			for ( i = 1; i <= pivot; i++ ) {
+				if ( order[i]->maxScore > order[best]->maxScore ) best = i;
+			}
+
+			SPTermCursorSeek(order[best], target);
+		}
+
+		SPTermCursorsSortByDocument(order, count);
+	}
+}
+
+static int SPCompareCursorLengths(const void *a, const void *b) {
+	const SPTermCursor *x = *(SPTermCursor * const *)a, *y = *(SPTermCursor * const *)b;
+	return ( x->info->documentCount < y->info->documentCount ? -1 : ( x->info->documentCount > y->info->documentCount ? 1 : 0 ) );
+}
+
+static void SPRankConjunction(SPTermCursor *cursors, SPTermCursor **order, size_t count, SPTopResults *top) {
+
+	// Leapfrog intersection led by the rarest term. Candidates whose blocks cannot reach
+	// the threshold are skipped to the nearest block end before the other lists are
+	// searched for them.
+
+	float maxScore = 0.0f;
+	uint32_t document;
+	size_t i;
+
+	for ( i = 0; i < count; i++ ) {
+		order[i] = &cursors[i];
+		maxScore += cursors[i].maxScore;
+	}
+
+	qsort(order, count, sizeof(SPTermCursor*), SPCompareCursorLengths);
+	document = order[0]->document;
+
+	while ( document != kSPTermCursorEnd && maxScore > SPTopResultsGetThreshold(top) ) {
+		float threshold = SPTopResultsGetThreshold(top), blockBound = 0.0f;
+		uint32_t blockEnd = kSPTermCursorEnd;
+
+		for ( i = 0; i < count; i++ ) {
+			uint32_t lastDocument;
+			blockBound += SPTermCursorProbe(order[i], document, &lastDocument);
+			if ( lastDocument < blockEnd ) blockEnd = lastDocument;
+		}
+
+		if ( blockBound <= threshold ) {
+			SPTermCursorSeek(order[0], ( blockEnd == kSPTermCursorEnd ? kSPTermCursorEnd : blockEnd + 1 ));
+			document = order[0]->document;
+			continue;
+		}
+
+		for ( i = 1; i < count; i++ ) {
+			SPTermCursorSeek(order[i], document);
+			if ( order[i]->document != document ) break;
+		}
+
+		if ( i == count ) {
+			SPTopResultsAdd(top, (SPDocumentID)document, SPTermCursorsGetScore(cursors, count, document));
+			SPTermCursorNext(order[0]);
+		}
+		else {
+			SPTermCursorSeek(order[0], order[i]->document);
+		}
+
+		document = order[0]->document;
+	}
+}
+
+static bool SPQueryNodeIsRankable(const SPQueryNode *node) {
+
+	// A single term, or terms joined by one operator
+
+	size_t i;
+
+	if ( node->type == kSPQueryNodeTerm ) return true;
+	if ( node->type != kSPQueryNodeAnd && node->type != kSPQueryNodeOr ) return false;
+
+	for ( i = 0; i < node->childCount; i++ ) {
+		if ( node->children[i]->type != kSPQueryNodeTerm ) return false;
+	}
+
+	return ( node->childCount > 0 );
+}
+
+static bool SPSnapshotRankTerms(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, SPTopResults *top) {
+
+	// Segments are ranked oldest first, which offers documents to the heap in ID order,
+	// and the threshold carries over from one segment to the next.
+
+	const SPQueryNode * const *terms = (const SPQueryNode * const *)node->children;
+	bool conjunctive = ( node->type == kSPQueryNodeAnd );
+	size_t i, j, termCount = node->childCount;
+	SPTermCursor *cursors = NULL;
+	SPTermCursor **order = NULL;
+	float *idfs = NULL;
+	bool success = false;
+
+	if ( node->type == kSPQueryNodeTerm ) {
+		terms = &node;
+		termCount = 1;
+	}
+
+	cursors = malloc(termCount * sizeof(SPTermCursor));
+	order = malloc(termCount * sizeof(SPTermCursor*));
+	idfs = malloc(termCount * sizeof(float));
+	if ( cursors == NULL || order == NULL || idfs == NULL ) goto bail;
+
+	for ( i = 0; i < termCount; i++ ) {
+		size_t documentCount = 0;
+
+		for ( j = 0; j < snapshot->segmentCount; j++ ) {
+			const SPSegmentTerm *info = SPSegmentFindTerm(snapshot->segments[j], terms[i]->text, terms[i]->length);
+			if ( info != NULL ) documentCount += info->documentCount;
+		}
+
+		idfs[i] = SPScorerGetTermInverseDocumentFrequency(scorer, terms[i]->text, terms[i]->length, documentCount);
+	}
+
+	for ( j = 0; j < snapshot->segmentCount; j++ ) {
+		const SPSegment *segment = snapshot->segments[j];
+		size_t count = 0;
+
+		if ( snapshot->deletedCounts[j] == segment->documentCount ) continue;
+
+		for ( i = 0; i < termCount; i++ ) {
+			const SPSegmentTerm *info = SPSegmentFindTerm(segment, terms[i]->text, terms[i]->length);
+
+			if ( info == NULL ) {
+				if ( conjunctive ) break;
+				continue;
+			}
+
+			SPTermCursorInit(&cursors[count++], snapshot, scorer, segment, info, terms[i]->weight, idfs[i]);
+		}
+
+		if ( count == 0 || ( conjunctive && i < termCount ) ) continue;
+
+		if ( conjunctive ) SPRankConjunction(cursors, order, count, top);
+		else SPRankDisjunction(cursors, order, count, top);
+	}
+
+	success = true;
+
+bail:
+	free(cursors);
+	free(order);
+	free(idfs);
+	return success;
+}
+
+static bool SPSnapshotCollectTopResults(const SPSnapshot *snapshot, const SPScorer *scorer, const SPQueryNode *node, 
+		bool scoresResults, SPTopResults *top) {
+
+	SPResultSet results;
+	bool success;
+	size_t i;
+
+	memset(&results, 0, sizeof(SPResultSet));
+	success = SPSnapshotEvaluateQuery(snapshot, scorer, node, &results);
+
+	for ( i = 0; i < results.count && success; i++ )
+		SPTopResultsAdd(top, results.documents[i], ( scoresResults ? results.scores[i] : 0.0f ));
+
+	SPResultSetFree(&results);
+	return success;
+}
+
+size_t SPIndexCopyTopResults(SPIndexRef index, const char *query, size_t length, SPSearchOptions options, 
+		const SPRankingOptions *ranking, size_t limit, SPDocumentID *outDocuments, float *outScores) {
+
+	SPQueryNode *node = SPQueryParse(&index->options, query, length, options);
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	bool scoresResults = !( options & kSPSearchOptionNoRelevanceScores );
+	bool success = false;
+	SPTopResults top;
+	SPScorer scorer;
+
+	memset(&top, 0, sizeof(SPTopResults));
+	top.limit = ( limit < snapshot->documentCount ? limit : snapshot->documentCount );
+
+	if ( node == NULL || top.limit == 0 ) goto bail;
+
+	top.documents = malloc(top.limit * sizeof(SPDocumentID));
+	top.scores = malloc(top.limit * sizeof(float));
+	if ( top.documents == NULL || top.scores == NULL ) goto bail;
+
+	SPScorerInitWithIndex(&scorer, index, snapshot, ranking);
+
+	if ( scoresResults && SPQueryNodeIsRankable(node) )
+		success = SPSnapshotRankTerms(snapshot, &scorer, node, &top);
+	else
+		success = SPSnapshotCollectTopResults(snapshot, &scorer, node, scoresResults, &top);
+
+	if ( success ) {
+		SPTopResultsSort(&top);
+		memcpy(outDocuments, top.documents, top.count * sizeof(SPDocumentID));
+		if ( outScores != NULL ) memcpy(outScores, top.scores, top.count * sizeof(float));
+	}
+
+bail:
+	SPSnapshotRelease(snapshot);
+	SPQueryNodeFree(node);
+	free(top.documents);
+	free(top.scores);
+	return ( success ? top.count : 0 );
+}
@@ -0,0 +1,687 @@
+//
+//  SPIngest.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPIngest.h"
+#include "SPStringTable.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kSPIngestDefaultQueueCapacity	256
+#define kSPIngestDefaultBatchSize		256
+#define kSPIngestMaximumReaders			64
+
+#pragma mark -
+#pragma mark Catalog
+
+typedef struct {
+	int64_t modified;
+	uint64_t size;
+	uint64_t hash;
+} SPIngestEntry;
+
+struct SPIngestCatalog {
+	pthread_mutex_t lock;
+	SPStringTable *paths;				// path -> index in entries
+	SPIngestEntry *entries;
+	size_t entryCount;
+	size_t entryCapacity;
+	size_t count;
+};
+
+SPIngestCatalog * SPIngestCatalogCreate(void) {
+
+	SPIngestCatalog *catalog = calloc(1, sizeof(SPIngestCatalog));
+	if ( catalog == NULL ) return NULL;
+
+	catalog->paths = SPStringTableCreate(1024);
+	if ( catalog->paths == NULL ) {
+		free(catalog);
+		return NULL;
+	}
+
+	pthread_mutex_init(&catalog->lock, NULL);
+	return catalog;
+}
+
+void SPIngestCatalogRelease(SPIngestCatalog *catalog) {
+	if ( catalog == NULL ) return;
+
+	pthread_mutex_destroy(&catalog->lock);
+	SPStringTableRelease(catalog->paths);
+	free(catalog->entries);
+	free(catalog);
+}
+
+static bool SPIngestCatalogGetEntry(SPIngestCatalog *catalog, const char *path, size_t length, SPIngestEntry *outEntry) {
+
+	int32_t value;
+
+	pthread_mutex_lock(&catalog->lock);
+	value = SPStringTableGetValue(catalog->paths, path, length);
+	if ( value != kSPStringTableNotFound ) *outEntry = catalog->entries[value];
+	pthread_mutex_unlock(&catalog->lock);
+
+	return ( value != kSPStringTableNotFound );
+}
+
+static bool SPIngestCatalogSetEntry(SPIngestCatalog *catalog, const char *path, size_t length, const SPIngestEntry *entry) {
+
+	// Entries are never reused, so a removed path leaves its slot behind. Paths are only
+	// removed along with their documents, which is rare next to crawling.
+
+	int32_t value;
+	bool success = false;
+
+	pthread_mutex_lock(&catalog->lock);
+
+	value = SPStringTableGetValue(catalog->paths, path, length);
+
+	if ( value == kSPStringTableNotFound ) {
+
+		if ( catalog->entryCount == catalog->entryCapacity ) {
+			size_t capacity = ( catalog->entryCapacity == 0 ? 1024 : catalog->entryCapacity * 2 );
+			SPIngestEntry *entries = ( capacity > INT32_MAX ? NULL : realloc(catalog->entries, capacity * sizeof(SPIngestEntry)) );
+			if ( entries == NULL ) goto bail;
+			catalog->entries = entries;
+			catalog->entryCapacity = capacity;
+		}
+
+		value = (int32_t)catalog->entryCount;
+		if ( !SPStringTableSetValue(catalog->paths, path, length, value, NULL) ) goto bail;
+
+		catalog->entryCount++;
+		catalog->count++;
+	}
+
+	catalog->entries[value] = *entry;
+	success = true;
+
+bail:
+	pthread_mutex_unlock(&catalog->lock);
+	return success;
+}
+
+bool SPIngestCatalogRemovePath(SPIngestCatalog *catalog, const char *path) {
+
+	bool removed;
+
+	pthread_mutex_lock(&catalog->lock);
+	removed = SPStringTableRemoveValue(catalog->paths, path, strlen(path));
+	if ( removed ) catalog->count--;
+	pthread_mutex_unlock(&catalog->lock);
+
+	return removed;
+}
+
+size_t SPIngestCatalogGetCount(SPIngestCatalog *catalog) {
+
+	size_t count;
+
+	pthread_mutex_lock(&catalog->lock);
+	count = catalog->count;
+	pthread_mutex_unlock(&catalog->lock);
+
+	return count;
+}
+
+#pragma mark -
+#pragma mark Bounded Queue
+
+// A fixed ring of pointers. Push blocks while the ring is full and pop while it is empty,
+// which is what carries backpressure from one stage to the one before it. A closed queue
+// drains and then pops NULL; a cancelled queue pops NULL and refuses pushes at once.
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+	void **items;
+	size_t capacity;
+	size_t head;
+	size_t count;
+	bool closed;
+	bool cancelled;
+} SPIngestQueue;
+
+static bool SPIngestQueueInit(SPIngestQueue *queue, size_t capacity) {
+
+	memset(queue, 0, sizeof(SPIngestQueue));
+
+	queue->items = malloc(capacity * sizeof(void*));
+	if ( queue->items == NULL ) return false;
+
+	queue->capacity = capacity;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->notEmpty, NULL);
+	pthread_cond_init(&queue->notFull, NULL);
+	return true;
+}
+
+static void SPIngestQueueDestroy(SPIngestQueue *queue) {
+	pthread_cond_destroy(&queue->notFull);
+	pthread_cond_destroy(&queue->notEmpty);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->items);
+}
+
+static bool SPIngestQueuePush(SPIngestQueue *queue, void *item) {
+
+	bool pushed = false;
+
+	pthread_mutex_lock(&queue->lock);
+
+	while ( queue->count == queue->capacity && !queue->cancelled )
+		pthread_cond_wait(&queue->notFull, &queue->lock);
+
+	if ( !queue->cancelled && !queue->closed ) {
+		queue->items[( queue->head + queue->count ) % queue->capacity] = item;
+		queue->count++;
+		pushed = true;
+		pthread_cond_signal(&queue->notEmpty);
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+	return pushed;
+}
+
+static void * SPIngestQueuePop(SPIngestQueue *queue) {
+
+	void *item = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+
+	while ( queue->count == 0 && !queue->closed && !queue->cancelled )
+		pthread_cond_wait(&queue->notEmpty, &queue->lock);
+
+	if ( queue->count > 0 && !queue->cancelled ) {
+		item = queue->items[queue->head];
+		queue->head = ( queue->head + 1 ) % queue->capacity;
+		queue->count--;
+		pthread_cond_signal(&queue->notFull);
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+	return item;
+}
+
+static void SPIngestQueueClose(SPIngestQueue *queue, bool cancel) {
+	pthread_mutex_lock(&queue->lock);
+	queue->closed = true;
+	if ( cancel ) queue->cancelled = true;
+	pthread_cond_broadcast(&queue->notEmpty);
+	pthread_cond_broadcast(&queue->notFull);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+static void * SPIngestQueueTake(SPIngestQueue *queue) {
+
+	// Removes whatever a cancelled queue was left holding, once its threads have finished
+
+	void *item = NULL;
+
+	if ( queue->count > 0 ) {
+		item = queue->items[queue->head];
+		queue->head = ( queue->head + 1 ) % queue->capacity;
+		queue->count--;
+	}
+
+	return item;
+}
+
+#pragma mark -
+#pragma mark Pipeline
+
+typedef struct {
+	char *path;
+	size_t pathLength;
+	SPIngestEntry entry;
+	const SPTextExtractor *extractor;
+	char *text;
+	size_t length;
+} SPIngestFile;
+
+typedef struct {
+	SPIngestCatalog *catalog;
+	const SPTextExtractor *extractors;
+	size_t extractorCount;
+	const char *root;
+	bool rootIsDirectory;
+
+	SPIngestQueue files;				// walker -> readers
+	SPIngestQueue documents;			// readers -> indexer
+	volatile int32_t readerCount;
+	volatile int32_t stopped;
+
+	volatile uint64_t fileCount;
+	volatile uint64_t unchangedCount;
+	volatile uint64_t failedCount;
+	volatile uint64_t byteCount;
+	volatile int32_t walkFailed;
+} SPIngestPipeline;
+
+static void SPIngestFileRelease(SPIngestFile *file) {
+	if ( file == NULL ) return;
+	free(file->path);
+	free(file->text);
+	free(file);
+}
+
+static uint64_t SPIngestHash(const unsigned char *bytes, size_t length) {
+
+	// 64 bit FNV-1a. Together with the size it is plenty to tell a changed file from an
+	// unchanged one.
+
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	for ( i = 0; i < length; i++ ) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static void SPIngestVisitFile(SPIngestPipeline *pipeline, const char *path, size_t length, const struct stat *status) {
+
+	const SPTextExtractor *extractor = SPTextExtractorForPath(pipeline->extractors, pipeline->extractorCount, path);
+	SPIngestEntry known;
+	SPIngestFile *file;
+
+	if ( extractor == NULL )
+		return;
+
+	__sync_fetch_and_add(&pipeline->fileCount, 1);
+
+	if ( pipeline->catalog != NULL && SPIngestCatalogGetEntry(pipeline->catalog, path, length, &known)
+			&& known.modified == (int64_t)status->st_mtime && known.size == (uint64_t)status->st_size ) {
+		__sync_fetch_and_add(&pipeline->unchangedCount, 1);
+		return;
+	}
+
+	file = calloc(1, sizeof(SPIngestFile));
+	if ( file == NULL || (file->path = malloc(length + 1)) == NULL ) {
+		__sync_fetch_and_add(&pipeline->failedCount, 1);
+		free(file);
+		return;
+	}
+
+	memcpy(file->path, path, length + 1);
+	file->pathLength = length;
+	file->entry.modified = (int64_t)status->st_mtime;
+	file->entry.size = (uint64_t)status->st_size;
+	file->extractor = extractor;
+
+	if ( !SPIngestQueuePush(&pipeline->files, file) )
+		SPIngestFileRelease(file);
+}
+
+static void * SPIngestWalker(void *argument) {
+
+	// Walks the tree depth first with a stack of directory paths rather than recursion, so
+	// deep trees cost heap rather than stack
+
+	SPIngestPipeline *pipeline = argument;
+	char **directories = NULL;
+	size_t directoryCount = 0, directoryCapacity = 0;
+	struct stat status;
+	bool isRoot = true;
+
+	if ( !pipeline->rootIsDirectory ) {
+		if ( lstat(pipeline->root, &status) == 0 )
+			SPIngestVisitFile(pipeline, pipeline->root, strlen(pipeline->root), &status);
+		goto bail;
+	}
+
+	directoryCapacity = 64;
+	directories = malloc(directoryCapacity * sizeof(char*));
+	if ( directories == NULL || (directories[0] = strdup(pipeline->root)) == NULL ) {
+		pipeline->walkFailed = 1;
+		goto bail;
+	}
+	directoryCount = 1;
+
+	while ( directoryCount > 0 ) {
+
+		char *directory = directories[--directoryCount];
+		size_t directoryLength = strlen(directory);
+		DIR *stream = opendir(directory);
+		struct dirent *entry;
+
+		if ( stream == NULL ) {
+			if ( isRoot ) pipeline->walkFailed = 1;
+			free(directory);
+			continue;
+		}
+
+		isRoot = false;
+
+		while ( (entry = readdir(stream)) != NULL ) {
+
+			size_t nameLength = strlen(entry->d_name);
+			size_t length = directoryLength + 1 + nameLength;
+			char *path;
+
+			if ( entry->d_name[0] == '.' )
+				continue;
+
+			if ( (path = malloc(length + 1)) == NULL )
+				continue;
+
+			memcpy(path, directory, directoryLength);
+			path[directoryLength] = '/';
+			memcpy(path + directoryLength + 1, entry->d_name, nameLength + 1);
+
+			if ( directoryLength > 0 && directory[directoryLength-1] == '/' ) {
+				memmove(path + directoryLength, path + directoryLength + 1, nameLength + 1);
+				length--;
+			}
+
+			if ( lstat(path, &status) != 0 ) {
+				free(path);
+			}
+			else if ( S_ISDIR(status.st_mode) ) {
+				if ( directoryCount == directoryCapacity ) {
+					char **grown = realloc(directories, directoryCapacity * 2 * sizeof(char*));
+					if ( grown == NULL ) {
+						free(path);
+						continue;
+					}
+					directories = grown;
+					directoryCapacity *= 2;
+				}
+				directories[directoryCount++] = path;
+			}
+			else {
+				if ( S_ISREG(status.st_mode) )
+					SPIngestVisitFile(pipeline, path, length, &status);
+				free(path);
+			}
+
+			if ( __sync_fetch_and_add(&pipeline->stopped, 0) ) break;
+		}
+
+		closedir(stream);
+		free(directory);
+
+		if ( __sync_fetch_and_add(&pipeline->stopped, 0) ) break;
+	}
+
+bail:
+	while ( directoryCount > 0 ) free(directories[--directoryCount]);
+	free(directories);
+
+	SPIngestQueueClose(&pipeline->files, false);
+	return NULL;
+}
+
+static bool SPIngestReadFile(SPIngestPipeline *pipeline, SPIngestFile *file, bool *outUnchanged) {
+
+	// Maps the file, hashes it and extracts its text. A file whose contents the catalog
+	// already has is only brought up to date with its new modification time.
+
+	struct stat status;
+	const char *bytes = "";
+	void *mapping = NULL;
+	size_t length = 0;
+	SPIngestEntry known;
+	int descriptor = open(file->path, O_RDONLY);
+
+	*outUnchanged = false;
+
+	if ( descriptor == -1 )
+		return false;
+
+	if ( fstat(descriptor, &status) != 0 ) {
+		close(descriptor);
+		return false;
+	}
+
+	file->entry.size = (uint64_t)status.st_size;
+	file->entry.modified = (int64_t)status.st_mtime;
+
+	if ( status.st_size > 0 ) {
+		length = (size_t)status.st_size;
+		mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if ( mapping == MAP_FAILED ) {
+			close(descriptor);
+			return false;
+		}
+		madvise(mapping, length, MADV_SEQUENTIAL);
+		bytes = mapping;
+	}
+
+	close(descriptor);
+
+	file->entry.hash = SPIngestHash((const unsigned char*)bytes, length);
+	__sync_fetch_and_add(&pipeline->byteCount, length);
+
+	if ( pipeline->catalog != NULL && SPIngestCatalogGetEntry(pipeline->catalog, file->path, file->pathLength, &known)
+			&& known.size == file->entry.size && known.hash == file->entry.hash ) {
+		SPIngestCatalogSetEntry(pipeline->catalog, file->path, file->pathLength, &file->entry);
+		*outUnchanged = true;
+	}
+	else {
+		file->text = file->extractor->extract(bytes, length, &file->length);
+	}
+
+	if ( mapping != NULL ) munmap(mapping, length);
+	return ( *outUnchanged || file->text != NULL );
+}
+
+static void * SPIngestReader(void *argument) {
+
+	SPIngestPipeline *pipeline = argument;
+	SPIngestFile *file;
+
+	while ( (file = SPIngestQueuePop(&pipeline->files)) != NULL ) {
+
+		bool unchanged;
+
+		if ( !SPIngestReadFile(pipeline, file, &unchanged) ) {
+			__sync_fetch_and_add(&pipeline->failedCount, 1);
+			SPIngestFileRelease(file);
+		}
+		else if ( unchanged ) {
+			__sync_fetch_and_add(&pipeline->unchangedCount, 1);
+			SPIngestFileRelease(file);
+		}
+		else if ( !SPIngestQueuePush(&pipeline->documents, file) ) {
+			SPIngestFileRelease(file);
+		}
+	}
+
+	// The last reader out tells the indexer that no more documents are coming
+
+	if ( __sync_sub_and_fetch(&pipeline->readerCount, 1) == 0 )
+		SPIngestQueueClose(&pipeline->documents, false);
+
+	return NULL;
+}
+
+static bool SPIngestIndexBatch(SPIngestPipeline *pipeline, SPIngestFile **batch, SPIngestDocument *documents, size_t count,
+		SPIngestIndexFunction index, void *context, SPIngestResult *result) {
+
+	size_t i;
+	bool proceed;
+
+	for ( i = 0; i < count; i++ ) {
+		documents[i].path = batch[i]->path;
+		documents[i].text = batch[i]->text;
+		documents[i].length = batch[i]->length;
+		documents[i].fileSize = batch[i]->entry.size;
+	}
+
+	proceed = index(documents, count, context);
+
+	for ( i = 0; i < count; i++ ) {
+		if ( proceed ) {
+			if ( pipeline->catalog != NULL )
+				SPIngestCatalogSetEntry(pipeline->catalog, batch[i]->path, batch[i]->pathLength, &batch[i]->entry);
+			result->documentCount++;
+			result->textByteCount += batch[i]->length;
+		}
+		SPIngestFileRelease(batch[i]);
+	}
+
+	return proceed;
+}
+
+bool SPIngestPath(const char *path, SPIngestCatalog *catalog, const SPIngestOptions *options,
+		SPIngestIndexFunction index, void *context, SPIngestResult *outResult) {
+
+	SPIngestPipeline pipeline;
+	SPIngestResult result;
+	SPIngestFile **batch = NULL;
+	SPIngestDocument *documents = NULL;
+	SPIngestFile *file;
+	pthread_t walker, readers[kSPIngestMaximumReaders];
+	size_t i, readerCount, queueCapacity, batchSize, batchCount = 0, started = 0;
+	bool hasWalker = false, filesReady = false, documentsReady = false, success = false, proceed = true;
+	struct stat status;
+
+	memset(&pipeline, 0, sizeof(SPIngestPipeline));
+	memset(&result, 0, sizeof(SPIngestResult));
+
+	readerCount = ( options == NULL ? 0 : options->readerCount );
+	queueCapacity = ( options == NULL || options->queueCapacity == 0 ? kSPIngestDefaultQueueCapacity : options->queueCapacity );
+	batchSize = ( options == NULL || options->batchSize == 0 ? kSPIngestDefaultBatchSize : options->batchSize );
+
+	if ( readerCount == 0 ) {
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		readerCount = ( processors < 1 ? 1 : (size_t)processors );
+	}
+	if ( readerCount > kSPIngestMaximumReaders ) readerCount = kSPIngestMaximumReaders;
+
+	if ( options != NULL && options->extractors != NULL ) {
+		pipeline.extractors = options->extractors;
+		pipeline.extractorCount = options->extractorCount;
+	}
+	else {
+		pipeline.extractors = SPTextExtractorGetDefaults(&pipeline.extractorCount);
+	}
+
+	if ( lstat(path, &status) != 0 || !( S_ISDIR(status.st_mode) || S_ISREG(status.st_mode) ) )
+		goto bail;
+
+	pipeline.catalog = catalog;
+	pipeline.root = path;
+	pipeline.rootIsDirectory = S_ISDIR(status.st_mode);
+
+	batch = malloc(batchSize * sizeof(SPIngestFile*));
+	documents = malloc(batchSize * sizeof(SPIngestDocument));
+	if ( batch == NULL || documents == NULL ) goto bail;
+
+	if ( !(filesReady = SPIngestQueueInit(&pipeline.files, queueCapacity)) ) goto bail;
+	if ( !(documentsReady = SPIngestQueueInit(&pipeline.documents, queueCapacity)) ) goto bail;
+
+	// The readers count themselves down as they finish, so they are all counted up front
+
+	pipeline.readerCount = (int32_t)readerCount;
+
+	for ( i = 0; i < readerCount; i++ ) {
+		if ( pthread_create(&readers[started], NULL, SPIngestReader, &pipeline) == 0 ) started++;
+	}
+
+	if ( started < readerCount && __sync_sub_and_fetch(&pipeline.readerCount, (int32_t)( readerCount - started )) == 0 )
+		SPIngestQueueClose(&pipeline.documents, false);
+
+	if ( started == 0 ) {
+		SPIngestQueueClose(&pipeline.files, true);
+		goto bail;
+	}
+
+	hasWalker = ( pthread_create(&walker, NULL, SPIngestWalker, &pipeline) == 0 );
+	if ( !hasWalker ) SPIngestQueueClose(&pipeline.files, false);
+
+	// The calling thread is the indexer
+
+	while ( (file = SPIngestQueuePop(&pipeline.documents)) != NULL ) {
+
+		batch[batchCount++] = file;
+
+		if ( batchCount == batchSize ) {
+			proceed = SPIngestIndexBatch(&pipeline, batch, documents, batchCount, index, context, &result);
+			batchCount = 0;
+			if ( !proceed ) break;
+		}
+	}
+
+	if ( proceed && batchCount > 0 )
+		proceed = SPIngestIndexBatch(&pipeline, batch, documents, batchCount, index, context, &result);
+
+	if ( !proceed ) {
+		__sync_lock_test_and_set(&pipeline.stopped, 1);
+		SPIngestQueueClose(&pipeline.files, true);
+		SPIngestQueueClose(&pipeline.documents, true);
+	}
+
+	success = ( proceed && hasWalker && !pipeline.walkFailed );
+
+bail:
+	if ( hasWalker ) pthread_join(walker, NULL);
+	for ( i = 0; i < started; i++ ) pthread_join(readers[i], NULL);
+
+	if ( filesReady ) {
+		while ( (file = SPIngestQueueTake(&pipeline.files)) != NULL ) SPIngestFileRelease(file);
+		SPIngestQueueDestroy(&pipeline.files);
+	}
+	if ( documentsReady ) {
+		while ( (file = SPIngestQueueTake(&pipeline.documents)) != NULL ) SPIngestFileRelease(file);
+		SPIngestQueueDestroy(&pipeline.documents);
+	}
+
+	free(batch);
+	free(documents);
+
+	result.fileCount = pipeline.fileCount;
+	result.unchangedCount = pipeline.unchangedCount;
+	result.failedCount = pipeline.failedCount;
+	result.byteCount = pipeline.byteCount;
+
+	if ( outResult != NULL ) *outResult = result;
+	return success;
+}
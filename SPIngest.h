@@ -0,0 +1,113 @@
+//
+//  SPIngest.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPINGEST_H
+#define SPINGEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SPTextExtractor.h"
+
+// SPIngest indexes a tree of files as a pipeline of stages. A walker finds the files, a
+// pool of readers maps each file and extracts its text, and the calling thread hands the
+// documents to an index function in batches. The stages are joined by bounded queues:
+// when the indexer falls behind the readers block, and when the readers fall behind the
+// walker blocks, so memory use stays flat however large the tree while the disk and
+// every processor are kept busy.
+
+// A catalog remembers the modification time, size and content hash of every file that
+// has been indexed. Files whose time and size have not changed are skipped without being
+// read, and files whose contents hash the same are skipped without being extracted, so
+// crawling the same tree again only indexes what changed.
+
+typedef struct SPIngestCatalog SPIngestCatalog;
+
+SPIngestCatalog * SPIngestCatalogCreate(void);
+void SPIngestCatalogRelease(SPIngestCatalog *catalog);
+
+bool SPIngestCatalogRemovePath(SPIngestCatalog *catalog, const char *path);
+
+	// Forgets the file at path so the next crawl indexes it again. Call it when a document
+	// is removed from the index. Returns false if the path was not in the catalog.
+
+size_t SPIngestCatalogGetCount(SPIngestCatalog *catalog);
+
+	// The catalog guards itself with a lock and may be used from any thread.
+
+typedef struct {
+	const char *path;					// NUL terminated
+	const char *text;					// UTF-8, NUL terminated
+	size_t length;						// of text
+	uint64_t fileSize;
+} SPIngestDocument;
+
+typedef bool (*SPIngestIndexFunction)(const SPIngestDocument *documents, size_t count, void *context);
+
+	// Indexes a batch of documents. Return false to stop the crawl; documents in a batch that
+	// returns false are not recorded in the catalog.
+
+typedef struct {
+	size_t readerCount;					// 0 for one per processor
+	size_t queueCapacity;				// files waiting between stages, 0 for the default
+	size_t batchSize;					// documents per call to the index function, 0 for the default
+	const SPTextExtractor *extractors;	// NULL for SPTextExtractorGetDefaults
+	size_t extractorCount;
+} SPIngestOptions;
+
+typedef struct {
+	uint64_t fileCount;					// files found with an extractor
+	uint64_t unchangedCount;			// skipped because the catalog has them
+	uint64_t documentCount;				// indexed
+	uint64_t failedCount;				// could not be read or extracted
+	uint64_t byteCount;					// of files read
+	uint64_t textByteCount;				// of text indexed
+} SPIngestResult;
+
+bool SPIngestPath(const char *path, SPIngestCatalog *catalog, const SPIngestOptions *options,
+		SPIngestIndexFunction index, void *context, SPIngestResult *outResult);
+
+	// Indexes the file at path or every file beneath it with an extractor for its extension.
+	// Hidden files and directories are skipped and symbolic links are not followed. catalog
+	// and options may be NULL; without a catalog every file is indexed. Returns false if path
+	// could not be read, memory ran out or the index function stopped the crawl. outResult,
+	// which may be NULL, receives the counts either way.
+
+#endif
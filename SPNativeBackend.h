@@ -0,0 +1,135 @@
+//
+//  SPNativeBackend.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPSearchBackend.h"
+#import "SPIndex.h"
+
+// The native backend stores documents in an SPIndex, a portable inverted index with
+// compressed posting lists and per document term frequencies. Added documents become
+// searchable when the index next refreshes, every kSPNativeBackendRefreshInterval
+// seconds or sooner once kSPNativeBackendMaximumBufferedDocuments are waiting, or when
+// the backend is flushed. Searches never wait on a refresh. Text is folded for case and
+// diacritics before it is indexed, and queries and terms are folded the same way. Stop
+// words, numbers and stemming set with kSPStopWordLanguages, kSPExcludesNumericTerms and
+// kSPStemsTerms are applied by the index itself, to queries and term lookups as well.
+// With kSKProximityIndexing the index keeps term positions, so that quoted phrases match
+// only words in sequence and queries may use NEAR/n, see SPIndex.h.
+
+#define kSPNativeBackendRefreshInterval				0.25
+#define kSPNativeBackendMaximumBufferedDocuments	10000
+
+// Wildcard terms such as *tune* are answered from a trigram index over the dictionary
+// rather than by matching every term. Set to 0 to trade the speed for memory.
+
+#define kSPNativeBackendIndexesTrigrams				1
+
+// Near duplicates are found from MinHash signatures kept for every document, which cost
+// a few hundred bytes each. Set to 0 to go without near duplicate detection.
+
+#define kSPNativeBackendIndexesSignatures			1
+
+// Compaction rewrites one segment at a time while searches and writes continue, and
+// rests between segments so that it is busy at most this share of the time.
+
+#define kSPNativeBackendCompactionDutyCycle			0.5
+
+// File based documents are mapped and read by the text extractor for their extension,
+// see SPTextExtractor.h, or as plain text. Document names and properties are kept in
+// the index as document data, encoded as binary property lists, and are saved with it.
+
+// A native index saved with writeToURL: is opened by mapping the file, and only the parts
+// of it that searches touch are ever read from disk. Trigrams and signatures are rebuilt
+// when the index is opened, which reads every term and document vector; turn them off
+// above when opening a large store has to be instant.
+
+// A backend opened with a URL keeps a write-ahead log beside its file, at the same path
+// with -log appended. Every change is appended to the log, and commit makes the changes
+// durable with a single fsync shared by every thread that commits at the same time, so a
+// save costs as much as the changes since the last one rather than the whole index. The
+// log is replayed when the store is opened again. Once it grows past
+// kSPNativeBackendCheckpointLength bytes, commit writes the index back to its file and
+// truncates the log.
+
+#define kSPNativeBackendCheckpointLength			(32*1024*1024)
+
+// Set to 1 to commit after every change rather than waiting for commit, which makes each
+// change durable before it returns at the cost of an fsync apiece.
+
+#define kSPNativeBackendCommitsEveryChange			0
+
+@interface SPNativeBackend : NSObject <SPSearchBackend> {
+	
+	SPIndexRef index;
+	SKIndexType indexType;
+	NSURL *fileURL;
+	
+	SPRankingOptions rankingOptions;
+	BOOL didCreateStore;
+}
+
+@property (readonly) SPIndexRef index;
+
+	// The underlying index, for profiling. It is safe to use from any thread.
+
+@property (readwrite) SPRankingOptions rankingOptions;
+
+	// The model topResultsForQuery:options:limit:ranks: scores documents with, BM25 with
+	// k1 = 1.2 and b = 0.75 by default. Searches are always ranked with tf-idf.
+
+@property (readonly) BOOL didCreateStore;
+
+- (id) initWithType:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions;
+- (id) initWithURL:(NSURL*)inFileURL type:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions;
+
+	// kSKMinTermLength and kSKMaximumTerms are honored. Stop words are filtered by the
+	// store as they are for SearchKit. initWithURL:type:analysisOptions: opens the index
+	// saved at inFileURL, keeping the analysis options it was created with, or creates a
+	// new index if there is no file there yet. It returns nil if the file is not a native
+	// index. The write-ahead log beside the file is opened or created and any changes it
+	// holds are replayed. Returns nil if the log cannot be opened or belongs to an older
+	// copy of the index. The file itself is not written until the first checkpoint or
+	// writeToURL:.
+
+- (BOOL) commit;
+
+	// Makes every change made so far durable in the write-ahead log, checkpointing the
+	// index to its file when the log has grown large. Returns NO for a backend without a
+	// file or when neither the log nor the file could be written.
+
+@end
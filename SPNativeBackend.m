@@ -0,0 +1,948 @@
+//
+//  SPNativeBackend.m
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPNativeBackend.h"
+#import "SPSimilarity.h"
+#import "SPStopWords.h"
+#import "SPTextExtractor.h"
+
+static NSString * SPNativeBackendFoldedString(NSString *inString) {
+	return [inString stringByFoldingWithOptions:(NSCaseInsensitiveSearch|NSDiacriticInsensitiveSearch) locale:nil];
+}
+
+static NSString * SPNativeBackendFoldedQuery(NSString *inQuery) {
+
+	// Queries are folded like document text, except for the upper case operators, AND, OR,
+	// NOT and NEAR/n, which must survive for the query parser to recognize them.
+
+	static NSCharacterSet *separators = nil;
+	if ( separators == nil )
+		separators = [[NSCharacterSet characterSetWithCharactersInString:@" \t\r\n()\"&|!"] retain];
+
+	NSMutableString *folded = [NSMutableString stringWithCapacity:[inQuery length]];
+	NSUInteger length = [inQuery length];
+	NSUInteger location = 0;
+
+	while ( location < length ) {
+
+		NSRange separator = [inQuery rangeOfCharacterFromSet:separators options:0
+				range:NSMakeRange(location, length - location)];
+		NSUInteger end = ( separator.location == NSNotFound ? length : separator.location );
+
+		if ( end > location ) {
+			NSString *word = [inQuery substringWithRange:NSMakeRange(location, end - location)];
+			const char *bytes = [word UTF8String];
+			if ( SPSearchIsOperatorWord(bytes, strlen(bytes)) )
+				[folded appendString:word];
+			else
+				[folded appendString:SPNativeBackendFoldedString(word)];
+		}
+
+		if ( separator.location == NSNotFound )
+			break;
+
+		[folded appendString:[inQuery substringWithRange:separator]];
+		location = NSMaxRange(separator);
+	}
+
+	return folded;
+}
+
+static NSString * SPNativeBackendFileContents(NSURL *inFileURL) {
+
+	// Without Spotlight importers files are mapped and passed through the text extractor
+	// for their extension, so HTML and Markdown are indexed without their markup. Files
+	// with any other extension are read as plain text.
+
+	NSData *data = [NSData dataWithContentsOfURL:inFileURL options:NSDataReadingMapped error:NULL];
+	const char *path = [[inFileURL path] fileSystemRepresentation];
+	const SPTextExtractor *extractors, *extractor;
+	size_t count, length = 0;
+	char *text;
+
+	if ( data == nil || path == NULL )
+		return nil;
+
+	extractors = SPTextExtractorGetDefaults(&count);
+	extractor = SPTextExtractorForPath(extractors, count, path);
+
+	text = ( extractor != NULL ? extractor->extract : SPTextExtractPlainText )([data bytes], [data length], &length);
+	if ( text == NULL )
+		return nil;
+
+	return [[[NSString alloc] initWithBytesNoCopy:text length:length encoding:NSUTF8StringEncoding freeWhenDone:YES] autorelease];
+}
+
+#define kSPNativeBackendURIBufferSize 1024
+
+static NSURL * SPNativeBackendCopyURL(SPIndexRef index, SPDocumentID document) {
+
+	// URIs are copied out of the index onto the stack, so that turning search results into
+	// URLs only allocates the URLs themselves. Longer URIs take the slow path.
+
+	NSURL *url = nil;
+	NSString *uriString = nil;
+	char buffer[kSPNativeBackendURIBufferSize];
+	size_t length = SPIndexGetDocumentURI(index, document, buffer, kSPNativeBackendURIBufferSize);
+
+	if ( length > 0 && length <= kSPNativeBackendURIBufferSize ) {
+		uriString = [[NSString alloc] initWithBytes:buffer length:length encoding:NSUTF8StringEncoding];
+	}
+	else if ( length > 0 ) {
+		char *uri = NULL;
+		if ( SPIndexCopyDocumentURI(index, document, &uri) > 0 ) uriString = [[NSString alloc] initWithUTF8String:uri];
+		free(uri);
+	}
+
+	if ( uriString != nil ) url = [[NSURL alloc] initWithString:uriString];
+	[uriString release];
+
+	return url;
+}
+
+// Names and properties are kept together as each document's data in the index, encoded
+// as a binary property list, so that they are logged and saved along with it
+
+static NSString * const SPNativeBackendNameKey = @"name";
+static NSString * const SPNativeBackendPropertiesKey = @"properties";
+
+static NSDictionary * SPNativeBackendCopyDocumentData(SPIndexRef index, const char *uri) {
+
+	NSDictionary *dictionary = nil;
+	NSData *data;
+	void *bytes = NULL;
+	size_t length = ( uri == NULL ? 0 : SPIndexCopyDocumentData(index, uri, &bytes) );
+
+	if ( length == 0 )
+		return nil;
+
+	data = [[NSData alloc] initWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+	dictionary = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:NULL];
+	[data release];
+
+	return ( [dictionary isKindOfClass:[NSDictionary class]] ? [dictionary retain] : nil );
+}
+
+static BOOL SPNativeBackendSetDocumentData(SPIndexRef index, const char *uri, NSDictionary *inDictionary) {
+
+	NSData *data = nil;
+
+	if ( uri == NULL )
+		return NO;
+
+	if ( [inDictionary count] > 0 ) {
+		data = [NSPropertyListSerialization dataWithPropertyList:inDictionary format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+		if ( data == nil )
+			return NO;
+	}
+
+	return SPIndexSetDocumentData(index, uri, [data bytes], [data length]);
+}
+
+static SPDocumentID SPNativeBackendDocumentID(NSInteger inDocumentID) {
+	return ( inDocumentID < 0 || inDocumentID > INT32_MAX ? kSPIndexNotFound : (SPDocumentID)inDocumentID );
+}
+
+#pragma mark -
+
+@interface SPNativeSearch : NSObject <SPSearchBackendSearch> {
+	SPNativeBackend *backend;
+	SPSearchRef search;
+}
+
+- (id) initWithBackend:(SPNativeBackend*)inBackend search:(SPSearchRef)inSearch;
+
+@end
+
+#pragma mark -
+
+@interface SPNativeBackend()
+
+- (SPTermID) _termIDForTerm:(NSString*)inTerm;
+- (NSUInteger) _addDocuments:(NSArray*)inDocumentURIs texts:(NSArray*)inContents byteCount:(unsigned long long*)outByteCount;
+- (BOOL) _setDocumentValue:(id)inValue forKey:(NSString*)inKey document:(NSURL*)inDocumentURI;
+- (id) _documentValueForKey:(NSString*)inKey document:(NSURL*)inDocumentURI;
+- (void) _didChange;
+
+@end
+
+#pragma mark -
+
+@implementation SPNativeBackend
+
+@synthesize index;
+@synthesize rankingOptions;
+@synthesize didCreateStore;
+
+- (id) initWithType:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions {
+	return [self initWithURL:nil type:inType analysisOptions:inOptions];
+}
+
+- (id) initWithURL:(NSURL*)inFileURL type:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions {
+
+	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
+	NSAssert( inFileURL==nil || [inFileURL isFileURL], @"inFileURL must be a file url");
+
+	if ( self = [super init] ) {
+
+		SPIndexOptions options;
+		const char *path = ( inFileURL == nil ? NULL : [[inFileURL path] fileSystemRepresentation] );
+
+		memset(&options, 0, sizeof(SPIndexOptions));
+		options.refreshInterval = kSPNativeBackendRefreshInterval;
+		options.maximumBufferedDocuments = kSPNativeBackendMaximumBufferedDocuments;
+		options.indexesTrigrams = kSPNativeBackendIndexesTrigrams;
+		options.indexesSignatures = kSPNativeBackendIndexesSignatures;
+		options.compactionDutyCycle = kSPNativeBackendCompactionDutyCycle;
+		options.minTermLength = [[inOptions objectForKey:(NSString*)kSKMinTermLength] unsignedIntValue];
+		options.maximumTerms = [[inOptions objectForKey:(NSString*)kSKMaximumTerms] unsignedIntValue];
+		if ( options.minTermLength == 0 ) options.minTermLength = 1;
+
+		for ( NSString *language in [inOptions objectForKey:kSPStopWordLanguages] )
+			options.stopWordLanguages |= SPStopWordsGetLanguage([language UTF8String]);
+		if ( [[inOptions objectForKey:kSPExcludesNumericTerms] boolValue] )
+			options.analysisFlags |= kSPAnalysisExcludesNumbers;
+		if ( [[inOptions objectForKey:kSPStemsTerms] boolValue] )
+			options.analysisFlags |= kSPAnalysisStemsTerms;
+		options.indexesPositions = [[inOptions objectForKey:(NSString*)kSKProximityIndexing] boolValue];
+
+		NSString *logPath = ( inFileURL == nil ? nil : [[inFileURL path] stringByAppendingString:@"-log"] );
+
+		if ( path != NULL && [[NSFileManager defaultManager] fileExistsAtPath:[inFileURL path]] ) {
+			index = SPIndexCreateWithFile(path, &options);
+			didCreateStore = NO;
+		}
+		else {
+			// a store that crashed before its first checkpoint only has its log
+			index = SPIndexCreate(&options);
+			didCreateStore = ( logPath == nil || ![[NSFileManager defaultManager] fileExistsAtPath:logPath] );
+		}
+		
+		rankingOptions.model = kSPRankingModelBM25;
+		rankingOptions.k1 = 1.2f;
+		rankingOptions.b = 0.75f;
+
+		if ( index == NULL || ( logPath != nil && !SPIndexOpenLog(index, [logPath fileSystemRepresentation]) ) ) {
+			[self release];
+			return nil;
+		}
+
+		fileURL = [inFileURL copy];
+		indexType = inType;
+	}
+	return self;
+}
+
+- (void) dealloc {
+
+	SPIndexRelease(index);
+	index = NULL;
+
+	[fileURL release], fileURL = nil;
+
+	[super dealloc];
+}
+
+- (SKIndexType) indexType {
+	return indexType;
+}
+
+#pragma mark -
+#pragma mark Document / Store Management
+
+- (BOOL) addDocument:(NSURL*)inFileURL typeHint:(NSString*)inMimeHint {
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+	NSString *contents = SPNativeBackendFileContents(inFileURL);
+	BOOL success = ( contents != nil && [self addDocument:inFileURL withText:contents] );
+
+	[pool release];
+	return success;
+}
+
+- (BOOL) addDocument:(NSURL*)inDocumentURI withText:(NSString*)inContents {
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+	const char *text = [SPNativeBackendFoldedString(inContents) UTF8String];
+	const char *uri = [[inDocumentURI absoluteString] UTF8String];
+
+	BOOL success = ( text != NULL && uri != NULL
+			&& SPIndexAddDocument(index, uri, text, strlen(text)) != kSPIndexNotFound );
+
+	[pool release];
+	if ( success ) [self _didChange];
+	return success;
+}
+
+- (NSUInteger) addDocuments:(NSArray*)inFileURLs typeHint:(NSString*)inMimeHint byteCount:(unsigned long long*)outByteCount {
+	return [self _addDocuments:inFileURLs texts:nil byteCount:outByteCount];
+}
+
+- (NSUInteger) addDocuments:(NSArray*)inDocumentURIs withTexts:(NSArray*)inContents byteCount:(unsigned long long*)outByteCount {
+	return [self _addDocuments:inDocumentURIs texts:inContents byteCount:outByteCount];
+}
+
+- (NSUInteger) _addDocuments:(NSArray*)inDocumentURIs texts:(NSArray*)inContents byteCount:(unsigned long long*)outByteCount {
+
+	// The documents are divided into one contiguous range per processor. Each operation reads,
+	// folds and tokenizes its documents into their own slots of the batch, so the workers share
+	// nothing until the batch is merged into the index under a single write lock.
+
+	NSUInteger count = ( inContents == nil ? [inDocumentURIs count] : MIN([inDocumentURIs count], [inContents count]) );
+	NSUInteger workerCount = MAX([[NSProcessInfo processInfo] activeProcessorCount], (NSUInteger)1);
+	NSUInteger chunkSize = ( count + workerCount - 1 ) / workerCount;
+	NSUInteger start, added = 0;
+
+	SPDocumentBatchRef batch = ( count == 0 ? NULL : SPDocumentBatchCreate(index, count) );
+
+	if ( batch != NULL ) {
+
+		NSOperationQueue *workers = [[NSOperationQueue alloc] init];
+
+		for ( start = 0; start < count; start += chunkSize ) {
+
+			NSUInteger end = MIN(start + chunkSize, count);
+
+			[workers addOperationWithBlock:^(void) {
+				NSUInteger i;
+				for ( i = start; i < end; i++ ) {
+
+					NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+					NSURL *documentURI = [inDocumentURIs objectAtIndex:i];
+
+					NSString *contents = ( inContents != nil ? [inContents objectAtIndex:i] :
+							SPNativeBackendFileContents(documentURI) );
+
+					const char *text = ( contents == nil ? NULL : [SPNativeBackendFoldedString(contents) UTF8String] );
+					const char *uri = [[documentURI absoluteString] UTF8String];
+
+					if ( text != NULL && uri != NULL )
+						SPDocumentBatchSetDocument(batch, i, uri, text, strlen(text));
+
+					[pool release];
+				}
+			}];
+		}
+
+		[workers waitUntilAllOperationsAreFinished];
+		[workers release];
+
+		// Refreshing right away writes the batch out as one segment, like the SearchKit
+		// backend's single flush, rather than leaving it to the periodic refresh
+
+		added = SPIndexAddDocumentBatch(index, batch);
+		if ( added > 0 ) SPIndexRefresh(index);
+		if ( added > 0 ) [self _didChange];
+	}
+
+	if ( outByteCount != NULL ) *outByteCount = ( batch == NULL ? 0 : SPDocumentBatchGetByteCount(batch) );
+	SPDocumentBatchRelease(batch);
+
+	return added;
+}
+
+- (BOOL) removeDocument:(NSURL*)inDocumentURI {
+
+	// the index drops the document's name and properties along with it
+
+	BOOL success = SPIndexRemoveDocument(index, [[inDocumentURI absoluteString] UTF8String]);
+	if ( success ) [self _didChange];
+
+	return success;
+}
+
+#pragma mark -
+
+- (void) setProperties:(NSDictionary*)inProperties forDocument:(NSURL*)inDocumentURI {
+	[self _setDocumentValue:inProperties forKey:SPNativeBackendPropertiesKey document:inDocumentURI];
+}
+
+- (NSDictionary*) propertiesForDocument:(NSURL*)inDocumentURI {
+	return [self _documentValueForKey:SPNativeBackendPropertiesKey document:inDocumentURI];
+}
+
+- (BOOL) setName:(NSString*)inTitle forDocument:(NSURL*)inDocumentURI {
+	return [self _setDocumentValue:inTitle forKey:SPNativeBackendNameKey document:inDocumentURI];
+}
+
+- (NSString*) nameOfDocument:(NSURL*)inDocumentURI {
+
+	// SearchKit names a document after the last component of its URL unless told otherwise
+
+	NSString *name = [self _documentValueForKey:SPNativeBackendNameKey document:inDocumentURI];
+	return ( name != nil ? name : [[inDocumentURI path] lastPathComponent] );
+}
+
+- (BOOL) _setDocumentValue:(id)inValue forKey:(NSString*)inKey document:(NSURL*)inDocumentURI {
+
+	// The name and properties share the document's data, so changing one rewrites both.
+	// Properties must be property list objects to be encoded.
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+	const char *uri = [[inDocumentURI absoluteString] UTF8String];
+	BOOL success;
+
+	@synchronized(self) {
+		NSDictionary *data = SPNativeBackendCopyDocumentData(index, uri);
+		NSMutableDictionary *changed = ( data == nil ? [NSMutableDictionary dictionary] : [[data mutableCopy] autorelease] );
+		[data release];
+
+		if ( inValue == nil ) [changed removeObjectForKey:inKey];
+		else [changed setObject:inValue forKey:inKey];
+
+		success = SPNativeBackendSetDocumentData(index, uri, changed);
+	}
+
+	[pool release];
+	if ( success ) [self _didChange];
+
+	return success;
+}
+
+- (id) _documentValueForKey:(NSString*)inKey document:(NSURL*)inDocumentURI {
+
+	id value = nil;
+
+	@synchronized(self) {
+		NSDictionary *data = SPNativeBackendCopyDocumentData(index, [[inDocumentURI absoluteString] UTF8String]);
+		value = [[[data objectForKey:inKey] retain] autorelease];
+		[data release];
+	}
+
+	return value;
+}
+
+- (SKDocumentIndexState) stateOfDocument:(NSURL*)inDocumentURI {
+	// SPDocumentState matches SKDocumentIndexState
+	return (SKDocumentIndexState)SPIndexGetDocumentState(index, [[inDocumentURI absoluteString] UTF8String]);
+}
+
+#pragma mark -
+
+- (NSInteger) documentIDForDocument:(NSURL*)inDocumentURI {
+	SPDocumentID document = SPIndexGetDocumentID(index, [[inDocumentURI absoluteString] UTF8String]);
+	return ( document == kSPIndexNotFound ? NSNotFound : (NSInteger)document );
+}
+
+- (NSURL*) documentForDocumentID:(NSInteger)inDocumentID {
+	SPDocumentID document = SPNativeBackendDocumentID(inDocumentID);
+	return ( document == kSPIndexNotFound ? nil : [SPNativeBackendCopyURL(index, document) autorelease] );
+}
+
+- (void) setProperties:(NSDictionary*)inProperties forDocumentID:(NSInteger)inDocumentID {
+
+	// Properties are kept by URI so that they survive the document being replaced, which
+	// gives it a new ID
+
+	NSURL *url = [self documentForDocumentID:inDocumentID];
+	if ( url != nil ) [self setProperties:inProperties forDocument:url];
+}
+
+- (NSDictionary*) propertiesForDocumentID:(NSInteger)inDocumentID {
+	NSURL *url = [self documentForDocumentID:inDocumentID];
+	return ( url == nil ? nil : [self propertiesForDocument:url] );
+}
+
+typedef struct {
+	NSMutableArray *documents;
+	BOOL ignoresEmpty;
+} SPNativeBackendDocumentContext;
+
+static bool SPNativeBackendCollectDocument(SPDocumentID document, const char *uri, size_t length,
+		size_t termCount, void *context) {
+
+	NSMutableArray *documents = ((SPNativeBackendDocumentContext*)context)->documents;
+
+	if ( ((SPNativeBackendDocumentContext*)context)->ignoresEmpty && termCount == 0 )
+		return true;
+
+	NSString *uriString = [[NSString alloc] initWithBytes:uri length:length encoding:NSUTF8StringEncoding];
+	NSURL *url = ( uriString == nil ? nil : [[NSURL alloc] initWithString:uriString] );
+
+	if ( url != nil ) [documents addObject:url];
+
+	[url release];
+	[uriString release];
+	return true;
+}
+
+- (NSArray*) allDocuments:(BOOL)ignoreEmptyDocuments {
+
+	// Unlike SearchKit the native index never adds parent folders of file based documents,
+	// so the empty document check only filters documents which really have no terms.
+
+	NSMutableArray *allDocuments = [NSMutableArray array];
+	SPNativeBackendDocumentContext context = { allDocuments, ignoreEmptyDocuments };
+
+	SPIndexEnumerateDocuments(index, SPNativeBackendCollectDocument, &context);
+
+	return [[allDocuments copy] autorelease];
+}
+
+#pragma mark -
+
+- (NSInteger) documentCount {
+	return (NSInteger)SPIndexGetDocumentCount(index);
+}
+
+- (NSInteger) maximumDocumentID {
+	return (NSInteger)SPIndexGetMaximumDocumentID(index);
+}
+
+- (NSUInteger) generation {
+	return (NSUInteger)SPIndexGetGeneration(index);
+}
+
+- (BOOL) compact {
+	return SPIndexCompact(index);
+}
+
+- (BOOL) compactsOnline {
+	return YES;
+}
+
+- (BOOL) flush {
+	// makes buffered changes searchable now rather than at the next refresh
+	return SPIndexRefresh(index);
+}
+
+- (void) close {
+	// the index is released with the backend
+}
+
+- (BOOL) writeToURL:(NSURL*)inFileURL {
+
+	// Writing the index back to its own file is a checkpoint, after which its log is empty
+
+	NSAssert( inFileURL != nil && [inFileURL isFileURL], @"inFileURL must be a file url");
+	const char *path = [[inFileURL path] fileSystemRepresentation];
+
+	if ( fileURL != nil && [[inFileURL path] isEqualToString:[fileURL path]] )
+		return SPIndexCheckpoint(index, path);
+
+	return SPIndexWriteToFile(index, path);
+}
+
+- (BOOL) commit {
+
+	// Saving also makes the changes searchable, as writing the file always has. A log that
+	// cannot be written is replaced by a checkpoint, which writes out every change and
+	// starts the log over.
+
+	if ( fileURL == nil )
+		return NO;
+
+	BOOL success = ( SPIndexRefresh(index) && SPIndexCommit(index) );
+
+	if ( !success || SPIndexGetLogLength(index) > kSPNativeBackendCheckpointLength )
+		success = SPIndexCheckpoint(index, [[fileURL path] fileSystemRepresentation]);
+
+	return success;
+}
+
+- (void) _didChange {
+#if kSPNativeBackendCommitsEveryChange
+	if ( fileURL != nil ) SPIndexCommit(index);
+#endif
+}
+
+#pragma mark -
+#pragma mark Searching
+
+- (id<SPSearchBackendSearch>) searchWithQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions {
+
+	NSString *folded = ( searchOptions & kSKSearchOptionFindSimilar ?
+			SPNativeBackendFoldedString(searchQuery) : SPNativeBackendFoldedQuery(searchQuery) );
+	const char *query = [folded UTF8String];
+
+	SPSearchRef search = SPSearchCreate(index, query, strlen(query), (SPSearchOptions)searchOptions);
+	if ( search == NULL ) {
+		NSLog(@"there was a problem creating the search query");
+		return nil;
+	}
+
+	return [[[SPNativeSearch alloc] initWithBackend:self search:search] autorelease];
+}
+
+- (NSArray*) topResultsForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions 
+		limit:(NSUInteger)limit ranks:(float*)outRanks {
+
+	NSString *folded = ( searchOptions & kSKSearchOptionFindSimilar ?
+			SPNativeBackendFoldedString(searchQuery) : SPNativeBackendFoldedQuery(searchQuery) );
+	const char *query = [folded UTF8String];
+
+	SPDocumentID *documentIds = calloc(( limit == 0 ? 1 : limit ), sizeof(SPDocumentID));
+	float *documentScores = calloc(( limit == 0 ? 1 : limit ), sizeof(float));
+	NSMutableArray *documents = [NSMutableArray arrayWithCapacity:limit];
+	SPRankingOptions ranking = self.rankingOptions;
+	size_t i, documentCount;
+
+	documentCount = SPIndexCopyTopResults(index, query, strlen(query), (SPSearchOptions)searchOptions, 
+			&ranking, limit, documentIds, documentScores);
+
+	for ( i = 0; i < documentCount; i++ ) {
+		NSURL *url = SPNativeBackendCopyURL(index, documentIds[i]);
+		if ( url == nil ) continue;
+
+		if ( outRanks != NULL ) outRanks[[documents count]] = documentScores[i];
+		[documents addObject:url];
+		[url release];
+	}
+
+	free(documentIds);
+	free(documentScores);
+
+	return [[documents copy] autorelease];
+}
+
+#pragma mark -
+#pragma mark Document Terms
+
+typedef struct {
+	void (^block)(NSString *term, NSUInteger documentCount, BOOL *stop);
+	NSAutoreleasePool *pool;
+	NSUInteger count;
+} SPNativeBackendTermEnumeration;
+
+static bool SPNativeBackendEnumerateTerm(SPTermID term, const char *string, size_t length,
+		size_t documentCount, void *context) {
+
+	// Terms are created one at a time and released in batches, so enumerating a large
+	// dictionary never holds more than a few of them
+
+	SPNativeBackendTermEnumeration *enumeration = context;
+	NSString *aTerm = [[NSString alloc] initWithBytes:string length:length encoding:NSUTF8StringEncoding];
+	BOOL stop = NO;
+
+	if ( aTerm != nil ) enumeration->block(aTerm, documentCount, &stop);
+	[aTerm release];
+
+	if ( ++enumeration->count % 1024 == 0 ) {
+		[enumeration->pool drain];
+		enumeration->pool = [[NSAutoreleasePool alloc] init];
+	}
+
+	return !stop;
+}
+
+- (void) enumerateTermsWithPrefix:(NSString*)inPrefix 
+		usingBlock:(void (^)(NSString *term, NSUInteger documentCount, BOOL *stop))block {
+
+	const char *prefix = [SPNativeBackendFoldedString(( inPrefix == nil ? @"" : inPrefix )) UTF8String];
+	SPNativeBackendTermEnumeration enumeration = { block, [[NSAutoreleasePool alloc] init], 0 };
+
+	SPIndexEnumerateTermsWithPrefix(index, prefix, strlen(prefix), SPNativeBackendEnumerateTerm, &enumeration);
+
+	[enumeration.pool drain];
+}
+
+- (SPTermID) _termIDForTerm:(NSString*)inTerm {
+
+	// Terms listed by the index are already in indexed form, and stemming one again could
+	// change it, so look the term up as it is before analyzing it as the index would.
+
+	const char *folded = [SPNativeBackendFoldedString(inTerm) UTF8String];
+	SPTermID termID;
+	char *term;
+	size_t length;
+
+	if ( folded == NULL ) return kSPIndexNotFound;
+
+	termID = SPIndexGetTermID(index, folded, strlen(folded));
+	if ( termID != kSPIndexNotFound ) return termID;
+
+	term = strdup(folded);
+	if ( term == NULL ) return kSPIndexNotFound;
+
+	length = SPIndexAnalyzeTerm(index, term, strlen(term));
+	if ( length != 0 ) termID = SPIndexGetTermID(index, term, length);
+
+	free(term);
+	return termID;
+}
+
+- (NSUInteger) documentCountForTerm:(NSString*)inTerm {
+	SPTermID term = [self _termIDForTerm:inTerm];
+	return ( term == kSPIndexNotFound ? 0 : SPIndexGetTermDocumentCount(index, term) );
+}
+
+- (NSArray*) documentsForTerm:(NSString*)inTerm {
+
+	NSMutableArray *documents = [NSMutableArray array];
+	SPDocumentID *documentIds = NULL;
+	size_t i, count = 0;
+
+	SPTermID term = [self _termIDForTerm:inTerm];
+	if ( term == kSPIndexNotFound ) goto bail;
+
+	count = SPIndexCopyDocumentIDsForTerm(index, term, &documentIds);
+
+	for ( i = 0; i < count; i++ ) {
+		NSURL *url = SPNativeBackendCopyURL(index, documentIds[i]);
+		if ( url != nil ) [documents addObject:url];
+		[url release];
+	}
+
+bail:
+	if ( documentIds ) free(documentIds);
+	return documents;
+}
+
+#pragma mark -
+
+- (NSUInteger) termCountForDocument:(NSURL*)inDocumentURI {
+	return [self termCountForDocumentID:[self documentIDForDocument:inDocumentURI]];
+}
+
+- (NSArray*) termsForDocument:(NSURL*)inDocumentURI {
+	return [self termsForDocumentID:[self documentIDForDocument:inDocumentURI]];
+}
+
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocument:(NSURL*)inDocumentURI {
+	return [self frequencyOfTerm:inTerm inDocumentID:[self documentIDForDocument:inDocumentURI]];
+}
+
+#pragma mark -
+
+- (NSIndexSet*) documentIDsForTerm:(NSString*)inTerm {
+
+	NSMutableIndexSet *documents = [NSMutableIndexSet indexSet];
+	SPDocumentID *documentIds = NULL;
+	size_t i, count = 0;
+
+	SPTermID term = [self _termIDForTerm:inTerm];
+	if ( term == kSPIndexNotFound ) goto bail;
+
+	count = SPIndexCopyDocumentIDsForTerm(index, term, &documentIds);
+	for ( i = 0; i < count; i++ ) [documents addIndex:(NSUInteger)documentIds[i]];
+
+bail:
+	if ( documentIds ) free(documentIds);
+	return documents;
+}
+
+- (NSUInteger) termCountForDocumentID:(NSInteger)inDocumentID {
+	SPDocumentID document = SPNativeBackendDocumentID(inDocumentID);
+	return ( document == kSPIndexNotFound ? 0 : SPIndexGetDocumentTermCount(index, document) );
+}
+
+- (NSArray*) termsForDocumentID:(NSInteger)inDocumentID {
+
+	NSMutableArray *documentTerms = [NSMutableArray array];
+	SPTermID *termIds = NULL;
+	size_t i, count = 0;
+
+	SPDocumentID document = SPNativeBackendDocumentID(inDocumentID);
+	if ( document == kSPIndexNotFound ) goto bail;
+
+	count = SPIndexCopyTermIDsForDocument(index, document, &termIds, NULL);
+
+	for ( i = 0; i < count; i++ ) {
+		char *term = NULL;
+		size_t length = SPIndexCopyTerm(index, termIds[i], &term);
+		if ( length == 0 ) continue;
+
+		NSString *aTerm = [[NSString alloc] initWithBytes:term length:length encoding:NSUTF8StringEncoding];
+		if ( aTerm != nil ) [documentTerms addObject:aTerm];
+		[aTerm release];
+		free(term);
+	}
+
+bail:
+	if ( termIds ) free(termIds);
+	return documentTerms;
+}
+
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocumentID:(NSInteger)inDocumentID {
+
+	SPDocumentID document = SPNativeBackendDocumentID(inDocumentID);
+	if ( document == kSPIndexNotFound ) return 0;
+
+	SPTermID term = [self _termIDForTerm:inTerm];
+	if ( term == kSPIndexNotFound ) return 0;
+
+	return SPIndexGetDocumentTermFrequency(index, document, term);
+}
+
+#pragma mark -
+#pragma mark Similarity
+
+- (NSArray*) documentsSimilarToDocument:(NSURL*)inDocumentURI limit:(NSUInteger)limit ranks:(float*)outRanks {
+
+	NSMutableArray *documents = [NSMutableArray arrayWithCapacity:limit];
+	SPDocumentID *documentIds = calloc(( limit == 0 ? 1 : limit ), sizeof(SPDocumentID));
+	float *documentScores = calloc(( limit == 0 ? 1 : limit ), sizeof(float));
+	size_t i, documentCount = 0;
+
+	SPDocumentID document = SPIndexGetDocumentID(index, [[inDocumentURI absoluteString] UTF8String]);
+	if ( document == kSPIndexNotFound ) goto bail;
+
+	documentCount = SPIndexCopySimilarDocuments(index, document, NULL, limit, documentIds, documentScores);
+
+	for ( i = 0; i < documentCount; i++ ) {
+		NSURL *url = SPNativeBackendCopyURL(index, documentIds[i]);
+		if ( url == nil ) continue;
+
+		if ( outRanks != NULL ) outRanks[[documents count]] = documentScores[i];
+		[documents addObject:url];
+		[url release];
+	}
+
+bail:
+	free(documentIds);
+	free(documentScores);
+
+	return [[documents copy] autorelease];
+}
+
+- (NSArray*) nearDuplicatesOfDocument:(NSURL*)inDocumentURI threshold:(float)threshold {
+
+	NSMutableArray *documents = [NSMutableArray array];
+	SPDocumentID *documentIds = NULL;
+	float *similarities = NULL;
+	size_t i, count = 0;
+
+	SPDocumentID document = SPIndexGetDocumentID(index, [[inDocumentURI absoluteString] UTF8String]);
+	if ( document == kSPIndexNotFound ) goto bail;
+
+	count = SPIndexCopyNearDuplicates(index, document, threshold, &documentIds, &similarities);
+
+	for ( i = 0; i < count; i++ ) {
+		NSURL *url = SPNativeBackendCopyURL(index, documentIds[i]);
+		if ( url != nil ) [documents addObject:url];
+		[url release];
+	}
+
+bail:
+	if ( documentIds ) free(documentIds);
+	if ( similarities ) free(similarities);
+	return documents;
+}
+
+- (NSArray*) nearDuplicatePairsWithThreshold:(float)threshold {
+
+	NSMutableArray *duplicates = [NSMutableArray array];
+	SPDocumentPair *pairs = NULL;
+	size_t i, count = SPIndexCopyNearDuplicatePairs(index, threshold, &pairs);
+
+	for ( i = 0; i < count; i++ ) {
+		NSURL *first = SPNativeBackendCopyURL(index, pairs[i].first);
+		NSURL *second = SPNativeBackendCopyURL(index, pairs[i].second);
+
+		if ( first != nil && second != nil ) [duplicates addObject:[NSArray arrayWithObjects:first, second, nil]];
+
+		[first release];
+		[second release];
+	}
+
+	if ( pairs ) free(pairs);
+	return duplicates;
+}
+
+#pragma mark -
+#pragma mark Term Graph
+
+- (SPGraphRef) copyGraphWithOrientation:(SPGraphOrientation)orientation documentIDs:(NSRange)range {
+
+	SPDocumentID first = (SPDocumentID)MIN(range.location, (NSUInteger)INT32_MAX);
+	SPDocumentID last = ( range.length == 0 ? first - 1 : (SPDocumentID)MIN(NSMaxRange(range) - 1, (NSUInteger)INT32_MAX) );
+
+	return SPIndexCopyGraph(index, first, last, orientation);
+}
+
+@end
+
+#pragma mark -
+
+@implementation SPNativeSearch
+
+- (id) initWithBackend:(SPNativeBackend*)inBackend search:(SPSearchRef)inSearch {
+	if ( self = [super init] ) {
+		backend = [inBackend retain];
+		search = inSearch;
+	}
+	return self;
+}
+
+- (void) dealloc {
+	SPSearchRelease(search);
+	search = NULL;
+	[backend release], backend = nil;
+	[super dealloc];
+}
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float*)outRanks
+		maxTime:(NSTimeInterval)maxTime maxCount:(NSInteger)maxCount {
+
+	// The native search is evaluated up front, so maxTime does not apply. Documents removed
+	// since the search was prepared are dropped along with their ranks.
+
+	NSMutableArray *documents = [NSMutableArray arrayWithCapacity:maxCount];
+	SPDocumentID *documentIds = calloc(maxCount, sizeof(SPDocumentID));
+	float *documentScores = calloc(maxCount, sizeof(float));
+	size_t i, documentCount = 0;
+	NSInteger count = 0;
+
+	BOOL stillSearching = SPSearchFindMatches(search, maxCount, documentIds, documentScores, &documentCount);
+
+	for ( i = 0; i < documentCount; i++ ) {
+		NSURL *url = SPNativeBackendCopyURL(backend.index, documentIds[i]);
+		if ( url == nil ) continue;
+
+		if ( outRanks != NULL ) outRanks[count] = documentScores[i];
+		[documents addObject:url];
+		[url release];
+		count++;
+	}
+
+	free(documentIds);
+	free(documentScores);
+
+	*outDocuments = [[documents copy] autorelease];
+	return stillSearching;
+}
+
+- (void) cancel {
+	SPSearchCancel(search);
+}
+
+@end
@@ -0,0 +1,163 @@
+//
+//  SPPostingList.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPPostingList.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+size_t SPVarIntEncode(uint32_t value, uint8_t *outBytes) {
+	size_t length = 0;
+	
+	while ( value >= 0x80 ) {
+		outBytes[length++] = (uint8_t)( value | 0x80 );
+		value >>= 7;
+	}
+	outBytes[length++] = (uint8_t)value;
+	
+	return length;
+}
+
+const uint8_t * SPVarIntDecode(const uint8_t *bytes, uint32_t *outValue) {
+	uint32_t value = 0;
+	int shift = 0;
+	
+	while ( *bytes & 0x80 ) {
+		value |= (uint32_t)( *bytes++ & 0x7F ) << shift;
+		shift += 7;
+	}
+	value |= (uint32_t)( *bytes++ ) << shift;
+	
+	*outValue = value;
+	return bytes;
+}
+
+bool SPPostingListAppend(SPPostingList *list, uint32_t document, uint32_t frequency) {
+	
+	uint8_t encoded[10];
+	size_t length;
+	
+	length = SPVarIntEncode(document - list->lastDocument, encoded);
+	length += SPVarIntEncode(frequency, encoded + length);
+	
+	if ( list->length + length > list->capacity ) {
+		uint32_t capacity = ( list->capacity == 0 ? 16 : list->capacity );
+		while ( list->length + length > capacity ) capacity += ( capacity >> 1 ) + 16;
+		
+		uint8_t *bytes = realloc(list->bytes, capacity);
+		if ( bytes == NULL ) return false;
+		
+		list->bytes = bytes;
+		list->capacity = capacity;
+	}
+	
+	memcpy(list->bytes + list->length, encoded, length);
+	list->length += (uint32_t)length;
+	list->lastDocument = document;
+	list->count++;
+	
+	if ( frequency > list->maxFrequency ) list->maxFrequency = frequency;
+	
+	return true;
+}
+
+void SPPostingListFree(SPPostingList *list) {
+	free(list->bytes);
+	memset(list, 0, sizeof(SPPostingList));
+}
+
+void SPPostingIteratorInit(SPPostingIterator *iterator, const uint8_t *bytes, size_t length) {
+	iterator->cursor = bytes;
+	iterator->end = ( bytes == NULL ? NULL : bytes + length );
+	iterator->document = 0;
+	iterator->frequency = 0;
+}
+
+bool SPPostingIteratorNext(SPPostingIterator *iterator) {
+	uint32_t gap;
+	
+	if ( iterator->cursor >= iterator->end ) 
+		return false;
+	
+	iterator->cursor = SPVarIntDecode(iterator->cursor, &gap);
+	iterator->cursor = SPVarIntDecode(iterator->cursor, &iterator->frequency);
+	iterator->document += gap;
+	
+	return true;
+}
+
+size_t SPPositionListEncode(const uint32_t *positions, uint32_t count, uint8_t *outBytes) {
+
+	// The positions are written after room for the longest length prefix and moved down
+	// once their length is known
+
+	uint8_t *encoded = outBytes + 5;
+	size_t length = 0, prefix;
+	uint32_t i, previous = 0;
+
+	for ( i = 0; i < count; i++ ) {
+		length += SPVarIntEncode(positions[i] - previous, encoded + length);
+		previous = positions[i];
+	}
+
+	prefix = SPVarIntEncode((uint32_t)length, outBytes);
+	memmove(outBytes + prefix, encoded, length);
+
+	return prefix + length;
+}
+
+const uint8_t * SPPositionListSkip(const uint8_t *bytes) {
+	uint32_t length;
+	bytes = SPVarIntDecode(bytes, &length);
+	return bytes + length;
+}
+
+const uint8_t * SPPositionListDecode(const uint8_t *bytes, uint32_t count, uint32_t *outPositions) {
+	uint32_t i, length, gap, position = 0;
+
+	bytes = SPVarIntDecode(bytes, &length);
+
+	for ( i = 0; i < count; i++ ) {
+		bytes = SPVarIntDecode(bytes, &gap);
+		position += gap;
+		outPositions[i] = position;
+	}
+
+	return bytes;
+}
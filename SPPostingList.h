@@ -0,0 +1,100 @@
+//
+//  SPPostingList.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPPOSTINGLIST_H
+#define SPPOSTINGLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Posting lists are stored as a stream of variable length integers. Each posting is
+// the gap from the previous document ID followed by the term frequency in that
+// document, so a list of one million postings over dense document IDs usually costs
+// two bytes per posting instead of eight. Document IDs must be appended in increasing
+// order, which the native index guarantees by never reusing an ID.
+
+// The same encoding is used for the document -> term vectors kept for
+// kSKIndexInvertedVector stores, in which case the "document" is a term ID.
+
+typedef struct {
+	uint8_t *bytes;
+	uint32_t length;
+	uint32_t capacity;
+	uint32_t count;				// postings in the list, including removed documents
+	uint32_t lastDocument;
+	uint32_t maxFrequency;
+} SPPostingList;
+
+typedef struct {
+	const uint8_t *cursor;
+	const uint8_t *end;
+	uint32_t document;
+	uint32_t frequency;
+} SPPostingIterator;
+
+size_t SPVarIntEncode(uint32_t value, uint8_t *outBytes);
+const uint8_t * SPVarIntDecode(const uint8_t *bytes, uint32_t *outValue);
+
+	// outBytes must have room for five bytes.
+
+bool SPPostingListAppend(SPPostingList *list, uint32_t document, uint32_t frequency);
+void SPPostingListFree(SPPostingList *list);
+
+	// SPPostingListFree releases the encoded bytes and zeroes the list.
+
+void SPPostingIteratorInit(SPPostingIterator *iterator, const uint8_t *bytes, size_t length);
+bool SPPostingIteratorNext(SPPostingIterator *iterator);
+
+	// Advances to the next posting, returning false when the list is exhausted.
+
+// Indexes that keep term positions write a position list for every posting, in a stream
+// of their own that runs parallel to the postings. Each list is its length in bytes
+// followed by the positions, the first as it is and the rest as gaps from the one
+// before, so a reader steps over the lists of documents it has no use for without
+// decoding them.
+
+size_t SPPositionListEncode(const uint32_t *positions, uint32_t count, uint8_t *outBytes);
+const uint8_t * SPPositionListSkip(const uint8_t *bytes);
+const uint8_t * SPPositionListDecode(const uint8_t *bytes, uint32_t count, uint32_t *outPositions);
+
+	// outBytes must have room for five bytes per position and five more. count is the
+	// posting's frequency. Skip and Decode return the start of the next list.
+
+#endif
@@ -0,0 +1,73 @@
+//
+//  SPReadWriteLock.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import <Foundation/Foundation.h>
+#include <pthread.h>
+
+// A readers/writer lock. Any number of threads may hold the lock for reading at once,
+// while a writer holds it alone. -lock and -unlock acquire the lock for reading so that
+// an SPReadWriteLock may stand in wherever an NSLock was used to guard reads.
+
+@interface SPReadWriteLock : NSObject <NSLocking> {
+	pthread_rwlock_t rwlock;
+}
+
+- (void) lockForReading;
+- (void) lockForWriting;
+
+- (BOOL) tryLockForReading;
+- (BOOL) tryLockForWriting;
+
+- (void) unlock;
+
+	// Releases the lock whichever way it was acquired.
+
+	// The time threads wait for and hold the lock, either way, is recorded as the read
+	// lock statistics. See SPStatistics.h.
+
+@end
+
+#pragma mark -
+
+// An NSLock whose wait and hold times are recorded as the write lock statistics. The
+// SearchKit backend guards its writers with one.
+
+@interface SPTimedLock : NSLock
+
+@end
@@ -0,0 +1,128 @@
+//
+//  SPReadWriteLock.m
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPReadWriteLock.h"
+#include "SPStatistics.h"
+
+@implementation SPReadWriteLock
+
+- (id) init {
+	if ( self = [super init] ) {
+		if ( pthread_rwlock_init(&rwlock, NULL) != 0 ) {
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+- (void) dealloc {
+	pthread_rwlock_destroy(&rwlock);
+	[super dealloc];
+}
+
+#pragma mark -
+
+- (void) lock {
+	[self lockForReading];
+}
+
+- (void) lockForReading {
+	SPStatisticsStart(requested);
+	pthread_rwlock_rdlock(&rwlock);
+	SPStatisticsLocked(kSPStatisticReadLockWait, kSPStatisticReadLockHold, requested);
+}
+
+- (void) lockForWriting {
+	SPStatisticsStart(requested);
+	pthread_rwlock_wrlock(&rwlock);
+	SPStatisticsLocked(kSPStatisticReadLockWait, kSPStatisticReadLockHold, requested);
+}
+
+- (BOOL) tryLockForReading {
+	SPStatisticsStart(requested);
+	if ( pthread_rwlock_tryrdlock(&rwlock) != 0 ) return NO;
+	SPStatisticsLocked(kSPStatisticReadLockWait, kSPStatisticReadLockHold, requested);
+	return YES;
+}
+
+- (BOOL) tryLockForWriting {
+	SPStatisticsStart(requested);
+	if ( pthread_rwlock_trywrlock(&rwlock) != 0 ) return NO;
+	SPStatisticsLocked(kSPStatisticReadLockWait, kSPStatisticReadLockHold, requested);
+	return YES;
+}
+
+- (void) unlock {
+	SPStatisticsUnlocking();
+	pthread_rwlock_unlock(&rwlock);
+}
+
+@end
+
+#pragma mark -
+
+@implementation SPTimedLock
+
+- (void) lock {
+	SPStatisticsStart(requested);
+	[super lock];
+	SPStatisticsLocked(kSPStatisticWriteLockWait, kSPStatisticWriteLockHold, requested);
+}
+
+- (BOOL) tryLock {
+	SPStatisticsStart(requested);
+	if ( ![super tryLock] ) return NO;
+	SPStatisticsLocked(kSPStatisticWriteLockWait, kSPStatisticWriteLockHold, requested);
+	return YES;
+}
+
+- (BOOL) lockBeforeDate:(NSDate*)limit {
+	SPStatisticsStart(requested);
+	if ( ![super lockBeforeDate:limit] ) return NO;
+	SPStatisticsLocked(kSPStatisticWriteLockWait, kSPStatisticWriteLockHold, requested);
+	return YES;
+}
+
+- (void) unlock {
+	SPStatisticsUnlocking();
+	[super unlock];
+}
+
+@end
@@ -0,0 +1,252 @@
+//
+//  SPSearchBackend.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import <Foundation/Foundation.h>
+#import "SPReadWriteLock.h"
+#import "SPGraph.h"
+
+// SPSearchStore talks to its index through the SPSearchBackend protocol. Two backends
+// are included: SPSearchKitBackend, which wraps a SearchKit SKIndexRef and is what the
+// store has always used, and SPNativeBackend, a portable inverted index which can be
+// built and profiled on any platform with Foundation and pthreads.
+
+// Backends are responsible for their own locking. SPSearchStore may call any backend
+// method from any thread.
+
+// SearchKit is used when it is available. Define SPSEARCHSTORE_USES_SEARCHKIT to 0 to
+// build the store without CoreServices, in which case only the native backend exists
+// and the SearchKit types used in the public interface are defined here instead.
+
+#ifndef SPSEARCHSTORE_USES_SEARCHKIT
+	#if defined(__APPLE__)
+		#define SPSEARCHSTORE_USES_SEARCHKIT 1
+	#else
+		#define SPSEARCHSTORE_USES_SEARCHKIT 0
+	#endif
+#endif
+
+#if SPSEARCHSTORE_USES_SEARCHKIT
+
+#import <CoreServices/CoreServices.h>
+
+#else
+
+typedef void * SKIndexRef;
+typedef NSInteger SKDocumentID;
+
+typedef enum {
+	kSKIndexUnknown = 0,
+	kSKIndexInverted,
+	kSKIndexVector,
+	kSKIndexInvertedVector
+} SKIndexType;
+
+typedef enum {
+	kSKDocumentStateNotIndexed = 0,
+	kSKDocumentStateIndexed = 1,
+	kSKDocumentStateAddPending = 2,
+	kSKDocumentStateDeletePending = 3
+} SKDocumentIndexState;
+
+typedef uint32_t SKSearchOptions;
+
+enum {
+	kSKSearchOptionDefault = 0,
+	kSKSearchOptionNoRelevanceScores = 1L << 0,
+	kSKSearchOptionSpaceMeansOR = 1L << 1,
+	kSKSearchOptionFindSimilar = 1L << 2
+};
+
+#define kSKMinTermLength		@"kSKMinTermLength"
+#define kSKMaximumTerms			@"kSKMaximumTerms"
+#define kSKProximityIndexing	@"kSKProximityIndexing"
+#define kSKStopWords			@"kSKStopWords"
+#define kSKSubstitutions		@"kSKSubstitutions"
+#define kSKTermChars			@"kSKTermChars"
+#define kSKStartTermChars		@"kSKStartTermChars"
+#define kSKEndTermChars			@"kSKEndTermChars"
+
+#endif
+
+// Analysis options of the native backend beyond SearchKit's, applied as documents are
+// indexed rather than when terms are listed. kSPStopWordLanguages is an array of two
+// character language codes such as @"en" whose built in stop words are never indexed,
+// see SPStopWords.h. The other two take boolean NSNumbers. SearchKit ignores them.
+
+#define kSPStopWordLanguages	@"SPStopWordLanguages"
+#define kSPExcludesNumericTerms	@"SPExcludesNumericTerms"
+#define kSPStemsTerms			@"SPStemsTerms"
+
+#pragma mark -
+
+@protocol SPSearchBackendSearch <NSObject>
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float*)outRanks 
+		maxTime:(NSTimeInterval)maxTime maxCount:(NSInteger)maxCount;
+		
+	// Fetches the next chunk of results. outRanks is NULL or has room for maxCount floats.
+	// Returns YES while more results may remain.
+
+- (void) cancel;
+
+@end
+
+#pragma mark -
+
+@protocol SPSearchBackend <NSObject>
+
+- (SKIndexType) indexType;
+
+- (BOOL) addDocument:(NSURL*)inFileURL typeHint:(NSString*)inMimeHint;
+- (BOOL) addDocument:(NSURL*)inDocumentURI withText:(NSString*)inContents;
+- (BOOL) removeDocument:(NSURL*)inDocumentURI;
+
+- (NSUInteger) addDocuments:(NSArray*)inFileURLs typeHint:(NSString*)inMimeHint byteCount:(unsigned long long*)outByteCount;
+- (NSUInteger) addDocuments:(NSArray*)inDocumentURIs withTexts:(NSArray*)inContents byteCount:(unsigned long long*)outByteCount;
+
+	// Adds many documents with a single acquisition of the write lock and a single commit.
+	// Returns the number of documents added. outByteCount, which may be NULL, receives the
+	// amount of text indexed.
+
+- (void) setProperties:(NSDictionary*)inProperties forDocument:(NSURL*)inDocumentURI;
+- (NSDictionary*) propertiesForDocument:(NSURL*)inDocumentURI;
+
+- (BOOL) setName:(NSString*)inTitle forDocument:(NSURL*)inDocumentURI;
+- (NSString*) nameOfDocument:(NSURL*)inDocumentURI;
+
+- (SKDocumentIndexState) stateOfDocument:(NSURL*)inDocumentURI;
+- (NSArray*) allDocuments:(BOOL)ignoreEmptyDocuments;
+
+- (NSInteger) documentIDForDocument:(NSURL*)inDocumentURI;
+- (NSURL*) documentForDocumentID:(NSInteger)inDocumentID;
+
+	// Document IDs are the backend's own. documentIDForDocument: returns NSNotFound for a
+	// document that is not in the index, and the ID methods below accept NSNotFound and
+	// treat it as an unknown document.
+
+- (void) setProperties:(NSDictionary*)inProperties forDocumentID:(NSInteger)inDocumentID;
+- (NSDictionary*) propertiesForDocumentID:(NSInteger)inDocumentID;
+
+- (NSInteger) documentCount;
+- (NSInteger) maximumDocumentID;
+
+	// Used to estimate bloat. Document IDs are never reused by either backend.
+
+- (NSUInteger) generation;
+
+	// Changes whenever the results of a search may have changed. Two searches made at the
+	// same generation return the same documents with the same ranks. SPSearchStore keys
+	// its result cache on it.
+
+- (BOOL) compact;
+- (BOOL) flush;
+- (void) close;
+
+- (id<SPSearchBackendSearch>) searchWithQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions;
+
+	// Returns an autoreleased search, or nil if the query could not be prepared.
+
+- (NSArray*) topResultsForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions 
+		limit:(NSUInteger)limit ranks:(float*)outRanks;
+
+	// Returns up to limit documents ordered by descending rank. outRanks is NULL or has room
+	// for limit floats.
+
+- (void) enumerateTermsWithPrefix:(NSString*)inPrefix 
+		usingBlock:(void (^)(NSString *term, NSUInteger documentCount, BOOL *stop))block;
+
+	// Calls block for every term beginning with inPrefix, in sorted order, along with the number
+	// of documents that contain it. An empty prefix enumerates every term.
+
+- (NSUInteger) documentCountForTerm:(NSString*)inTerm;
+- (NSArray*) documentsForTerm:(NSString*)inTerm;
+- (NSUInteger) termCountForDocument:(NSURL*)inDocumentURI;
+- (NSArray*) termsForDocument:(NSURL*)inDocumentURI;
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocument:(NSURL*)inDocumentURI;
+
+- (NSIndexSet*) documentIDsForTerm:(NSString*)inTerm;
+- (NSUInteger) termCountForDocumentID:(NSInteger)inDocumentID;
+- (NSArray*) termsForDocumentID:(NSInteger)inDocumentID;
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocumentID:(NSInteger)inDocumentID;
+
+	// Terms are returned unfiltered. SPSearchStore removes stop words and numeric terms.
+
+@optional
+
+- (SPGraphRef) copyGraphWithOrientation:(SPGraphOrientation)orientation documentIDs:(NSRange)range;
+
+	// Exports the documents whose IDs fall in range and their terms as a compressed sparse row
+	// graph, which the caller releases with SPGraphRelease. Only the native backend can export.
+
+- (NSArray*) documentsSimilarToDocument:(NSURL*)inDocumentURI limit:(NSUInteger)limit ranks:(float*)outRanks;
+
+	// Returns up to limit documents ordered by the cosine similarity of their TF-IDF vectors
+	// to the document's, which is not itself included. outRanks is NULL or has room for limit
+	// floats.
+
+- (NSArray*) nearDuplicatesOfDocument:(NSURL*)inDocumentURI threshold:(float)threshold;
+- (NSArray*) nearDuplicatePairsWithThreshold:(float)threshold;
+
+	// Near duplicates share at least threshold of their distinct terms, estimated from MinHash
+	// signatures. Pairs are arrays of two URLs, most similar first.
+
+- (BOOL) compactsOnline;
+
+	// YES when compact leaves the backend free to index and search while it runs. The store
+	// then compacts off its indexing queue, so queued changes do not wait on compaction.
+
+- (BOOL) writeToURL:(NSURL*)inFileURL;
+
+	// Saves the index to a file which can be opened again without reading it in. Only the
+	// native backend writes files this way; SearchKit indexes are saved with flush.
+
+- (BOOL) commit;
+
+	// Makes the changes made so far durable without writing out the whole index, for
+	// backends that log their changes beside a file. SPSearchStore prefers it to writeToURL:
+	// when saving changes.
+
+- (SKIndexRef) searchIndex;
+- (NSLock*) writeLock;
+- (SPReadWriteLock*) readLock;
+- (NSMutableData*) storeData;
+
+	// Only meaningful for the SearchKit backend.
+
+@end
@@ -0,0 +1,104 @@
+//
+//  SPSearchKitBackend.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPSearchBackend.h"
+#import "SPReadWriteLock.h"
+#include "SPDocumentTable.h"
+
+#if SPSEARCHSTORE_USES_SEARCHKIT
+
+// The SearchKit backend. All calls to the SKIndexRef are made here, guarded by a pair
+// of locks as described in SPSearchStore.h. Reads share the readLock, so searches and
+// term requests from several threads run side by side. Compacting and closing the
+// index take it for writing.
+
+// Changes are flushed on a background queue shortly after they are made rather than by
+// the next reader, so a search never waits on SKIndexFlush. Searches see the index as
+// of the last flush.
+
+// Document URLs and their SearchKit IDs are interned in an SPDocumentTable as documents
+// are added and looked up, so that per document calls resolve a URL with a hash lookup
+// instead of creating an SKDocumentRef and asking SearchKit, and search results become
+// URLs without a trip through SKIndexCopyDocumentURLsForDocumentIDs. Documents indexed
+// before the index was opened are interned the first time they are looked up.
+
+#define kSPSearchKitBackendRefreshInterval 0.25
+
+@interface SPSearchKitBackend : NSObject <SPSearchBackend> {
+	
+	SKIndexRef searchIndex;
+	SKIndexType indexType;
+	
+	NSMutableData *storeData;
+	BOOL didCreateStore;
+	
+	NSLock *writeLock;
+	SPReadWriteLock *readLock;
+	
+	SPDocumentTable *documentTable;
+	
+	NSUInteger changeCount;
+	NSUInteger generation;
+	NSOperationQueue *flushQueue;
+	BOOL flushScheduled;
+	NSTimeInterval refreshInterval;
+}
+
+@property (readonly) SKIndexRef searchIndex;
+@property (readonly) SKIndexType indexType;
+
+@property (readonly,retain) NSLock *writeLock;
+@property (readonly,retain) SPReadWriteLock *readLock;
+
+@property (readonly,retain) NSMutableData *storeData;
+@property (readonly) BOOL didCreateStore;
+
+@property (readwrite) NSTimeInterval refreshInterval;
+
+	// Seconds between a change and the flush that makes it searchable. Pass 0 to flush as
+	// soon as the background queue gets to it. -flush commits pending changes immediately.
+
+- (id) initWithMemory:(NSMutableData*)inData type:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions;
+- (id) initWithURL:(NSURL*)inFileURL type:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions;
+
+	// inOptions are the text analysis options used when a new index is created.
+
+@end
+
+#endif
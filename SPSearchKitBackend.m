@@ -0,0 +1,1287 @@
+//
+//  SPSearchKitBackend.m
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPSearchKitBackend.h"
+#include "SPStatistics.h"
+
+#if SPSEARCHSTORE_USES_SEARCHKIT
+
+NSString const * kSPSearchStoreIndexName = @"Search Index";
+NSInteger const kSPSearchStoreMemorySize = 2^16;
+
+#define kSPSearchKitBackendTopResultsChunkSize 256
+#define kSPSearchKitBackendURIBufferSize 1024
+
+static CFIndex SPSearchKitBackendGetURIBytes(NSURL *inDocumentURI, UInt8 *buffer) {
+
+	// The bytes a URL was made from, read without making a string of them. URLs relative
+	// to a base and URLs too long for the buffer return 0 and go through SearchKit.
+
+	if ( inDocumentURI == nil || CFURLGetBaseURL((CFURLRef)inDocumentURI) != NULL ) return 0;
+
+	CFIndex length = CFURLGetBytes((CFURLRef)inDocumentURI, buffer, kSPSearchKitBackendURIBufferSize);
+	return ( length < 0 ? 0 : length );
+}
+
+static void SPSearchKitSiftDown(SKDocumentID *documents, float *scores, CFIndex count, CFIndex i) {
+
+	// Min-heap on score, so that the root is the lowest ranked result kept
+
+	for ( ;; ) {
+		CFIndex lowest = i, left = 2 * i + 1, right = left + 1;
+
+		if ( left < count && scores[left] < scores[lowest] ) lowest = left;
+		if ( right < count && scores[right] < scores[lowest] ) lowest = right;
+		if ( lowest == i ) return;
+
+		SKDocumentID document = documents[i];
+		float score = scores[i];
+		documents[i] = documents[lowest], scores[i] = scores[lowest];
+		documents[lowest] = document, scores[lowest] = score;
+		i = lowest;
+	}
+}
+
+#pragma mark -
+
+@interface SPSearchKitSearch : NSObject <SPSearchBackendSearch> {
+	SPSearchKitBackend *backend;
+	SKSearchRef search;
+}
+
+- (id) initWithBackend:(SPSearchKitBackend*)inBackend search:(SKSearchRef)inSearch;
+
+@end
+
+#pragma mark -
+
+@interface SPSearchKitBackend()
+
+@property (readwrite,retain) NSMutableData *storeData;
+@property (readwrite) BOOL didCreateStore;
+
+- (NSArray*) _allDocumentsForDocumentRef:(SKDocumentRef)document ignoreEmptyDocuments:(BOOL)ignoresEmpty;
+
+- (SKDocumentID) _documentIDForURL:(NSURL*)inDocumentURI;
+- (void) _internDocument:(SKDocumentRef)document URL:(NSURL*)inDocumentURI;
+- (void) _copyURLs:(CFURLRef*)outURLs forDocumentIDs:(SKDocumentID*)documentIds count:(CFIndex)count;
+
+- (void) _incrementChangeCount;
+- (void) _scheduleFlush;
+- (BOOL) _flushIndexIfNecessary;
+
+@end
+
+#pragma mark -
+
+@implementation SPSearchKitBackend
+
+@synthesize searchIndex;
+@synthesize indexType;
+
+@synthesize writeLock;
+@synthesize readLock;
+
+@synthesize refreshInterval;
+
+@synthesize didCreateStore;
+
+- (id) initWithMemory:(NSMutableData*)inData type:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions {
+
+	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
+
+	if ( self = [super init] ) {
+
+		if ( inData == nil ) {
+			// create a new in memory store
+
+			inData = [NSMutableData dataWithCapacity: kSPSearchStoreMemorySize];
+			searchIndex = SKIndexCreateWithMutableData( (CFMutableDataRef)inData, (CFStringRef)NULL,
+					(SKIndexType)inType, (CFDictionaryRef)inOptions );
+		}
+		else {
+			// open a store from memory
+
+			searchIndex = SKIndexOpenWithMutableData ( (CFMutableDataRef)inData, (CFStringRef)NULL );
+		}
+
+		if ( searchIndex == NULL ) {
+			[self release];
+			return nil;
+		}
+
+		writeLock = [[SPTimedLock alloc] init];
+		readLock = [[SPReadWriteLock alloc] init];
+		documentTable = SPDocumentTableCreate(1024);
+
+		if ( documentTable == NULL ) {
+			[self release];
+			return nil;
+		}
+
+		flushQueue = [[NSOperationQueue alloc] init];
+		[flushQueue setMaxConcurrentOperationCount:1];
+		refreshInterval = kSPSearchKitBackendRefreshInterval;
+
+		self.didCreateStore = (inData==nil);
+		self.storeData = inData;
+
+		indexType = inType;
+		changeCount = 0;
+
+	}
+	return self;
+}
+
+- (id) initWithURL:(NSURL*)inFileURL type:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions {
+
+	NSAssert( inFileURL!=nil, @"inFileURL must not be nil");
+	NSAssert( [inFileURL isFileURL], @"inFileURL must be a file url");
+	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
+
+	if ( self = [super init] ) {
+
+		NSFileManager *fm = [[[NSFileManager alloc] init] autorelease];
+		BOOL fileExists = [fm fileExistsAtPath:[inFileURL path]];
+
+		if ( fileExists ) {
+			// store already exists, we want to open it
+
+			searchIndex = SKIndexOpenWithURL((CFURLRef)inFileURL, (CFStringRef)NULL, true);
+		}
+		else {
+			// store does not exist, we want to create it
+
+			searchIndex = SKIndexCreateWithURL((CFURLRef)inFileURL, (CFStringRef)NULL,
+					(SKIndexType)inType, (CFDictionaryRef)inOptions );
+		}
+
+		if ( searchIndex == NULL ) {
+			[self release];
+			return nil;
+		}
+
+		writeLock = [[SPTimedLock alloc] init];
+		readLock = [[SPReadWriteLock alloc] init];
+		documentTable = SPDocumentTableCreate(1024);
+
+		if ( documentTable == NULL ) {
+			[self release];
+			return nil;
+		}
+
+		flushQueue = [[NSOperationQueue alloc] init];
+		[flushQueue setMaxConcurrentOperationCount:1];
+		refreshInterval = kSPSearchKitBackendRefreshInterval;
+
+		self.didCreateStore = !fileExists;
+		self.storeData = nil;
+
+		indexType = inType;
+		changeCount = 0;
+
+	}
+	return self;
+}
+
+- (void) dealloc {
+
+	self.storeData = nil;
+
+	if ( searchIndex ) SKIndexClose(searchIndex);
+	searchIndex = NULL;
+
+	[writeLock release], writeLock = nil;
+	[readLock release], readLock = nil;
+	[flushQueue release], flushQueue = nil;
+
+	SPDocumentTableRelease(documentTable);
+	documentTable = NULL;
+
+	[super dealloc];
+}
+
+#pragma mark -
+
+- (void) setStoreData:(NSMutableData *)inData {
+    @synchronized(self) {
+        [inData retain];
+        [storeData release];
+        storeData = inData;
+    }
+}
+
+- (NSMutableData *) storeData {
+	NSMutableData *data = nil;
+    @synchronized(self) {
+        [self _flushIndexIfNecessary];
+        data = [[storeData retain] autorelease];
+    }
+    return data;
+}
+
+#pragma mark -
+#pragma mark Document / Store Management
+
+- (BOOL) addDocument:(NSURL*)inFileURL typeHint:(NSString*)inMimeHint {
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	[writeLock lock];
+
+	BOOL success = NO;
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inFileURL);
+	if ( document == NULL ) goto bail; // not always harmful!
+
+	success = SKIndexAddDocument(searchIndex, document, (CFStringRef)inMimeHint, true);
+	if ( success ) [self _internDocument:document URL:inFileURL];
+	if ( success ) [self _incrementChangeCount];
+
+	//
+	// CFStringRef name = SKDocumentGetName(document);
+	// NSLog(@"name is %@", (NSString*)name);
+	//
+
+bail:
+	if ( document ) CFRelease(document);
+	[writeLock unlock];
+	[pool release];
+	return success;
+}
+
+- (BOOL) addDocument:(NSURL*)inDocumentURI withText:(NSString*)inContents {
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	[writeLock lock];
+
+	BOOL success = NO;
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
+	if ( document == NULL ) goto bail;
+
+	success = SKIndexAddDocumentWithText(searchIndex, document, (CFStringRef)inContents, true);
+	if ( success ) [self _internDocument:document URL:inDocumentURI];
+	if ( success ) [self _incrementChangeCount];
+
+bail:
+	if ( document ) CFRelease(document);
+	[writeLock unlock];
+	[pool release];
+	return success;
+}
+
+- (NSUInteger) addDocuments:(NSArray*)inFileURLs typeHint:(NSString*)inMimeHint byteCount:(unsigned long long*)outByteCount {
+
+	// SearchKit reads and tokenizes files itself, so the most we can do is hold the write
+	// lock once for the whole batch and flush once at the end.
+
+	NSFileManager *fm = [[[NSFileManager alloc] init] autorelease];
+	unsigned long long byteCount = 0;
+	NSUInteger added = 0;
+
+	[writeLock lock];
+
+	for ( NSURL *aFileURL in inFileURLs ) {
+
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+		SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)aFileURL);
+		if ( document != NULL ) {
+			if ( SKIndexAddDocument(searchIndex, document, (CFStringRef)inMimeHint, true) ) {
+				[self _internDocument:document URL:aFileURL];
+				byteCount += [[fm attributesOfItemAtPath:[aFileURL path] error:NULL] fileSize];
+				added++;
+			}
+			CFRelease(document);
+		}
+
+		[pool release];
+	}
+
+	if ( added > 0 ) [self _incrementChangeCount];
+	[writeLock unlock];
+
+	[self _flushIndexIfNecessary];
+
+	if ( outByteCount != NULL ) *outByteCount = byteCount;
+	return added;
+}
+
+- (NSUInteger) addDocuments:(NSArray*)inDocumentURIs withTexts:(NSArray*)inContents byteCount:(unsigned long long*)outByteCount {
+
+	// SearchKit does not expose its tokenizer, so unlike the native backend the text cannot
+	// be analyzed in parallel ahead of time. The batch holds the write lock once and flushes
+	// once at the end.
+
+	NSUInteger count = MIN([inDocumentURIs count], [inContents count]);
+	unsigned long long byteCount = 0;
+	NSUInteger added = 0;
+	NSUInteger i;
+
+	[writeLock lock];
+
+	for ( i = 0; i < count; i++ ) {
+
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSString *contents = [inContents objectAtIndex:i];
+
+		SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)[inDocumentURIs objectAtIndex:i]);
+		if ( document != NULL ) {
+			if ( SKIndexAddDocumentWithText(searchIndex, document, (CFStringRef)contents, true) ) {
+				[self _internDocument:document URL:[inDocumentURIs objectAtIndex:i]];
+				byteCount += [contents lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+				added++;
+			}
+			CFRelease(document);
+		}
+
+		[pool release];
+	}
+
+	if ( added > 0 ) [self _incrementChangeCount];
+	[writeLock unlock];
+
+	[self _flushIndexIfNecessary];
+
+	if ( outByteCount != NULL ) *outByteCount = byteCount;
+	return added;
+}
+
+#pragma mark -
+
+- (BOOL) removeDocument:(NSURL*)inDocumentURI {
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	[writeLock lock];
+
+	BOOL success = NO;
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
+	if ( document == NULL ) goto bail;
+
+	SKDocumentID documentId = [self _documentIDForURL:inDocumentURI];
+
+	success = SKIndexRemoveDocument(searchIndex, document);
+	if ( success && documentId != kCFNotFound ) SPDocumentTableRemoveDocument(documentTable, (int32_t)documentId);
+	if ( success ) [self _incrementChangeCount];
+
+bail:
+	if ( document ) CFRelease(document);
+	[writeLock unlock];
+	[pool release];
+	return success;
+}
+
+#pragma mark -
+
+- (void) setProperties:(NSDictionary*)inProperties forDocument:(NSURL*)inDocumentURI {
+
+	[writeLock lock];
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
+	if ( document == NULL ) goto bail;
+
+	SKIndexSetDocumentProperties(searchIndex, document, (CFDictionaryRef)inProperties);
+
+bail:
+	if ( document ) CFRelease(document);
+	[writeLock unlock];
+}
+
+- (NSDictionary*) propertiesForDocument:(NSURL*)inDocumentURI {
+
+	[readLock lockForReading];
+
+	CFDictionaryRef properties = NULL;
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
+	if ( document == NULL ) goto bail;
+
+	properties = SKIndexCopyDocumentProperties(searchIndex, document);
+	[(id)properties autorelease];
+
+bail:
+	if ( document ) CFRelease(document);
+	[readLock unlock];
+	return (NSDictionary*)properties;
+}
+
+- (BOOL) setName:(NSString*)inTitle forDocument:(NSURL*)inDocumentURI {
+
+	[writeLock lock];
+
+	BOOL success = NO;
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
+	if ( document == NULL ) goto bail;
+
+	success = SKIndexRenameDocument(searchIndex, document, (CFStringRef)inTitle);
+
+bail:
+	if ( document ) CFRelease(document);
+	[writeLock unlock];
+	return success;
+}
+
+- (NSString*) nameOfDocument:(NSURL*)inDocumentURI {
+
+	[readLock lockForReading];
+
+	CFStringRef documentName = NULL;
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
+	if ( document == NULL ) goto bail;
+
+	documentName = SKDocumentGetName(document);
+
+bail:
+	if ( document ) CFRelease(document);
+	[readLock unlock];
+	return (NSString*)documentName;
+}
+
+- (SKDocumentIndexState) stateOfDocument:(NSURL*)inDocumentURI {
+
+	[readLock lockForReading];
+
+	SKDocumentIndexState documentState = kSKDocumentStateNotIndexed;
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
+	if ( document == NULL ) goto bail;
+
+	documentState = SKIndexGetDocumentState(searchIndex, document);
+
+bail:
+	if ( document ) CFRelease(document);
+	[readLock unlock];
+	return documentState;
+}
+
+#pragma mark -
+
+- (NSInteger) documentIDForDocument:(NSURL*)inDocumentURI {
+
+	[readLock lockForReading];
+	SKDocumentID documentId = [self _documentIDForURL:inDocumentURI];
+	[readLock unlock];
+
+	return ( documentId == kCFNotFound ? NSNotFound : (NSInteger)documentId );
+}
+
+- (NSURL*) documentForDocumentID:(NSInteger)inDocumentID {
+
+	if ( inDocumentID == NSNotFound ) return nil;
+
+	SKDocumentID documentId = (SKDocumentID)inDocumentID;
+	CFURLRef documentURL = NULL;
+
+	[readLock lockForReading];
+	[self _copyURLs:&documentURL forDocumentIDs:&documentId count:1];
+	[readLock unlock];
+
+	return [(NSURL*)documentURL autorelease];
+}
+
+- (void) setProperties:(NSDictionary*)inProperties forDocumentID:(NSInteger)inDocumentID {
+
+	// SearchKit only keeps properties by document, but it will hand back the document for
+	// an ID without a URL being made first
+
+	if ( inDocumentID == NSNotFound ) return;
+
+	SKDocumentID documentId = (SKDocumentID)inDocumentID;
+	SKDocumentRef document = NULL;
+
+	[writeLock lock];
+
+	SKIndexCopyDocumentRefsForDocumentIDs(searchIndex, 1, &documentId, &document);
+	if ( document != NULL ) {
+		SKIndexSetDocumentProperties(searchIndex, document, (CFDictionaryRef)inProperties);
+		CFRelease(document);
+	}
+
+	[writeLock unlock];
+}
+
+- (NSDictionary*) propertiesForDocumentID:(NSInteger)inDocumentID {
+
+	if ( inDocumentID == NSNotFound ) return nil;
+
+	SKDocumentID documentId = (SKDocumentID)inDocumentID;
+	SKDocumentRef document = NULL;
+	CFDictionaryRef properties = NULL;
+
+	[readLock lockForReading];
+
+	SKIndexCopyDocumentRefsForDocumentIDs(searchIndex, 1, &documentId, &document);
+	if ( document != NULL ) {
+		properties = SKIndexCopyDocumentProperties(searchIndex, document);
+		CFRelease(document);
+	}
+
+	[readLock unlock];
+	return [(NSDictionary*)properties autorelease];
+}
+
+#pragma mark -
+
+- (NSArray*) allDocuments:(BOOL)ignoreEmptyDocuments {
+
+	// There is some curious behavior here regarding the additions SearchKit makes when indexing file
+	// based documents. In addition to indexing the specified file, SearchKit also adds every parent
+	// folder up to a certain (unknown) point. The folders aren't actually indexed, nor their files
+	// which haven't been specified.
+
+	// The SKIndexDocumentIteratorRef will consequently return all of these "documents", even though
+	// none of them were actually added to the index. Fortunately, these documents all have zero terms,
+	// so we check for empty documents prior to adding them to our array.
+
+	// The trouble with this approach is that indexed documents which have a zero term count will also
+	// be filtered by this method.
+
+	[readLock lockForReading];
+	[writeLock lock];
+
+	NSArray *allDocuments = [self _allDocumentsForDocumentRef:NULL ignoreEmptyDocuments:ignoreEmptyDocuments];
+		// Recursion. Yum.
+
+	[writeLock unlock];
+	[readLock unlock];
+	return [[allDocuments copy] autorelease];
+}
+
+- (NSArray*) _allDocumentsForDocumentRef:(SKDocumentRef)document ignoreEmptyDocuments:(BOOL)ignoresEmpty {
+
+	NSMutableArray *allDocuments = [NSMutableArray array];
+
+	SKIndexDocumentIteratorRef docIterator = SKIndexDocumentIteratorCreate(searchIndex, document);
+	if ( docIterator == NULL ) goto bail;
+
+	SKDocumentRef subDocument = SKIndexDocumentIteratorCopyNext(docIterator);
+	if ( subDocument == NULL ) goto bail;
+
+	while ( subDocument != NULL ) {
+
+		CFIndex termCount = 0;
+		SKDocumentID subDocumentId = SKIndexGetDocumentID(searchIndex, subDocument);
+		if ( subDocumentId != kCFNotFound ) termCount = SKIndexGetDocumentTermCount(searchIndex, subDocumentId);
+
+		if ( !( ignoresEmpty && (termCount == 0) ) ) {
+
+			CFURLRef subDocumentURL = SKDocumentCopyURL(subDocument);
+			if ( subDocumentURL != NULL ) {
+				[allDocuments addObject:(NSURL*)subDocumentURL];
+				CFRelease(subDocumentURL);
+				subDocumentURL = NULL;
+			}
+		}
+
+		NSArray *subDocuments = [self _allDocumentsForDocumentRef:subDocument ignoreEmptyDocuments:ignoresEmpty];
+		if ( subDocuments ) [allDocuments addObjectsFromArray:subDocuments];
+
+		CFRelease(subDocument);
+		subDocument = NULL;
+
+		subDocument = SKIndexDocumentIteratorCopyNext(docIterator);
+	}
+
+bail:
+	if ( docIterator ) CFRelease(docIterator);
+	return [[allDocuments copy] autorelease];
+}
+
+#pragma mark -
+
+- (NSInteger) documentCount {
+	NSInteger documentCount;
+
+	[readLock lockForReading];
+	documentCount = SKIndexGetDocumentCount(searchIndex);
+	[readLock unlock];
+
+	return documentCount;
+}
+
+- (NSInteger) maximumDocumentID {
+	NSInteger maxDocumentId;
+
+	[readLock lockForReading];
+	maxDocumentId = SKIndexGetMaximumDocumentID(searchIndex);
+	[readLock unlock];
+
+	return maxDocumentId;
+}
+
+- (BOOL) compact {
+
+	// To check for bloat you can take advantage of the way Search Kit assigns document IDs.
+	// It does so starting at 1 and without reusing previously allocated IDs for an index.
+	// Simply compare the highest document ID, found with the SKIndexGetMaximumDocumentID() function,
+	// with the current document count, found with the SKIndexGetDocumentCount() function.
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	BOOL success = NO;
+
+	[readLock lockForWriting];
+	[writeLock lock];
+
+	success = SKIndexCompact(searchIndex);
+
+	[writeLock unlock];
+	[readLock unlock];
+
+	[pool release];
+	return success;
+}
+
+- (BOOL) flush {
+	return [self _flushIndexIfNecessary];
+}
+
+- (NSUInteger) generation {
+	// A word sized read needs no lock, and taking the write lock here would make cache
+	// lookups wait on indexing
+	return generation;
+}
+
+- (void) close {
+
+	// A scheduled flush would find the index closed, so let it go first
+
+	[flushQueue cancelAllOperations];
+	[flushQueue waitUntilAllOperationsAreFinished];
+
+	[readLock lockForWriting];
+	[writeLock lock];
+
+	SKIndexClose(searchIndex);
+	searchIndex = NULL;
+
+	[writeLock unlock];
+	[readLock unlock];
+}
+
+#pragma mark -
+#pragma mark Searching
+
+- (id<SPSearchBackendSearch>) searchWithQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions {
+
+	SPSearchKitSearch *search = nil;
+
+	[readLock lockForReading];
+
+	SKSearchRef searchRef = SKSearchCreate(searchIndex, (CFStringRef)searchQuery, searchOptions);
+	if ( searchRef == NULL ) NSLog(@"there was a problem creating the search query");
+
+	[readLock unlock];
+
+	if ( searchRef != NULL ) {
+		search = [[[SPSearchKitSearch alloc] initWithBackend:self search:searchRef] autorelease];
+		CFRelease(searchRef);
+	}
+
+	return search;
+}
+
+- (NSArray*) topResultsForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions 
+		limit:(NSUInteger)limit ranks:(float*)outRanks {
+
+	// SearchKit has no ranked retrieval of its own and produces matches in no particular
+	// order, so every match is still found and scored. Only the best limit are kept as the
+	// chunks arrive, which saves sorting and holding on to the full result list.
+
+	NSMutableArray *documents = [NSMutableArray arrayWithCapacity:limit];
+	CFIndex i, keptCount = 0, keptLimit = (CFIndex)limit;
+	Boolean stillSearching = true;
+
+	if ( limit == 0 ) return [NSArray array];
+
+	SKDocumentID *keptIds = calloc(keptLimit, sizeof(SKDocumentID));
+	float *keptScores = calloc(keptLimit, sizeof(float));
+	SKDocumentID chunkIds[kSPSearchKitBackendTopResultsChunkSize];
+	float chunkScores[kSPSearchKitBackendTopResultsChunkSize];
+
+	[readLock lockForReading];
+
+	SKSearchRef searchRef = SKSearchCreate(searchIndex, (CFStringRef)searchQuery, searchOptions);
+	if ( searchRef == NULL ) {
+		NSLog(@"there was a problem creating the search query");
+		stillSearching = false;
+	}
+
+	while ( stillSearching ) {
+		CFIndex chunkCount = 0;
+
+		stillSearching = SKSearchFindMatches(searchRef, kSPSearchKitBackendTopResultsChunkSize, 
+				chunkIds, chunkScores, 1.0, &chunkCount);
+
+		for ( i = 0; i < chunkCount; i++ ) {
+			if ( keptCount < keptLimit ) {
+				keptIds[keptCount] = chunkIds[i];
+				keptScores[keptCount] = chunkScores[i];
+				if ( ++keptCount == keptLimit ) {
+					CFIndex j;
+					for ( j = keptLimit / 2; j >= 0; j-- ) SPSearchKitSiftDown(keptIds, keptScores, keptCount, j);
+				}
+			}
+			else if ( chunkScores[i] > keptScores[0] ) {
+				keptIds[0] = chunkIds[i];
+				keptScores[0] = chunkScores[i];
+				SPSearchKitSiftDown(keptIds, keptScores, keptCount, 0);
+			}
+		}
+	}
+
+	if ( searchRef != NULL ) CFRelease(searchRef);
+
+	// Heap sort the kept results into descending order
+
+	if ( keptCount < keptLimit ) {
+		for ( i = keptCount / 2; i >= 0; i-- ) SPSearchKitSiftDown(keptIds, keptScores, keptCount, i);
+	}
+
+	for ( i = keptCount - 1; i > 0; i-- ) {
+		SKDocumentID document = keptIds[0];
+		float score = keptScores[0];
+		keptIds[0] = keptIds[i], keptScores[0] = keptScores[i];
+		keptIds[i] = document, keptScores[i] = score;
+		SPSearchKitSiftDown(keptIds, keptScores, i, 0);
+	}
+
+	CFURLRef *documentURLs = calloc(( keptCount == 0 ? 1 : keptCount ), sizeof(CFURLRef));
+	[self _copyURLs:documentURLs forDocumentIDs:keptIds count:keptCount];
+
+	for ( i = 0; i < keptCount; i++ ) {
+		if ( documentURLs[i] == NULL ) continue;
+		if ( outRanks != NULL ) outRanks[[documents count]] = keptScores[i];
+		[documents addObject:(NSURL*)documentURLs[i]];
+		CFRelease(documentURLs[i]);
+	}
+
+	[readLock unlock];
+
+	free(documentURLs);
+	free(keptIds);
+	free(keptScores);
+
+	return [[documents copy] autorelease];
+}
+
+#pragma mark -
+#pragma mark Document Terms
+
+- (void) enumerateTermsWithPrefix:(NSString*)inPrefix 
+		usingBlock:(void (^)(NSString *term, NSUInteger documentCount, BOOL *stop))block {
+
+	// SearchKit only enumerates by term ID, so the matching terms are collected under the
+	// lock and sorted before they are handed out
+
+	NSMutableArray *terms = [NSMutableArray array];
+	NSMutableArray *counts = [NSMutableArray array];
+	NSString *prefix = ( inPrefix == nil ? @"" : inPrefix );
+	NSUInteger i, *order = NULL;
+	BOOL stop = NO;
+
+	[readLock lockForReading];
+
+	// flush the index before calling - (BOOL) writeIndexToDisk
+	CFIndex maxTermID = SKIndexGetMaximumTermID(searchIndex);
+	CFIndex aTermID;
+
+	for ( aTermID = 0; aTermID < maxTermID; aTermID++ )
+	{
+		CFIndex documentCount = SKIndexGetTermDocumentCount( searchIndex, aTermID );
+		if ( documentCount == 0 ) // may be the case if the index has not been recently flushed
+			continue;
+
+		CFStringRef aTerm = SKIndexCopyTermStringForTermID( searchIndex, aTermID );
+		if ( aTerm == NULL ) {
+			NSLog(@"%s - unable to get term for term index %ld", __PRETTY_FUNCTION__, aTermID);
+			continue;
+		}
+
+		if ( [(NSString*)aTerm hasPrefix:prefix] ) {
+			[terms addObject:(NSString*)aTerm];
+			[counts addObject:[NSNumber numberWithInteger:documentCount]];
+		}
+
+		CFRelease(aTerm);
+	}
+
+	[readLock unlock];
+
+	order = malloc(( [terms count] == 0 ? 1 : [terms count] ) * sizeof(NSUInteger));
+	for ( i = 0; i < [terms count]; i++ ) order[i] = i;
+
+	qsort_b(order, [terms count], sizeof(NSUInteger), ^int(const void *a, const void *b) {
+		return (int)[[terms objectAtIndex:*(const NSUInteger*)a] compare:[terms objectAtIndex:*(const NSUInteger*)b] 
+				options:NSLiteralSearch];
+	});
+
+	for ( i = 0; i < [terms count] && !stop; i++ )
+		block([terms objectAtIndex:order[i]], [[counts objectAtIndex:order[i]] unsignedIntegerValue], &stop);
+
+	free(order);
+}
+
+- (NSUInteger) documentCountForTerm:(NSString*)inTerm {
+
+	[readLock lockForReading];
+
+	CFIndex documentCount = 0;
+
+	// flush the index before calling - (BOOL) writeIndexToDisk
+	CFIndex aTermID = SKIndexGetTermIDForTermString( searchIndex, (CFStringRef)inTerm );
+	if ( aTermID == kCFNotFound ) goto bail;
+
+	documentCount = SKIndexGetTermDocumentCount( searchIndex, aTermID );
+
+bail:
+	[readLock unlock];
+	return documentCount;
+}
+
+- (NSArray*) documentsForTerm:(NSString*)inTerm {
+
+	[readLock lockForReading];
+
+	NSMutableArray *documents = [NSMutableArray array];
+
+	CFArrayRef documentIdsArray = NULL;
+	SKDocumentID *documentIds = NULL;
+	CFURLRef *documentURLs = NULL;
+
+	CFIndex termId = SKIndexGetTermIDForTermString( searchIndex, (CFStringRef)inTerm );
+	if ( termId == kCFNotFound ) goto bail;
+
+	CFIndex documentCount = SKIndexGetTermDocumentCount( searchIndex, termId );
+	if ( documentCount == 0 ) goto bail;
+
+	documentIdsArray = SKIndexCopyDocumentIDArrayForTermID( searchIndex, termId );
+	if ( documentIdsArray == NULL ) goto bail;
+
+	// I must convert the CFArray to a SKDocumentID * memory block.
+	// Annoying. Is there is a better process, or am I cocoa spoiled?
+
+	// I don't know why I can't use:
+	// CFArrayGetValues(documentIdsArray, CFRangeMake(0,docIdCount), (const void **)documentIds);
+
+	CFIndex docIdCount = CFArrayGetCount(documentIdsArray);
+
+	documentIds = calloc( docIdCount, sizeof(SKDocumentID) );
+	documentURLs = calloc( docIdCount, sizeof(CFURLRef) );
+
+	NSInteger i, x = 0;
+	for ( i = 0; i < docIdCount; i++ ) {
+		SKDocumentID aDocumentId;
+		const void * value = CFArrayGetValueAtIndex(documentIdsArray,i);
+		if ( CFNumberGetValue( (CFNumberRef)value, kCFNumberSInt32Type, &aDocumentId ) ) {
+			documentIds[x++] = aDocumentId;
+		}
+	}
+
+	[self _copyURLs:documentURLs forDocumentIDs:documentIds count:x];
+
+		// On input, a pointer to an array for document URLs (CFURL objects). On output, points to the
+		// previously allocated array, which now contains document URLs corresponding to the document IDs
+		// in inDocumentIDArray. When finished with the document URL array, dispose of it by calling
+		// CFRelease on each array element.
+
+
+	for ( i = 0; i < x; i++ ) {
+		if ( documentURLs[i] == NULL ) continue;
+		[documents addObject:(NSURL*)documentURLs[i]];
+		CFRelease(documentURLs[i]);
+	}
+
+bail:
+	if ( documentIdsArray ) CFRelease(documentIdsArray);
+	if ( documentURLs ) free(documentURLs);
+	if ( documentIds ) free(documentIds);
+	[readLock unlock];
+	return documents;
+}
+
+#pragma mark -
+
+- (NSUInteger) termCountForDocument:(NSURL*)inDocumentURI {
+	return [self termCountForDocumentID:[self documentIDForDocument:inDocumentURI]];
+}
+
+- (NSArray*) termsForDocument:(NSURL*)inDocumentURI {
+	return [self termsForDocumentID:[self documentIDForDocument:inDocumentURI]];
+}
+
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocument:(NSURL*)inDocumentURI {
+	return [self frequencyOfTerm:inTerm inDocumentID:[self documentIDForDocument:inDocumentURI]];
+}
+
+#pragma mark -
+
+- (NSIndexSet*) documentIDsForTerm:(NSString*)inTerm {
+
+	[readLock lockForReading];
+
+	NSMutableIndexSet *documents = [NSMutableIndexSet indexSet];
+	CFArrayRef documentIdsArray = NULL;
+
+	CFIndex termId = SKIndexGetTermIDForTermString( searchIndex, (CFStringRef)inTerm );
+	if ( termId == kCFNotFound ) goto bail;
+
+	documentIdsArray = SKIndexCopyDocumentIDArrayForTermID( searchIndex, termId );
+	if ( documentIdsArray == NULL ) goto bail;
+
+	CFIndex i, docIdCount = CFArrayGetCount(documentIdsArray);
+
+	for ( i = 0; i < docIdCount; i++ ) {
+		SKDocumentID aDocumentId;
+		const void * value = CFArrayGetValueAtIndex(documentIdsArray,i);
+		if ( CFNumberGetValue( (CFNumberRef)value, kCFNumberSInt32Type, &aDocumentId ) ) {
+			[documents addIndex:(NSUInteger)aDocumentId];
+		}
+	}
+
+bail:
+	if ( documentIdsArray ) CFRelease(documentIdsArray);
+	[readLock unlock];
+	return documents;
+}
+
+- (NSUInteger) termCountForDocumentID:(NSInteger)inDocumentID {
+
+	if ( inDocumentID == NSNotFound ) return 0;
+
+	[readLock lockForReading];
+	CFIndex termCount = SKIndexGetDocumentTermCount(searchIndex, (SKDocumentID)inDocumentID);
+	[readLock unlock];
+
+	return termCount;
+}
+
+- (NSArray*) termsForDocumentID:(NSInteger)inDocumentID {
+
+	if ( inDocumentID == NSNotFound ) return [NSArray array];
+
+	[readLock lockForReading];
+
+	NSMutableSet *documentTerms = [NSMutableSet set];
+
+	CFArrayRef termIds = SKIndexCopyTermIDArrayForDocumentID( searchIndex, (SKDocumentID)inDocumentID );
+	if ( termIds == NULL ) goto bail;
+
+	// convert the termIds to actual terms, by way of these annoying get values method again
+
+	CFIndex termCount = CFArrayGetCount(termIds);
+	NSInteger i;
+
+	for ( i = 0; i < termCount; i++ ) {
+
+		CFNumberRef aNumberRef = CFArrayGetValueAtIndex(termIds,i);
+		CFIndex aTermId;
+
+		if ( !CFNumberGetValue( aNumberRef, kCFNumberSInt32Type, &aTermId) )
+			continue;
+
+		CFIndex documentCount = SKIndexGetTermDocumentCount( searchIndex, aTermId );
+		if ( documentCount == 0 ) // if the index has not been compacted
+			continue;
+
+		CFStringRef aTerm = SKIndexCopyTermStringForTermID( searchIndex, aTermId );
+		if ( aTerm == NULL )
+			continue;
+
+		[documentTerms addObject:(NSString*)aTerm];
+		CFRelease(aTerm);
+	}
+
+bail:
+	if ( termIds ) CFRelease(termIds);
+	[readLock unlock];
+
+	NSArray *termsArray = [documentTerms allObjects];
+	return termsArray;
+}
+
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocumentID:(NSInteger)inDocumentID {
+
+	if ( inDocumentID == NSNotFound ) return 0;
+
+	[readLock lockForReading];
+
+	CFIndex termCount = 0;
+
+	CFIndex termId = SKIndexGetTermIDForTermString( searchIndex, (CFStringRef)inTerm );
+	if ( termId == kCFNotFound ) goto bail;
+
+	termCount = SKIndexGetDocumentTermFrequency( searchIndex, (SKDocumentID)inDocumentID, termId);
+
+bail:
+	[readLock unlock];
+	return termCount;
+}
+
+#pragma mark -
+#pragma mark Document Table
+
+- (SKDocumentID) _documentIDForURL:(NSURL*)inDocumentURI {
+
+	// Looks in the document table first. A document that is not there, typically because
+	// it was indexed before the index was opened, is looked up through SearchKit once and
+	// interned, so that the next lookup is a hash away. Called with either lock held.
+
+	UInt8 buffer[kSPSearchKitBackendURIBufferSize];
+	CFIndex length = SPSearchKitBackendGetURIBytes(inDocumentURI, buffer);
+	SKDocumentID documentId = kCFNotFound;
+
+	if ( length > 0 ) {
+		int32_t document = SPDocumentTableGetDocument(documentTable, (const char*)buffer, length);
+		if ( document != kSPDocumentTableNotFound ) return (SKDocumentID)document;
+	}
+
+	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
+	if ( document == NULL ) return kCFNotFound;
+
+	documentId = SKIndexGetDocumentID(searchIndex, document);
+	CFRelease(document);
+
+	if ( documentId != kCFNotFound && length > 0 ) 
+		SPDocumentTableSetDocument(documentTable, (const char*)buffer, length, (int32_t)documentId);
+
+	return documentId;
+}
+
+- (void) _internDocument:(SKDocumentRef)document URL:(NSURL*)inDocumentURI {
+
+	// Called with the write lock held once document has been added
+
+	UInt8 buffer[kSPSearchKitBackendURIBufferSize];
+	CFIndex length = SPSearchKitBackendGetURIBytes(inDocumentURI, buffer);
+	if ( length == 0 ) return;
+
+	SKDocumentID documentId = SKIndexGetDocumentID(searchIndex, document);
+	if ( documentId != kCFNotFound ) 
+		SPDocumentTableSetDocument(documentTable, (const char*)buffer, length, (int32_t)documentId);
+}
+
+- (void) _copyURLs:(CFURLRef*)outURLs forDocumentIDs:(SKDocumentID*)documentIds count:(CFIndex)count {
+
+	// Behaves like SKIndexCopyDocumentURLsForDocumentIDs, which is only asked for the
+	// documents the table does not know yet. Their URLs are interned on the way out.
+	// Called with the read lock held.
+
+	UInt8 buffer[kSPSearchKitBackendURIBufferSize];
+	SKDocumentID *missingIds = NULL;
+	CFIndex *missingIndexes = NULL;
+	CFURLRef *missingURLs = NULL;
+	CFIndex i, missingCount = 0;
+
+	memset(outURLs, 0, count * sizeof(CFURLRef));
+
+	for ( i = 0; i < count; i++ ) {
+		size_t length = SPDocumentTableGetURI(documentTable, (int32_t)documentIds[i], (char*)buffer, 
+				kSPSearchKitBackendURIBufferSize);
+
+		if ( length > 0 && length <= kSPSearchKitBackendURIBufferSize ) 
+			outURLs[i] = CFURLCreateWithBytes(kCFAllocatorDefault, buffer, length, kCFStringEncodingUTF8, NULL);
+		if ( outURLs[i] != NULL ) continue;
+
+		if ( missingIds == NULL ) {
+			missingIds = malloc(count * sizeof(SKDocumentID));
+			missingIndexes = malloc(count * sizeof(CFIndex));
+			if ( missingIds == NULL || missingIndexes == NULL ) goto bail;
+		}
+
+		missingIds[missingCount] = documentIds[i];
+		missingIndexes[missingCount] = i;
+		missingCount++;
+	}
+
+	if ( missingCount == 0 ) goto bail;
+
+	missingURLs = calloc(missingCount, sizeof(CFURLRef));
+	if ( missingURLs == NULL ) goto bail;
+
+	SKIndexCopyDocumentURLsForDocumentIDs(searchIndex, missingCount, missingIds, missingURLs);
+
+	for ( i = 0; i < missingCount; i++ ) {
+		outURLs[missingIndexes[i]] = missingURLs[i];
+		if ( missingURLs[i] == NULL ) continue;
+
+		CFIndex length = SPSearchKitBackendGetURIBytes((NSURL*)missingURLs[i], buffer);
+		if ( length > 0 ) SPDocumentTableSetDocument(documentTable, (const char*)buffer, length, (int32_t)missingIds[i]);
+	}
+
+bail:
+	free(missingURLs);
+	free(missingIndexes);
+	free(missingIds);
+}
+
+#pragma mark -
+#pragma mark Utilities
+
+- (void) _incrementChangeCount {
+	// called with the write lock held
+	changeCount++;
+	generation++;
+	[self _scheduleFlush];
+}
+
+- (void) _scheduleFlush {
+
+	// Docs: "Before searching an index, always call SKIndexFlush, even though the flush process may 
+	// take up to several seconds." Rather than have the first search after a change pay for the flush,
+	// changes are flushed on a background queue refreshInterval seconds after they are made. Readers
+	// search whatever was last flushed and never wait. Called with the write lock held.
+
+	if ( flushScheduled )
+		return;
+
+	flushScheduled = YES;
+	NSTimeInterval interval = refreshInterval;
+
+	[flushQueue addOperationWithBlock:^{
+		if ( interval > 0 ) [NSThread sleepForTimeInterval:interval];
+
+		[writeLock lock];
+		flushScheduled = NO;
+		[writeLock unlock];
+
+		[self _flushIndexIfNecessary];
+	}];
+}
+
+- (BOOL) _flushIndexIfNecessary {
+
+	BOOL success = YES;
+	[writeLock lock];
+
+	if ( changeCount > 0 && searchIndex != NULL ) {
+		SPStatisticsStart(started);
+		SPStatisticsCount(kSPStatisticFlushChanges, changeCount);
+		
+		success = SKIndexFlush(searchIndex);
+		SPStatisticsStop(kSPStatisticFlush, started);
+		
+		if ( success ) changeCount = 0;
+		
+		// Searches only see a change once it is flushed, so results cached between the change
+		// and the flush belong to the old contents
+		
+		if ( success ) generation++;
+	}
+
+	[writeLock unlock];
+
+	return success;
+}
+
+@end
+
+#pragma mark -
+
+@implementation SPSearchKitSearch
+
+- (id) initWithBackend:(SPSearchKitBackend*)inBackend search:(SKSearchRef)inSearch {
+	if ( self = [super init] ) {
+		backend = [inBackend retain];
+		search = (SKSearchRef)CFRetain(inSearch);
+	}
+	return self;
+}
+
+- (void) dealloc {
+	if ( search ) {
+		SKSearchCancel(search);
+		CFRelease(search);
+		search = NULL;
+	}
+	[backend release], backend = nil;
+	[super dealloc];
+}
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float*)outRanks
+		maxTime:(NSTimeInterval)maxTime maxCount:(NSInteger)maxCount {
+
+	// outRanks should contain enough memory to hold maxCount floats
+
+	CFTimeInterval kMaxTime = (CFTimeInterval)maxTime;
+	CFIndex kMaxCount = (CFIndex)maxCount;
+
+	NSMutableArray *documents = [NSMutableArray array];
+	BOOL stillSearching = YES;
+	NSInteger i;
+
+	[backend.readLock lockForReading];
+
+	float *documentScores = ( outRanks == NULL ? NULL : calloc(kMaxCount,sizeof(float)) );
+	SKDocumentID *documentIds = calloc(kMaxCount,sizeof(SKDocumentID));
+	CFURLRef *documentURLs = NULL;
+	CFIndex documentCount = 0;
+
+	stillSearching = SKSearchFindMatches(search, kMaxCount, documentIds,
+			documentScores, kMaxTime, &documentCount);
+
+	documentURLs = calloc(( documentCount == 0 ? 1 : documentCount ), sizeof(CFURLRef));
+
+	[backend _copyURLs:documentURLs forDocumentIDs:documentIds count:documentCount];
+
+	for ( i = 0; i < documentCount; i++ ) {
+		if ( documentURLs[i] == NULL ) continue;
+		if ( outRanks != NULL ) outRanks[[documents count]] = documentScores[i];
+		[documents addObject:(NSURL*)documentURLs[i]];
+		CFRelease(documentURLs[i]);
+	}
+
+	free(documentScores);
+	free(documentURLs);
+	free(documentIds);
+
+	*outDocuments = [[documents copy] autorelease];
+	[backend.readLock unlock];
+	return stillSearching;
+}
+
+- (void) cancel {
+	SKSearchCancel(search);
+}
+
+@end
+
+#endif
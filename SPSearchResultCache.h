@@ -0,0 +1,110 @@
+//
+//  SPSearchResultCache.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import <Foundation/Foundation.h>
+#import "SPSearchBackend.h"
+
+// A bounded, least recently used cache of complete search results. Entries are keyed on
+// the query and its options and stamped with the backend's generation. An entry from an
+// older generation is dropped the first time it is looked up, so a cached search always
+// returns exactly what a new search against the backend would.
+
+// SPSearchStore consults its cache whenever it creates a search session. A miss wraps the
+// backend search so that its results are recorded as they are fetched. They are cached
+// once the search runs to completion; cancelled searches are not cached.
+
+// The cache is thread safe.
+
+#define kSPSearchResultCacheDefaultCountLimit	256
+#define kSPSearchResultCacheDefaultMemoryLimit	(16*1024*1024)
+
+@class SPSearchResultCacheEntry;
+
+@interface SPSearchResultCache : NSObject {
+	
+	NSMutableDictionary *entries;
+	SPSearchResultCacheEntry *newestEntry;
+	SPSearchResultCacheEntry *oldestEntry;
+	
+	NSUInteger countLimit;
+	NSUInteger memoryLimit;
+	NSUInteger memorySize;
+	
+	NSUInteger hitCount;
+	NSUInteger missCount;
+	NSUInteger evictionCount;
+	NSUInteger invalidationCount;
+}
+
+@property (readwrite) NSUInteger countLimit;
+@property (readwrite) NSUInteger memoryLimit;
+
+	// The maximum number of searches and an estimate of the bytes their results may occupy.
+	// Least recently used searches are evicted to stay within both. Lowering a limit evicts
+	// immediately.
+
+@property (readonly) NSUInteger count;
+@property (readonly) NSUInteger memorySize;
+
+@property (readonly) NSUInteger hitCount;
+@property (readonly) NSUInteger missCount;
+@property (readonly) NSUInteger evictionCount;
+@property (readonly) NSUInteger invalidationCount;
+
+	// Lookups served from and missing the cache, entries evicted to make room and entries
+	// dropped because the index had changed since they were cached. Invalidated lookups
+	// also count as misses.
+
+- (id) initWithCountLimit:(NSUInteger)inCountLimit memoryLimit:(NSUInteger)inMemoryLimit;
+
+- (id<SPSearchBackendSearch>) searchForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions 
+		generation:(NSUInteger)generation;
+
+	// Returns an autoreleased search which serves the cached results, or nil on a miss.
+
+- (id<SPSearchBackendSearch>) searchCachingResultsOf:(id<SPSearchBackendSearch>)inSearch 
+		query:(NSString*)searchQuery options:(SKSearchOptions)searchOptions generation:(NSUInteger)generation;
+
+	// Wraps a backend search made at generation, which must have been read before the search
+	// was created. The results are cached if the wrapper is fetched until it returns NO.
+
+- (void) removeAllResults;
+- (void) resetStatistics;
+
+@end
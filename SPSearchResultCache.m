@@ -0,0 +1,510 @@
+//
+//  SPSearchResultCache.m
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPSearchResultCache.h"
+
+// The estimated cost of a cached document beyond its URL string: the URL object itself,
+// the array slot pointing to it and its rank.
+
+#define kSPSearchResultCacheDocumentOverhead (64 + sizeof(id) + sizeof(float))
+
+static NSString * SPSearchResultCacheKey(NSString *searchQuery, SKSearchOptions searchOptions) {
+	return [NSString stringWithFormat:@"%u %@", (unsigned int)searchOptions, searchQuery];
+}
+
+#pragma mark -
+
+@interface SPSearchResultCacheEntry : NSObject {
+@public
+	NSString *key;
+	NSUInteger generation;
+	
+	NSArray *documents;
+	float *ranks;
+	NSUInteger cost;
+	
+	SPSearchResultCacheEntry *previous;	// newer, not retained
+	SPSearchResultCacheEntry *next;		// older, not retained
+}
+
+- (id) initWithKey:(NSString*)inKey generation:(NSUInteger)inGeneration 
+		documents:(NSArray*)inDocuments ranks:(float*)inRanks;
+
+	// Takes ownership of inRanks, which holds a rank for every document.
+
+@end
+
+#pragma mark -
+
+@interface SPCachedSearch : NSObject <SPSearchBackendSearch> {
+	SPSearchResultCacheEntry *entry;
+	NSUInteger location;
+	BOOL cancelled;
+}
+
+- (id) initWithEntry:(SPSearchResultCacheEntry*)inEntry;
+
+@end
+
+#pragma mark -
+
+@interface SPCachingSearch : NSObject <SPSearchBackendSearch> {
+	id<SPSearchBackendSearch> search;
+	SPSearchResultCache *cache;
+	
+	NSString *key;
+	NSUInteger generation;
+	
+	NSMutableArray *documents;
+	float *ranks;
+	BOOL failed;
+	BOOL finished;
+	BOOL cancelled;
+}
+
+- (id) initWithSearch:(id<SPSearchBackendSearch>)inSearch cache:(SPSearchResultCache*)inCache 
+		key:(NSString*)inKey generation:(NSUInteger)inGeneration;
+
+@end
+
+#pragma mark -
+
+@interface SPSearchResultCache()
+
+- (void) _cacheEntry:(SPSearchResultCacheEntry*)entry;
+- (void) _addEntry:(SPSearchResultCacheEntry*)entry;
+- (void) _removeEntry:(SPSearchResultCacheEntry*)entry;
+- (void) _trimToCountLimit:(NSUInteger)inCountLimit memoryLimit:(NSUInteger)inMemoryLimit;
+
+@end
+
+#pragma mark -
+
+@implementation SPSearchResultCache
+
+- (id) init {
+	return [self initWithCountLimit:kSPSearchResultCacheDefaultCountLimit 
+			memoryLimit:kSPSearchResultCacheDefaultMemoryLimit];
+}
+
+- (id) initWithCountLimit:(NSUInteger)inCountLimit memoryLimit:(NSUInteger)inMemoryLimit {
+	if ( self = [super init] ) {
+		entries = [[NSMutableDictionary alloc] init];
+		countLimit = inCountLimit;
+		memoryLimit = inMemoryLimit;
+	}
+	return self;
+}
+
+- (void) dealloc {
+	
+	// entries holds the only references to the list
+	
+	newestEntry = nil;
+	oldestEntry = nil;
+	[entries release], entries = nil;
+	
+	[super dealloc];
+}
+
+#pragma mark -
+
+- (NSUInteger) countLimit {
+	@synchronized(self) {
+		return countLimit;
+	}
+}
+
+- (void) setCountLimit:(NSUInteger)inCountLimit {
+	@synchronized(self) {
+		countLimit = inCountLimit;
+		[self _trimToCountLimit:countLimit memoryLimit:memoryLimit];
+	}
+}
+
+- (NSUInteger) memoryLimit {
+	@synchronized(self) {
+		return memoryLimit;
+	}
+}
+
+- (void) setMemoryLimit:(NSUInteger)inMemoryLimit {
+	@synchronized(self) {
+		memoryLimit = inMemoryLimit;
+		[self _trimToCountLimit:countLimit memoryLimit:memoryLimit];
+	}
+}
+
+- (NSUInteger) count {
+	@synchronized(self) {
+		return [entries count];
+	}
+}
+
+- (NSUInteger) memorySize {
+	@synchronized(self) {
+		return memorySize;
+	}
+}
+
+- (NSUInteger) hitCount {
+	@synchronized(self) {
+		return hitCount;
+	}
+}
+
+- (NSUInteger) missCount {
+	@synchronized(self) {
+		return missCount;
+	}
+}
+
+- (NSUInteger) evictionCount {
+	@synchronized(self) {
+		return evictionCount;
+	}
+}
+
+- (NSUInteger) invalidationCount {
+	@synchronized(self) {
+		return invalidationCount;
+	}
+}
+
+#pragma mark -
+
+- (id<SPSearchBackendSearch>) searchForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions 
+		generation:(NSUInteger)generation {
+	
+	NSAssert( searchQuery!=nil, @"searchQuery must not be nil");
+	
+	NSString *key = SPSearchResultCacheKey(searchQuery, searchOptions);
+	SPSearchResultCacheEntry *entry = nil;
+	
+	@synchronized(self) {
+		
+		entry = [entries objectForKey:key];
+		
+		if ( entry != nil && entry->generation != generation ) {
+			[self _removeEntry:entry];
+			invalidationCount++;
+			entry = nil;
+		}
+		
+		if ( entry == nil ) {
+			missCount++;
+			return nil;
+		}
+		
+		// move the entry to the front of the list
+		
+		[entry retain];
+		[self _removeEntry:entry];
+		[self _addEntry:entry];
+		[entry release];
+		
+		hitCount++;
+	}
+	
+	return [[[SPCachedSearch alloc] initWithEntry:entry] autorelease];
+}
+
+- (id<SPSearchBackendSearch>) searchCachingResultsOf:(id<SPSearchBackendSearch>)inSearch 
+		query:(NSString*)searchQuery options:(SKSearchOptions)searchOptions generation:(NSUInteger)generation {
+	
+	NSAssert( inSearch!=nil, @"inSearch must not be nil");
+	NSAssert( searchQuery!=nil, @"searchQuery must not be nil");
+	
+	return [[[SPCachingSearch alloc] initWithSearch:inSearch 
+			cache:self 
+			key:SPSearchResultCacheKey(searchQuery, searchOptions) 
+			generation:generation] autorelease];
+}
+
+- (void) removeAllResults {
+	@synchronized(self) {
+		[self _trimToCountLimit:0 memoryLimit:0];
+	}
+}
+
+- (void) resetStatistics {
+	@synchronized(self) {
+		hitCount = 0;
+		missCount = 0;
+		evictionCount = 0;
+		invalidationCount = 0;
+	}
+}
+
+#pragma mark -
+
+- (void) _cacheEntry:(SPSearchResultCacheEntry*)entry {
+	
+	@synchronized(self) {
+		
+		SPSearchResultCacheEntry *existing = [entries objectForKey:entry->key];
+		
+		// A search which finishes late must not replace the results of a newer generation
+		
+		if ( existing != nil && existing->generation > entry->generation )
+			return;
+		
+		if ( entry->cost > memoryLimit || countLimit == 0 )
+			return;
+		
+		if ( existing != nil ) [self _removeEntry:existing];
+		[self _addEntry:entry];
+		
+		[self _trimToCountLimit:countLimit memoryLimit:memoryLimit];
+	}
+}
+
+- (void) _addEntry:(SPSearchResultCacheEntry*)entry {
+	
+	// Adds the entry as the newest. Called while synchronized
+	
+	[entries setObject:entry forKey:entry->key];
+	
+	entry->previous = nil;
+	entry->next = newestEntry;
+	
+	if ( newestEntry != nil ) newestEntry->previous = entry;
+	newestEntry = entry;
+	if ( oldestEntry == nil ) oldestEntry = entry;
+	
+	memorySize += entry->cost;
+}
+
+- (void) _removeEntry:(SPSearchResultCacheEntry*)entry {
+	
+	// Unlinks the entry, which may be released as a result. Called while synchronized
+	
+	if ( entry->previous != nil ) entry->previous->next = entry->next;
+	else newestEntry = entry->next;
+	
+	if ( entry->next != nil ) entry->next->previous = entry->previous;
+	else oldestEntry = entry->previous;
+	
+	entry->previous = nil;
+	entry->next = nil;
+	
+	memorySize -= entry->cost;
+	[entries removeObjectForKey:entry->key];
+}
+
+- (void) _trimToCountLimit:(NSUInteger)inCountLimit memoryLimit:(NSUInteger)inMemoryLimit {
+	
+	// Evicts the oldest entries until both limits are met. Called while synchronized
+	
+	while ( oldestEntry != nil && ( [entries count] > inCountLimit || memorySize > inMemoryLimit ) ) {
+		[self _removeEntry:oldestEntry];
+		evictionCount++;
+	}
+}
+
+@end
+
+#pragma mark -
+
+@implementation SPSearchResultCacheEntry
+
+- (id) initWithKey:(NSString*)inKey generation:(NSUInteger)inGeneration 
+		documents:(NSArray*)inDocuments ranks:(float*)inRanks {
+	
+	if ( self = [super init] ) {
+		
+		key = [inKey copy];
+		generation = inGeneration;
+		documents = [inDocuments copy];
+		ranks = inRanks;
+		
+		cost = [key length];
+		
+		for ( NSURL *aURL in documents ) {
+			cost += kSPSearchResultCacheDocumentOverhead + [[aURL absoluteString] length];
+		}
+	}
+	return self;
+}
+
+- (void) dealloc {
+	[key release], key = nil;
+	[documents release], documents = nil;
+	if ( ranks ) free(ranks), ranks = NULL;
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation SPCachedSearch
+
+- (id) initWithEntry:(SPSearchResultCacheEntry*)inEntry {
+	if ( self = [super init] ) {
+		// the entry may be evicted while the search is being fetched
+		entry = [inEntry retain];
+		location = 0;
+	}
+	return self;
+}
+
+- (void) dealloc {
+	[entry release], entry = nil;
+	[super dealloc];
+}
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float*)outRanks 
+		maxTime:(NSTimeInterval)maxTime maxCount:(NSInteger)maxCount {
+	
+	// The results are already at hand, so maxTime does not apply
+	
+	NSUInteger count = [entry->documents count];
+	NSUInteger length = 0;
+	BOOL isCancelled = NO;
+	
+	@synchronized(self) {
+		isCancelled = cancelled;
+	}
+	
+	if ( !isCancelled && location < count )
+		length = MIN((NSUInteger)MAX(maxCount, 0), count - location);
+	
+	*outDocuments = [entry->documents subarrayWithRange:NSMakeRange(location, length)];
+	if ( outRanks != NULL && length > 0 ) memcpy(outRanks, entry->ranks + location, length*sizeof(float));
+	
+	location += length;
+	return ( !isCancelled && location < count );
+}
+
+- (void) cancel {
+	@synchronized(self) {
+		cancelled = YES;
+	}
+}
+
+@end
+
+#pragma mark -
+
+@implementation SPCachingSearch
+
+- (id) initWithSearch:(id<SPSearchBackendSearch>)inSearch cache:(SPSearchResultCache*)inCache 
+		key:(NSString*)inKey generation:(NSUInteger)inGeneration {
+	
+	if ( self = [super init] ) {
+		search = [inSearch retain];
+		cache = [inCache retain];
+		key = [inKey copy];
+		generation = inGeneration;
+		documents = [[NSMutableArray alloc] init];
+	}
+	return self;
+}
+
+- (void) dealloc {
+	[search release], search = nil;
+	[cache release], cache = nil;
+	[key release], key = nil;
+	[documents release], documents = nil;
+	if ( ranks ) free(ranks), ranks = NULL;
+	[super dealloc];
+}
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float*)outRanks 
+		maxTime:(NSTimeInterval)maxTime maxCount:(NSInteger)maxCount {
+	
+	// Ranks are always fetched, whether or not the caller wants them, so that the cached
+	// results can serve any later caller
+	
+	float *localRanks = ( outRanks != NULL ? outRanks : calloc(MAX(maxCount, 1), sizeof(float)) );
+	NSArray *localDocuments = nil;
+	NSUInteger previousCount = [documents count];
+	NSUInteger localCount = 0;
+	BOOL isCancelled = NO;
+	
+	BOOL stillSearching = [search fetchResults:&localDocuments ranks:localRanks maxTime:maxTime maxCount:maxCount];
+	localCount = [localDocuments count];
+	
+	@synchronized(self) {
+		isCancelled = cancelled;
+	}
+	
+	if ( !failed && !finished && localRanks != NULL ) {
+		float *grown = realloc(ranks, MAX(previousCount + localCount, 1)*sizeof(float));
+		if ( grown != NULL ) {
+			ranks = grown;
+			memcpy(ranks + previousCount, localRanks, localCount*sizeof(float));
+			[documents addObjectsFromArray:localDocuments];
+		}
+		else {
+			failed = YES;
+		}
+	}
+	else {
+		failed = YES;
+	}
+	
+	if ( !stillSearching && !isCancelled && !failed && !finished ) {
+		
+		SPSearchResultCacheEntry *entry = [[SPSearchResultCacheEntry alloc] initWithKey:key 
+				generation:generation 
+				documents:documents 
+				ranks:ranks];
+		
+		ranks = NULL; // owned by the entry
+		[cache _cacheEntry:entry];
+		[entry release];
+	}
+	
+	if ( !stillSearching ) finished = YES;
+	if ( localRanks != outRanks ) free(localRanks);
+	
+	*outDocuments = localDocuments;
+	return stillSearching;
+}
+
+- (void) cancel {
+	@synchronized(self) {
+		cancelled = YES;
+	}
+	[search cancel];
+}
+
+@end
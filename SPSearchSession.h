@@ -0,0 +1,84 @@
+//
+//  SPSearchSession.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import <Foundation/Foundation.h>
+#import "SPSearchBackend.h"
+
+// A single search against a store. Sessions are independent of one another: any number
+// may be open at once, on any number of threads, and cancelling or exhausting one has no
+// effect on the others. Create a session with -[SPSearchStore searchSessionForQuery:options:].
+
+// A session keeps its backend alive until it is released. The results are those of the
+// index at the time the session was created, although documents removed in the meantime
+// are not returned.
+
+@interface SPSearchSession : NSObject {
+	
+	id<SPSearchBackendSearch> search;
+	
+	NSString *query;
+	SKSearchOptions options;
+	
+	NSTimeInterval fetchTime;
+	NSInteger fetchCount;
+}
+
+@property (readonly,copy) NSString *query;
+@property (readonly) SKSearchOptions options;
+
+@property (readwrite) NSTimeInterval fetchTime;
+@property (readwrite) NSInteger fetchCount;
+
+	// Equivalent to the store's properties of the same name, from which they are copied
+	// when the session is created.
+
+- (id) initWithSearch:(id<SPSearchBackendSearch>)inSearch query:(NSString*)inQuery options:(SKSearchOptions)inOptions;
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float**)outRanks untilFinished:(BOOL)untilComplete;
+- (BOOL) fetchResults:(NSArray**)outDocuments ranksArray:(NSArray**)outRanks untilFinished:(BOOL)untilComplete;
+
+	// Behave exactly like SPSearchStore's fetch methods. Once a fetch returns NO the session
+	// is finished and further fetches return an empty array.
+
+- (BOOL) isStillSearching;
+- (void) cancel;
+
+	// It is safe to cancel a session from another thread while it is being fetched.
+
+@end
@@ -0,0 +1,220 @@
+//
+//  SPSearchSession.m
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPSearchSession.h"
+#include "SPStatistics.h"
+
+@interface SPSearchSession()
+
+@property (readwrite,copy) NSString *query;
+@property (readwrite) SKSearchOptions options;
+
+- (id<SPSearchBackendSearch>) _search;
+
+@end
+
+#pragma mark -
+
+@implementation SPSearchSession
+
+@synthesize query;
+@synthesize options;
+
+@synthesize fetchTime;
+@synthesize fetchCount;
+
+- (id) initWithSearch:(id<SPSearchBackendSearch>)inSearch query:(NSString*)inQuery options:(SKSearchOptions)inOptions {
+	
+	NSAssert( inSearch!=nil, @"inSearch must not be nil");
+	
+	if ( self = [super init] ) {
+		
+		search = [inSearch retain];
+		
+		self.query = inQuery;
+		self.options = inOptions;
+		
+		self.fetchTime = 0.5;
+		self.fetchCount = 100;
+	}
+	return self;
+}
+
+- (void) dealloc {
+	
+	[search cancel];
+	[search release], search = nil;
+	
+	self.query = nil;
+	
+	[super dealloc];
+}
+
+#pragma mark -
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranksArray:(NSArray**)outRanks untilFinished:(BOOL)untilComplete {
+	
+	// Convenience method to use NSArray for outRanks. May be slower due to Obj-C overhead.
+	
+	float * ranks = NULL;
+	
+	BOOL complete = [self fetchResults:outDocuments ranks:(outRanks==NULL?NULL:&ranks) untilFinished:untilComplete];
+	
+	if ( outRanks != NULL && ranks != NULL ) {
+		
+		NSUInteger count = [*outDocuments count];
+		NSMutableArray *allRanks = [NSMutableArray arrayWithCapacity:count];
+		NSInteger i;
+		
+		for ( i = 0; i < count; i++ ) {
+			[allRanks addObject:[NSNumber numberWithFloat:ranks[i] ]];
+		}
+		
+		*outRanks = [[allRanks copy] autorelease];
+		free(ranks);
+	}
+	
+	return complete;
+}
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float**)outRanks untilFinished:(BOOL)untilComplete {
+	
+	NSAssert( outDocuments!=NULL, @"outDocuments must not be nil");
+	
+	// Hold our own reference to the search so that a cancel on another thread cannot
+	// release it out from under us
+	
+	id<SPSearchBackendSearch> aSearch = [self _search];
+	BOOL stillSearching = ( aSearch != nil );
+	NSUInteger chunks = 0;
+	
+	SPStatisticsStart(started);
+	
+	if ( aSearch == nil ) {
+		*outDocuments = [NSArray array];
+		if ( outRanks != NULL ) *outRanks = NULL;
+	}
+	else if ( untilComplete ) {
+		// fetch the results as many times as is necessary until we have acquired all of it
+		NSMutableArray *allDocuments = [NSMutableArray array];
+		float * allRanks = NULL;
+		NSInteger count = 0;
+		NSInteger i;
+		
+		while ( stillSearching ) {
+		
+			NSArray * localResults = nil;
+			float * localRanks = (outRanks==NULL ? NULL : calloc(self.fetchCount,sizeof(float)) );
+			NSInteger localCount = 0;
+			
+			stillSearching = [aSearch fetchResults:&localResults ranks:localRanks 
+					maxTime:self.fetchTime 
+					maxCount:self.fetchCount];
+			chunks++;
+			
+			localCount = [localResults count];
+			count += localCount;
+			
+			[allDocuments addObjectsFromArray:localResults];
+			if ( outRanks != NULL ) { // I need to keep a growing track of the ranks
+				allRanks = reallocf( allRanks, count*sizeof(float) );
+				if ( allRanks != NULL ) {
+					for ( i = 0; i < localCount; i++ ) {
+						allRanks[i+count-localCount] = localRanks[i];
+					}
+				}
+				
+				free(localRanks);
+				localRanks = NULL;
+			}
+		}
+		
+		*outDocuments = [[allDocuments copy] autorelease];
+		if ( outRanks != NULL ) *outRanks = allRanks; // caller must free
+	}
+	else {
+		// perform once, simply passing in the parameters we are given
+		
+		float * localRanks = (outRanks==NULL ? NULL : calloc(self.fetchCount,sizeof(float)) );
+		
+		stillSearching = [aSearch fetchResults:outDocuments ranks:localRanks 
+				maxTime:self.fetchTime 
+				maxCount:self.fetchCount];
+		chunks++;
+				
+		if ( outRanks != NULL ) *outRanks = localRanks;
+	}
+	
+	SPStatisticsStop(kSPStatisticFetch, started);
+	SPStatisticsCount(kSPStatisticFetchChunks, chunks);
+	
+	if ( stillSearching == NO )
+		[self cancel];
+	
+	return stillSearching;
+}
+
+#pragma mark -
+
+- (BOOL) isStillSearching {
+	return ( [self _search] != nil );
+}
+
+- (void) cancel {
+	
+	id<SPSearchBackendSearch> aSearch = nil;
+	
+	@synchronized(self) {
+		aSearch = search;
+		search = nil;
+	}
+	
+	[aSearch cancel];
+	[aSearch release];
+}
+
+- (id<SPSearchBackendSearch>) _search {
+	id<SPSearchBackendSearch> aSearch = nil;
+	@synchronized(self) {
+		aSearch = [[search retain] autorelease];
+	}
+	return aSearch;
+}
+
+@end
@@ -37,32 +37,56 @@
 	For non-attribution licensing options refer to http://phildow.net/licensing/
 */
 
-#import <Cocoa/Cocoa.h>
-#import <CoreServices/CoreServices.h>
+#import <Foundation/Foundation.h>
+#import "SPSearchBackend.h"
+#import "SPSearchSession.h"
+#import "SPSearchResultCache.h"
 
 // Be sure to link to Core/Services
 
+extern NSString * const kSPSearchStoreIngestDocumentCount;
+extern NSString * const kSPSearchStoreIngestByteCount;
+extern NSString * const kSPSearchStoreIngestElapsedTime;
+extern NSString * const kSPSearchStoreIngestDocumentsPerSecond;
+extern NSString * const kSPSearchStoreIngestBytesPerSecond;
+extern NSString * const kSPSearchStoreIngestUnchangedCount;
+extern NSString * const kSPSearchStoreIngestFailedCount;
+
+	// Keys in the statistics dictionary returned by the batch add methods. Values are NSNumbers.
+	// Only addDocumentsAtURL:statistics: reports unchanged and failed files.
+
+extern NSString * const kSPSearchStoreStatisticCount;
+extern NSString * const kSPSearchStoreStatisticTotal;
+extern NSString * const kSPSearchStoreStatisticMean;
+extern NSString * const kSPSearchStoreStatisticMaximum;
+extern NSString * const kSPSearchStoreStatisticMedian;
+extern NSString * const kSPSearchStoreStatistic90thPercentile;
+extern NSString * const kSPSearchStoreStatistic99thPercentile;
+extern NSString * const kSPSearchStoreStatisticBuckets;
+
+	// Keys in each histogram of the statistics snapshot. Values are NSNumbers, times in seconds,
+	// except for the buckets, an array of counts described in SPStatistics.h.
+
+extern NSString * const kSPSearchStoreIndexQueueOperationCount;
+extern NSString * const kSPSearchStoreResultCacheCount;
+extern NSString * const kSPSearchStoreResultCacheMemorySize;
+extern NSString * const kSPSearchStoreResultCacheHitCount;
+extern NSString * const kSPSearchStoreResultCacheMissCount;
+extern NSString * const kSPSearchStoreResultCacheEvictionCount;
+extern NSString * const kSPSearchStoreResultCacheInvalidationCount;
+
+	// Keys for the store's own values in the statistics snapshot. Values are NSNumbers.
+
 @interface SPSearchStore : NSObject {
 	
-	SKIndexRef searchIndex;
-	SKIndexType indexType;
+	id<SPSearchBackend> backend;
 	
-	NSMutableData *storeData;
 	NSURL *storeURL;
 	BOOL didCreateStore;
 	
 	NSOperationQueue *indexQue;
-	NSLock *writeLock;
-	NSLock *readLock;
-	
-	// Should we use NSRecursiveLock instead? Docs:
-	// "Recursive locks are used during recursive iterations primarily but may also be used in cases where
-	//  multiple methods each need to acquire the lock separately."
-	
-	// Docs: "Search Kit is thread-safe. You can use separate indexing and searching threads. Your application 
-	// is responsible for ensuring that no more than one process is open at a time for writing to an index."
-	// We ensure that here by using separate locks for reading and writing. Your classes do not need to
-	// worry about threaded access.
+	NSOperationQueue *compactionQue;
+	struct SPIngestCatalog *ingestCatalog;
 	
 	NSDictionary *analysisOptions;
 	NSSet *stopWords;
@@ -74,27 +98,44 @@
 	NSTimeInterval fetchTime;
 	NSInteger fetchCount;
 	
-	SKSearchRef currentSearch;
-	NSUInteger changeCount;
+	SPSearchSession *currentSearch;
+	SPSearchResultCache *resultCache;
 }
 
+@property (readonly,retain) id<SPSearchBackend> backend;
+
+	// The index implementation behind the store. Stores created with the initStoreWith...
+	// methods use SearchKit. Use initNativeStoreWithType: or initStoreWithBackend: to 
+	// choose another backend. See SPSearchBackend.h.
+
 @property (readonly) SKIndexRef searchIndex;
 	
 	// In case you want direct access to the SKIndexRef used by SPSearchStore. If your 
 	// application is multi-threaded, take care to control access to the store. When you
 	// use this class to access the store, multi-threading issues are managed automatically.
+	
+	// NULL unless the store uses the SearchKit backend.
 
 @property (readonly,retain) NSLock *writeLock;
-@property (readonly,retain) NSLock *readLock;
+@property (readonly,retain) SPReadWriteLock *readLock;
 
 	// If you are directly accessing the SKIndexRef searchIndex you must ensure that you do not
 	// perform more than one indexing and more than one searching operation simultaneously.
 	// You may use these locks to control access to the index.
+	
+	// Docs: "Search Kit is thread-safe. You can use separate indexing and searching threads. Your application 
+	// is responsible for ensuring that no more than one process is open at a time for writing to an index."
+	// The SearchKit backend ensures that by using separate locks for reading and writing. Your classes do 
+	// not need to worry about threaded access. The native backend manages its own locking and these
+	// properties are nil.
+	
+	// readLock is a readers/writer lock. -lock takes it for reading, which any number of threads may
+	// do at once; -lockForWriting excludes every reader.
 
 @property (readonly,retain) NSMutableData *storeData;	
 
-	// The storeData property only applies to stores created in memory and will be nil
-	// for file based stores. You can use this data object to persist your store.
+	// The storeData property only applies to SearchKit stores created in memory and will be 
+	// nil for file based and native stores. You can use this data object to persist your store.
 
 @property (readonly,retain) NSURL *storeURL;
 	
@@ -143,6 +184,14 @@
 	// is 100. This does not place an upper limit on the total number of results which will be
 	// returned, only a limit on the results captured in any one chunk. Refer to the fetchResults:
 	// method below for more information.
+
+@property (readwrite,retain) SPSearchResultCache *resultCache;
+
+	// Complete results of recent searches, keyed on the query, its options and the backend's
+	// generation, so that repeating a popular search does not search the index again. Any
+	// change to the store invalidates them. The default cache holds 256 searches in up to
+	// 16 MB. Adjust its limits or read its hit, miss and eviction counts through this property,
+	// or set it to nil to search the index every time. See SPSearchResultCache.h.
 	
 #pragma mark -
 
@@ -156,6 +205,50 @@
 	// and is the most comprehensive type. You must specify this type to use the advanced
 	// term support of this class.
 	
+	// When SearchKit is not available (SPSEARCHSTORE_USES_SEARCHKIT is 0) a new in-memory
+	// store uses the native backend, saved data cannot be opened and file based stores are
+	// native stores.
+
+- (id) initNativeStoreWithType:(SKIndexType)inType;
+
+	// Creates an in-memory store backed by SPNativeBackend, a portable inverted index with
+	// compressed posting lists. It uses the default text analysis options below. Changes
+	// to a native store are written as small immutable segments which become searchable
+	// within a fraction of a second and are merged in the background.
+
+- (id) initNativeStoreWithURL:(NSURL*)inFileURL type:(SKIndexType)inType;
+
+	// Opens the native store saved at inFileURL, or creates an empty one which will be saved
+	// there. The file is mapped rather than read, so opening a large store is nearly instant
+	// and memory use follows the parts of the index that are searched. Changes are appended
+	// to a write-ahead log beside the file, at its path with -log appended, which is replayed
+	// when the store is opened again. saveChangesToStore commits the log, and the store is
+	// written back to its file once the log has grown large. Returns nil if the log cannot be
+	// opened. When SearchKit is not available the initStoreWithURL: and initStoreWithFilename:
+	// methods open native stores.
+
+- (id) initShardedNativeStoreWithCount:(NSUInteger)inShardCount type:(SKIndexType)inType;
+
+	// Creates an in-memory native store divided into inShardCount shards. Documents are
+	// assigned to shards by a hash of their URI and every shard is indexed and searched in
+	// parallel, so large batches and busy stores are not held up behind a single write lock.
+	// Results from the shards are merged into one ranking with the same scores an unsharded
+	// native store would give. One shard per processor is a good place to start. Sharded
+	// stores cannot be saved with writeStoreToURL:. Any backends can be sharded by passing
+	// an SPShardedBackend to initStoreWithBackend:.
+
+- (BOOL) writeStoreToURL:(NSURL*)inFileURL;
+
+	// Saves a native store to a file that initNativeStoreWithURL:type: can open. The file is
+	// written beside its destination and then moved into place, so an existing store is never
+	// left half written. Document names and properties are saved along with the index. Writing
+	// a store to its own URL also empties its write-ahead log. Returns NO for SearchKit stores,
+	// whose storeData or file is already the saved index.
+
+- (id) initStoreWithBackend:(id<SPSearchBackend>)inBackend;
+
+	// The designated initializer. The other initializers create a backend and call this one.
+	
 #pragma mark -
 	
 + (void) setDefaultTextAnalysisOption:(id)inObject forKey:(NSString*)inKey;
@@ -178,10 +271,14 @@
 	// to provide default values. You must specify the default stop words and other 
 	// analysis preferences prior to the creation of your index using the method above.
 	
-	// inLanguage is a two-character language specifier such as "en" or "de". Currently
-	// this method only returns stop words for the English language. You may expand 
-	// stop word support by modifying the SPSearchStoreStopWords() function in the class
-	// file.	
+	// inLanguage is a two-character language specifier: "en", "de", "fr", "es", "it", "pt",
+	// "nl" or "sv". Words with diacritics are included both with and without them. The
+	// lists are built into SPStopWords.c; add to them with Tools/SPStopWordsGenerator.py.
+	
+	// A native store can instead drop stop words as it indexes, which keeps them out of
+	// the index altogether, by setting the kSPStopWordLanguages analysis option to an
+	// array of these codes. kSPExcludesNumericTerms and kSPStemsTerms likewise leave out
+	// terms beginning with a digit and index English words by their stems.
 
 #pragma mark -
 #pragma mark Index / Document Management
@@ -205,6 +302,36 @@
 	// Returns YES if the document was successfully indexed, no otherwise; however, the return
 	// value is always YES if you have set usesConcurrentIndexing.
 
+- (BOOL) addDocuments:(NSArray*)inFileURLs typeHint:(NSString*)inMimeHint statistics:(NSDictionary**)outStatistics;
+- (BOOL) addDocuments:(NSArray*)inDocumentURIs withTexts:(NSArray*)inContents statistics:(NSDictionary**)outStatistics;
+
+	// Batch versions of the methods above for bulk loads. The native backend reads and tokenizes
+	// the documents in parallel across every core, then adds them to the index with a single 
+	// acquisition of the write lock and writes them out as a single segment. The SearchKit backend
+	// cannot tokenize ahead of time but still locks and flushes once for the whole batch.
+	// inContents must be parallel to inDocumentURIs.
+	
+	// Batches run on the calling thread even if you have set usesConcurrentIndexing, after any
+	// queued indexing operations have finished. Returns YES if every document was indexed. If 
+	// outStatistics is not NULL it receives the number of documents and bytes indexed, the time
+	// taken and the resulting documents and bytes per second. See the keys above.
+
+- (BOOL) addDocumentsAtURL:(NSURL*)inFileURL statistics:(NSDictionary**)outStatistics;
+
+	// Indexes the file at inFileURL or, for a directory, every file beneath it that has a text
+	// extractor: plain text, HTML and Markdown. Hidden files are skipped and symbolic links are
+	// not followed. The crawl is a pipeline: one thread walks the tree, a reader per processor
+	// maps files and extracts their text, and the calling thread adds the documents in batches.
+	// Bounded queues between the stages hold back whichever stage gets ahead, so a large tree
+	// keeps the disk and processors busy without piling up text in memory. Text is extracted
+	// by SPTextExtractor rather than Spotlight importers, for native and SearchKit stores alike.
+	
+	// The store remembers the modification date, size and content hash of every file it crawls.
+	// Crawling the same tree again skips files that have not changed, and files that have been
+	// touched without changing are not reindexed. Removing a document makes the crawl index it
+	// again. Like the batch methods this runs on the calling thread. Returns YES if every file
+	// was read and indexed. outStatistics also receives the unchanged and failed file counts.
+
 - (BOOL) removeDocument:(NSURL*)inDocumentURI;
 
 	// Use a single method to remove a document from the search index. If it is a file, simply
@@ -248,6 +375,22 @@
 	// after the index is flushed or closed, and in the index but will be deleted after the index is 
 	// flushed or closed."
 
+- (NSInteger) documentIDForDocument:(NSURL*)inDocumentURI;
+- (NSURL*) documentForDocumentID:(NSInteger)inDocumentID;
+
+	// Translates between document URIs and the integer IDs the index keeps for them. Returns
+	// NSNotFound or nil for a document which is not in the store. Both backends answer from a
+	// hash table of interned URIs, so resolving a URI once and passing its ID to the methods
+	// below lets a loop over many documents skip making URL and SearchKit document objects.
+	
+	// IDs are never reused, but a document which is removed and added again, or replaced, may
+	// come back with a different ID. Don't keep IDs across changes to the store.
+
+- (void) setProperties:(NSDictionary*)inProperties forDocumentID:(NSInteger)inDocumentID;
+- (NSDictionary*) propertiesForDocumentID:(NSInteger)inDocumentID;
+
+	// Behave like setProperties:forDocument: and propertiesForDocument:.
+
 - (NSArray*) allDocuments:(BOOL)ignoreEmptyDocuments;
 
 	// Returns all the documents currently indexed in the search store. If ignoreEmptyDocuments is YES,
@@ -275,15 +418,24 @@
 	// tolerance should be between 0 and 1. Pass a value of 0 to force this method to compact the index.
 	
 	// Because index compacting is potentially an expensive operation, SPSearchStore always performs
-	// the operation on a separate thread. Indexing and querying are unavailable during this time, and
-	// any calls to index or query the store will block that thread until compaction is completed.
+	// the operation on a separate thread. With the SearchKit backend indexing and querying are 
+	// unavailable during this time, and any calls to index or query the store will block that thread
+	// until compaction is completed.
+	
+	// The native backend compacts online. It rewrites one segment at a time and swaps each in as it
+	// is finished, so indexing and querying continue at full speed, and it rests between segments to
+	// leave the processor and disk to searches. See kSPNativeBackendCompactionDutyCycle. Calling
+	// this again while a compaction is still running does not queue another.
 
 - (BOOL) saveChangesToStore;
 	
 	// This updates the index store backing. For an in-memory store it updates the storeData object
-	// and for on-disk stores is writes out the index to the filesystem. SPSearchStore manages the
-	// store state as needed by your search and term requests, but you may save the store at any
-	// time by calling this method.
+	// and for on-disk stores is writes out the index to the filesystem. Native stores opened with
+	// a URL commit their write-ahead log instead, so that every change made so far survives a
+	// crash at the cost of the changes alone, and concurrent saves share a single fsync. Both
+	// backends commit changes in the background shortly after they are made, so searches and
+	// term requests never wait on a flush and see the store as of the last commit. Call this
+	// method to make changes searchable immediately or to save the store at any time.
 	
 - (BOOL) closeStore;
 
@@ -297,6 +449,13 @@
 #pragma mark -
 #pragma mark Searching
 
+- (SPSearchSession*) searchSessionForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions;
+
+	// Returns a new, autoreleased search session, or nil if the query could not be prepared. Unlike 
+	// prepareSearch:options: below, sessions do not cancel one another, so several threads may each 
+	// run their own searches against the store at the same time. Reads share the index, so searches 
+	// from separate threads run in parallel. See SPSearchSession.h.
+
 - (void) prepareSearch:(NSString*)searchQuery options:(SKSearchOptions)searchOptions;
 - (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float**)outRanks untilFinished:(BOOL)untilComplete;
 - (BOOL) fetchResults:(NSArray**)outDocuments ranksArray:(NSArray**)outRanks untilFinished:(BOOL)untilComplete;
@@ -360,12 +519,29 @@
 - (BOOL) isStillSearching;
 - (void) cancelSearch;
 
+	// The prepareSearch:options: family manages a single session on behalf of the store, and preparing
+	// a new search cancels the previous one. Use searchSessionForQuery:options: for independent searches.
+	
 	// Use these methods to check the status of the index and to cancel any current searches. Normally
 	// you won't need to check if a search is continuing, as multiple calls to fetchResults:ranks: will
 	// exhaust the search results. But you may want to cancel a search prematurely, if, for example,
 	// the user changes the query. It is always safe to call cancelSearch even when no search is currely
 	// taking place.
 
+- (NSArray*) topResultsForQuery:(NSString*)searchQuery limit:(NSUInteger)limit;
+- (NSArray*) topResultsForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions 
+		limit:(NSUInteger)limit ranks:(float**)outRanks;
+
+	// Returns the limit best matching documents for a query, most relevant first, in a single call.
+	// Use these methods when you only show the first page of results: the native backend ranks with
+	// BM25 by default and passes over documents that cannot make the cut rather than scoring and
+	// sorting every match, which makes common queries against large stores much faster. See
+	// SPNativeBackend's rankingOptions. The SearchKit backend still finds every match but only keeps
+	// the best of them.
+	
+	// outRanks behaves as it does for fetchResults:ranks:untilFinished:. The first method uses the
+	// default search options.
+
 #pragma mark -
 #pragma mark Document Terms
 
@@ -381,9 +557,24 @@
 
 - (NSArray*) allTerms;
 	
-	// Returns all the terms used in your the search store. You must have specified 
+	// Returns all the terms used in your the search store, sorted. You must have specified 
 	// kSKIndexInvertedVector when creating the store, as is the case for all of the following 
-	// document <-> term methods.
+	// document <-> term methods. On a large store prefer one of the next two methods, which
+	// do not need every term in memory at once.
+
+- (NSArray*) termsWithPrefix:(NSString*)inPrefix limit:(NSUInteger)limit;
+
+	// Returns up to limit terms beginning with inPrefix, sorted. Pass 0 for no limit. Useful for
+	// autocompletion: the native backend keeps its dictionary sorted and stops as soon as it
+	// has found limit terms.
+
+- (void) enumerateTermsWithPrefix:(NSString*)inPrefix 
+		usingBlock:(void (^)(NSString *term, NSUInteger documentCount, BOOL *stop))block;
+
+	// Calls block with every term beginning with inPrefix, sorted, and the number of documents
+	// that contain it. Pass nil or an empty string to walk the whole dictionary. The native
+	// backend streams terms out of the index without building an array of them. Set *stop to
+	// YES to end the enumeration early.
 
 - (NSUInteger) documentCountForTerm:(NSString*)inTerm;
 
@@ -415,4 +606,76 @@
 
 	// Returns the total number of times a specific term occurs in a document.
 
+- (NSIndexSet*) documentIDsForTerm:(NSString*)inTerm;
+- (NSUInteger) termCountForDocumentID:(NSInteger)inDocumentID;
+- (NSArray*) termsForDocumentID:(NSInteger)inDocumentID;
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocumentID:(NSInteger)inDocumentID;
+
+	// The same requests by document ID, see documentIDForDocument:. documentIDsForTerm: returns
+	// the IDs of the documents containing a term without making a URL for any of them.
+
+#pragma mark -
+#pragma mark Similarity
+
+- (NSArray*) documentsSimilarToDocument:(NSURL*)inDocumentURI limit:(NSUInteger)limit ranks:(float**)outRanks;
+
+	// Returns up to limit documents most like the specified document, most similar first, not
+	// counting the document itself. Native stores compare the TF-IDF vectors of documents by
+	// cosine similarity, scoring segments of the index in parallel, so ranks fall between 0 and
+	// 1. SearchKit stores run a kSKSearchOptionFindSimilar query of the document's terms
+	// instead. outRanks behaves as it does for fetchResults:ranks:untilFinished:.
+
+- (NSArray*) nearDuplicatesOfDocument:(NSURL*)inDocumentURI threshold:(float)threshold;
+
+	// Returns the documents which share at least threshold of their distinct terms with the
+	// specified document, most similar first. Similarity is estimated from MinHash signatures
+	// which the native index keeps up to date as documents are added and removed, so the
+	// check is fast enough to run on every import. A threshold around 0.8 catches copies that
+	// differ by light edits. Returns nil for SearchKit stores.
+
+- (NSArray*) nearDuplicatePairsWithThreshold:(float)threshold;
+
+	// Returns every pair of near duplicates in the store as arrays of two URLs, most similar
+	// first. Returns nil for SearchKit stores.
+
+#pragma mark -
+#pragma mark Term Graph
+
+	// Walking the whole graph one document at a time is slow. Native stores can export it in
+	// a single call instead, as compressed sparse row arrays of document IDs, term IDs and term
+	// frequencies along with tables of the URIs and terms behind the IDs. See SPGraph.h.
+
+- (SPGraphRef) copyTermGraphWithOrientation:(SPGraphOrientation)orientation documentIDs:(NSRange)range;
+
+	// Returns a graph of the documents whose IDs fall in range, which you must release with
+	// SPGraphRelease. kSPGraphDocumentRows has a row of terms per document, kSPGraphTermRows a
+	// row of documents per term. Pass NSMakeRange(0, NSUIntegerMax) for the whole store, or
+	// split the store into slices of IDs up to maximumDocumentID of the backend. Stop words and
+	// numeric terms are not filtered out. Returns NULL for SearchKit stores.
+
+- (BOOL) writeTermGraphToURL:(NSURL*)fileURL orientation:(SPGraphOrientation)orientation documentIDs:(NSRange)range;
+
+	// Writes the same graph to a file, which offline jobs can map with SPGraphCreateWithFile
+	// instead of reading it in. Returns NO for SearchKit stores or if the file could not be
+	// written.
+
+#pragma mark -
+#pragma mark Statistics
+
+- (NSDictionary*) statisticsSnapshot;
+
+	// Returns the latency histograms of the store's hot paths: adding single documents and
+	// batches, removing, flushing, preparing searches, fetching, top results, term requests,
+	// compacting and merging, the time spent waiting for and holding the read and write locks,
+	// the backend fetches per session fetch, the depth of the indexing queue and the changes
+	// per flush. Each is a dictionary keyed by the statistic's name, such as "add",
+	// "batch_add" or "write_lock_wait", as listed in SPStatistics.h. A batch is recorded once
+	// under "batch_add" rather than once per document under "add", so that each holds the
+	// latency of one kind of call. The histograms cover every store in the process and only
+	// grow, so scrape them periodically and take differences.
+	
+	// The snapshot also holds this store's current indexing queue length and result cache
+	// counters. When statistics are compiled out (SPSEARCHSTORE_STATISTICS is 0) only those
+	// are returned.
+
 @end
@@ -38,58 +38,109 @@
 */
 
 #import "SPSearchStore.h"
-
-NSString const * kSPSearchStoreIndexName = @"Search Index";
-NSInteger const kSPSearchStoreMemorySize = 2^16;
+#import "SPNativeBackend.h"
+#import "SPShardedBackend.h"
+#include "SPStatistics.h"
+#include "SPIngest.h"
+#include "SPStopWords.h"
+
+#if SPSEARCHSTORE_USES_SEARCHKIT
+#import "SPSearchKitBackend.h"
+#endif
+
+NSString * const kSPSearchStoreIngestDocumentCount = @"SPSearchStoreIngestDocumentCount";
+NSString * const kSPSearchStoreIngestByteCount = @"SPSearchStoreIngestByteCount";
+NSString * const kSPSearchStoreIngestElapsedTime = @"SPSearchStoreIngestElapsedTime";
+NSString * const kSPSearchStoreIngestDocumentsPerSecond = @"SPSearchStoreIngestDocumentsPerSecond";
+NSString * const kSPSearchStoreIngestBytesPerSecond = @"SPSearchStoreIngestBytesPerSecond";
+NSString * const kSPSearchStoreIngestUnchangedCount = @"SPSearchStoreIngestUnchangedCount";
+NSString * const kSPSearchStoreIngestFailedCount = @"SPSearchStoreIngestFailedCount";
+
+NSString * const kSPSearchStoreStatisticCount = @"count";
+NSString * const kSPSearchStoreStatisticTotal = @"total";
+NSString * const kSPSearchStoreStatisticMean = @"mean";
+NSString * const kSPSearchStoreStatisticMaximum = @"maximum";
+NSString * const kSPSearchStoreStatisticMedian = @"p50";
+NSString * const kSPSearchStoreStatistic90thPercentile = @"p90";
+NSString * const kSPSearchStoreStatistic99thPercentile = @"p99";
+NSString * const kSPSearchStoreStatisticBuckets = @"buckets";
+
+NSString * const kSPSearchStoreIndexQueueOperationCount = @"index_queue_operation_count";
+NSString * const kSPSearchStoreResultCacheCount = @"result_cache_count";
+NSString * const kSPSearchStoreResultCacheMemorySize = @"result_cache_memory_size";
+NSString * const kSPSearchStoreResultCacheHitCount = @"result_cache_hit_count";
+NSString * const kSPSearchStoreResultCacheMissCount = @"result_cache_miss_count";
+NSString * const kSPSearchStoreResultCacheEvictionCount = @"result_cache_eviction_count";
+NSString * const kSPSearchStoreResultCacheInvalidationCount = @"result_cache_invalidation_count";
 
 static NSTimeInterval kSPSearchStoreDefaultFetchTime = 0.5;
 static NSInteger kSPSearchStoreDefaultFetchCount = 100;
 
-static NSDictionary * SPSearchStoreStopWords() {
-	
-	// Stop words dictionary. Currently only supports english but it hould be easy
-	// to add other language specific stop words. Simply expand the stopWords
-	// dictionary by adding a string of words separated by single space for the
-	// value, followed by the two character language specifier for the key.
-	
-	// Other possible English stop words:
-	// about against under with away also across ago been before after above below 
-	// around vs up down while
-	
-	static NSDictionary *stopWords = nil;
-	if ( stopWords == nil ) {
-		stopWords = [[NSDictionary alloc] initWithObjectsAndKeys:
-				@"a all am an and any are as at be but by can could did do does etc for from goes got had has have he her hers him his how if in is it its let me more much must my no nor not now of off on or our own see set shall she should so some than that the them then there these they this those though to too us was way we what when where which who why will would yes yet you your yours",
-				@"en",
-				nil];
-	}
-	
-	return stopWords;
+static void SPSearchStoreAddStopWord(const char *word, size_t length, void *context) {
+	NSString *string = [[NSString alloc] initWithBytes:word length:length encoding:NSUTF8StringEncoding];
+	if ( string != nil ) [(NSMutableSet*)context addObject:string];
+	[string release];
 }
 
 static NSMutableDictionary * SPSearchStoreTextAnalysisOptions() {
-	
+
 	// This dictionary stores a default set of text analysis options which are
 	// specified during search index creation. They cover preferences such as
-	// stop words, term length, proximity indexing and so on. 
-	
+	// stop words, term length, proximity indexing and so on.
+
 	static NSMutableDictionary *textAnalysis = nil;
 	if ( textAnalysis == nil ) {
 		textAnalysis = [[NSMutableDictionary alloc] init];
-			
+
 		[textAnalysis setObject:[NSNumber numberWithBool:NO] forKey:(NSString *)kSKProximityIndexing];
 		[textAnalysis setObject:[NSNumber numberWithInteger:0] forKey:(NSString *)kSKMaximumTerms];
 		[textAnalysis setObject:[NSNumber numberWithInteger:1] forKey:(NSString *)kSKMinTermLength];
 	}
-	
+
 	return textAnalysis;
 }
 
+typedef struct {
+	id<SPSearchBackend> backend;
+	NSUInteger added;
+} SPSearchStoreCrawl;
+
+static bool SPSearchStoreIndexCrawledDocuments(const SPIngestDocument *documents, size_t count, void *context) {
+
+	// The indexing stage of a crawl. Each batch is handed to the backend's own batch add,
+	// which the native backend tokenizes across every core.
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	SPSearchStoreCrawl *crawl = context;
+	NSMutableArray *documentURLs = [NSMutableArray arrayWithCapacity:count];
+	NSMutableArray *texts = [NSMutableArray arrayWithCapacity:count];
+	NSFileManager *fileManager = [NSFileManager defaultManager];
+	size_t i;
+
+	for ( i = 0; i < count; i++ ) {
+		NSString *path = [fileManager stringWithFileSystemRepresentation:documents[i].path length:strlen(documents[i].path)];
+		NSString *text = [[NSString alloc] initWithBytes:documents[i].text length:documents[i].length encoding:NSUTF8StringEncoding];
+
+		if ( path != nil && text != nil ) {
+			[documentURLs addObject:[NSURL fileURLWithPath:path]];
+			[texts addObject:text];
+		}
+		[text release];
+	}
+
+	SPStatisticsStart(timed);
+	crawl->added += [crawl->backend addDocuments:documentURLs withTexts:texts byteCount:NULL];
+	SPStatisticsStop(kSPStatisticBatchAdd, timed);
+
+	[pool drain];
+	return true;
+}
+
 #pragma mark -
 
 @interface SPSearchStore()
 
-@property (readwrite,retain) NSMutableData *storeData;
+@property (readwrite,retain) id<SPSearchBackend> backend;
 @property (readwrite,retain) NSURL *storeURL;
 
 @property (readwrite,copy) NSDictionary *analysisOptions;
@@ -98,18 +149,17 @@ static NSMutableDictionary * SPSearchStoreTextAnalysisOptions() {
 
 #pragma mark -
 
-- (BOOL) _addDocument:(NSURL*)inDocumentURI withText:(NSString*)inContents;
-- (BOOL) _addDocument:(NSURL*)inFileURL typeHint:(NSString*)inMimeHint;
-- (BOOL) _removeDocument:(NSURL*)inDocumentURI;
+- (BOOL) _isFilteredTerm:(NSString*)aTerm ignoringNumbers:(BOOL)ignoresNumbers words:(NSSet*)ignoredWords;
+- (NSArray*) _filteredTerms:(NSArray*)inTerms;
 
-- (NSArray*) _allDocumentsForDocumentRef:(SKDocumentRef)document ignoreEmptyDocuments:(BOOL)ignoresEmpty;
+- (SPSearchSession*) _currentSearch;
+- (void) _clearCurrentSearch:(SPSearchSession*)session;
 
-- (BOOL) _fetchResults:(NSArray**)outDocuments ranks:(float*)outRanks 
-		maxTime:(CFTimeInterval)maxTime maxCount:(CFIndex)maxCount;
+- (NSDictionary*) _ingestStatisticsForDocumentCount:(NSUInteger)documentCount byteCount:(unsigned long long)byteCount 
+		elapsedTime:(NSTimeInterval)elapsed;
+- (NSDictionary*) _dictionaryWithHistogram:(const SPHistogram*)histogram isTime:(BOOL)isTime;
 
-- (void) _incrementChangeCount;
-- (BOOL) _flushIndexIfNecessary;
-- (BOOL) _compactIndex;
+- (void) _forgetCrawledDocument:(NSURL*)inDocumentURI;
 
 @end
 
@@ -117,12 +167,9 @@ static NSMutableDictionary * SPSearchStoreTextAnalysisOptions() {
 
 @implementation SPSearchStore
 
-@synthesize searchIndex;
+@synthesize backend;
 @synthesize storeURL;
 
-@synthesize writeLock;
-@synthesize readLock;
-
 @synthesize didCreateStore;
 @synthesize analysisOptions;
 @synthesize stopWords;
@@ -132,129 +179,181 @@ static NSMutableDictionary * SPSearchStoreTextAnalysisOptions() {
 @synthesize fetchCount;
 @synthesize fetchTime;
 
+@synthesize resultCache;
+
 #pragma mark -
 
-- (id) initStoreWithMemory:(NSMutableData*)inData type:(SKIndexType)inType {
-	
-	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
-	
+- (id) initStoreWithBackend:(id<SPSearchBackend>)inBackend {
+
 	if ( self = [super init] ) {
-		
-		if ( inData == nil ) {
-			// create a new in memory store
-			
-			inData = [NSMutableData dataWithCapacity: kSPSearchStoreMemorySize];
-			searchIndex = SKIndexCreateWithMutableData( (CFMutableDataRef)inData, (CFStringRef)NULL,
-					(SKIndexType)inType, (CFDictionaryRef)SPSearchStoreTextAnalysisOptions() );
-		}
-		else {
-			// open a store from memory
-			
-			searchIndex = SKIndexOpenWithMutableData ( (CFMutableDataRef)inData, (CFStringRef)NULL );
-		}
-		
-		if ( searchIndex == NULL ) {
+
+		if ( inBackend == nil ) {
 			[self release];
 			return nil;
 		}
-		
-		writeLock = [[NSLock alloc] init];
-		readLock = [[NSLock alloc] init];
-		
+
+		self.backend = inBackend;
+
 		self.stopWords = [SPSearchStoreTextAnalysisOptions() objectForKey:(NSString*)kSKStopWords];
 		self.analysisOptions = SPSearchStoreTextAnalysisOptions();
-		self.didCreateStore = (inData==nil);
-		self.storeData = inData;
+		self.didCreateStore = NO;
 		self.storeURL = nil;
-		
+
 		self.fetchCount = kSPSearchStoreDefaultFetchCount;
 		self.fetchTime = kSPSearchStoreDefaultFetchTime;
-		
-		indexType = inType;
-		changeCount = 0;
-		
+
+		self.resultCache = [[[SPSearchResultCache alloc] init] autorelease];
+
+	}
+	return self;
+}
+
+- (id) initNativeStoreWithType:(SKIndexType)inType {
+
+	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
+
+	SPNativeBackend *nativeBackend = [[[SPNativeBackend alloc] initWithType:inType
+			analysisOptions:SPSearchStoreTextAnalysisOptions()] autorelease];
+
+	if ( self = [self initStoreWithBackend:nativeBackend] ) {
+		self.didCreateStore = YES;
+	}
+	return self;
+}
+
+- (id) initNativeStoreWithURL:(NSURL*)inFileURL type:(SKIndexType)inType {
+
+	NSAssert( inFileURL!=nil, @"inFileURL must not be nil");
+	NSAssert( [inFileURL isFileURL], @"inFileURL must be a file url");
+	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
+
+	SPNativeBackend *nativeBackend = [[[SPNativeBackend alloc] initWithURL:inFileURL type:inType
+			analysisOptions:SPSearchStoreTextAnalysisOptions()] autorelease];
+
+	if ( self = [self initStoreWithBackend:nativeBackend] ) {
+		self.didCreateStore = nativeBackend.didCreateStore;
+		self.storeURL = inFileURL;
+	}
+	return self;
+}
+
+- (id) initShardedNativeStoreWithCount:(NSUInteger)inShardCount type:(SKIndexType)inType {
+
+	NSAssert( inShardCount > 0, @"inShardCount must be greater than zero");
+	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
+
+	SPShardedBackend *shardedBackend = [[[SPShardedBackend alloc] initNativeWithCount:inShardCount type:inType
+			analysisOptions:SPSearchStoreTextAnalysisOptions()] autorelease];
+
+	if ( self = [self initStoreWithBackend:shardedBackend] ) {
+		self.didCreateStore = YES;
+	}
+	return self;
+}
+
+- (id) initStoreWithMemory:(NSMutableData*)inData type:(SKIndexType)inType {
+
+	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
+
+#if SPSEARCHSTORE_USES_SEARCHKIT
+
+	SPSearchKitBackend *searchKitBackend = [[[SPSearchKitBackend alloc] initWithMemory:inData type:inType
+			analysisOptions:SPSearchStoreTextAnalysisOptions()] autorelease];
+
+	if ( self = [self initStoreWithBackend:searchKitBackend] ) {
+		self.didCreateStore = searchKitBackend.didCreateStore;
 	}
 	return self;
+
+#else
+
+	if ( inData != nil ) {
+		// native stores cannot be reopened from memory
+		[self release];
+		return nil;
+	}
+
+	return [self initNativeStoreWithType:inType];
+
+#endif
 }
 
 - (id) initStoreWithFilename:(NSString*)inPath type:(SKIndexType)inType {
-	
+
 	NSAssert( inPath!=nil, @"inPath must not be nil");
 	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
-	
+
 	return [self initStoreWithURL:[NSURL fileURLWithPath:inPath] type:inType];
 }
 
 - (id) initStoreWithURL:(NSURL*)inFileURL type:(SKIndexType)inType {
-	
+
 	NSAssert( inFileURL!=nil, @"inFileURL must not be nil");
 	NSAssert( [inFileURL isFileURL], @"inFileURL must be a file url");
 	NSAssert( inType!=kSKIndexUnknown, @"inType must not be kSKIndexUnknown (0)" );
-	
-	if ( self = [super init] ) {
-		
-		NSFileManager *fm = [[[NSFileManager alloc] init] autorelease];
-		BOOL fileExists = [fm fileExistsAtPath:[inFileURL path]];
-		
-		if ( fileExists ) {
-			// store already exists, we want to open it
-			
-			searchIndex = SKIndexOpenWithURL((CFURLRef)inFileURL, (CFStringRef)NULL, true);
-		}
-		else {
-			// store does not exist, we want to create it
-			
-			searchIndex = SKIndexCreateWithURL((CFURLRef)inFileURL, (CFStringRef)NULL, 
-					(SKIndexType)inType, (CFDictionaryRef)SPSearchStoreTextAnalysisOptions() );
-		}
-		
-		if ( searchIndex == NULL ) {
-			[self release];
-			return nil;
-		}
-		
-		writeLock = [[NSLock alloc] init];
-		readLock = [[NSLock alloc] init];
-		
-		self.stopWords = [SPSearchStoreTextAnalysisOptions() objectForKey:(NSString*)kSKStopWords];
-		self.analysisOptions = SPSearchStoreTextAnalysisOptions();
-		self.didCreateStore = !fileExists;
+
+#if SPSEARCHSTORE_USES_SEARCHKIT
+
+	SPSearchKitBackend *searchKitBackend = [[[SPSearchKitBackend alloc] initWithURL:inFileURL type:inType
+			analysisOptions:SPSearchStoreTextAnalysisOptions()] autorelease];
+
+	if ( self = [self initStoreWithBackend:searchKitBackend] ) {
+		self.didCreateStore = searchKitBackend.didCreateStore;
 		self.storeURL = inFileURL;
-		self.storeData = nil;
-		
-		self.fetchCount = kSPSearchStoreDefaultFetchCount;
-		self.fetchTime = kSPSearchStoreDefaultFetchTime;
-		
-		indexType = inType;
-		changeCount = 0;
-		
 	}
 	return self;
+
+#else
+
+	return [self initNativeStoreWithURL:inFileURL type:inType];
+
+#endif
 }
 
 - (void) dealloc {
-	
+
+	[currentSearch release], currentSearch = nil;
+
+	self.resultCache = nil;
 	self.analysisOptions = nil;
-	self.storeData = nil;
+	self.stopWords = nil;
 	self.storeURL = nil;
-	
-	SKIndexClose(searchIndex);
-	searchIndex = NULL;
-	
-	[writeLock release], writeLock = nil;
-	[readLock release], readLock = nil;
+	self.backend = nil;
+
 	[indexQue release], indexQue = nil;
-	
+	[compactionQue release], compactionQue = nil;
+
+	SPIngestCatalogRelease(ingestCatalog);
+	ingestCatalog = NULL;
+
 	[super dealloc];
 }
 
 #pragma mark -
 
+- (SKIndexRef) searchIndex {
+	return ( [backend respondsToSelector:@selector(searchIndex)] ? [backend searchIndex] : NULL );
+}
+
+- (NSLock*) writeLock {
+	return ( [backend respondsToSelector:@selector(writeLock)] ? [backend writeLock] : nil );
+}
+
+- (SPReadWriteLock*) readLock {
+	return ( [backend respondsToSelector:@selector(readLock)] ? [backend readLock] : nil );
+}
+
+- (NSMutableData *) storeData {
+	return ( [backend respondsToSelector:@selector(storeData)] ? [backend storeData] : nil );
+}
+
 - (void) setUsesSpotlightImporters:(BOOL)useSpotlight {
 	@synchronized(self) {
         usesSpotlightImporters = useSpotlight;
 
+#if SPSEARCHSTORE_USES_SEARCHKIT
         if ( useSpotlight ) SKLoadDefaultExtractorPlugIns();
+#endif
     }
 }
 
@@ -269,7 +368,7 @@ static NSMutableDictionary * SPSearchStoreTextAnalysisOptions() {
 - (void) setUsesConcurrentIndexing:(BOOL)useConcurrent {
 	@synchronized(self) {
         usesConcurrentIndexing = useConcurrent;
-        
+
         if ( useConcurrent && indexQue == nil ) {
             indexQue = [[NSOperationQueue alloc] init];
             [indexQue setMaxConcurrentOperationCount:1];
@@ -291,23 +390,6 @@ static NSMutableDictionary * SPSearchStoreTextAnalysisOptions() {
     return uses;
 }
 
-- (void) setStoreData:(NSMutableData *)inData {
-    @synchronized(self) {
-        [inData retain];
-        [storeData release];
-        storeData = inData;
-    }
-}
-
-- (NSMutableData *) storeData {
-	NSMutableData *data = nil;
-    @synchronized(self) {
-        [self _flushIndexIfNecessary];
-        data = [[storeData retain] autorelease];
-    }
-    return data;
-}
-
 #pragma mark -
 
 + (void) setDefaultTextAnalysisOption:(id)inObject forKey:(NSString*)inKey {
@@ -319,179 +401,260 @@ static NSMutableDictionary * SPSearchStoreTextAnalysisOptions() {
 }
 
 + (NSSet*) stopWordsForLanguage:(NSString*)inLanguage {
-	NSString *words = [SPSearchStoreStopWords() objectForKey:inLanguage];
-	return ( words ? [NSSet setWithArray:[words componentsSeparatedByString:@" "]] : nil );
+
+	// The same built in lists the native index can exclude as it indexes
+
+	uint32_t language = ( inLanguage == nil ? 0 : SPStopWordsGetLanguage([inLanguage UTF8String]) );
+	NSMutableSet *words;
+
+	if ( language == 0 ) return nil;
+
+	words = [NSMutableSet set];
+	SPStopWordsEnumerate(language, SPSearchStoreAddStopWord, words);
+	return words;
 }
 
 #pragma mark -
 #pragma mark Document / Store Management
 
 - (BOOL) addDocument:(NSURL*)inDocumentURI withText:(NSString*)inContents {
-	
+
 	NSAssert( inDocumentURI!=nil, @"inDocumentURI must not be nil");
 	NSAssert( inContents!=nil, @"inContents must not be nil");
-	
-	// Pass the call to a private method in order to support concurrent processing. Could
-	// be made 10.5 compatible using invocation operations or detachNewThreadSelector:
-	
+
+	// Pass the call to the backend on the index queue in order to support concurrent
+	// processing. Could be made 10.5 compatible using invocation operations or
+	// detachNewThreadSelector:
+
 	if ( self.usesConcurrentIndexing ) {
 		if ( indexQue == nil ) return NO;
+		SPStatisticsCount(kSPStatisticIndexQueueDepth, [indexQue operationCount]);
 		[indexQue addOperationWithBlock:^(void) {
-			[self _addDocument:inDocumentURI withText:inContents];
+			SPStatisticsStart(started);
+			[backend addDocument:inDocumentURI withText:inContents];
+			SPStatisticsStop(kSPStatisticAdd, started);
 		}];
 		return YES;
 	}
 	else {
-		return [self _addDocument:inDocumentURI withText:inContents];
+		SPStatisticsStart(started);
+		BOOL success = [backend addDocument:inDocumentURI withText:inContents];
+		SPStatisticsStop(kSPStatisticAdd, started);
+		return success;
 	}
 }
 
 - (BOOL) addDocument:(NSURL*)inFileURL typeHint:(NSString*)inMimeHint {
-	
+
 	NSAssert( inFileURL!=nil, @"inFileURL must not be nil");
-	
-	// Pass the call to a private method in order to support concurrent processing. Could
-	// be made 10.5 compatible using invocation operations or detachNewThreadSelector:
-	
+
+	// Pass the call to the backend on the index queue in order to support concurrent
+	// processing. Could be made 10.5 compatible using invocation operations or
+	// detachNewThreadSelector:
+
 	if ( self.usesConcurrentIndexing ) {
 		if ( indexQue == nil ) return NO;
+		SPStatisticsCount(kSPStatisticIndexQueueDepth, [indexQue operationCount]);
 		[indexQue addOperationWithBlock:^(void) {
-			[self _addDocument:inFileURL typeHint:inMimeHint];
+			SPStatisticsStart(started);
+			[backend addDocument:inFileURL typeHint:inMimeHint];
+			SPStatisticsStop(kSPStatisticAdd, started);
 		}];
 		return YES;
 	}
 	else {
-		return [self _addDocument:inFileURL typeHint:inMimeHint];
+		SPStatisticsStart(started);
+		BOOL success = [backend addDocument:inFileURL typeHint:inMimeHint];
+		SPStatisticsStop(kSPStatisticAdd, started);
+		return success;
 	}
 }
 
-- (BOOL) _addDocument:(NSURL*)inFileURL typeHint:(NSString*)inMimeHint {
+#pragma mark -
+
+- (BOOL) addDocuments:(NSArray*)inFileURLs typeHint:(NSString*)inMimeHint statistics:(NSDictionary**)outStatistics {
 	
-	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-	[writeLock lock];
+	NSAssert( inFileURLs!=nil, @"inFileURLs must not be nil");
 	
-	BOOL success = NO;
+	if ( indexQue != nil ) [indexQue waitUntilAllOperationsAreFinished];
 	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inFileURL);
-	if ( document == NULL ) goto bail; // not always harmful!
+	unsigned long long byteCount = 0;
+	NSDate *started = [NSDate date];
 	
-	success = SKIndexAddDocument(searchIndex, document, (CFStringRef)inMimeHint, true);
-	if ( success ) [self _incrementChangeCount];
+	SPStatisticsStart(timed);
+	NSUInteger added = [backend addDocuments:inFileURLs typeHint:inMimeHint byteCount:&byteCount];
+	SPStatisticsStop(kSPStatisticBatchAdd, timed);
 	
-	//
-	// CFStringRef name = SKDocumentGetName(document);
-	// NSLog(@"name is %@", (NSString*)name);
-	//
+	if ( outStatistics != NULL ) 
+		*outStatistics = [self _ingestStatisticsForDocumentCount:added byteCount:byteCount 
+				elapsedTime:-[started timeIntervalSinceNow]];
 	
-bail:
-	if ( document ) CFRelease(document);
-	[writeLock unlock];
-	[pool release];
-	return success;
+	return ( added == [inFileURLs count] );
 }
 
-- (BOOL) _addDocument:(NSURL*)inDocumentURI withText:(NSString*)inContents {
+- (BOOL) addDocuments:(NSArray*)inDocumentURIs withTexts:(NSArray*)inContents statistics:(NSDictionary**)outStatistics {
 	
-	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-	[writeLock lock];
+	NSAssert( inDocumentURIs!=nil, @"inDocumentURIs must not be nil");
+	NSAssert( inContents!=nil, @"inContents must not be nil");
+	NSAssert( [inDocumentURIs count]==[inContents count], @"inDocumentURIs and inContents must have the same count");
 	
-	BOOL success = NO;
+	if ( indexQue != nil ) [indexQue waitUntilAllOperationsAreFinished];
 	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
+	unsigned long long byteCount = 0;
+	NSDate *started = [NSDate date];
 	
-	success = SKIndexAddDocumentWithText(searchIndex, document, (CFStringRef)inContents, true);
-	if ( success ) [self _incrementChangeCount];
+	SPStatisticsStart(timed);
+	NSUInteger added = [backend addDocuments:inDocumentURIs withTexts:inContents byteCount:&byteCount];
+	SPStatisticsStop(kSPStatisticBatchAdd, timed);
 	
-bail:
-	if ( document ) CFRelease(document);
-	[writeLock unlock];
-	[pool release];
-	return success;
+	if ( outStatistics != NULL ) 
+		*outStatistics = [self _ingestStatisticsForDocumentCount:added byteCount:byteCount 
+				elapsedTime:-[started timeIntervalSinceNow]];
+	
+	return ( added == [inDocumentURIs count] );
+}
+
+- (BOOL) addDocumentsAtURL:(NSURL*)inFileURL statistics:(NSDictionary**)outStatistics {
+
+	NSAssert( inFileURL!=nil, @"inFileURL must not be nil");
+	NSAssert( [inFileURL isFileURL], @"inFileURL must be a file url");
+
+	SPSearchStoreCrawl crawl = { backend, 0 };
+	SPIngestResult result;
+	NSDate *started = [NSDate date];
+	BOOL success;
+
+	if ( indexQue != nil ) [indexQue waitUntilAllOperationsAreFinished];
+
+	@synchronized(self) {
+		if ( ingestCatalog == NULL ) ingestCatalog = SPIngestCatalogCreate();
+	}
+
+	success = SPIngestPath([[inFileURL path] fileSystemRepresentation], ingestCatalog, NULL,
+			SPSearchStoreIndexCrawledDocuments, &crawl, &result);
+
+	if ( outStatistics != NULL ) {
+		NSMutableDictionary *statistics = [NSMutableDictionary dictionaryWithDictionary:
+				[self _ingestStatisticsForDocumentCount:crawl.added byteCount:result.textByteCount
+				elapsedTime:-[started timeIntervalSinceNow]]];
+		[statistics setObject:[NSNumber numberWithUnsignedLongLong:result.unchangedCount] forKey:kSPSearchStoreIngestUnchangedCount];
+		[statistics setObject:[NSNumber numberWithUnsignedLongLong:result.failedCount] forKey:kSPSearchStoreIngestFailedCount];
+		*outStatistics = statistics;
+	}
+
+	return ( success && result.failedCount == 0 && crawl.added == result.documentCount );
+}
+
+- (void) _forgetCrawledDocument:(NSURL*)inDocumentURI {
+
+	// A removed file is crawled again even if it has not changed
+
+	const char *path;
+
+	@synchronized(self) {
+		if ( ingestCatalog != NULL && [inDocumentURI isFileURL] && (path = [[inDocumentURI path] fileSystemRepresentation]) != NULL )
+			SPIngestCatalogRemovePath(ingestCatalog, path);
+	}
 }
 
 #pragma mark -
 
 - (BOOL) removeDocument:(NSURL*)inDocumentURI {
-	
+
 	NSAssert( inDocumentURI!=nil, @"inFileURL must not be nil");
-	
+
+	[self _forgetCrawledDocument:inDocumentURI];
+
 	if ( self.usesConcurrentIndexing ) {
 		if ( indexQue == nil ) return NO;
+		SPStatisticsCount(kSPStatisticIndexQueueDepth, [indexQue operationCount]);
 		[indexQue addOperationWithBlock:^(void) {
-			[self _removeDocument:inDocumentURI];
+			SPStatisticsStart(started);
+			[backend removeDocument:inDocumentURI];
+			SPStatisticsStop(kSPStatisticRemove, started);
 		}];
 		return YES;
 	}
 	else {
-		return [self _removeDocument:inDocumentURI];
+		SPStatisticsStart(started);
+		BOOL success = [backend removeDocument:inDocumentURI];
+		SPStatisticsStop(kSPStatisticRemove, started);
+		return success;
 	}
 
 }
 
-- (BOOL) _removeDocument:(NSURL*)inDocumentURI {
-	
-	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-	[writeLock lock];
-	
-	BOOL success = NO;
-
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
-	
-	success = SKIndexRemoveDocument(searchIndex, document);
-	if ( success ) [self _incrementChangeCount];
-
-bail:
-	if ( document ) CFRelease(document);
-	[writeLock unlock];
-	[pool release];
-	return success;
-}
-
 #pragma mark -
 
 - (BOOL) replaceDocument:(NSURL*)oldDocumentURL withDocument:(NSURL*)newDocumentURL typeHint:(NSString*)inMimeHint {
-	
+
 	NSAssert( oldDocumentURL!=nil, @"oldDocumentURL must not be nil");
 	NSAssert( newDocumentURL!=nil, @"newDocumentURL must not be nil");
-	
+
+	[self _forgetCrawledDocument:oldDocumentURL];
+
 	if ( self.usesConcurrentIndexing ) {
 		if ( indexQue == nil ) return NO;
+		SPStatisticsCount(kSPStatisticIndexQueueDepth, [indexQue operationCount]);
 		[indexQue addOperationWithBlock:^(void) {
-			[self _removeDocument:oldDocumentURL];
+			SPStatisticsStart(started);
+			[backend removeDocument:oldDocumentURL];
+			SPStatisticsStop(kSPStatisticRemove, started);
 		}];
 		[indexQue addOperationWithBlock:^(void) {
-			[self _addDocument:newDocumentURL typeHint:inMimeHint];
+			SPStatisticsStart(started);
+			[backend addDocument:newDocumentURL typeHint:inMimeHint];
+			SPStatisticsStop(kSPStatisticAdd, started);
 		}];
 		return YES;
 	}
 	else {
-		BOOL success = [self _removeDocument:oldDocumentURL];
-		success = ( success && [self _addDocument:newDocumentURL typeHint:inMimeHint] );
+		SPStatisticsStart(started);
+		BOOL success = [backend removeDocument:oldDocumentURL];
+		SPStatisticsStop(kSPStatisticRemove, started);
+		
+		if ( success ) {
+			SPStatisticsStart(added);
+			success = [backend addDocument:newDocumentURL typeHint:inMimeHint];
+			SPStatisticsStop(kSPStatisticAdd, added);
+		}
 		return success;
 	}
 }
 
 - (BOOL) replaceDocument:(NSURL*)oldDocumentURI withDocument:(NSURL*)newDocumentURI withText:(NSString*)inContents {
-	
+
 	NSAssert( oldDocumentURI!=nil, @"oldDocumentURL must not be nil");
 	NSAssert( newDocumentURI!=nil, @"newDocumentURL must not be nil");
 	NSAssert( inContents!=nil, @"inContents must not be nil");
-	
+
+	[self _forgetCrawledDocument:oldDocumentURI];
+
 	if ( self.usesConcurrentIndexing ) {
 		if ( indexQue == nil ) return NO;
+		SPStatisticsCount(kSPStatisticIndexQueueDepth, [indexQue operationCount]);
 		[indexQue addOperationWithBlock:^(void) {
-			[self _removeDocument:oldDocumentURI];
+			SPStatisticsStart(started);
+			[backend removeDocument:oldDocumentURI];
+			SPStatisticsStop(kSPStatisticRemove, started);
 		}];
 		[indexQue addOperationWithBlock:^(void) {
-			[self _addDocument:newDocumentURI withText:inContents];
+			SPStatisticsStart(started);
+			[backend addDocument:newDocumentURI withText:inContents];
+			SPStatisticsStop(kSPStatisticAdd, started);
 		}];
 		return YES;
 	}
 	else {
-		BOOL success = [self _removeDocument:oldDocumentURI];
-		success = ( success && [self _addDocument:newDocumentURI withText:inContents] );
+		SPStatisticsStart(started);
+		BOOL success = [backend removeDocument:oldDocumentURI];
+		SPStatisticsStop(kSPStatisticRemove, started);
+		
+		if ( success ) {
+			SPStatisticsStart(added);
+			success = [backend addDocument:newDocumentURI withText:inContents];
+			SPStatisticsStop(kSPStatisticAdd, added);
+		}
 		return success;
 	}
 }
@@ -499,207 +662,123 @@ bail:
 #pragma mark -
 
 - (void) setProperties:(NSDictionary*)inProperties forDocument:(NSURL*)inDocumentURI {
-	
+
 	NSAssert( inDocumentURI!=nil, @"inDocumentURI cannot be nil");
 	NSAssert( inProperties!=nil, @"inProperties cannot be nil");
-	
-	[writeLock lock];
-	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
-	
-	SKIndexSetDocumentProperties(searchIndex, document, (CFDictionaryRef)inProperties);
 
-bail:
-	if ( document ) CFRelease(document);
-	[writeLock unlock];
+	[backend setProperties:inProperties forDocument:inDocumentURI];
 }
 
 - (NSDictionary*) propertiesForDocument:(NSURL*)inDocumentURI {
-	
+
 	NSAssert( inDocumentURI!=nil, @"inDocumentURI cannot be nil");
-	
-	[readLock lock];
-	
-	CFDictionaryRef properties = NULL;
-	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
 
-	properties = SKIndexCopyDocumentProperties(searchIndex, document);
-	[(id)properties autorelease];
-	
-bail:
-	if ( document ) CFRelease(document);
-	[readLock unlock];
-	return (NSDictionary*)properties;
+	return [backend propertiesForDocument:inDocumentURI];
 }
 
 - (BOOL) setName:(NSString*)inTitle forDocument:(NSURL*)inDocumentURI {
-	
+
 	NSAssert( inDocumentURI!=nil, @"inDocumentURI cannot be nil");
 	NSAssert( inTitle!=nil, @"inTitle must not be nil");
-	
-	[writeLock lock];
-	
-	BOOL success = NO;
-	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
-	
-	success = SKIndexRenameDocument(searchIndex, document, (CFStringRef)inTitle);
-	
-bail:
-	if ( document ) CFRelease(document);
-	[writeLock unlock];
-	return success;
+
+	return [backend setName:inTitle forDocument:inDocumentURI];
 }
 
 - (NSString*) nameOfDocument:(NSURL*)inDocumentURI {
-		
+
 	NSAssert( inDocumentURI!=nil, @"inDocumentURI cannot be nil");
-	
-	[readLock lock];
-	
-	CFStringRef documentName = NULL;
-	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
-	
-	documentName = SKDocumentGetName(document);
-	
-bail:
-	if ( document ) CFRelease(document);
-	[readLock unlock];
-	return (NSString*)documentName;
+
+	return [backend nameOfDocument:inDocumentURI];
 }
 
 - (SKDocumentIndexState) stateOfDocument:(NSURL*)inDocumentURI {
-	
+
 	NSAssert( inDocumentURI!=nil, @"inDocumentURI cannot be nil");
-	
-	[readLock lock];
-	
-	SKDocumentIndexState documentState = kSKDocumentStateNotIndexed;
-	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
-	
-	documentState = SKIndexGetDocumentState(searchIndex, document);
-	
-bail:
-	if ( document ) CFRelease(document);
-	[readLock unlock];
-	return documentState;
+
+	return [backend stateOfDocument:inDocumentURI];
+}
+
+- (NSInteger) documentIDForDocument:(NSURL*)inDocumentURI {
+
+	NSAssert( inDocumentURI!=nil, @"inDocumentURI cannot be nil");
+
+	return [backend documentIDForDocument:inDocumentURI];
+}
+
+- (NSURL*) documentForDocumentID:(NSInteger)inDocumentID {
+	return [backend documentForDocumentID:inDocumentID];
+}
+
+- (void) setProperties:(NSDictionary*)inProperties forDocumentID:(NSInteger)inDocumentID {
+
+	NSAssert( inProperties!=nil, @"inProperties cannot be nil");
+
+	[backend setProperties:inProperties forDocumentID:inDocumentID];
+}
+
+- (NSDictionary*) propertiesForDocumentID:(NSInteger)inDocumentID {
+	return [backend propertiesForDocumentID:inDocumentID];
 }
 
 #pragma mark -
 
 - (NSArray*) allDocuments:(BOOL)ignoreEmptyDocuments {
-	
-	// There is some curious behavior here regarding the additions SearchKit makes when indexing file 
-	// based documents. In addition to indexing the specified file, SearchKit also adds every parent 
-	// folder up to a certain (unknown) point. The folders aren't actually indexed, nor their files 
-	// which haven't been specified. 
-	
-	// The SKIndexDocumentIteratorRef will consequently return all of these "documents", even though 
-	// none of them were actually added to the index. Fortunately, these documents all have zero terms,
-	// so we check for empty documents prior to adding them to our array.
-	
-	// The trouble with this approach is that indexed documents which have a zero term count will also
-	// be filtered by this method.
-	
-	[self _flushIndexIfNecessary];
-	[readLock lock];
-	[writeLock lock];
-	
-	NSArray *allDocuments = [self _allDocumentsForDocumentRef:NULL ignoreEmptyDocuments:ignoreEmptyDocuments];
-		// Recursion. Yum.
-	
-bail:
-	[writeLock unlock];
-	[readLock unlock];
-	return [[allDocuments copy] autorelease];
-}
 
-- (NSArray*) _allDocumentsForDocumentRef:(SKDocumentRef)document ignoreEmptyDocuments:(BOOL)ignoresEmpty {
-	
-	NSMutableArray *allDocuments = [NSMutableArray array];
-	
-	SKIndexDocumentIteratorRef docIterator = SKIndexDocumentIteratorCreate(searchIndex, document);
-	if ( docIterator == NULL ) goto bail;
-	
-	SKDocumentRef subDocument = SKIndexDocumentIteratorCopyNext(docIterator);
-	if ( subDocument == NULL ) goto bail;
-	
-	while ( subDocument != NULL ) {
-		
-		CFIndex termCount = 0;
-		SKDocumentID subDocumentId = SKIndexGetDocumentID(searchIndex, subDocument);
-		if ( subDocumentId != kCFNotFound ) termCount = SKIndexGetDocumentTermCount(searchIndex, subDocumentId);
-		
-		if ( !( ignoresEmpty && (termCount == 0) ) ) {
-		
-			CFURLRef subDocumentURL = SKDocumentCopyURL(subDocument);
-			if ( subDocumentURL != NULL ) {
-				[allDocuments addObject:(NSURL*)subDocumentURL];
-				CFRelease(subDocumentURL);
-				subDocumentURL = NULL;
-			}
-		}
-		
-		NSArray *subDocuments = [self _allDocumentsForDocumentRef:subDocument ignoreEmptyDocuments:ignoresEmpty];
-		if ( subDocuments ) [allDocuments addObjectsFromArray:subDocuments];
-		
-		CFRelease(subDocument);
-		subDocument = NULL;
-		
-		subDocument = SKIndexDocumentIteratorCopyNext(docIterator);
-	}
-	
-bail:
-	if ( docIterator ) CFRelease(docIterator);
-	return [[allDocuments copy] autorelease];
+	// See the SearchKit backend for the curious behavior of file based documents and
+	// why empty documents are ignored.
+
+	return [backend allDocuments:ignoreEmptyDocuments];
 }
 
 #pragma mark -
 
 - (BOOL) compactStore:(float)tolerance {
-	
+
 	BOOL willCompact = NO;
-	
+
 	if ( tolerance == 0 ) {
 		willCompact = YES;
 	}
 	else {
-		
-		SKDocumentID maxDocumentId;
-		CFIndex documentCount;
-		
-		[readLock lock];
-		
-		documentCount = SKIndexGetDocumentCount(searchIndex);
-		maxDocumentId = SKIndexGetMaximumDocumentID(searchIndex);
-		
-		[readLock unlock];
-		
+
+		NSInteger documentCount = [backend documentCount];
+		NSInteger maxDocumentId = [backend maximumDocumentID];
+
 		if ( documentCount > 0 && maxDocumentId > 0 ) {
-			
-			CFIndex dif = ( maxDocumentId - documentCount );
+
+			NSInteger dif = ( maxDocumentId - documentCount );
 			willCompact = ( (float)( (float)dif / (float)documentCount ) > tolerance );
 		}
 	}
-	
-	if ( willCompact ) {
+
+	if ( willCompact && [backend respondsToSelector:@selector(compactsOnline)] && [backend compactsOnline] ) {
+		@synchronized(self) {
+			if ( compactionQue == nil ) {
+				compactionQue = [[NSOperationQueue alloc] init];
+				[compactionQue setMaxConcurrentOperationCount:1];
+			}
+			if ( [compactionQue operationCount] == 0 ) {
+				[compactionQue addOperationWithBlock:^(void) {
+					SPStatisticsStart(started);
+					[backend compact];
+					SPStatisticsStop(kSPStatisticCompact, started);
+				}];
+			}
+		}
+	}
+	else if ( willCompact ) {
 		if ( indexQue == nil ) {
 			indexQue = [[NSOperationQueue alloc] init];
 			[indexQue setMaxConcurrentOperationCount:1];
 		}
+		SPStatisticsCount(kSPStatisticIndexQueueDepth, [indexQue operationCount]);
 		[indexQue addOperationWithBlock:^(void) {
-			[self _compactIndex];
+			SPStatisticsStart(started);
+			[backend compact];
+			SPStatisticsStop(kSPStatisticCompact, started);
 		}];
 	}
-	
+
 	return willCompact;
 }
 
@@ -708,192 +787,133 @@ bail:
 	// otherwise the store will not return the correct results. The store is not
 	// updated until a search or term request is made, even if there have been multiple
 	// documents added, removed or replaced to the store since the last save.
-	
-	return [self _flushIndexIfNecessary];
+
+	// Native stores commit their write-ahead log, which costs as much as the changes
+	// since the last save rather than the whole index
+
+	if ( self.storeURL != nil && [backend respondsToSelector:@selector(commit)] )
+		return [backend commit];
+
+	if ( self.storeURL != nil && [backend respondsToSelector:@selector(writeToURL:)] )
+		return [backend writeToURL:self.storeURL];
+
+	return [backend flush];
+}
+
+- (BOOL) writeStoreToURL:(NSURL*)inFileURL {
+
+	NSAssert( inFileURL != nil && [inFileURL isFileURL], @"inFileURL must be a file url");
+
+	if ( ![backend respondsToSelector:@selector(writeToURL:)] )
+		return NO;
+
+	return [backend writeToURL:inFileURL];
 }
 
 - (BOOL) closeStore {
-	
+
 	BOOL success = NO;
-	
+
 	[self cancelSearch];
 	
-	[readLock lock];
-	[writeLock lock];
-	
-	SKIndexClose(searchIndex);
-	searchIndex = NULL;
-	
-	[writeLock unlock];
-	[readLock unlock];
-	
+	// an online compaction is still using the index
+	if ( compactionQue != nil ) [compactionQue waitUntilAllOperationsAreFinished];
+	[backend close];
+
 	return success;
 }
 
 #pragma mark -
 #pragma mark Searching
 
-- (void) prepareSearch:(NSString*)searchQuery options:(SKSearchOptions)searchOptions {
+- (SPSearchSession*) searchSessionForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions {
 	
 	NSAssert( searchQuery!=nil, @"searchQuery must not be nil");
 	
-	if ( [self isStillSearching] )
-		[self cancelSearch];
-	
-	[self _flushIndexIfNecessary];
-	[readLock lock];
-	
-	currentSearch = SKSearchCreate(searchIndex, (CFStringRef)searchQuery, searchOptions);
-	if ( currentSearch == NULL ) NSLog(@"there was a problem creating the search query");
-	
-	[readLock unlock];
-}
-
-- (BOOL) fetchResults:(NSArray**)outDocuments ranksArray:(NSArray**)outRanks untilFinished:(BOOL)untilComplete {
-	
-	// Convenience method to use NSArray for outRanks. May be slower due to Obj-C overhead.
+	// The generation is read before searching, so a change made while the search runs can
+	// only make the cached results newer than their key, never older
 	
-	float * ranks = NULL;
+	// Searches that fail to prepare are timed as well, so every path reaches the stop
 	
-	BOOL complete = [self fetchResults:outDocuments ranks:(outRanks==NULL?NULL:&ranks) untilFinished:untilComplete];
+	SPStatisticsStart(started);
+	SPSearchResultCache *cache = self.resultCache;
+	SPSearchSession *session = nil;
+	NSUInteger generation = [backend generation];
+	id<SPSearchBackendSearch> search = [cache searchForQuery:searchQuery options:searchOptions generation:generation];
 	
-	if ( outRanks != NULL && ranks != NULL ) {
+	if ( search == nil ) {
+		search = [backend searchWithQuery:searchQuery options:searchOptions];
 		
-		NSUInteger count = [*outDocuments count];
-		NSMutableArray *allRanks = [NSMutableArray arrayWithCapacity:count];
-		NSInteger i;
-		
-		for ( i = 0; i < count; i++ ) {
-			[allRanks addObject:[NSNumber numberWithFloat:ranks[i] ]];
-		}
+		if ( search != nil && cache != nil ) search = [cache searchCachingResultsOf:search query:searchQuery 
+				options:searchOptions generation:generation];
+	}
+	
+	if ( search != nil ) {
+		session = [[[SPSearchSession alloc] initWithSearch:search 
+				query:searchQuery 
+				options:searchOptions] autorelease];
 		
-		*outRanks = [[allRanks copy] autorelease];
-		free(ranks);
+		session.fetchCount = self.fetchCount;
+		session.fetchTime = self.fetchTime;
 	}
 	
-	return complete;
+	SPStatisticsStop(kSPStatisticSearch, started);
+	return session;
 }
 
-- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float**)outRanks untilFinished:(BOOL)untilComplete {
+#pragma mark -
+
+- (void) prepareSearch:(NSString*)searchQuery options:(SKSearchOptions)searchOptions {
 	
-	NSAssert( currentSearch!=NULL, @"currentSearch must not be nil, call prepareSearch:options: prior to this method");
-	NSAssert( outDocuments!=NULL, @"outDocuments must not be nil");
+	NSAssert( searchQuery!=nil, @"searchQuery must not be nil");
 	
-	BOOL stillSearching = YES;
+	if ( [self isStillSearching] )
+		[self cancelSearch];
 	
-	if ( untilComplete ) {
-		// fetch the results as many times as is necessary until we have acquired all of it
-		NSMutableArray *allDocuments = [NSMutableArray array];
-		float * allRanks = NULL;
-		CFIndex count = 0;
-		NSInteger i;
-		
-		while ( stillSearching ) {
-		
-			NSArray * localResults = nil;
-			float * localRanks = (outRanks==NULL ? NULL : calloc(self.fetchCount,sizeof(float)) );
-			NSInteger localCount = 0;
-			
-			stillSearching = [self _fetchResults:&localResults ranks:localRanks 
-					maxTime:(CFTimeInterval)self.fetchTime 
-					maxCount:(CFIndex)self.fetchCount];
-			
-			localCount = [localResults count];
-			count += (CFIndex)localCount;
-			
-			[allDocuments addObjectsFromArray:localResults];
-			if ( outRanks != NULL ) { // I need to keep a growing track of the ranks
-				allRanks = reallocf( allRanks, count*sizeof(float) );
-				if ( allRanks != NULL ) {
-					for ( i = 0; i < localCount; i++ ) {
-						allRanks[i+count-localCount] = localRanks[i];
-					}
-				}
-				
-				free(localRanks);
-				localRanks = NULL;
-			}
-		}
-		
-		*outDocuments = [[allDocuments copy] autorelease];
-		if ( outRanks != NULL ) *outRanks = allRanks; // caller must free
-	}
-	else {
-		// perform once, simply passing in the parameters we are given
-		
-		float * localRanks = (outRanks==NULL ? NULL : calloc(self.fetchCount,sizeof(float)) );
-		
-		stillSearching = [self _fetchResults:outDocuments ranks:localRanks 
-				maxTime:(CFTimeInterval)self.fetchTime 
-				maxCount:(CFIndex)self.fetchCount];
-				
-		if ( outRanks != NULL ) *outRanks = localRanks;
-	}
+	SPSearchSession *session = [self searchSessionForQuery:searchQuery options:searchOptions];
 	
-	if ( stillSearching == NO ) {
-		SKSearchCancel(currentSearch);
-		CFRelease(currentSearch);
-		currentSearch = NULL;
+	@synchronized(self) {
+		[currentSearch release];
+		currentSearch = [session retain];
 	}
-	
-	return stillSearching;
 }
 
-- (BOOL) _fetchResults:(NSArray**)outDocuments ranks:(float*)outRanks 
-		maxTime:(CFTimeInterval)maxTime maxCount:(CFIndex)maxCount {
-	
-	// outRanks should contain enough memory to hold maxCount floats
-	
-	CFTimeInterval kMaxTime = maxTime;
-	CFIndex kMaxCount = maxCount;
-	
-	NSMutableArray *documents = [NSMutableArray array];
-	BOOL stillSearching = YES;
-	NSInteger i;
-	
-	[readLock lock];
-	
-	float *documentScores = ( outRanks == NULL ? NULL : calloc(kMaxCount,sizeof(float)) );
-	SKDocumentID *documentIds = calloc(kMaxCount,sizeof(SKDocumentID));
-	CFURLRef *documentURLs = NULL;
-	CFIndex documentCount = 0;
+- (BOOL) fetchResults:(NSArray**)outDocuments ranksArray:(NSArray**)outRanks untilFinished:(BOOL)untilComplete {
 	
-	stillSearching = SKSearchFindMatches(currentSearch, kMaxCount, documentIds, 
-			documentScores, kMaxTime, &documentCount);
+	SPSearchSession *session = [self _currentSearch];
+	NSAssert( session!=nil, @"currentSearch must not be nil, call prepareSearch:options: prior to this method");
 	
-	documentURLs = calloc(documentCount, sizeof(CFURLRef));
+	BOOL stillSearching = [session fetchResults:outDocuments ranksArray:outRanks untilFinished:untilComplete];
+	if ( stillSearching == NO ) [self _clearCurrentSearch:session];
 	
-	SKIndexCopyDocumentURLsForDocumentIDs(searchIndex, documentCount, documentIds, documentURLs);
+	return stillSearching;
+}
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float**)outRanks untilFinished:(BOOL)untilComplete {
 	
-	for ( i = 0; i < documentCount; i++ ) {
-		if ( outRanks != NULL ) outRanks[i] = documentScores[i];
-		[documents addObject:(NSURL*)documentURLs[i]];
-		CFRelease(documentURLs[i]);
-	}
+	SPSearchSession *session = [self _currentSearch];
+	NSAssert( session!=nil, @"currentSearch must not be nil, call prepareSearch:options: prior to this method");
 	
-	free(documentScores);
-	free(documentURLs);
-	free(documentIds);
+	BOOL stillSearching = [session fetchResults:outDocuments ranks:outRanks untilFinished:untilComplete];
+	if ( stillSearching == NO ) [self _clearCurrentSearch:session];
 	
-	*outDocuments = [[documents copy] autorelease];
-	[readLock unlock];
 	return stillSearching;
 }
 
 #pragma mark -
 
 - (float*) copyNormalizedRankings:(float*)inRankings {
-	
+
 	float maxValue = 0.0;
-	NSInteger i; 
-	
+	NSInteger i;
+
 	NSUInteger count = sizeof(inRankings) / sizeof(float);
 	float *normalizedRankings = calloc(count, sizeof(float));
-	
+
 	for ( i = 0; i < count; i++ ) {
 		if ( inRankings[i] > maxValue ) maxValue = inRankings[i];
 	}
-	
+
 	for ( i = 0; i < count; i++ ) {
 		normalizedRankings[i] = ( maxValue == 0.0 ? 1.0 : inRankings[i] / maxValue );
 	}
@@ -902,338 +922,429 @@ bail:
 }
 
 - (NSArray*) normalizedRankingsArray:(NSArray*)inRankings {
-	
+
 	float maxValue = 0.0;
 	NSUInteger count = [inRankings count];
 	NSInteger i;
-	
+
 	NSMutableArray *normalizedArray = [NSMutableArray arrayWithCapacity:count];
-	
+
 	for ( i = 0; i < count; i++ ) {
 		float val = [[inRankings objectAtIndex:i] floatValue];
 		if ( val > maxValue ) maxValue = val;
 	}
-	
+
 	for ( i = 0; i < count; i++ ) {
 		float val = [[inRankings objectAtIndex:i] floatValue];
 		float normalized = ( maxValue == 0.0 ? 1.0 : val / maxValue );
 		[normalizedArray addObject:[NSNumber numberWithFloat:normalized]];
 	}
-	
+
 	return [[normalizedArray copy] autorelease];
 }
 
 - (BOOL) isStillSearching {
-	BOOL stillSearching;
-	
-	[readLock lock];
-	stillSearching = ( currentSearch != NULL );
-	[readLock unlock];
-	
-	return stillSearching;
+	return [[self _currentSearch] isStillSearching];
 }
 
 - (void) cancelSearch {
-	[readLock lock];
 	
-	if ( currentSearch != NULL ) {
-		SKSearchCancel(currentSearch);
-		CFRelease(currentSearch);
-		currentSearch = NULL;
+	SPSearchSession *session = nil;
+	
+	@synchronized(self) {
+		session = currentSearch;
+		currentSearch = nil;
 	}
 	
-	[readLock unlock];
+	[session cancel];
+	[session release];
 }
 
 #pragma mark -
-#pragma mark Document Terms
 
-- (NSArray*) allTerms {
-	
-	NSAssert( indexType == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
-	
-	[self _flushIndexIfNecessary];
-	[readLock lock];
-	
-	// flush the index before calling - (BOOL) writeIndexToDisk
-	NSMutableSet *allTerms = [NSMutableSet set];
-	
-	CFIndex maxTermID = SKIndexGetMaximumTermID(searchIndex);
-	CFIndex aTermID;
-	
-	for ( aTermID = 0; aTermID < maxTermID; aTermID++ )
-	{
-		CFIndex documentCount = SKIndexGetTermDocumentCount( searchIndex, aTermID );
-		if ( documentCount == 0 ) // may be the case if the index has not been recently flushed
-			continue;
-		
-		CFStringRef aTerm = SKIndexCopyTermStringForTermID( searchIndex, aTermID );
-		if ( aTerm == NULL ) {
-			NSLog(@"%s - unable to get term for term index %ld", __PRETTY_FUNCTION__, aTermID);
-			continue;
-		}
-		
-		if ( !( self.ignoresNumericTerms && CFStringGetCharacterAtIndex(aTerm,0) < 0x0041 ) )
-			[allTerms addObject:(NSString*)aTerm];
-		
-		CFRelease(aTerm);
-	}
+- (NSArray*) topResultsForQuery:(NSString*)searchQuery limit:(NSUInteger)limit {
+	return [self topResultsForQuery:searchQuery options:kSKSearchOptionDefault limit:limit ranks:NULL];
+}
+
+- (NSArray*) topResultsForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions 
+		limit:(NSUInteger)limit ranks:(float**)outRanks {
 	
-	[readLock unlock];
+	NSAssert( searchQuery!=nil, @"searchQuery must not be nil");
 	
-	// somewhat annoyingly, SearchKit includes the stop words as document terms
-	if ( self.stopWords != nil ) [allTerms minusSet:self.stopWords];
+	SPStatisticsStart(started);
+	float *ranks = ( outRanks == NULL ? NULL : calloc(( limit == 0 ? 1 : limit ), sizeof(float)) );
+	NSArray *documents = [backend topResultsForQuery:searchQuery options:searchOptions limit:limit ranks:ranks];
+	SPStatisticsStop(kSPStatisticTopResults, started);
 	
-	NSArray *termsArray = [allTerms allObjects];
-	return termsArray;
+	if ( outRanks != NULL ) *outRanks = ranks;
+	return documents;
+}
+
+#pragma mark -
+#pragma mark Document Terms
+
+- (NSArray*) allTerms {
+	return [self termsWithPrefix:nil limit:0];
+}
+
+- (NSArray*) termsWithPrefix:(NSString*)inPrefix limit:(NSUInteger)limit {
+
+	NSMutableArray *terms = [NSMutableArray array];
+
+	[self enumerateTermsWithPrefix:inPrefix usingBlock:^(NSString *term, NSUInteger documentCount, BOOL *stop) {
+		[terms addObject:term];
+		if ( [terms count] == limit ) *stop = YES;
+	}];
+
+	return terms;
+}
+
+- (void) enumerateTermsWithPrefix:(NSString*)inPrefix 
+		usingBlock:(void (^)(NSString *term, NSUInteger documentCount, BOOL *stop))block {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+	NSAssert( block != nil, @"block must not be nil");
+
+	BOOL ignoresNumbers = self.ignoresNumericTerms;
+	NSSet *ignoredWords = self.stopWords;
+
+	SPStatisticsStart(started);
+	[backend enumerateTermsWithPrefix:inPrefix usingBlock:^(NSString *term, NSUInteger documentCount, BOOL *stop) {
+		if ( ![self _isFilteredTerm:term ignoringNumbers:ignoresNumbers words:ignoredWords] )
+			block(term, documentCount, stop);
+	}];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 }
 
 #pragma mark -
 
 - (NSUInteger) documentCountForTerm:(NSString*)inTerm {
-	
-	NSAssert( indexType == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
 	NSAssert( inTerm != nil && [inTerm length] > 0, @"inTerm must not be nil or an empty string" );
-	
-	[self _flushIndexIfNecessary];
-	[readLock lock];
-	
-	CFIndex documentCount = 0;
-	
-	// flush the index before calling - (BOOL) writeIndexToDisk
-	CFIndex aTermID = SKIndexGetTermIDForTermString( searchIndex, (CFStringRef)inTerm );
-	if ( aTermID == kCFNotFound ) goto bail;
-	
-	documentCount = SKIndexGetTermDocumentCount( searchIndex, aTermID );
 
-bail:
-	[readLock unlock];
-	return documentCount;
+	SPStatisticsStart(started);
+	NSUInteger count = [backend documentCountForTerm:inTerm];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
+	
+	return count;
 }
 
 - (NSArray*) documentsForTerm:(NSString*)inTerm {
-	
-	NSAssert( indexType == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
 	NSAssert( inTerm != nil && [inTerm length] > 0, @"inTerm must not be nil or an empty string" );
+
+	SPStatisticsStart(started);
+	NSArray *documents = [backend documentsForTerm:inTerm];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 	
-	[self _flushIndexIfNecessary];
-	[readLock lock];
-	
-	NSMutableArray *documents = [NSMutableArray array];
-	
-	CFArrayRef documentIdsArray = NULL;
-	SKDocumentID *documentIds = NULL;
-	CFURLRef *documentURLs = NULL;
-	
-	CFIndex termId = SKIndexGetTermIDForTermString( searchIndex, (CFStringRef)inTerm );
-	if ( termId == kCFNotFound ) goto bail;
-	
-	CFIndex documentCount = SKIndexGetTermDocumentCount( searchIndex, termId );
-	if ( documentCount == 0 ) goto bail;
-	
-	documentIdsArray = SKIndexCopyDocumentIDArrayForTermID( searchIndex, termId );
-	if ( documentIdsArray == NULL ) goto bail;
-	
-	// I must convert the CFArray to a SKDocumentID * memory block.
-	// Annoying. Is there is a better process, or am I cocoa spoiled?
-	
-	// I don't know why I can't use:
-	// CFArrayGetValues(documentIdsArray, CFRangeMake(0,docIdCount), (const void **)documentIds);
-	
-	CFIndex docIdCount = CFArrayGetCount(documentIdsArray);
-	
-	documentIds = calloc( docIdCount, sizeof(SKDocumentID) );
-	documentURLs = calloc( docIdCount, sizeof(CFURLRef) );
-	
-	NSInteger i, x = 0;
-	for ( i = 0; i < docIdCount; i++ ) {
-		SKDocumentID aDocumentId;
-		const void * value = CFArrayGetValueAtIndex(documentIdsArray,i);
-		if ( CFNumberGetValue( (CFNumberRef)value, kCFNumberSInt32Type, &aDocumentId ) ) {
-			documentIds[x++] = aDocumentId;
-		}
-	}
-	
-	SKIndexCopyDocumentURLsForDocumentIDs( searchIndex, docIdCount, documentIds, documentURLs);
-	
-		// On input, a pointer to an array for document URLs (CFURL objects). On output, points to the 
-		// previously allocated array, which now contains document URLs corresponding to the document IDs 
-		// in inDocumentIDArray. When finished with the document URL array, dispose of it by calling 
-		// CFRelease on each array element.
-	
-	
-	for ( i = 0; i < docIdCount; i++ ) {
-		[documents addObject:(NSURL*)documentURLs[i]];
-		CFRelease(documentURLs[i]);
-	}
-	
-bail:
-	if ( documentIdsArray ) CFRelease(documentIdsArray);
-	if ( documentURLs ) free(documentURLs);
-	if ( documentIds ) free(documentIds);
-	[readLock unlock];
 	return documents;
 }
 
 #pragma mark -
 
 - (NSUInteger) termCountForDocument:(NSURL*)inDocumentURI {
-	
-	NSAssert( indexType == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
 	NSAssert( inDocumentURI != nil, @"inDocumentURI must not be nil");
+
+	SPStatisticsStart(started);
+	NSUInteger count = [backend termCountForDocument:inDocumentURI];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 	
-	[self _flushIndexIfNecessary];
-	[readLock lock];
-	
-	CFIndex termCount = 0;
-	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
-	
-	SKDocumentID documentId = SKIndexGetDocumentID(searchIndex, document);
-	if ( documentId == kCFNotFound ) goto bail;
-		
-	termCount = SKIndexGetDocumentTermCount(searchIndex, documentId);
-	
-bail:	
-	if ( document ) CFRelease(document);
-	[readLock unlock];
-	return termCount;
+	return count;
 }
 
 - (NSArray*) termsForDocument:(NSURL*)inDocumentURI {
-	
-	NSAssert( indexType == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
 	NSAssert( inDocumentURI != nil, @"inDocumentURI must not be nil");
-	
-	[self _flushIndexIfNecessary];
-	[readLock lock];
-	
-	NSMutableSet *documentTerms = [NSMutableSet set];
-	
-	CFArrayRef termIds = NULL;
-	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
-	
-	SKDocumentID documentId = SKIndexGetDocumentID(searchIndex, document);
-	if ( documentId == kCFNotFound ) goto bail;
 
-	termIds = SKIndexCopyTermIDArrayForDocumentID( searchIndex, documentId );
-	if ( termIds == NULL ) goto bail;
-	
-	// convert the termIds to actual terms, by way of these annoying get values method again
+	SPStatisticsStart(started);
+	NSArray *terms = [self _filteredTerms:[backend termsForDocument:inDocumentURI]];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 	
-	CFIndex termCount = CFArrayGetCount(termIds);
-	NSInteger i;
-	
-	for ( i = 0; i < termCount; i++ ) {
-		
-		CFNumberRef aNumberRef = CFArrayGetValueAtIndex(termIds,i);
-		CFIndex aTermId;
-		
-		if ( !CFNumberGetValue( aNumberRef, kCFNumberSInt32Type, &aTermId) )
-			continue; 
-		
-		CFIndex documentCount = SKIndexGetTermDocumentCount( searchIndex, aTermId );
-		if ( documentCount == 0 ) // if the index has not been compacted
-			continue;
-		
-		CFStringRef aTerm = SKIndexCopyTermStringForTermID( searchIndex, aTermId );
-		if ( aTerm == NULL ) 
-			continue;
-		
-		if ( !( self.ignoresNumericTerms && CFStringGetCharacterAtIndex(aTerm,0) < 0x0041 ) )
-			[documentTerms addObject:(NSString*)aTerm];
-		
-		CFRelease(aTerm);
-	}
-	
-bail:
-	if ( document ) CFRelease(document);
-	if ( termIds ) CFRelease(termIds);
-	[readLock unlock];
-	
-	if ( self.stopWords != nil ) [documentTerms minusSet:self.stopWords];
-	
-	NSArray *termsArray = [documentTerms allObjects];
-	return termsArray;
+	return terms;
 }
 
 - (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocument:(NSURL*)inDocumentURI {
-	
-	NSAssert( indexType == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
 	NSAssert( inTerm != nil && [inTerm length] > 0, @"inTerm must not be nil or an empty string" );
 	NSAssert( inDocumentURI != nil, @"inDocumentURI must not be nil");
+
+	SPStatisticsStart(started);
+	NSUInteger frequency = [backend frequencyOfTerm:inTerm inDocument:inDocumentURI];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 	
-	[self _flushIndexIfNecessary];
-	[readLock lock];
-	
-	CFIndex termCount = 0;
-	
-	SKDocumentRef document = SKDocumentCreateWithURL((CFURLRef)inDocumentURI);
-	if ( document == NULL ) goto bail;
+	return frequency;
+}
+
+#pragma mark -
+
+- (NSIndexSet*) documentIDsForTerm:(NSString*)inTerm {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+	NSAssert( inTerm != nil && [inTerm length] > 0, @"inTerm must not be nil or an empty string" );
+
+	SPStatisticsStart(started);
+	NSIndexSet *documents = [backend documentIDsForTerm:inTerm];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 	
-	SKDocumentID documentId = SKIndexGetDocumentID(searchIndex, document);
-	if ( documentId == kCFNotFound ) goto bail;
+	return documents;
+}
+
+- (NSUInteger) termCountForDocumentID:(NSInteger)inDocumentID {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	SPStatisticsStart(started);
+	NSUInteger count = [backend termCountForDocumentID:inDocumentID];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 	
-	CFIndex termId = SKIndexGetTermIDForTermString( searchIndex, (CFStringRef)inTerm );
-	if ( termId == kCFNotFound ) goto bail;
+	return count;
+}
+
+- (NSArray*) termsForDocumentID:(NSInteger)inDocumentID {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	SPStatisticsStart(started);
+	NSArray *terms = [self _filteredTerms:[backend termsForDocumentID:inDocumentID]];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 	
-	termCount = SKIndexGetDocumentTermFrequency( searchIndex, documentId, termId);
+	return terms;
+}
+
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocumentID:(NSInteger)inDocumentID {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+	NSAssert( inTerm != nil && [inTerm length] > 0, @"inTerm must not be nil or an empty string" );
+
+	SPStatisticsStart(started);
+	NSUInteger frequency = [backend frequencyOfTerm:inTerm inDocumentID:inDocumentID];
+	SPStatisticsStop(kSPStatisticTermQuery, started);
 	
-bail:
-	if ( document ) CFRelease(document);
-	[readLock unlock];
-	return termCount;
+	return frequency;
 }
 
 #pragma mark -
-#pragma mark Utilities
+#pragma mark Similarity
+
+- (NSArray*) documentsSimilarToDocument:(NSURL*)inDocumentURI limit:(NSUInteger)limit ranks:(float**)outRanks {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+	NSAssert( inDocumentURI != nil, @"inDocumentURI must not be nil");
+
+	float *ranks = ( outRanks == NULL ? NULL : calloc(( limit == 0 ? 1 : limit ), sizeof(float)) );
+	NSArray *documents = nil;
+
+	if ( [backend respondsToSelector:@selector(documentsSimilarToDocument:limit:ranks:)] ) {
+		documents = [backend documentsSimilarToDocument:inDocumentURI limit:limit ranks:ranks];
+	}
+	else {
+
+		// SearchKit finds the document itself, which is dropped from the results
+
+		NSString *query = [[self termsForDocument:inDocumentURI] componentsJoinedByString:@" "];
+		float *queryRanks = calloc(limit + 1, sizeof(float));
+		NSMutableArray *similar = [NSMutableArray arrayWithCapacity:limit];
+		NSArray *matches = ( [query length] == 0 ? [NSArray array] : 
+				[backend topResultsForQuery:query options:kSKSearchOptionFindSimilar limit:limit + 1 ranks:queryRanks] );
+		NSUInteger i;
+
+		for ( i = 0; i < [matches count] && [similar count] < limit; i++ ) {
+			if ( [[matches objectAtIndex:i] isEqual:inDocumentURI] ) continue;
+			if ( ranks != NULL ) ranks[[similar count]] = queryRanks[i];
+			[similar addObject:[matches objectAtIndex:i]];
+		}
+
+		free(queryRanks);
+		documents = similar;
+	}
 
-- (void) _incrementChangeCount {
-	changeCount++;
+	if ( outRanks != NULL ) *outRanks = ranks;
+	return documents;
 }
 
-- (BOOL) _flushIndexIfNecessary {
-	if ( changeCount == 0 ) 
-		return YES;
-	
-	// Before searching an index, always call SKIndexFlush, even though the flush process may take up to 
-	// several seconds. If there are no updates to commit, a call to SKIndexFlush does nothing 
-	// and takes minimal time.
-	
-	BOOL success = NO;
-	[writeLock lock];
-	
-	success = SKIndexFlush(searchIndex);
-	if ( success ) changeCount = 0;
-	
-	[writeLock unlock];
-	
+- (NSArray*) nearDuplicatesOfDocument:(NSURL*)inDocumentURI threshold:(float)threshold {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+	NSAssert( inDocumentURI != nil, @"inDocumentURI must not be nil");
+
+	if ( ![backend respondsToSelector:@selector(nearDuplicatesOfDocument:threshold:)] )
+		return nil;
+
+	return [backend nearDuplicatesOfDocument:inDocumentURI threshold:threshold];
+}
+
+- (NSArray*) nearDuplicatePairsWithThreshold:(float)threshold {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	if ( ![backend respondsToSelector:@selector(nearDuplicatePairsWithThreshold:)] )
+		return nil;
+
+	return [backend nearDuplicatePairsWithThreshold:threshold];
+}
+
+#pragma mark -
+#pragma mark Term Graph
+
+- (SPGraphRef) copyTermGraphWithOrientation:(SPGraphOrientation)orientation documentIDs:(NSRange)range {
+
+	NSAssert( [backend indexType] == kSKIndexInvertedVector, @"index must be of type kSKIndexInvertedVector");
+
+	if ( ![backend respondsToSelector:@selector(copyGraphWithOrientation:documentIDs:)] )
+		return NULL;
+
+	return [backend copyGraphWithOrientation:orientation documentIDs:range];
+}
+
+- (BOOL) writeTermGraphToURL:(NSURL*)fileURL orientation:(SPGraphOrientation)orientation documentIDs:(NSRange)range {
+
+	NSAssert( fileURL != nil && [fileURL isFileURL], @"fileURL must be a file url");
+
+	SPGraphRef graph = [self copyTermGraphWithOrientation:orientation documentIDs:range];
+	if ( graph == NULL ) return NO;
+
+	BOOL success = SPGraphWriteToFile(graph, [[fileURL path] fileSystemRepresentation]);
+	SPGraphRelease(graph);
+
 	return success;
 }
 
-- (BOOL) _compactIndex {
-	
-	// To check for bloat you can take advantage of the way Search Kit assigns document IDs. 
-	// It does so starting at 1 and without reusing previously allocated IDs for an index. 
-	// Simply compare the highest document ID, found with the SKIndexGetMaximumDocumentID() function, 
-	// with the current document count, found with the SKIndexGetDocumentCount() function.
-	
-	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-	BOOL success = NO;
-	
-	[readLock lock];
-	[writeLock lock];
-	
-	success = SKIndexCompact(searchIndex);
+#pragma mark -
+#pragma mark Statistics
+
+- (NSDictionary*) statisticsSnapshot {
+
+	NSMutableDictionary *snapshot = [NSMutableDictionary dictionary];
+	SPSearchResultCache *cache = self.resultCache;
+	NSUInteger queued = 0;
+
+#if SPSEARCHSTORE_STATISTICS
+	SPHistogram histograms[kSPStatisticCount];
+	SPStatistic statistic;
+
+	SPStatisticsCopySnapshot(histograms);
+
+	for ( statistic = 0; statistic < kSPStatisticCount; statistic++ ) {
+		[snapshot setObject:[self _dictionaryWithHistogram:&histograms[statistic] isTime:SPStatisticIsTime(statistic)] 
+				forKey:[NSString stringWithUTF8String:SPStatisticGetName(statistic)]];
+	}
+#endif
+
+	@synchronized(self) {
+		queued = ( indexQue == nil ? 0 : [indexQue operationCount] );
+	}
+
+	[snapshot setObject:[NSNumber numberWithUnsignedInteger:queued] forKey:kSPSearchStoreIndexQueueOperationCount];
+
+	if ( cache != nil ) {
+		[snapshot setObject:[NSNumber numberWithUnsignedInteger:cache.count] forKey:kSPSearchStoreResultCacheCount];
+		[snapshot setObject:[NSNumber numberWithUnsignedInteger:cache.memorySize] forKey:kSPSearchStoreResultCacheMemorySize];
+		[snapshot setObject:[NSNumber numberWithUnsignedInteger:cache.hitCount] forKey:kSPSearchStoreResultCacheHitCount];
+		[snapshot setObject:[NSNumber numberWithUnsignedInteger:cache.missCount] forKey:kSPSearchStoreResultCacheMissCount];
+		[snapshot setObject:[NSNumber numberWithUnsignedInteger:cache.evictionCount] forKey:kSPSearchStoreResultCacheEvictionCount];
+		[snapshot setObject:[NSNumber numberWithUnsignedInteger:cache.invalidationCount] forKey:kSPSearchStoreResultCacheInvalidationCount];
+	}
+
+	return snapshot;
+}
+
+#pragma mark -
+#pragma mark Utilities
+
+- (SPSearchSession*) _currentSearch {
+	SPSearchSession *session = nil;
+	@synchronized(self) {
+		session = [[currentSearch retain] autorelease];
+	}
+	return session;
+}
+
+- (void) _clearCurrentSearch:(SPSearchSession*)session {
+	@synchronized(self) {
+		if ( currentSearch == session ) {
+			[currentSearch release];
+			currentSearch = nil;
+		}
+	}
+}
+
+- (NSDictionary*) _ingestStatisticsForDocumentCount:(NSUInteger)documentCount byteCount:(unsigned long long)byteCount 
+		elapsedTime:(NSTimeInterval)elapsed {
 	
-	[writeLock unlock];
-	[readLock unlock];
+	double seconds = ( elapsed > 0 ? elapsed : 0 );
 	
-	[pool release];
-	return success;
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+			[NSNumber numberWithUnsignedInteger:documentCount], kSPSearchStoreIngestDocumentCount,
+			[NSNumber numberWithUnsignedLongLong:byteCount], kSPSearchStoreIngestByteCount,
+			[NSNumber numberWithDouble:seconds], kSPSearchStoreIngestElapsedTime,
+			[NSNumber numberWithDouble:( seconds == 0 ? 0 : documentCount / seconds )], kSPSearchStoreIngestDocumentsPerSecond,
+			[NSNumber numberWithDouble:( seconds == 0 ? 0 : byteCount / seconds )], kSPSearchStoreIngestBytesPerSecond,
+			nil];
+}
+
+- (NSDictionary*) _dictionaryWithHistogram:(const SPHistogram*)histogram isTime:(BOOL)isTime {
+
+	// Times are recorded in nanoseconds and reported in seconds. Buckets past the last
+	// one in use are left off.
+
+	double scale = ( isTime ? 1e-9 : 1.0 );
+	NSMutableArray *buckets = [NSMutableArray array];
+	NSInteger b, last = -1;
+
+	for ( b = 0; b < kSPHistogramBucketCount; b++ ) {
+		if ( histogram->buckets[b] != 0 ) last = b;
+	}
+
+	for ( b = 0; b <= last; b++ ) {
+		[buckets addObject:[NSNumber numberWithUnsignedLongLong:histogram->buckets[b]]];
+	}
+
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+			[NSNumber numberWithUnsignedLongLong:histogram->count], kSPSearchStoreStatisticCount,
+			[NSNumber numberWithDouble:histogram->total * scale], kSPSearchStoreStatisticTotal,
+			[NSNumber numberWithDouble:( histogram->count == 0 ? 0 : histogram->total * scale / histogram->count )], kSPSearchStoreStatisticMean,
+			[NSNumber numberWithDouble:histogram->maximum * scale], kSPSearchStoreStatisticMaximum,
+			[NSNumber numberWithDouble:SPHistogramGetPercentile(histogram, 0.5) * scale], kSPSearchStoreStatisticMedian,
+			[NSNumber numberWithDouble:SPHistogramGetPercentile(histogram, 0.9) * scale], kSPSearchStoreStatistic90thPercentile,
+			[NSNumber numberWithDouble:SPHistogramGetPercentile(histogram, 0.99) * scale], kSPSearchStoreStatistic99thPercentile,
+			buckets, kSPSearchStoreStatisticBuckets,
+			nil];
+}
+
+- (BOOL) _isFilteredTerm:(NSString*)aTerm ignoringNumbers:(BOOL)ignoresNumbers words:(NSSet*)ignoredWords {
+
+	// somewhat annoyingly, SearchKit includes the stop words as document terms
+
+	if ( ignoresNumbers && [aTerm length] > 0 && [aTerm characterAtIndex:0] < 0x0041 )
+		return YES;
+	if ( [ignoredWords containsObject:aTerm] )
+		return YES;
+
+	return NO;
+}
+
+- (NSArray*) _filteredTerms:(NSArray*)inTerms {
+
+	BOOL ignoresNumbers = self.ignoresNumericTerms;
+	NSSet *ignoredWords = self.stopWords;
+
+	if ( !ignoresNumbers && ignoredWords == nil )
+		return inTerms;
+
+	NSMutableArray *terms = [NSMutableArray arrayWithCapacity:[inTerms count]];
+
+	for ( NSString *aTerm in inTerms ) {
+		if ( ![self _isFilteredTerm:aTerm ignoringNumbers:ignoresNumbers words:ignoredWords] )
+			[terms addObject:aTerm];
+	}
+
+	return terms;
 }
 
 @end
@@ -0,0 +1,796 @@
+//
+//  SPSegment.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPSegment.h"
+#include "SPPostingList.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#pragma mark Byte Buffers
+
+typedef struct {
+	uint8_t *bytes;
+	size_t length;
+	size_t capacity;
+} SPByteBuffer;
+
+static bool SPByteBufferReserve(SPByteBuffer *buffer, size_t length) {
+
+	if ( buffer->length + length <= buffer->capacity )
+		return true;
+
+	size_t capacity = ( buffer->capacity == 0 ? 4096 : buffer->capacity );
+	while ( capacity < buffer->length + length ) capacity *= 2;
+
+	uint8_t *bytes = realloc(buffer->bytes, capacity);
+	if ( bytes == NULL ) return false;
+
+	buffer->bytes = bytes;
+	buffer->capacity = capacity;
+	return true;
+}
+
+static bool SPByteBufferAppend(SPByteBuffer *buffer, const void *bytes, size_t length) {
+	if ( !SPByteBufferReserve(buffer, length) ) return false;
+	if ( length > 0 ) memcpy(buffer->bytes + buffer->length, bytes, length);
+	buffer->length += length;
+	return true;
+}
+
+static bool SPByteBufferAppendPosting(SPByteBuffer *buffer, uint32_t gap, uint32_t frequency) {
+	if ( !SPByteBufferReserve(buffer, 10) ) return false;
+	buffer->length += SPVarIntEncode(gap, buffer->bytes + buffer->length);
+	buffer->length += SPVarIntEncode(frequency, buffer->bytes + buffer->length);
+	return true;
+}
+
+static bool SPByteBufferAppendPositions(SPByteBuffer *buffer, const uint32_t *positions, uint32_t count) {
+	if ( !SPByteBufferReserve(buffer, 5 + (size_t)count * 5) ) return false;
+	buffer->length += SPPositionListEncode(positions, count, buffer->bytes + buffer->length);
+	return true;
+}
+
+#pragma mark -
+#pragma mark Mapped Files
+
+SPMappedFile * SPMappedFileRetain(SPMappedFile *file) {
+	if ( file != NULL ) __sync_fetch_and_add(&file->retainCount, 1);
+	return file;
+}
+
+void SPMappedFileRelease(SPMappedFile *file) {
+	if ( file == NULL || __sync_sub_and_fetch(&file->retainCount, 1) != 0 ) return;
+	munmap(file->bytes, file->length);
+	free(file);
+}
+
+#pragma mark -
+#pragma mark Deletion Sets
+
+SPDeletionSet * SPDeletionSetCreateCopy(const SPDeletionSet *set, SPDocumentID capacity) {
+
+	SPDeletionSet *copy = calloc(1, sizeof(SPDeletionSet));
+	if ( copy == NULL ) return NULL;
+
+	if ( set != NULL && set->capacity > capacity ) capacity = set->capacity;
+	capacity = ( capacity + 8 ) & ~7;
+
+	copy->bits = calloc((size_t)capacity / 8, 1);
+	if ( copy->bits == NULL ) {
+		free(copy);
+		return NULL;
+	}
+
+	if ( set != NULL ) memcpy(copy->bits, set->bits, (size_t)set->capacity / 8);
+
+	copy->capacity = capacity;
+	copy->retainCount = 1;
+	return copy;
+}
+
+SPDeletionSet * SPDeletionSetRetain(SPDeletionSet *set) {
+	if ( set != NULL ) __sync_fetch_and_add(&set->retainCount, 1);
+	return set;
+}
+
+void SPDeletionSetRelease(SPDeletionSet *set) {
+	if ( set == NULL || __sync_sub_and_fetch(&set->retainCount, 1) != 0 ) return;
+	free(set->bits);
+	free(set);
+}
+
+void SPDeletionSetAdd(SPDeletionSet *set, SPDocumentID document) {
+	if ( document < set->capacity ) set->bits[document >> 3] |= (uint8_t)( 1 << ( document & 7 ) );
+}
+
+#pragma mark -
+#pragma mark Segment Creation
+
+typedef struct {
+	SPDocumentID document;
+	uint32_t frequency;
+	uint32_t length;				// of the document
+	const uint32_t *positions;		// frequency of them, NULL without positions
+} SPSegmentPosting;
+
+static bool SPSegmentTermAppendPosting(SPSegmentTerm *term, SPByteBuffer *postings, SPByteBuffer *blocks, 
+		const SPByteBuffer *positions, uint32_t document, uint32_t frequency, uint32_t length) {
+
+	// Appends a posting to the term being written, opening a new skip block every
+	// kSPSegmentBlockSize postings. The term's postingsOffset, blockOffset and, when
+	// positions is not NULL, positionsOffset must be set. The caller appends the
+	// posting's position list afterwards.
+
+	SPSegmentBlock *block;
+	uint32_t lastDocument = 0;
+
+	if ( term->blockCount > 0 ) {
+		block = (SPSegmentBlock*)blocks->bytes + term->blockOffset + term->blockCount - 1;
+		lastDocument = block->lastDocument;
+	}
+
+	if ( term->documentCount % kSPSegmentBlockSize == 0 ) {
+		SPSegmentBlock opened = { 0, (uint32_t)( postings->length - term->postingsOffset ), 0, UINT32_MAX, 
+				( positions == NULL ? 0 : (uint32_t)( positions->length - term->positionsOffset ) ) };
+		if ( !SPByteBufferAppend(blocks, &opened, sizeof(SPSegmentBlock)) ) return false;
+		term->blockCount++;
+	}
+
+	if ( !SPByteBufferAppendPosting(postings, document - lastDocument, frequency) ) return false;
+
+	block = (SPSegmentBlock*)blocks->bytes + term->blockOffset + term->blockCount - 1;
+	block->lastDocument = document;
+	if ( frequency > block->maxFrequency ) block->maxFrequency = frequency;
+	if ( length < block->minLength ) block->minLength = length;
+
+	if ( frequency > term->maxFrequency ) term->maxFrequency = frequency;
+	if ( length < term->minLength || term->documentCount == 0 ) term->minLength = length;
+	term->documentCount++;
+
+	return true;
+}
+
+typedef struct {
+	SPTermID term;
+	uint32_t frequency;
+	uint32_t index;					// of the term in the analyzed text
+} SPSegmentVectorEntry;
+
+static int SPCompareVectorEntries(const void *a, const void *b) {
+	const SPSegmentVectorEntry *x = a, *y = b;
+	return ( x->term < y->term ? -1 : ( x->term > y->term ? 1 : 0 ) );
+}
+
+typedef struct {
+	SPTermID term;
+	const char *string;
+	uint32_t length;
+	uint32_t bucket;				// first posting of the term in the bucket array
+	uint32_t count;
+} SPSegmentTermEntry;
+
+static int SPCompareTermEntryIDs(const void *a, const void *b) {
+	SPTermID x = ((const SPSegmentTermEntry*)a)->term, y = ((const SPSegmentTermEntry*)b)->term;
+	return ( x < y ? -1 : ( x > y ? 1 : 0 ) );
+}
+
+static int SPCompareTermEntryStrings(const void *a, const void *b) {
+	const SPSegmentTermEntry *x = a, *y = b;
+	return SPCompareStrings(x->string, x->length, y->string, y->length);
+}
+
+// Front codes term strings as they are appended in sorted order
+
+typedef struct {
+	SPByteBuffer strings;
+	SPByteBuffer blocks;			// uint32_t offsets into strings
+	uint32_t count;
+	uint32_t previousLength;
+	char previous[kSPIndexMaximumTermLength];
+} SPTermStringWriter;
+
+static bool SPTermStringWriterAppend(SPTermStringWriter *writer, const char *string, uint32_t length) {
+
+	uint8_t header[2];
+	uint32_t shared = 0;
+
+	if ( writer->count % kSPSegmentTermBlockSize == 0 ) {
+		uint32_t offset = (uint32_t)writer->strings.length;
+		if ( !SPByteBufferAppend(&writer->blocks, &offset, sizeof(uint32_t)) ) return false;
+	}
+	else {
+		while ( shared < length && shared < writer->previousLength && string[shared] == writer->previous[shared] ) shared++;
+	}
+
+	header[0] = (uint8_t)shared;
+	header[1] = (uint8_t)( length - shared );
+
+	if ( !SPByteBufferAppend(&writer->strings, header, 2) ) return false;
+	if ( !SPByteBufferAppend(&writer->strings, string + shared, length - shared) ) return false;
+
+	memcpy(writer->previous + shared, string + shared, length - shared);
+	writer->previousLength = length;
+	writer->count++;
+
+	return true;
+}
+
+static SPSegment * SPSegmentAllocate(size_t documentCount) {
+
+	SPSegment *segment = calloc(1, sizeof(SPSegment));
+	if ( segment == NULL ) return NULL;
+
+	segment->retainCount = 1;
+	segment->documents = calloc(( documentCount == 0 ? 1 : documentCount ), sizeof(SPSegmentDocument));
+	segment->uriTable = SPStringTableCreate(documentCount);
+
+	if ( segment->documents == NULL || segment->uriTable == NULL ) {
+		SPSegmentRelease(segment);
+		return NULL;
+	}
+
+	return segment;
+}
+
+static bool SPSegmentFinish(SPSegment *segment, SPByteBuffer *uris, SPByteBuffer *vectors, 
+		SPTermStringWriter *strings, SPByteBuffer *postings, SPByteBuffer *blocks, SPByteBuffer *positions) {
+
+	// Takes ownership of the buffers and indexes the URIs. positions is NULL for a segment
+	// without them.
+
+	uint32_t i;
+
+	if ( uris->length > UINT32_MAX || vectors->length > UINT32_MAX 
+			|| strings->strings.length > UINT32_MAX || postings->length > UINT32_MAX 
+			|| blocks->length / sizeof(SPSegmentBlock) > UINT32_MAX 
+			|| ( positions != NULL && positions->length > UINT32_MAX ) )
+		return false;
+
+	if ( positions != NULL && segment->termCount > 0 ) {
+		segment->positions = positions->bytes;
+		segment->positionsLength = (uint32_t)positions->length;
+		segment->memorySize += positions->capacity;
+		memset(positions, 0, sizeof(SPByteBuffer));
+	}
+
+	segment->uris = (char*)uris->bytes;
+	segment->vectors = vectors->bytes;
+	segment->termStrings = strings->strings.bytes;
+	segment->termBlocks = (uint32_t*)strings->blocks.bytes;
+	segment->postings = postings->bytes;
+	segment->blocks = (SPSegmentBlock*)blocks->bytes;
+	segment->blockCount = (uint32_t)( blocks->length / sizeof(SPSegmentBlock) );
+
+	segment->urisLength = (uint32_t)uris->length;
+	segment->vectorsLength = (uint32_t)vectors->length;
+	segment->termStringsLength = (uint32_t)strings->strings.length;
+	segment->postingsLength = (uint32_t)postings->length;
+
+	segment->memorySize += sizeof(SPSegment) + segment->documentCount * sizeof(SPSegmentDocument)
+			+ segment->termCount * sizeof(SPSegmentTerm)
+			+ uris->capacity + vectors->capacity + strings->strings.capacity + strings->blocks.capacity 
+			+ postings->capacity + blocks->capacity;
+
+	memset(uris, 0, sizeof(SPByteBuffer));
+	memset(vectors, 0, sizeof(SPByteBuffer));
+	memset(&strings->strings, 0, sizeof(SPByteBuffer));
+	memset(&strings->blocks, 0, sizeof(SPByteBuffer));
+	memset(postings, 0, sizeof(SPByteBuffer));
+	memset(blocks, 0, sizeof(SPByteBuffer));
+
+	for ( i = 0; i < segment->documentCount; i++ ) {
+		if ( !SPStringTableSetValue(segment->uriTable, segment->uris + segment->documents[i].uriOffset, 
+				segment->documents[i].uriLength, (int32_t)i, NULL) )
+			return false;
+	}
+
+	segment->memorySize += SPStringTableGetMemorySize(segment->uriTable);
+	return true;
+}
+
+SPSegment * SPSegmentCreate(const SPSegmentSource *sources, size_t count, SPTermDirectory *directory) {
+
+	// Terms are interned and each document's term vector written first. The postings are
+	// then bucketed by term with a counting sort, which keeps them in document order, and
+	// finally written out in term string order.
+
+	SPSegment *segment = SPSegmentAllocate(count);
+	SPByteBuffer uris = { 0 }, vectors = { 0 }, postings = { 0 }, blocks = { 0 }, positions = { 0 };
+	SPTermStringWriter strings;
+	SPSegmentVectorEntry *entries = NULL;
+	SPSegmentTermEntry *terms = NULL;
+	SPSegmentPosting *buckets = NULL;
+	uint32_t *cursors = NULL;
+	size_t i, j, pairCount = 0, termCount = 0;
+	bool positional = true;
+	bool success = false;
+
+	memset(&strings, 0, sizeof(SPTermStringWriter));
+	if ( segment == NULL ) return NULL;
+
+	for ( i = 0; i < count; i++ ) {
+		pairCount += sources[i].text->count;
+		if ( sources[i].text->count > 0 && sources[i].text->positions == NULL ) positional = false;
+	}
+
+	// Every document's entries are kept, sorted by term, for bucketing the postings
+
+	entries = malloc(( pairCount == 0 ? 1 : pairCount ) * sizeof(SPSegmentVectorEntry));
+	terms = malloc(( pairCount == 0 ? 1 : pairCount ) * sizeof(SPSegmentTermEntry));
+	buckets = malloc(( pairCount == 0 ? 1 : pairCount ) * sizeof(SPSegmentPosting));
+	if ( entries == NULL || terms == NULL || buckets == NULL ) goto bail;
+
+	// Documents and term vectors
+
+	for ( i = 0; i < count; i++ ) {
+
+		const SPSegmentSource *source = &sources[i];
+		const SPAnalyzedText *text = source->text;
+		SPSegmentDocument *document = &segment->documents[i];
+		SPSegmentVectorEntry *entry = entries + termCount;
+		SPTermID lastTerm = 0;
+
+		for ( j = 0; j < text->count; j++ ) {
+			entry[j].term = SPTermDirectoryIntern(directory, text->buffer + text->offsets[j], text->lengths[j]);
+			entry[j].frequency = text->frequencies[j];
+			entry[j].index = (uint32_t)j;
+			if ( entry[j].term == kSPIndexNotFound ) goto bail;
+		}
+
+		qsort(entry, text->count, sizeof(SPSegmentVectorEntry), SPCompareVectorEntries);
+
+		document->document = source->document;
+		document->uriOffset = (uint32_t)uris.length;
+		document->uriLength = (uint32_t)source->uriLength;
+		document->termCount = (uint32_t)text->count;
+		document->length = (uint32_t)text->tokenCount;
+		document->vectorOffset = (uint32_t)vectors.length;
+
+		for ( j = 0; j < text->count; j++ ) {
+			if ( !SPByteBufferAppendPosting(&vectors, (uint32_t)( entry[j].term - lastTerm ), entry[j].frequency) ) goto bail;
+			lastTerm = entry[j].term;
+			terms[termCount++].term = entry[j].term;
+		}
+
+		document->vectorLength = (uint32_t)( vectors.length - document->vectorOffset );
+
+		if ( !SPByteBufferAppend(&uris, source->uri, source->uriLength) ) goto bail;
+
+		segment->tokenCount += text->tokenCount;
+	}
+
+	segment->documentCount = (uint32_t)count;
+
+	// The distinct terms of the segment, in ID order so that postings can find their bucket
+
+	qsort(terms, termCount, sizeof(SPSegmentTermEntry), SPCompareTermEntryIDs);
+
+	for ( i = 0, j = 0; i < termCount; i++ ) {
+		if ( j == 0 || terms[j-1].term != terms[i].term ) {
+			terms[j].term = terms[i].term;
+			terms[j].bucket = 0;
+			j++;
+		}
+	}
+	termCount = j;
+
+	cursors = calloc(termCount + 1, sizeof(uint32_t));
+	if ( cursors == NULL ) goto bail;
+
+	for ( i = 0; i < pairCount; i++ ) {
+		SPSegmentTermEntry key;
+		key.term = entries[i].term;
+		SPSegmentTermEntry *found = bsearch(&key, terms, termCount, sizeof(SPSegmentTermEntry), SPCompareTermEntryIDs);
+		cursors[( found - terms ) + 1]++;
+	}
+
+	for ( i = 0; i < termCount; i++ ) {
+		cursors[i+1] += cursors[i];
+		terms[i].bucket = cursors[i];
+	}
+
+	for ( i = 0, j = 0; i < count; i++ ) {
+		const SPAnalyzedText *text = sources[i].text;
+		const SPSegmentVectorEntry *entry = entries + j, *end = entry + text->count;
+
+		for ( ; entry < end; entry++ ) {
+			SPSegmentTermEntry key;
+			key.term = entry->term;
+			size_t index = (SPSegmentTermEntry*)bsearch(&key, terms, termCount, sizeof(SPSegmentTermEntry), SPCompareTermEntryIDs) - terms;
+			SPSegmentPosting *posting = &buckets[cursors[index]++];
+
+			posting->document = segment->documents[i].document;
+			posting->frequency = entry->frequency;
+			posting->length = segment->documents[i].length;
+			posting->positions = ( positional ? text->positions + text->positionOffsets[entry->index] : NULL );
+		}
+
+		j += text->count;
+	}
+
+	// cursors[i] now marks the end of bucket i. Write the terms out in string order.
+
+	for ( i = 0; i < termCount; i++ ) {
+		size_t length;
+		terms[i].string = SPTermDirectoryGetTerm(directory, terms[i].term, &length);
+		terms[i].length = (uint32_t)length;
+		terms[i].count = cursors[i] - terms[i].bucket;
+	}
+
+	qsort(terms, termCount, sizeof(SPSegmentTermEntry), SPCompareTermEntryStrings);
+
+	segment->terms = calloc(( termCount == 0 ? 1 : termCount ), sizeof(SPSegmentTerm));
+	if ( segment->terms == NULL ) goto bail;
+
+	for ( i = 0; i < termCount; i++ ) {
+		SPSegmentTerm *term = &segment->terms[i];
+		const SPSegmentPosting *posting = buckets + terms[i].bucket;
+		const SPSegmentPosting *end = posting + terms[i].count;
+
+		term->term = terms[i].term;
+		term->postingsOffset = (uint32_t)postings.length;
+		term->blockOffset = (uint32_t)( blocks.length / sizeof(SPSegmentBlock) );
+		term->positionsOffset = (uint32_t)positions.length;
+
+		if ( !SPTermStringWriterAppend(&strings, terms[i].string, terms[i].length) ) goto bail;
+
+		for ( ; posting < end; posting++ ) {
+			if ( !SPSegmentTermAppendPosting(term, &postings, &blocks, ( positional ? &positions : NULL ), 
+					(uint32_t)posting->document, posting->frequency, posting->length) ) 
+				goto bail;
+			if ( positional && !SPByteBufferAppendPositions(&positions, posting->positions, posting->frequency) )
+				goto bail;
+		}
+
+		term->postingsLength = (uint32_t)( postings.length - term->postingsOffset );
+	}
+
+	segment->termCount = (uint32_t)termCount;
+	success = SPSegmentFinish(segment, &uris, &vectors, &strings, &postings, &blocks, ( positional ? &positions : NULL ));
+
+bail:
+	free(uris.bytes);
+	free(vectors.bytes);
+	free(strings.strings.bytes);
+	free(strings.blocks.bytes);
+	free(postings.bytes);
+	free(blocks.bytes);
+	free(positions.bytes);
+	free(entries);
+	free(terms);
+	free(buckets);
+	free(cursors);
+
+	if ( !success ) {
+		SPSegmentRelease(segment);
+		segment = NULL;
+	}
+
+	return segment;
+}
+
+SPSegment * SPSegmentCreateByMerging(SPSegment * const *segments, size_t count, const SPDeletionSet *deleted) {
+
+	// Documents are copied over in segment order, which is ID order, and terms are merged
+	// by string. Segments share the term directory, so equal strings carry equal IDs.
+	// Position lists are copied as they are, length and all.
+
+	SPSegment *segment = NULL;
+	SPByteBuffer uris = { 0 }, vectors = { 0 }, postings = { 0 }, blocks = { 0 }, positions = { 0 };
+	SPTermStringWriter strings;
+	SPSegmentTermReader *readers = NULL;
+	size_t i, j, documentCount = 0, termCapacity = 0, termCount = 0;
+	bool positional = true;
+	bool success = false;
+
+	memset(&strings, 0, sizeof(SPTermStringWriter));
+
+	for ( i = 0; i < count; i++ ) {
+		documentCount += segments[i]->documentCount;
+		termCapacity += segments[i]->termCount;
+		if ( !SPSegmentHasPositions(segments[i]) ) positional = false;
+	}
+
+	segment = SPSegmentAllocate(documentCount);
+	readers = calloc(( count == 0 ? 1 : count ), sizeof(SPSegmentTermReader));
+	if ( segment == NULL || readers == NULL ) goto bail;
+
+	segment->terms = calloc(( termCapacity == 0 ? 1 : termCapacity ), sizeof(SPSegmentTerm));
+	if ( segment->terms == NULL ) goto bail;
+
+	// Documents
+
+	documentCount = 0;
+
+	for ( i = 0; i < count; i++ ) {
+		const SPSegment *source = segments[i];
+
+		for ( j = 0; j < source->documentCount; j++ ) {
+			const SPSegmentDocument *document = &source->documents[j];
+			SPSegmentDocument *copy = &segment->documents[documentCount];
+
+			if ( SPDeletionSetContains(deleted, document->document) )
+				continue;
+
+			*copy = *document;
+			copy->uriOffset = (uint32_t)uris.length;
+			copy->vectorOffset = (uint32_t)vectors.length;
+
+			if ( !SPByteBufferAppend(&uris, source->uris + document->uriOffset, document->uriLength) ) goto bail;
+			if ( !SPByteBufferAppend(&vectors, source->vectors + document->vectorOffset, document->vectorLength) ) goto bail;
+
+			segment->tokenCount += document->length;
+			documentCount++;
+		}
+	}
+
+	segment->documentCount = (uint32_t)documentCount;
+
+	// Terms, merged by string. Only a handful of segments are merged at once, so a linear
+	// scan for the smallest head is cheaper than maintaining a heap.
+
+	for ( i = 0; i < count; i++ )
+		SPSegmentTermReaderInit(&readers[i], segments[i], 0);
+
+	for ( ;; ) {
+		SPSegmentTermReader *smallest = NULL;
+		SPSegmentTerm *term = &segment->terms[termCount];
+
+		for ( i = 0; i < count; i++ ) {
+			SPSegmentTermReader *candidate = &readers[i];
+
+			if ( candidate->term == NULL ) continue;
+
+			if ( smallest == NULL || SPCompareStrings(candidate->string, candidate->length, smallest->string, smallest->length) < 0 )
+				smallest = candidate;
+		}
+
+		if ( smallest == NULL ) break;
+
+		memset(term, 0, sizeof(SPSegmentTerm));
+		term->term = smallest->term->term;
+		term->postingsOffset = (uint32_t)postings.length;
+		term->blockOffset = (uint32_t)( blocks.length / sizeof(SPSegmentBlock) );
+		term->positionsOffset = (uint32_t)positions.length;
+
+		// the smallest reader is advanced last so that its string stays valid for the append
+
+		for ( i = 0; i < count; i++ ) {
+			const SPSegmentTerm *candidate = readers[i].term;
+			const uint8_t *list = NULL, *next = NULL;
+			SPPostingIterator iterator;
+
+			if ( candidate == NULL || candidate->term != term->term ) continue;
+
+			if ( positional && segments[i]->positions != NULL ) list = segments[i]->positions + candidate->positionsOffset;
+
+			SPPostingIteratorInit(&iterator, segments[i]->postings + candidate->postingsOffset, candidate->postingsLength);
+			for ( ; SPPostingIteratorNext(&iterator); list = next ) {
+				const SPSegmentDocument *document;
+
+				if ( list != NULL ) next = SPPositionListSkip(list);
+
+				if ( SPDeletionSetContains(deleted, (SPDocumentID)iterator.document) ) continue;
+
+				document = SPSegmentFindDocument(segments[i], (SPDocumentID)iterator.document);
+				if ( !SPSegmentTermAppendPosting(term, &postings, &blocks, ( positional ? &positions : NULL ), 
+						iterator.document, iterator.frequency, document->length) ) 
+					goto bail;
+				if ( list != NULL && !SPByteBufferAppend(&positions, list, (size_t)( next - list )) )
+					goto bail;
+			}
+		}
+
+		// a term whose documents have all been deleted is dropped
+
+		if ( term->documentCount == 0 ) {
+			postings.length = term->postingsOffset;
+			positions.length = term->positionsOffset;
+		}
+		else {
+			term->postingsLength = (uint32_t)( postings.length - term->postingsOffset );
+			if ( !SPTermStringWriterAppend(&strings, smallest->string, smallest->length) ) goto bail;
+			termCount++;
+		}
+
+		for ( i = 0; i < count; i++ ) {
+			if ( &readers[i] != smallest && readers[i].term != NULL && readers[i].term->term == term->term )
+				SPSegmentTermReaderNext(&readers[i]);
+		}
+
+		SPSegmentTermReaderNext(smallest);
+	}
+
+	segment->termCount = (uint32_t)termCount;
+	success = SPSegmentFinish(segment, &uris, &vectors, &strings, &postings, &blocks, ( positional ? &positions : NULL ));
+
+bail:
+	free(uris.bytes);
+	free(vectors.bytes);
+	free(strings.strings.bytes);
+	free(strings.blocks.bytes);
+	free(postings.bytes);
+	free(blocks.bytes);
+	free(positions.bytes);
+	free(readers);
+
+	if ( !success && segment != NULL ) {
+		SPSegmentRelease(segment);
+		segment = NULL;
+	}
+
+	return segment;
+}
+
+SPSegment * SPSegmentRetain(SPSegment *segment) {
+	if ( segment != NULL ) __sync_fetch_and_add(&segment->retainCount, 1);
+	return segment;
+}
+
+void SPSegmentRelease(SPSegment *segment) {
+
+	if ( segment == NULL || __sync_sub_and_fetch(&segment->retainCount, 1) != 0 )
+		return;
+
+	if ( segment->uriTable != NULL ) SPStringTableRelease(segment->uriTable);
+
+	if ( segment->file != NULL ) {
+		SPMappedFileRelease(segment->file);
+		free(segment);
+		return;
+	}
+
+	free(segment->documents);
+	free(segment->uris);
+	free(segment->vectors);
+	free(segment->terms);
+	free(segment->termStrings);
+	free(segment->termBlocks);
+	free(segment->postings);
+	free(segment->blocks);
+	free(segment->positions);
+	free(segment);
+}
+
+#pragma mark -
+#pragma mark Segment Lookups
+
+const SPSegmentTerm * SPSegmentFindTerm(const SPSegment *segment, const char *term, size_t length) {
+
+	SPSegmentTermReader reader;
+	SPSegmentTermReaderSeek(&reader, segment, term, length);
+
+	if ( reader.term == NULL || SPCompareStrings(reader.string, reader.length, term, length) != 0 )
+		return NULL;
+
+	return reader.term;
+}
+
+const SPSegmentDocument * SPSegmentFindDocument(const SPSegment *segment, SPDocumentID document) {
+
+	size_t low = 0, high = segment->documentCount;
+
+	while ( low < high ) {
+		size_t middle = low + ( high - low ) / 2;
+		SPDocumentID candidate = segment->documents[middle].document;
+
+		if ( candidate == document ) return &segment->documents[middle];
+		if ( candidate < document ) low = middle + 1;
+		else high = middle;
+	}
+
+	return NULL;
+}
+
+const SPSegmentDocument * SPSegmentFindURI(const SPSegment *segment, const char *uri, size_t length) {
+	int32_t index = SPStringTableGetValue(segment->uriTable, uri, length);
+	return ( index == kSPStringTableNotFound ? NULL : &segment->documents[index] );
+}
+
+#pragma mark -
+#pragma mark Term Readers
+
+static void SPSegmentTermReaderDecode(SPSegmentTermReader *reader) {
+
+	uint32_t shared = reader->cursor[0], suffix = reader->cursor[1];
+
+	memcpy(reader->string + shared, reader->cursor + 2, suffix);
+	reader->length = shared + suffix;
+	reader->cursor += 2 + suffix;
+	reader->term = &reader->segment->terms[reader->index];
+}
+
+static void SPSegmentTermReaderStartBlock(SPSegmentTermReader *reader, const SPSegment *segment, uint32_t block) {
+
+	reader->segment = segment;
+	reader->index = block * kSPSegmentTermBlockSize;
+	reader->term = NULL;
+	reader->length = 0;
+
+	if ( reader->index >= segment->termCount ) return;
+
+	reader->cursor = segment->termStrings + segment->termBlocks[block];
+	SPSegmentTermReaderDecode(reader);
+}
+
+void SPSegmentTermReaderInit(SPSegmentTermReader *reader, const SPSegment *segment, uint32_t index) {
+
+	SPSegmentTermReaderStartBlock(reader, segment, index / kSPSegmentTermBlockSize);
+
+	while ( reader->term != NULL && reader->index < index )
+		SPSegmentTermReaderNext(reader);
+}
+
+void SPSegmentTermReaderSeek(SPSegmentTermReader *reader, const SPSegment *segment, const char *term, size_t length) {
+
+	// Find the last block whose first term is at or before term, then decode forward
+
+	uint32_t low = 0, high = ( segment->termCount + kSPSegmentTermBlockSize - 1 ) / kSPSegmentTermBlockSize;
+
+	while ( low < high ) {
+		uint32_t middle = low + ( high - low ) / 2;
+		const uint8_t *leader = segment->termStrings + segment->termBlocks[middle];
+
+		if ( SPCompareStrings((const char*)leader + 2, leader[1], term, length) <= 0 ) low = middle + 1;
+		else high = middle;
+	}
+
+	SPSegmentTermReaderStartBlock(reader, segment, ( low == 0 ? 0 : low - 1 ));
+
+	while ( reader->term != NULL && SPCompareStrings(reader->string, reader->length, term, length) < 0 )
+		SPSegmentTermReaderNext(reader);
+}
+
+bool SPSegmentTermReaderNext(SPSegmentTermReader *reader) {
+
+	if ( reader->term == NULL ) return false;
+
+	if ( ++reader->index >= reader->segment->termCount ) {
+		reader->term = NULL;
+		return false;
+	}
+
+	if ( reader->index % kSPSegmentTermBlockSize == 0 )
+		reader->cursor = reader->segment->termStrings + reader->segment->termBlocks[reader->index / kSPSegmentTermBlockSize];
+
+	SPSegmentTermReaderDecode(reader);
+	return true;
+}
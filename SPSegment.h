@@ -0,0 +1,245 @@
+//
+//  SPSegment.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPSEGMENT_H
+#define SPSEGMENT_H
+
+#include "SPAnalysis.h"
+#include "SPStringTable.h"
+#include "SPTermDirectory.h"
+
+#include <string.h>
+
+// Segments are the immutable building blocks of the native index. A refresh turns the
+// documents buffered since the last refresh into a new segment, and merges combine runs
+// of neighbouring segments into larger ones. Because a segment never changes after it is
+// created, any number of readers may use it without locks. Segments are reference
+// counted so that a reader's snapshot keeps them alive after a merge has replaced them.
+
+// A segment holds a contiguous stretch of the document ID space: every document in a
+// newer segment has a higher ID than every document in an older one. Posting lists are
+// therefore in ascending ID order when read segment by segment.
+
+// Posting lists are divided into blocks of kSPSegmentBlockSize postings. Each block
+// records where it starts, its last document, and the highest frequency and shortest
+// document length found in it, which bound the score any of its documents can reach.
+// Ranked retrieval uses the blocks both to skip through a list and to skip over
+// documents that cannot make the top results.
+
+// Segments of an index that keeps positions also have a position list for every posting,
+// laid out in the same order as the postings, and each term and block records where its
+// lists begin. A reader that has found a document in the postings can then skip straight
+// to the block's lists and step over the ones before the document's, see SPPostingList.h.
+
+#define kSPSegmentBlockSize 128
+
+// Segments read from a saved index point into the mapped file rather than owning their
+// arrays, and keep the mapping alive until the last of them is released.
+
+typedef struct {
+	volatile int32_t retainCount;
+	void *bytes;
+	size_t length;
+} SPMappedFile;
+
+SPMappedFile * SPMappedFileRetain(SPMappedFile *file);
+void SPMappedFileRelease(SPMappedFile *file);
+
+typedef struct {
+	uint32_t lastDocument;
+	uint32_t postingsOffset;		// from the start of the term's postings
+	uint32_t maxFrequency;
+	uint32_t minLength;
+	uint32_t positionsOffset;		// from the start of the term's position lists
+} SPSegmentBlock;
+
+typedef struct {
+	SPTermID term;					// global term ID
+	uint32_t documentCount;			// postings, including documents deleted since
+	uint32_t maxFrequency;
+	uint32_t minLength;				// shortest document in the postings
+	uint32_t postingsOffset;		// into postings
+	uint32_t postingsLength;
+	uint32_t blockOffset;			// into blocks
+	uint32_t blockCount;
+	uint32_t positionsOffset;		// into positions
+} SPSegmentTerm;
+
+typedef struct {
+	SPDocumentID document;
+	uint32_t uriOffset;				// into uris
+	uint32_t uriLength;
+	uint32_t termCount;				// distinct terms
+	uint32_t length;				// terms counting repeats
+	uint32_t vectorOffset;			// into vectors, term ID gaps and frequencies
+	uint32_t vectorLength;
+} SPSegmentDocument;
+
+typedef struct {
+	volatile int32_t retainCount;
+
+	SPSegmentDocument *documents;	// ordered by document ID
+	uint32_t documentCount;
+	uint64_t tokenCount;
+	char *uris;
+	SPStringTable *uriTable;		// URI -> index into documents
+	uint8_t *vectors;
+
+	SPSegmentTerm *terms;			// ordered by term string
+	uint32_t termCount;
+	uint8_t *termStrings;			// front coded, see below
+	uint32_t *termBlocks;			// offset of each block of strings
+	uint8_t *postings;
+	SPSegmentBlock *blocks;
+	uint32_t blockCount;
+	uint8_t *positions;				// NULL unless the segment has positions
+
+	uint32_t urisLength;			// in bytes, for saving
+	uint32_t vectorsLength;
+	uint32_t termStringsLength;
+	uint32_t postingsLength;
+	uint32_t positionsLength;
+
+	SPMappedFile *file;				// NULL unless the arrays above point into a file
+	size_t memorySize;
+} SPSegment;
+
+// Term strings are front coded in blocks of kSPSegmentTermBlockSize. Each entry is the
+// length of the prefix it shares with the previous term, the length of the rest and the
+// rest; the first entry of a block shares nothing, so a block can be decoded on its own
+// and the blocks binary searched by their first term. Neighbouring terms in a sorted
+// dictionary share long prefixes, which makes this about half the size of plain strings.
+
+#define kSPSegmentTermBlockSize 16
+
+// Documents deleted from written segments are recorded in a bitmap over document IDs.
+// A bitmap is shared by every snapshot published while no new deletions arrive.
+
+typedef struct {
+	volatile int32_t retainCount;
+	uint8_t *bits;
+	SPDocumentID capacity;			// covers IDs below capacity
+} SPDeletionSet;
+
+static inline bool SPDeletionSetContains(const SPDeletionSet *set, SPDocumentID document) {
+	return ( set != NULL && document < set->capacity && ( set->bits[document >> 3] & ( 1 << ( document & 7 ) ) ) != 0 );
+}
+
+SPDeletionSet * SPDeletionSetCreateCopy(const SPDeletionSet *set, SPDocumentID capacity);
+SPDeletionSet * SPDeletionSetRetain(SPDeletionSet *set);
+void SPDeletionSetRelease(SPDeletionSet *set);
+
+	// The copy is mutable until it is published. Set bits with SPDeletionSetAdd.
+
+void SPDeletionSetAdd(SPDeletionSet *set, SPDocumentID document);
+
+// Building segments
+
+typedef struct {
+	SPDocumentID document;
+	const char *uri;
+	size_t uriLength;
+	const SPAnalyzedText *text;
+} SPSegmentSource;
+
+SPSegment * SPSegmentCreate(const SPSegmentSource *sources, size_t count, SPTermDirectory *directory);
+
+	// Sources must be in ascending document ID order. Terms are interned in directory, so
+	// the caller must be the index writer. The segment has positions if the texts do.
+
+SPSegment * SPSegmentCreateByMerging(SPSegment * const *segments, size_t count, const SPDeletionSet *deleted);
+
+	// segments must be neighbours in ID order, oldest first. Deleted documents are dropped
+	// along with terms that no longer have any documents. May be called from any thread.
+	// The merged segment has positions if all of the segments do.
+
+SPSegment * SPSegmentRetain(SPSegment *segment);
+void SPSegmentRelease(SPSegment *segment);
+
+// Reading segments
+
+const SPSegmentTerm * SPSegmentFindTerm(const SPSegment *segment, const char *term, size_t length);
+const SPSegmentDocument * SPSegmentFindDocument(const SPSegment *segment, SPDocumentID document);
+const SPSegmentDocument * SPSegmentFindURI(const SPSegment *segment, const char *uri, size_t length);
+
+	// Return NULL when the segment does not contain the term or document.
+
+// A term reader decodes a segment's dictionary in string order. Position it with Seek,
+// or with Init to start from a term index, and advance with Next. After either call term
+// is NULL once the dictionary is exhausted, and otherwise string and length describe it.
+
+typedef struct {
+	const SPSegment *segment;
+	const SPSegmentTerm *term;
+	uint32_t index;					// of term
+	uint32_t length;
+	const uint8_t *cursor;			// next entry
+	char string[kSPIndexMaximumTermLength];
+} SPSegmentTermReader;
+
+void SPSegmentTermReaderInit(SPSegmentTermReader *reader, const SPSegment *segment, uint32_t index);
+void SPSegmentTermReaderSeek(SPSegmentTermReader *reader, const SPSegment *segment, const char *term, size_t length);
+bool SPSegmentTermReaderNext(SPSegmentTermReader *reader);
+
+	// Seek positions the reader at the first term at or after term in string order.
+	// Next returns false when it runs off the end of the dictionary.
+
+static inline int SPCompareStrings(const char *a, size_t aLength, const char *b, size_t bLength) {
+	int order = memcmp(a, b, ( aLength < bLength ? aLength : bLength ));
+	if ( order != 0 ) return order;
+	return ( aLength < bLength ? -1 : ( aLength > bLength ? 1 : 0 ) );
+}
+
+	// Byte order, which is the order of segment dictionaries.
+
+static inline bool SPSegmentHasPositions(const SPSegment *segment) {
+	return ( segment->positions != NULL || segment->termCount == 0 );
+}
+
+	// A segment without terms has no postings to position.
+
+static inline SPDocumentID SPSegmentGetFirstDocument(const SPSegment *segment) {
+	return segment->documents[0].document;
+}
+
+static inline SPDocumentID SPSegmentGetLastDocument(const SPSegment *segment) {
+	return segment->documents[segment->documentCount - 1].document;
+}
+
+#endif
@@ -0,0 +1,74 @@
+//
+//  SPShardedBackend.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPSearchBackend.h"
+
+// The sharded backend spreads documents over any number of underlying backends, its
+// shards, and presents them as a single index. Each document belongs to the shard chosen
+// by a stable hash of its URI, so every shard has its own write lock and its own merges
+// and a large batch is indexed by all of the shards at once. Searches run on every shard
+// in parallel and their results are merged by rank into one ranking.
+
+// A document ID combines the document's ID in its shard with the shard's number, so the
+// IDs of a sharded backend are unique across its shards but are not dense.
+
+// Ranks are only comparable across shards when the shards score with the same collection
+// statistics. When every shard is an SPNativeBackend they share their document counts,
+// lengths and term frequencies, and a document is ranked exactly as it would be in a
+// single index of the whole collection. SearchKit shards rank with their own statistics.
+
+@interface SPShardedBackend : NSObject <SPSearchBackend> {
+	NSArray *shards;
+	void *collection;
+}
+
+@property (readonly) NSArray *shards;
+
+- (id) initWithBackends:(NSArray*)inBackends;
+- (id) initNativeWithCount:(NSUInteger)inCount type:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions;
+
+	// The backends must all have the same index type and analysis options and must not be
+	// used directly once they are sharded. initNativeWithCount:type:analysisOptions: creates
+	// inCount in-memory native shards. Sharded backends cannot be written to a single file.
+
+- (NSUInteger) shardForDocument:(NSURL*)inDocumentURI;
+
+	// The index of the shard that holds or would hold the document.
+
+@end
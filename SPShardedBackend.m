@@ -0,0 +1,791 @@
+//
+//  SPShardedBackend.m
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#import "SPShardedBackend.h"
+#import "SPNativeBackend.h"
+#import "SPStringTable.h"
+
+typedef struct {
+	SPIndexRef *indexes;
+	size_t count;
+} SPShardedCollection;
+
+static void SPShardedCollectionGetCounts(uint64_t *outDocumentCount, uint64_t *outTokenCount, void *context) {
+	SPShardedCollection *collection = context;
+	uint64_t documentCount = 0, tokenCount = 0;
+	size_t i;
+
+	for ( i = 0; i < collection->count; i++ ) {
+		uint64_t documents, tokens;
+		SPIndexGetCollectionCounts(collection->indexes[i], &documents, &tokens);
+		documentCount += documents;
+		tokenCount += tokens;
+	}
+
+	*outDocumentCount = documentCount;
+	*outTokenCount = tokenCount;
+}
+
+static size_t SPShardedCollectionGetTermDocumentFrequency(const char *term, size_t length, void *context) {
+	SPShardedCollection *collection = context;
+	size_t i, count = 0;
+
+	for ( i = 0; i < collection->count; i++ )
+		count += SPIndexGetTermDocumentFrequency(collection->indexes[i], term, length);
+
+	return count;
+}
+
+static void SPShardedBackendPerform(NSUInteger count, void (^block)(NSUInteger shard)) {
+
+	// Runs block once for every shard, each in its own operation, and waits for them all.
+	// Autoreleased objects do not survive an operation, so blocks retain what they keep.
+
+	NSOperationQueue *workers = nil;
+	NSUInteger i;
+
+	if ( count == 1 ) {
+		block(0);
+		return;
+	}
+
+	workers = [[NSOperationQueue alloc] init];
+
+	for ( i = 0; i < count; i++ )
+		[workers addOperationWithBlock:^(void) { block(i); }];
+
+	[workers waitUntilAllOperationsAreFinished];
+	[workers release];
+}
+
+static NSUInteger SPShardedBackendMerge(NSUInteger count, NSArray **documents, float **ranks, NSUInteger *positions,
+		const BOOL *pending, NSUInteger limit, NSMutableArray *outDocuments, float *outRanks) {
+
+	// Merges the shards' ranked results from their current positions. There are only ever a
+	// few shards, so the head of each is compared directly rather than kept in a heap. Ties
+	// go to the lower shard so a merge is repeatable. The merge stops short of limit when a
+	// shard which has run out of buffered results may still have more, since the next result
+	// cannot be chosen without them.
+
+	NSUInteger i, merged = 0;
+
+	while ( merged < limit ) {
+
+		NSInteger best = -1;
+
+		for ( i = 0; i < count; i++ ) {
+			if ( positions[i] < [documents[i] count] ) {
+				if ( best == -1 || ranks[i][positions[i]] > ranks[best][positions[best]] )
+					best = i;
+			}
+			else if ( pending != NULL && pending[i] ) {
+				return merged;
+			}
+		}
+
+		if ( best == -1 )
+			break;
+
+		if ( outRanks != NULL ) outRanks[merged] = ranks[best][positions[best]];
+		[outDocuments addObject:[documents[best] objectAtIndex:positions[best]]];
+		positions[best]++;
+		merged++;
+	}
+
+	return merged;
+}
+
+static NSInteger SPShardedBackendDocumentID(NSInteger inShardDocumentID, NSUInteger shard, NSUInteger count) {
+	return ( inShardDocumentID == NSNotFound || inShardDocumentID < 0 ? NSNotFound : inShardDocumentID * (NSInteger)count + shard );
+}
+
+#pragma mark -
+
+@interface SPShardedSearch : NSObject <SPSearchBackendSearch> {
+	NSArray *searches;
+	NSUInteger count;
+	NSArray **buffers;
+	float **bufferRanks;
+	NSUInteger *positions;
+	BOOL *pending;
+}
+
+- (id) initWithSearches:(NSArray*)inSearches;
+
+@end
+
+#pragma mark -
+
+@interface SPShardedBackend()
+
+- (id<SPSearchBackend>) _shardForDocument:(NSURL*)inDocumentURI;
+- (id<SPSearchBackend>) _shardForDocumentID:(NSInteger)inDocumentID shardDocumentID:(NSInteger*)outShardDocumentID;
+- (NSUInteger) _addDocuments:(NSArray*)inDocumentURIs texts:(NSArray*)inContents typeHint:(NSString*)inMimeHint
+		byteCount:(unsigned long long*)outByteCount;
+
+@end
+
+#pragma mark -
+
+@implementation SPShardedBackend
+
+@synthesize shards;
+
+- (id) initWithBackends:(NSArray*)inBackends {
+
+	NSAssert( [inBackends count] > 0, @"inBackends must not be empty");
+
+	if ( self = [super init] ) {
+
+		NSUInteger i, count = [inBackends count];
+		BOOL allNative = YES;
+
+		if ( count == 0 ) {
+			[self release];
+			return nil;
+		}
+
+		shards = [inBackends copy];
+
+		for ( i = 0; i < count; i++ )
+			if ( ![[shards objectAtIndex:i] isKindOfClass:[SPNativeBackend class]] ) allNative = NO;
+
+		// Native shards rank against the statistics of the whole collection, which they
+		// gather from one another at the start of each search
+
+		if ( allNative && count > 1 ) {
+
+			SPShardedCollection *shared = malloc(sizeof(SPShardedCollection));
+			SPIndexRef *indexes = malloc(count * sizeof(SPIndexRef));
+
+			if ( shared != NULL && indexes != NULL ) {
+
+				SPCollectionStatistics statistics = { SPShardedCollectionGetCounts, SPShardedCollectionGetTermDocumentFrequency, shared };
+
+				for ( i = 0; i < count; i++ )
+					indexes[i] = [(SPNativeBackend*)[shards objectAtIndex:i] index];
+
+				shared->indexes = indexes;
+				shared->count = count;
+				collection = shared;
+
+				for ( i = 0; i < count; i++ )
+					SPIndexSetCollectionStatistics(indexes[i], &statistics);
+			}
+			else {
+				free(shared);
+				free(indexes);
+			}
+		}
+	}
+	return self;
+}
+
+- (id) initNativeWithCount:(NSUInteger)inCount type:(SKIndexType)inType analysisOptions:(NSDictionary*)inOptions {
+
+	NSAssert( inCount > 0, @"inCount must be greater than zero");
+
+	NSMutableArray *backends = [NSMutableArray arrayWithCapacity:inCount];
+	NSUInteger i;
+
+	for ( i = 0; i < inCount; i++ ) {
+		SPNativeBackend *shard = [[SPNativeBackend alloc] initWithType:inType analysisOptions:inOptions];
+		if ( shard != nil ) [backends addObject:shard];
+		[shard release];
+	}
+
+	if ( [backends count] != inCount ) {
+		[self release];
+		return nil;
+	}
+
+	return [self initWithBackends:backends];
+}
+
+- (void) dealloc {
+
+	if ( collection != NULL ) {
+		SPShardedCollection *shared = collection;
+		size_t i;
+
+		for ( i = 0; i < shared->count; i++ )
+			SPIndexSetCollectionStatistics(shared->indexes[i], NULL);
+
+		free(shared->indexes);
+		free(shared);
+		collection = NULL;
+	}
+
+	[shards release], shards = nil;
+	[super dealloc];
+}
+
+#pragma mark -
+
+- (NSUInteger) shardForDocument:(NSURL*)inDocumentURI {
+	const char *uri = [[inDocumentURI absoluteString] UTF8String];
+	return ( uri == NULL ? 0 : SPStringHash(uri, strlen(uri)) % [shards count] );
+}
+
+- (id<SPSearchBackend>) _shardForDocument:(NSURL*)inDocumentURI {
+	return [shards objectAtIndex:[self shardForDocument:inDocumentURI]];
+}
+
+- (id<SPSearchBackend>) _shardForDocumentID:(NSInteger)inDocumentID shardDocumentID:(NSInteger*)outShardDocumentID {
+
+	// Unknown IDs resolve to no shard at all, and messages to it return nil or zero
+
+	NSInteger count = [shards count];
+
+	if ( inDocumentID == NSNotFound || inDocumentID < 0 ) {
+		*outShardDocumentID = NSNotFound;
+		return nil;
+	}
+
+	*outShardDocumentID = inDocumentID / count;
+	return [shards objectAtIndex:inDocumentID % count];
+}
+
+- (SKIndexType) indexType {
+	return [[shards objectAtIndex:0] indexType];
+}
+
+#pragma mark -
+
+- (BOOL) addDocument:(NSURL*)inFileURL typeHint:(NSString*)inMimeHint {
+	return [[self _shardForDocument:inFileURL] addDocument:inFileURL typeHint:inMimeHint];
+}
+
+- (BOOL) addDocument:(NSURL*)inDocumentURI withText:(NSString*)inContents {
+	return [[self _shardForDocument:inDocumentURI] addDocument:inDocumentURI withText:inContents];
+}
+
+- (BOOL) removeDocument:(NSURL*)inDocumentURI {
+	return [[self _shardForDocument:inDocumentURI] removeDocument:inDocumentURI];
+}
+
+- (NSUInteger) addDocuments:(NSArray*)inFileURLs typeHint:(NSString*)inMimeHint byteCount:(unsigned long long*)outByteCount {
+	return [self _addDocuments:inFileURLs texts:nil typeHint:inMimeHint byteCount:outByteCount];
+}
+
+- (NSUInteger) addDocuments:(NSArray*)inDocumentURIs withTexts:(NSArray*)inContents byteCount:(unsigned long long*)outByteCount {
+	return [self _addDocuments:inDocumentURIs texts:inContents typeHint:nil byteCount:outByteCount];
+}
+
+- (NSUInteger) _addDocuments:(NSArray*)inDocumentURIs texts:(NSArray*)inContents typeHint:(NSString*)inMimeHint
+		byteCount:(unsigned long long*)outByteCount {
+
+	// The batch is divided by shard and every shard adds its part at the same time, each
+	// under its own write lock
+
+	NSUInteger i, count = ( inContents == nil ? [inDocumentURIs count] : MIN([inDocumentURIs count], [inContents count]) );
+	NSUInteger shardCount = [shards count];
+	NSMutableArray *documents = [NSMutableArray arrayWithCapacity:shardCount];
+	NSMutableArray *texts = [NSMutableArray arrayWithCapacity:shardCount];
+	NSUInteger *added = calloc(shardCount, sizeof(NSUInteger));
+	unsigned long long *bytes = calloc(shardCount, sizeof(unsigned long long));
+	NSUInteger total = 0;
+	unsigned long long totalBytes = 0;
+
+	if ( added == NULL || bytes == NULL )
+		goto bail;
+
+	for ( i = 0; i < shardCount; i++ ) {
+		[documents addObject:[NSMutableArray array]];
+		[texts addObject:[NSMutableArray array]];
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		NSURL *documentURI = [inDocumentURIs objectAtIndex:i];
+		NSUInteger shard = [self shardForDocument:documentURI];
+		[[documents objectAtIndex:shard] addObject:documentURI];
+		if ( inContents != nil ) [[texts objectAtIndex:shard] addObject:[inContents objectAtIndex:i]];
+	}
+
+	SPShardedBackendPerform(shardCount, ^(NSUInteger shard) {
+		id<SPSearchBackend> backend = [shards objectAtIndex:shard];
+		NSArray *shardDocuments = [documents objectAtIndex:shard];
+
+		if ( [shardDocuments count] == 0 )
+			return;
+
+		if ( inContents != nil )
+			added[shard] = [backend addDocuments:shardDocuments withTexts:[texts objectAtIndex:shard] byteCount:&bytes[shard]];
+		else
+			added[shard] = [backend addDocuments:shardDocuments typeHint:inMimeHint byteCount:&bytes[shard]];
+	});
+
+	for ( i = 0; i < shardCount; i++ ) {
+		total += added[i];
+		totalBytes += bytes[i];
+	}
+
+bail:
+	if ( outByteCount != NULL ) *outByteCount = totalBytes;
+	free(added);
+	free(bytes);
+	return total;
+}
+
+#pragma mark -
+
+- (void) setProperties:(NSDictionary*)inProperties forDocument:(NSURL*)inDocumentURI {
+	[[self _shardForDocument:inDocumentURI] setProperties:inProperties forDocument:inDocumentURI];
+}
+
+- (NSDictionary*) propertiesForDocument:(NSURL*)inDocumentURI {
+	return [[self _shardForDocument:inDocumentURI] propertiesForDocument:inDocumentURI];
+}
+
+- (BOOL) setName:(NSString*)inTitle forDocument:(NSURL*)inDocumentURI {
+	return [[self _shardForDocument:inDocumentURI] setName:inTitle forDocument:inDocumentURI];
+}
+
+- (NSString*) nameOfDocument:(NSURL*)inDocumentURI {
+	return [[self _shardForDocument:inDocumentURI] nameOfDocument:inDocumentURI];
+}
+
+- (SKDocumentIndexState) stateOfDocument:(NSURL*)inDocumentURI {
+	return [[self _shardForDocument:inDocumentURI] stateOfDocument:inDocumentURI];
+}
+
+- (NSArray*) allDocuments:(BOOL)ignoreEmptyDocuments {
+
+	NSUInteger i, count = [shards count];
+	NSArray **shardDocuments = calloc(count, sizeof(NSArray*));
+	NSMutableArray *documents = [NSMutableArray array];
+
+	if ( shardDocuments == NULL )
+		return documents;
+
+	SPShardedBackendPerform(count, ^(NSUInteger shard) {
+		shardDocuments[shard] = [[[shards objectAtIndex:shard] allDocuments:ignoreEmptyDocuments] retain];
+	});
+
+	for ( i = 0; i < count; i++ ) {
+		if ( shardDocuments[i] != nil ) [documents addObjectsFromArray:shardDocuments[i]];
+		[shardDocuments[i] release];
+	}
+
+	free(shardDocuments);
+	return documents;
+}
+
+- (NSInteger) documentIDForDocument:(NSURL*)inDocumentURI {
+	NSUInteger shard = [self shardForDocument:inDocumentURI];
+	NSInteger shardDocumentID = [[shards objectAtIndex:shard] documentIDForDocument:inDocumentURI];
+	return SPShardedBackendDocumentID(shardDocumentID, shard, [shards count]);
+}
+
+- (NSURL*) documentForDocumentID:(NSInteger)inDocumentID {
+	NSInteger shardDocumentID;
+	return [[self _shardForDocumentID:inDocumentID shardDocumentID:&shardDocumentID] documentForDocumentID:shardDocumentID];
+}
+
+- (void) setProperties:(NSDictionary*)inProperties forDocumentID:(NSInteger)inDocumentID {
+	NSInteger shardDocumentID;
+	[[self _shardForDocumentID:inDocumentID shardDocumentID:&shardDocumentID] setProperties:inProperties forDocumentID:shardDocumentID];
+}
+
+- (NSDictionary*) propertiesForDocumentID:(NSInteger)inDocumentID {
+	NSInteger shardDocumentID;
+	return [[self _shardForDocumentID:inDocumentID shardDocumentID:&shardDocumentID] propertiesForDocumentID:shardDocumentID];
+}
+
+#pragma mark -
+
+- (NSInteger) documentCount {
+	NSInteger count = 0;
+	for ( id<SPSearchBackend> shard in shards )
+		count += [shard documentCount];
+	return count;
+}
+
+- (NSInteger) maximumDocumentID {
+
+	// The largest ID handed out, so that the store's estimate of bloat still compares IDs
+	// with documents
+
+	NSUInteger i, count = [shards count];
+	NSInteger maximum = 0;
+
+	for ( i = 0; i < count; i++ )
+		maximum = MAX(maximum, SPShardedBackendDocumentID([[shards objectAtIndex:i] maximumDocumentID], i, count));
+
+	return maximum;
+}
+
+- (NSUInteger) generation {
+
+	// Shard generations only ever increase, so their sum changes whenever any of them does
+
+	NSUInteger generation = 0;
+	for ( id<SPSearchBackend> shard in shards )
+		generation += [shard generation];
+	return generation;
+}
+
+- (BOOL) compact {
+	__block BOOL success = YES;
+
+	SPShardedBackendPerform([shards count], ^(NSUInteger shard) {
+		if ( ![[shards objectAtIndex:shard] compact] ) success = NO;
+	});
+
+	return success;
+}
+
+- (BOOL) compactsOnline {
+	for ( id<SPSearchBackend> shard in shards ) {
+		if ( ![shard respondsToSelector:@selector(compactsOnline)] || ![shard compactsOnline] )
+			return NO;
+	}
+	return YES;
+}
+
+- (BOOL) flush {
+	__block BOOL success = YES;
+
+	SPShardedBackendPerform([shards count], ^(NSUInteger shard) {
+		if ( ![[shards objectAtIndex:shard] flush] ) success = NO;
+	});
+
+	return success;
+}
+
+- (void) close {
+	for ( id<SPSearchBackend> shard in shards )
+		[shard close];
+}
+
+#pragma mark -
+
+- (id<SPSearchBackendSearch>) searchWithQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions {
+
+	NSUInteger i, count = [shards count];
+	id *shardSearches = calloc(count, sizeof(id));
+	NSMutableArray *searches = [NSMutableArray arrayWithCapacity:count];
+	BOOL prepared = NO;
+
+	if ( shardSearches == NULL )
+		return nil;
+
+	// Preparing a search may evaluate it, so every shard prepares its own at once
+
+	SPShardedBackendPerform(count, ^(NSUInteger shard) {
+		shardSearches[shard] = [[[shards objectAtIndex:shard] searchWithQuery:searchQuery options:searchOptions] retain];
+	});
+
+	for ( i = 0; i < count; i++ ) {
+		if ( shardSearches[i] != nil ) prepared = YES;
+		[searches addObject:( shardSearches[i] != nil ? shardSearches[i] : [NSNull null] )];
+		[shardSearches[i] release];
+	}
+
+	free(shardSearches);
+	return ( prepared ? [[[SPShardedSearch alloc] initWithSearches:searches] autorelease] : nil );
+}
+
+- (NSArray*) topResultsForQuery:(NSString*)searchQuery options:(SKSearchOptions)searchOptions 
+		limit:(NSUInteger)limit ranks:(float*)outRanks {
+
+	// Every shard finds its own top results, which are enough to make up the top results
+	// of the whole collection
+
+	NSUInteger i, count = [shards count];
+	NSArray **documents = calloc(count, sizeof(NSArray*));
+	float **ranks = calloc(count, sizeof(float*));
+	NSUInteger *positions = calloc(count, sizeof(NSUInteger));
+	NSMutableArray *results = [NSMutableArray arrayWithCapacity:limit];
+
+	if ( documents == NULL || ranks == NULL || positions == NULL || limit == 0 )
+		goto bail;
+
+	SPShardedBackendPerform(count, ^(NSUInteger shard) {
+		float *shardRanks = malloc(limit * sizeof(float));
+		if ( shardRanks == NULL ) return;
+
+		documents[shard] = [[[shards objectAtIndex:shard] topResultsForQuery:searchQuery options:searchOptions
+				limit:limit ranks:shardRanks] retain];
+		ranks[shard] = shardRanks;
+	});
+
+	SPShardedBackendMerge(count, documents, ranks, positions, NULL, limit, results, outRanks);
+
+bail:
+	for ( i = 0; documents != NULL && i < count; i++ ) [documents[i] release];
+	for ( i = 0; ranks != NULL && i < count; i++ ) free(ranks[i]);
+	free(documents);
+	free(ranks);
+	free(positions);
+	return results;
+}
+
+#pragma mark -
+
+- (void) enumerateTermsWithPrefix:(NSString*)inPrefix 
+		usingBlock:(void (^)(NSString *term, NSUInteger documentCount, BOOL *stop))block {
+
+	// Each shard lists its terms in sorted order, and the lists are merged so that a term
+	// held by several shards is reported once with the sum of its document counts
+
+	NSUInteger i, count = [shards count];
+	NSMutableArray **terms = calloc(count, sizeof(NSMutableArray*));
+	NSMutableArray **documentCounts = calloc(count, sizeof(NSMutableArray*));
+	NSUInteger *positions = calloc(count, sizeof(NSUInteger));
+	BOOL stop = NO;
+
+	if ( terms == NULL || documentCounts == NULL || positions == NULL )
+		goto bail;
+
+	SPShardedBackendPerform(count, ^(NSUInteger shard) {
+		NSMutableArray *shardTerms = [[NSMutableArray alloc] init];
+		NSMutableArray *shardCounts = [[NSMutableArray alloc] init];
+
+		[[shards objectAtIndex:shard] enumerateTermsWithPrefix:inPrefix usingBlock:^(NSString *term, NSUInteger documentCount, BOOL *stopShard) {
+			[shardTerms addObject:term];
+			[shardCounts addObject:[NSNumber numberWithUnsignedInteger:documentCount]];
+		}];
+
+		terms[shard] = shardTerms;
+		documentCounts[shard] = shardCounts;
+	});
+
+	while ( !stop ) {
+
+		NSString *term = nil;
+		NSUInteger documentCount = 0;
+
+		for ( i = 0; i < count; i++ ) {
+			if ( positions[i] >= [terms[i] count] ) continue;
+			NSString *candidate = [terms[i] objectAtIndex:positions[i]];
+			if ( term == nil || [candidate compare:term options:NSLiteralSearch] == NSOrderedAscending )
+				term = candidate;
+		}
+
+		if ( term == nil )
+			break;
+
+		for ( i = 0; i < count; i++ ) {
+			if ( positions[i] >= [terms[i] count] ) continue;
+			if ( ![[terms[i] objectAtIndex:positions[i]] isEqualToString:term] ) continue;
+			documentCount += [[documentCounts[i] objectAtIndex:positions[i]] unsignedIntegerValue];
+			positions[i]++;
+		}
+
+		block(term, documentCount, &stop);
+	}
+
+bail:
+	for ( i = 0; terms != NULL && i < count; i++ ) [terms[i] release];
+	for ( i = 0; documentCounts != NULL && i < count; i++ ) [documentCounts[i] release];
+	free(terms);
+	free(documentCounts);
+	free(positions);
+}
+
+- (NSUInteger) documentCountForTerm:(NSString*)inTerm {
+	NSUInteger count = 0;
+	for ( id<SPSearchBackend> shard in shards )
+		count += [shard documentCountForTerm:inTerm];
+	return count;
+}
+
+- (NSArray*) documentsForTerm:(NSString*)inTerm {
+
+	NSUInteger i, count = [shards count];
+	NSArray **shardDocuments = calloc(count, sizeof(NSArray*));
+	NSMutableArray *documents = [NSMutableArray array];
+
+	if ( shardDocuments == NULL )
+		return documents;
+
+	SPShardedBackendPerform(count, ^(NSUInteger shard) {
+		shardDocuments[shard] = [[[shards objectAtIndex:shard] documentsForTerm:inTerm] retain];
+	});
+
+	for ( i = 0; i < count; i++ ) {
+		if ( shardDocuments[i] != nil ) [documents addObjectsFromArray:shardDocuments[i]];
+		[shardDocuments[i] release];
+	}
+
+	free(shardDocuments);
+	return documents;
+}
+
+- (NSUInteger) termCountForDocument:(NSURL*)inDocumentURI {
+	return [[self _shardForDocument:inDocumentURI] termCountForDocument:inDocumentURI];
+}
+
+- (NSArray*) termsForDocument:(NSURL*)inDocumentURI {
+	return [[self _shardForDocument:inDocumentURI] termsForDocument:inDocumentURI];
+}
+
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocument:(NSURL*)inDocumentURI {
+	return [[self _shardForDocument:inDocumentURI] frequencyOfTerm:inTerm inDocument:inDocumentURI];
+}
+
+- (NSIndexSet*) documentIDsForTerm:(NSString*)inTerm {
+
+	NSMutableIndexSet *documentIDs = [NSMutableIndexSet indexSet];
+	NSUInteger i, count = [shards count];
+
+	for ( i = 0; i < count; i++ ) {
+		NSIndexSet *shardDocumentIDs = [[shards objectAtIndex:i] documentIDsForTerm:inTerm];
+		NSUInteger shard = i;
+
+		[shardDocumentIDs enumerateIndexesUsingBlock:^(NSUInteger shardDocumentID, BOOL *stop) {
+			[documentIDs addIndex:SPShardedBackendDocumentID(shardDocumentID, shard, count)];
+		}];
+	}
+
+	return documentIDs;
+}
+
+- (NSUInteger) termCountForDocumentID:(NSInteger)inDocumentID {
+	NSInteger shardDocumentID;
+	return [[self _shardForDocumentID:inDocumentID shardDocumentID:&shardDocumentID] termCountForDocumentID:shardDocumentID];
+}
+
+- (NSArray*) termsForDocumentID:(NSInteger)inDocumentID {
+	NSInteger shardDocumentID;
+	return [[self _shardForDocumentID:inDocumentID shardDocumentID:&shardDocumentID] termsForDocumentID:shardDocumentID];
+}
+
+- (NSUInteger) frequencyOfTerm:(NSString*)inTerm inDocumentID:(NSInteger)inDocumentID {
+	NSInteger shardDocumentID;
+	return [[self _shardForDocumentID:inDocumentID shardDocumentID:&shardDocumentID] frequencyOfTerm:inTerm inDocumentID:shardDocumentID];
+}
+
+@end
+
+#pragma mark -
+
+@implementation SPShardedSearch
+
+- (id) initWithSearches:(NSArray*)inSearches {
+	if ( self = [super init] ) {
+		searches = [inSearches copy];
+		count = [searches count];
+		buffers = calloc(count, sizeof(NSArray*));
+		bufferRanks = calloc(count, sizeof(float*));
+		positions = calloc(count, sizeof(NSUInteger));
+		pending = calloc(count, sizeof(BOOL));
+
+		if ( buffers == NULL || bufferRanks == NULL || positions == NULL || pending == NULL ) {
+			[self release];
+			return nil;
+		}
+
+		NSUInteger i;
+		for ( i = 0; i < count; i++ )
+			pending[i] = ( [searches objectAtIndex:i] != [NSNull null] );
+	}
+	return self;
+}
+
+- (void) dealloc {
+	NSUInteger i;
+
+	for ( i = 0; buffers != NULL && i < count; i++ ) [buffers[i] release];
+	for ( i = 0; bufferRanks != NULL && i < count; i++ ) free(bufferRanks[i]);
+
+	free(buffers);
+	free(bufferRanks);
+	free(positions);
+	free(pending);
+
+	[searches release], searches = nil;
+	[super dealloc];
+}
+
+- (BOOL) fetchResults:(NSArray**)outDocuments ranks:(float*)outRanks
+		maxTime:(NSTimeInterval)maxTime maxCount:(NSInteger)maxCount {
+
+	// Results are fetched from the shards a chunk at a time and kept until they are merged.
+	// Every shard that has used up its chunk fetches its next one at the same time. Results
+	// are only returned once every shard that may still have results has some buffered, so
+	// a fetch can return fewer than maxCount while the shards are still searching.
+
+	NSMutableArray *documents = [NSMutableArray arrayWithCapacity:MAX(maxCount, 0)];
+	BOOL stillSearching = NO;
+	NSUInteger i;
+
+	if ( maxCount > 0 ) {
+
+		SPShardedBackendPerform(count, ^(NSUInteger shard) {
+			id<SPSearchBackendSearch> search = [searches objectAtIndex:shard];
+			NSArray *fetched = nil;
+			float *ranks = NULL;
+
+			if ( !pending[shard] || positions[shard] < [buffers[shard] count] )
+				return;
+
+			if ( (ranks = malloc(maxCount * sizeof(float))) == NULL ) {
+				pending[shard] = NO;
+				return;
+			}
+
+			pending[shard] = [search fetchResults:&fetched ranks:ranks maxTime:maxTime maxCount:maxCount];
+
+			[buffers[shard] release];
+			free(bufferRanks[shard]);
+
+			buffers[shard] = [fetched retain];
+			bufferRanks[shard] = ranks;
+			positions[shard] = 0;
+		});
+
+		SPShardedBackendMerge(count, buffers, bufferRanks, positions, pending, maxCount, documents, outRanks);
+	}
+
+	for ( i = 0; i < count; i++ )
+		if ( pending[i] || positions[i] < [buffers[i] count] ) stillSearching = YES;
+
+	*outDocuments = [[documents copy] autorelease];
+	return stillSearching;
+}
+
+- (void) cancel {
+	for ( id search in searches ) {
+		if ( search != [NSNull null] ) [search cancel];
+	}
+}
+
+@end
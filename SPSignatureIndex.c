@@ -0,0 +1,565 @@
+//
+//  SPSignatureIndex.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPSignatureIndex.h"
+#include "SPPostingList.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kSPSignatureRows	( kSPSignatureLength / kSPSignatureBands )
+#define kSPSignatureEmpty	(-1)
+
+// Each band is an open addressing table from the hash of a band to the most recently
+// added document with that band. The other documents of a bucket are chained through
+// next, which is indexed like the documents. Buckets are never emptied: removed
+// documents are skipped until enough of them accumulate to rebuild the index.
+
+typedef struct {
+	uint64_t *keys;
+	int32_t *heads;					// kSPSignatureEmpty for a free slot
+	int32_t *next;
+	size_t slotCount;				// a power of two
+	size_t used;
+} SPSignatureBand;
+
+struct SPSignatureIndex {
+	pthread_rwlock_t lock;
+
+	SPDocumentID *documents;		// ascending
+	uint32_t *values;				// kSPSignatureLength per document
+	uint8_t *removed;
+	size_t count;
+	size_t capacity;
+	size_t removedCount;
+
+	SPSignatureBand bands[kSPSignatureBands];
+	uint64_t multipliers[kSPSignatureLength];
+	uint64_t increments[kSPSignatureLength];
+	bool failed;
+};
+
+static inline uint64_t SPSignatureMix(uint64_t x) {
+	// splitmix64 finalizer
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+	return x ^ ( x >> 31 );
+}
+
+static uint64_t SPSignatureGetBandKey(const uint32_t *values, size_t band) {
+	uint64_t key = band;
+	size_t i;
+
+	for ( i = 0; i < kSPSignatureRows; i++ )
+		key = SPSignatureMix(key ^ values[band * kSPSignatureRows + i]) + i;
+
+	return key;
+}
+
+SPSignatureIndex * SPSignatureIndexCreate(void) {
+
+	SPSignatureIndex *signatures = calloc(1, sizeof(SPSignatureIndex));
+	uint64_t seed = 0x5350536967736565ULL;
+	size_t i;
+
+	if ( signatures == NULL ) return NULL;
+
+	if ( pthread_rwlock_init(&signatures->lock, NULL) != 0 ) {
+		free(signatures);
+		return NULL;
+	}
+
+	// The hash functions are fixed, so signatures are comparable across runs
+
+	for ( i = 0; i < kSPSignatureLength; i++ ) {
+		signatures->multipliers[i] = SPSignatureMix(seed += 0x9e3779b97f4a7c15ULL) | 1;
+		signatures->increments[i] = SPSignatureMix(seed += 0x9e3779b97f4a7c15ULL);
+	}
+
+	return signatures;
+}
+
+static void SPSignatureBandFree(SPSignatureBand *band) {
+	free(band->keys);
+	free(band->heads);
+	free(band->next);
+	memset(band, 0, sizeof(SPSignatureBand));
+}
+
+void SPSignatureIndexRelease(SPSignatureIndex *signatures) {
+
+	size_t i;
+
+	if ( signatures == NULL ) return;
+
+	for ( i = 0; i < kSPSignatureBands; i++ ) SPSignatureBandFree(&signatures->bands[i]);
+
+	pthread_rwlock_destroy(&signatures->lock);
+	free(signatures->documents);
+	free(signatures->values);
+	free(signatures->removed);
+	free(signatures);
+}
+
+#pragma mark -
+#pragma mark Bands
+
+static bool SPSignatureBandResize(SPSignatureBand *band, size_t slotCount) {
+
+	uint64_t *keys = malloc(slotCount * sizeof(uint64_t));
+	int32_t *heads = malloc(slotCount * sizeof(int32_t));
+	size_t i;
+
+	if ( keys == NULL || heads == NULL ) {
+		free(keys);
+		free(heads);
+		return false;
+	}
+
+	for ( i = 0; i < slotCount; i++ ) heads[i] = kSPSignatureEmpty;
+
+	for ( i = 0; i < band->slotCount; i++ ) {
+		size_t slot;
+		if ( band->heads[i] == kSPSignatureEmpty ) continue;
+
+		for ( slot = band->keys[i] & ( slotCount - 1 ); heads[slot] != kSPSignatureEmpty; slot = ( slot + 1 ) & ( slotCount - 1 ) );
+		keys[slot] = band->keys[i];
+		heads[slot] = band->heads[i];
+	}
+
+	free(band->keys);
+	free(band->heads);
+	band->keys = keys;
+	band->heads = heads;
+	band->slotCount = slotCount;
+
+	return true;
+}
+
+static size_t SPSignatureBandFind(const SPSignatureBand *band, uint64_t key) {
+
+	size_t slot = key & ( band->slotCount - 1 );
+
+	while ( band->heads[slot] != kSPSignatureEmpty && band->keys[slot] != key )
+		slot = ( slot + 1 ) & ( band->slotCount - 1 );
+
+	return slot;
+}
+
+static bool SPSignatureBandAdd(SPSignatureBand *band, uint64_t key, int32_t document) {
+
+	size_t slot;
+
+	if ( ( band->used + 1 ) * 2 > band->slotCount && !SPSignatureBandResize(band, ( band->slotCount == 0 ? 1024 : band->slotCount * 2 )) )
+		return false;
+
+	slot = SPSignatureBandFind(band, key);
+
+	if ( band->heads[slot] == kSPSignatureEmpty ) {
+		band->keys[slot] = key;
+		band->used++;
+	}
+
+	band->next[document] = band->heads[slot];
+	band->heads[slot] = document;
+
+	return true;
+}
+
+#pragma mark -
+#pragma mark Signing
+
+static void SPSignatureIndexSign(const SPSignatureIndex *signatures, const SPSegment *segment, 
+		const SPSegmentDocument *document, uint32_t *values) {
+
+	// One hash of the term ID is spread into kSPSignatureLength universal hashes, which
+	// is much cheaper than hashing the term that many times
+
+	SPPostingIterator iterator;
+	size_t i;
+
+	for ( i = 0; i < kSPSignatureLength; i++ ) values[i] = UINT32_MAX;
+
+	SPPostingIteratorInit(&iterator, segment->vectors + document->vectorOffset, document->vectorLength);
+	while ( SPPostingIteratorNext(&iterator) ) {
+		uint64_t hash = SPSignatureMix((uint64_t)iterator.document + 1);
+
+		for ( i = 0; i < kSPSignatureLength; i++ ) {
+			uint32_t value = (uint32_t)( ( hash * signatures->multipliers[i] + signatures->increments[i] ) >> 32 );
+			if ( value < values[i] ) values[i] = value;
+		}
+	}
+}
+
+static bool SPSignatureIndexReserve(SPSignatureIndex *signatures, size_t count) {
+
+	size_t capacity = ( signatures->capacity == 0 ? 1024 : signatures->capacity ), i;
+	SPDocumentID *documents;
+	uint32_t *values;
+	uint8_t *removed;
+	int32_t *next;
+
+	if ( count <= signatures->capacity ) return true;
+	while ( capacity < count ) capacity *= 2;
+
+	if ( ( documents = realloc(signatures->documents, capacity * sizeof(SPDocumentID)) ) == NULL ) return false;
+	signatures->documents = documents;
+
+	if ( ( values = realloc(signatures->values, capacity * kSPSignatureLength * sizeof(uint32_t)) ) == NULL ) return false;
+	signatures->values = values;
+
+	if ( ( removed = realloc(signatures->removed, capacity) ) == NULL ) return false;
+	signatures->removed = removed;
+
+	for ( i = 0; i < kSPSignatureBands; i++ ) {
+		if ( ( next = realloc(signatures->bands[i].next, capacity * sizeof(int32_t)) ) == NULL ) return false;
+		signatures->bands[i].next = next;
+	}
+
+	signatures->capacity = capacity;
+	return true;
+}
+
+static bool SPSignatureIndexFile(SPSignatureIndex *signatures, size_t index) {
+
+	size_t i;
+
+	for ( i = 0; i < kSPSignatureBands; i++ ) {
+		uint64_t key = SPSignatureGetBandKey(signatures->values + index * kSPSignatureLength, i);
+		if ( !SPSignatureBandAdd(&signatures->bands[i], key, (int32_t)index) ) return false;
+	}
+
+	return true;
+}
+
+static bool SPSignatureIndexRebuild(SPSignatureIndex *signatures) {
+
+	// Drops removed documents and files the rest again in fresh bands
+
+	size_t i, j = 0;
+
+	for ( i = 0; i < signatures->count; i++ ) {
+		if ( signatures->removed[i] ) continue;
+
+		signatures->documents[j] = signatures->documents[i];
+		signatures->removed[j] = 0;
+		memmove(signatures->values + j * kSPSignatureLength, signatures->values + i * kSPSignatureLength, 
+				kSPSignatureLength * sizeof(uint32_t));
+		j++;
+	}
+
+	signatures->count = j;
+	signatures->removedCount = 0;
+
+	for ( i = 0; i < kSPSignatureBands; i++ ) {
+		SPSignatureBand *band = &signatures->bands[i];
+		free(band->keys);
+		free(band->heads);
+		band->keys = NULL;
+		band->heads = NULL;
+		band->slotCount = 0;
+		band->used = 0;
+	}
+
+	for ( i = 0; i < signatures->count; i++ ) {
+		if ( !SPSignatureIndexFile(signatures, i) ) return false;
+	}
+
+	return true;
+}
+
+bool SPSignatureIndexAddSegment(SPSignatureIndex *signatures, const SPSegment *segment) {
+
+	// Signatures are computed before the lock is taken so that readers only wait while
+	// they are filed
+
+	uint32_t *values = malloc(( segment->documentCount == 0 ? 1 : segment->documentCount ) * kSPSignatureLength * sizeof(uint32_t));
+	size_t i, start;
+	bool success = false;
+
+	if ( values != NULL ) {
+		for ( i = 0; i < segment->documentCount; i++ ) {
+			if ( segment->documents[i].termCount > 0 ) 
+				SPSignatureIndexSign(signatures, segment, &segment->documents[i], values + i * kSPSignatureLength);
+		}
+	}
+
+	pthread_rwlock_wrlock(&signatures->lock);
+
+	if ( values == NULL || signatures->failed || !SPSignatureIndexReserve(signatures, signatures->count + segment->documentCount) ) 
+		goto bail;
+
+	for ( i = 0; i < segment->documentCount; i++ ) {
+		if ( segment->documents[i].termCount == 0 ) continue;
+
+		start = signatures->count++;
+		signatures->documents[start] = segment->documents[i].document;
+		signatures->removed[start] = 0;
+		memcpy(signatures->values + start * kSPSignatureLength, values + i * kSPSignatureLength, kSPSignatureLength * sizeof(uint32_t));
+
+		if ( !SPSignatureIndexFile(signatures, start) ) goto bail;
+	}
+
+	success = true;
+
+bail:
+	if ( !success ) signatures->failed = true;
+	pthread_rwlock_unlock(&signatures->lock);
+
+	free(values);
+	return success;
+}
+
+static size_t SPSignatureIndexFindDocument(const SPSignatureIndex *signatures, SPDocumentID document) {
+
+	size_t low = 0, high = signatures->count;
+
+	while ( low < high ) {
+		size_t middle = low + ( high - low ) / 2;
+
+		if ( signatures->documents[middle] == document ) return middle;
+		if ( signatures->documents[middle] < document ) low = middle + 1;
+		else high = middle;
+	}
+
+	return signatures->count;
+}
+
+void SPSignatureIndexRemoveDocuments(SPSignatureIndex *signatures, const SPDocumentID *documents, size_t count) {
+
+	size_t i;
+
+	pthread_rwlock_wrlock(&signatures->lock);
+
+	for ( i = 0; i < count; i++ ) {
+		size_t index = SPSignatureIndexFindDocument(signatures, documents[i]);
+		if ( index == signatures->count || signatures->removed[index] ) continue;
+
+		signatures->removed[index] = 1;
+		signatures->removedCount++;
+	}
+
+	if ( !signatures->failed && signatures->removedCount > 1024 && signatures->removedCount * 2 > signatures->count ) {
+		if ( !SPSignatureIndexRebuild(signatures) ) signatures->failed = true;
+	}
+
+	pthread_rwlock_unlock(&signatures->lock);
+}
+
+#pragma mark -
+#pragma mark Lookups
+
+static float SPSignatureIndexGetSimilarity(const SPSignatureIndex *signatures, size_t a, size_t b) {
+
+	const uint32_t *x = signatures->values + a * kSPSignatureLength, *y = signatures->values + b * kSPSignatureLength;
+	size_t i, agreements = 0;
+
+	for ( i = 0; i < kSPSignatureLength; i++ ) agreements += ( x[i] == y[i] );
+
+	return (float)agreements / kSPSignatureLength;
+}
+
+static bool SPSignatureIndexSharesEarlierBand(const SPSignatureIndex *signatures, size_t a, size_t b, size_t band) {
+
+	// A pair is only reported from the first band it shares
+
+	const uint32_t *x = signatures->values + a * kSPSignatureLength, *y = signatures->values + b * kSPSignatureLength;
+	size_t i;
+
+	for ( i = 0; i < band; i++ ) {
+		if ( memcmp(x + i * kSPSignatureRows, y + i * kSPSignatureRows, kSPSignatureRows * sizeof(uint32_t)) == 0 ) 
+			return true;
+	}
+
+	return false;
+}
+
+bool SPSignatureIndexCopyNeighbours(SPSignatureIndex *signatures, SPDocumentID document, float threshold, 
+		SPDocumentID **outDocuments, float **outSimilarities, size_t *outCount) {
+
+	SPDocumentID *documents = NULL;
+	float *similarities = NULL;
+	size_t index, i, count = 0, capacity = 0;
+	bool success = false;
+
+	pthread_rwlock_rdlock(&signatures->lock);
+
+	if ( signatures->failed ) goto bail;
+
+	index = SPSignatureIndexFindDocument(signatures, document);
+	if ( index == signatures->count || signatures->removed[index] ) {
+		success = true;
+		goto bail;
+	}
+
+	for ( i = 0; i < kSPSignatureBands; i++ ) {
+		const SPSignatureBand *band = &signatures->bands[i];
+		size_t slot = SPSignatureBandFind(band, SPSignatureGetBandKey(signatures->values + index * kSPSignatureLength, i));
+		int32_t candidate;
+
+		for ( candidate = band->heads[slot]; candidate != kSPSignatureEmpty; candidate = band->next[candidate] ) {
+			float similarity;
+
+			if ( (size_t)candidate == index || signatures->removed[candidate] 
+					|| SPSignatureIndexSharesEarlierBand(signatures, index, (size_t)candidate, i) ) 
+				continue;
+
+			similarity = SPSignatureIndexGetSimilarity(signatures, index, (size_t)candidate);
+			if ( similarity < threshold ) continue;
+
+			if ( count == capacity ) {
+				SPDocumentID *grownDocuments;
+				float *grownSimilarities;
+
+				capacity = ( capacity == 0 ? 16 : capacity * 2 );
+				if ( ( grownDocuments = realloc(documents, capacity * sizeof(SPDocumentID)) ) == NULL ) goto bail;
+				documents = grownDocuments;
+				if ( ( grownSimilarities = realloc(similarities, capacity * sizeof(float)) ) == NULL ) goto bail;
+				similarities = grownSimilarities;
+			}
+
+			documents[count] = signatures->documents[candidate];
+			similarities[count] = similarity;
+			count++;
+		}
+	}
+
+	success = true;
+
+bail:
+	pthread_rwlock_unlock(&signatures->lock);
+
+	if ( !success ) {
+		free(documents);
+		free(similarities);
+		documents = NULL;
+		similarities = NULL;
+		count = 0;
+	}
+
+	*outDocuments = documents;
+	*outSimilarities = similarities;
+	*outCount = count;
+
+	return success;
+}
+
+bool SPSignatureIndexCopyPairs(SPSignatureIndex *signatures, float threshold, SPDocumentPair **outPairs, size_t *outCount) {
+
+	// Every pair of documents sharing a bucket is a candidate. Buckets are small unless
+	// many documents are near duplicates of each other, which is exactly what is asked.
+
+	SPDocumentPair *pairs = NULL;
+	size_t i, slot, count = 0, capacity = 0;
+	bool success = false;
+
+	pthread_rwlock_rdlock(&signatures->lock);
+
+	if ( signatures->failed ) goto bail;
+
+	for ( i = 0; i < kSPSignatureBands; i++ ) {
+		const SPSignatureBand *band = &signatures->bands[i];
+
+		for ( slot = 0; slot < band->slotCount; slot++ ) {
+			int32_t a, b;
+
+			for ( a = band->heads[slot]; a != kSPSignatureEmpty; a = band->next[a] ) {
+				if ( signatures->removed[a] ) continue;
+
+				for ( b = band->next[a]; b != kSPSignatureEmpty; b = band->next[b] ) {
+					float similarity;
+
+					if ( signatures->removed[b] || SPSignatureIndexSharesEarlierBand(signatures, (size_t)a, (size_t)b, i) ) 
+						continue;
+
+					similarity = SPSignatureIndexGetSimilarity(signatures, (size_t)a, (size_t)b);
+					if ( similarity < threshold ) continue;
+
+					if ( count == capacity ) {
+						SPDocumentPair *grown;
+						capacity = ( capacity == 0 ? 64 : capacity * 2 );
+						grown = realloc(pairs, capacity * sizeof(SPDocumentPair));
+						if ( grown == NULL ) goto bail;
+						pairs = grown;
+					}
+
+					// chains run from the newest document to the oldest
+
+					pairs[count].first = signatures->documents[b];
+					pairs[count].second = signatures->documents[a];
+					pairs[count].similarity = similarity;
+					count++;
+				}
+			}
+		}
+	}
+
+	success = true;
+
+bail:
+	pthread_rwlock_unlock(&signatures->lock);
+
+	if ( !success ) {
+		free(pairs);
+		pairs = NULL;
+		count = 0;
+	}
+
+	*outPairs = pairs;
+	*outCount = count;
+
+	return success;
+}
+
+size_t SPSignatureIndexGetMemorySize(SPSignatureIndex *signatures) {
+
+	size_t i, size = sizeof(SPSignatureIndex);
+
+	pthread_rwlock_rdlock(&signatures->lock);
+
+	size += signatures->capacity * ( sizeof(SPDocumentID) + kSPSignatureLength * sizeof(uint32_t) + 1 );
+	for ( i = 0; i < kSPSignatureBands; i++ ) {
+		size += signatures->capacity * sizeof(int32_t);
+		size += signatures->bands[i].slotCount * ( sizeof(uint64_t) + sizeof(int32_t) );
+	}
+
+	pthread_rwlock_unlock(&signatures->lock);
+	return size;
+}
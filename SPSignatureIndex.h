@@ -0,0 +1,86 @@
+//
+//  SPSignatureIndex.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPSIGNATUREINDEX_H
+#define SPSIGNATUREINDEX_H
+
+#include "SPSegment.h"
+#include "SPSimilarity.h"
+
+// SPSignatureIndex keeps a MinHash signature of every document's set of terms. The
+// share of positions at which two signatures agree estimates the Jaccard similarity of
+// the two sets. Signatures are split into bands and every band is filed in a hash
+// table, so that documents sharing most of their terms, which are all but certain to
+// agree on at least one whole band, are found by looking in a handful of buckets
+// instead of comparing every pair. With 16 bands of 4 rows, pairs above a similarity
+// of about 0.7 are found almost always and pairs below 0.3 rarely become candidates.
+
+// The writer signs the documents of every refreshed segment and drops removed ones, so
+// the index is kept up to date incrementally. Signatures depend only on the terms of a
+// document, which merges never change. Readers share a read-write lock with the writer.
+// The index may be ahead of a reader's snapshot, so readers check the documents they
+// find against their snapshot.
+
+typedef struct SPSignatureIndex SPSignatureIndex;
+
+#define kSPSignatureLength	64
+#define kSPSignatureBands	16
+
+SPSignatureIndex * SPSignatureIndexCreate(void);
+void SPSignatureIndexRelease(SPSignatureIndex *signatures);
+
+bool SPSignatureIndexAddSegment(SPSignatureIndex *signatures, const SPSegment *segment);
+void SPSignatureIndexRemoveDocuments(SPSignatureIndex *signatures, const SPDocumentID *documents, size_t count);
+
+	// Writer only. Segments must be added in the order they are refreshed. Documents
+	// without terms are not signed. Returns false if memory ran out, after which the
+	// index finds nothing.
+
+bool SPSignatureIndexCopyNeighbours(SPSignatureIndex *signatures, SPDocumentID document, float threshold, 
+		SPDocumentID **outDocuments, float **outSimilarities, size_t *outCount);
+bool SPSignatureIndexCopyPairs(SPSignatureIndex *signatures, float threshold, 
+		SPDocumentPair **outPairs, size_t *outCount);
+
+	// Find the documents, or the pairs of documents, whose estimated similarity is at
+	// least threshold. Each pair is reported once, with the lower ID first. The arrays
+	// are malloc'd and must be freed by the caller. Return false if memory ran out.
+
+size_t SPSignatureIndexGetMemorySize(SPSignatureIndex *signatures);
+
+#endif
@@ -0,0 +1,518 @@
+//
+//  SPSimilarity.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPSimilarity.h"
+#include "SPIndexPrivate.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define kSPSimilarityMaximumThreads 64
+
+#pragma mark Parallel Work
+
+// Work is split into tasks, one per segment, which threads claim from a shared counter
+// until none are left. The calling thread works alongside the others, so the work still
+// gets done if no thread can be started.
+
+typedef void (*SPParallelFunction)(void *context, size_t task);
+
+typedef struct {
+	SPParallelFunction function;
+	void *context;
+	size_t taskCount;
+	volatile size_t nextTask;
+} SPParallelWork;
+
+static void * SPParallelWorker(void *argument) {
+
+	SPParallelWork *work = argument;
+	size_t task;
+
+	while ( ( task = __sync_fetch_and_add(&work->nextTask, 1) ) < work->taskCount )
+		work->function(work->context, task);
+
+	return NULL;
+}
+
+static void SPRunParallel(size_t taskCount, uint32_t threadCount, SPParallelFunction function, void *context) {
+
+	SPParallelWork work = { function, context, taskCount, 0 };
+	pthread_t threads[kSPSimilarityMaximumThreads];
+	size_t i, count = threadCount, started = 0;
+
+	if ( count == 0 ) {
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		count = ( processors < 1 ? 1 : (size_t)processors );
+	}
+
+	if ( count > taskCount ) count = taskCount;
+	if ( count > kSPSimilarityMaximumThreads ) count = kSPSimilarityMaximumThreads;
+
+	for ( i = 1; i < count; i++ ) {
+		if ( pthread_create(&threads[started], NULL, SPParallelWorker, &work) == 0 ) started++;
+	}
+
+	SPParallelWorker(&work);
+
+	for ( i = 0; i < started; i++ ) pthread_join(threads[i], NULL);
+}
+
+#pragma mark -
+#pragma mark Vector Norms
+
+typedef struct {
+	const SPSnapshot *snapshot;
+	SPVectorNorms *norms;
+} SPNormsWork;
+
+static void SPComputeSegmentNorms(void *context, size_t task) {
+
+	SPNormsWork *work = context;
+	const SPSegment *segment = work->snapshot->segments[task];
+	const SPScorer *scorer = &work->norms->scorer;
+	size_t i;
+
+	for ( i = 0; i < segment->documentCount; i++ ) {
+		const SPSegmentDocument *document = &segment->documents[i];
+		SPPostingIterator iterator;
+		float sum = 0.0f;
+
+		SPPostingIteratorInit(&iterator, segment->vectors + document->vectorOffset, document->vectorLength);
+		while ( SPPostingIteratorNext(&iterator) ) {
+			float weight = SPScorerGetTermScore(scorer, 1.0f, iterator.frequency, document->length) 
+					* work->norms->inverseFrequencies[iterator.document];
+			sum += weight * weight;
+		}
+
+		work->norms->norms[document->document] = sqrtf(sum);
+	}
+}
+
+static SPVectorNorms * SPVectorNormsCreate(const SPSnapshot *snapshot, uint32_t threadCount) {
+
+	// Document frequencies are summed from the segment dictionaries, the same way the
+	// scorer counts them for ranking
+
+	static const SPRankingOptions options = { kSPRankingModelTFIDF, 0.0f, 0.0f };
+
+	SPVectorNorms *norms = calloc(1, sizeof(SPVectorNorms));
+	uint32_t *frequencies = NULL;
+	SPNormsWork work;
+	size_t i, j;
+
+	if ( norms == NULL ) return NULL;
+
+	norms->retainCount = 1;
+	norms->generation = snapshot->generation;
+	SPScorerInit(&norms->scorer, snapshot, &options);
+
+	frequencies = calloc((size_t)snapshot->termCount + 1, sizeof(uint32_t));
+	norms->inverseFrequencies = malloc(( (size_t)snapshot->termCount + 1 ) * sizeof(float));
+	norms->norms = calloc((size_t)snapshot->maximumDocumentID + 1, sizeof(float));
+
+	if ( frequencies == NULL || norms->inverseFrequencies == NULL || norms->norms == NULL ) {
+		free(frequencies);
+		SPVectorNormsRelease(norms);
+		return NULL;
+	}
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		const SPSegment *segment = snapshot->segments[i];
+		for ( j = 0; j < segment->termCount; j++ ) frequencies[segment->terms[j].term] += segment->terms[j].documentCount;
+	}
+
+	for ( i = 0; i < (size_t)snapshot->termCount; i++ )
+		norms->inverseFrequencies[i] = SPScorerGetInverseDocumentFrequency(&norms->scorer, frequencies[i]);
+
+	free(frequencies);
+
+	work.snapshot = snapshot;
+	work.norms = norms;
+	SPRunParallel(snapshot->segmentCount, threadCount, SPComputeSegmentNorms, &work);
+
+	return norms;
+}
+
+void SPVectorNormsRelease(SPVectorNorms *norms) {
+
+	if ( norms == NULL || __sync_sub_and_fetch(&norms->retainCount, 1) != 0 )
+		return;
+
+	free(norms->inverseFrequencies);
+	free(norms->norms);
+	free(norms);
+}
+
+static SPVectorNorms * SPIndexCopyVectorNorms(SPIndexRef index, const SPSnapshot *snapshot, uint32_t threadCount) {
+
+	// Threads that find the norms out of date may compute them at the same time, and
+	// the newest generation wins. The lock is never held while computing.
+
+	SPVectorNorms *norms, *created;
+
+	pthread_mutex_lock(&index->normsLock);
+	norms = index->norms;
+	if ( norms != NULL && norms->generation == snapshot->generation ) __sync_fetch_and_add(&norms->retainCount, 1);
+	else norms = NULL;
+	pthread_mutex_unlock(&index->normsLock);
+
+	if ( norms != NULL ) return norms;
+
+	created = SPVectorNormsCreate(snapshot, threadCount);
+	if ( created == NULL ) return NULL;
+
+	pthread_mutex_lock(&index->normsLock);
+	if ( index->norms == NULL || index->norms->generation < created->generation ) {
+		norms = index->norms;
+		index->norms = created;
+		__sync_fetch_and_add(&created->retainCount, 1);
+	}
+	pthread_mutex_unlock(&index->normsLock);
+
+	SPVectorNormsRelease(norms);
+	return created;
+}
+
+#pragma mark -
+#pragma mark Document Vectors
+
+size_t SPIndexCopyDocumentVector(SPIndexRef index, SPDocumentID document, SPTermID **outTerms, float **outWeights) {
+
+	// Only the document's own terms are looked up, rather than the statistics of every
+	// term, so that a single vector stays cheap
+
+	static const SPRankingOptions options = { kSPRankingModelTFIDF, 0.0f, 0.0f };
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	const SPSegment *segment = NULL;
+	const SPSegmentDocument *info = SPSnapshotFindDocument(snapshot, document, &segment);
+	SPTermID *terms = NULL;
+	float *weights = NULL, sum = 0.0f;
+	size_t i, count = 0;
+	SPPostingIterator iterator;
+	SPScorer scorer;
+
+	*outTerms = NULL;
+	*outWeights = NULL;
+
+	if ( info == NULL || info->termCount == 0 ) goto bail;
+
+	terms = malloc(info->termCount * sizeof(SPTermID));
+	weights = malloc(info->termCount * sizeof(float));
+	if ( terms == NULL || weights == NULL ) goto bail;
+
+	SPScorerInit(&scorer, snapshot, &options);
+
+	SPPostingIteratorInit(&iterator, segment->vectors + info->vectorOffset, info->vectorLength);
+	while ( SPPostingIteratorNext(&iterator) ) {
+		size_t length, documentCount = 0;
+		const char *string = SPTermDirectoryGetTerm(snapshot->directory, (SPTermID)iterator.document, &length);
+
+		for ( i = 0; i < snapshot->segmentCount; i++ ) {
+			const SPSegmentTerm *term = SPSegmentFindTerm(snapshot->segments[i], string, length);
+			if ( term != NULL ) documentCount += term->documentCount;
+		}
+
+		terms[count] = (SPTermID)iterator.document;
+		weights[count] = SPScorerGetTermScore(&scorer, 1.0f, iterator.frequency, info->length) 
+				* SPScorerGetInverseDocumentFrequency(&scorer, documentCount);
+		sum += weights[count] * weights[count];
+		count++;
+	}
+
+	sum = sqrtf(sum);
+	for ( i = 0; i < count && sum > 0.0f; i++ ) weights[i] /= sum;
+
+	*outTerms = terms;
+	*outWeights = weights;
+	terms = NULL;
+	weights = NULL;
+
+bail:
+	free(terms);
+	free(weights);
+	SPSnapshotRelease(snapshot);
+
+	return ( *outTerms == NULL ? 0 : count );
+}
+
+#pragma mark -
+#pragma mark Similar Documents
+
+typedef struct {
+	SPTermID term;
+	const char *string;
+	size_t length;
+	float weight;
+} SPSimilarityTerm;
+
+typedef struct {
+	const SPSnapshot *snapshot;
+	const SPVectorNorms *norms;
+	const SPSimilarityTerm *terms;
+	size_t termCount;
+	SPDocumentID source;
+	SPTopResults *tops;				// one per segment
+} SPSimilarityWork;
+
+static int SPCompareSimilarityTermWeights(const void *a, const void *b) {
+	float x = ((const SPSimilarityTerm*)a)->weight, y = ((const SPSimilarityTerm*)b)->weight;
+	return ( x > y ? -1 : ( x < y ? 1 : 0 ) );
+}
+
+static void SPScoreSegmentSimilarity(void *context, size_t task) {
+
+	// Dot products are accumulated term at a time into an array spanning the segment's
+	// document IDs, then divided by the norms. The query is already of unit length.
+
+	SPSimilarityWork *work = context;
+	const SPSegment *segment = work->snapshot->segments[task];
+	const SPVectorNorms *norms = work->norms;
+	SPDocumentID first, last;
+	float *products;
+	size_t i;
+
+	if ( segment->documentCount == 0 ) return;
+
+	first = SPSegmentGetFirstDocument(segment);
+	last = SPSegmentGetLastDocument(segment);
+	products = calloc((size_t)( last - first ) + 1, sizeof(float));
+	if ( products == NULL ) return;
+
+	for ( i = 0; i < work->termCount; i++ ) {
+		const SPSimilarityTerm *term = &work->terms[i];
+		const SPSegmentTerm *info = SPSegmentFindTerm(segment, term->string, term->length);
+		float weight = term->weight * norms->inverseFrequencies[term->term];
+		SPPostingIterator iterator;
+
+		if ( info == NULL ) continue;
+
+		SPPostingIteratorInit(&iterator, segment->postings + info->postingsOffset, info->postingsLength);
+		while ( SPPostingIteratorNext(&iterator) ) {
+			const SPSegmentDocument *document = SPSegmentFindDocument(segment, (SPDocumentID)iterator.document);
+			products[iterator.document - (uint32_t)first] += weight 
+					* SPScorerGetTermScore(&norms->scorer, 1.0f, iterator.frequency, document->length);
+		}
+	}
+
+	for ( i = 0; i <= (size_t)( last - first ); i++ ) {
+		SPDocumentID document = first + (SPDocumentID)i;
+
+		if ( products[i] <= 0.0f || document == work->source || norms->norms[document] <= 0.0f 
+				|| SPDeletionSetContains(work->snapshot->deleted, document) )
+			continue;
+
+		SPTopResultsAdd(&work->tops[task], document, products[i] / norms->norms[document]);
+	}
+
+	free(products);
+}
+
+size_t SPIndexCopySimilarDocuments(SPIndexRef index, SPDocumentID document, const SPSimilarityOptions *options, 
+		size_t limit, SPDocumentID *outDocuments, float *outScores) {
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	SPSimilarityOptions defaults = { 0, 0 };
+	const SPSegment *segment = NULL;
+	const SPSegmentDocument *info = SPSnapshotFindDocument(snapshot, document, &segment);
+	SPVectorNorms *norms = NULL;
+	SPSimilarityTerm *terms = NULL;
+	SPTopResults *tops = NULL, top = { outDocuments, NULL, 0, limit };
+	float *scores = NULL;
+	size_t i, j, termCount = 0;
+	SPPostingIterator iterator;
+	SPSimilarityWork work;
+
+	if ( options == NULL ) options = &defaults;
+	if ( info == NULL || info->termCount == 0 || limit == 0 ) goto bail;
+
+	norms = SPIndexCopyVectorNorms(index, snapshot, options->threadCount);
+	terms = malloc(info->termCount * sizeof(SPSimilarityTerm));
+	tops = calloc(snapshot->segmentCount, sizeof(SPTopResults));
+	scores = malloc(limit * sizeof(float));
+	if ( norms == NULL || terms == NULL || tops == NULL || scores == NULL || norms->norms[document] <= 0.0f ) goto bail;
+
+	// The document's own vector is the query
+
+	SPPostingIteratorInit(&iterator, segment->vectors + info->vectorOffset, info->vectorLength);
+	while ( SPPostingIteratorNext(&iterator) ) {
+		SPSimilarityTerm *term = &terms[termCount];
+
+		term->term = (SPTermID)iterator.document;
+		term->string = SPTermDirectoryGetTerm(snapshot->directory, term->term, &term->length);
+		term->weight = SPScorerGetTermScore(&norms->scorer, 1.0f, iterator.frequency, info->length) 
+				* norms->inverseFrequencies[term->term] / norms->norms[document];
+
+		if ( term->weight > 0.0f ) termCount++;
+	}
+
+	if ( options->maximumTerms > 0 && termCount > options->maximumTerms ) {
+		qsort(terms, termCount, sizeof(SPSimilarityTerm), SPCompareSimilarityTermWeights);
+		termCount = options->maximumTerms;
+	}
+
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		tops[i].limit = limit;
+		tops[i].documents = malloc(limit * sizeof(SPDocumentID));
+		tops[i].scores = malloc(limit * sizeof(float));
+		if ( tops[i].documents == NULL || tops[i].scores == NULL ) goto bail;
+	}
+
+	work.snapshot = snapshot;
+	work.norms = norms;
+	work.terms = terms;
+	work.termCount = termCount;
+	work.source = document;
+	work.tops = tops;
+
+	SPRunParallel(snapshot->segmentCount, options->threadCount, SPScoreSegmentSimilarity, &work);
+
+	top.scores = scores;
+	for ( i = 0; i < snapshot->segmentCount; i++ ) {
+		for ( j = 0; j < tops[i].count; j++ ) SPTopResultsAdd(&top, tops[i].documents[j], tops[i].scores[j]);
+	}
+
+	SPTopResultsSort(&top);
+	if ( outScores != NULL ) memcpy(outScores, scores, top.count * sizeof(float));
+
+bail:
+	if ( tops != NULL ) {
+		for ( i = 0; i < snapshot->segmentCount; i++ ) {
+			free(tops[i].documents);
+			free(tops[i].scores);
+		}
+		free(tops);
+	}
+
+	free(scores);
+	free(terms);
+	SPVectorNormsRelease(norms);
+	SPSnapshotRelease(snapshot);
+
+	return top.count;
+}
+
+#pragma mark -
+#pragma mark Near Duplicates
+
+static bool SPSnapshotContainsDocument(const SPSnapshot *snapshot, SPDocumentID document) {
+	return ( document <= snapshot->maximumDocumentID && !SPDeletionSetContains(snapshot->deleted, document) );
+}
+
+static int SPComparePairs(const void *a, const void *b) {
+	const SPDocumentPair *x = a, *y = b;
+	if ( x->similarity != y->similarity ) return ( x->similarity > y->similarity ? -1 : 1 );
+	if ( x->first != y->first ) return ( x->first < y->first ? -1 : 1 );
+	return ( x->second < y->second ? -1 : ( x->second > y->second ? 1 : 0 ) );
+}
+
+size_t SPIndexCopyNearDuplicates(SPIndexRef index, SPDocumentID document, float threshold, 
+		SPDocumentID **outDocuments, float **outSimilarities) {
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	SPDocumentID *documents = NULL;
+	float *similarities = NULL;
+	SPDocumentPair *pairs = NULL;
+	size_t i, j = 0, count = 0;
+
+	*outDocuments = NULL;
+	*outSimilarities = NULL;
+
+	if ( index->signatures == NULL || !SPSnapshotContainsDocument(snapshot, document) 
+			|| !SPSignatureIndexCopyNeighbours(index->signatures, document, threshold, &documents, &similarities, &count) ) 
+		goto bail;
+
+	// Sorted through pairs so that neighbours come out in the same order as pairs do
+
+	if ( count > 0 && ( pairs = malloc(count * sizeof(SPDocumentPair)) ) == NULL ) goto bail;
+
+	for ( i = 0; i < count; i++ ) {
+		if ( !SPSnapshotContainsDocument(snapshot, documents[i]) ) continue;
+		pairs[j].first = documents[i];
+		pairs[j].second = document;
+		pairs[j].similarity = similarities[i];
+		j++;
+	}
+
+	if ( j > 0 ) qsort(pairs, j, sizeof(SPDocumentPair), SPComparePairs);
+
+	for ( i = 0; i < j; i++ ) {
+		documents[i] = pairs[i].first;
+		similarities[i] = pairs[i].similarity;
+	}
+
+	*outDocuments = documents;
+	*outSimilarities = similarities;
+	documents = NULL;
+	similarities = NULL;
+
+bail:
+	free(pairs);
+	free(documents);
+	free(similarities);
+	SPSnapshotRelease(snapshot);
+
+	return ( *outDocuments == NULL ? 0 : j );
+}
+
+size_t SPIndexCopyNearDuplicatePairs(SPIndexRef index, float threshold, SPDocumentPair **outPairs) {
+
+	SPSnapshot *snapshot = SPIndexCopySnapshot(index);
+	SPDocumentPair *pairs = NULL;
+	size_t i, j = 0, count = 0;
+
+	*outPairs = NULL;
+
+	if ( index->signatures != NULL && SPSignatureIndexCopyPairs(index->signatures, threshold, &pairs, &count) ) {
+		for ( i = 0; i < count; i++ ) {
+			if ( SPSnapshotContainsDocument(snapshot, pairs[i].first) && SPSnapshotContainsDocument(snapshot, pairs[i].second) ) 
+				pairs[j++] = pairs[i];
+		}
+
+		if ( j > 0 ) qsort(pairs, j, sizeof(SPDocumentPair), SPComparePairs);
+		*outPairs = pairs;
+	}
+
+	SPSnapshotRelease(snapshot);
+	return j;
+}
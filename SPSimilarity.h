@@ -0,0 +1,90 @@
+//
+//  SPSimilarity.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPSIMILARITY_H
+#define SPSIMILARITY_H
+
+#include "SPIndex.h"
+
+// Document similarity for the native index, built on the term vectors it already keeps.
+// Documents are compared in two ways. Cosine similarity of tf-idf weighted term vectors
+// ranks the documents most like a given one, and is computed on as many threads as there
+// are processors, each scoring its own segments. MinHash signatures estimate how much of
+// their vocabulary two documents share and find near duplicates, either of one document
+// or across the whole index, without comparing every pair. Signatures are only kept when
+// the index is created with indexesSignatures.
+
+typedef struct {
+	uint32_t maximumTerms;			// highest weighted terms of the document to match, 0 for all
+	uint32_t threadCount;			// 0 for one per processor
+} SPSimilarityOptions;
+
+	// Matching fewer terms bounds the cost of finding similar documents to long documents,
+	// at some cost in accuracy: the cosine is then computed over the chosen terms only.
+
+typedef struct {
+	SPDocumentID first;				// the lower ID
+	SPDocumentID second;
+	float similarity;
+} SPDocumentPair;
+
+size_t SPIndexCopyDocumentVector(SPIndexRef index, SPDocumentID document, SPTermID **outTerms, float **outWeights);
+
+	// Copies the tf-idf vector of a document, normalized to unit length, in ascending term
+	// ID order. Weights follow kSPRankingModelTFIDF. Returns the number of terms; the arrays
+	// are malloc'd and must be freed by the caller.
+
+size_t SPIndexCopySimilarDocuments(SPIndexRef index, SPDocumentID document, const SPSimilarityOptions *options, 
+		size_t limit, SPDocumentID *outDocuments, float *outScores);
+
+	// Finds up to limit other documents with the highest cosine similarity to document,
+	// most similar first. options may be NULL. outScores may be NULL. The norms of every
+	// document are computed for the whole index on first use after a refresh and kept
+	// until the next one.
+
+size_t SPIndexCopyNearDuplicates(SPIndexRef index, SPDocumentID document, float threshold, 
+		SPDocumentID **outDocuments, float **outSimilarities);
+size_t SPIndexCopyNearDuplicatePairs(SPIndexRef index, float threshold, SPDocumentPair **outPairs);
+
+	// Find the documents whose estimated Jaccard similarity to document, or to each other,
+	// is at least threshold, most similar first. Thresholds below about 0.5 miss a growing
+	// share of pairs. Return 0 without signatures. The arrays are malloc'd and must be freed
+	// by the caller.
+
+#endif
@@ -0,0 +1,271 @@
+//
+//  SPStatistics.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPStatistics.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+// Each thread owns a block of histograms, found through a thread specific key. Blocks are
+// kept on a list which only ever grows, so a snapshot can walk it without a lock. When a
+// thread exits its block is marked free and the next new thread adopts it, counts and all,
+// so nothing recorded is ever lost and the list stays as long as the most threads that
+// have recorded at once.
+
+#define kSPStatisticsLockDepth 8
+
+typedef struct SPThreadStatistics {
+	struct SPThreadStatistics *next;
+	volatile int inUse;
+	
+	SPHistogram histograms[kSPStatisticCount];
+	
+	uint64_t lockTimes[kSPStatisticsLockDepth];
+	SPStatistic lockStatistics[kSPStatisticsLockDepth];
+	size_t lockDepth;
+} SPThreadStatistics;
+
+static const struct {
+	const char *name;
+	bool isTime;
+} SPStatisticInfo[kSPStatisticCount] = {
+	{ "add", true },
+	{ "batch_add", true },
+	{ "remove", true },
+	{ "flush", true },
+	{ "search", true },
+	{ "fetch", true },
+	{ "top_results", true },
+	{ "term_query", true },
+	{ "compact", true },
+	{ "merge", true },
+	{ "read_lock_wait", true },
+	{ "read_lock_hold", true },
+	{ "write_lock_wait", true },
+	{ "write_lock_hold", true },
+	{ "fetch_chunks", false },
+	{ "index_queue_depth", false },
+	{ "flush_changes", false }
+};
+
+const char * SPStatisticGetName(SPStatistic statistic) {
+	return ( statistic < kSPStatisticCount ? SPStatisticInfo[statistic].name : NULL );
+}
+
+bool SPStatisticIsTime(SPStatistic statistic) {
+	return ( statistic < kSPStatisticCount && SPStatisticInfo[statistic].isTime );
+}
+
+uint64_t SPHistogramGetPercentile(const SPHistogram *histogram, double percentile) {
+
+	uint64_t rank, seen = 0;
+	size_t b;
+
+	if ( histogram->count == 0 )
+		return 0;
+
+	rank = (uint64_t)( percentile * (double)histogram->count + 0.5 );
+	if ( rank < 1 ) rank = 1;
+	if ( rank > histogram->count ) rank = histogram->count;
+
+	for ( b = 0; b < kSPHistogramBucketCount; b++ ) {
+		seen += histogram->buckets[b];
+		if ( seen >= rank ) {
+			uint64_t bound = ( b == 0 ? 0 : ( b == kSPHistogramBucketCount - 1 ? UINT64_MAX : ( (uint64_t)1 << b ) - 1 ) );
+			return ( bound < histogram->maximum ? bound : histogram->maximum );
+		}
+	}
+
+	return histogram->maximum;
+}
+
+#if SPSEARCHSTORE_STATISTICS
+
+static SPThreadStatistics * volatile SPStatisticsThreads = NULL;
+static pthread_key_t SPStatisticsKey;
+static pthread_once_t SPStatisticsOnce = PTHREAD_ONCE_INIT;
+
+static void SPStatisticsThreadDidExit(void *value) {
+	SPThreadStatistics *statistics = value;
+	statistics->lockDepth = 0;
+	__sync_lock_release(&statistics->inUse);
+}
+
+static void SPStatisticsInitialize(void) {
+	pthread_key_create(&SPStatisticsKey, SPStatisticsThreadDidExit);
+}
+
+static SPThreadStatistics * SPStatisticsGetThread(void) {
+
+	SPThreadStatistics *statistics;
+
+	pthread_once(&SPStatisticsOnce, SPStatisticsInitialize);
+
+	statistics = pthread_getspecific(SPStatisticsKey);
+	if ( statistics != NULL )
+		return statistics;
+
+	for ( statistics = SPStatisticsThreads; statistics != NULL; statistics = statistics->next ) {
+		if ( __sync_bool_compare_and_swap(&statistics->inUse, 0, 1) )
+			break;
+	}
+
+	if ( statistics == NULL ) {
+		statistics = calloc(1, sizeof(SPThreadStatistics));
+		if ( statistics == NULL ) return NULL;
+		
+		statistics->inUse = 1;
+		do {
+			statistics->next = SPStatisticsThreads;
+		} while ( !__sync_bool_compare_and_swap(&SPStatisticsThreads, statistics->next, statistics) );
+	}
+
+	pthread_setspecific(SPStatisticsKey, statistics);
+	return statistics;
+}
+
+static void SPHistogramRecord(SPHistogram *histogram, uint64_t value) {
+
+	size_t b = ( value == 0 ? 0 : 64 - (size_t)__builtin_clzll(value) );
+
+	histogram->count++;
+	histogram->total += value;
+	if ( value > histogram->maximum ) histogram->maximum = value;
+	histogram->buckets[b < kSPHistogramBucketCount ? b : kSPHistogramBucketCount - 1]++;
+}
+
+uint64_t SPStatisticsGetTime(void) {
+
+#if defined(__APPLE__)
+	static mach_timebase_info_data_t timebase;
+	if ( timebase.denom == 0 ) mach_timebase_info(&timebase);
+	return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+void SPStatisticsRecord(SPStatistic statistic, uint64_t value) {
+
+	SPThreadStatistics *statistics = SPStatisticsGetThread();
+
+	if ( statistics != NULL && statistic < kSPStatisticCount )
+		SPHistogramRecord(&statistics->histograms[statistic], value);
+}
+
+void SPStatisticsDidLock(SPStatistic waitStatistic, SPStatistic holdStatistic, uint64_t requested) {
+
+	SPThreadStatistics *statistics = SPStatisticsGetThread();
+	uint64_t now = SPStatisticsGetTime();
+
+	if ( statistics == NULL )
+		return;
+
+	SPHistogramRecord(&statistics->histograms[waitStatistic], now - requested);
+
+	if ( statistics->lockDepth < kSPStatisticsLockDepth ) {
+		statistics->lockTimes[statistics->lockDepth] = now;
+		statistics->lockStatistics[statistics->lockDepth] = holdStatistic;
+	}
+	statistics->lockDepth++;
+}
+
+void SPStatisticsDidUnlock(void) {
+
+	SPThreadStatistics *statistics = SPStatisticsGetThread();
+	size_t depth;
+
+	if ( statistics == NULL || statistics->lockDepth == 0 )
+		return;
+
+	depth = --statistics->lockDepth;
+	if ( depth < kSPStatisticsLockDepth )
+		SPHistogramRecord(&statistics->histograms[statistics->lockStatistics[depth]], 
+				SPStatisticsGetTime() - statistics->lockTimes[depth]);
+}
+
+void SPStatisticsCopySnapshot(SPHistogram outHistograms[kSPStatisticCount]) {
+
+	SPThreadStatistics *statistics;
+	size_t s, b;
+
+	memset(outHistograms, 0, kSPStatisticCount * sizeof(SPHistogram));
+
+	for ( statistics = SPStatisticsThreads; statistics != NULL; statistics = statistics->next ) {
+		for ( s = 0; s < kSPStatisticCount; s++ ) {
+			const SPHistogram *histogram = &statistics->histograms[s];
+			
+			outHistograms[s].count += histogram->count;
+			outHistograms[s].total += histogram->total;
+			if ( histogram->maximum > outHistograms[s].maximum ) outHistograms[s].maximum = histogram->maximum;
+			
+			for ( b = 0; b < kSPHistogramBucketCount; b++ )
+				outHistograms[s].buckets[b] += histogram->buckets[b];
+		}
+	}
+}
+
+#else
+
+uint64_t SPStatisticsGetTime(void) {
+	return 0;
+}
+
+void SPStatisticsRecord(SPStatistic statistic, uint64_t value) {
+}
+
+void SPStatisticsDidLock(SPStatistic waitStatistic, SPStatistic holdStatistic, uint64_t requested) {
+}
+
+void SPStatisticsDidUnlock(void) {
+}
+
+void SPStatisticsCopySnapshot(SPHistogram outHistograms[kSPStatisticCount]) {
+	memset(outHistograms, 0, kSPStatisticCount * sizeof(SPHistogram));
+}
+
+#endif
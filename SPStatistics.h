@@ -0,0 +1,160 @@
+//
+//  SPStatistics.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPSTATISTICS_H
+#define SPSTATISTICS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Latency and size histograms for the store's hot paths: indexing, flushing, searching,
+// fetching, term requests and compaction, along with the time callers wait for and hold
+// the index locks and the depth of the indexing queue.
+
+// Every thread records into its own set of histograms, so recording takes no lock and no
+// atomic operation, only a clock read and a few increments. A snapshot sums the sets of
+// every thread that has recorded. It may lag a thread that is recording at that moment by
+// a value or so. Statistics are kept for the whole process rather than for each store.
+
+// Define SPSEARCHSTORE_STATISTICS to 0 to compile the instrumentation out entirely, in
+// which case the macros below do nothing and snapshots are empty.
+
+#ifndef SPSEARCHSTORE_STATISTICS
+	#define SPSEARCHSTORE_STATISTICS 1
+#endif
+
+typedef enum {
+	kSPStatisticAdd = 0,				// adding or replacing one document
+	kSPStatisticBatchAdd,				// adding a batch of documents, per batch
+	kSPStatisticRemove,
+	kSPStatisticFlush,					// making changes searchable
+	kSPStatisticSearch,					// preparing a search session, or failing to
+	kSPStatisticFetch,					// each fetch from a search session
+	kSPStatisticTopResults,
+	kSPStatisticTermQuery,
+	kSPStatisticCompact,
+	kSPStatisticMerge,					// native segment merges, including compaction's
+	kSPStatisticReadLockWait,
+	kSPStatisticReadLockHold,
+	kSPStatisticWriteLockWait,
+	kSPStatisticWriteLockHold,
+	kSPStatisticFetchChunks,			// backend fetches made by each session fetch
+	kSPStatisticIndexQueueDepth,		// operations already queued when one is added
+	kSPStatisticFlushChanges,			// changes made searchable by each flush
+	kSPStatisticCount
+} SPStatistic;
+
+#define kSPHistogramBucketCount 64
+
+typedef struct {
+	uint64_t count;
+	uint64_t total;
+	uint64_t maximum;
+	uint64_t buckets[kSPHistogramBucketCount];
+} SPHistogram;
+
+	// Bucket 0 counts zeros and bucket b counts values from 2^(b-1) up to 2^b, with the last
+	// bucket taking everything larger. Times are in nanoseconds.
+
+const char * SPStatisticGetName(SPStatistic statistic);
+bool SPStatisticIsTime(SPStatistic statistic);
+
+	// Names are short lower case identifiers such as "add" or "read_lock_wait". Statistics
+	// which are not times are counts.
+
+void SPStatisticsCopySnapshot(SPHistogram outHistograms[kSPStatisticCount]);
+
+	// Sums every thread's histograms into outHistograms.
+
+uint64_t SPHistogramGetPercentile(const SPHistogram *histogram, double percentile);
+
+	// Estimates the value below which percentile (0 to 1) of the recorded values fall, from
+	// the upper bound of the bucket it lands in, never more than the maximum.
+
+uint64_t SPStatisticsGetTime(void);
+void SPStatisticsRecord(SPStatistic statistic, uint64_t value);
+
+	// A monotonic clock in nanoseconds, and recording a value in the calling thread's
+	// histogram. Prefer the macros, which disappear when statistics are compiled out.
+
+void SPStatisticsDidLock(SPStatistic waitStatistic, SPStatistic holdStatistic, uint64_t requested);
+void SPStatisticsDidUnlock(void);
+
+	// Lock wrappers call these after acquiring a lock they asked for at time requested, and
+	// before releasing it. Locks must be released in the reverse order they were taken on
+	// the thread which took them, as pthread locks require. Only the innermost few locks a
+	// thread holds are timed.
+
+#if SPSEARCHSTORE_STATISTICS
+
+	#define SPStatisticsStart(start)				uint64_t start = SPStatisticsGetTime()
+	#define SPStatisticsStop(statistic, start)		SPStatisticsRecord(statistic, SPStatisticsGetTime() - (start))
+	#define SPStatisticsCount(statistic, value)		SPStatisticsRecord(statistic, (uint64_t)(value))
+
+	#define SPStatisticsLocked(waitStatistic, holdStatistic, requested)		SPStatisticsDidLock(waitStatistic, holdStatistic, requested)
+	#define SPStatisticsUnlocking()											SPStatisticsDidUnlock()
+
+static inline void SPStatisticsLockMutex(pthread_mutex_t *mutex, SPStatistic waitStatistic, SPStatistic holdStatistic) {
+	uint64_t requested = SPStatisticsGetTime();
+	pthread_mutex_lock(mutex);
+	SPStatisticsDidLock(waitStatistic, holdStatistic, requested);
+}
+
+static inline void SPStatisticsUnlockMutex(pthread_mutex_t *mutex) {
+	SPStatisticsDidUnlock();
+	pthread_mutex_unlock(mutex);
+}
+
+#else
+
+	#define SPStatisticsStart(start)
+	#define SPStatisticsStop(statistic, start)		do { } while ( 0 )
+	#define SPStatisticsCount(statistic, value)		do { } while ( 0 )
+
+	#define SPStatisticsLocked(waitStatistic, holdStatistic, requested)		do { } while ( 0 )
+	#define SPStatisticsUnlocking()											do { } while ( 0 )
+
+	#define SPStatisticsLockMutex(mutex, waitStatistic, holdStatistic)		pthread_mutex_lock(mutex)
+	#define SPStatisticsUnlockMutex(mutex)									pthread_mutex_unlock(mutex)
+
+#endif
+
+#endif
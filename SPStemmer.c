@@ -0,0 +1,326 @@
+//
+//  SPStemmer.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPStemmer.h"
+#include "SPStringTable.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// A direct reading of M.F. Porter, "An algorithm for suffix stripping", Program 14(3), 1980.
+// The word is b[0..k], j marks the end of the stem while a suffix is being considered.
+
+typedef struct {
+	char *b;
+	int k;
+	int j;
+} SPStemmer;
+
+static bool SPStemmerIsConsonant(const SPStemmer *z, int i) {
+	switch ( z->b[i] ) {
+	case 'a': case 'e': case 'i': case 'o': case 'u':
+		return false;
+	case 'y':
+		return ( i == 0 ? true : !SPStemmerIsConsonant(z, i - 1) );
+	default:
+		return true;
+	}
+}
+
+static int SPStemmerMeasure(const SPStemmer *z) {
+
+	// The number of vowel-consonant sequences in b[0..j].
+
+	int n = 0, i = 0;
+
+	while ( true ) {
+		if ( i > z->j ) return n;
+		if ( !SPStemmerIsConsonant(z, i) ) break;
+		i++;
+	}
+	i++;
+	while ( true ) {
+		while ( true ) {
+			if ( i > z->j ) return n;
+			if ( SPStemmerIsConsonant(z, i) ) break;
+			i++;
+		}
+		i++;
+		n++;
+		while ( true ) {
+			if ( i > z->j ) return n;
+			if ( !SPStemmerIsConsonant(z, i) ) break;
+			i++;
+		}
+		i++;
+	}
+}
+
+static bool SPStemmerStemHasVowel(const SPStemmer *z) {
+	int i;
+	for ( i = 0; i <= z->j; i++ ) {
+		if ( !SPStemmerIsConsonant(z, i) ) return true;
+	}
+	return false;
+}
+
+static bool SPStemmerDoubleConsonant(const SPStemmer *z, int i) {
+	return ( i >= 1 && z->b[i] == z->b[i-1] && SPStemmerIsConsonant(z, i) );
+}
+
+static bool SPStemmerConsonantVowelConsonant(const SPStemmer *z, int i) {
+
+	// b[i-2..i] is consonant-vowel-consonant and the last is not w, x or y, as in hop.
+
+	if ( i < 2 || !SPStemmerIsConsonant(z, i) || SPStemmerIsConsonant(z, i - 1) || !SPStemmerIsConsonant(z, i - 2) )
+		return false;
+	return ( z->b[i] != 'w' && z->b[i] != 'x' && z->b[i] != 'y' );
+}
+
+static bool SPStemmerEnds(SPStemmer *z, const char *suffix, int length) {
+
+	if ( length > z->k + 1 || z->b[z->k] != suffix[length-1] ) return false;
+	if ( memcmp(z->b + z->k - length + 1, suffix, length) != 0 ) return false;
+
+	z->j = z->k - length;
+	return true;
+}
+
+static void SPStemmerSetTo(SPStemmer *z, const char *suffix, int length) {
+	memcpy(z->b + z->j + 1, suffix, length);
+	z->k = z->j + length;
+}
+
+// Suffixes are literals, so their lengths are known without strlen
+
+#define SPStemmerEndsWith(z, suffix)	SPStemmerEnds(z, suffix, sizeof(suffix) - 1)
+#define SPStemmerSetToString(z, suffix)	SPStemmerSetTo(z, suffix, sizeof(suffix) - 1)
+
+typedef struct {
+	const char *suffix;
+	int length;
+	const char *replacement;
+	int replacementLength;
+} SPStemmerRule;
+
+#define SPStemmerSuffix(suffix, replacement)	{ suffix, sizeof(suffix) - 1, replacement, sizeof(replacement) - 1 }
+
+static void SPStemmerApplyRules(SPStemmer *z, const SPStemmerRule *rules, size_t count) {
+
+	// The first rule whose suffix matches is the only one tried
+
+	size_t i;
+
+	for ( i = 0; i < count; i++ ) {
+		if ( SPStemmerEnds(z, rules[i].suffix, rules[i].length) ) {
+			if ( SPStemmerMeasure(z) > 0 ) SPStemmerSetTo(z, rules[i].replacement, rules[i].replacementLength);
+			return;
+		}
+	}
+}
+
+static void SPStemmerStep1ab(SPStemmer *z) {
+
+	// Plurals and -ed or -ing: caresses -> caress, ponies -> poni, meetings -> meet.
+
+	if ( z->b[z->k] == 's' ) {
+		if ( SPStemmerEndsWith(z, "sses") ) z->k -= 2;
+		else if ( SPStemmerEndsWith(z, "ies") ) SPStemmerSetToString(z, "i");
+		else if ( z->b[z->k-1] != 's' ) z->k--;
+	}
+
+	if ( SPStemmerEndsWith(z, "eed") ) {
+		if ( SPStemmerMeasure(z) > 0 ) z->k--;
+	}
+	else if ( ( SPStemmerEndsWith(z, "ed") || SPStemmerEndsWith(z, "ing") ) && SPStemmerStemHasVowel(z) ) {
+		z->k = z->j;
+		if ( SPStemmerEndsWith(z, "at") ) SPStemmerSetToString(z, "ate");
+		else if ( SPStemmerEndsWith(z, "bl") ) SPStemmerSetToString(z, "ble");
+		else if ( SPStemmerEndsWith(z, "iz") ) SPStemmerSetToString(z, "ize");
+		else if ( SPStemmerDoubleConsonant(z, z->k) ) {
+			char c = z->b[z->k];
+			z->k--;
+			if ( c == 'l' || c == 's' || c == 'z' ) z->k++;
+		}
+		else {
+			z->j = z->k;
+			if ( SPStemmerMeasure(z) == 1 && SPStemmerConsonantVowelConsonant(z, z->k) ) SPStemmerSetToString(z, "e");
+		}
+	}
+}
+
+static void SPStemmerStep1c(SPStemmer *z) {
+
+	// A terminal y becomes i when there is another vowel in the stem.
+
+	if ( SPStemmerEndsWith(z, "y") && SPStemmerStemHasVowel(z) ) z->b[z->k] = 'i';
+}
+
+static void SPStemmerStep2(SPStemmer *z) {
+
+	// Double suffixes map to single ones when the stem's measure is above zero.
+
+	static const SPStemmerRule rules[] = {
+		SPStemmerSuffix("ational", "ate"), SPStemmerSuffix("tional", "tion"), SPStemmerSuffix("enci", "ence"), 
+		SPStemmerSuffix("anci", "ance"), SPStemmerSuffix("izer", "ize"), SPStemmerSuffix("bli", "ble"), 
+		SPStemmerSuffix("alli", "al"), SPStemmerSuffix("entli", "ent"), SPStemmerSuffix("eli", "e"), 
+		SPStemmerSuffix("ousli", "ous"), SPStemmerSuffix("ization", "ize"), SPStemmerSuffix("ation", "ate"), 
+		SPStemmerSuffix("ator", "ate"), SPStemmerSuffix("alism", "al"), SPStemmerSuffix("iveness", "ive"), 
+		SPStemmerSuffix("fulness", "ful"), SPStemmerSuffix("ousness", "ous"), SPStemmerSuffix("aliti", "al"), 
+		SPStemmerSuffix("iviti", "ive"), SPStemmerSuffix("biliti", "ble"), SPStemmerSuffix("logi", "log")
+	};
+
+	if ( z->k < 1 ) return;
+	SPStemmerApplyRules(z, rules, sizeof(rules) / sizeof(rules[0]));
+}
+
+static void SPStemmerStep3(SPStemmer *z) {
+
+	static const SPStemmerRule rules[] = {
+		SPStemmerSuffix("icate", "ic"), SPStemmerSuffix("ative", ""), SPStemmerSuffix("alize", "al"), 
+		SPStemmerSuffix("iciti", "ic"), SPStemmerSuffix("ical", "ic"), SPStemmerSuffix("ful", ""), 
+		SPStemmerSuffix("ness", "")
+	};
+
+	SPStemmerApplyRules(z, rules, sizeof(rules) / sizeof(rules[0]));
+}
+
+static void SPStemmerStep4(SPStemmer *z) {
+
+	// Single suffixes come off when the stem's measure is above one.
+
+	static const SPStemmerRule rules[] = {
+		SPStemmerSuffix("al", ""), SPStemmerSuffix("ance", ""), SPStemmerSuffix("ence", ""), SPStemmerSuffix("er", ""), 
+		SPStemmerSuffix("ic", ""), SPStemmerSuffix("able", ""), SPStemmerSuffix("ible", ""), SPStemmerSuffix("ant", ""), 
+		SPStemmerSuffix("ement", ""), SPStemmerSuffix("ment", ""), SPStemmerSuffix("ent", ""), SPStemmerSuffix("ion", ""), 
+		SPStemmerSuffix("ou", ""), SPStemmerSuffix("ism", ""), SPStemmerSuffix("ate", ""), SPStemmerSuffix("iti", ""), 
+		SPStemmerSuffix("ous", ""), SPStemmerSuffix("ive", ""), SPStemmerSuffix("ize", "")
+	};
+	size_t i;
+
+	if ( z->k < 1 ) return;
+
+	for ( i = 0; i < sizeof(rules) / sizeof(rules[0]); i++ ) {
+		if ( SPStemmerEnds(z, rules[i].suffix, rules[i].length) ) {
+			if ( strcmp(rules[i].suffix, "ion") == 0 && ( z->j < 0 || ( z->b[z->j] != 's' && z->b[z->j] != 't' ) ) )
+				return;
+			if ( SPStemmerMeasure(z) > 1 ) z->k = z->j;
+			return;
+		}
+	}
+}
+
+static void SPStemmerStep5(SPStemmer *z) {
+
+	// A final e comes off, and a double l becomes single, when the measure allows.
+
+	z->j = z->k;
+
+	if ( z->b[z->k] == 'e' ) {
+		int measure = SPStemmerMeasure(z);
+		if ( measure > 1 || ( measure == 1 && !SPStemmerConsonantVowelConsonant(z, z->k - 1) ) ) z->k--;
+	}
+
+	if ( z->b[z->k] == 'l' && SPStemmerDoubleConsonant(z, z->k) && SPStemmerMeasure(z) > 1 ) z->k--;
+}
+
+#pragma mark -
+
+// Word frequencies follow a Zipf distribution, so most of the terms a thread stems it has
+// stemmed before. Each thread keeps the stems of recent short terms in a direct mapped
+// cache, which turns the common case into a hash and two small copies.
+
+#define kSPStemCacheSize		1024
+#define kSPStemCacheTermLength	24
+
+typedef struct {
+	uint32_t hash;
+	uint8_t length;					// 0 for an empty entry
+	uint8_t stemLength;
+	char term[kSPStemCacheTermLength];
+	char stem[kSPStemCacheTermLength];
+} SPStemCacheEntry;
+
+static __thread SPStemCacheEntry SPStemCache[kSPStemCacheSize];
+
+size_t SPStemTerm(char *term, size_t length) {
+
+	SPStemCacheEntry *entry = NULL;
+	SPStemmer z;
+	size_t i;
+
+	if ( length <= 2 || length > 64 ) return length;
+
+	for ( i = 0; i < length; i++ ) {
+		if ( term[i] < 'a' || term[i] > 'z' ) return length;
+	}
+
+	if ( length <= kSPStemCacheTermLength ) {
+		uint32_t hash = SPStringHash(term, length);
+		entry = &SPStemCache[hash & ( kSPStemCacheSize - 1 )];
+		if ( entry->hash == hash && entry->length == length && memcmp(entry->term, term, length) == 0 ) {
+			memcpy(term, entry->stem, entry->stemLength);
+			return entry->stemLength;
+		}
+		entry->hash = hash;
+		entry->length = 0;
+		memcpy(entry->term, term, length);
+	}
+
+	z.b = term;
+	z.k = (int)length - 1;
+	z.j = 0;
+
+	SPStemmerStep1ab(&z);
+	if ( z.k > 0 ) {
+		SPStemmerStep1c(&z);
+		SPStemmerStep2(&z);
+		SPStemmerStep3(&z);
+		SPStemmerStep4(&z);
+		SPStemmerStep5(&z);
+	}
+
+	if ( entry != NULL ) {
+		memcpy(entry->stem, term, z.k + 1);
+		entry->stemLength = (uint8_t)( z.k + 1 );
+		entry->length = (uint8_t)length;
+	}
+
+	return (size_t)z.k + 1;
+}
@@ -0,0 +1,417 @@
+//
+//  SPStopWords.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPStopWords.h"
+#include "SPStringTable.h"
+
+#include <string.h>
+
+// A term hashes with FNV-1a to a bucket, whose displacement is mixed into the hash again
+// to give the term's slot. The generator chose the displacements so that no two words
+// share a slot, and so a term that is not in its slot is not a stop word.
+
+typedef struct {
+	uint16_t offset;				// in SPStopWordStrings
+	uint8_t length;					// 0 for an empty slot
+	uint8_t languages;
+} SPStopWordSlot;
+
+#pragma mark Generated Tables
+
+// Generated by Tools/SPStopWordsGenerator.py from 675 words, do not edit by hand.
+
+#define kSPStopWordSlotCount		1024
+#define kSPStopWordBucketCount		169
+#define kSPStopWordMaximumLength	8
+
+static const char SPStopWordStrings[] =
+	"aaanaberadaialalgoalgunasalgunosallallaalleallemallenallerallesalloalltalsalsoaltijdamanancheand"
+	"andereanderenandereranderesanteantesanyaoaosarareasatateattat\303\251auauchaufausaussiauxavavec"
+	"avezavoiravonsbebeibenbijbinbisbistblevbliblirbutbyccancarcecelacescetcetteceuxchechicicomcome"
+	"comoconcontracontrocouldcualcuandocuiddadaardaldalladalledamitdandanndansdardasdassdasselbedat"
+	"dazudedeglideideindeinedeldeladeledelladelledellodemdendenndennaderderasdesdesdedessdessendet"
+	"dettadezedididdiediesdiesedieserdiesesdigdindinaditdodochdoendoesdoncdondedoordortdosdovedu"
+	"durantedurchdusd\303\244reedeeneenseftereineineeinemeineneinereinesejelelaelaseleelesellaellas"
+	"elleellerellesellosemenentreereraeresesesaesaseseesoesosessaesseestestaestabaestaresteestoestos"
+	"etetceteetreettetwaseueucheuereuxfoiforfranfromfr\303\245nfuefueronfurf\303\266rf\303\274rgegeen"
+	"gegengeweestgewesengligoesgothahaarhabhabehabenhadhadehanhannohansharhashastahathattehavehayhe"
+	"hebhebbenheefthemhennehennesherhershethierhijhimhinhinterhishoehonhonomhowhunhurh\303\241"
+	"h\303\244riichickeietsifihmihnihnenihrihreikililsiminindeminsinteioisissoististoititsjjajagje"
+	"jedejedemjedenjederjedesjetztjuj\303\241kankannkeinkeinekonkonnenkunnenk\303\266nnenllalaslelei"
+	"lesletleurleurslhelolorolosluimmamaarmaismanmanchemasmemedmeermeinmeinemellanmememenmesmetmeumi"
+	"miamichmigmijmijnminminaminhamiomirmismitmittmoetmoimoinsmonmoremotmuchmuchomuitomussmustmuymy"
+	"mycketm\303\241sm\303\252mennanaarnachnadanagonnagotnaonarnasneneglineinelnellanellenemninicht"
+	"nichtsnietnietsnonochnognoinonnornosnosotrosnostronotnotrenousnownununnurn\303\243on\303\244r"
+	"n\303\245gonn\303\245gotn\303\263soobochoderofoffohneomomdatononderonsontookoporosossotraotroou"
+	"ouroverowno\303\271paparparapaspelapeloperpercheperch\303\251peropiupi\303\271pluspocoporporque"
+	"pourp\303\245ququalqualequandoquequellaquellequelloquemquestaquestequestoquiquienqu\303\251reeds"
+	"ssasammasaosesedanseesehrseiseinseinesemsersessetseushallsheshouldsisiasiamosichsiesigsinsina"
+	"sindsjalvsj\303\244lvskullesosobresolchesollsomsomesonsondernsonosonstsontsusuasuesulsullasuosur"
+	"suss\303\243os\303\245s\303\255ttatambemtambientambi\303\251ntamb\303\251mtetegentemtesthanthat"
+	"thethemthentherethesetheythisthosethoughtienetilltotochtoentoitontootottoustouttratres"
+	"tr\303\250stutustuttituttouuberuitumumaununaundunderuneunounosunsunserunteruppusututanuwvadvan"
+	"varvaravaritveelvividvielvilkavilkenvocevoc\303\252voivomvonvoorvorvosvotrevouswahrendwantwar"
+	"warenwaswatwayweweilweiterwelwelchewennwerwerdwerdewerdenwezenwhatwhenwherewhichwhowhywiewieder"
+	"wilwillwirwirdwowollenwordenwouldw\303\244hrendyyayesyetyoyouyouryourszalzezelfzichzijzijnzo"
+	"zonderzouzuzumzurzwarzwischen\303\240\303\244n\303\244r\303\245t\303\250\303\251\303\251l"
+	"\303\251t\303\251\303\252tre\303\266ver\303\274ber";
+
+static const SPStopWordSlot SPStopWordSlots[kSPStopWordSlotCount] = {
+	{ 0, 0, 0 }, { 39, 4, 0x12 }, { 1630, 6, 0x10 }, { 0, 0, 0 },
+	{ 1823, 3, 0x10 }, { 1457, 3, 0x40 }, { 1284, 5, 0x20 }, { 201, 3, 0x02 },
+	{ 1360, 4, 0x08 }, { 1486, 3, 0x01 }, { 1662, 3, 0x28 }, { 0, 0, 0 },
+	{ 2275, 3, 0x01 }, { 2014, 5, 0x01 }, { 0, 0, 0 }, { 152, 3, 0x80 },
+	{ 466, 5, 0x80 }, { 868, 4, 0x80 }, { 1080, 2, 0x44 }, { 2130, 5, 0x80 },
+	{ 960, 3, 0x02 }, { 0, 0, 0 }, { 379, 5, 0x10 }, { 1616, 3, 0x04 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1033, 2, 0x14 },
+	{ 252, 3, 0x04 }, { 0, 0, 0 }, { 145, 2, 0x25 }, { 950, 4, 0x42 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 712, 4, 0x28 }, { 691, 3, 0x08 }, { 770, 3, 0x04 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 1042, 5, 0x02 }, { 2334, 5, 0x01 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1581, 3, 0x80 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 140, 2, 0x80 }, { 1132, 3, 0x40 },
+	{ 1394, 3, 0x20 }, { 1106, 5, 0x02 }, { 1826, 5, 0x10 }, { 326, 5, 0x10 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 123, 4, 0x08 },
+	{ 0, 0, 0 }, { 2054, 4, 0x40 }, { 668, 5, 0x28 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 171, 5, 0x04 }, { 1948, 3, 0x08 }, { 1192, 3, 0x14 },
+	{ 748, 4, 0x04 }, { 1579, 2, 0x28 }, { 527, 4, 0x01 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1031, 2, 0x40 }, { 1941, 4, 0x20 }, { 0, 0, 0 },
+	{ 1554, 5, 0x40 }, { 2006, 4, 0x01 }, { 2362, 4, 0x03 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 2246, 4, 0x04 }, { 1932, 3, 0x10 }, { 531, 4, 0x04 },
+	{ 1050, 4, 0x80 }, { 1763, 3, 0x20 }, { 236, 1, 0x04 }, { 0, 0, 0 },
+	{ 1185, 4, 0x10 }, { 684, 3, 0x08 }, { 1183, 2, 0x18 }, { 2122, 2, 0x1C },
+	{ 1062, 3, 0x02 }, { 1421, 5, 0x10 }, { 264, 3, 0x10 }, { 1119, 4, 0x02 },
+	{ 1821, 2, 0x1C }, { 2195, 3, 0x80 }, { 384, 3, 0x10 }, { 0, 0, 0 },
+	{ 32, 3, 0x01 }, { 523, 4, 0x40 }, { 93, 3, 0x01 }, { 2272, 3, 0x40 },
+	{ 1509, 4, 0x20 }, { 1442, 4, 0x40 }, { 2078, 4, 0x04 }, { 1716, 4, 0x20 },
+	{ 0, 0, 0 }, { 1267, 3, 0x80 }, { 1882, 4, 0x02 }, { 2074, 4, 0x04 },
+	{ 0, 0, 0 }, { 1704, 6, 0x10 }, { 1298, 3, 0x02 }, { 0, 0, 0 },
+	{ 2109, 1, 0x40 }, { 1889, 4, 0x01 }, { 1841, 3, 0x88 }, { 323, 3, 0x10 },
+	{ 582, 4, 0x40 }, { 1258, 2, 0x18 }, { 954, 3, 0x40 }, { 1451, 2, 0x29 },
+	{ 78, 6, 0x40 }, { 0, 0, 0 }, { 428, 4, 0x02 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 1113, 3, 0x20 }, { 331, 5, 0x10 },
+	{ 1260, 3, 0x10 }, { 0, 0, 0 }, { 1494, 4, 0x04 }, { 0, 0, 0 },
+	{ 722, 5, 0x08 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1992, 3, 0x04 },
+	{ 2068, 3, 0x01 }, { 1236, 6, 0x80 }, { 1780, 3, 0x10 }, { 0, 0, 0 },
+	{ 2451, 3, 0x40 }, { 2436, 3, 0x40 }, { 0, 0, 0 }, { 1912, 4, 0x04 },
+	{ 840, 4, 0x01 }, { 142, 3, 0x01 }, { 2373, 2, 0x02 }, { 377, 2, 0xEC },
+	{ 1552, 2, 0xC0 }, { 1403, 2, 0x14 }, { 0, 0, 0 }, { 995, 4, 0x80 },
+	{ 2264, 5, 0x42 }, { 1209, 6, 0x02 }, { 844, 3, 0x01 }, { 0, 0, 0 },
+	{ 2359, 3, 0x40 }, { 0, 0, 0 }, { 608, 5, 0x02 }, { 358, 4, 0x02 },
+	{ 0, 0, 0 }, { 2065, 3, 0x04 }, { 1466, 3, 0x01 }, { 1869, 2, 0x03 },
+	{ 0, 0, 0 }, { 2290, 3, 0x40 }, { 709, 3, 0x04 }, { 165, 3, 0x02 },
+	{ 540, 4, 0x40 }, { 2375, 6, 0x02 }, { 1280, 4, 0x80 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 316, 1, 0x04 }, { 1195, 1, 0x04 },
+	{ 1011, 2, 0x01 }, { 2400, 1, 0x0C }, { 0, 0, 0 }, { 887, 3, 0x01 },
+	{ 0, 0, 0 }, { 849, 4, 0x40 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 745, 3, 0x04 }, { 2096, 3, 0x08 }, { 0, 0, 0 },
+	{ 1463, 3, 0x10 }, { 355, 3, 0x22 }, { 96, 6, 0x42 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 2241, 5, 0x04 }, { 0, 0, 0 },
+	{ 983, 3, 0x01 }, { 0, 0, 0 }, { 0, 0, 0 }, { 2228, 3, 0x02 },
+	{ 0, 0, 0 }, { 535, 5, 0x08 }, { 1597, 4, 0xC0 }, { 1758, 5, 0x80 },
+	{ 2207, 6, 0x80 }, { 0, 0, 0 }, { 2479, 3, 0x80 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 649, 5, 0x80 }, { 0, 0, 0 }, { 2124, 3, 0x18 },
+	{ 2381, 6, 0x40 }, { 0, 0, 0 }, { 622, 3, 0x20 }, { 0, 0, 0 },
+	{ 1069, 2, 0x01 }, { 1506, 3, 0x02 }, { 387, 4, 0x02 }, { 792, 3, 0x08 },
+	{ 1309, 3, 0x04 }, { 0, 0, 0 }, { 1984, 5, 0x40 }, { 872, 3, 0x88 },
+	{ 860, 5, 0x02 }, { 986, 3, 0x40 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 884, 3, 0x80 }, { 1065, 4, 0x20 }, { 2269, 3, 0x43 }, { 1798, 3, 0x04 },
+	{ 0, 0, 0 }, { 1162, 3, 0x10 }, { 517, 2, 0x21 }, { 1123, 4, 0x02 },
+	{ 1436, 6, 0x02 }, { 762, 4, 0x02 }, { 1127, 5, 0x02 }, { 0, 0, 0 },
+	{ 755, 5, 0x02 }, { 0, 0, 0 }, { 697, 4, 0x08 }, { 1536, 3, 0x80 },
+	{ 0, 0, 0 }, { 978, 5, 0x80 }, { 572, 4, 0x80 }, { 0, 0, 0 },
+	{ 463, 3, 0x80 }, { 1776, 4, 0x02 }, { 0, 0, 0 }, { 2280, 4, 0x02 },
+	{ 0, 0, 0 }, { 947, 3, 0x40 }, { 0, 0, 0 }, { 1013, 3, 0x02 },
+	{ 1647, 3, 0x10 }, { 783, 4, 0x01 }, { 0, 0, 0 }, { 2443, 2, 0x40 },
+	{ 0, 0, 0 }, { 412, 5, 0x10 }, { 2306, 4, 0x40 }, { 1838, 3, 0x80 },
+	{ 159, 2, 0x04 }, { 636, 4, 0x08 }, { 432, 5, 0x80 }, { 1007, 4, 0x40 },
+	{ 1566, 3, 0x40 }, { 344, 4, 0x02 }, { 0, 0, 0 }, { 4, 4, 0x02 },
+	{ 2119, 3, 0x20 }, { 0, 0, 0 }, { 1227, 4, 0x02 }, { 0, 0, 0 },
+	{ 2171, 3, 0x80 }, { 2403, 3, 0x01 }, { 0, 0, 0 }, { 1807, 5, 0x01 },
+	{ 0, 0, 0 }, { 629, 3, 0x20 }, { 632, 4, 0x20 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 2401, 2, 0x08 }, { 1678, 2, 0x04 }, { 2163, 2, 0x80 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 25, 7, 0x08 }, { 2315, 6, 0x02 },
+	{ 2048, 4, 0x80 }, { 0, 0, 0 }, { 830, 7, 0x02 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 35, 4, 0x90 }, { 0, 0, 0 }, { 1916, 2, 0x18 },
+	{ 0, 0, 0 }, { 2426, 2, 0x40 }, { 74, 4, 0x02 }, { 926, 3, 0x40 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 1196, 2, 0x14 }, { 0, 0, 0 },
+	{ 1750, 5, 0x40 }, { 1246, 3, 0xC0 }, { 912, 3, 0x40 }, { 0, 0, 0 },
+	{ 391, 5, 0x02 }, { 1543, 2, 0x41 }, { 0, 0, 0 }, { 2293, 6, 0x02 },
+	{ 731, 4, 0x08 }, { 1698, 6, 0x10 }, { 1812, 3, 0x01 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1675, 3, 0x80 },
+	{ 625, 4, 0x20 }, { 102, 7, 0x02 }, { 0, 0, 0 }, { 2127, 3, 0x02 },
+	{ 0, 0, 0 }, { 272, 3, 0x20 }, { 1960, 7, 0x08 }, { 341, 3, 0x40 },
+	{ 213, 3, 0x02 }, { 88, 5, 0x10 }, { 2406, 3, 0x01 }, { 224, 3, 0x80 },
+	{ 1951, 1, 0x04 }, { 1501, 2, 0xC0 }, { 0, 0, 0 }, { 317, 2, 0x32 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 2032, 5, 0x01 }, { 1027, 4, 0x02 },
+	{ 0, 0, 0 }, { 1389, 5, 0x80 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 86, 2, 0x83 }, { 1577, 2, 0x01 }, { 1756, 2, 0x84 },
+	{ 204, 3, 0x40 }, { 0, 0, 0 }, { 2189, 4, 0x40 }, { 1289, 3, 0x10 },
+	{ 760, 2, 0x20 }, { 14, 4, 0x08 }, { 1489, 5, 0x04 }, { 675, 3, 0x28 },
+	{ 0, 0, 0 }, { 1472, 8, 0x08 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 1766, 2, 0x3C }, { 2037, 6, 0x01 }, { 12, 2, 0x58 }, { 307, 6, 0x08 },
+	{ 1921, 3, 0x10 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1077, 3, 0x80 },
+	{ 286, 6, 0x08 }, { 2284, 6, 0x02 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 701, 4, 0x20 }, { 0, 0, 0 }, { 0, 0, 0 }, { 2347, 3, 0x01 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 2213, 4, 0x20 }, { 2141, 4, 0x08 },
+	{ 812, 2, 0x40 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 58, 5, 0x42 }, { 2094, 2, 0x1C }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 1627, 3, 0x10 }, { 898, 5, 0x02 }, { 1935, 3, 0x04 }, { 168, 3, 0x02 },
+	{ 2366, 3, 0x02 }, { 0, 0, 0 }, { 275, 4, 0x10 }, { 453, 4, 0x80 },
+	{ 0, 0, 0 }, { 1623, 4, 0x20 }, { 362, 8, 0x02 }, { 1384, 5, 0x80 },
+	{ 603, 5, 0x02 }, { 0, 0, 0 }, { 963, 6, 0x02 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1202, 4, 0x24 }, { 1446, 5, 0x40 }, { 940, 3, 0x01 },
+	{ 283, 3, 0x18 }, { 199, 2, 0x01 }, { 1135, 6, 0x02 }, { 0, 0, 0 },
+	{ 279, 4, 0x28 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1741, 5, 0x08 },
+	{ 0, 0, 0 }, { 666, 2, 0xCC }, { 808, 4, 0x02 }, { 498, 6, 0x02 },
+	{ 2145, 3, 0x02 }, { 2158, 3, 0x80 }, { 2423, 3, 0x40 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 313, 3, 0x10 }, { 2485, 2, 0x10 }, { 1453, 4, 0x02 },
+	{ 645, 4, 0x04 }, { 0, 0, 0 }, { 1003, 4, 0x80 }, { 2089, 5, 0x04 },
+	{ 53, 5, 0x02 }, { 2487, 2, 0x20 }, { 847, 2, 0xB8 }, { 1349, 3, 0x08 },
+	{ 480, 3, 0x42 }, { 1171, 4, 0x04 }, { 373, 4, 0x02 }, { 910, 2, 0x01 },
+	{ 0, 0, 0 }, { 1907, 5, 0x02 }, { 1071, 3, 0x01 }, { 613, 5, 0x02 },
+	{ 2085, 4, 0x04 }, { 417, 5, 0x10 }, { 1792, 3, 0x20 }, { 0, 0, 0 },
+	{ 507, 3, 0x80 }, { 477, 3, 0x01 }, { 1223, 4, 0x40 }, { 1480, 6, 0x10 },
+	{ 0, 0, 0 }, { 1787, 5, 0x02 }, { 0, 0, 0 }, { 1612, 4, 0x28 },
+	{ 934, 6, 0x80 }, { 1220, 3, 0x80 }, { 0, 0, 0 }, { 1539, 4, 0x02 },
+	{ 1671, 4, 0x04 }, { 1397, 3, 0x80 }, { 1801, 3, 0x01 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 1460, 3, 0x10 }, { 0, 0, 0 },
+	{ 2507, 5, 0x02 }, { 298, 5, 0x01 }, { 260, 4, 0x04 }, { 0, 0, 0 },
+	{ 243, 2, 0x04 }, { 787, 5, 0x80 }, { 1954, 6, 0x20 }, { 0, 0, 0 },
+	{ 1157, 3, 0x08 }, { 2174, 3, 0x40 }, { 0, 0, 0 }, { 1561, 5, 0x40 },
+	{ 210, 3, 0x02 }, { 2257, 4, 0x40 }, { 2350, 3, 0x42 }, { 0, 0, 0 },
+	{ 2235, 3, 0x02 }, { 1295, 3, 0x08 }, { 249, 3, 0x04 }, { 1863, 6, 0x80 },
+	{ 0, 0, 0 }, { 471, 4, 0x40 }, { 179, 2, 0x80 }, { 0, 0, 0 },
+	{ 2003, 3, 0x01 }, { 237, 3, 0x01 }, { 2261, 3, 0x02 }, { 972, 3, 0x40 },
+	{ 0, 0, 0 }, { 2058, 4, 0x40 }, { 2028, 4, 0x01 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 292, 6, 0x10 }, { 1903, 4, 0x10 }, { 779, 4, 0x80 },
+	{ 0, 0, 0 }, { 1871, 5, 0x08 }, { 240, 3, 0x04 }, { 0, 0, 0 },
+	{ 875, 5, 0x10 }, { 0, 0, 0 }, { 776, 3, 0xA1 }, { 43, 5, 0x02 },
+	{ 10, 2, 0x04 }, { 0, 0, 0 }, { 1215, 3, 0x28 }, { 2418, 5, 0x01 },
+	{ 1364, 5, 0x04 }, { 0, 0, 0 }, { 234, 2, 0x01 }, { 2330, 4, 0x01 },
+	{ 735, 5, 0x08 }, { 0, 0, 0 }, { 2476, 3, 0x80 }, { 2217, 5, 0x20 },
+	{ 1352, 2, 0x01 }, { 2387, 5, 0x01 }, { 2099, 5, 0x10 }, { 1533, 1, 0x38 },
+	{ 1312, 5, 0x04 }, { 1545, 3, 0x01 }, { 1559, 2, 0x05 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1292, 3, 0x02 }, { 1601, 3, 0x01 }, { 1918, 3, 0x30 },
+	{ 8, 2, 0x10 }, { 795, 6, 0x08 }, { 943, 4, 0x01 }, { 1575, 2, 0x40 },
+	{ 1019, 5, 0x02 }, { 1155, 2, 0x1C }, { 1768, 5, 0x80 }, { 303, 4, 0x08 },
+	{ 0, 0, 0 }, { 1844, 4, 0x80 }, { 705, 4, 0x20 }, { 2466, 8, 0x02 },
+	{ 716, 6, 0x08 }, { 0, 0, 0 }, { 853, 3, 0x02 }, { 0, 0, 0 },
+	{ 1636, 7, 0x10 }, { 457, 6, 0x02 }, { 1074, 1, 0x04 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 1619, 4, 0x20 }, { 0, 0, 0 }, { 1999, 4, 0x01 }, { 1376, 4, 0x02 },
+	{ 0, 0, 0 }, { 1689, 6, 0x30 }, { 1534, 2, 0x02 }, { 0, 0, 0 },
+	{ 1270, 3, 0x40 }, { 2052, 2, 0x01 }, { 1503, 3, 0x02 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 618, 2, 0x80 },
+	{ 2114, 3, 0x40 }, { 2225, 3, 0x02 }, { 0, 0, 0 }, { 1024, 3, 0x02 },
+	{ 0, 0, 0 }, { 63, 4, 0x10 }, { 231, 3, 0x01 }, { 514, 3, 0x40 },
+	{ 2010, 4, 0x01 }, { 2062, 3, 0x04 }, { 0, 0, 0 }, { 1252, 3, 0x40 },
+	{ 0, 0, 0 }, { 445, 3, 0x06 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 1016, 3, 0x02 }, { 969, 3, 0x01 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 880, 4, 0x80 }, { 0, 0, 0 }, { 0, 0, 0 }, { 440, 5, 0x80 },
+	{ 1710, 6, 0x10 }, { 127, 5, 0x08 }, { 2492, 5, 0x04 }, { 0, 0, 0 },
+	{ 270, 2, 0x10 }, { 1658, 4, 0x08 }, { 399, 4, 0x20 }, { 2459, 3, 0x02 },
+	{ 245, 4, 0x04 }, { 1607, 2, 0x80 }, { 1086, 5, 0x02 }, { 1180, 3, 0x20 },
+	{ 370, 3, 0x40 }, { 1160, 2, 0x1C }, { 0, 0, 0 }, { 576, 1, 0x38 },
+	{ 801, 3, 0x02 }, { 1096, 5, 0x02 }, { 2414, 4, 0x01 }, { 2392, 8, 0x02 },
+	{ 0, 0, 0 }, { 907, 3, 0x08 }, { 0, 0, 0 }, { 640, 5, 0x08 },
+	{ 348, 4, 0x04 }, { 2428, 4, 0x40 }, { 483, 4, 0x02 }, { 1982, 2, 0x6C },
+	{ 890, 5, 0x08 }, { 0, 0, 0 }, { 0, 0, 0 }, { 2411, 3, 0x01 },
+	{ 1249, 3, 0x04 }, { 0, 0, 0 }, { 1345, 4, 0x01 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 396, 3, 0x18 }, { 1529, 4, 0x20 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 207, 3, 0x40 }, { 1815, 6, 0x01 }, { 1165, 3, 0x0C },
+	{ 903, 4, 0x01 }, { 352, 3, 0x80 }, { 0, 0, 0 }, { 84, 2, 0x03 },
+	{ 1795, 3, 0x28 }, { 71, 3, 0x42 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 598, 5, 0x02 }, { 687, 4, 0x08 }, { 1426, 3, 0x20 }, { 2409, 2, 0x08 },
+	{ 1835, 3, 0x02 }, { 591, 3, 0x02 }, { 510, 4, 0x80 }, { 149, 3, 0x20 },
+	{ 0, 0, 0 }, { 1255, 3, 0x20 }, { 2180, 4, 0x80 }, { 551, 4, 0x10 },
+	{ 1783, 4, 0x02 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1498, 3, 0x01 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 2339, 5, 0x01 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 814, 4, 0x40 }, { 1609, 3, 0x04 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1695, 3, 0x2C }, { 0, 0, 0 }, { 137, 3, 0x20 },
+	{ 519, 4, 0x42 }, { 0, 0, 0 }, { 594, 4, 0x02 }, { 1336, 5, 0x20 },
+	{ 1305, 4, 0x40 }, { 425, 3, 0x82 }, { 740, 2, 0x04 }, { 135, 2, 0x20 },
+	{ 185, 4, 0x04 }, { 0, 0, 0 }, { 1206, 3, 0x82 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1101, 5, 0x02 }, { 0, 0, 0 }, { 555, 2, 0x86 },
+	{ 682, 2, 0x0A }, { 1054, 2, 0x10 }, { 1569, 3, 0x04 }, { 0, 0, 0 },
+	{ 48, 5, 0x02 }, { 992, 3, 0x20 }, { 1857, 6, 0x80 }, { 1665, 6, 0x08 },
+	{ 0, 0, 0 }, { 116, 7, 0x02 }, { 0, 0, 0 }, { 227, 4, 0x80 },
+	{ 1410, 3, 0x10 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 2502, 5, 0x80 }, { 194, 5, 0x04 }, { 1075, 2, 0x60 }, { 0, 0, 0 },
+	{ 929, 5, 0x80 }, { 1369, 1, 0x04 }, { 1588, 4, 0x08 }, { 2117, 2, 0x22 },
+	{ 1594, 3, 0x01 }, { 0, 0, 0 }, { 1995, 4, 0x01 }, { 0, 0, 0 },
+	{ 1341, 4, 0x02 }, { 0, 0, 0 }, { 2202, 5, 0x80 }, { 2161, 2, 0x01 },
+	{ 0, 0, 0 }, { 422, 3, 0x82 }, { 2369, 4, 0x02 }, { 0, 0, 0 },
+	{ 773, 3, 0x20 }, { 0, 0, 0 }, { 1038, 2, 0x02 }, { 1324, 3, 0x80 },
+	{ 1372, 4, 0x40 }, { 664, 2, 0x20 }, { 0, 0, 0 }, { 1523, 6, 0x80 },
+	{ 2024, 4, 0x01 }, { 0, 0, 0 }, { 1317, 3, 0x04 }, { 0, 0, 0 },
+	{ 1242, 4, 0x04 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1301, 4, 0x80 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 1, 3, 0x40 }, { 0, 0, 0 },
+	{ 2439, 4, 0x40 }, { 1175, 5, 0x04 }, { 0, 0, 0 }, { 1370, 2, 0x60 },
+	{ 1848, 4, 0x02 }, { 216, 4, 0x02 }, { 1896, 7, 0x02 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1320, 4, 0x01 }, { 0, 0, 0 }, { 1040, 2, 0x53 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 2321, 5, 0x40 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 1746, 4, 0x08 }, { 1893, 3, 0x0C },
+	{ 569, 3, 0x40 }, { 2353, 6, 0x02 }, { 2489, 3, 0x08 }, { 1513, 4, 0x80 },
+	{ 155, 4, 0x20 }, { 0, 0, 0 }, { 336, 5, 0x02 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1429, 2, 0x8C }, { 2153, 5, 0x02 }, { 1604, 3, 0x04 },
+	{ 1147, 7, 0x02 }, { 0, 0, 0 }, { 0, 0, 0 }, { 403, 4, 0x20 },
+	{ 1967, 8, 0x08 }, { 475, 2, 0x10 }, { 1572, 3, 0x40 }, { 2497, 5, 0x04 },
+	{ 0, 0, 0 }, { 2082, 3, 0x10 }, { 620, 2, 0x08 }, { 109, 7, 0x02 },
+	{ 0, 0, 0 }, { 132, 3, 0x01 }, { 694, 3, 0x08 }, { 0, 0, 0 },
+	{ 1924, 3, 0x10 }, { 957, 3, 0x01 }, { 319, 4, 0x40 }, { 0, 0, 0 },
+	{ 1989, 3, 0x20 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1720, 6, 0x10 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 1047, 3, 0x02 }, { 577, 2, 0x10 }, { 921, 5, 0x40 }, { 2165, 4, 0x80 },
+	{ 255, 5, 0x04 }, { 0, 0, 0 }, { 2104, 5, 0x10 }, { 673, 2, 0x42 },
+	{ 2043, 5, 0x08 }, { 0, 0, 0 }, { 2250, 7, 0x02 }, { 1517, 6, 0x80 },
+	{ 766, 4, 0x02 }, { 0, 0, 0 }, { 1263, 4, 0x02 }, { 0, 0, 0 },
+	{ 1380, 4, 0x08 }, { 147, 2, 0x81 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 2193, 2, 0x90 }, { 67, 4, 0x80 }, { 1198, 4, 0x40 }, { 2198, 4, 0x02 },
+	{ 752, 3, 0x80 }, { 1056, 2, 0x41 }, { 2456, 3, 0x02 }, { 0, 0, 0 },
+	{ 1111, 2, 0x80 }, { 0, 0, 0 }, { 1650, 4, 0x10 }, { 0, 0, 0 },
+	{ 865, 3, 0x41 }, { 1058, 4, 0x20 }, { 1218, 2, 0x6D }, { 1189, 3, 0x08 },
+	{ 1277, 3, 0x80 }, { 2310, 5, 0x02 }, { 2135, 3, 0x04 }, { 1654, 4, 0x04 },
+	{ 2303, 3, 0x02 }, { 1154, 1, 0x04 }, { 1755, 1, 0x04 }, { 2019, 5, 0x01 },
+	{ 0, 0, 0 }, { 2299, 4, 0x02 }, { 1405, 5, 0x10 }, { 0, 0, 0 },
+	{ 1431, 5, 0x02 }, { 0, 0, 0 }, { 1416, 5, 0x10 }, { 1726, 6, 0x10 },
+	{ 1732, 6, 0x10 }, { 1804, 3, 0x20 }, { 999, 1, 0x90 }, { 0, 0, 0 },
+	{ 407, 5, 0x10 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1938, 3, 0x08 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 181, 4, 0x04 }, { 579, 3, 0x40 },
+	{ 0, 0, 0 }, { 837, 3, 0x10 }, { 989, 3, 0x80 }, { 1168, 3, 0x01 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 2238, 3, 0x04 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 2169, 2, 0x40 }, { 0, 0, 0 },
+	{ 2445, 6, 0x40 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 654, 5, 0x04 }, { 0, 0, 0 }, { 1548, 4, 0x02 }, { 2278, 2, 0x41 },
+	{ 0, 0, 0 }, { 2344, 3, 0x01 }, { 2177, 3, 0x80 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 2454, 2, 0x02 }, { 564, 5, 0x02 }, { 2184, 5, 0x80 }, { 0, 0, 0 },
+	{ 2432, 4, 0x40 }, { 2222, 3, 0x10 }, { 1680, 4, 0x20 }, { 1852, 5, 0x80 },
+	{ 0, 0, 0 }, { 742, 3, 0x01 }, { 544, 4, 0x02 }, { 2071, 3, 0x40 },
+	{ 1273, 4, 0x40 }, { 1469, 3, 0x2C }, { 2462, 4, 0x02 }, { 1000, 3, 0x02 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1354, 6, 0x80 }, { 18, 7, 0x08 }, { 1331, 5, 0x08 },
+	{ 0, 1, 0x3D }, { 856, 4, 0x02 }, { 0, 0, 0 }, { 1091, 5, 0x02 },
+	{ 0, 0, 0 }, { 1975, 7, 0x20 }, { 487, 5, 0x02 }, { 176, 3, 0x04 },
+	{ 804, 4, 0x80 }, { 1400, 3, 0x20 }, { 659, 5, 0x08 }, { 1327, 4, 0x01 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 492, 6, 0x02 }, { 1116, 3, 0xC0 },
+	{ 0, 0, 0 }, { 1035, 3, 0x04 }, { 895, 3, 0x02 }, { 1584, 4, 0x08 },
+	{ 1684, 5, 0x10 }, { 2110, 4, 0x02 }, { 0, 0, 0 }, { 586, 5, 0x80 },
+	{ 0, 0, 0 }, { 267, 3, 0x10 }, { 1141, 6, 0x40 }, { 1876, 6, 0x02 },
+	{ 0, 0, 0 }, { 437, 3, 0x42 }, { 2326, 4, 0x01 }, { 0, 0, 0 },
+	{ 161, 4, 0x02 }, { 0, 0, 0 }, { 0, 0, 0 }, { 975, 3, 0x80 },
+	{ 0, 0, 0 }, { 1643, 4, 0x08 }, { 0, 0, 0 }, { 189, 5, 0x04 },
+	{ 2474, 2, 0x04 }, { 727, 4, 0x28 }, { 818, 5, 0x02 }, { 1831, 4, 0x02 },
+	{ 220, 4, 0x80 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 448, 5, 0x08 }, { 0, 0, 0 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 678, 4, 0x08 }, { 1952, 2, 0x04 }, { 0, 0, 0 },
+	{ 1082, 4, 0x02 }, { 1945, 3, 0x80 }, { 2482, 3, 0x80 }, { 0, 0, 0 },
+	{ 557, 7, 0x08 }, { 548, 3, 0x20 }, { 504, 3, 0x80 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 0, 0, 0 }, { 1738, 3, 0x04 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 1413, 3, 0x10 }, { 1592, 2, 0x24 }, { 0, 0, 0 },
+	{ 1927, 5, 0x10 }, { 823, 7, 0x40 }, { 1231, 5, 0x02 }, { 1886, 3, 0x80 },
+	{ 2231, 4, 0x40 }, { 0, 0, 0 }, { 915, 6, 0x40 }, { 0, 0, 0 },
+	{ 0, 0, 0 }, { 2138, 3, 0x18 }, { 1773, 3, 0x01 }, { 2148, 5, 0x02 },
+};
+
+static const uint16_t SPStopWordDisplacements[kSPStopWordBucketCount] = {
+	3, 1, 3, 14, 2, 0, 3, 5, 0, 0, 6, 6, 12, 0, 5, 0,
+	25, 13, 5, 0, 1, 7, 4, 0, 0, 0, 3, 3, 4, 5, 5, 7,
+	1, 10, 4, 0, 11, 2, 13, 5, 3, 3, 0, 10, 0, 1, 6, 4,
+	7, 4, 7, 17, 0, 0, 3, 18, 0, 0, 7, 23, 6, 5, 4, 12,
+	0, 2, 2, 8, 13, 9, 0, 0, 25, 17, 14, 0, 6, 0, 0, 1,
+	9, 6, 13, 23, 42, 3, 2, 3, 6, 7, 7, 1, 6, 7, 13, 8,
+	1, 0, 8, 13, 24, 0, 2, 2, 24, 9, 2, 0, 2, 6, 1, 2,
+	0, 21, 1, 1, 0, 1, 0, 12, 0, 16, 7, 12, 6, 4, 31, 0,
+	3, 5, 9, 12, 4, 6, 1, 3, 0, 1, 0, 1, 7, 7, 0, 22,
+	27, 14, 0, 2, 7, 4, 8, 57, 17, 7, 0, 2, 1, 8, 5, 5,
+	4, 5, 0, 23, 1, 11, 0, 15, 17,
+};
+
+#pragma mark -
+
+static inline uint32_t SPStopWordMix(uint32_t hash) {
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6B;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+uint32_t SPStopWordGetLanguages(const char *term, size_t length) {
+
+	const SPStopWordSlot *slot;
+	uint32_t hash, displacement;
+
+	if ( length == 0 || length > kSPStopWordMaximumLength ) return 0;
+
+	hash = SPStringHash(term, length);
+	displacement = SPStopWordDisplacements[hash % kSPStopWordBucketCount];
+	slot = &SPStopWordSlots[SPStopWordMix(hash ^ ( displacement * 0x9E3779B9 )) & ( kSPStopWordSlotCount - 1 )];
+
+	if ( slot->length != length || memcmp(SPStopWordStrings + slot->offset, term, length) != 0 )
+		return 0;
+
+	return slot->languages;
+}
+
+uint32_t SPStopWordsGetLanguage(const char *code) {
+
+	static const char *codes[] = { "en", "de", "fr", "es", "it", "pt", "nl", "sv" };
+	size_t i;
+
+	for ( i = 0; i < sizeof(codes) / sizeof(codes[0]); i++ ) {
+		if ( strcmp(codes[i], code) == 0 ) return 1U << i;
+	}
+
+	return 0;
+}
+
+void SPStopWordsEnumerate(uint32_t languages, SPStopWordFunction function, void *context) {
+
+	size_t i;
+
+	for ( i = 0; i < kSPStopWordSlotCount; i++ ) {
+		const SPStopWordSlot *slot = &SPStopWordSlots[i];
+		if ( slot->length != 0 && ( slot->languages & languages ) != 0 )
+			function(SPStopWordStrings + slot->offset, slot->length, context);
+	}
+}
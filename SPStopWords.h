@@ -0,0 +1,81 @@
+//
+//  SPStopWords.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPSTOPWORDS_H
+#define SPSTOPWORDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Built in stop words for the languages the native index can exclude as it indexes. The
+// words of every language share one perfect hash table generated ahead of time by
+// Tools/SPStopWordsGenerator.py, so checking a term against any set of languages costs
+// one hash, one probe and at most one comparison. Words are lowercase UTF-8 and listed
+// both with and without their diacritics, since the native backend folds diacritics
+// before it indexes.
+
+enum {
+	kSPLanguageEnglish		= 1 << 0,
+	kSPLanguageGerman		= 1 << 1,
+	kSPLanguageFrench		= 1 << 2,
+	kSPLanguageSpanish		= 1 << 3,
+	kSPLanguageItalian		= 1 << 4,
+	kSPLanguagePortuguese	= 1 << 5,
+	kSPLanguageDutch		= 1 << 6,
+	kSPLanguageSwedish		= 1 << 7,
+	kSPLanguageAll			= 0xFF
+};
+
+uint32_t SPStopWordGetLanguages(const char *term, size_t length);
+
+	// Returns the languages in which term is a stop word, 0 if it is not one in any.
+
+uint32_t SPStopWordsGetLanguage(const char *code);
+
+	// Maps a two character language code such as "en" or "de" to its kSPLanguage value.
+	// Returns 0 for a language without built in stop words.
+
+typedef void (*SPStopWordFunction)(const char *word, size_t length, void *context);
+
+void SPStopWordsEnumerate(uint32_t languages, SPStopWordFunction function, void *context);
+
+	// Calls function with each stop word of any of the languages, in no particular order.
+
+#endif
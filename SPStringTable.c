@@ -0,0 +1,348 @@
+//
+//  SPStringTable.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPStringTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Slots hold a copy of the hash so that probing rarely touches the arena.
+// value is kSPStringTableEmpty for an unused slot and kSPStringTableDeleted
+// for a tombstone left behind by SPStringTableRemoveValue. A tombstone keeps
+// its string, so a string that is removed and added again is revived in
+// place rather than copied into the arena a second time.
+
+#define kSPStringTableEmpty		(-1)
+#define kSPStringTableDeleted	(-2)
+
+typedef struct {
+	uint32_t hash;
+	uint32_t offset;
+	uint32_t length;
+	int32_t value;
+} SPStringTableSlot;
+
+struct SPStringTable {
+	SPStringTableSlot *slots;
+	size_t capacity;		// always a power of two
+	size_t count;			// live mappings
+	size_t used;			// live mappings plus tombstones
+	
+	char *arena;
+	size_t arenaLength;
+	size_t arenaCapacity;
+	
+	bool isImage;			// slots and arena belong to someone else until the first change
+};
+
+uint32_t SPStringHash(const char *string, size_t length) {
+	uint32_t hash = 2166136261u;
+	size_t i;
+	
+	for ( i = 0; i < length; i++ ) {
+		hash ^= (uint8_t)string[i];
+		hash *= 16777619u;
+	}
+	
+	return hash;
+}
+
+static SPStringTableSlot * SPStringTableAllocateSlots(size_t capacity) {
+	SPStringTableSlot *slots = malloc(capacity * sizeof(SPStringTableSlot));
+	size_t i;
+	
+	if ( slots == NULL ) return NULL;
+	for ( i = 0; i < capacity; i++ ) slots[i].value = kSPStringTableEmpty;
+	
+	return slots;
+}
+
+SPStringTable * SPStringTableCreate(size_t capacityHint) {
+	
+	SPStringTable *table = calloc(1, sizeof(SPStringTable));
+	if ( table == NULL ) return NULL;
+	
+	table->capacity = 64;
+	while ( table->capacity < capacityHint * 2 ) table->capacity <<= 1;
+	
+	table->slots = SPStringTableAllocateSlots(table->capacity);
+	table->arenaCapacity = 1024;
+	table->arena = malloc(table->arenaCapacity);
+	
+	if ( table->slots == NULL || table->arena == NULL ) {
+		SPStringTableRelease(table);
+		return NULL;
+	}
+	
+	return table;
+}
+
+void SPStringTableRelease(SPStringTable *table) {
+	if ( table == NULL ) return;
+	
+	if ( !table->isImage ) {
+		free(table->slots);
+		free(table->arena);
+	}
+	
+	free(table);
+}
+
+void SPStringTableGetImage(const SPStringTable *table, SPStringTableImage *outImage) {
+	outImage->slots = table->slots;
+	outImage->slotsLength = table->capacity * sizeof(SPStringTableSlot);
+	outImage->arena = table->arena;
+	outImage->arenaLength = table->arenaLength;
+	outImage->count = table->count;
+	outImage->used = table->used;
+}
+
+SPStringTable * SPStringTableCreateWithImage(const SPStringTableImage *image) {
+	
+	// Probing ends at an empty slot, so a full table would never finish a failed lookup
+	
+	size_t capacity = image->slotsLength / sizeof(SPStringTableSlot);
+	SPStringTable *table;
+	
+	if ( capacity == 0 || ( capacity & ( capacity - 1 ) ) != 0 || image->slotsLength % sizeof(SPStringTableSlot) != 0
+			|| image->used >= capacity || image->count > image->used || image->arenaLength > UINT32_MAX )
+		return NULL;
+	
+	table = calloc(1, sizeof(SPStringTable));
+	if ( table == NULL ) return NULL;
+	
+	table->slots = (SPStringTableSlot*)image->slots;
+	table->capacity = capacity;
+	table->count = (size_t)image->count;
+	table->used = (size_t)image->used;
+	table->arena = (char*)image->arena;
+	table->arenaLength = image->arenaLength;
+	table->arenaCapacity = image->arenaLength;
+	table->isImage = true;
+	
+	return table;
+}
+
+static bool SPStringTableCopyImage(SPStringTable *table) {
+	
+	size_t arenaCapacity = 1024;
+	SPStringTableSlot *slots;
+	char *arena;
+	
+	while ( arenaCapacity < table->arenaLength ) arenaCapacity <<= 1;
+	
+	slots = malloc(table->capacity * sizeof(SPStringTableSlot));
+	arena = malloc(arenaCapacity);
+	
+	if ( slots == NULL || arena == NULL ) {
+		free(slots);
+		free(arena);
+		return false;
+	}
+	
+	memcpy(slots, table->slots, table->capacity * sizeof(SPStringTableSlot));
+	memcpy(arena, table->arena, table->arenaLength);
+	
+	table->slots = slots;
+	table->arena = arena;
+	table->arenaCapacity = arenaCapacity;
+	table->isImage = false;
+	
+	return true;
+}
+
+static SPStringTableSlot * SPStringTableFindSlot(const SPStringTable *table, uint32_t hash, 
+		const char *string, size_t length) {
+	
+	size_t mask = table->capacity - 1;
+	size_t index = hash & mask;
+	
+	while ( table->slots[index].value != kSPStringTableEmpty ) {
+		SPStringTableSlot *slot = &table->slots[index];
+		
+		if ( slot->value != kSPStringTableDeleted && slot->hash == hash && slot->length == length
+				&& memcmp(table->arena + slot->offset, string, length) == 0 )
+			return slot;
+		
+		index = ( index + 1 ) & mask;
+	}
+	
+	return NULL;
+}
+
+static SPStringTableSlot * SPStringTableFindDeletedSlot(const SPStringTable *table, uint32_t hash, 
+		const char *string, size_t length) {
+	
+	size_t mask = table->capacity - 1;
+	size_t index = hash & mask;
+	
+	while ( table->slots[index].value != kSPStringTableEmpty ) {
+		SPStringTableSlot *slot = &table->slots[index];
+		
+		if ( slot->value == kSPStringTableDeleted && slot->hash == hash && slot->length == length
+				&& memcmp(table->arena + slot->offset, string, length) == 0 )
+			return slot;
+		
+		index = ( index + 1 ) & mask;
+	}
+	
+	return NULL;
+}
+
+static bool SPStringTableRehash(SPStringTable *table, size_t capacity) {
+	
+	SPStringTableSlot *slots = SPStringTableAllocateSlots(capacity);
+	size_t mask = capacity - 1;
+	size_t i;
+	
+	if ( slots == NULL ) return false;
+	
+	for ( i = 0; i < table->capacity; i++ ) {
+		SPStringTableSlot *slot = &table->slots[i];
+		if ( slot->value < 0 ) continue;
+		
+		size_t index = slot->hash & mask;
+		while ( slots[index].value != kSPStringTableEmpty ) index = ( index + 1 ) & mask;
+		slots[index] = *slot;
+	}
+	
+	free(table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+	table->used = table->count;
+	
+	return true;
+}
+
+int32_t SPStringTableGetValue(const SPStringTable *table, const char *string, size_t length) {
+	SPStringTableSlot *slot = SPStringTableFindSlot(table, SPStringHash(string, length), string, length);
+	return ( slot == NULL ? kSPStringTableNotFound : slot->value );
+}
+
+bool SPStringTableSetValue(SPStringTable *table, const char *string, size_t length, int32_t value, uint32_t *outOffset) {
+	
+	uint32_t hash = SPStringHash(string, length);
+	SPStringTableSlot *slot;
+	
+	if ( table->isImage && !SPStringTableCopyImage(table) ) return false;
+	
+	slot = SPStringTableFindSlot(table, hash, string, length);
+	if ( slot != NULL ) {
+		slot->value = value;
+		if ( outOffset != NULL ) *outOffset = slot->offset;
+		return true;
+	}
+	
+	// The tombstone is already counted in used and its string is still in the arena
+	
+	slot = SPStringTableFindDeletedSlot(table, hash, string, length);
+	if ( slot != NULL ) {
+		slot->value = value;
+		table->count++;
+		if ( outOffset != NULL ) *outOffset = slot->offset;
+		return true;
+	}
+	
+	// keep the load factor, tombstones included, under three quarters
+	
+	if ( ( table->used + 1 ) * 4 > table->capacity * 3 ) {
+		size_t capacity = table->capacity;
+		if ( ( table->count + 1 ) * 2 > capacity ) capacity <<= 1;
+		if ( !SPStringTableRehash(table, capacity) ) return false;
+	}
+	
+	if ( table->arenaLength + length > table->arenaCapacity ) {
+		size_t arenaCapacity = table->arenaCapacity;
+		while ( table->arenaLength + length > arenaCapacity ) arenaCapacity <<= 1;
+		
+		char *arena = realloc(table->arena, arenaCapacity);
+		if ( arena == NULL ) return false;
+		
+		table->arena = arena;
+		table->arenaCapacity = arenaCapacity;
+	}
+	
+	size_t mask = table->capacity - 1;
+	size_t index = hash & mask;
+	
+	while ( table->slots[index].value >= 0 ) index = ( index + 1 ) & mask;
+	if ( table->slots[index].value == kSPStringTableEmpty ) table->used++;
+	
+	slot = &table->slots[index];
+	slot->hash = hash;
+	slot->offset = (uint32_t)table->arenaLength;
+	slot->length = (uint32_t)length;
+	slot->value = value;
+	
+	memcpy(table->arena + table->arenaLength, string, length);
+	table->arenaLength += length;
+	table->count++;
+	
+	if ( outOffset != NULL ) *outOffset = slot->offset;
+	return true;
+}
+
+bool SPStringTableRemoveValue(SPStringTable *table, const char *string, size_t length) {
+	SPStringTableSlot *slot = SPStringTableFindSlot(table, SPStringHash(string, length), string, length);
+	if ( slot == NULL ) return false;
+	
+	if ( table->isImage ) {
+		size_t index = (size_t)( slot - table->slots );
+		if ( !SPStringTableCopyImage(table) ) return false;
+		slot = &table->slots[index];
+	}
+	
+	slot->value = kSPStringTableDeleted;
+	table->count--;
+	
+	return true;
+}
+
+const char * SPStringTableGetString(const SPStringTable *table, uint32_t offset) {
+	return table->arena + offset;
+}
+
+size_t SPStringTableGetCount(const SPStringTable *table) {
+	return table->count;
+}
+
+size_t SPStringTableGetMemorySize(const SPStringTable *table) {
+	if ( table->isImage ) return sizeof(SPStringTable);
+	return sizeof(SPStringTable) + table->capacity * sizeof(SPStringTableSlot) + table->arenaCapacity;
+}
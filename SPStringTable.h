@@ -0,0 +1,114 @@
+//
+//  SPStringTable.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPSTRINGTABLE_H
+#define SPSTRINGTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// SPStringTable interns byte strings in a single growable arena and maps each of them
+// to a 32 bit value using open addressing. The native index uses one table for the
+// term dictionary and another for document URIs. Strings are never moved out of the
+// arena once they are added, so an offset returned by the table remains valid until
+// the table is released, although the arena itself may be reallocated. Always resolve
+// offsets through SPStringTableGetString rather than holding on to the pointer.
+
+// The table is not thread safe. The native index guards it with its own lock.
+
+typedef struct SPStringTable SPStringTable;
+
+#define kSPStringTableNotFound (-1)
+
+SPStringTable * SPStringTableCreate(size_t capacityHint);
+void SPStringTableRelease(SPStringTable *table);
+
+int32_t SPStringTableGetValue(const SPStringTable *table, const char *string, size_t length);
+
+	// Returns the value associated with string or kSPStringTableNotFound.
+
+bool SPStringTableSetValue(SPStringTable *table, const char *string, size_t length, int32_t value, uint32_t *outOffset);
+
+	// Associates value with string, interning the string if it is not already in the table.
+	// value must be zero or positive. outOffset may be NULL and otherwise receives the
+	// location of the interned string in the arena. Returns false if memory could not be
+	// allocated.
+
+bool SPStringTableRemoveValue(SPStringTable *table, const char *string, size_t length);
+
+	// Removes the mapping for string. The string itself remains in the arena until the
+	// table is released, so previously returned offsets remain valid. Adding the string
+	// again reuses it, along with its offset, so a URI that is removed and re-added any
+	// number of times is stored once. Strings removed and not added again before the
+	// table next rehashes are left behind in the arena.
+
+const char * SPStringTableGetString(const SPStringTable *table, uint32_t offset);
+
+	// Resolves an arena offset. The returned string is not NUL terminated; callers keep
+	// track of the length they interned.
+
+size_t SPStringTableGetCount(const SPStringTable *table);
+size_t SPStringTableGetMemorySize(const SPStringTable *table);
+
+// A table can be saved as an image of its slots and arena, exactly as they are laid out
+// in memory, along with its counts. A table created with an image reads the bytes where
+// they are, typically in a mapped file, and copies them the first time it is changed.
+
+typedef struct {
+	const void *slots;
+	size_t slotsLength;				// in bytes
+	const char *arena;
+	size_t arenaLength;
+	uint64_t count;
+	uint64_t used;
+} SPStringTableImage;
+
+void SPStringTableGetImage(const SPStringTable *table, SPStringTableImage *outImage);
+SPStringTable * SPStringTableCreateWithImage(const SPStringTableImage *image);
+
+	// The image's bytes must outlive the table or its first change, whichever comes first.
+	// Returns NULL if the counts and lengths are inconsistent. The slots themselves are
+	// trusted, so only use images whose bytes have been checked.
+
+uint32_t SPStringHash(const char *string, size_t length);
+
+	// FNV-1a, exposed so that other modules hash strings the same way.
+
+#endif
@@ -0,0 +1,215 @@
+//
+//  SPTermDirectory.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPTermDirectory.h"
+#include "SPStringTable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define kSPTermDirectoryPageSize	65536			// entries per page
+#define kSPTermDirectoryPageCount	4096
+#define kSPTermDirectoryBlockSize	( 1 << 20 )		// bytes per string block
+#define kSPTermDirectoryBlockCount	4096
+
+typedef struct {
+	const char *string;
+	uint32_t length;
+} SPTermEntry;
+
+struct SPTermDirectory {
+	SPStringTable *table;					// term -> ID, used by the writer to intern
+	SPTermID count;
+
+	SPTermEntry *pages[kSPTermDirectoryPageCount];
+	char *blocks[kSPTermDirectoryBlockCount];
+	uint32_t blockCount;
+	uint32_t blockUsed;						// bytes used in the last block
+
+	const uint32_t *imageOffsets;			// terms below imageCount, when created with an image
+	const char *imageStrings;
+	SPTermID imageCount;
+};
+
+SPTermDirectory * SPTermDirectoryCreate(void) {
+
+	SPTermDirectory *directory = calloc(1, sizeof(SPTermDirectory));
+	if ( directory == NULL ) return NULL;
+
+	directory->table = SPStringTableCreate(4096);
+	if ( directory->table == NULL ) {
+		free(directory);
+		return NULL;
+	}
+
+	return directory;
+}
+
+void SPTermDirectoryRelease(SPTermDirectory *directory) {
+
+	uint32_t i;
+
+	if ( directory == NULL ) return;
+
+	for ( i = 0; i < kSPTermDirectoryPageCount; i++ ) free(directory->pages[i]);
+	for ( i = 0; i < directory->blockCount; i++ ) free(directory->blocks[i]);
+
+	SPStringTableRelease(directory->table);
+	free(directory);
+}
+
+SPTermDirectory * SPTermDirectoryCreateWithImage(const SPStringTableImage *table, const uint32_t *offsets,
+		const char *strings, size_t stringsLength, SPTermID count) {
+
+	SPTermDirectory *directory;
+
+	if ( count < 0 || offsets[0] != 0 || offsets[count] > stringsLength || (uint64_t)count != table->count )
+		return NULL;
+
+	directory = calloc(1, sizeof(SPTermDirectory));
+	if ( directory == NULL ) return NULL;
+
+	directory->table = SPStringTableCreateWithImage(table);
+	if ( directory->table == NULL ) {
+		free(directory);
+		return NULL;
+	}
+
+	directory->imageOffsets = offsets;
+	directory->imageStrings = strings;
+	directory->imageCount = count;
+	directory->count = count;
+
+	return directory;
+}
+
+void SPTermDirectoryGetImage(SPTermDirectory *directory, SPStringTableImage *outTable) {
+	SPStringTableGetImage(directory->table, outTable);
+}
+
+static const char * SPTermDirectoryCopyString(SPTermDirectory *directory, const char *term, size_t length) {
+
+	// Terms are at most kSPIndexMaximumTermLength bytes, so a block always fits several
+
+	if ( directory->blockCount == 0 || directory->blockUsed + length > kSPTermDirectoryBlockSize ) {
+		if ( directory->blockCount == kSPTermDirectoryBlockCount ) return NULL;
+
+		char *block = malloc(kSPTermDirectoryBlockSize);
+		if ( block == NULL ) return NULL;
+
+		directory->blocks[directory->blockCount++] = block;
+		directory->blockUsed = 0;
+	}
+
+	char *string = directory->blocks[directory->blockCount - 1] + directory->blockUsed;
+	memcpy(string, term, length);
+	directory->blockUsed += (uint32_t)length;
+
+	return string;
+}
+
+SPTermID SPTermDirectoryIntern(SPTermDirectory *directory, const char *term, size_t length) {
+
+	SPTermID existing = SPStringTableGetValue(directory->table, term, length);
+	if ( existing != kSPStringTableNotFound ) return existing;
+
+	SPTermID id = directory->count;
+	uint32_t page = (uint32_t)id / kSPTermDirectoryPageSize;
+
+	if ( page >= kSPTermDirectoryPageCount ) return kSPIndexNotFound;
+
+	if ( directory->pages[page] == NULL ) {
+		directory->pages[page] = malloc(kSPTermDirectoryPageSize * sizeof(SPTermEntry));
+		if ( directory->pages[page] == NULL ) return kSPIndexNotFound;
+	}
+
+	const char *string = SPTermDirectoryCopyString(directory, term, length);
+	if ( string == NULL || !SPStringTableSetValue(directory->table, term, length, id, NULL) )
+		return kSPIndexNotFound;
+
+	SPTermEntry *entry = &directory->pages[page][(uint32_t)id % kSPTermDirectoryPageSize];
+	entry->string = string;
+	entry->length = (uint32_t)length;
+
+	// Make the entry visible before the count that covers it
+
+	__sync_synchronize();
+	directory->count = id + 1;
+
+	return id;
+}
+
+SPTermID SPTermDirectoryLookup(SPTermDirectory *directory, const char *term, size_t length) {
+	SPTermID id = SPStringTableGetValue(directory->table, term, length);
+	return ( id == kSPStringTableNotFound ? kSPIndexNotFound : id );
+}
+
+SPTermID SPTermDirectoryGetCount(SPTermDirectory *directory) {
+	return directory->count;
+}
+
+const char * SPTermDirectoryGetTerm(const SPTermDirectory *directory, SPTermID term, size_t *outLength) {
+
+	if ( term < 0 ) return NULL;
+
+	if ( term < directory->imageCount ) {
+		if ( outLength != NULL ) *outLength = directory->imageOffsets[term + 1] - directory->imageOffsets[term];
+		return directory->imageStrings + directory->imageOffsets[term];
+	}
+
+	const SPTermEntry *page = directory->pages[(uint32_t)term / kSPTermDirectoryPageSize];
+	if ( page == NULL ) return NULL;
+
+	const SPTermEntry *entry = &page[(uint32_t)term % kSPTermDirectoryPageSize];
+	if ( outLength != NULL ) *outLength = entry->length;
+
+	return entry->string;
+}
+
+size_t SPTermDirectoryGetMemorySize(SPTermDirectory *directory) {
+
+	size_t size = sizeof(SPTermDirectory) + SPStringTableGetMemorySize(directory->table);
+	uint32_t i;
+
+	for ( i = 0; i < kSPTermDirectoryPageCount; i++ ) {
+		if ( directory->pages[i] != NULL ) size += kSPTermDirectoryPageSize * sizeof(SPTermEntry);
+	}
+
+	return size + (size_t)directory->blockCount * kSPTermDirectoryBlockSize;
+}
@@ -0,0 +1,78 @@
+//
+//  SPTermDirectory.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPTERMDIRECTORY_H
+#define SPTERMDIRECTORY_H
+
+#include "SPIndex.h"
+#include "SPStringTable.h"
+
+// The term directory assigns term IDs and maps them back to strings. IDs are handed out
+// by the writer, and an entry never moves once it has been written, so a reader may look
+// up any ID below a count taken from a snapshot without holding a lock. Strings live in
+// fixed size blocks rather than a growing arena for the same reason.
+
+typedef struct SPTermDirectory SPTermDirectory;
+
+SPTermDirectory * SPTermDirectoryCreate(void);
+void SPTermDirectoryRelease(SPTermDirectory *directory);
+
+SPTermDirectory * SPTermDirectoryCreateWithImage(const SPStringTableImage *table, const uint32_t *offsets,
+		const char *strings, size_t stringsLength, SPTermID count);
+void SPTermDirectoryGetImage(SPTermDirectory *directory, SPStringTableImage *outTable);
+
+	// A saved directory is its table image and the strings of its terms in ID order, term i
+	// running from offsets[i] to offsets[i+1]. The bytes are read in place and must outlive
+	// the directory. New terms are added as usual. Writer only.
+
+SPTermID SPTermDirectoryIntern(SPTermDirectory *directory, const char *term, size_t length);
+SPTermID SPTermDirectoryLookup(SPTermDirectory *directory, const char *term, size_t length);
+SPTermID SPTermDirectoryGetCount(SPTermDirectory *directory);
+
+	// Writer only. Intern returns the existing ID of a known term or assigns the next one,
+	// and returns kSPIndexNotFound when memory runs out or the directory is full.
+
+const char * SPTermDirectoryGetTerm(const SPTermDirectory *directory, SPTermID term, size_t *outLength);
+
+	// Safe from any thread for IDs the caller learned of through a published snapshot.
+	// The string is not NUL terminated.
+
+size_t SPTermDirectoryGetMemorySize(SPTermDirectory *directory);
+
+#endif
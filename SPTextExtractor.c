@@ -0,0 +1,621 @@
+//
+//  SPTextExtractor.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPTextExtractor.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Every extractor writes into a growable buffer. A failed allocation is remembered and
+// later appends do nothing, so the extractors only check for it once at the end.
+
+typedef struct {
+	char *bytes;
+	size_t length;
+	size_t capacity;
+	bool failed;
+} SPTextBuffer;
+
+static bool SPTextBufferInit(SPTextBuffer *buffer, size_t capacityHint) {
+	buffer->capacity = ( capacityHint < 64 ? 64 : capacityHint );
+	buffer->bytes = malloc(buffer->capacity);
+	buffer->length = 0;
+	buffer->failed = ( buffer->bytes == NULL );
+	return !buffer->failed;
+}
+
+static bool SPTextBufferReserve(SPTextBuffer *buffer, size_t length) {
+
+	size_t capacity = buffer->capacity;
+	char *bytes;
+
+	if ( buffer->failed ) return false;
+	if ( buffer->length + length < buffer->capacity ) return true;
+
+	while ( capacity <= buffer->length + length ) capacity <<= 1;
+
+	bytes = realloc(buffer->bytes, capacity);
+	if ( bytes == NULL ) {
+		buffer->failed = true;
+		return false;
+	}
+
+	buffer->bytes = bytes;
+	buffer->capacity = capacity;
+	return true;
+}
+
+static void SPTextBufferAppendByte(SPTextBuffer *buffer, char c) {
+	if ( SPTextBufferReserve(buffer, 1) ) buffer->bytes[buffer->length++] = c;
+}
+
+static void SPTextBufferAppendSpace(SPTextBuffer *buffer) {
+
+	// Runs of separators collapse into one, which keeps stripped markup from leaving
+	// long stretches of spaces behind
+
+	if ( buffer->length > 0 && ( buffer->bytes[buffer->length-1] == ' ' || buffer->bytes[buffer->length-1] == '\n' ) )
+		return;
+	SPTextBufferAppendByte(buffer, ' ');
+}
+
+static void SPTextBufferAppendCodePoint(SPTextBuffer *buffer, uint32_t c) {
+
+	if ( c < 0x20 || c == 0x7F ) {
+		SPTextBufferAppendByte(buffer, ( c == '\n' ? '\n' : ' ' ));
+		return;
+	}
+	if ( c > 0x10FFFF || ( c >= 0xD800 && c <= 0xDFFF ) )
+		c = 0xFFFD;
+
+	if ( !SPTextBufferReserve(buffer, 4) ) return;
+
+	if ( c < 0x80 ) {
+		buffer->bytes[buffer->length++] = (char)c;
+	}
+	else if ( c < 0x800 ) {
+		buffer->bytes[buffer->length++] = (char)( 0xC0 | ( c >> 6 ) );
+		buffer->bytes[buffer->length++] = (char)( 0x80 | ( c & 0x3F ) );
+	}
+	else if ( c < 0x10000 ) {
+		buffer->bytes[buffer->length++] = (char)( 0xE0 | ( c >> 12 ) );
+		buffer->bytes[buffer->length++] = (char)( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+		buffer->bytes[buffer->length++] = (char)( 0x80 | ( c & 0x3F ) );
+	}
+	else {
+		buffer->bytes[buffer->length++] = (char)( 0xF0 | ( c >> 18 ) );
+		buffer->bytes[buffer->length++] = (char)( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+		buffer->bytes[buffer->length++] = (char)( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+		buffer->bytes[buffer->length++] = (char)( 0x80 | ( c & 0x3F ) );
+	}
+}
+
+static size_t SPTextValidSequenceLength(const unsigned char *bytes, size_t length) {
+
+	// The length of the well formed UTF-8 sequence at bytes, or 0 if there is none
+
+	unsigned char c = bytes[0];
+	size_t i, count;
+
+	if ( c < 0x80 ) return 1;
+	else if ( c >= 0xC2 && c <= 0xDF ) count = 2;
+	else if ( c >= 0xE0 && c <= 0xEF ) count = 3;
+	else if ( c >= 0xF0 && c <= 0xF4 ) count = 4;
+	else return 0;
+
+	if ( count > length ) return 0;
+	for ( i = 1; i < count; i++ )
+		if ( ( bytes[i] & 0xC0 ) != 0x80 ) return 0;
+
+	if ( c == 0xE0 && bytes[1] < 0xA0 ) return 0;		// overlong
+	if ( c == 0xED && bytes[1] >= 0xA0 ) return 0;		// surrogate
+	if ( c == 0xF0 && bytes[1] < 0x90 ) return 0;		// overlong
+	if ( c == 0xF4 && bytes[1] >= 0x90 ) return 0;		// beyond U+10FFFF
+
+	return count;
+}
+
+static void SPTextBufferAppendText(SPTextBuffer *buffer, const char *text, size_t length) {
+
+	// Copies well formed UTF-8 as it is, a run at a time, and reads any other byte as
+	// Latin-1. Control characters other than newlines become spaces.
+
+	const unsigned char *bytes = (const unsigned char*)text;
+	size_t i = 0, run = 0;
+
+	while ( i < length ) {
+
+		size_t sequence = SPTextValidSequenceLength(bytes + i, length - i);
+
+		if ( sequence > 0 && !( sequence == 1 && ( bytes[i] < 0x20 || bytes[i] == 0x7F ) ) ) {
+			i += sequence;
+			continue;
+		}
+
+		if ( i > run && SPTextBufferReserve(buffer, i - run) ) {
+			memcpy(buffer->bytes + buffer->length, bytes + run, i - run);
+			buffer->length += i - run;
+		}
+
+		if ( bytes[i] == '\r' && i + 1 < length && bytes[i+1] == '\n' ) {
+			// part of a line ending, the newline follows
+		}
+		else if ( bytes[i] == '\r' ) {
+			SPTextBufferAppendByte(buffer, '\n');
+		}
+		else if ( bytes[i] == '\t' ) {
+			SPTextBufferAppendByte(buffer, ' ');
+		}
+		else {
+			SPTextBufferAppendCodePoint(buffer, bytes[i]);
+		}
+
+		run = ++i;
+	}
+
+	if ( i > run && SPTextBufferReserve(buffer, i - run) ) {
+		memcpy(buffer->bytes + buffer->length, bytes + run, i - run);
+		buffer->length += i - run;
+	}
+}
+
+static char * SPTextBufferFinish(SPTextBuffer *buffer, size_t *outLength) {
+
+	SPTextBufferAppendByte(buffer, '\0');
+
+	if ( buffer->failed ) {
+		free(buffer->bytes);
+		*outLength = 0;
+		return NULL;
+	}
+
+	*outLength = buffer->length - 1;
+	return buffer->bytes;
+}
+
+#pragma mark -
+
+char * SPTextExtractPlainText(const char *bytes, size_t length, size_t *outLength) {
+
+	const unsigned char *text = (const unsigned char*)bytes;
+	SPTextBuffer buffer;
+
+	if ( !SPTextBufferInit(&buffer, length + 1) )
+		return NULL;
+
+	if ( length >= 2 && ( ( text[0] == 0xFF && text[1] == 0xFE ) || ( text[0] == 0xFE && text[1] == 0xFF ) ) ) {
+
+		// UTF-16 with a byte order mark
+
+		bool littleEndian = ( text[0] == 0xFF );
+		size_t i;
+
+		for ( i = 2; i + 1 < length; i += 2 ) {
+			uint32_t c = ( littleEndian ? ( text[i] | ( text[i+1] << 8 ) ) : ( ( text[i] << 8 ) | text[i+1] ) );
+
+			if ( c >= 0xD800 && c <= 0xDBFF && i + 3 < length ) {
+				uint32_t low = ( littleEndian ? ( text[i+2] | ( text[i+3] << 8 ) ) : ( ( text[i+2] << 8 ) | text[i+3] ) );
+				if ( low >= 0xDC00 && low <= 0xDFFF ) {
+					c = 0x10000 + ( ( c - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+					i += 2;
+				}
+			}
+
+			if ( c == '\r' ) c = '\n';
+			else if ( c == '\t' ) c = ' ';
+			SPTextBufferAppendCodePoint(&buffer, c);
+		}
+	}
+	else {
+		if ( length >= 3 && text[0] == 0xEF && text[1] == 0xBB && text[2] == 0xBF ) {
+			bytes += 3;
+			length -= 3;
+		}
+		SPTextBufferAppendText(&buffer, bytes, length);
+	}
+
+	return SPTextBufferFinish(&buffer, outLength);
+}
+
+#pragma mark -
+
+typedef struct {
+	const char *name;
+	uint32_t codePoint;
+} SPTextEntity;
+
+static const SPTextEntity SPTextEntities[] = {
+	{ "amp", '&' }, { "lt", '<' }, { "gt", '>' }, { "quot", '"' }, { "apos", '\'' },
+	{ "nbsp", ' ' }, { "copy", 0xA9 }, { "reg", 0xAE }, { "trade", 0x2122 }, { "deg", 0xB0 },
+	{ "ndash", 0x2013 }, { "mdash", 0x2014 }, { "hellip", 0x2026 }, { "bull", 0x2022 },
+	{ "lsquo", 0x2018 }, { "rsquo", 0x2019 }, { "ldquo", 0x201C }, { "rdquo", 0x201D },
+	{ "laquo", 0xAB }, { "raquo", 0xBB }, { "euro", 0x20AC }, { "pound", 0xA3 }, { "middot", 0xB7 },
+};
+
+static size_t SPTextDecodeEntity(const char *bytes, size_t length, uint32_t *outCodePoint) {
+
+	// Decodes the character reference at bytes, which starts with '&', and returns its
+	// length including the semicolon, or 0 if it is not one we know
+
+	size_t i, end;
+
+	for ( end = 1; end < length && end < 12 && bytes[end] != ';'; end++ );
+	if ( end >= length || bytes[end] != ';' || end == 1 ) return 0;
+
+	if ( bytes[1] == '#' ) {
+		uint32_t c = 0;
+		bool hex = ( end > 2 && ( bytes[2] == 'x' || bytes[2] == 'X' ) );
+
+		for ( i = ( hex ? 3 : 2 ); i < end; i++ ) {
+			int digit;
+			if ( isdigit((unsigned char)bytes[i]) ) digit = bytes[i] - '0';
+			else if ( hex && isxdigit((unsigned char)bytes[i]) ) digit = tolower((unsigned char)bytes[i]) - 'a' + 10;
+			else return 0;
+			c = c * ( hex ? 16 : 10 ) + digit;
+			if ( c > 0x10FFFF ) return 0;
+		}
+
+		if ( i == ( hex ? 3u : 2u ) ) return 0;
+		*outCodePoint = c;
+		return end + 1;
+	}
+
+	for ( i = 0; i < sizeof(SPTextEntities) / sizeof(SPTextEntity); i++ ) {
+		size_t nameLength = strlen(SPTextEntities[i].name);
+		if ( nameLength == end - 1 && strncmp(bytes + 1, SPTextEntities[i].name, nameLength) == 0 ) {
+			*outCodePoint = SPTextEntities[i].codePoint;
+			return end + 1;
+		}
+	}
+
+	return 0;
+}
+
+static const char * SPTextFindCaseInsensitive(const char *bytes, size_t length, const char *needle) {
+	size_t i, needleLength = strlen(needle);
+	for ( i = 0; i + needleLength <= length; i++ )
+		if ( strncasecmp(bytes + i, needle, needleLength) == 0 ) return bytes + i;
+	return NULL;
+}
+
+static bool SPTextIsBlockTag(const char *name, size_t length) {
+
+	static const char *blockTags[] = {
+		"address", "article", "aside", "blockquote", "br", "caption", "dd", "div", "dl", "dt",
+		"figcaption", "figure", "footer", "form", "h1", "h2", "h3", "h4", "h5", "h6", "header",
+		"hr", "li", "main", "nav", "ol", "option", "p", "pre", "section", "table", "td", "th",
+		"title", "tr", "ul",
+	};
+	size_t i;
+
+	for ( i = 0; i < sizeof(blockTags) / sizeof(char*); i++ )
+		if ( strlen(blockTags[i]) == length && strncasecmp(name, blockTags[i], length) == 0 ) return true;
+
+	return false;
+}
+
+char * SPTextExtractHTML(const char *bytes, size_t length, size_t *outLength) {
+
+	SPTextBuffer buffer;
+	size_t i = 0, run = 0;
+
+	if ( !SPTextBufferInit(&buffer, length / 2 + 1) )
+		return NULL;
+
+	while ( i < length ) {
+
+		if ( bytes[i] != '<' && bytes[i] != '&' ) {
+			i++;
+			continue;
+		}
+
+		SPTextBufferAppendText(&buffer, bytes + run, i - run);
+
+		if ( bytes[i] == '&' ) {
+			uint32_t c;
+			size_t entity = SPTextDecodeEntity(bytes + i, length - i, &c);
+			if ( entity > 0 ) {
+				SPTextBufferAppendCodePoint(&buffer, c);
+				i += entity;
+			}
+			else {
+				SPTextBufferAppendByte(&buffer, '&');
+				i++;
+			}
+		}
+		else if ( length - i >= 4 && strncmp(bytes + i, "<!--", 4) == 0 ) {
+			const char *end = SPTextFindCaseInsensitive(bytes + i + 4, length - i - 4, "-->");
+			i = ( end == NULL ? length : (size_t)( end - bytes ) + 3 );
+		}
+		else {
+			size_t nameStart = i + 1, nameEnd;
+			char quote = 0;
+
+			if ( nameStart < length && bytes[nameStart] == '/' ) nameStart++;
+			for ( nameEnd = nameStart; nameEnd < length && isalnum((unsigned char)bytes[nameEnd]); nameEnd++ );
+
+			if ( nameEnd == nameStart && !( nameStart < length && ( bytes[nameStart] == '!' || bytes[nameStart] == '?' ) ) ) {
+
+				// A lone '<' is text
+
+				SPTextBufferAppendByte(&buffer, '<');
+				run = ++i;
+				continue;
+			}
+
+			// Skip to the end of the tag, stepping over quoted attribute values
+
+			for ( i = nameEnd; i < length; i++ ) {
+				if ( quote != 0 ) { if ( bytes[i] == quote ) quote = 0; }
+				else if ( bytes[i] == '"' || bytes[i] == '\'' ) quote = bytes[i];
+				else if ( bytes[i] == '>' ) break;
+			}
+			i = ( i < length ? i + 1 : length );
+
+			if ( bytes[nameStart-1] != '/' && ( ( nameEnd - nameStart == 6 && strncasecmp(bytes + nameStart, "script", 6) == 0 )
+					|| ( nameEnd - nameStart == 5 && strncasecmp(bytes + nameStart, "style", 5) == 0 ) ) ) {
+
+				// The contents of scripts and style sheets are not text
+
+				const char *end = SPTextFindCaseInsensitive(bytes + i, length - i,
+						( nameEnd - nameStart == 6 ? "</script" : "</style" ));
+				if ( end == NULL ) {
+					i = length;
+				}
+				else {
+					for ( i = (size_t)( end - bytes ); i < length && bytes[i] != '>'; i++ );
+					i = ( i < length ? i + 1 : length );
+				}
+				SPTextBufferAppendSpace(&buffer);
+			}
+			else if ( SPTextIsBlockTag(bytes + nameStart, nameEnd - nameStart) ) {
+				SPTextBufferAppendSpace(&buffer);
+			}
+		}
+
+		run = i;
+	}
+
+	SPTextBufferAppendText(&buffer, bytes + run, length - run);
+	return SPTextBufferFinish(&buffer, outLength);
+}
+
+#pragma mark -
+
+static bool SPTextIsRuleLine(const char *line, size_t length) {
+
+	// A thematic break or setext underline: three or more of one of -, *, _ or = and
+	// nothing else but spaces
+
+	size_t i, count = 0;
+	char mark = 0;
+
+	for ( i = 0; i < length; i++ ) {
+		if ( line[i] == ' ' || line[i] == '\t' ) continue;
+		if ( mark == 0 && ( line[i] == '-' || line[i] == '*' || line[i] == '_' || line[i] == '=' ) ) mark = line[i];
+		if ( line[i] != mark ) return false;
+		count++;
+	}
+
+	return ( count >= 3 );
+}
+
+static bool SPTextIsWordByte(unsigned char c) {
+	return ( isalnum(c) || c >= 0x80 );
+}
+
+static void SPTextAppendMarkdownInline(SPTextBuffer *buffer, const char *line, size_t length) {
+
+	size_t i = 0, run = 0;
+
+	while ( i < length ) {
+
+		char c = line[i];
+
+		if ( c != '*' && c != '_' && c != '`' && c != '~' && c != '\\' && c != '!' && c != '['
+				&& c != ']' && c != '<' && c != '|' ) {
+			i++;
+			continue;
+		}
+
+		SPTextBufferAppendText(buffer, line + run, i - run);
+
+		if ( c == '\\' && i + 1 < length && ispunct((unsigned char)line[i+1]) ) {
+			SPTextBufferAppendByte(buffer, line[i+1]);
+			i += 2;
+		}
+		else if ( c == '_' && i > 0 && i + 1 < length && SPTextIsWordByte(line[i-1]) && SPTextIsWordByte(line[i+1]) ) {
+			// an underscore inside a word, as in snake_case, is part of the word
+			SPTextBufferAppendByte(buffer, '_');
+			i++;
+		}
+		else if ( c == '!' && !( i + 1 < length && line[i+1] == '[' ) ) {
+			SPTextBufferAppendByte(buffer, '!');
+			i++;
+		}
+		else if ( c == ']' && i + 1 < length && ( line[i+1] == '(' || line[i+1] == '[' ) ) {
+
+			// The end of link or image text. The destination or reference that follows is dropped.
+
+			char close = ( line[i+1] == '(' ? ')' : ']' );
+			size_t end;
+			for ( end = i + 2; end < length && line[end] != close; end++ );
+			i = ( end < length ? end + 1 : length );
+		}
+		else if ( c == '<' ) {
+
+			// Autolinks keep their address, inline tags are dropped, and anything else is text
+
+			size_t end;
+			for ( end = i + 1; end < length && line[end] != '>' && line[end] != ' '; end++ );
+
+			if ( end < length && line[end] == '>' && memchr(line + i, ':', end - i) != NULL ) {
+				SPTextBufferAppendText(buffer, line + i + 1, end - i - 1);
+				i = end + 1;
+			}
+			else if ( i + 1 < length && ( isalpha((unsigned char)line[i+1]) || line[i+1] == '/' ) ) {
+				for ( end = i + 1; end < length && line[end] != '>'; end++ );
+				i = ( end < length ? end + 1 : length );
+			}
+			else {
+				SPTextBufferAppendByte(buffer, '<');
+				i++;
+			}
+		}
+		else if ( c == '|' ) {
+			SPTextBufferAppendSpace(buffer);
+			i++;
+		}
+		else {
+			i++;
+		}
+
+		run = i;
+	}
+
+	SPTextBufferAppendText(buffer, line + run, length - run);
+}
+
+char * SPTextExtractMarkdown(const char *bytes, size_t length, size_t *outLength) {
+
+	SPTextBuffer buffer;
+	size_t start = 0;
+	bool inFence = false;
+
+	if ( !SPTextBufferInit(&buffer, length + 1) )
+		return NULL;
+
+	while ( start < length ) {
+
+		const char *newline = memchr(bytes + start, '\n', length - start);
+		size_t end = ( newline == NULL ? length : (size_t)( newline - bytes ) );
+		const char *line = bytes + start;
+		size_t lineLength = end - start, i = 0;
+
+		start = end + 1;
+
+		while ( i < lineLength && i < 3 && line[i] == ' ' ) i++;
+
+		if ( lineLength - i >= 3 && ( strncmp(line + i, "```", 3) == 0 || strncmp(line + i, "~~~", 3) == 0 ) ) {
+			inFence = !inFence;
+			continue;
+		}
+
+		if ( inFence ) {
+			SPTextBufferAppendText(&buffer, line, lineLength);
+			SPTextBufferAppendByte(&buffer, '\n');
+			continue;
+		}
+
+		if ( SPTextIsRuleLine(line, lineLength) )
+			continue;
+
+		// Block quote markers, then heading or list markers
+
+		while ( i < lineLength && ( line[i] == '>' || line[i] == ' ' || line[i] == '\t' ) ) i++;
+
+		if ( i < lineLength && line[i] == '#' ) {
+			size_t marker = i;
+			while ( marker < lineLength && line[marker] == '#' ) marker++;
+			if ( marker == lineLength || line[marker] == ' ' ) i = marker;
+		}
+		else if ( i + 1 < lineLength && ( line[i] == '-' || line[i] == '*' || line[i] == '+' ) && line[i+1] == ' ' ) {
+			i += 2;
+		}
+		else if ( i < lineLength && isdigit((unsigned char)line[i]) ) {
+			size_t marker = i;
+			while ( marker < lineLength && isdigit((unsigned char)line[marker]) ) marker++;
+			if ( marker + 1 < lineLength && ( line[marker] == '.' || line[marker] == ')' ) && line[marker+1] == ' ' ) i = marker + 2;
+		}
+		else if ( i < lineLength && line[i] == '[' ) {
+
+			// Link reference definitions are not text
+
+			const char *close = memchr(line + i, ']', lineLength - i);
+			if ( close != NULL && (size_t)( close - line ) + 1 < lineLength && close[1] == ':' )
+				continue;
+		}
+
+		SPTextAppendMarkdownInline(&buffer, line + i, lineLength - i);
+		SPTextBufferAppendByte(&buffer, '\n');
+	}
+
+	return SPTextBufferFinish(&buffer, outLength);
+}
+
+#pragma mark -
+
+static const SPTextExtractor SPTextExtractorDefaults[] = {
+	{ "txt text log csv tsv", SPTextExtractPlainText },
+	{ "html htm xhtml", SPTextExtractHTML },
+	{ "md markdown mdown mkd", SPTextExtractMarkdown },
+};
+
+const SPTextExtractor * SPTextExtractorGetDefaults(size_t *outCount) {
+	*outCount = sizeof(SPTextExtractorDefaults) / sizeof(SPTextExtractor);
+	return SPTextExtractorDefaults;
+}
+
+const SPTextExtractor * SPTextExtractorForPath(const SPTextExtractor *extractors, size_t count, const char *path) {
+
+	const char *slash = strrchr(path, '/');
+	const char *dot = strrchr(( slash == NULL ? path : slash ), '.');
+	size_t i, extensionLength;
+
+	if ( dot == NULL || dot[1] == '\0' || dot == ( slash == NULL ? path : slash + 1 ) )
+		return NULL;
+
+	dot++;
+	extensionLength = strlen(dot);
+
+	for ( i = 0; i < count; i++ ) {
+		const char *extension = extractors[i].extensions;
+		while ( *extension != '\0' ) {
+			size_t length = strcspn(extension, " ");
+			if ( length == extensionLength && strncasecmp(extension, dot, length) == 0 ) return &extractors[i];
+			extension += length;
+			while ( *extension == ' ' ) extension++;
+		}
+	}
+
+	return NULL;
+}
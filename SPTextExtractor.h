@@ -0,0 +1,84 @@
+//
+//  SPTextExtractor.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPTEXTEXTRACTOR_H
+#define SPTEXTEXTRACTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Text extractors turn the bytes of a file into the plain UTF-8 text that is indexed.
+// They work on a file's bytes where they lie, typically in a mapped file, and need no
+// importers from the system, so file based documents are read the same way everywhere.
+// Each extractor claims the file extensions it understands. Bytes which are not valid
+// UTF-8 are read as Latin-1, and control characters become spaces.
+
+typedef char * (*SPTextExtractorFunction)(const char *bytes, size_t length, size_t *outLength);
+
+	// Returns the extracted text, NUL terminated, which the caller frees, and its length
+	// in outLength. Returns NULL if memory could not be allocated.
+
+typedef struct {
+	const char *extensions;				// space separated, without dots, matched ignoring case
+	SPTextExtractorFunction extract;
+} SPTextExtractor;
+
+char * SPTextExtractPlainText(const char *bytes, size_t length, size_t *outLength);
+
+	// Plain text in UTF-8, Latin-1 or, when it starts with a byte order mark, UTF-16.
+
+char * SPTextExtractHTML(const char *bytes, size_t length, size_t *outLength);
+
+	// Drops tags, comments, scripts and style sheets and decodes character references.
+	// Block level tags separate words; inline tags do not.
+
+char * SPTextExtractMarkdown(const char *bytes, size_t length, size_t *outLength);
+
+	// Drops headings, quotes, list markers, rules, emphasis, code fences, inline tags and
+	// link destinations, keeping link and image text and the contents of code blocks.
+
+const SPTextExtractor * SPTextExtractorGetDefaults(size_t *outCount);
+
+	// Plain text, HTML and Markdown, in that order.
+
+const SPTextExtractor * SPTextExtractorForPath(const SPTextExtractor *extractors, size_t count, const char *path);
+
+	// The first of extractors which claims the extension of path, or NULL.
+
+#endif
@@ -0,0 +1,302 @@
+//
+//  SPTrigramIndex.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#include "SPTrigramIndex.h"
+#include "SPAnalysis.h"
+#include "SPStringTable.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kSPTrigramStart		'\001'
+#define kSPTrigramEnd		'\002'
+
+typedef struct {
+	SPTermID *terms;				// ascending
+	uint32_t count;
+	uint32_t capacity;
+} SPTrigramList;
+
+struct SPTrigramIndex {
+	pthread_rwlock_t lock;
+	SPStringTable *table;			// trigram -> index into lists
+	SPTrigramList *lists;
+	size_t listCount;
+	size_t listCapacity;
+	SPTermID termCount;				// terms indexed so far
+	bool failed;
+};
+
+SPTrigramIndex * SPTrigramIndexCreate(void) {
+
+	SPTrigramIndex *trigrams = calloc(1, sizeof(SPTrigramIndex));
+	if ( trigrams == NULL ) return NULL;
+
+	trigrams->table = SPStringTableCreate(4096);
+	if ( trigrams->table == NULL || pthread_rwlock_init(&trigrams->lock, NULL) != 0 ) {
+		SPStringTableRelease(trigrams->table);
+		free(trigrams);
+		return NULL;
+	}
+
+	return trigrams;
+}
+
+void SPTrigramIndexRelease(SPTrigramIndex *trigrams) {
+
+	size_t i;
+
+	if ( trigrams == NULL ) return;
+
+	for ( i = 0; i < trigrams->listCount; i++ ) free(trigrams->lists[i].terms);
+
+	free(trigrams->lists);
+	SPStringTableRelease(trigrams->table);
+	pthread_rwlock_destroy(&trigrams->lock);
+	free(trigrams);
+}
+
+#pragma mark -
+#pragma mark Writing
+
+static bool SPTrigramIndexAddTrigram(SPTrigramIndex *trigrams, const char *trigram, SPTermID term) {
+
+	int32_t value = SPStringTableGetValue(trigrams->table, trigram, 3);
+	SPTrigramList *list;
+
+	if ( value == kSPStringTableNotFound ) {
+		if ( trigrams->listCount == trigrams->listCapacity ) {
+			size_t capacity = ( trigrams->listCapacity == 0 ? 1024 : trigrams->listCapacity * 2 );
+			SPTrigramList *lists = realloc(trigrams->lists, capacity * sizeof(SPTrigramList));
+			if ( lists == NULL ) return false;
+			trigrams->lists = lists;
+			trigrams->listCapacity = capacity;
+		}
+
+		value = (int32_t)trigrams->listCount;
+		if ( !SPStringTableSetValue(trigrams->table, trigram, 3, value, NULL) ) return false;
+
+		memset(&trigrams->lists[value], 0, sizeof(SPTrigramList));
+		trigrams->listCount++;
+	}
+
+	list = &trigrams->lists[value];
+
+	// A term repeating a trigram, such as banana, is only listed once
+
+	if ( list->count > 0 && list->terms[list->count - 1] == term ) return true;
+
+	if ( list->count == list->capacity ) {
+		uint32_t capacity = ( list->capacity == 0 ? 4 : list->capacity * 2 );
+		SPTermID *terms = realloc(list->terms, capacity * sizeof(SPTermID));
+		if ( terms == NULL ) return false;
+		list->terms = terms;
+		list->capacity = capacity;
+	}
+
+	list->terms[list->count++] = term;
+	return true;
+}
+
+bool SPTrigramIndexAddTerms(SPTrigramIndex *trigrams, const SPTermDirectory *directory, SPTermID count) {
+
+	char padded[kSPIndexMaximumTermLength + 2];
+	SPTermID term;
+	bool success = true;
+
+	if ( trigrams->failed ) return false;
+	if ( trigrams->termCount >= count ) return true;
+
+	pthread_rwlock_wrlock(&trigrams->lock);
+
+	for ( term = trigrams->termCount; term < count && success; term++ ) {
+		size_t i, length;
+		const char *string = SPTermDirectoryGetTerm(directory, term, &length);
+
+		if ( length > kSPIndexMaximumTermLength ) length = kSPIndexMaximumTermLength;
+
+		padded[0] = kSPTrigramStart;
+		memcpy(padded + 1, string, length);
+		padded[length + 1] = kSPTrigramEnd;
+
+		for ( i = 0; i + 3 <= length + 2 && success; i++ )
+			success = SPTrigramIndexAddTrigram(trigrams, padded + i, term);
+	}
+
+	trigrams->termCount = count;
+	if ( !success ) trigrams->failed = true;
+
+	pthread_rwlock_unlock(&trigrams->lock);
+	return success;
+}
+
+#pragma mark -
+#pragma mark Reading
+
+static int SPCompareListCounts(const void *a, const void *b) {
+	const SPTrigramList *x = *(const SPTrigramList * const *)a, *y = *(const SPTrigramList * const *)b;
+	return ( x->count < y->count ? -1 : ( x->count > y->count ? 1 : 0 ) );
+}
+
+static bool SPTrigramListContains(const SPTrigramList *list, SPTermID term, uint32_t *position) {
+
+	// Gallops forward from *position, which only ever increases across calls
+
+	uint32_t low = *position, step = 1, high;
+
+	while ( low + step < list->count && list->terms[low + step] < term ) {
+		low += step;
+		step *= 2;
+	}
+
+	high = ( low + step < list->count ? low + step + 1 : list->count );
+
+	while ( low < high ) {
+		uint32_t middle = low + ( high - low ) / 2;
+		if ( list->terms[middle] < term ) low = middle + 1;
+		else high = middle;
+	}
+
+	*position = low;
+	return ( low < list->count && list->terms[low] == term );
+}
+
+bool SPTrigramIndexCopyCandidates(SPTrigramIndex *trigrams, const char *pattern, size_t length, SPTermID limit, 
+		SPTermID **outTerms, size_t *outCount) {
+
+	// Every run of literal characters between stars contributes its trigrams, including
+	// the start or end marker when the run is anchored to that end of the pattern.
+
+	char padded[kSPIndexMaximumTermLength + 2];
+	const SPTrigramList **lists = NULL;
+	uint32_t *positions = NULL;
+	size_t i, listCount = 0, start = 0, count = 0;
+	SPTermID *terms = NULL;
+	bool missing = false;
+	bool success = false;
+
+	*outTerms = NULL;
+	*outCount = 0;
+
+	if ( length > kSPIndexMaximumTermLength ) return false;
+
+	lists = malloc(( length + 2 ) * sizeof(SPTrigramList*));
+	if ( lists == NULL ) return false;
+
+	pthread_rwlock_rdlock(&trigrams->lock);
+
+	if ( trigrams->failed ) goto bail;
+
+	while ( start <= length ) {
+		size_t end = start, runLength = 0, j;
+
+		while ( end < length && pattern[end] != '*' ) end++;
+
+		if ( start == 0 ) padded[runLength++] = kSPTrigramStart;
+		memcpy(padded + runLength, pattern + start, end - start);
+		runLength += end - start;
+		if ( end == length ) padded[runLength++] = kSPTrigramEnd;
+
+		for ( j = 0; j + 3 <= runLength; j++ ) {
+			int32_t value = SPStringTableGetValue(trigrams->table, padded + j, 3);
+			if ( value == kSPStringTableNotFound ) missing = true;
+			else lists[listCount++] = &trigrams->lists[value];
+		}
+
+		start = end + 1;
+	}
+
+	if ( listCount == 0 && !missing ) goto bail;
+
+	success = true;
+	if ( missing ) goto bail;
+
+	// Intersect starting from the shortest list
+
+	qsort(lists, listCount, sizeof(SPTrigramList*), SPCompareListCounts);
+
+	terms = malloc(( lists[0]->count == 0 ? 1 : lists[0]->count ) * sizeof(SPTermID));
+	positions = calloc(listCount, sizeof(uint32_t));
+	if ( terms == NULL || positions == NULL ) {
+		success = false;
+		goto bail;
+	}
+
+	for ( i = 0; i < lists[0]->count && lists[0]->terms[i] < limit; i++ ) {
+		SPTermID term = lists[0]->terms[i];
+		size_t j;
+
+		for ( j = 1; j < listCount; j++ ) {
+			if ( !SPTrigramListContains(lists[j], term, &positions[j]) ) break;
+		}
+
+		if ( j == listCount ) terms[count++] = term;
+	}
+
+bail:
+	pthread_rwlock_unlock(&trigrams->lock);
+
+	free(lists);
+	free(positions);
+
+	if ( success ) {
+		*outTerms = terms;
+		*outCount = count;
+	}
+	else {
+		free(terms);
+	}
+
+	return success;
+}
+
+size_t SPTrigramIndexGetMemorySize(SPTrigramIndex *trigrams) {
+
+	size_t i, size;
+
+	pthread_rwlock_rdlock(&trigrams->lock);
+
+	size = sizeof(SPTrigramIndex) + SPStringTableGetMemorySize(trigrams->table) 
+			+ trigrams->listCapacity * sizeof(SPTrigramList);
+	for ( i = 0; i < trigrams->listCount; i++ ) size += trigrams->lists[i].capacity * sizeof(SPTermID);
+
+	pthread_rwlock_unlock(&trigrams->lock);
+	return size;
+}
@@ -0,0 +1,77 @@
+//
+//  SPTrigramIndex.h
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+#ifndef SPTRIGRAMINDEX_H
+#define SPTRIGRAMINDEX_H
+
+#include "SPIndex.h"
+#include "SPTermDirectory.h"
+
+// SPTrigramIndex maps every three byte sequence found in the term directory to the IDs
+// of the terms containing it, so that wildcard patterns with a leading * need not scan
+// the whole dictionary. Terms are indexed with start and end markers, which lets the
+// anchored ends of patterns such as foo* and *bar be matched as well.
+
+// The writer adds terms in ID order as the directory grows. Term IDs are never reused
+// and terms are never removed, so the index only ever grows; terms whose documents have
+// all been removed are dropped when their candidates are looked up in the segments.
+// Readers share a read-write lock with the writer, which only holds it to append.
+
+typedef struct SPTrigramIndex SPTrigramIndex;
+
+SPTrigramIndex * SPTrigramIndexCreate(void);
+void SPTrigramIndexRelease(SPTrigramIndex *trigrams);
+
+bool SPTrigramIndexAddTerms(SPTrigramIndex *trigrams, const SPTermDirectory *directory, SPTermID count);
+
+	// Writer only. Indexes the directory's terms from the last one indexed up to count.
+	// Returns false if memory ran out, after which the index refuses every pattern.
+
+bool SPTrigramIndexCopyCandidates(SPTrigramIndex *trigrams, const char *pattern, size_t length, SPTermID limit, 
+		SPTermID **outTerms, size_t *outCount);
+
+	// Finds the terms below limit which contain every trigram of the wildcard pattern, in
+	// ascending ID order. Candidates must still be matched against the pattern. Returns
+	// false without candidates when the pattern has no trigrams, for example a*, or the
+	// index cannot answer it, in which case the caller scans the dictionary instead.
+	// *outTerms is malloc'd and must be freed by the caller.
+
+size_t SPTrigramIndexGetMemorySize(SPTrigramIndex *trigrams);
+
+#endif
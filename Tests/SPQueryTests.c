@@ -0,0 +1,159 @@
+//
+//  SPQueryTests.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+// Queries reach the native index folded to lower case, with the operator words left as
+// they are, the way SPNativeBackend folds them before searching. NEAR must still constrain
+// how far apart its operands are after folding.
+
+#include "SPIndex.h"
+#include "SPAnalysis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int SPTestFailures = 0;
+
+#define SPTestAssert(condition) do { \
+	if ( !(condition) ) { \
+		fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+		SPTestFailures++; \
+	} \
+} while ( 0 )
+
+static bool SPTestIsSeparator(char c) {
+	return ( strchr(" \t\r\n()\"&|!", c) != NULL );
+}
+
+static char * SPTestCopyFoldedQuery(const char *query) {
+
+	// SPNativeBackendFoldedQuery without the diacritic folding Foundation adds
+
+	size_t length = strlen(query), start = 0, i;
+	char *folded = strdup(query);
+
+	while ( start < length ) {
+		size_t end = start;
+		while ( end < length && !SPTestIsSeparator(query[end]) ) end++;
+
+		if ( !SPSearchIsOperatorWord(query + start, end - start) )
+			for ( i = start; i < end; i++ ) folded[i] = (char)SPFoldCharacter((uint8_t)query[i]);
+
+		start = end + 1;
+	}
+
+	return folded;
+}
+
+static size_t SPTestSearch(SPIndexRef index, const char *query, SPDocumentID *outDocuments, size_t capacity) {
+
+	char *folded = SPTestCopyFoldedQuery(query);
+	SPSearchRef search = SPSearchCreate(index, folded, strlen(folded), 0);
+	size_t found = 0;
+
+	if ( search != NULL ) {
+		SPSearchFindMatches(search, capacity, outDocuments, NULL, &found);
+		SPSearchRelease(search);
+	}
+
+	free(folded);
+	return found;
+}
+
+static void SPTestFoldedOperatorWords(void) {
+
+	char *folded = SPTestCopyFoldedQuery("Merger NEAR/5 Bank AND (Loan OR NOT Near) NEAR");
+
+	SPTestAssert( strcmp(folded, "merger NEAR/5 bank AND (loan OR NOT near) NEAR") == 0 );
+	SPTestAssert( SPSearchIsOperatorWord("NEAR/12", 7) );
+	SPTestAssert( !SPSearchIsOperatorWord("near/12", 7) );
+	SPTestAssert( !SPSearchIsOperatorWord("NEAR/", 5) );
+	SPTestAssert( !SPSearchIsOperatorWord("NEAR/5x", 7) );
+
+	free(folded);
+}
+
+static void SPTestFoldedNearQuery(void) {
+
+	// merger and bank are four words apart in one document and twenty in the other
+
+	const char *close = "The Merger was approved by the Bank";
+	const char *far = "Merger talks dragged on through a long winter of meetings, memos, calls, "
+			"reviews, audits, filings, hearings, delays, objections, revisions, drafts, "
+			"votes and finally the Bank";
+
+	SPIndexOptions options;
+	SPIndexRef index;
+	SPDocumentID documents[4], closeDocument, farDocument;
+
+	memset(&options, 0, sizeof(SPIndexOptions));
+	options.minTermLength = 1;
+	options.refreshInterval = 3600;
+	options.indexesPositions = true;
+
+	index = SPIndexCreate(&options);
+	closeDocument = SPIndexAddDocument(index, "file:///close.txt", close, strlen(close));
+	farDocument = SPIndexAddDocument(index, "file:///far.txt", far, strlen(far));
+	SPIndexRefresh(index);
+
+	SPTestAssert( SPTestSearch(index, "Merger Bank", documents, 4) == 2 );
+
+	SPTestAssert( SPTestSearch(index, "Merger NEAR/5 Bank", documents, 4) == 1 );
+	SPTestAssert( documents[0] == closeDocument );
+
+	SPTestAssert( SPTestSearch(index, "Merger NEAR Bank", documents, 4) == 1 );
+	SPTestAssert( documents[0] == closeDocument );
+
+	SPTestAssert( SPTestSearch(index, "Merger NEAR/3 Bank", documents, 4) == 0 );
+
+	SPTestAssert( SPTestSearch(index, "Merger NEAR/25 Bank", documents, 4) == 2 );
+	SPTestAssert( documents[0] == closeDocument || documents[1] == closeDocument );
+	SPTestAssert( documents[0] == farDocument || documents[1] == farDocument );
+
+	SPIndexRelease(index);
+}
+
+int main(int argc, char *argv[]) {
+
+	SPTestFoldedOperatorWords();
+	SPTestFoldedNearQuery();
+
+	printf("SPQueryTests: %s\n", ( SPTestFailures == 0 ? "passed" : "FAILED" ));
+	return ( SPTestFailures == 0 ? 0 : 1 );
+}
@@ -0,0 +1,253 @@
+//
+//  SPStringTableTests.c
+//  SPSearchStore
+//
+//	v0.9
+//
+//  Created by Philip Dow on 6/6/11.
+//  Copyright 2011 Philip Dow /Sprouted. All rights reserved.
+//	phil@phildow.net / phil@getsprouted.com
+//
+
+/*
+ Redistribution and use in source and binary forms, with or without modification, are permitted
+ provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions
+ and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+ and the following disclaimer in the documentation and/or other materials provided with the
+ distribution.
+ 
+ * Neither the name of the author nor the names of its contributors may be used to endorse or
+ promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	For non-attribution licensing options refer to http://phildow.net/licensing/
+*/
+
+// Interned strings must be stored once however often they are removed and added again,
+// in the string table itself and in the tables built on it: the SearchKit backend's
+// document table and the native index's URI and document data tables. Each test churns
+// a few strings many times and checks that memory stops growing after the first round.
+
+#include "SPDocumentTable.h"
+#include "SPIndex.h"
+#include "SPIndexPrivate.h"
+#include "SPStringTable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kSPTestChurnCount		200000
+#define kSPTestIndexChurnCount	20000
+
+static int SPTestFailures = 0;
+
+#define SPTestAssert(condition) do { \
+	if ( !(condition) ) { \
+		fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+		SPTestFailures++; \
+	} \
+} while ( 0 )
+
+static const char *kSPTestURI = "file:///Users/me/Documents/Notes/churned.txt";
+
+static void SPTestStringTableChurn(void) {
+
+	SPStringTable *table = SPStringTableCreate(16);
+	size_t length = strlen(kSPTestURI), size;
+	uint32_t offset, first;
+	int i;
+
+	SPStringTableSetValue(table, kSPTestURI, length, 0, &first);
+	size = SPStringTableGetMemorySize(table);
+
+	for ( i = 1; i <= kSPTestChurnCount; i++ ) {
+		SPStringTableRemoveValue(table, kSPTestURI, length);
+		SPStringTableSetValue(table, kSPTestURI, length, i, &offset);
+	}
+
+	SPTestAssert( offset == first );
+	SPTestAssert( SPStringTableGetCount(table) == 1 );
+	SPTestAssert( SPStringTableGetValue(table, kSPTestURI, length) == kSPTestChurnCount );
+	SPTestAssert( SPStringTableGetMemorySize(table) == size );
+
+	SPStringTableRelease(table);
+}
+
+static void SPTestStringTableChurnWhileGrowing(void) {
+
+	// Strings churned while others are added keep their values and their single copies
+	// until a rehash drops their tombstones
+
+	SPStringTable *table = SPStringTableCreate(16);
+	SPStringTableImage image;
+	char string[64];
+	size_t length;
+	int i, j;
+
+	for ( i = 0; i < 2000; i++ ) {
+		length = (size_t)snprintf(string, sizeof(string), "doc://added/%d", i);
+		SPStringTableSetValue(table, string, length, i, NULL);
+
+		for ( j = 0; j < 8; j++ ) {
+			length = (size_t)snprintf(string, sizeof(string), "doc://churned/%d", j);
+			SPStringTableRemoveValue(table, string, length);
+			SPStringTableSetValue(table, string, length, 10000 + j, NULL);
+		}
+	}
+
+	SPTestAssert( SPStringTableGetCount(table) == 2008 );
+
+	for ( i = 0; i < 2000; i++ ) {
+		length = (size_t)snprintf(string, sizeof(string), "doc://added/%d", i);
+		SPTestAssert( SPStringTableGetValue(table, string, length) == i );
+	}
+
+	// Removed strings are only ever in the arena once each
+
+	SPStringTableGetImage(table, &image);
+	SPTestAssert( image.arenaLength < 2 * ( 2000 * strlen("doc://added/0000") + 8 * strlen("doc://churned/0") ) );
+
+	SPStringTableRelease(table);
+}
+
+static void SPTestStringTableImageChurn(void) {
+
+	// A table read from an image copies it on the first change and then churns in place
+
+	SPStringTable *table = SPStringTableCreate(16), *copy;
+	SPStringTableImage image;
+	size_t length = strlen(kSPTestURI), size;
+	int i;
+
+	SPStringTableSetValue(table, kSPTestURI, length, 1, NULL);
+	SPStringTableRemoveValue(table, kSPTestURI, length);
+	SPStringTableGetImage(table, &image);
+
+	copy = SPStringTableCreateWithImage(&image);
+	SPStringTableSetValue(copy, kSPTestURI, length, 2, NULL);
+	size = SPStringTableGetMemorySize(copy);
+
+	for ( i = 0; i < kSPTestChurnCount; i++ ) {
+		SPStringTableRemoveValue(copy, kSPTestURI, length);
+		SPStringTableSetValue(copy, kSPTestURI, length, i, NULL);
+	}
+
+	SPTestAssert( SPStringTableGetCount(copy) == 1 );
+	SPTestAssert( SPStringTableGetMemorySize(copy) == size );
+
+	SPStringTableRelease(copy);
+	SPStringTableRelease(table);
+}
+
+static void SPTestDocumentTableChurn(void) {
+
+	// The SearchKit backend gives a re-added document a new ID each time
+
+	SPDocumentTable *table = SPDocumentTableCreate(16);
+	size_t length = strlen(kSPTestURI), size;
+	char buffer[128];
+	int i;
+
+	SPDocumentTableSetDocument(table, kSPTestURI, length, 0);
+	SPDocumentTableRemoveDocument(table, 0);
+	SPDocumentTableSetDocument(table, kSPTestURI, length, 1);
+	size = SPDocumentTableGetMemorySize(table);
+
+	for ( i = 2; i < 1000; i++ ) {
+		SPDocumentTableRemoveDocument(table, i - 1);
+		SPDocumentTableSetDocument(table, kSPTestURI, length, i);
+	}
+
+	// The locations grow with the IDs, so churn the same ID from here on
+
+	size = SPDocumentTableGetMemorySize(table);
+
+	for ( i = 0; i < kSPTestChurnCount; i++ ) {
+		SPDocumentTableRemoveDocument(table, 999);
+		SPDocumentTableSetDocument(table, kSPTestURI, length, 999);
+	}
+
+	SPTestAssert( SPDocumentTableGetCount(table) == 1 );
+	SPTestAssert( SPDocumentTableGetDocument(table, kSPTestURI, length) == 999 );
+	SPTestAssert( SPDocumentTableGetURI(table, 999, buffer, sizeof(buffer)) == length );
+	SPTestAssert( memcmp(buffer, kSPTestURI, length) == 0 );
+	SPTestAssert( SPDocumentTableGetMemorySize(table) == size );
+
+	SPDocumentTableRelease(table);
+}
+
+static void SPTestIndexChurn(void) {
+
+	// Removing and adding a document again, and setting and clearing its data, leave the
+	// index's URI and data tables as they were after the first round
+
+	SPIndexOptions options;
+	SPIndexRef index;
+	size_t documentTableSize, dataTableSize;
+	void *bytes = NULL;
+	int i;
+
+	memset(&options, 0, sizeof(SPIndexOptions));
+	options.minTermLength = 1;
+	options.refreshInterval = 3600;
+
+	index = SPIndexCreate(&options);
+
+	SPIndexAddDocument(index, kSPTestURI, "churned text", 12);
+	SPIndexSetDocumentData(index, kSPTestURI, "data", 4);
+	SPIndexRemoveDocument(index, kSPTestURI);
+	SPIndexAddDocument(index, kSPTestURI, "churned text", 12);
+	SPIndexSetDocumentData(index, kSPTestURI, "data", 4);
+	SPIndexRefresh(index);
+
+	documentTableSize = SPStringTableGetMemorySize(index->documentTable);
+	dataTableSize = SPStringTableGetMemorySize(index->dataTable);
+
+	for ( i = 0; i < kSPTestIndexChurnCount; i++ ) {
+		SPIndexRemoveDocument(index, kSPTestURI);
+		SPIndexAddDocument(index, kSPTestURI, "churned text", 12);
+		if ( i % 1000 == 0 ) SPIndexRefresh(index);
+	}
+
+	for ( i = 0; i < kSPTestChurnCount; i++ ) {
+		SPIndexSetDocumentData(index, kSPTestURI, NULL, 0);
+		SPIndexSetDocumentData(index, kSPTestURI, "data", 4);
+	}
+
+	SPIndexRefresh(index);
+
+	SPTestAssert( SPIndexGetDocumentCount(index) == 1 );
+	SPTestAssert( SPIndexCopyDocumentData(index, kSPTestURI, &bytes) == 4 );
+	SPTestAssert( SPStringTableGetMemorySize(index->documentTable) == documentTableSize );
+	SPTestAssert( SPStringTableGetMemorySize(index->dataTable) == dataTableSize );
+
+	free(bytes);
+	SPIndexRelease(index);
+}
+
+int main(int argc, char *argv[]) {
+
+	SPTestStringTableChurn();
+	SPTestStringTableChurnWhileGrowing();
+	SPTestStringTableImageChurn();
+	SPTestDocumentTableChurn();
+	SPTestIndexChurn();
+
+	printf("SPStringTableTests: %s\n", ( SPTestFailures == 0 ? "passed" : "FAILED" ));
+	return ( SPTestFailures == 0 ? 0 : 1 );
+}
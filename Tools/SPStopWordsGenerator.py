@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+#
+#  SPStopWordsGenerator.py
+#  SPSearchStore
+#
+#  Writes the stop word tables in SPStopWords.c. The words of every language are hashed
+#  into one perfect hash table, so that a term is checked against all of the languages
+#  with a single probe and a single comparison. Run it from the repository root after
+#  changing a list:
+#
+#      python3 Tools/SPStopWordsGenerator.py > /tmp/tables && <paste into SPStopWords.c>
+#
+#  or with --update to rewrite the generated section of SPStopWords.c in place.
+#
+
+import sys
+import unicodedata
+
+# The order of the languages gives their bits, and must match kSPLanguage... in SPStopWords.h.
+#
+# Other possible English stop words:
+# about against under with away also across ago been before after above below
+# around vs up down while
+
+LANGUAGES = [
+	( "en", "a all am an and any are as at be but by can could did do does etc for from goes got had has have he her hers him his how if in is it its let me more much must my no nor not now of off on or our own see set shall she should so some than that the them then there these they this those though to too us was way we what when where which who why will would yes yet you your yours" ),
+	( "de", "aber alle allem allen aller alles als also am an andere anderen anderer anderes auch auf aus bei bin bis bist da damit dann das dass dasselbe dazu dein deine dem den denn der des dessen die dies diese dieser dieses doch dort du durch ein eine einem einen einer eines er es etwas euch euer für gegen gewesen hab habe haben hat hatte hier hin hinter ich ihm ihn ihnen ihr ihre im in indem ins ist jede jedem jeden jeder jedes jetzt kann kein keine können man manche mein meine mich mir mit muss nach nicht nichts noch nun nur ob oder ohne sehr sein seine sich sie sind so solche soll sondern sonst über um und uns unser unter viel vom von vor während war waren was weil weiter welche wenn wer werde werden wie wieder will wir wird wo wollen zu zum zur zwar zwischen" ),
+	( "fr", "à ai as au aussi aux avec avez avoir avons c car ce cela ces cet cette ceux d dans de des donc du elle elles en est et été être eux il ils j je l la le les leur leurs lui m ma mais me même mes moi moins mon n ne ni nos notre nous on ont ou où par pas plus pour qu que qui s sa se ses si son sont sur t ta te tes toi ton tous tout très tu un une vos votre vous y" ),
+	( "es", "a al algo algunas algunos ante antes como con contra cual cuando de del desde donde durante e el él ella ellas ellos en entre era eres es esa esas ese eso esos esta estaba estar este esto estos fue fueron ha han hasta hay la las le les lo los más me mi mis mucho muy nada ni no nos nosotros o os otra otro para pero poco por porque que qué quien se ser si sí sin sobre son su sus también te tiene tu tus un una uno unos y ya yo" ),
+	( "it", "a ad al alla alle allo anche che chi ci come con contro cui da dal dalla dalle degli dei del della delle dello di dove e è ed gli ha hanno i il in io la le lei lo loro lui ma mi mia mio ne negli nei nel nella nelle noi non nostro o per perché più quale quando quella quelle quello questa queste questo se sei si sia siamo sono su sua sue suo sul sulla tra tu tutti tutto un una uno vi voi" ),
+	( "pt", "a ao aos as até com como da das de dela dele do dos e é ela elas ele eles em entre era essa esse esta este eu foi for há isso isto já lhe mais mas me meu minha muito na nas não nem no nos nós o os ou para pela pelo por qual quando que quem se sem ser seu sua são também te tem um uma você" ),
+	( "nl", "aan al alles als altijd andere ben bij daar dan dat de der deze die dit doch doen door dus een eens en er ge geen geweest haar had heb hebben heeft hem het hier hij hoe hun iets ik in is ja je kan kon kunnen maar me meer men met mij mijn moet na naar niet niets nog nu of om omdat onder ons ook op over reeds te tegen toch toen tot u uit uw van veel voor want waren was wat we wel werd wezen wie wil worden zal ze zelf zich zij zijn zo zonder zou" ),
+	( "sv", "alla allt att av blev bli blir de dem den denna deras dess det detta dig din dina du där efter ej eller en ett från för ha hade han hans har henne hennes hon honom hur här i icke inte jag ju kan man med mellan men mig min mina mitt mot mycket ni nu när någon något och om oss på samma sedan sig sin sina själv skulle som så till under upp ut utan vad var vara varit vi vid vilka vilken åt än är över" ),
+]
+
+BUCKET_LOAD = 4
+
+def fnv1a(data):
+	h = 2166136261
+	for b in data:
+		h ^= b
+		h = ( h * 16777619 ) & 0xFFFFFFFF
+	return h
+
+def mix(h):
+	h ^= h >> 16
+	h = ( h * 0x85EBCA6B ) & 0xFFFFFFFF
+	h ^= h >> 13
+	h = ( h * 0xC2B2AE35 ) & 0xFFFFFFFF
+	h ^= h >> 16
+	return h
+
+def slot_for(h, displacement, mask):
+	return mix(h ^ ( ( displacement * 0x9E3779B9 ) & 0xFFFFFFFF )) & mask
+
+def fold(word):
+	# the native backend folds diacritics before indexing, so both spellings are listed
+	return "".join(c for c in unicodedata.normalize("NFD", word) if not unicodedata.combining(c))
+
+def collect():
+	words = {}
+	for bit, ( code, text ) in enumerate(LANGUAGES):
+		for word in text.split():
+			for form in { word, fold(word) }:
+				words[form.encode("utf-8")] = words.get(form.encode("utf-8"), 0) | ( 1 << bit )
+	return words
+
+def build(words):
+	slotCount = 1
+	while slotCount < len(words) * 5 // 4: slotCount *= 2
+	bucketCount = ( len(words) + BUCKET_LOAD - 1 ) // BUCKET_LOAD
+	mask = slotCount - 1
+
+	buckets = [ [] for _ in range(bucketCount) ]
+	for word in words:
+		buckets[fnv1a(word) % bucketCount].append(word)
+
+	slots = [ None ] * slotCount
+	displacements = [ 0 ] * bucketCount
+
+	for index in sorted(range(bucketCount), key=lambda i: -len(buckets[i])):
+		bucket = buckets[index]
+		if not bucket: continue
+		for displacement in range(1 << 16):
+			chosen = { slot_for(fnv1a(word), displacement, mask) for word in bucket }
+			if len(chosen) == len(bucket) and all(slots[s] is None for s in chosen):
+				for word in bucket: slots[slot_for(fnv1a(word), displacement, mask)] = word
+				displacements[index] = displacement
+				break
+		else:
+			sys.exit("no displacement found, raise the slot count")
+
+	return slotCount, bucketCount, slots, displacements
+
+def emit(words):
+	slotCount, bucketCount, slots, displacements = build(words)
+	out = []
+	pool = b""
+	offsets = {}
+	for word in sorted(words):
+		offsets[word] = len(pool)
+		pool += word
+
+	out.append("// Generated by Tools/SPStopWordsGenerator.py from %d words, do not edit by hand." % len(words))
+	out.append("")
+	out.append("#define kSPStopWordSlotCount\t\t%d" % slotCount)
+	out.append("#define kSPStopWordBucketCount\t\t%d" % bucketCount)
+	out.append("#define kSPStopWordMaximumLength\t%d" % max(len(w) for w in words))
+	out.append("")
+	out.append("static const char SPStopWordStrings[] =")
+	line = ""
+	for word in sorted(words):
+		literal = "".join(chr(b) if 0x20 <= b < 0x7F and b not in ( 0x22, 0x5C ) else "\\%03o" % b for b in word)
+		if len(line) + len(literal) > 96:
+			out.append("\t\"%s\"" % line)
+			line = ""
+		line += literal
+	out.append("\t\"%s\";" % line)
+	out.append("")
+	out.append("static const SPStopWordSlot SPStopWordSlots[kSPStopWordSlotCount] = {")
+	row = []
+	for word in slots:
+		row.append("{ 0, 0, 0 }" if word is None else "{ %d, %d, 0x%02X }" % ( offsets[word], len(word), words[word] ))
+		if len(row) == 4:
+			out.append("\t" + ", ".join(row) + ",")
+			row = []
+	if row: out.append("\t" + ", ".join(row) + ",")
+	out.append("};")
+	out.append("")
+	out.append("static const uint16_t SPStopWordDisplacements[kSPStopWordBucketCount] = {")
+	for i in range(0, bucketCount, 16):
+		out.append("\t" + ", ".join(str(d) for d in displacements[i:i+16]) + ",")
+	out.append("};")
+	return "\n".join(out) + "\n"
+
+BEGIN = "#pragma mark Generated Tables\n"
+END = "#pragma mark -\n"
+
+if __name__ == "__main__":
+	tables = emit(collect())
+	if len(sys.argv) > 1 and sys.argv[1] == "--update":
+		with open("SPStopWords.c") as f: source = f.read()
+		start = source.index(BEGIN) + len(BEGIN)
+		end = source.index(END, start)
+		with open("SPStopWords.c", "w") as f: f.write(source[:start] + "\n" + tables + "\n" + source[end:])
+	else:
+		sys.stdout.write(tables)